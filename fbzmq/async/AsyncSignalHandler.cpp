@@ -20,6 +20,9 @@
 
 #include <unistd.h>
 
+#include <array>
+#include <cerrno>
+
 #include <folly/Format.h>
 
 namespace fbzmq {
@@ -36,7 +39,7 @@ AsyncSignalHandler::AsyncSignalHandler(ZmqEventLoop* evl) : evl_(evl) {
   if ((signalFd_ = signalfd(
            -1 /* create a new fd */,
            &registeredSignals_,
-           SFD_CLOEXEC /* flags */)) < 0) {
+           SFD_NONBLOCK | SFD_CLOEXEC /* flags */)) < 0) {
     PLOG(FATAL) << "AsyncSignalHandler: Failed to create a signalfd.";
   }
 #else
@@ -48,23 +51,7 @@ AsyncSignalHandler::AsyncSignalHandler(ZmqEventLoop* evl) : evl_(evl) {
   // Attach callback on signal fd
   evl_->addSocketFd(signalFd_, ZMQ_POLLIN, [this](int revents) noexcept {
     CHECK(revents & ZMQ_POLLIN);
-    int sig;
-    // Receive signal
-#ifndef IS_BSD
-    struct signalfd_siginfo fdsi;
-    auto bytesRead = read(signalFd_, &fdsi, sizeof(fdsi));
-    CHECK_EQ(sizeof(fdsi), bytesRead);
-    sig = static_cast<int>(fdsi.ssi_signo);
-#else
-    struct kevent kInEv;
-    int r = kevent(signalFd_, NULL, 0, &kInEv, 1, NULL);
-    if (r < 0 || kInEv.filter != EVFILT_SIGNAL) {
-      PLOG(FATAL) << "AsyncSignalHandler: Failed to read signalfd.";
-    }
-    sig = static_cast<int>(kInEv.ident);
-#endif
-    VLOG(1) << "AsyncSignalHandler: Received signal " << sig;
-    signalReceived(sig);
+    processSignals();
   });
 }
 
@@ -109,7 +96,7 @@ AsyncSignalHandler::setupSignal(int sig, bool isAdding) {
   if ((signalFd_ = signalfd(
            signalFd_ /* update fd */,
            &registeredSignals_,
-           SFD_CLOEXEC /* flags */)) < 0) {
+           SFD_NONBLOCK | SFD_CLOEXEC /* flags */)) < 0) {
     PLOG(FATAL) << "AsyncSignalHandler: Failed to update signalfd.";
   }
 #else
@@ -130,6 +117,56 @@ AsyncSignalHandler::setupSignal(int sig, bool isAdding) {
 #endif
 }
 
+void
+AsyncSignalHandler::processSignals() noexcept {
+  std::array<int, kMaxSignalsPerRead> sigs;
+  size_t numSigs{0};
+  do {
+    // Receive as many signals as are pending, upto batch size per syscall
+#ifndef IS_BSD
+    std::array<struct signalfd_siginfo, kMaxSignalsPerRead> fdsi;
+    auto bytesRead = read(signalFd_, fdsi.data(), sizeof(fdsi));
+    if (bytesRead < 0) {
+      if (errno == EAGAIN) {
+        break;
+      }
+      PLOG(FATAL) << "AsyncSignalHandler: Failed to read signalfd.";
+    }
+    CHECK_EQ(0, bytesRead % sizeof(struct signalfd_siginfo));
+    numSigs = bytesRead / sizeof(struct signalfd_siginfo);
+    for (size_t i = 0; i < numSigs; ++i) {
+      sigs[i] = static_cast<int>(fdsi[i].ssi_signo);
+    }
+#else
+    std::array<struct kevent, kMaxSignalsPerRead> kInEvs;
+    const struct timespec noWait = {0, 0};
+    int r = kevent(signalFd_, NULL, 0, kInEvs.data(), kInEvs.size(), &noWait);
+    if (r < 0) {
+      PLOG(FATAL) << "AsyncSignalHandler: Failed to read signalfd.";
+    }
+    numSigs = static_cast<size_t>(r);
+    for (size_t i = 0; i < numSigs; ++i) {
+      if (kInEvs[i].filter != EVFILT_SIGNAL) {
+        LOG(FATAL) << "AsyncSignalHandler: Unexpected kqueue event.";
+      }
+      sigs[i] = static_cast<int>(kInEvs[i].ident);
+    }
+#endif
+    if (numSigs == 0) {
+      break;
+    }
+    VLOG(1) << "AsyncSignalHandler: Received " << numSigs << " signal(s)";
+    signalsReceived(folly::Range<const int*>(sigs.data(), numSigs));
+  } while (numSigs == sigs.size());
+}
+
+void
+AsyncSignalHandler::signalsReceived(folly::Range<const int*> sigs) noexcept {
+  for (auto sig : sigs) {
+    signalReceived(sig);
+  }
+}
+
 void
 AsyncSignalHandler::registerSignalHandler(int sig) {
   setupSignal(sig, true);
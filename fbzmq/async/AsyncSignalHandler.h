@@ -9,6 +9,8 @@
 
 #include <csignal>
 
+#include <folly/Range.h>
+
 #include <fbzmq/async/ZmqEventLoop.h>
 
 #ifdef IS_BSD
@@ -83,6 +85,17 @@ class AsyncSignalHandler {
    */
   virtual void signalReceived(int sig) noexcept = 0;
 
+  /**
+   * All signals pending when the loop woke up are drained at once and handed
+   * over in batches, hence a burst of signals costs a single wakeup. Batch is
+   * unordered. Kernel already coalesces pending standard signals, so a batch
+   * has at most one entry per pending standard signal. Default
+   * implementation calls signalReceived() for each of them, override to
+   * handle a batch in one go e.g. reload config only once for SIGHUP and
+   * SIGUSR1 delivered together.
+   */
+  virtual void signalsReceived(folly::Range<const int*> sigs) noexcept;
+
   /**
    * get event loop
    */
@@ -95,6 +108,12 @@ class AsyncSignalHandler {
 
   void setupSignal(int sig, bool isAdding);
 
+  // Drain pending signals from signal fd and deliver them
+  void processSignals() noexcept;
+
+  // Max signals received per syscall (and delivered per batch)
+  static constexpr size_t kMaxSignalsPerRead{16};
+
   // event loop
   ZmqEventLoop* evl_{nullptr};
 
@@ -0,0 +1,319 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/TimerWheel.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Generation is kept within 31 bits so that timer-ids are non-negative
+const uint32_t kGenerationMask{0x7fffffff};
+
+} // namespace
+
+constexpr uint32_t TimerWheel::kSlotBits;
+constexpr uint32_t TimerWheel::kNumSlots;
+constexpr uint32_t TimerWheel::kNumLevels;
+constexpr uint64_t TimerWheel::kMaxTicks;
+constexpr uint32_t TimerWheel::kInvalidIndex;
+
+TimerWheel::TimerWheel(std::chrono::steady_clock::time_point startTime)
+    : startTime_(startTime) {
+  for (auto& level : slots_) {
+    level.fill(kInvalidIndex);
+  }
+}
+
+int64_t
+TimerWheel::schedule(
+    std::chrono::steady_clock::time_point scheduledTime, Callback callback) {
+  const auto index = allocateEntry();
+  auto& entry = entries_[index];
+  entry.callback = std::move(callback);
+  entry.scheduledTime = scheduledTime;
+  entry.seq = nextSeq_++;
+  entry.tick = toTick(scheduledTime);
+  insertEntry(index);
+  ++numPendingTimers_;
+  return makeTimerId(index, entry.generation);
+}
+
+bool
+TimerWheel::cancel(int64_t timerId) {
+  const auto index = findEntry(timerId);
+  if (index == kInvalidIndex) {
+    return false;
+  }
+
+  // Entries in expired list are lazily dropped by their timer-id
+  const bool isExpired = entries_[index].state == EntryState::EXPIRED;
+  if (not isExpired) {
+    unlinkEntry(index);
+  }
+  releaseEntry(index);
+  if (isExpired) {
+    pruneExpired();
+  }
+  return true;
+}
+
+size_t
+TimerWheel::runExpired(std::chrono::steady_clock::time_point now) {
+  return runExpired(
+      now, [](int64_t, std::chrono::steady_clock::time_point, Callback& cb) {
+        cb();
+      });
+}
+
+size_t
+TimerWheel::runExpired(
+    std::chrono::steady_clock::time_point now,
+    Invoker invoker,
+    size_t maxTimers /* = 0 */) {
+  advance(toTick(now));
+
+  // Pop timers which are due, in order, upto the budget. Timers scheduled
+  // from within the callbacks (seq beyond `seqLimit`) are set aside and will
+  // be looked at in next call. Rest of the heap is left untouched.
+  const auto seqLimit = nextSeq_;
+  size_t numInvoked{0};
+  while (not expired_.empty() and
+         (maxTimers == 0 or numInvoked < maxTimers)) {
+    auto const& top = expired_.front();
+    if (top.scheduledTime >= now) {
+      break;
+    }
+    const auto timer = popExpired();
+    if (timer.seq >= seqLimit) {
+      expiredScratch_.push_back(timer);
+      continue;
+    }
+
+    // Timer can be cancelled by one of the previous callbacks
+    const auto index = findEntry(timer.timerId);
+    if (index == kInvalidIndex) {
+      continue;
+    }
+
+    // Callback must be issued after releasing the entry as it can in turn
+    // schedule more timers and re-use (or re-allocate) entries.
+    auto callback = std::move(entries_[index].callback);
+    releaseEntry(index);
+    invoker(timer.timerId, timer.scheduledTime, callback);
+    ++numInvoked;
+  }
+
+  for (auto const& timer : expiredScratch_) {
+    pushExpired(timer);
+  }
+  expiredScratch_.clear();
+  pruneExpired();
+  return numInvoked;
+}
+
+folly::Optional<std::chrono::steady_clock::time_point>
+TimerWheel::getNextExpiry() const {
+  // Timers in expired list are always earlier than the ones in wheel. Top
+  // of the heap is always a pending timer, refer to pruneExpired().
+  if (not expired_.empty()) {
+    return expired_.front().scheduledTime;
+  }
+
+  auto expiration = getNextExpiration();
+  if (not expiration) {
+    return folly::none;
+  }
+  return startTime_ + std::chrono::milliseconds(expiration->deadline);
+}
+
+uint64_t
+TimerWheel::toTick(std::chrono::steady_clock::time_point timePoint) const {
+  if (timePoint <= startTime_) {
+    return 0;
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             timePoint - startTime_)
+      .count();
+}
+
+uint32_t
+TimerWheel::findEntry(int64_t timerId) const {
+  if (timerId < 0) {
+    return kInvalidIndex;
+  }
+  const auto index = static_cast<uint32_t>(timerId);
+  const auto generation = static_cast<uint32_t>(timerId >> 32);
+  if (index >= entries_.size()) {
+    return kInvalidIndex;
+  }
+  auto const& entry = entries_[index];
+  if (entry.state == EntryState::FREE || entry.generation != generation) {
+    return kInvalidIndex;
+  }
+  return index;
+}
+
+uint32_t
+TimerWheel::allocateEntry() {
+  if (not freeEntries_.empty()) {
+    const auto index = freeEntries_.back();
+    freeEntries_.pop_back();
+    return index;
+  }
+  CHECK_GT(kInvalidIndex, entries_.size()) << "Too many pending timers";
+  entries_.emplace_back();
+  return entries_.size() - 1;
+}
+
+void
+TimerWheel::releaseEntry(uint32_t index) {
+  auto& entry = entries_[index];
+  entry.callback = nullptr; // Release memory held by callback
+  entry.state = EntryState::FREE;
+  entry.generation = (entry.generation + 1) & kGenerationMask;
+  freeEntries_.push_back(index);
+  --numPendingTimers_;
+}
+
+void
+TimerWheel::insertEntry(uint32_t index) {
+  auto& entry = entries_[index];
+  if (entry.tick <= elapsed_) {
+    entry.state = EntryState::EXPIRED;
+    pushExpired(ExpiredTimer{
+        entry.scheduledTime, entry.seq, makeTimerId(index, entry.generation)});
+    return;
+  }
+
+  // Find the level at which `elapsed_` and `tick` differ in slots. Timers
+  // beyond range of the wheel are kept at the last level.
+  uint64_t masked = (elapsed_ ^ entry.tick) | (kNumSlots - 1);
+  if (masked >= kMaxTicks) {
+    masked = kMaxTicks - 1;
+  }
+  const uint32_t significant = 63 - __builtin_clzll(masked);
+  const uint32_t level = significant / kSlotBits;
+  const uint32_t slot = (entry.tick >> (level * kSlotBits)) & (kNumSlots - 1);
+
+  entry.state = EntryState::WHEEL;
+  entry.level = level;
+  entry.slot = slot;
+  entry.prev = kInvalidIndex;
+  entry.next = slots_[level][slot];
+  if (entry.next != kInvalidIndex) {
+    entries_[entry.next].prev = index;
+  }
+  slots_[level][slot] = index;
+  occupied_[level] |= (1ULL << slot);
+}
+
+void
+TimerWheel::pushExpired(ExpiredTimer const& timer) {
+  expired_.push_back(timer);
+  std::push_heap(expired_.begin(), expired_.end(), ExpiredTimerLater());
+}
+
+TimerWheel::ExpiredTimer
+TimerWheel::popExpired() {
+  std::pop_heap(expired_.begin(), expired_.end(), ExpiredTimerLater());
+  const auto timer = expired_.back();
+  expired_.pop_back();
+  return timer;
+}
+
+void
+TimerWheel::pruneExpired() {
+  while (not expired_.empty() and
+         findEntry(expired_.front().timerId) == kInvalidIndex) {
+    popExpired();
+  }
+}
+
+void
+TimerWheel::unlinkEntry(uint32_t index) {
+  auto& entry = entries_[index];
+  if (entry.prev != kInvalidIndex) {
+    entries_[entry.prev].next = entry.next;
+  } else {
+    slots_[entry.level][entry.slot] = entry.next;
+    if (entry.next == kInvalidIndex) {
+      occupied_[entry.level] &= ~(1ULL << entry.slot);
+    }
+  }
+  if (entry.next != kInvalidIndex) {
+    entries_[entry.next].prev = entry.prev;
+  }
+  entry.prev = kInvalidIndex;
+  entry.next = kInvalidIndex;
+}
+
+void
+TimerWheel::advance(uint64_t tick) {
+  while (true) {
+    auto expiration = getNextExpiration();
+    if (not expiration || expiration->deadline > tick) {
+      break;
+    }
+    processExpiration(*expiration);
+  }
+  elapsed_ = std::max(elapsed_, tick);
+}
+
+folly::Optional<TimerWheel::Expiration>
+TimerWheel::getNextExpiration() const {
+  // Entries at lower levels always expire before any entry of higher levels
+  for (uint32_t level = 0; level < kNumLevels; ++level) {
+    const uint64_t occupied = occupied_[level];
+    if (occupied == 0) {
+      continue;
+    }
+
+    // Find next occupied slot starting from current one (with wrap around)
+    const uint64_t slotRange = 1ULL << (level * kSlotBits);
+    const uint64_t levelRange = slotRange << kSlotBits;
+    const uint32_t nowSlot = (elapsed_ / slotRange) & (kNumSlots - 1);
+    const uint64_t rotated = nowSlot == 0
+        ? occupied
+        : (occupied >> nowSlot) | (occupied << (kNumSlots - nowSlot));
+    const uint32_t slot = (__builtin_ctzll(rotated) + nowSlot) % kNumSlots;
+
+    Expiration expiration;
+    expiration.level = level;
+    expiration.slot = slot;
+    expiration.deadline = (elapsed_ & ~(levelRange - 1)) + slot * slotRange;
+    if (expiration.deadline <= elapsed_ && level > 0) {
+      // Slot belongs to next rotation of this level
+      expiration.deadline += levelRange;
+    }
+    return expiration;
+  }
+  return folly::none;
+}
+
+void
+TimerWheel::processExpiration(Expiration const& expiration) {
+  // Detach all entries of the slot
+  auto index = slots_[expiration.level][expiration.slot];
+  slots_[expiration.level][expiration.slot] = kInvalidIndex;
+  occupied_[expiration.level] &= ~(1ULL << expiration.slot);
+
+  // Re-insert entries relative to the new elapsed time. They will either
+  // cascade into lower levels or move into expired list.
+  elapsed_ = std::max(elapsed_, expiration.deadline);
+  while (index != kInvalidIndex) {
+    const auto next = entries_[index].next;
+    insertEntry(index);
+    index = next;
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+
+namespace fbzmq {
+
+/**
+ * Hashed hierarchical timer wheel used by ZmqEventLoop to maintain timeouts.
+ *
+ * Time is divided into ticks of 1ms. The wheel has `kNumLevels` levels of
+ * `kNumSlots` slots each. A slot at level `L` covers `kNumSlots^L` ticks.
+ * Timers are placed in the lowest level whose range covers their expiry and
+ * are cascaded down to lower levels as time advances. Timers expiring beyond
+ * the range of the wheel (~2 years) are kept in the last level and re-sorted
+ * on every rotation.
+ *
+ * - schedule/cancel are O(1). Cancelled timers release their callbacks
+ *   immediately.
+ * - Timer entries are pooled and re-used, so that steady state scheduling
+ *   doesn't incur any allocation (apart from the one by callback itself).
+ * - Timers are invoked in order of their scheduled time. Timers with equal
+ *   scheduled time are invoked in the order they were scheduled.
+ * - Expired timers are kept in a min-heap, so that running `B` of them
+ *   costs O(B log N) regardless of how many more are backlogged.
+ *
+ * This is not thread safe.
+ */
+class TimerWheel {
+ public:
+  using Callback = folly::Function<void(void)>;
+
+  explicit TimerWheel(
+      std::chrono::steady_clock::time_point startTime =
+          std::chrono::steady_clock::now());
+
+  /**
+   * non-copyable and non-movable
+   */
+  TimerWheel(TimerWheel const&) = delete;
+  TimerWheel& operator=(TimerWheel const&) = delete;
+
+  /**
+   * Schedule a callback to be invoked once specified time has elapsed.
+   *
+   * @returns: A unique (non-negative) id of the timer which can be used to
+   *           cancel it.
+   */
+  int64_t schedule(
+      std::chrono::steady_clock::time_point scheduledTime, Callback callback);
+
+  /**
+   * Cancel a pending timer and release its callback.
+   *
+   * @returns: true if timer was pending else false
+   */
+  bool cancel(int64_t timerId);
+
+  /**
+   * Invoke callbacks of all the pending timers scheduled strictly before
+   * `now`. Timers scheduled from within those callbacks are not invoked as
+   * part of the same call.
+   *
+   * @returns: Number of callbacks invoked
+   */
+  size_t runExpired(std::chrono::steady_clock::time_point now);
+
+  /**
+   * Same as above but expired timers are handed over to `invoker` along with
+   * their id and scheduled time, which must invoke the callback. Allows
+   * callers to measure timer lateness and duration of callbacks.
+   *
+   * At most `maxTimers` (if non-zero) callbacks are invoked. Rest of the
+   * expired timers stay pending, in order, for the next call.
+   */
+  using Invoker = folly::FunctionRef<void(
+      int64_t timerId,
+      std::chrono::steady_clock::time_point scheduledTime,
+      Callback& callback)>;
+  size_t runExpired(
+      std::chrono::steady_clock::time_point now,
+      Invoker invoker,
+      size_t maxTimers = 0);
+
+  /**
+   * Returns time point at which next timer will expire (or will move to an
+   * expiry list from higher level), if any. O(1) for expired timers, which
+   * are read off the top of the heap.
+   */
+  folly::Optional<std::chrono::steady_clock::time_point> getNextExpiry() const;
+
+  /**
+   * Returns number of pending timers
+   */
+  size_t
+  size() const {
+    return numPendingTimers_;
+  }
+
+  bool
+  empty() const {
+    return numPendingTimers_ == 0;
+  }
+
+  // Number of bits per level and derived wheel geometry
+  static constexpr uint32_t kSlotBits{6};
+  static constexpr uint32_t kNumSlots{1 << kSlotBits};
+  static constexpr uint32_t kNumLevels{6};
+  static constexpr uint64_t kMaxTicks{1ULL << (kSlotBits * kNumLevels)};
+
+ private:
+  static constexpr uint32_t kInvalidIndex{UINT32_MAX};
+
+  enum class EntryState : uint8_t {
+    FREE = 0, // in free list
+    WHEEL = 1, // in one of the slots of wheel
+    EXPIRED = 2, // in expired list, waiting for scheduled time to elapse
+  };
+
+  // Timer entry. Entries are linked in their slot by indices.
+  struct Entry {
+    Callback callback{nullptr};
+    std::chrono::steady_clock::time_point scheduledTime;
+    // Insertion sequence for ordering of timers with same scheduledTime
+    uint64_t seq{0};
+    // Tick at which timer expires
+    uint64_t tick{0};
+    // Incremented on every re-use of entry. Part of timer-id.
+    uint32_t generation{0};
+    uint32_t prev{kInvalidIndex};
+    uint32_t next{kInvalidIndex};
+    uint8_t level{0};
+    uint8_t slot{0};
+    EntryState state{EntryState::FREE};
+  };
+
+  // Slot which will expire next
+  struct Expiration {
+    uint32_t level{0};
+    uint32_t slot{0};
+    uint64_t deadline{0};
+  };
+
+  uint64_t toTick(std::chrono::steady_clock::time_point timePoint) const;
+
+  static int64_t
+  makeTimerId(uint32_t index, uint32_t generation) {
+    return (static_cast<int64_t>(generation) << 32) | index;
+  }
+
+  // Returns entry index of a valid pending timer else kInvalidIndex
+  uint32_t findEntry(int64_t timerId) const;
+
+  uint32_t allocateEntry();
+  void releaseEntry(uint32_t index);
+
+  // Add entry to the wheel or expired list based on its tick
+  void insertEntry(uint32_t index);
+  void unlinkEntry(uint32_t index);
+
+  // Advance wheel to specified tick and move due timers to expired list
+  void advance(uint64_t tick);
+  folly::Optional<Expiration> getNextExpiration() const;
+  void processExpiration(Expiration const& expiration);
+
+  // Reference time point for tick 0
+  const std::chrono::steady_clock::time_point startTime_;
+
+  // Ticks processed so far
+  uint64_t elapsed_{0};
+
+  // Pool of entries along with list of free ones
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> freeEntries_;
+
+  // Head of linked list of entries in every slot, and bitmap of non-empty
+  // slots for every level
+  std::array<std::array<uint32_t, kNumSlots>, kNumLevels> slots_;
+  std::array<uint64_t, kNumLevels> occupied_{};
+
+  // Timer whose tick has elapsed. Ordering key is copied so that heap stays
+  // valid while entries of cancelled timers are re-used.
+  struct ExpiredTimer {
+    std::chrono::steady_clock::time_point scheduledTime;
+    uint64_t seq{0};
+    int64_t timerId{0};
+  };
+
+  // Comparator for min-heap by (scheduledTime, seq)
+  struct ExpiredTimerLater {
+    bool
+    operator()(ExpiredTimer const& lhs, ExpiredTimer const& rhs) const {
+      if (lhs.scheduledTime != rhs.scheduledTime) {
+        return lhs.scheduledTime > rhs.scheduledTime;
+      }
+      return lhs.seq > rhs.seq;
+    }
+  };
+
+  void pushExpired(ExpiredTimer const& timer);
+  ExpiredTimer popExpired();
+
+  // Pop cancelled timers off the top of `expired_`, so that top is always a
+  // pending timer
+  void pruneExpired();
+
+  // Min-heap of timers whose tick has elapsed. Timers here are invoked once
+  // their exact scheduled time has passed. Cancelled timers are dropped
+  // lazily as they reach the top.
+  std::vector<ExpiredTimer> expired_;
+  // Timers scheduled by callbacks of ongoing runExpired() call
+  std::vector<ExpiredTimer> expiredScratch_;
+
+  // Sequence number of next scheduled timer
+  uint64_t nextSeq_{0};
+
+  size_t numPendingTimers_{0};
+};
+
+} // namespace fbzmq
@@ -0,0 +1,133 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <folly/Function.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+
+namespace fbzmq {
+
+/**
+ * Collects items and flushes them as one batch once `maxBatchSize` items have
+ * been added or `maxDelay` has elapsed since the first item of the batch,
+ * whichever comes first.
+ *
+ * For e.g. to publish many small updates as a single multipart message
+ *
+ *  ZmqBatcher<Message> batcher(
+ *      evl, 10ms, 64, [this](std::vector<Message>& batch) noexcept {
+ *        pubSock_.sendBatch(std::move(batch));
+ *      });
+ *
+ *  batcher.add(std::move(msg));
+ *
+ * Flush callback gets the batch by reference and may move items out of it.
+ * Batch is cleared after callback returns and its storage is reused for
+ * subsequent batches, hence steady state batching doesn't allocate. Items can
+ * be added (and flushed) from within the flush callback.
+ *
+ * Items not yet flushed are dropped on destruction, use `flush()` to avoid it.
+ * Not thread safe, must be used from within the event loop.
+ */
+template <typename T>
+class ZmqBatcher final : private ZmqTimeout {
+ public:
+  using FlushCallback = folly::Function<void(std::vector<T>& batch) noexcept>;
+
+  ZmqBatcher(
+      folly::ScheduledExecutor* evl,
+      std::chrono::milliseconds maxDelay,
+      size_t maxBatchSize,
+      FlushCallback callback)
+      : ZmqTimeout(evl),
+        maxDelay_(maxDelay),
+        maxBatchSize_(maxBatchSize),
+        callback_(std::move(callback)) {
+    CHECK(callback_);
+    CHECK_LT(0, maxBatchSize_);
+    batch_.reserve(maxBatchSize_);
+  }
+
+  ~ZmqBatcher() override = default;
+
+  /**
+   * Add an item to current batch. Batch is flushed right away if it is full
+   * or if `maxDelay` is zero.
+   */
+  template <typename... Args>
+  void
+  add(Args&&... args) {
+    batch_.emplace_back(std::forward<Args>(args)...);
+    if (batch_.size() >= maxBatchSize_ or
+        maxDelay_ <= std::chrono::milliseconds(0)) {
+      flush();
+      return;
+    }
+    if (batch_.size() == 1) {
+      scheduleTimeout(maxDelay_);
+    }
+  }
+
+  /**
+   * Flush current batch (if non-empty) right away
+   */
+  void
+  flush() {
+    cancelTimeout();
+    if (batch_.empty()) {
+      return;
+    }
+
+    // Callback can add items into `batch_` while we are flushing
+    std::vector<T> batch;
+    batch.swap(batch_);
+    callback_(batch);
+    batch.clear();
+
+    // Retain storage for next batch
+    if (batch_.empty() and batch_.capacity() < batch.capacity()) {
+      batch_.swap(batch);
+    }
+  }
+
+  /**
+   * Number of items in current batch
+   */
+  size_t
+  size() const {
+    return batch_.size();
+  }
+
+  bool
+  empty() const {
+    return batch_.empty();
+  }
+
+ private:
+  /**
+   * Overrides ZmqTimeout's timeout callback
+   */
+  void
+  timeoutExpired() noexcept override {
+    flush();
+  }
+
+  const std::chrono::milliseconds maxDelay_{0};
+  const size_t maxBatchSize_{0};
+  FlushCallback callback_{nullptr};
+
+  // Current batch
+  std::vector<T> batch_;
+};
+
+} // namespace fbzmq
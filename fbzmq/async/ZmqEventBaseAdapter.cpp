@@ -0,0 +1,347 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqEventBaseAdapter.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <folly/Format.h>
+#include <folly/io/async/EventHandler.h>
+
+#include <fbzmq/zmq/Socket.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Callbacks of a busy socket per check, before it yields to rest of the
+// EventBase
+const size_t kMaxCallbacksPerCheck{64};
+
+int
+getZmqEvents(void* socketPtr) {
+  int zmqEvents{0};
+  size_t zmqEventsLen = sizeof(zmqEvents);
+  if (zmq_getsockopt(socketPtr, ZMQ_EVENTS, &zmqEvents, &zmqEventsLen) != 0) {
+    LOG(ERROR) << "ZmqEventBaseAdapter: Failed to get ZMQ_EVENTS of socket. "
+               << zmq_strerror(zmq_errno());
+    return 0;
+  }
+  return zmqEvents;
+}
+
+} // namespace
+
+struct ZmqEventBaseAdapter::Subscription
+    : public folly::EventHandler,
+      public std::enable_shared_from_this<Subscription> {
+  Subscription(
+      ZmqEventBaseAdapter& adapter,
+      void* socketPtr,
+      int fd,
+      int events,
+      SocketCallback callback)
+      : folly::EventHandler(
+            adapter.evb_, folly::NetworkSocket::fromFd(fd)),
+        adapter(adapter),
+        socketPtr(socketPtr),
+        events(events),
+        callback(std::move(callback)) {}
+
+  void
+  handlerReady(uint16_t readyEvents) noexcept override {
+    if (socketPtr) {
+      adapter.dispatchSocket(*this);
+    } else {
+      adapter.dispatchFd(*this, readyEvents);
+    }
+  }
+
+  ZmqEventBaseAdapter& adapter;
+  // Raw zmq socket, nullptr for fds
+  void* const socketPtr{nullptr};
+  const int events{0};
+  SocketCallback callback;
+
+  bool isRegistered{true};
+  bool isCheckScheduled{false};
+};
+
+ZmqEventBaseAdapter::ZmqEventBaseAdapter(folly::EventBase* evb)
+    : evb_(evb),
+      timerWheelTimeout_(evb, *this),
+      isAlive_(std::make_shared<bool>(true)) {
+  CHECK(evb_);
+}
+
+ZmqEventBaseAdapter::~ZmqEventBaseAdapter() {
+  CHECK(isInEventLoop());
+  *isAlive_ = false;
+  for (auto& kv : socketMap_) {
+    kv.second->isRegistered = false;
+    kv.second->unregisterHandler();
+  }
+  for (auto& kv : fdMap_) {
+    kv.second->isRegistered = false;
+    kv.second->unregisterHandler();
+  }
+  timerWheelTimeout_.cancelTimeout();
+}
+
+template <typename Fn>
+void
+ZmqEventBaseAdapter::invokeTracked(Fn&& fn, void* skipSocketPtr) {
+  auto prevSocketActivity = detail::tlsSocketActivity;
+  detail::tlsSocketActivity = &socketActivity_;
+  fn();
+  detail::tlsSocketActivity = prevSocketActivity;
+
+  void* lastSocketPtr{nullptr};
+  for (auto socketPtr : socketActivity_) {
+    // Consecutive I/O on the same socket is very common
+    if (socketPtr == lastSocketPtr or socketPtr == skipSocketPtr) {
+      continue;
+    }
+    lastSocketPtr = socketPtr;
+    auto it = socketMap_.find(reinterpret_cast<uintptr_t>(socketPtr));
+    if (it != socketMap_.end()) {
+      scheduleCheck(it->second);
+    }
+  }
+  socketActivity_.clear();
+}
+
+void
+ZmqEventBaseAdapter::addSocket(
+    RawZmqSocketPtr socketPtr, int events, SocketCallback callback) {
+  CHECK(isInEventLoop());
+  CHECK_NE(0, events) << "Subscription events can't be empty.";
+  if (socketMap_.count(socketPtr)) {
+    throw std::runtime_error("Socket callback already registered.");
+  }
+  auto rawSocketPtr =
+      reinterpret_cast<void*>(static_cast<uintptr_t>(socketPtr));
+  int fd{-1};
+  size_t fdLen = sizeof(fd);
+  if (zmq_getsockopt(rawSocketPtr, ZMQ_FD, &fd, &fdLen) != 0) {
+    throw std::runtime_error(folly::sformat(
+        "Failed to get ZMQ_FD of socket. {}", zmq_strerror(zmq_errno())));
+  }
+
+  auto subscription = std::make_shared<Subscription>(
+      *this, rawSocketPtr, fd, events, std::move(callback));
+  // ZMQ_FD signals readability on any change of ZMQ_EVENTS
+  subscription->registerHandler(
+      folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  // Edge might have been consumed before
+  scheduleCheck(subscription);
+  socketMap_.emplace(socketPtr, std::move(subscription));
+}
+
+void
+ZmqEventBaseAdapter::addSocketFd(
+    int socketFd, int events, SocketCallback callback) {
+  CHECK(isInEventLoop());
+  CHECK_NE(0, events) << "Subscription events can't be empty.";
+  if (fdMap_.count(socketFd)) {
+    throw std::runtime_error("Socket callback already registered.");
+  }
+
+  uint16_t handlerEvents{folly::EventHandler::PERSIST};
+  if (events & ZMQ_POLLIN) {
+    handlerEvents |= folly::EventHandler::READ;
+  }
+  if (events & ZMQ_POLLOUT) {
+    handlerEvents |= folly::EventHandler::WRITE;
+  }
+  auto subscription = std::make_shared<Subscription>(
+      *this, nullptr, socketFd, events, std::move(callback));
+  subscription->registerHandler(handlerEvents);
+  fdMap_.emplace(socketFd, std::move(subscription));
+}
+
+void
+ZmqEventBaseAdapter::removeSocket(RawZmqSocketPtr socketPtr) {
+  CHECK(isInEventLoop());
+  auto it = socketMap_.find(socketPtr);
+  if (it == socketMap_.end()) {
+    return;
+  }
+  it->second->isRegistered = false;
+  it->second->unregisterHandler();
+  socketMap_.erase(it);
+}
+
+void
+ZmqEventBaseAdapter::removeSocketFd(int socketFd) {
+  CHECK(isInEventLoop());
+  auto it = fdMap_.find(socketFd);
+  if (it == fdMap_.end()) {
+    return;
+  }
+  it->second->isRegistered = false;
+  it->second->unregisterHandler();
+  fdMap_.erase(it);
+}
+
+void
+ZmqEventBaseAdapter::recheckSocket(RawZmqSocketPtr socketPtr) {
+  CHECK(isInEventLoop());
+  auto it = socketMap_.find(socketPtr);
+  if (it != socketMap_.end()) {
+    scheduleCheck(it->second);
+  }
+}
+
+void
+ZmqEventBaseAdapter::dispatchSocket(Subscription& subscription) {
+  // Callback may remove subscription
+  auto keepAlive = subscription.shared_from_this();
+  for (size_t i = 0; i < kMaxCallbacksPerCheck; ++i) {
+    if (not subscription.isRegistered) {
+      return;
+    }
+    // Reading ZMQ_EVENTS re-arms the edge of ZMQ_FD
+    const int revents = getZmqEvents(subscription.socketPtr) &
+        subscription.events;
+    if (not revents) {
+      return;
+    }
+    invokeTracked(
+        [&subscription, revents] { subscription.callback(revents); },
+        subscription.socketPtr);
+  }
+
+  // Still busy, continue after others had their turn
+  if (subscription.isRegistered) {
+    scheduleCheck(keepAlive);
+  }
+}
+
+void
+ZmqEventBaseAdapter::dispatchFd(Subscription& subscription, uint16_t events) {
+  auto keepAlive = subscription.shared_from_this();
+  int revents{0};
+  if (events & folly::EventHandler::READ) {
+    revents |= ZMQ_POLLIN;
+  }
+  if (events & folly::EventHandler::WRITE) {
+    revents |= ZMQ_POLLOUT;
+  }
+  invokeTracked([&subscription, revents] { subscription.callback(revents); });
+}
+
+void
+ZmqEventBaseAdapter::scheduleCheck(
+    std::shared_ptr<Subscription> const& subscription) {
+  if (subscription->isCheckScheduled) {
+    return;
+  }
+  subscription->isCheckScheduled = true;
+  evb_->runInLoop([weakSubscription = std::weak_ptr<Subscription>(
+                       subscription)]() noexcept {
+    auto subscription = weakSubscription.lock();
+    if (not subscription or not subscription->isRegistered) {
+      return;
+    }
+    subscription->isCheckScheduled = false;
+    subscription->adapter.dispatchSocket(*subscription);
+  });
+}
+
+int64_t
+ZmqEventBaseAdapter::scheduleTimeout(
+    std::chrono::milliseconds timeout, TimeoutCallback callback) {
+  return scheduleTimeoutAt(
+      std::chrono::steady_clock::now() + timeout, std::move(callback));
+}
+
+int64_t
+ZmqEventBaseAdapter::scheduleTimeoutAt(
+    std::chrono::steady_clock::time_point scheduleTime,
+    TimeoutCallback callback) {
+  CHECK(isInEventLoop());
+  const auto timeoutId =
+      timerWheel_.schedule(scheduleTime, std::move(callback));
+  if (not armedTime_ or scheduleTime < *armedTime_) {
+    armTimer();
+  }
+  return timeoutId;
+}
+
+bool
+ZmqEventBaseAdapter::cancelTimeout(int64_t timeoutId) {
+  CHECK(isInEventLoop());
+  // Timer stays armed, a spurious wakeup is cheaper than re-arming
+  return timerWheel_.cancel(timeoutId);
+}
+
+void
+ZmqEventBaseAdapter::runExpiredTimeouts() {
+  armedTime_.reset();
+  invokeTracked(
+      [this] { timerWheel_.runExpired(std::chrono::steady_clock::now()); });
+  armTimer();
+}
+
+void
+ZmqEventBaseAdapter::armTimer() {
+  const auto nextExpiry = timerWheel_.getNextExpiry();
+  if (not nextExpiry) {
+    timerWheelTimeout_.cancelTimeout();
+    armedTime_.reset();
+    return;
+  }
+
+  // Wheel runs timeouts scheduled strictly before now, hence the extra
+  // millisecond
+  const auto delay = std::max(
+      std::chrono::milliseconds(0),
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          *nextExpiry - std::chrono::steady_clock::now()) +
+          std::chrono::milliseconds(1));
+  timerWheelTimeout_.scheduleTimeout(delay);
+  armedTime_ = *nextExpiry;
+}
+
+void
+ZmqEventBaseAdapter::runInEventLoop(TimeoutCallback callback) {
+  evb_->runInEventBaseThread(
+      [this, isAlive = isAlive_, callback = std::move(callback)]() mutable {
+        if (*isAlive) {
+          invokeTracked([&callback] { callback(); });
+        }
+      });
+}
+
+void
+ZmqEventBaseAdapter::runImmediatelyOrInEventLoop(TimeoutCallback callback) {
+  if (isInEventLoop()) {
+    invokeTracked([&callback] { callback(); });
+    return;
+  }
+  runInEventLoop(std::move(callback));
+}
+
+void
+ZmqEventBaseAdapter::scheduleAt(
+    TimeoutCallback&& callback,
+    std::chrono::steady_clock::time_point const& ts) {
+  if (isInEventLoop()) {
+    scheduleTimeoutAt(ts, std::move(callback));
+    return;
+  }
+  evb_->runInEventBaseThread(
+      [this, isAlive = isAlive_, ts, callback = std::move(callback)]() mutable {
+        if (*isAlive) {
+          scheduleTimeoutAt(ts, std::move(callback));
+        }
+      });
+}
+
+} // namespace fbzmq
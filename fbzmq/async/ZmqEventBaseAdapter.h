@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/executors/ScheduledExecutor.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+
+#include <fbzmq/async/TimerWheel.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace fbzmq {
+
+/**
+ * Registration API of ZmqEventLoop (sockets/fds, timeouts and callbacks from
+ * other threads) on top of an existing folly::EventBase. Lets services built
+ * on EventBase (e.g. thrift) and fbzmq share a single thread, instead of
+ * running a ZmqEventLoop thread next to it and hopping between the two.
+ *
+ * - Sockets are watched through their ZMQ_FD, just like fbzmq::Socket does
+ *   for fibers. ZMQ_FD is edge-triggered, hence socket is re-checked (at the
+ *   end of EventBase iteration) after its callback if events are still
+ *   pending, and after I/O performed on it from within any of the callbacks
+ *   of adapter.
+ * - Timeouts are kept in a TimerWheel, behind a single AsyncTimeout armed
+ *   for the earliest of them. Same ordering guarantees as ZmqEventLoop.
+ * - It is a ScheduledExecutor, hence works with ZmqTimeout, futures and
+ *   coroutines.
+ *
+ * NOTE: I/O performed on a registered socket outside of adapter callbacks
+ * (e.g. directly from an EventBase callback) can consume its ZMQ_FD edge.
+ * Call `recheckSocket()` after such I/O.
+ *
+ * All methods except `runInEventLoop` and `add`/`scheduleAt` must be called
+ * from the thread of EventBase (or while it isn't running). Adapter must be
+ * destroyed there too, before EventBase.
+ *
+ *  folly::EventBase evb;
+ *  ZmqEventBaseAdapter zmqLoop(&evb);
+ *  zmqLoop.addSocket(RawZmqSocketPtr{*sock}, ZMQ_POLLIN, [&](int) noexcept {
+ *    auto msg = sock.recvOne();
+ *  });
+ *  evb.loopForever();
+ */
+class ZmqEventBaseAdapter : public folly::ScheduledExecutor {
+ public:
+  explicit ZmqEventBaseAdapter(folly::EventBase* evb);
+
+  ~ZmqEventBaseAdapter() override;
+
+  /**
+   * non-copyable and non-movable
+   */
+  ZmqEventBaseAdapter(ZmqEventBaseAdapter const&) = delete;
+  ZmqEventBaseAdapter& operator=(ZmqEventBaseAdapter const&) = delete;
+
+  folly::EventBase*
+  getEventBase() const {
+    return evb_;
+  }
+
+  bool
+  isInEventLoop() const {
+    return evb_->isInEventBaseThread();
+  }
+
+  /**
+   * Same as ZmqEventLoop. Sockets/fds are dispatched in the order EventBase
+   * reports them, hence `options` of ZmqEventLoop don't apply.
+   */
+  void addSocketFd(int socketFd, int events, SocketCallback callback);
+  void addSocket(
+      RawZmqSocketPtr socketPtr, int events, SocketCallback callback);
+
+  void removeSocket(RawZmqSocketPtr socketPtr);
+  void removeSocketFd(int socketFd);
+
+  /**
+   * Check registered socket for pending events, e.g. after I/O performed on it
+   * outside of adapter callbacks. Callback is invoked later on, in the current
+   * or next iteration of EventBase.
+   */
+  void recheckSocket(RawZmqSocketPtr socketPtr);
+
+  /**
+   * Same as ZmqEventLoop
+   */
+  int64_t scheduleTimeout(
+      std::chrono::milliseconds timeout, TimeoutCallback callback);
+  int64_t scheduleTimeoutAt(
+      std::chrono::steady_clock::time_point scheduleTime,
+      TimeoutCallback callback);
+  bool cancelTimeout(int64_t timeoutId);
+
+  size_t
+  getNumPendingTimeouts() const {
+    return timerWheel_.size();
+  }
+
+  /**
+   * Enqueue callback into thread of EventBase. Can be called from any thread.
+   */
+  void runInEventLoop(TimeoutCallback callback);
+
+  /**
+   * Same as above but executed right away if called from thread of EventBase
+   */
+  void runImmediatelyOrInEventLoop(TimeoutCallback callback);
+
+  /**
+   * ScheduledExecutor & Executor interface
+   */
+  void
+  add(TimeoutCallback callback) override {
+    runImmediatelyOrInEventLoop(std::move(callback));
+  }
+  void scheduleAt(
+      TimeoutCallback&& callback,
+      std::chrono::steady_clock::time_point const& ts) override;
+
+ private:
+  struct Subscription;
+
+  // Wakes up adapter for expired timeouts
+  class TimerWheelTimeout : public folly::AsyncTimeout {
+   public:
+    TimerWheelTimeout(folly::EventBase* evb, ZmqEventBaseAdapter& adapter)
+        : folly::AsyncTimeout(evb), adapter_(adapter) {}
+
+    void
+    timeoutExpired() noexcept override {
+      adapter_.runExpiredTimeouts();
+    }
+
+   private:
+    ZmqEventBaseAdapter& adapter_;
+  };
+
+  // Invoked by EventBase for ready sockets/fds
+  void dispatchSocket(Subscription& subscription);
+  void dispatchFd(Subscription& subscription, uint16_t events);
+
+  // Check socket in EventBase loop, at most once until checked
+  void scheduleCheck(std::shared_ptr<Subscription> const& subscription);
+
+  // Invoke `fn` while tracking I/O on sockets, then re-check them except
+  // `skipSocketPtr`
+  template <typename Fn>
+  void invokeTracked(Fn&& fn, void* skipSocketPtr = nullptr);
+
+  void runExpiredTimeouts();
+  void armTimer();
+
+  folly::EventBase* const evb_{nullptr};
+
+  std::unordered_map<uintptr_t, std::shared_ptr<Subscription>> socketMap_;
+  std::unordered_map<int, std::shared_ptr<Subscription>> fdMap_;
+
+  // Sockets on which I/O is performed by callbacks, from
+  // `detail::tlsSocketActivity`
+  std::vector<void*> socketActivity_;
+
+  TimerWheel timerWheel_;
+  TimerWheelTimeout timerWheelTimeout_;
+  // Deadline the timeout is armed for, if any
+  folly::Optional<std::chrono::steady_clock::time_point> armedTime_;
+
+  // Guards callbacks deferred into EventBase against destruction of adapter
+  std::shared_ptr<bool> isAlive_;
+};
+
+} // namespace fbzmq
@@ -8,23 +8,139 @@
 #include <fbzmq/async/ZmqEventLoop.h>
 
 #ifndef IS_BSD
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
 #else
 #include <fcntl.h>
 #endif
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include <folly/CancellationToken.h>
 #include <folly/Format.h>
 #include <folly/Memory.h>
 #include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/experimental/coro/Baton.h>
+#include <folly/lang/Bits.h>
+#include <folly/system/ThreadName.h>
 
 #include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Socket.h>
 
 namespace fbzmq {
 
+namespace {
+
+PollBackend
+getSupportedPollBackend(PollBackend pollBackend) {
+#ifdef IS_BSD
+  if (pollBackend == PollBackend::EPOLL) {
+    LOG(WARNING) << "ZmqEventLoop: EPOLL backend is not supported on this "
+                 << "platform. Falling back to ZMQ_POLL.";
+    return PollBackend::ZMQ_POLL;
+  }
+#endif
+  return pollBackend;
+}
+
+// Placeholder revents of a ready socket whose ZMQ_EVENTS must be looked up
+// right before it is dispatched
+const int kCheckZmqEvents{-1};
+
+// Subscriptions with default options don't need budgeted dispatch
+bool
+isBudgeted(SocketDispatchOptions const& options) {
+  return options.priority != EventPriority::NORMAL or
+      options.maxCallbacksPerIteration != 1 or
+      options.maxTimePerIteration.count() != 0;
+}
+
+#ifndef IS_BSD
+// Initial number of events to receive from epoll_wait in one call
+const size_t kEpollEventsBatch{64};
+
+// Convert zmq poll events to epoll events
+uint32_t
+toEpollEvents(int events) {
+  uint32_t epollEvents{0};
+  if (events & ZMQ_POLLIN) {
+    epollEvents |= EPOLLIN;
+  }
+  if (events & ZMQ_POLLOUT) {
+    epollEvents |= EPOLLOUT;
+  }
+  if (events & ZMQ_POLLPRI) {
+    epollEvents |= EPOLLPRI;
+  }
+  return epollEvents;
+}
+
+// Convert epoll events to zmq poll events. Follows `zmq_poll` semantics for
+// raw fds, anything other than IN/OUT is reported as ZMQ_POLLERR.
+int
+toZmqEvents(uint32_t epollEvents) {
+  int events{0};
+  if (epollEvents & EPOLLIN) {
+    events |= ZMQ_POLLIN;
+  }
+  if (epollEvents & EPOLLOUT) {
+    events |= ZMQ_POLLOUT;
+  }
+  if (epollEvents & EPOLLPRI) {
+    events |= ZMQ_POLLPRI;
+  }
+  if (epollEvents & ~(EPOLLIN | EPOLLOUT | EPOLLPRI)) {
+    events |= ZMQ_POLLERR;
+  }
+  return events;
+}
+#endif
+
+} // namespace
+
+std::unordered_map<std::string, int64_t>
+ZmqEventLoop::LoopStats::getCounters(std::string const& prefix) const {
+  auto toUs = [](std::chrono::nanoseconds value) {
+    return static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(value).count());
+  };
+
+  std::unordered_map<std::string, int64_t> counters;
+  counters[prefix + ".iterations"] = numIterations;
+  counters[prefix + ".poll_wait_us"] = toUs(totalPollWaitTime);
+  counters[prefix + ".busy_us"] = toUs(totalBusyTime);
+  counters[prefix + ".busy_us.max"] = toUs(maxBusyTime);
+  counters[prefix + ".slow_callbacks"] = numSlowCallbacks;
+  counters[prefix + ".spin_iterations"] = numSpinIterations;
+  counters[prefix + ".idle_spin_us"] = toUs(totalIdleSpinTime);
+  counters[prefix + ".coalesced_timeouts"] = numCoalescedTimeouts;
+
+  auto addHistogram = [&](std::string const& name, auto const& histogram) {
+    const auto key = folly::sformat("{}.{}_us", prefix, name);
+    counters[key + ".count"] = histogram.count;
+    counters[key + ".avg"] =
+        histogram.count ? toUs(histogram.sum) / histogram.count : 0;
+    counters[key + ".p50"] = toUs(histogram.getPercentile(50));
+    counters[key + ".p99"] = toUs(histogram.getPercentile(99));
+    counters[key + ".max"] = toUs(histogram.max);
+  };
+  addHistogram("socket_callback", socketCallbacks);
+  addHistogram("timeout_callback", timeoutCallbacks);
+  addHistogram("timeout_lateness", timeoutLateness);
+  addHistogram("queued_callback", queuedCallbacks);
+  addHistogram("queue_wait", queueWait);
+  return counters;
+}
+
 ZmqEventLoop::ZmqEventLoop(
-    uint64_t queueCapacity, std::chrono::seconds healthCheckDuration)
-    : callbackQueue_(queueCapacity),
+    uint64_t queueCapacity,
+    std::chrono::seconds healthCheckDuration,
+    PollBackend pollBackend)
+    : pollBackend_(getSupportedPollBackend(pollBackend)),
       healthCheckDuration_(
           std::chrono::duration_cast<std::chrono::milliseconds>(
               healthCheckDuration)) {
@@ -32,68 +148,52 @@ ZmqEventLoop::ZmqEventLoop(
   latestActivityTs_.store(
       std::chrono::steady_clock::now().time_since_epoch().count());
 
+  // Create callback queue
+  if (queueCapacity == kUnboundedQueueCapacity) {
+    unboundedCallbackQueue_ = std::make_unique<
+        folly::UMPSCQueue<TimeoutCallback, false /* MayBlock */>>();
+  } else {
+    boundedCallbackQueue_ = std::make_unique<
+        folly::MPMCQueue<TimeoutCallback, std::atomic, true>>(queueCapacity);
+  }
+
 #ifndef IS_BSD
-  // Create signal-fd for start/stop events
-  if ((signalFd_ = eventfd(0 /* init-value */, 0 /* flags */)) < 0) {
-    LOG(FATAL) << "ZmqEventLoop: Failed to create an eventfd.";
+  // Create epoll instance for EPOLL backend. Must happen before any
+  // subscription is added.
+  if (pollBackend_ == PollBackend::EPOLL) {
+    if ((epollFd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      LOG(FATAL) << "ZmqEventLoop: Failed to create an epoll instance.";
+    }
+    epollEvents_.resize(kEpollEventsBatch);
   }
 
-  // Create signal-fd for callback events from external threads
-  if ((callbackFd_ = eventfd(0 /* init-value */, EFD_NONBLOCK)) < 0) {
+  // Create control eventfd for stop requests and callback events from
+  // external threads
+  if ((controlFd_ = eventfd(0 /* init-value */, EFD_NONBLOCK | EFD_CLOEXEC)) <
+      0) {
     LOG(FATAL) << "ZmqEventLoop: Failed to create an eventfd.";
   }
-  int callbackFd = callbackFd_;
-  int signalFd = signalFd_;
+  int controlFd = controlFd_;
 #else
-  createPipeBsd(signalFds_);
-  createPipeBsd(callbackFds_);
-
-  int signalFd = signalFds_[0];
-  int callbackFd = callbackFds_[0];
+  createPipeBsd(controlFds_);
+  int controlFd = controlFds_[0];
 #endif
-  // Attach callback on signal fd
-  addSocketFd(signalFd, ZMQ_POLLIN, [this, signalFd](int revents) noexcept {
-    CHECK(revents & ZMQ_POLLIN);
-
-    // Receive 8 byte integer
-    uint64_t buf;
-    auto bytesRead = read(signalFd, static_cast<void*>(&buf), sizeof(buf));
-    CHECK_EQ(sizeof(buf), bytesRead);
-
-    VLOG(4) << "ZmqEventLoop: Received stop signal. Stopping thread.";
-    stop_ = true;
-  });
-
-  // Attach callback on callback event fd
-  addSocketFd(callbackFd, ZMQ_POLLIN, [this, callbackFd](int revents) noexcept {
+  // Attach callback on control fd
+  addSocketFd(controlFd, ZMQ_POLLIN, [this](int revents) noexcept {
     CHECK(revents & ZMQ_POLLIN);
-
-    // Receive 8 byte integer
-    uint64_t buf;
-    auto bytesRead = read(callbackFd, static_cast<void*>(&buf), sizeof(buf));
-    CHECK_EQ(sizeof(buf), bytesRead);
-
-    // Process events
-    VLOG(4) << "ZmqEventLoop: Received callback events in queue. #" << buf;
-    TimeoutCallback callback;
-    auto items = callbackQueue_.size();
-    VLOG(4) << "ZmqEventLoop: Processing " << items << " callback from queue.";
-    while (items-- > 0) {
-      callbackQueue_.blockingRead(callback);
-      callback();
-    }
+    processControlEvents();
   });
 }
 
 ZmqEventLoop::~ZmqEventLoop() {
 #ifndef IS_BSD
-  close(callbackFd_);
-  close(signalFd_);
+  close(controlFd_);
+  if (epollFd_ >= 0) {
+    close(epollFd_);
+  }
 #else
-  close(callbackFds_[0]);
-  close(callbackFds_[1]);
-  close(signalFds_[0]);
-  close(signalFds_[1]);
+  close(controlFds_[0]);
+  close(controlFds_[1]);
 #endif
 }
 
@@ -131,93 +231,276 @@ ZmqEventLoop::run() {
   SCOPE_EXIT {
     threadId_.store({}, std::memory_order_relaxed);
   };
+  applyThreadOptions();
 
   // Start the magic
   loopForever();
 }
 
 void
-ZmqEventLoop::stop() {
-  CHECK(isRunning()) << "Attempt to stop a non-running thread";
+ZmqEventLoop::setThreadOptions(LoopThreadOptions const& options) {
+  CHECK(!isRunning()) << "Thread options must be set before calling run()";
+  threadOptions_ = options;
+}
 
+void
+ZmqEventLoop::applyThreadOptions() {
+  const auto thread = pthread_self();
+
+  if (not threadOptions_.cpus.empty()) {
 #ifndef IS_BSD
-  int signalFd = signalFd_;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (const int cpu : threadOptions_.cpus) {
+      CPU_SET(cpu, &cpuSet);
+    }
+    const int rc = pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet);
+    if (rc != 0) {
+      LOG(ERROR) << "ZmqEventLoop: Failed to pin thread to cpus "
+                 << folly::join(",", threadOptions_.cpus) << ". "
+                 << folly::errnoStr(rc);
+    }
 #else
-  int signalFd = signalFds_[1];
+    LOG(WARNING) << "ZmqEventLoop: CPU pinning is not supported on this "
+                 << "platform. Thread is not pinned.";
 #endif
-  // Send signal on the signalFd_ (eventfd)
+  }
+
+  if (threadOptions_.schedPolicy) {
+    struct sched_param param {};
+    param.sched_priority = threadOptions_.schedPriority;
+    const int rc = pthread_setschedparam(
+        thread, threadOptions_.schedPolicy.value(), &param);
+    if (rc != 0) {
+      LOG(ERROR) << "ZmqEventLoop: Failed to set scheduling policy "
+                 << threadOptions_.schedPolicy.value() << " with priority "
+                 << threadOptions_.schedPriority << ". "
+                 << folly::errnoStr(rc);
+    }
+  }
+
+  if (threadOptions_.name) {
+    if (not folly::setThreadName(threadOptions_.name.value())) {
+      LOG(ERROR) << "ZmqEventLoop: Failed to name thread "
+                 << threadOptions_.name.value();
+    }
+  }
+}
+
+void
+ZmqEventLoop::stop() {
+  CHECK(isRunning()) << "Attempt to stop a non-running thread";
+
+  stopRequested_.store(true, std::memory_order_release);
+  wakeup();
+}
+
+void
+ZmqEventLoop::wakeup() {
+#ifndef IS_BSD
+  // Adds to counter of eventfd, never blocks short of 2^64 - 1 pending
+  // wakeups
   uint64_t buf{1};
-  auto bytesWritten = write(signalFd, static_cast<void*>(&buf), sizeof(buf));
+  auto bytesWritten = write(controlFd_, static_cast<void*>(&buf), sizeof(buf));
   CHECK_EQ(sizeof(buf), bytesWritten);
+#else
+  // A full pipe already has a wakeup pending
+  const char buf{1};
+  auto bytesWritten = write(controlFds_[1], &buf, sizeof(buf));
+  CHECK(bytesWritten == sizeof(buf) or errno == EAGAIN)
+      << "ZmqEventLoop: Failed to write control pipe";
+#endif
+}
+
+void
+ZmqEventLoop::processControlEvents() {
+  // Consume all the wakeups at once, whichever they were issued for. Wakeups
+  // issued from now on are seen by the next iteration.
+#ifndef IS_BSD
+  uint64_t numWakeups{0};
+  auto bytesRead =
+      read(controlFd_, static_cast<void*>(&numWakeups), sizeof(numWakeups));
+  if (bytesRead < 0) {
+    CHECK_EQ(EAGAIN, errno) << "ZmqEventLoop: Failed to read control eventfd";
+    return;
+  }
+  CHECK_EQ(sizeof(numWakeups), bytesRead);
+#else
+  uint64_t numWakeups{0};
+  char buf[64];
+  while (true) {
+    auto bytesRead = read(controlFds_[0], buf, sizeof(buf));
+    if (bytesRead <= 0) {
+      CHECK(bytesRead == 0 or errno == EAGAIN)
+          << "ZmqEventLoop: Failed to read control pipe";
+      break;
+    }
+    numWakeups += bytesRead;
+  }
+#endif
+  VLOG(4) << "ZmqEventLoop: Received " << numWakeups << " control events.";
+
+  if (stopRequested_.exchange(false, std::memory_order_acq_rel)) {
+    VLOG(4) << "ZmqEventLoop: Received stop signal. Stopping thread.";
+    stop_ = true;
+  }
+  if (callbackSignalPending_.load(std::memory_order_acquire)) {
+    processCallbackQueue();
+  }
 }
 
 void
 ZmqEventLoop::addSocket(
-    RawZmqSocketPtr socketPtr, int events, SocketCallback callback) {
+    RawZmqSocketPtr socketPtr,
+    int events,
+    SocketCallback callback,
+    SocketDispatchOptions const& options) {
   CHECK(isInEventLoop());
   CHECK_NE(0, events) << "Subscription events can't be empty.";
+  CHECK_LE(1, options.maxCallbacksPerIteration);
   if (socketMap_.count(socketPtr)) {
     throw std::runtime_error("Socket callback already registered.");
   }
   auto subscription =
-      std::make_shared<PollSubscription>(events, std::move(callback));
+      std::make_shared<PollSubscription>(events, std::move(callback), options);
+  auto rawSocketPtr =
+      reinterpret_cast<void*>(static_cast<uintptr_t>(socketPtr));
+  subscription->socketPtr = rawSocketPtr;
+#ifndef IS_BSD
+  if (pollBackend_ == PollBackend::EPOLL) {
+    int fd{-1};
+    size_t fdLen = sizeof(fd);
+    if (zmq_getsockopt(rawSocketPtr, ZMQ_FD, &fd, &fdLen) != 0) {
+      throw std::runtime_error(folly::sformat(
+          "Failed to get ZMQ_FD of socket. {}", zmq_strerror(zmq_errno())));
+    }
+    subscription->fd = fd;
+    // ZMQ_FD only signals state changes, ZMQ_EVENTS tells actual events
+    epollRegister(*subscription, EPOLLIN | EPOLLET);
+    // Socket might already have pending events before it got registered
+    queueSocket(*subscription);
+  }
+#endif
   socketMap_.emplace(socketPtr, std::move(subscription));
   needsRebuild_ = true;
+  if (isBudgeted(options)) {
+    ++numBudgetedSubscriptions_;
+    updateBudgetedDispatch();
+  }
 }
 
 void
-ZmqEventLoop::addSocketFd(int socketFd, int events, SocketCallback callback) {
+ZmqEventLoop::addSocketFd(
+    int socketFd,
+    int events,
+    SocketCallback callback,
+    SocketDispatchOptions const& options) {
   CHECK(isInEventLoop());
   CHECK_NE(0, events) << "Subscription events can't be empty.";
+  CHECK_LE(1, options.maxCallbacksPerIteration);
   if (socketFdMap_.count(socketFd)) {
     throw std::runtime_error("Socket callback already registered.");
   }
 
   auto subscription =
-      std::make_shared<PollSubscription>(events, std::move(callback));
+      std::make_shared<PollSubscription>(events, std::move(callback), options);
+  subscription->fd = socketFd;
+#ifndef IS_BSD
+  if (pollBackend_ == PollBackend::EPOLL) {
+    epollRegister(*subscription, toEpollEvents(events));
+  }
+#endif
   socketFdMap_.emplace(socketFd, std::move(subscription));
   needsRebuild_ = true;
+  if (isBudgeted(options)) {
+    ++numBudgetedSubscriptions_;
+    updateBudgetedDispatch();
+  }
 }
 
 void
 ZmqEventLoop::removeSocket(RawZmqSocketPtr socketPtr) {
   CHECK(isInEventLoop());
-  if (socketMap_.erase(socketPtr)) {
-    needsRebuild_ = true;
+  auto it = socketMap_.find(socketPtr);
+  if (it == socketMap_.end()) {
+    return;
+  }
+  it->second->isRegistered = false;
+#ifndef IS_BSD
+  if (pollBackend_ == PollBackend::EPOLL) {
+    epollUnregister(*it->second);
+  }
+#endif
+  if (isBudgeted(it->second->dispatchOptions)) {
+    --numBudgetedSubscriptions_;
+    updateBudgetedDispatch();
   }
+  socketMap_.erase(it);
+  needsRebuild_ = true;
 }
 
 void
 ZmqEventLoop::removeSocketFd(int socketFd) {
   CHECK(isInEventLoop());
-  if (socketFdMap_.erase(socketFd)) {
-    needsRebuild_ = true;
+  auto it = socketFdMap_.find(socketFd);
+  if (it == socketFdMap_.end()) {
+    return;
+  }
+  it->second->isRegistered = false;
+#ifndef IS_BSD
+  if (pollBackend_ == PollBackend::EPOLL) {
+    epollUnregister(*it->second);
+  }
+#endif
+  if (isBudgeted(it->second->dispatchOptions)) {
+    --numBudgetedSubscriptions_;
+    updateBudgetedDispatch();
   }
+  socketFdMap_.erase(it);
+  needsRebuild_ = true;
 }
 
 int64_t
 ZmqEventLoop::scheduleTimeout(
-    std::chrono::milliseconds timeout, TimeoutCallback callback) {
+    std::chrono::milliseconds timeout,
+    TimeoutCallback callback,
+    std::chrono::milliseconds slack) {
   CHECK(isInEventLoop());
   return scheduleTimeoutAt(
-      std::chrono::steady_clock::now() + timeout, std::move(callback));
+      std::chrono::steady_clock::now() + timeout, std::move(callback), slack);
 }
 
 int64_t
 ZmqEventLoop::scheduleTimeoutAt(
     std::chrono::steady_clock::time_point scheduleTime,
-    TimeoutCallback callback) {
+    TimeoutCallback callback,
+    std::chrono::milliseconds slack) {
   CHECK(isInEventLoop());
-  auto timeoutId = timeoutId_++;
-  timeoutHeap_.emplace(scheduleTime, std::move(callback), timeoutId);
-  activeTimeouts_.insert(timeoutId);
-  return timeoutId;
+  return timerWheel_.schedule(
+      alignToSlack(scheduleTime, slack), std::move(callback));
+}
+
+std::chrono::steady_clock::time_point
+ZmqEventLoop::alignToSlack(
+    std::chrono::steady_clock::time_point timePoint,
+    std::chrono::milliseconds slack) {
+  if (slack <= std::chrono::milliseconds(0)) {
+    return timePoint;
+  }
+  const std::chrono::steady_clock::duration granularity =
+      std::chrono::milliseconds(
+          folly::prevPowTwo(static_cast<uint64_t>(slack.count())));
+  const auto remainder = timePoint.time_since_epoch() % granularity;
+  if (remainder.count() == 0) {
+    return timePoint;
+  }
+  return timePoint + (granularity - remainder);
 }
 
 bool
 ZmqEventLoop::cancelTimeout(int64_t timeoutId) {
   CHECK(isInEventLoop());
-  return activeTimeouts_.erase(timeoutId) > 0;
+  return timerWheel_.cancel(timeoutId);
 }
 
 void
@@ -229,17 +512,180 @@ ZmqEventLoop::runInEventLoop(TimeoutCallback callback) {
   CHECK(!isRunning() || !isInEventLoop());
 
   // Enqueue the callback
-  callbackQueue_.blockingWrite(std::move(callback));
+  const auto startTime = std::chrono::steady_clock::now();
+  if (instrumentationEnabled_.load(std::memory_order_relaxed)) {
+    callback = wrapQueuedCallback(std::move(callback), startTime);
+  }
+  if (unboundedCallbackQueue_) {
+    unboundedCallbackQueue_->enqueue(std::move(callback));
+  } else {
+    boundedCallbackQueue_->blockingWrite(std::move(callback));
+  }
+  updateEnqueueStats(1, startTime);
 
-  // Send signal on the callbackFd_ (eventfd)
-  uint64_t buf{1};
-#ifndef IS_BSD
-  int callbackFd = callbackFd_;
-#else
-  int callbackFd = callbackFds_[1];
-#endif
-  auto bytesWritten = write(callbackFd, static_cast<void*>(&buf), sizeof(buf));
-  CHECK_EQ(sizeof(buf), bytesWritten);
+  // Wake up the loop
+  signalCallbackQueue();
+}
+
+void
+ZmqEventLoop::runInEventLoopBatch(std::vector<TimeoutCallback> callbacks) {
+  // Refer to runInEventLoop
+  CHECK(!isRunning() || !isInEventLoop());
+  if (callbacks.empty()) {
+    return;
+  }
+
+  // Enqueue all callbacks
+  const auto startTime = std::chrono::steady_clock::now();
+  const bool instrumented =
+      instrumentationEnabled_.load(std::memory_order_relaxed);
+  for (auto& callback : callbacks) {
+    if (instrumented) {
+      callback = wrapQueuedCallback(std::move(callback), startTime);
+    }
+    if (unboundedCallbackQueue_) {
+      unboundedCallbackQueue_->enqueue(std::move(callback));
+      continue;
+    }
+    if (not boundedCallbackQueue_->write(std::move(callback))) {
+      // Queue is full. Loop must be woken up to drain it before we block.
+      signalCallbackQueue();
+      boundedCallbackQueue_->blockingWrite(std::move(callback));
+    }
+  }
+  updateEnqueueStats(callbacks.size(), startTime);
+
+  // Wake up the loop only once for the whole batch
+  signalCallbackQueue();
+}
+
+size_t
+ZmqEventLoop::getNumPendingCallbacks() const {
+  if (unboundedCallbackQueue_) {
+    return unboundedCallbackQueue_->size();
+  }
+  // Can be negative while the loop is blocked on reading
+  return std::max<ssize_t>(0, boundedCallbackQueue_->size());
+}
+
+ZmqEventLoop::CallbackQueueStats
+ZmqEventLoop::getCallbackQueueStats() const {
+  CallbackQueueStats stats;
+  stats.numCallbacks = numEnqueuedCallbacks_.load(std::memory_order_relaxed);
+  stats.numWakeups = numCallbackWakeups_.load(std::memory_order_relaxed);
+  stats.totalEnqueueLatency = std::chrono::nanoseconds(
+      totalEnqueueLatencyNs_.load(std::memory_order_relaxed));
+  stats.maxEnqueueLatency = std::chrono::nanoseconds(
+      maxEnqueueLatencyNs_.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void
+ZmqEventLoop::signalCallbackQueue() {
+  // Spinning loop drains the queue without a wakeup. Fence pairs with the
+  // one in `setSpinning`, hence either loop sees the callback once it stops
+  // spinning or we see that it stopped.
+  if (spinEnabled_.load(std::memory_order_relaxed)) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (isSpinning_.load(std::memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // Loop is yet to process the queue since last wakeup. It will see every
+  // callback enqueued so far.
+  if (callbackSignalPending_.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  numCallbackWakeups_.fetch_add(1, std::memory_order_relaxed);
+
+  wakeup();
+}
+
+void
+ZmqEventLoop::processCallbackQueue() {
+  // Clear pending wakeup before draining the queue. Any callback enqueued
+  // after this point issues a new wakeup, hence can't be missed.
+  callbackSignalPending_.exchange(false, std::memory_order_acq_rel);
+
+  // Only process items which are in queue at this point. Callbacks enqueued
+  // later on will be processed in next iteration of loop.
+  TimeoutCallback callback;
+  auto items = unboundedCallbackQueue_ ? unboundedCallbackQueue_->size()
+                                       : boundedCallbackQueue_->size();
+  const auto maxItems = dispatchOptions_.maxQueuedCallbacksPerIteration;
+  if (maxItems > 0 and items > maxItems) {
+    // Leave the rest for next iteration and make sure it doesn't block
+    items = maxItems;
+    signalCallbackQueue();
+  }
+  VLOG(4) << "ZmqEventLoop: Processing " << items << " callback from queue.";
+  while (items-- > 0) {
+    if (unboundedCallbackQueue_) {
+      unboundedCallbackQueue_->dequeue(callback);
+    } else {
+      boundedCallbackQueue_->blockingRead(callback);
+    }
+    callback();
+    ++numDispatched_;
+  }
+}
+
+bool
+ZmqEventLoop::shouldSpin(std::chrono::steady_clock::time_point now) {
+  if (spinOptions_.spinDuration.count() <= 0) {
+    return false;
+  }
+
+  // Replenish budget for the time elapsed
+  spinBudget_ = std::min<std::chrono::nanoseconds>(
+      getMaxSpinBudget(),
+      spinBudget_ +
+          (now - lastSpinBudgetTime_) * spinOptions_.maxIdleSpinPct / 100);
+  lastSpinBudgetTime_ = now;
+
+  return spinBudget_.count() > 0 and
+      now - lastActiveTime_ < spinOptions_.spinDuration;
+}
+
+std::chrono::nanoseconds
+ZmqEventLoop::getMaxSpinBudget() const {
+  // A second worth of budget
+  return std::chrono::nanoseconds(std::chrono::seconds(1)) *
+      spinOptions_.maxIdleSpinPct / 100;
+}
+
+void
+ZmqEventLoop::setSpinning(bool spinning) {
+  if (isSpinning_.load(std::memory_order_relaxed) == spinning) {
+    return;
+  }
+  isSpinning_.store(spinning, std::memory_order_relaxed);
+  if (spinning) {
+    return;
+  }
+
+  // Producers might have skipped the wakeup while we were spinning
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (getNumPendingCallbacks() > 0) {
+    signalCallbackQueue();
+  }
+}
+
+void
+ZmqEventLoop::updateEnqueueStats(
+    size_t numCallbacks, std::chrono::steady_clock::time_point startTime) {
+  const uint64_t latencyNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - startTime)
+          .count();
+  numEnqueuedCallbacks_.fetch_add(numCallbacks, std::memory_order_relaxed);
+  totalEnqueueLatencyNs_.fetch_add(latencyNs, std::memory_order_relaxed);
+  auto maxLatencyNs = maxEnqueueLatencyNs_.load(std::memory_order_relaxed);
+  while (latencyNs > maxLatencyNs &&
+         not maxEnqueueLatencyNs_.compare_exchange_weak(
+             maxLatencyNs, latencyNs, std::memory_order_relaxed)) {
+  }
 }
 
 void
@@ -252,28 +698,300 @@ ZmqEventLoop::runImmediatelyOrInEventLoop(TimeoutCallback callback) {
   runInEventLoop(std::move(callback));
 }
 
+namespace {
+
+/**
+ * State of coroutine waiting on the loop. Shared with callback of the loop
+ * and with cancellation, either of which may outlive the coroutine frame.
+ */
+struct CoroWaitState {
+  folly::coro::Baton baton;
+  // Ready events of socket/fd or 1 for expired timeout, 0 if cancelled
+  int result{0};
+  bool isDone{false};
+  // Undo registration with the loop
+  folly::Function<void()> unregister;
+};
+
+/**
+ * Complete wait from the loop, first of callback or cancellation wins
+ */
+void
+completeWait(std::shared_ptr<CoroWaitState> state, int result) {
+  if (state->isDone) {
+    return;
+  }
+  state->isDone = true;
+  state->result = result;
+  state->unregister();
+  state->baton.post();
+}
+
+folly::coro::Task<int>
+waitOnLoop(ZmqEventLoop& evl, std::shared_ptr<CoroWaitState> state) {
+  auto const& token = co_await folly::coro::co_current_cancellation_token;
+  folly::CancellationCallback cancelCallback(token, [&evl, state]() noexcept {
+    // Cancellation may be requested from any thread
+    evl.runImmediatelyOrInEventLoop(
+        [state]() mutable { completeWait(std::move(state), 0); });
+  });
+  co_await state->baton;
+  if (state->result == 0) {
+    co_yield folly::coro::co_cancelled;
+  }
+  co_return state->result;
+}
+
+} // namespace
+
+void
+ZmqEventLoop::addTask(folly::coro::Task<void> task) {
+  std::move(task).scheduleOn(this).start([](folly::Try<void>&& result) {
+    if (result.hasException()) {
+      LOG(ERROR) << "ZmqEventLoop: Task failed. "
+                 << folly::exceptionStr(result.exception());
+    }
+  });
+}
+
+folly::coro::Task<int>
+ZmqEventLoop::waitForSocket(RawZmqSocketPtr socketPtr, int events) {
+  CHECK(isInEventLoop());
+  auto state = std::make_shared<CoroWaitState>();
+  state->unregister = [this, socketPtr]() { removeSocket(socketPtr); };
+  // Socket is level triggered, hence registered for a single wakeup
+  // Wait holds a reference of its own, as callback goes away along with its
+  // registration
+  addSocket(socketPtr, events, [state](int revents) noexcept {
+    completeWait(state, revents);
+  });
+  co_return co_await waitOnLoop(*this, std::move(state));
+}
+
+folly::coro::Task<int>
+ZmqEventLoop::waitForSocketFd(int socketFd, int events) {
+  CHECK(isInEventLoop());
+  auto state = std::make_shared<CoroWaitState>();
+  state->unregister = [this, socketFd]() { removeSocketFd(socketFd); };
+  addSocketFd(socketFd, events, [state](int revents) noexcept {
+    completeWait(state, revents);
+  });
+  co_return co_await waitOnLoop(*this, std::move(state));
+}
+
+folly::coro::Task<void>
+ZmqEventLoop::sleepFor(std::chrono::milliseconds timeout) {
+  return sleepUntil(std::chrono::steady_clock::now() + timeout);
+}
+
+folly::coro::Task<void>
+ZmqEventLoop::sleepUntil(std::chrono::steady_clock::time_point scheduleTime) {
+  CHECK(isInEventLoop());
+  auto state = std::make_shared<CoroWaitState>();
+  const auto timeoutId = scheduleTimeoutAt(scheduleTime, [state]() mutable {
+    // Nothing to cancel once timeout has fired
+    state->unregister = []() {};
+    completeWait(std::move(state), 1);
+  });
+  state->unregister = [this, timeoutId]() { cancelTimeout(timeoutId); };
+  co_await waitOnLoop(*this, std::move(state));
+}
+
+void
+ZmqEventLoop::setInstrumentationOptions(
+    InstrumentationOptions const& options) {
+  CHECK(isInEventLoop());
+  instrumentationOptions_ = options;
+  instrumentationEnabled_.store(options.enabled, std::memory_order_relaxed);
+}
+
+ZmqEventLoop::LoopStats
+ZmqEventLoop::getLoopStats() const {
+  CHECK(isInEventLoop());
+  return loopStats_;
+}
+
+void
+ZmqEventLoop::resetLoopStats() {
+  CHECK(isInEventLoop());
+  loopStats_ = LoopStats();
+}
+
+void
+ZmqEventLoop::setSpinOptions(LoopSpinOptions const& options) {
+  CHECK(isInEventLoop());
+  CHECK_GE(100, options.maxIdleSpinPct);
+  spinOptions_ = options;
+  spinEnabled_.store(
+      options.spinDuration.count() > 0, std::memory_order_relaxed);
+  if (not spinEnabled_.load(std::memory_order_relaxed)) {
+    setSpinning(false);
+  }
+}
+
+void
+ZmqEventLoop::setDispatchOptions(LoopDispatchOptions const& options) {
+  CHECK(isInEventLoop());
+  dispatchOptions_ = options;
+  updateBudgetedDispatch();
+}
+
+void
+ZmqEventLoop::updateBudgetedDispatch() {
+  // Timeout and queue budgets are enforced by their own processing and don't
+  // need readiness to be collected
+  budgetedDispatch_ = numBudgetedSubscriptions_ > 0 or
+      dispatchOptions_.roundRobin or
+      dispatchOptions_.timeoutPriority != EventPriority::NORMAL;
+}
+
+void
+ZmqEventLoop::invokeSocketCallback(
+    PollSubscription& subscription, int revents) {
+  ++numDispatched_;
+  if (not instrumentationOptions_.enabled) {
+    subscription.callback(revents);
+    return;
+  }
+
+  const auto startTime = std::chrono::steady_clock::now();
+  subscription.callback(revents);
+  recordCallback(
+      loopStats_.socketCallbacks,
+      std::chrono::steady_clock::now() - startTime,
+      [&subscription, revents]() {
+        return subscription.socketPtr
+            ? folly::sformat(
+                  "socket {} (revents {})", subscription.socketPtr, revents)
+            : folly::sformat(
+                  "fd {} (revents {})", subscription.fd, revents);
+      });
+}
+
+void
+ZmqEventLoop::invokeTimeout(
+    int64_t timeoutId,
+    std::chrono::steady_clock::time_point scheduledTime,
+    TimeoutCallback& callback) {
+  // Previous timeout of this wakeup had the same scheduled time, this one
+  // would have needed a wakeup of its own if it weren't aligned with it
+  if (scheduledTime == lastTimeoutTime_) {
+    ++loopStats_.numCoalescedTimeouts;
+  }
+  lastTimeoutTime_ = scheduledTime;
+
+  const auto startTime = std::chrono::steady_clock::now();
+  callback();
+  if (not instrumentationOptions_.enabled) {
+    return;
+  }
+
+  const auto lateness = startTime - scheduledTime;
+  loopStats_.timeoutLateness.addValue(lateness);
+  recordCallback(
+      loopStats_.timeoutCallbacks,
+      std::chrono::steady_clock::now() - startTime,
+      [timeoutId, lateness]() {
+        return folly::sformat(
+            "timeout {} (late by {}us)",
+            timeoutId,
+            std::chrono::duration_cast<std::chrono::microseconds>(lateness)
+                .count());
+      });
+}
+
+TimeoutCallback
+ZmqEventLoop::wrapQueuedCallback(
+    TimeoutCallback callback,
+    std::chrono::steady_clock::time_point enqueueTime) {
+  return [this, enqueueTime, callback = std::move(callback)]() mutable {
+    const auto startTime = std::chrono::steady_clock::now();
+    callback();
+    if (not instrumentationOptions_.enabled) {
+      return;
+    }
+
+    loopStats_.queueWait.addValue(startTime - enqueueTime);
+    recordCallback(
+        loopStats_.queuedCallbacks,
+        std::chrono::steady_clock::now() - startTime,
+        []() { return std::string("queued callback"); });
+  };
+}
+
+void
+ZmqEventLoop::recordCallback(
+    LatencyHistogram& histogram,
+    std::chrono::nanoseconds duration,
+    folly::FunctionRef<std::string()> describe) {
+  histogram.addValue(duration);
+  const auto threshold = instrumentationOptions_.slowCallbackThreshold;
+  if (threshold.count() > 0 and duration >= threshold) {
+    ++loopStats_.numSlowCallbacks;
+    LOG(WARNING) << "ZmqEventLoop: Slow callback of " << describe()
+                 << " took "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        duration)
+                        .count()
+                 << "us.";
+  }
+}
+
 void
 ZmqEventLoop::loopForever() {
   std::chrono::milliseconds pollTimeout;
   stop_ = false;
-  while (not stop_) {
-    // Rebuild poll-items if needed
-    if (needsRebuild_) {
-      rebuildPollItems();
-      needsRebuild_ = false;
+
+#ifndef IS_BSD
+  if (pollBackend_ == PollBackend::EPOLL) {
+    // Edges might have been consumed while we were not running. Check all
+    // sockets once to begin with.
+    for (auto& kv : socketMap_) {
+      queueSocket(*kv.second);
     }
 
+    // Track I/O performed on sockets from within this loop
+    detail::tlsSocketActivity = &socketActivity_;
+  }
+  SCOPE_EXIT {
+    detail::tlsSocketActivity = nullptr;
+    socketActivity_.clear();
+  };
+#endif
+
+  // Start with full spin budget. Producers must signal wakeups while loop is
+  // not running.
+  lastActiveTime_ = lastSpinBudgetTime_ = std::chrono::steady_clock::now();
+  spinBudget_ = getMaxSpinBudget();
+  SCOPE_EXIT {
+    setSpinning(false);
+  };
+
+  while (not stop_) {
+    const bool instrumented = instrumentationOptions_.enabled;
+    const auto iterationStartTime = instrumented
+        ? std::chrono::steady_clock::now()
+        : std::chrono::steady_clock::time_point();
+
     // Calculate poll-timeout. If there is a pending timeout then poll-timeout
     // will be the amount of duration for that timeout to become active. This
     // is our best try at scheduling request as soon as possible once it becomes
     // active.
-    if (not timeoutHeap_.empty()) {
+    auto nextExpiry = timerWheel_.getNextExpiry();
+    if (nextExpiry) {
       // Calculate waitTime for next scheduled event
+      const auto pollStartTime = std::chrono::steady_clock::now();
       auto waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-          timeoutHeap_.top().scheduledTime - std::chrono::steady_clock::now());
+          *nextExpiry - pollStartTime);
 
       // wait time can be negative if scheduled-timeout is already active
       pollTimeout = std::max(std::chrono::milliseconds(1), waitTime);
+
+      // Expired timeouts left over by budget must not wait for poll
+      if (dispatchOptions_.maxTimeoutsPerIteration > 0 and
+          *nextExpiry < pollStartTime) {
+        pollTimeout = std::chrono::milliseconds(0);
+      }
     } else {
       // No pending timeouts. Use default poll-duration
       pollTimeout = healthCheckDuration_;
@@ -282,43 +1000,386 @@ ZmqEventLoop::loopForever() {
     // Always make sure we go through loop once in every healthCheckDuration_
     pollTimeout = std::min(pollTimeout, healthCheckDuration_);
 
-    // Perform polling on sockets
+    // Poll without blocking if spinning, refer to LoopSpinOptions
+    bool spinning{false};
+    std::chrono::steady_clock::time_point spinStartTime;
+    if (spinEnabled_.load(std::memory_order_relaxed) and
+        pollTimeout.count() > 0) {
+      spinStartTime = std::chrono::steady_clock::now();
+      spinning = shouldSpin(spinStartTime);
+      if (spinning) {
+        pollTimeout = std::chrono::milliseconds(0);
+      }
+    }
+    setSpinning(spinning);
+    const auto numDispatched = numDispatched_;
+
+    // Perform polling on sockets and invoke callbacks
     VLOG(5) << "ZmqEventLoop: Polling with poll timeout of "
             << pollTimeout.count() << "ms.";
-    // this will throw on error
-    int count = fbzmq::poll(pollItems_, pollTimeout).value();
-    for (size_t i = 0; i < pollItems_.size() && count > 0; ++i) {
-      auto& item = pollItems_[i];
-      auto& subscription = pollSubscriptions_[i];
-      if (item.revents & subscription->events) {
-        subscription->callback(item.revents & subscription->events);
-        --count;
-      }
-    } // end for
-
-    // Process timeout heap
-    auto now = std::chrono::steady_clock::now();
-    while (!timeoutHeap_.empty() && (timeoutHeap_.top().scheduledTime < now)) {
-      // Skip processing if timeout is not active
-      if (not activeTimeouts_.erase(timeoutHeap_.top().timeoutId)) {
-        timeoutHeap_.pop();
-        continue;
-      }
+#ifndef IS_BSD
+    if (pollBackend_ == PollBackend::EPOLL) {
+      pollEpoll(pollTimeout);
+    } else {
+      pollZmq(pollTimeout);
+    }
+#else
+    pollZmq(pollTimeout);
+#endif
 
-      // Callback must be issued after popping up the timeout as it can in turn
-      // push some more callbacks which can potentially make the callback
-      // to be destroyed.
-      auto callbackPtr = std::move(timeoutHeap_.top().callbackPtr); // Move ptr
-      timeoutHeap_.pop();
-      (*callbackPtr)();
+    // Invoke ready events collected by poll (if any) and process expired
+    // timeouts
+    dispatchReadyEvents(instrumented);
+
+    // Callbacks enqueued while spinning come without a wakeup
+    if (spinning and getNumPendingCallbacks() > 0) {
+      processCallbackQueue();
     }
 
     // update aliveness timestamp
-    latestActivityTs_.store(
-        std::chrono::steady_clock::now().time_since_epoch().count());
+    const auto iterationEndTime = std::chrono::steady_clock::now();
+    latestActivityTs_.store(iterationEndTime.time_since_epoch().count());
+
+    // Keep spinning while there is something to do, charge idle spinning
+    // against the budget
+    const bool isIdle = numDispatched_ == numDispatched;
+    if (not isIdle) {
+      lastActiveTime_ = iterationEndTime;
+    } else if (spinning) {
+      spinBudget_ -= iterationEndTime - spinStartTime;
+      if (instrumented) {
+        loopStats_.totalIdleSpinTime += iterationEndTime - spinStartTime;
+      }
+    }
+    if (spinning and instrumented) {
+      ++loopStats_.numSpinIterations;
+    }
+
+    // Options might have been changed from within one of the callbacks
+    if (instrumented and instrumentationOptions_.enabled) {
+      const auto busyTime = iterationEndTime - pollReturnTime_;
+      ++loopStats_.numIterations;
+      loopStats_.totalPollWaitTime += pollReturnTime_ - iterationStartTime;
+      loopStats_.totalBusyTime += busyTime;
+      loopStats_.maxBusyTime = std::max<std::chrono::nanoseconds>(
+          loopStats_.maxBusyTime, busyTime);
+    }
   } // end while
 }
 
+void
+ZmqEventLoop::pollZmq(std::chrono::milliseconds pollTimeout) {
+  // Rebuild poll-items if needed
+  if (needsRebuild_) {
+    rebuildPollItems();
+    needsRebuild_ = false;
+  }
+
+  // this will throw on error
+  int count = fbzmq::poll(pollItems_, pollTimeout).value();
+  if (instrumentationOptions_.enabled) {
+    pollReturnTime_ = std::chrono::steady_clock::now();
+  }
+  for (size_t i = 0; i < pollItems_.size() && count > 0; ++i) {
+    auto& item = pollItems_[i];
+    auto& subscription = pollSubscriptions_[i];
+    if (item.revents & subscription->events) {
+      if (budgetedDispatch_) {
+        readyEvents_.emplace_back(
+            subscription, item.revents & subscription->events);
+      } else {
+        invokeSocketCallback(
+            *subscription, item.revents & subscription->events);
+      }
+      --count;
+    }
+  } // end for
+}
+
+#ifndef IS_BSD
+void
+ZmqEventLoop::pollEpoll(std::chrono::milliseconds pollTimeout) {
+  // I/O performed on sockets since last poll might have consumed their ZMQ_FD
+  // edge. Queue them up for ZMQ_EVENTS check.
+  queueActiveSockets();
+
+  // Do not block if there are sockets to be checked
+  const int timeoutMs =
+      readySockets_.empty() ? static_cast<int>(pollTimeout.count()) : 0;
+  int count{0};
+  do {
+    count = epoll_wait(
+        epollFd_,
+        epollEvents_.data(),
+        static_cast<int>(epollEvents_.size()),
+        timeoutMs);
+  } while (count < 0 && errno == EINTR);
+  if (count < 0) {
+    PLOG(FATAL) << "ZmqEventLoop: epoll_wait failed.";
+  }
+  if (instrumentationOptions_.enabled) {
+    pollReturnTime_ = std::chrono::steady_clock::now();
+  }
+
+  // Collect readiness before invoking any callback. Callbacks can remove
+  // subscriptions and invalidate pointers reported by epoll.
+  for (int i = 0; i < count; ++i) {
+    auto& event = epollEvents_[i];
+    auto subscription = static_cast<PollSubscription*>(event.data.ptr);
+    if (subscription->socketPtr) {
+      queueSocket(*subscription);
+    } else {
+      readyFds_.emplace_back(
+          subscription->shared_from_this(), toZmqEvents(event.events));
+    }
+  }
+
+  // Buffer was too small, grow it for subsequent calls
+  if (static_cast<size_t>(count) == epollEvents_.size()) {
+    epollEvents_.resize(epollEvents_.size() * 2);
+  }
+
+  // Leave dispatch to `dispatchReadyEvents`. ZMQ_EVENTS of sockets is looked
+  // up at the time of dispatch.
+  if (budgetedDispatch_) {
+    for (auto& readyFd : readyFds_) {
+      readyEvents_.emplace_back(std::move(readyFd));
+    }
+    readyFds_.clear();
+    readySocketsScratch_.swap(readySockets_);
+    for (auto& subscription : readySocketsScratch_) {
+      subscription->isQueued = false;
+      readyEvents_.emplace_back(std::move(subscription), kCheckZmqEvents);
+    }
+    readySocketsScratch_.clear();
+    return;
+  }
+
+  // Invoke callbacks for ready fds
+  for (auto& readyFd : readyFds_) {
+    auto& subscription = readyFd.first;
+    const int revents = readyFd.second & subscription->events;
+    if (subscription->isRegistered && revents) {
+      invokeSocketCallback(*subscription, revents);
+    }
+  }
+  readyFds_.clear();
+
+  // Check ZMQ_EVENTS of queued sockets and invoke callbacks. A socket with
+  // events is re-queued as it might have more messages pending than callback
+  // consumes.
+  readySocketsScratch_.swap(readySockets_);
+  for (auto& subscription : readySocketsScratch_) {
+    subscription->isQueued = false;
+    if (not subscription->isRegistered) {
+      continue;
+    }
+
+    int zmqEvents{0};
+    size_t zmqEventsLen = sizeof(zmqEvents);
+    if (zmq_getsockopt(
+            subscription->socketPtr, ZMQ_EVENTS, &zmqEvents, &zmqEventsLen) !=
+        0) {
+      LOG(ERROR) << "ZmqEventLoop: Failed to get ZMQ_EVENTS of socket. "
+                 << zmq_strerror(zmq_errno());
+      continue;
+    }
+
+    const int revents = zmqEvents & subscription->events;
+    if (revents) {
+      queueSocket(*subscription);
+      invokeSocketCallback(*subscription, revents);
+    }
+  }
+  readySocketsScratch_.clear();
+}
+
+void
+ZmqEventLoop::epollRegister(
+    PollSubscription& subscription, uint32_t epollEvents) {
+  struct epoll_event event {};
+  event.events = epollEvents;
+  event.data.ptr = &subscription;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, subscription.fd, &event) != 0) {
+    // Follow `zmq_poll` semantics which silently ignores invalid fds
+    PLOG(ERROR) << "ZmqEventLoop: Failed to add fd " << subscription.fd
+                << " to epoll.";
+  }
+}
+
+void
+ZmqEventLoop::epollUnregister(PollSubscription& subscription) {
+  // Can fail if fd/socket has been already closed, which is fine as closing
+  // an fd removes it from epoll-set.
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, subscription.fd, nullptr);
+}
+
+void
+ZmqEventLoop::queueSocket(PollSubscription& subscription) {
+  if (subscription.isQueued) {
+    return;
+  }
+  subscription.isQueued = true;
+  readySockets_.emplace_back(subscription.shared_from_this());
+}
+
+void
+ZmqEventLoop::queueActiveSockets() {
+  void* lastSocketPtr{nullptr};
+  for (auto socketPtr : socketActivity_) {
+    // Consecutive I/O on the same socket is very common
+    if (socketPtr == lastSocketPtr) {
+      continue;
+    }
+    lastSocketPtr = socketPtr;
+    auto it = socketMap_.find(
+        RawZmqSocketPtr{reinterpret_cast<uintptr_t>(socketPtr)});
+    if (it != socketMap_.end()) {
+      queueSocket(*it->second);
+    }
+  }
+  socketActivity_.clear();
+}
+#endif
+
+void
+ZmqEventLoop::dispatchReadyEvents(bool instrumented) {
+  if (readyEvents_.empty()) {
+    runExpiredTimeouts(instrumented);
+    return;
+  }
+
+  if (dispatchOptions_.roundRobin and readyEvents_.size() > 1) {
+    // Poll items of ZMQ_POLL are in fixed order. EPOLL re-queues sockets in
+    // the order of their dispatch, hence rotating by one is enough.
+    const auto offset = pollBackend_ == PollBackend::EPOLL
+        ? 1
+        : roundRobinOffset_++ % readyEvents_.size();
+    std::rotate(
+        readyEvents_.begin(),
+        readyEvents_.begin() + offset,
+        readyEvents_.end());
+  }
+  if (numBudgetedSubscriptions_ > 0) {
+    // Stable to retain (rotated) order within a priority class
+    std::stable_sort(
+        readyEvents_.begin(),
+        readyEvents_.end(),
+        [](auto const& lhs, auto const& rhs) {
+          return lhs.first->dispatchOptions.priority <
+              rhs.first->dispatchOptions.priority;
+        });
+  }
+
+  // Timeouts go after sockets/fds of their own priority class
+  const auto timeoutPriority = dispatchOptions_.timeoutPriority;
+  bool hasRunTimeouts{false};
+  for (auto& readyEvent : readyEvents_) {
+    auto& subscription = *readyEvent.first;
+    if (not hasRunTimeouts and
+        subscription.dispatchOptions.priority > timeoutPriority) {
+      runExpiredTimeouts(instrumented);
+      hasRunTimeouts = true;
+    }
+    // Subscription might have been removed by one of the callbacks
+    if (subscription.isRegistered) {
+      dispatchSocket(subscription, readyEvent.second);
+    }
+  }
+  readyEvents_.clear();
+  if (not hasRunTimeouts) {
+    runExpiredTimeouts(instrumented);
+  }
+}
+
+void
+ZmqEventLoop::dispatchSocket(PollSubscription& subscription, int revents) {
+  if (revents == kCheckZmqEvents) {
+    revents = getReadyEvents(subscription);
+    if (not revents) {
+      return;
+    }
+#ifndef IS_BSD
+    // Socket might have more messages pending than callback consumes
+    queueSocket(subscription);
+#endif
+  }
+
+  // Invoke callback as per budget while subscription stays ready
+  auto const& options = subscription.dispatchOptions;
+  const auto startTime = options.maxTimePerIteration.count() > 0
+      ? std::chrono::steady_clock::now()
+      : std::chrono::steady_clock::time_point();
+  for (uint32_t numCallbacks = 1;; ++numCallbacks) {
+    invokeSocketCallback(subscription, revents);
+    if (numCallbacks >= options.maxCallbacksPerIteration or
+        not subscription.isRegistered or stop_) {
+      break;
+    }
+    if (options.maxTimePerIteration.count() > 0 and
+        std::chrono::steady_clock::now() - startTime >=
+            options.maxTimePerIteration) {
+      break;
+    }
+    revents = getReadyEvents(subscription);
+    if (not revents) {
+      break;
+    }
+  }
+}
+
+int
+ZmqEventLoop::getReadyEvents(PollSubscription& subscription) {
+  if (subscription.socketPtr) {
+    int zmqEvents{0};
+    size_t zmqEventsLen = sizeof(zmqEvents);
+    if (zmq_getsockopt(
+            subscription.socketPtr, ZMQ_EVENTS, &zmqEvents, &zmqEventsLen) !=
+        0) {
+      LOG(ERROR) << "ZmqEventLoop: Failed to get ZMQ_EVENTS of socket. "
+                 << zmq_strerror(zmq_errno());
+      return 0;
+    }
+    return zmqEvents & subscription.events;
+  }
+
+  zmq_pollitem_t item{nullptr, subscription.fd, subscription.events, 0};
+  if (zmq_poll(&item, 1, 0) <= 0) {
+    return 0;
+  }
+  return item.revents & subscription.events;
+}
+
+void
+ZmqEventLoop::runExpiredTimeouts(bool instrumented) {
+  const auto now = std::chrono::steady_clock::now();
+  const auto maxTimeouts = dispatchOptions_.maxTimeoutsPerIteration;
+  size_t numInvoked{0};
+  if (instrumented) {
+    lastTimeoutTime_ = std::chrono::steady_clock::time_point();
+    numInvoked = timerWheel_.runExpired(
+        now,
+        [this](
+            int64_t timeoutId,
+            std::chrono::steady_clock::time_point scheduledTime,
+            TimeoutCallback& callback) {
+          invokeTimeout(timeoutId, scheduledTime, callback);
+        },
+        maxTimeouts);
+  } else if (maxTimeouts > 0) {
+    numInvoked = timerWheel_.runExpired(
+        now,
+        [](int64_t,
+           std::chrono::steady_clock::time_point,
+           TimeoutCallback& callback) { callback(); },
+        maxTimeouts);
+  } else {
+    numInvoked = timerWheel_.runExpired(now);
+  }
+  // Timer only iterations aren't idle, e.g. for spin mode
+  numDispatched_ += numInvoked;
+}
+
 void
 ZmqEventLoop::rebuildPollItems() {
   pollItems_.clear();
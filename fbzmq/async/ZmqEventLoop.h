@@ -13,17 +13,24 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
+
+#ifndef IS_BSD
+#include <sys/epoll.h>
+#endif
 
-#include <boost/heap/priority_queue.hpp>
 #include <boost/serialization/strong_typedef.hpp>
 #include <folly/Function.h>
 #include <folly/MPMCQueue.h>
+#include <folly/Optional.h>
+#include <folly/concurrency/UnboundedQueue.h>
 #include <folly/executors/ScheduledExecutor.h>
+#include <folly/experimental/coro/Task.h>
 #include <glog/logging.h>
 #include <zmq.h>
 
 #include <fbzmq/async/Runnable.h>
+#include <fbzmq/async/TimerWheel.h>
 
 namespace fbzmq {
 
@@ -32,6 +39,115 @@ using TimeoutCallback = folly::Function<void(void)>;
 
 BOOST_STRONG_TYPEDEF(uintptr_t, RawZmqSocketPtr)
 
+/**
+ * Polling backend used by ZmqEventLoop to wait for events on sockets/fds.
+ *
+ * ZMQ_POLL: Rebuilds a list of `zmq_pollitem_t` and performs `zmq_poll` on
+ *   all of the registered sockets/fds on every iteration. Cost of each wakeup
+ *   is proportional to the number of registered sockets.
+ *
+ * EPOLL: Registers ZMQ_FD of every socket (edge-triggered) and every raw fd
+ *   (level-triggered) with epoll only once. On wakeup ZMQ_EVENTS is queried
+ *   only for the signalled sockets. Cost of each wakeup is proportional to the
+ *   number of active sockets. Available on Linux only, ZMQ_POLL is used as a
+ *   fallback on other platforms.
+ *
+ *   NOTE: ZMQ_FD edge can be consumed by any I/O performed on a socket. Loop
+ *   keeps track of I/O done via fbzmq::Socket APIs from within the loop and
+ *   re-checks those sockets. If you perform I/O via raw libzmq APIs on a
+ *   socket outside of its own callback then use ZMQ_POLL backend.
+ */
+enum class PollBackend {
+  ZMQ_POLL = 1,
+  EPOLL = 2,
+};
+
+/**
+ * Priority class of a socket/fd or of timeouts. Within an iteration of the
+ * loop ready sockets/fds and expired timeouts are dispatched in order of their
+ * class, HIGH first. Within a class sockets/fds go before timeouts.
+ */
+enum class EventPriority {
+  HIGH = 1,
+  NORMAL = 2,
+  LOW = 3,
+};
+
+/**
+ * Dispatch budget of a socket/fd, refer to `ZmqEventLoop::addSocket`
+ */
+struct SocketDispatchOptions {
+  EventPriority priority{EventPriority::NORMAL};
+
+  // Max number of callback invocations per iteration. Callback is invoked
+  // again as long as socket/fd stays ready and budget is left, which saves a
+  // poll per message for busy sockets whose callback reads one message.
+  uint32_t maxCallbacksPerIteration{1};
+
+  // Stop re-invoking callback in an iteration once its invocations have
+  // taken this long. Zero for no limit.
+  std::chrono::microseconds maxTimePerIteration{0};
+};
+
+/**
+ * Dispatch options of the whole loop, refer to
+ * `ZmqEventLoop::setDispatchOptions`. Defaults dispatch all the ready
+ * sockets/fds, expired timeouts and queued callbacks in every iteration.
+ */
+struct LoopDispatchOptions {
+  // Rotate the order in which ready sockets/fds of a priority class get
+  // dispatched in every iteration, so that none of them is always first.
+  bool roundRobin{false};
+
+  EventPriority timeoutPriority{EventPriority::NORMAL};
+
+  // Max number of expired timeouts and of callbacks enqueued via
+  // `runInEventLoop` APIs processed per iteration. Rest of them are processed
+  // in subsequent iterations without waiting in poll. Zero for no limit.
+  uint32_t maxTimeoutsPerIteration{0};
+  uint32_t maxQueuedCallbacksPerIteration{0};
+};
+
+/**
+ * Busy polling of the loop, refer to `ZmqEventLoop::setSpinOptions`.
+ * Defaults block in poll whenever there is nothing to do.
+ *
+ * While spinning the loop polls sockets/fds without blocking and drains the
+ * callback queue directly, hence producers of `runInEventLoop` skip the
+ * wakeup (eventfd write) and the loop avoids the cost of going to sleep and
+ * being woken up, at the expense of CPU.
+ */
+struct LoopSpinOptions {
+  // Keep polling without blocking for this long after the loop last had
+  // something to do (callback, timeout or queued callback). Zero disables
+  // spinning.
+  std::chrono::microseconds spinDuration{0};
+
+  // Cap on the CPU time spent spinning with nothing to do, as percentage of
+  // wall time. Loop blocks in poll once the budget is used up, till it gets
+  // replenished. Bounds the cost of an idle loop. Budget holds up to a
+  // second worth of it, hence bursts after idle periods start out spinning.
+  uint32_t maxIdleSpinPct{10};
+};
+
+/**
+ * Placement of the thread running the loop, refer to
+ * `ZmqEventLoop::setThreadOptions`. Defaults leave the thread as is.
+ */
+struct LoopThreadOptions {
+  // Pin the thread on these CPUs, e.g. CPUs local to the NUMA node of the
+  // NIC and of the IO threads of its context (`ContextOptions::ioThreadCpus`)
+  std::vector<int> cpus{};
+
+  // Scheduling policy (e.g. SCHED_FIFO) and priority of the thread
+  folly::Optional<int> schedPolicy{folly::none};
+  int schedPriority{0};
+
+  // Name of the thread (up to 15 characters on Linux). Named threads are
+  // told apart in per thread CPU stats of ZmqMonitor.
+  folly::Optional<std::string> name{folly::none};
+};
+
 /**
  * In ZMQ world thread is all about multiplexing read/write of messages on
  * multiple sockets into a single loop. This class wraps up many basic
@@ -63,6 +179,94 @@ BOOST_STRONG_TYPEDEF(uintptr_t, RawZmqSocketPtr)
  */
 class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
  public:
+  /**
+   * Queue capacity value for an unbounded callback queue
+   */
+  static constexpr uint64_t kUnboundedQueueCapacity{0};
+
+  /**
+   * Cumulative stats of callbacks enqueued from external threads via
+   * `runInEventLoop` APIs.
+   */
+  struct CallbackQueueStats {
+    // Total number of enqueued callbacks
+    uint64_t numCallbacks{0};
+
+    // Total number of loop wakeups (signals) issued for these callbacks.
+    // Multiple callbacks enqueued before loop wakes up share a single wakeup.
+    uint64_t numWakeups{0};
+
+    // Time spent by producers in enqueuing callbacks, including the time
+    // blocked on a full queue. Max is for a single enqueue call.
+    std::chrono::nanoseconds totalEnqueueLatency{0};
+    std::chrono::nanoseconds maxEnqueueLatency{0};
+  };
+
+  /**
+   * Histogram of durations, refer to fbzmq::LatencyHistogram
+   */
+  using LatencyHistogram = fbzmq::LatencyHistogram;
+
+  /**
+   * Stats of the loop itself, recorded only if instrumentation is enabled.
+   * Refer to `InstrumentationOptions`.
+   */
+  struct LoopStats {
+    // Number of loop iterations
+    uint64_t numIterations{0};
+
+    // Time spent waiting in poll vs time spent in callbacks and timeouts
+    std::chrono::nanoseconds totalPollWaitTime{0};
+    std::chrono::nanoseconds totalBusyTime{0};
+    std::chrono::nanoseconds maxBusyTime{0};
+
+    // Iterations which polled without blocking because of spinning, and the
+    // time spent in those which had nothing to do
+    uint64_t numSpinIterations{0};
+    std::chrono::nanoseconds totalIdleSpinTime{0};
+
+    // Duration of socket/fd callbacks
+    LatencyHistogram socketCallbacks;
+
+    // Duration of timeout callbacks and their lateness i.e. time elapsed
+    // between scheduled time and invocation
+    LatencyHistogram timeoutCallbacks;
+    LatencyHistogram timeoutLateness;
+
+    // Duration of callbacks enqueued via `runInEventLoop` APIs and time
+    // they have waited in the queue
+    LatencyHistogram queuedCallbacks;
+    LatencyHistogram queueWait;
+
+    // Number of callbacks which took longer than slow callback threshold
+    uint64_t numSlowCallbacks{0};
+
+    // Timeouts fired in the same wakeup as the previous timeout with the same
+    // scheduled time, i.e. wakeups saved by aligning timeouts with slack
+    uint64_t numCoalescedTimeouts{0};
+
+    /**
+     * Flat counters of stats with given key prefix, e.g.
+     * `<prefix>.socket_callback_us.p99`. Same format as
+     * `ThreadData::getCounters()`, ready to be submitted to ZmqMonitor.
+     */
+    std::unordered_map<std::string, int64_t> getCounters(
+        std::string const& prefix) const;
+  };
+
+  /**
+   * Instrumentation of the loop. Disabled by default.
+   */
+  struct InstrumentationOptions {
+    // Record LoopStats. Costs a couple of clock reads per callback and
+    // wrapping of callbacks enqueued via `runInEventLoop` APIs.
+    bool enabled{false};
+
+    // Log every callback taking at least this long along with the socket,
+    // fd or timeout it belongs to. Zero disables logging.
+    std::chrono::milliseconds slowCallbackThreshold{0};
+  };
+
   /**
    * ZmqEventLoop constructor
    *
@@ -70,10 +274,19 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    * every healthCheckDuration in worst case to avoid infinite polling or
    * long timeout which casuses unnecessary crash if there's health check
    * mechanism monitoring on latestActivityTs_.
+   *
+   * `queueCapacity` bounds the queue of callbacks enqueued via
+   * `runInEventLoop` APIs, producers block when it is full. Use
+   * `kUnboundedQueueCapacity` for an unbounded (segmented) queue in which case
+   * producers never block.
+   *
+   * `pollBackend` selects the mechanism for waiting on socket/fd events. Refer
+   * to `PollBackend` for more details.
    */
   explicit ZmqEventLoop(
       uint64_t queueCapacity = 1e2,
-      std::chrono::seconds healthCheckDuration = std::chrono::seconds(30));
+      std::chrono::seconds healthCheckDuration = std::chrono::seconds(30),
+      PollBackend pollBackend = PollBackend::ZMQ_POLL);
 
   ~ZmqEventLoop() override;
 
@@ -98,8 +311,8 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
   void run() override;
 
   /**
-   * Stop sends a request on special eventfd to running thread. On receipt of
-   * the signal main-thread will break the loop.
+   * Stop sends a request on control eventfd of the loop to running thread.
+   * On receipt of the request main-thread will break the loop.
    *
    * This could be invoked from any thread to abort the mainLoop runs. The
    * thread where run has aborted, could then restart looping again, by
@@ -148,10 +361,20 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    * `events` bitmap for specifying polling events you are interested in.
    *
    * Callback will be invoked with the appropriate revents bitmap.
+   *
+   * `options` sets priority class and work budget of socket/fd in every
+   * iteration of the loop. Refer to `SocketDispatchOptions`.
    */
-  void addSocketFd(int socketFd, int events, SocketCallback callback);
+  void addSocketFd(
+      int socketFd,
+      int events,
+      SocketCallback callback,
+      SocketDispatchOptions const& options = SocketDispatchOptions());
   void addSocket(
-      RawZmqSocketPtr socketPtr, int events, SocketCallback callback);
+      RawZmqSocketPtr socketPtr,
+      int events,
+      SocketCallback callback,
+      SocketDispatchOptions const& options = SocketDispatchOptions());
 
   /**
    * Remove socket/fd from polling list. You must remove first before inserting
@@ -169,26 +392,40 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    *           to cancel the timeout if it is still pending.
    */
   int64_t scheduleTimeout(
-      std::chrono::milliseconds timeout, TimeoutCallback callback);
+      std::chrono::milliseconds timeout,
+      TimeoutCallback callback,
+      std::chrono::milliseconds slack = std::chrono::milliseconds(0));
 
   /**
    * Same as above method but takes a time-point after which to call this
    * callback. If two callbacks are inserted with same timestamp then their
    * order of execution will be in the same order as their order of insertion.
    *
+   * Timeouts which tolerate a delay can specify `slack`. Their scheduled time
+   * is deferred (by less than slack) to a boundary given by `alignToSlack`,
+   * so that nearby timeouts fire together in a single wakeup of the loop.
+   *
    * @returns: A unique token associated with the timeout which you can use
    *           to cancel the timeout if it is still pending.
    */
   int64_t scheduleTimeoutAt(
       std::chrono::steady_clock::time_point scheduleTime,
-      TimeoutCallback callback);
+      TimeoutCallback callback,
+      std::chrono::milliseconds slack = std::chrono::milliseconds(0));
 
   /**
-   * Cancel previously scheduled timeout if it exists.
-   *
-   * NOTE: As of current implementation the scheduled timeout will incur the
-   *       memory overhead until its timeout is expired. We keep it in heap
-   *       and discard when it is processed.
+   * Round time point up to a multiple of the largest power of two
+   * milliseconds not exceeding `slack`. Boundaries of a bigger slack are
+   * boundaries of smaller ones too, hence timeouts with different slack
+   * coalesce as well. Returns time point as-is if slack is zero.
+   */
+  static std::chrono::steady_clock::time_point alignToSlack(
+      std::chrono::steady_clock::time_point timePoint,
+      std::chrono::milliseconds slack);
+
+  /**
+   * Cancel previously scheduled timeout if it exists. Memory associated with
+   * the timeout (including callback) is released immediately.
    *
    * @returns: true if timeout is pending and has been cancelled else returns
    *           false if timeout already got executed.
@@ -224,6 +461,15 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    */
   void runInEventLoop(TimeoutCallback callback);
 
+  /**
+   * Same as above but enqueues all of the callbacks with at most one wakeup of
+   * the loop. Callbacks are executed in the order of vector.
+   *
+   * NOTE: If bounded queue gets full, loop is woken up to drain it before
+   * producer blocks.
+   */
+  void runInEventLoopBatch(std::vector<TimeoutCallback> callbacks);
+
   /**
    * Same as above but can be called from within the loop as well. It will be
    * executed immediately if called from within the same thread otherwise
@@ -231,13 +477,66 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    */
   void runImmediatelyOrInEventLoop(TimeoutCallback callback);
 
+  /**
+   * Coroutine support. ZmqEventLoop is an executor, hence tasks can be
+   * scheduled on it like on any other, e.g.
+   *  std::move(task).scheduleOn(&evl).start();
+   * Coroutines running on the loop can then wait for sockets and timers of
+   * the loop instead of registering callbacks. Waiting coroutines are resumed
+   * right from the callbacks of the loop, without any extra hop.
+   *
+   *  folly::coro::Task<void>
+   *  reader(ZmqEventLoop& evl, Socket<ZMQ_PULL, ZMQ_SERVER>& sock) {
+   *    while (true) {
+   *      co_await evl.readable(RawZmqSocketPtr{*sock});
+   *      auto msg = sock.recvOne();
+   *      ...
+   *      co_await evl.sleepFor(std::chrono::milliseconds(10));
+   *    }
+   *  }
+   *  evl.addTask(reader(evl, sock));
+   *
+   * Awaitables below must be awaited from coroutines running on this loop.
+   * Waits are cancellable: on cancellation of the awaiting task they finish
+   * early with `folly::OperationCancelled`.
+   */
+
+  /**
+   * Schedule task on the loop and start it detached. Errors of task are
+   * logged.
+   */
+  void addTask(folly::coro::Task<void> task);
+
+  /**
+   * Wait till socket/fd has any of `events`, returns the ready events.
+   * Socket/fd must not be registered by `addSocket/addSocketFd` meanwhile.
+   */
+  folly::coro::Task<int> waitForSocket(RawZmqSocketPtr socketPtr, int events);
+  folly::coro::Task<int> waitForSocketFd(int socketFd, int events);
+
+  folly::coro::Task<int>
+  readable(RawZmqSocketPtr socketPtr) {
+    return waitForSocket(socketPtr, ZMQ_POLLIN);
+  }
+  folly::coro::Task<int>
+  writable(RawZmqSocketPtr socketPtr) {
+    return waitForSocket(socketPtr, ZMQ_POLLOUT);
+  }
+
+  /**
+   * Sleep on the timeouts of the loop
+   */
+  folly::coro::Task<void> sleepFor(std::chrono::milliseconds timeout);
+  folly::coro::Task<void> sleepUntil(
+      std::chrono::steady_clock::time_point scheduleTime);
+
   /**
    * Returns the count of currently active timeouts which will get executed
    * eventually.
    */
   size_t
   getNumPendingTimeouts() const {
-    return activeTimeouts_.size();
+    return timerWheel_.size();
   }
 
   /**
@@ -252,11 +551,90 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
   }
 
   /**
-   * return zmq event callback queue size
+   * return zmq event callback queue size. For a bounded queue it is the
+   * allocated capacity, for an unbounded queue it is the number of pending
+   * callbacks.
    */
   size_t
   getEventQueueSize() const {
-    return callbackQueue_.allocatedCapacity();
+    return boundedCallbackQueue_ ? boundedCallbackQueue_->allocatedCapacity()
+                                 : unboundedCallbackQueue_->size();
+  }
+
+  /**
+   * Returns the number of callbacks waiting in the queue to be executed.
+   * Thread safe, but only an estimate while producers/loop are active.
+   */
+  size_t getNumPendingCallbacks() const;
+
+  /**
+   * Returns stats of callbacks enqueued via `runInEventLoop` APIs. Thread
+   * safe.
+   */
+  CallbackQueueStats getCallbackQueueStats() const;
+
+  /**
+   * Enable/disable instrumentation of the loop. Stats recorded so far are
+   * retained. Must be called from within the loop (or before it is run).
+   */
+  void setInstrumentationOptions(InstrumentationOptions const& options);
+
+  InstrumentationOptions
+  getInstrumentationOptions() const {
+    return instrumentationOptions_;
+  }
+
+  /**
+   * Returns/resets stats of the loop. Must be called from within the loop
+   * (or while it is not running), e.g. from a periodic timeout which exports
+   * `getLoopStats().getCounters(prefix)`.
+   */
+  LoopStats getLoopStats() const;
+  void resetLoopStats();
+
+  /**
+   * Bound the work done per iteration and order it by priority class, so that
+   * a chatty socket or a flood of queued callbacks can't starve timeouts and
+   * other sockets. Must be called from within the loop (or before it is run).
+   */
+  void setDispatchOptions(LoopDispatchOptions const& options);
+
+  LoopDispatchOptions
+  getDispatchOptions() const {
+    return dispatchOptions_;
+  }
+
+  /**
+   * Enable/disable busy polling, refer to `LoopSpinOptions`. Must be called
+   * from within the loop (or before it is run).
+   */
+  void setSpinOptions(LoopSpinOptions const& options);
+
+  LoopSpinOptions
+  getSpinOptions() const {
+    return spinOptions_;
+  }
+
+  /**
+   * Pin/name the thread calling `run()`. Applied on every `run()`, before
+   * anything gets dispatched, and retained by the thread after `run()`
+   * returns. Failures (e.g. lack of privileges for real-time scheduling) are
+   * logged and leave the thread as is. Must be called while the loop is not
+   * running.
+   */
+  void setThreadOptions(LoopThreadOptions const& options);
+
+  LoopThreadOptions
+  getThreadOptions() const {
+    return threadOptions_;
+  }
+
+  /**
+   * Returns the polling backend in use
+   */
+  PollBackend
+  getPollBackend() const {
+    return pollBackend_;
   }
 
  private:
@@ -264,44 +642,41 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    * Utility struct to store information about poll-item and its callback
    * for all added sockets/fds
    */
-  struct PollSubscription {
-    PollSubscription(int events, SocketCallback&& callback)
-        : events(events), callback(std::move(callback)) {}
+  struct PollSubscription
+      : public std::enable_shared_from_this<PollSubscription> {
+    PollSubscription(
+        int events,
+        SocketCallback&& callback,
+        SocketDispatchOptions const& dispatchOptions)
+        : events(events),
+          callback(std::move(callback)),
+          dispatchOptions(dispatchOptions) {}
 
     // bitmap of subscribed events
     short events{0};
 
     // callback which needs to be invoked on event.
     SocketCallback callback{nullptr};
-  };
 
-  /**
-   * Struct to maintain the timeout-state which includes its scheduleTime and
-   * associated callback.
-   */
-  struct TimeoutEvent {
-    TimeoutEvent(
-        std::chrono::steady_clock::time_point scheduledTime,
-        TimeoutCallback&& callback,
-        int64_t timeoutId)
-        : scheduledTime(scheduledTime), timeoutId(timeoutId) {
-      callbackPtr = std::make_shared<TimeoutCallback>(std::move(callback));
-    }
+    // raw zmq socket (nullptr for fd subscriptions)
+    void* socketPtr{nullptr};
 
-    // Define '>' operator for building min-heap
-    bool
-    operator>(TimeoutEvent const& rhs) const {
-      return scheduledTime > rhs.scheduledTime;
-    }
+    // subscribed fd. For sockets it is ZMQ_FD registered with EPOLL backend.
+    int fd{-1};
 
-    // Time point when this timeout should be executed
-    std::chrono::steady_clock::time_point scheduledTime;
+    // Priority and budget of the subscription
+    SocketDispatchOptions dispatchOptions;
 
-    // So that copy will not involve copy of callback
-    std::shared_ptr<TimeoutCallback> callbackPtr{nullptr};
+    // Set to false on removal. Readiness which has been already collected
+    // must not be dispatched to a removed subscription.
+    bool isRegistered{true};
 
-    // Unique-ID associated with this timeout
-    int64_t timeoutId{0};
+    //
+    // Below fields are only used by EPOLL backend
+    //
+
+    // Is this subscription queued in readySockets_ for ZMQ_EVENTS check
+    bool isQueued{false};
   };
 
   /**
@@ -309,31 +684,124 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
    */
   void loopForever();
 
+  /**
+   * Apply `threadOptions_` on the calling thread
+   */
+  void applyThreadOptions();
+
   /**
    * Helper function to rebuild the pollItems_ and pollSubscriptions_ list. This
    * is invoked only after processing of poll items is finished.
    */
   void rebuildPollItems();
 
+  /**
+   * Budgeted dispatch helpers. Poll backends collect ready subscriptions into
+   * `readyEvents_` instead of invoking them if `budgetedDispatch_` is set.
+   * `dispatchReadyEvents` then invokes them along with expired timeouts in
+   * order of priority.
+   */
+  void dispatchReadyEvents(bool instrumented);
+  void dispatchSocket(PollSubscription& subscription, int revents);
+  int getReadyEvents(PollSubscription& subscription);
+  void runExpiredTimeouts(bool instrumented);
+  void updateBudgetedDispatch();
+
+  /**
+   * Helpers for callback queue.
+   * `signalCallbackQueue` wakes up the loop unless a wakeup is already
+   * pending. `processCallbackQueue` drains the queue from within the loop.
+   */
+  void signalCallbackQueue();
+  void processCallbackQueue();
+
+  /**
+   * Control channel of the loop, shared by stop requests and callback queue.
+   * `wakeup` can be invoked from any thread, `processControlEvents` drains
+   * every wakeup issued so far with a single read and handles all of them.
+   */
+  void wakeup();
+  void processControlEvents();
+
+  /**
+   * Spinning helpers. `shouldSpin` decides whether current iteration polls
+   * without blocking and accounts for the budget. `setSpinning` publishes it
+   * to producers and makes sure no queued callback is left behind without a
+   * wakeup once spinning stops.
+   */
+  bool shouldSpin(std::chrono::steady_clock::time_point now);
+  std::chrono::nanoseconds getMaxSpinBudget() const;
+  void setSpinning(bool spinning);
+  void updateEnqueueStats(
+      size_t numCallbacks, std::chrono::steady_clock::time_point startTime);
+
+  /**
+   * Instrumentation helpers. `wrapQueuedCallback` records queue wait and
+   * duration of externally enqueued callbacks when instrumentation is on.
+   */
+  void invokeSocketCallback(PollSubscription& subscription, int revents);
+  void invokeTimeout(
+      int64_t timeoutId,
+      std::chrono::steady_clock::time_point scheduledTime,
+      TimeoutCallback& callback);
+  TimeoutCallback wrapQueuedCallback(
+      TimeoutCallback callback,
+      std::chrono::steady_clock::time_point enqueueTime);
+  void recordCallback(
+      LatencyHistogram& histogram,
+      std::chrono::nanoseconds duration,
+      folly::FunctionRef<std::string()> describe);
+
+  /**
+   * Wait for events with specified timeout and invoke callbacks of ready
+   * sockets/fds. One method per polling backend.
+   */
+  void pollZmq(std::chrono::milliseconds pollTimeout);
 #ifndef IS_BSD
-  // Local eventfd for capturing stop signal
-  int signalFd_{-1};
-  // Local eventfd for capturing the signal from newly enqueued callbacks
-  // from other threads
-  int callbackFd_{-1};
+  void pollEpoll(std::chrono::milliseconds pollTimeout);
+
+  /**
+   * EPOLL backend helpers
+   */
+  void epollRegister(PollSubscription& subscription, uint32_t epollEvents);
+  void epollUnregister(PollSubscription& subscription);
+  void queueSocket(PollSubscription& subscription);
+  void queueActiveSockets();
+#endif
+
+#ifndef IS_BSD
+  // Local eventfd waking up the loop for stop requests and callbacks
+  // enqueued from other threads. Wakeups add up in its counter, hence any
+  // number of them is consumed with a single read.
+  int controlFd_{-1};
 #else
-  // Local eventfd for capturing the signal from newly enqueued callbacks
+  // Local pipe waking up the loop for stop requests and callbacks enqueued
   // from other threads
-  int callbackFds_[2]{-1, -1};
-  // Local eventfd for capturing stop signal
-  int signalFds_[2]{-1, -1};
+  int controlFds_[2]{-1, -1};
 
   void setNonBlockingFd(int fd);
   void createPipeBsd(int fds[]);
 #endif
 
-  // Queue to hold externally enqueued events.
-  folly::MPMCQueue<TimeoutCallback, std::atomic, true> callbackQueue_;
+  // Set by `stop()` ahead of waking up the loop
+  std::atomic<bool> stopRequested_{false};
+
+  // Queue to hold externally enqueued events. Bounded or unbounded depending
+  // on queueCapacity. Only one of them is set.
+  std::unique_ptr<folly::MPMCQueue<TimeoutCallback, std::atomic, true>>
+      boundedCallbackQueue_;
+  std::unique_ptr<folly::UMPSCQueue<TimeoutCallback, false /* MayBlock */>>
+      unboundedCallbackQueue_;
+
+  // Set when a wakeup has been signalled on callback fd and loop has not yet
+  // started to process the queue. Used to coalesce wakeups.
+  std::atomic<bool> callbackSignalPending_{false};
+
+  // Callback queue stats
+  std::atomic<uint64_t> numEnqueuedCallbacks_{0};
+  std::atomic<uint64_t> numCallbackWakeups_{0};
+  std::atomic<uint64_t> totalEnqueueLatencyNs_{0};
+  std::atomic<uint64_t> maxEnqueueLatencyNs_{0};
 
   // thread-id associated with `run` loop (default value is 0). `threadId_` is
   // also being used to indicate whether a main loop is running or not
@@ -350,24 +818,85 @@ class ZmqEventLoop : public virtual Runnable, public folly::ScheduledExecutor {
   std::unordered_map<int /* socket-fd */, std::shared_ptr<PollSubscription>>
       socketFdMap_{};
 
+  // Polling backend in use
+  const PollBackend pollBackend_{PollBackend::ZMQ_POLL};
+
   // Polling item. Updated dynamically.
   bool needsRebuild_{false};
   std::vector<zmq_pollitem_t> pollItems_{};
   std::vector<std::shared_ptr<PollSubscription>> pollSubscriptions_{};
 
-  // Priority queue DS for maintaining timeout-heap and callbacks
-  boost::heap::priority_queue<
-      TimeoutEvent,
-      boost::heap::compare<std::greater<TimeoutEvent>>,
-      boost::heap::stable<true>>
-      timeoutHeap_;
+  // Loop wide dispatch options
+  LoopDispatchOptions dispatchOptions_{};
+
+  // Placement of the thread running the loop
+  LoopThreadOptions threadOptions_{};
+
+  // Spin options and state. `spinEnabled_` mirrors options and `isSpinning_`
+  // the current iteration for producers of callback queue.
+  LoopSpinOptions spinOptions_{};
+  std::atomic<bool> spinEnabled_{false};
+  std::atomic<bool> isSpinning_{false};
+  std::chrono::steady_clock::time_point lastActiveTime_{};
+  std::chrono::steady_clock::time_point lastSpinBudgetTime_{};
+  std::chrono::nanoseconds spinBudget_{0};
+
+  // Number of callbacks (of sockets/fds, timeouts and queue) invoked so far,
+  // to tell whether an iteration had anything to do
+  uint64_t numDispatched_{0};
+
+  // Set if readiness must be collected and dispatched as per priorities and
+  // budgets, else callbacks are invoked as soon as readiness is known.
+  bool budgetedDispatch_{false};
+
+  // Number of subscriptions with non-default SocketDispatchOptions
+  size_t numBudgetedSubscriptions_{0};
+
+  // Ready subscriptions of current iteration along with their revents. For
+  // sockets of EPOLL backend revents is kCheckZmqEvents, to be looked up
+  // right before dispatch.
+  std::vector<std::pair<std::shared_ptr<PollSubscription>, int>>
+      readyEvents_{};
+
+  // Rotation offset of ready events for round robin dispatch
+  size_t roundRobinOffset_{0};
+
+#ifndef IS_BSD
+  // epoll instance for EPOLL backend
+  int epollFd_{-1};
+
+  // Buffer for receiving events from epoll_wait. Grows on demand.
+  std::vector<struct epoll_event> epollEvents_{};
+
+  // Sockets for which ZMQ_EVENTS must be checked in next iteration. These
+  // are signalled sockets as well as sockets which had events in previous
+  // iteration (might still have pending messages).
+  std::vector<std::shared_ptr<PollSubscription>> readySockets_{};
+  std::vector<std::shared_ptr<PollSubscription>> readySocketsScratch_{};
+
+  // Fds that got signalled in the current iteration along with revents
+  std::vector<std::pair<std::shared_ptr<PollSubscription>, int>> readyFds_{};
+
+  // Raw sockets on which I/O has been performed from within the loop. Filled
+  // in by SocketImpl via `detail::tlsSocketActivity`.
+  std::vector<void*> socketActivity_{};
+#endif
+
+  // Timer wheel for maintaining scheduled timeouts and their callbacks
+  TimerWheel timerWheel_;
+
+  // Scheduled time of the last timeout invoked in current wakeup, to count
+  // coalesced timeouts when instrumented
+  std::chrono::steady_clock::time_point lastTimeoutTime_{};
 
-  // Maintains set of active timeouts.
-  std::unordered_set<int64_t> activeTimeouts_;
+  // Instrumentation options and stats. `instrumentationEnabled_` mirrors
+  // options for producers of callback queue.
+  InstrumentationOptions instrumentationOptions_{};
+  std::atomic<bool> instrumentationEnabled_{false};
+  LoopStats loopStats_{};
 
-  // Monotonically increasing integer used to assign IDs to newly scheduled
-  // timeouts
-  int64_t timeoutId_{0};
+  // Time at which poll of current iteration has returned
+  std::chrono::steady_clock::time_point pollReturnTime_{};
 
   // Timestamp of latest callback gets invoked
   std::atomic<std::chrono::steady_clock::duration::rep> latestActivityTs_;
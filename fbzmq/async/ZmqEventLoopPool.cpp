@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqEventLoopPool.h>
+
+#include <folly/Format.h>
+
+namespace fbzmq {
+
+ZmqEventLoopPool::ZmqEventLoopPool(size_t numLoops, Options options)
+    : options_(std::move(options)) {
+  CHECK_LT(0, numLoops) << "Pool must have at least one loop";
+  loops_.reserve(numLoops);
+  for (size_t i = 0; i < numLoops; ++i) {
+    loops_.emplace_back(std::make_unique<ZmqEventLoop>(
+        options_.queueCapacity,
+        options_.healthCheckDuration,
+        options_.pollBackend));
+
+    // Placement is applied by the loop itself as it starts running
+    LoopThreadOptions threadOptions;
+    threadOptions.name = folly::sformat("{}{}", options_.threadNamePrefix, i);
+    if (not options_.cpus.empty()) {
+      threadOptions.cpus = {options_.cpus[i % options_.cpus.size()]};
+    }
+    loops_.back()->setThreadOptions(threadOptions);
+  }
+}
+
+ZmqEventLoopPool::~ZmqEventLoopPool() {
+  CHECK(threads_.empty()) << "Destroying a running ZmqEventLoopPool";
+}
+
+void
+ZmqEventLoopPool::run() {
+  CHECK(threads_.empty()) << "Calling run() on already running pool";
+
+  threads_.reserve(loops_.size());
+  for (size_t i = 0; i < loops_.size(); ++i) {
+    threads_.emplace_back([this, i]() { loops_[i]->run(); });
+  }
+  for (auto& loop : loops_) {
+    loop->waitUntilRunning();
+  }
+  running_.store(true, std::memory_order_release);
+
+  // Block until all the loops are stopped
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  running_.store(false, std::memory_order_release);
+}
+
+void
+ZmqEventLoopPool::stop() {
+  CHECK(isRunning()) << "Attempt to stop a non-running pool";
+  for (auto& loop : loops_) {
+    loop->stop();
+  }
+}
+
+void
+ZmqEventLoopPool::add(folly::Func callback) {
+  getNextLoop().add(std::move(callback));
+}
+
+ZmqEventLoop&
+ZmqEventLoopPool::getNextLoop() {
+  const auto start = nextLoop_.fetch_add(1, std::memory_order_relaxed);
+  if (options_.dispatchPolicy == DispatchPolicy::ROUND_ROBIN) {
+    return *loops_[start % loops_.size()];
+  }
+
+  // Scan all the loops, pool is expected to have only a handful of them
+  size_t best = start % loops_.size();
+  size_t bestDepth = loops_[best]->getNumPendingCallbacks();
+  for (size_t i = 1; i < loops_.size() and bestDepth > 0; ++i) {
+    const size_t index = (start + i) % loops_.size();
+    const size_t depth = loops_[index]->getNumPendingCallbacks();
+    if (depth < bestDepth) {
+      best = index;
+      bestDepth = depth;
+    }
+  }
+  return *loops_[best];
+}
+
+ZmqEventLoop*
+ZmqEventLoopPool::getCurrentLoop() const {
+  for (auto const& loop : loops_) {
+    if (loop->isRunning() and loop->isInEventLoop()) {
+      return loop.get();
+    }
+  }
+  return nullptr;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/Executor.h>
+
+#include <fbzmq/async/Runnable.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace fbzmq {
+
+/**
+ * How `ZmqEventLoopPool::add()` and `getNextLoop()` pick a loop
+ */
+enum class PoolDispatchPolicy {
+  // Loops in turn
+  ROUND_ROBIN = 1,
+  // Loop with the least number of pending callbacks in its queue
+  LEAST_QUEUE_DEPTH = 2,
+};
+
+struct ZmqEventLoopPoolOptions {
+  // Arguments of every ZmqEventLoop. Refer to ZmqEventLoop constructor.
+  uint64_t queueCapacity{100};
+  std::chrono::seconds healthCheckDuration{30};
+  PollBackend pollBackend{PollBackend::ZMQ_POLL};
+
+  PoolDispatchPolicy dispatchPolicy{PoolDispatchPolicy::ROUND_ROBIN};
+
+  // CPUs to pin loop threads to, loop `i` is pinned to `cpus[i % size]`.
+  // Empty for no pinning. Placement is set as LoopThreadOptions of every
+  // loop, refer to ZmqEventLoop::setThreadOptions.
+  std::vector<int> cpus{};
+
+  // Threads are named `<threadNamePrefix><index>`
+  std::string threadNamePrefix{"ZmqEvlPool"};
+};
+
+/**
+ * Pool of ZmqEventLoops, every loop running in its own thread. A service can
+ * be scaled across cores by placing its sockets/sessions on loops of the
+ * pool instead of hand managing loops and their threads.
+ *
+ * - `getLoopForKey(hash)` gives sticky placement, the same key always maps to
+ *   the same loop. Use it for sockets and state which must stay on one loop.
+ * - `add()` (folly::Executor) and `getNextLoop()` distribute work as per
+ *   `DispatchPolicy`.
+ *
+ * Pool follows the Runnable contract of ZmqEventLoop. `run()` starts all the
+ * loop threads and blocks until `stop()` is invoked from any thread. Sockets
+ * and timeouts must be added to a loop from within that loop, e.g. via
+ * `runInEventLoop`, once pool is running.
+ *
+ * Usage
+ *
+ *  ZmqEventLoopPool pool(4);
+ *  std::thread poolThread([&pool]() { pool.run(); });
+ *  pool.waitUntilRunning();
+ *
+ *  auto& evl = pool.getLoopForKey(sessionId);
+ *  evl.runInEventLoop([&evl, sessionId]() { startSession(evl, sessionId); });
+ *
+ *  pool.stop();
+ *  poolThread.join();
+ */
+class ZmqEventLoopPool : public virtual Runnable, public folly::Executor {
+ public:
+  using DispatchPolicy = PoolDispatchPolicy;
+  using Options = ZmqEventLoopPoolOptions;
+
+  /**
+   * Create pool of `numLoops` (> 0) loops. Loops are created upfront and can
+   * be accessed before the pool is running.
+   */
+  explicit ZmqEventLoopPool(size_t numLoops, Options options = Options());
+
+  /**
+   * Pool must be stopped before it is destroyed
+   */
+  ~ZmqEventLoopPool() override;
+
+  /**
+   * Make this non-copyable and non-movable
+   */
+  ZmqEventLoopPool(ZmqEventLoopPool const&) = delete;
+  ZmqEventLoopPool& operator=(ZmqEventLoopPool const&) = delete;
+
+  /**
+   * Start threads of all loops. Blocks and returns only after stop() has
+   * been invoked and all loops have stopped. Can be invoked repeatedly, just
+   * like ZmqEventLoop::run().
+   */
+  void run() override;
+
+  /**
+   * Stop all the loops. Can be invoked from any thread including the loops
+   * of the pool.
+   */
+  void stop() override;
+
+  /**
+   * Pool is running once all of its loops are running
+   */
+  bool
+  isRunning() const override {
+    return running_.load(std::memory_order_acquire);
+  }
+
+  void
+  waitUntilRunning() override {
+    while (not isRunning()) {
+      std::this_thread::yield();
+    }
+  }
+
+  void
+  waitUntilStopped() override {
+    while (isRunning()) {
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * folly::Executor interface. Callback is executed in one of the loops
+   * picked as per dispatch policy. Thread safe.
+   */
+  void add(folly::Func callback) override;
+
+  /**
+   * Loop for sticky placement of a key. Always returns the same loop for a
+   * given hash.
+   */
+  ZmqEventLoop&
+  getLoopForKey(uint64_t hash) {
+    return *loops_[hash % loops_.size()];
+  }
+
+  /**
+   * Loop as per dispatch policy, e.g. for placing a new socket on the least
+   * loaded loop. Thread safe.
+   */
+  ZmqEventLoop& getNextLoop();
+
+  ZmqEventLoop&
+  getLoop(size_t index) {
+    return *loops_.at(index);
+  }
+
+  size_t
+  getNumLoops() const {
+    return loops_.size();
+  }
+
+  /**
+   * Returns loop of the calling thread if it is one of the pool's loops else
+   * nullptr
+   */
+  ZmqEventLoop* getCurrentLoop() const;
+
+ private:
+  const Options options_;
+
+  std::vector<std::unique_ptr<ZmqEventLoop>> loops_;
+
+  std::vector<std::thread> threads_;
+
+  // Next loop for round robin dispatch. Also the starting point of scans of
+  // least queue depth dispatch, so that ties are spread across loops.
+  std::atomic<uint64_t> nextLoop_{0};
+
+  std::atomic<bool> running_{false};
+};
+
+} // namespace fbzmq
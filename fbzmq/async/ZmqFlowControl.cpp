@@ -0,0 +1,391 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqFlowControl.h>
+
+#include <algorithm>
+
+#include <folly/lang/Bits.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Header frame of messages, followed by a number (uint64_t, big endian) and
+// then payload frames for data messages. Numbers are
+// - data: number of message, counting from 1 for every peer
+// - credit grant: number of the last message consumed
+// - resync: number of messages sent so far
+constexpr uint8_t kDataMsg{1};
+constexpr uint8_t kCreditMsg{2};
+constexpr uint8_t kResyncMsg{3};
+
+size_t
+getNumBytes(std::vector<Message> const& msg) {
+  size_t numBytes{0};
+  for (auto const& frame : msg) {
+    numBytes += frame.size();
+  }
+  return numBytes;
+}
+
+} // namespace
+
+ZmqFlowControl::ZmqFlowControl(
+    ZmqEventLoop& evl,
+    detail::SocketImpl& sock,
+    MessageCallback messageCallback,
+    Options options)
+    : evl_(evl),
+      sock_(sock),
+      messageCallback_(std::move(messageCallback)),
+      options_(std::move(options)) {
+  CHECK(evl_.isInEventLoop());
+  CHECK_LT(0, options_.grantBatch);
+  CHECK_LE(options_.grantBatch, options_.window);
+  CHECK_LT(0, options_.maxBatchSize);
+
+  int type{0};
+  size_t len = sizeof(type);
+  sock_.getSockOpt(ZMQ_TYPE, &type, &len).value();
+  CHECK(type == ZMQ_ROUTER or type == ZMQ_DEALER)
+      << "Flow control is supported on ROUTER and DEALER sockets only";
+  isRouter_ = type == ZMQ_ROUTER;
+
+  evl_.addSocket(
+      RawZmqSocketPtr{*sock_},
+      ZMQ_POLLIN,
+      [this](int) noexcept { recvMessages(); },
+      options_.dispatchOptions);
+
+  if (options_.resyncInterval.count() > 0) {
+    resyncTimer_ =
+        ZmqTimeout::make(&evl_, [this]() noexcept { resyncStalledPeers(); });
+    resyncTimer_->scheduleTimeout(
+        options_.resyncInterval, true /* isPeriodic */);
+  }
+}
+
+ZmqFlowControl::~ZmqFlowControl() {
+  CHECK(evl_.isInEventLoop());
+  resyncTimer_.reset();
+  evl_.removeSocket(RawZmqSocketPtr{*sock_});
+}
+
+folly::Expected<folly::Unit, Error>
+ZmqFlowControl::send(std::string const& peerId, std::vector<Message> msg) {
+  CHECK(evl_.isInEventLoop());
+  if (msg.empty()) {
+    return folly::makeUnexpected(Error(EINVAL, "Empty message"));
+  }
+
+  auto& peer = getPeer(peerId);
+  auto& stats = peer.stats;
+
+  // Preserve order, messages go after the ones already queued up
+  if (peer.queue.empty() and stats.sendCredits > 0) {
+    auto ret = sendNow(peerId, peer, msg);
+    if (ret.hasError()) {
+      return ret;
+    }
+    --stats.sendCredits;
+    ++stats.numSent;
+    return folly::unit;
+  }
+
+  const size_t numBytes = getNumBytes(msg);
+  peer.isBlocked = true;
+  if (peer.queue.size() >= options_.maxQueuedMsgsPerPeer or
+      numQueuedBytes_ + numBytes > options_.maxQueuedBytes) {
+    ++stats.numRejected;
+    return folly::makeUnexpected(Error(ENOBUFS, "Peer is out of credit"));
+  }
+  peer.queue.emplace_back(std::move(msg));
+  ++stats.numQueued;
+  ++stats.numQueuedMsgs;
+  stats.numQueuedBytes += numBytes;
+  numQueuedBytes_ += numBytes;
+  return folly::unit;
+}
+
+void
+ZmqFlowControl::removePeer(std::string const& peerId) {
+  CHECK(evl_.isInEventLoop());
+  auto it = peers_.find(peerId);
+  if (it == peers_.end()) {
+    return;
+  }
+  numQueuedBytes_ -= it->second.stats.numQueuedBytes;
+  peers_.erase(it);
+}
+
+folly::Optional<ZmqFlowControlPeerStats>
+ZmqFlowControl::getPeerStats(std::string const& peerId) const {
+  CHECK(evl_.isInEventLoop());
+  auto it = peers_.find(peerId);
+  if (it == peers_.end()) {
+    return folly::none;
+  }
+  return it->second.stats;
+}
+
+std::unordered_map<std::string, ZmqFlowControlPeerStats>
+ZmqFlowControl::getAllPeerStats() const {
+  CHECK(evl_.isInEventLoop());
+  std::unordered_map<std::string, ZmqFlowControlPeerStats> allStats;
+  for (auto const& kv : peers_) {
+    allStats.emplace(kv.first, kv.second.stats);
+  }
+  return allStats;
+}
+
+std::unordered_map<std::string, int64_t>
+ZmqFlowControl::getCounters(std::string const& prefix) const {
+  CHECK(evl_.isInEventLoop());
+  ZmqFlowControlPeerStats total;
+  size_t maxQueuedMsgs{0};
+  for (auto const& kv : peers_) {
+    auto const& stats = kv.second.stats;
+    total.numQueuedMsgs += stats.numQueuedMsgs;
+    total.numQueuedBytes += stats.numQueuedBytes;
+    total.numSent += stats.numSent;
+    total.numReceived += stats.numReceived;
+    total.numQueued += stats.numQueued;
+    total.numRejected += stats.numRejected;
+    total.numLost += stats.numLost;
+    total.numResyncs += stats.numResyncs;
+    maxQueuedMsgs = std::max(maxQueuedMsgs, stats.numQueuedMsgs);
+  }
+
+  std::unordered_map<std::string, int64_t> counters;
+  counters[prefix + ".peers"] = peers_.size();
+  counters[prefix + ".queued_msgs"] = total.numQueuedMsgs;
+  counters[prefix + ".queued_msgs.max"] = maxQueuedMsgs;
+  counters[prefix + ".queued_bytes"] = total.numQueuedBytes;
+  counters[prefix + ".sent"] = total.numSent;
+  counters[prefix + ".received"] = total.numReceived;
+  counters[prefix + ".queued"] = total.numQueued;
+  counters[prefix + ".rejected"] = total.numRejected;
+  counters[prefix + ".lost"] = total.numLost;
+  counters[prefix + ".resyncs"] = total.numResyncs;
+  return counters;
+}
+
+ZmqFlowControl::Peer&
+ZmqFlowControl::getPeer(std::string const& peerId) {
+  auto it = peers_.find(peerId);
+  if (it == peers_.end()) {
+    // Every peer starts with a full window
+    it = peers_.emplace(peerId, Peer()).first;
+    it->second.stats.sendCredits = options_.window;
+    it->second.lastCreditTime = std::chrono::steady_clock::now();
+  }
+  return it->second;
+}
+
+void
+ZmqFlowControl::recvMessages() noexcept {
+  const size_t headerIndex = isRouter_ ? 1 : 0;
+  for (size_t i = 0; i < options_.maxBatchSize; ++i) {
+    auto ret = sock_.recvMultipleInto(frames_, std::chrono::milliseconds(0));
+    if (ret.hasError()) {
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqFlowControl: Failed to receive message. "
+                   << ret.error();
+      }
+      return;
+    }
+
+    if (frames_.size() <= headerIndex) {
+      LOG(ERROR) << "ZmqFlowControl: Dropping message without header";
+      continue;
+    }
+    const auto peerId =
+        isRouter_ ? frames_[0].read<std::string>().value() : std::string();
+    const auto header = frames_[headerIndex].read<uint8_t>();
+    folly::Optional<uint64_t> seqNum;
+    if (frames_.size() > headerIndex + 1) {
+      auto num = frames_[headerIndex + 1].read<uint64_t>();
+      if (num.hasValue()) {
+        seqNum = folly::Endian::big(num.value());
+      }
+    }
+    if (not header.hasValue() or not seqNum.hasValue()) {
+      LOG(ERROR) << "ZmqFlowControl: Dropping message with invalid header";
+      continue;
+    }
+
+    if (header.value() == kDataMsg) {
+      std::vector<Message> msg(
+          std::make_move_iterator(frames_.begin() + headerIndex + 2),
+          std::make_move_iterator(frames_.end()));
+      ++getPeer(peerId).stats.numReceived;
+      messageCallback_(peerId, std::move(msg));
+
+      // Callback might have removed the peer
+      auto it = peers_.find(peerId);
+      if (it != peers_.end()) {
+        consumed(peerId, it->second, seqNum.value());
+      }
+    } else if (
+        header.value() == kCreditMsg and frames_.size() == headerIndex + 2) {
+      addCredits(peerId, getPeer(peerId), seqNum.value());
+    } else if (
+        header.value() == kResyncMsg and frames_.size() == headerIndex + 2) {
+      resync(peerId, getPeer(peerId), seqNum.value());
+    } else {
+      LOG(ERROR) << "ZmqFlowControl: Dropping message with invalid header";
+    }
+  }
+}
+
+void
+ZmqFlowControl::addCredits(
+    std::string const& peerId, Peer& peer, uint64_t consumed) {
+  auto& stats = peer.stats;
+  peer.lastCreditTime = std::chrono::steady_clock::now();
+
+  // Window is relative to what peer consumed. Peer may have started over
+  // (e.g. restarted) while we didn't, credits never exceed the window.
+  const uint64_t granted = consumed + options_.window;
+  stats.sendCredits = granted > stats.numSent
+      ? std::min<uint64_t>(granted - stats.numSent, options_.window)
+      : 0;
+
+  // Flush queued up messages as far as credits go
+  while (stats.sendCredits > 0 and not peer.queue.empty()) {
+    auto msg = std::move(peer.queue.front());
+    peer.queue.pop_front();
+    const size_t numBytes = getNumBytes(msg);
+    --stats.numQueuedMsgs;
+    stats.numQueuedBytes -= numBytes;
+    numQueuedBytes_ -= numBytes;
+
+    auto ret = sendNow(peerId, peer, msg);
+    if (ret.hasError()) {
+      LOG(ERROR) << "ZmqFlowControl: Dropping queued message. "
+                 << ret.error();
+      continue;
+    }
+    --stats.sendCredits;
+    ++stats.numSent;
+  }
+
+  if (peer.isBlocked and peer.queue.empty()) {
+    peer.isBlocked = false;
+    if (drainedCallback_) {
+      drainedCallback_(peerId);
+    }
+  }
+}
+
+void
+ZmqFlowControl::consumed(
+    std::string const& peerId, Peer& peer, uint64_t seqNum) {
+  // Message numbered at or below the last one means peer started over
+  const bool isRestarted = seqNum <= peer.numConsumed;
+  advanceConsumed(peer, seqNum);
+  grantCredits(peerId, peer, isRestarted);
+}
+
+void
+ZmqFlowControl::resync(
+    std::string const& peerId, Peer& peer, uint64_t numSent) {
+  // Messages sent before resync which haven't arrived by now never will, as
+  // messages of a connection are delivered in order
+  advanceConsumed(peer, numSent);
+  grantCredits(peerId, peer, true /* force */);
+}
+
+void
+ZmqFlowControl::advanceConsumed(Peer& peer, uint64_t seqNum) {
+  if (seqNum > peer.numConsumed + 1) {
+    peer.stats.numLost += seqNum - peer.numConsumed - 1;
+  }
+  peer.numConsumed = seqNum;
+  if (peer.numGranted > peer.numConsumed) {
+    // Peer started over
+    peer.numGranted = 0;
+  }
+  peer.stats.numUngranted = peer.numConsumed - peer.numGranted;
+}
+
+void
+ZmqFlowControl::grantCredits(
+    std::string const& peerId, Peer& peer, bool force) {
+  if (not force and peer.stats.numUngranted < options_.grantBatch) {
+    return;
+  }
+
+  // Grant credits back, retried on next message (or resync) if it fails
+  auto ret = sendControl(peerId, kCreditMsg, peer.numConsumed);
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqFlowControl: Failed to grant credits. " << ret.error();
+    return;
+  }
+  peer.numGranted = peer.numConsumed;
+  peer.stats.numUngranted = 0;
+}
+
+void
+ZmqFlowControl::resyncStalledPeers() noexcept {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& kv : peers_) {
+    auto& peer = kv.second;
+    if (peer.queue.empty() or peer.stats.sendCredits > 0 or
+        now - peer.lastCreditTime < options_.resyncInterval) {
+      continue;
+    }
+    VLOG(2) << "ZmqFlowControl: Peer '" << kv.first << "' is stalled for "
+            << "lack of credits, asking it to resync";
+    auto ret = sendControl(kv.first, kResyncMsg, peer.stats.numSent);
+    if (ret.hasError()) {
+      LOG(ERROR) << "ZmqFlowControl: Failed to resync. " << ret.error();
+      continue;
+    }
+    ++peer.stats.numResyncs;
+    peer.lastCreditTime = now;
+  }
+}
+
+folly::Expected<folly::Unit, Error>
+ZmqFlowControl::sendControl(
+    std::string const& peerId, uint8_t type, uint64_t value) {
+  frames_.clear();
+  if (isRouter_) {
+    frames_.emplace_back(Message::from(peerId).value());
+  }
+  frames_.emplace_back(Message::from(type).value());
+  frames_.emplace_back(Message::from(folly::Endian::big(value)).value());
+  auto ret = sock_.sendBatch(std::move(frames_));
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  return folly::unit;
+}
+
+folly::Expected<folly::Unit, Error>
+ZmqFlowControl::sendNow(
+    std::string const& peerId, Peer& peer, std::vector<Message>& msg) {
+  frames_.clear();
+  if (isRouter_) {
+    frames_.emplace_back(Message::from(peerId).value());
+  }
+  frames_.emplace_back(Message::from(kDataMsg).value());
+  frames_.emplace_back(
+      Message::from(folly::Endian::big(peer.stats.numSent + 1)).value());
+  for (auto& frame : msg) {
+    frames_.emplace_back(std::move(frame));
+  }
+  auto ret = sock_.sendBatch(std::move(frames_));
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  return folly::unit;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+struct ZmqFlowControlOptions {
+  // Messages a peer can send ahead of being granted more credits. Must be the
+  // same on both ends. Keep it below HWMs of sockets, so that libzmq never
+  // gets to drop (ROUTER) or block (DEALER) messages.
+  uint32_t window{1000};
+
+  // Receiver grants credits back to a peer for every so many messages of the
+  // peer it has consumed. Must not exceed `window`.
+  uint32_t grantBatch{100};
+
+  // Bounds of messages queued up by sender while peers are out of credit.
+  // Sending fails with ENOBUFS beyond them.
+  size_t maxQueuedMsgsPerPeer{10000};
+  size_t maxQueuedBytes{64 * 1024 * 1024};
+
+  // Max messages received in one go whenever socket becomes readable
+  size_t maxBatchSize{128};
+
+  // Sender which has been out of credit (with messages queued up) for this
+  // long asks peer to resync credits, which recovers from lost grants and
+  // data messages. 0 disables resync.
+  std::chrono::milliseconds resyncInterval{1000};
+
+  // Priority and budget of the socket on the loop
+  SocketDispatchOptions dispatchOptions{};
+};
+
+/**
+ * Flow control state and stats of a peer
+ */
+struct ZmqFlowControlPeerStats {
+  // Messages which can be sent to peer right away
+  uint32_t sendCredits{0};
+
+  // Messages (and their bytes) queued up for peer, waiting for credits
+  size_t numQueuedMsgs{0};
+  size_t numQueuedBytes{0};
+
+  // Messages received from peer and consumed, not yet granted back
+  uint32_t numUngranted{0};
+
+  // Messages sent to (including the queued ones once sent) and received from
+  // peer
+  uint64_t numSent{0};
+  uint64_t numReceived{0};
+
+  // Messages queued up for lack of credits, and rejected for lack of queue
+  uint64_t numQueued{0};
+  uint64_t numRejected{0};
+
+  // Messages of peer which never arrived, as told by gaps in their sequence
+  uint64_t numLost{0};
+
+  // Resyncs asked of peer while out of credit
+  uint64_t numResyncs{0};
+};
+
+/**
+ * Credit based flow control of messages over a ROUTER or DEALER socket.
+ *
+ * Every peer may have up to `window` messages in flight towards the other
+ * end. Receiver grants credits back as it consumes messages (handed over to
+ * `MessageCallback`) and sender queues messages up locally, within bounded
+ * memory, while peer is out of credit. Hence a slow peer doesn't make libzmq
+ * silently drop (ROUTER at HWM) or block (DEALER at HWM) messages. Instead,
+ * `send()` fails with ENOBUFS once the queue of a peer is full and producers
+ * can back off until `DrainedCallback` reports the queue of peer as empty.
+ *
+ *  ZmqFlowControl flow(evl, router, [](std::string const& peer,
+ *                                      std::vector<Message>&& msg) noexcept {
+ *    ...
+ *  });
+ *  auto ret = flow.send(peer, std::move(msg));
+ *  if (ret.hasError() and ret.error().errNum == ENOBUFS) {
+ *    // back off till drained callback is invoked for peer
+ *  }
+ *
+ * Both ends of a connection must use flow control. Messages are prefixed by
+ * header frames (following the identity frame on ROUTER), credit grants are
+ * control messages of their own. Data messages are numbered and grants carry
+ * the cumulative number of messages consumed, rather than increments, hence
+ * window of sender is `window + consumed - sent` and a lost grant is made up
+ * for by the next one. Receiver accounts for lost data messages by gaps in
+ * their numbers, and a sender stalled for `resyncInterval` tells receiver the
+ * number of messages it sent, so that receiver grants all of them. Peers are
+ * identified by identity on ROUTER. DEALER has a single peer identified by an
+ * empty string, hence it must be connected to only one ROUTER.
+ *
+ * Socket is owned by caller and must outlive flow control. Flow control must
+ * be created, used and destroyed in the thread of the loop (or before loop is
+ * running). State of ROUTER peers is retained till `removePeer()`.
+ */
+class ZmqFlowControl {
+ public:
+  using Options = ZmqFlowControlOptions;
+
+  // Message received from peer, with its header (and identity) stripped
+  using MessageCallback = folly::Function<void(
+      std::string const& peer, std::vector<Message>&& msg) noexcept>;
+
+  // Queue of a peer which was out of credit or rejected a message has been
+  // drained completely
+  using DrainedCallback =
+      folly::Function<void(std::string const& peer) noexcept>;
+
+  ZmqFlowControl(
+      ZmqEventLoop& evl,
+      detail::SocketImpl& sock,
+      MessageCallback messageCallback,
+      Options options = Options());
+
+  ~ZmqFlowControl();
+
+  ZmqFlowControl(ZmqFlowControl const&) = delete;
+  ZmqFlowControl& operator=(ZmqFlowControl const&) = delete;
+
+  /**
+   * Send message (frames of a multipart message) to peer, right away if peer
+   * has credit else once it gets granted. Errors
+   * - ENOBUFS: Queue of peer (or all queues together) is full
+   * - Errors of sending on socket, if sent right away
+   */
+  folly::Expected<folly::Unit, Error> send(
+      std::string const& peer, std::vector<Message> msg);
+
+  void
+  setDrainedCallback(DrainedCallback drainedCallback) {
+    drainedCallback_ = std::move(drainedCallback);
+  }
+
+  /**
+   * Forget state of peer, dropping messages queued up for it. Peer starts
+   * over with a full window if it shows up again.
+   */
+  void removePeer(std::string const& peer);
+
+  /**
+   * Stats of a peer or of all peers
+   */
+  folly::Optional<ZmqFlowControlPeerStats> getPeerStats(
+      std::string const& peer) const;
+  std::unordered_map<std::string, ZmqFlowControlPeerStats> getAllPeerStats()
+      const;
+
+  /**
+   * Flat counters of stats summed up across peers with given key prefix,
+   * e.g. `<prefix>.queued_msgs`, along with the longest queue of a peer as
+   * `<prefix>.queued_msgs.max`
+   */
+  std::unordered_map<std::string, int64_t> getCounters(
+      std::string const& prefix) const;
+
+ private:
+  struct Peer {
+    ZmqFlowControlPeerStats stats;
+
+    // Messages waiting for credits
+    std::deque<std::vector<Message>> queue;
+
+    // Peer hit the end of its credit or queue since it was last drained
+    bool isBlocked{false};
+
+    // Number of the last message of peer consumed, and the number last
+    // granted back to peer
+    uint64_t numConsumed{0};
+    uint64_t numGranted{0};
+
+    // Time credits were last granted by peer (or resync asked of it)
+    std::chrono::steady_clock::time_point lastCreditTime;
+  };
+
+  Peer& getPeer(std::string const& peer);
+
+  // Receive up to a batch of messages
+  void recvMessages() noexcept;
+
+  // Handle credit grant from peer, with number of messages peer consumed
+  void addCredits(std::string const& peerId, Peer& peer, uint64_t consumed);
+
+  // Account for consumed message of peer, with its number, granting credits
+  // if due
+  void consumed(std::string const& peerId, Peer& peer, uint64_t seqNum);
+
+  // Handle resync from peer, with number of messages peer sent
+  void resync(std::string const& peerId, Peer& peer, uint64_t numSent);
+
+  // Account for messages of peer upto `seqNum` as consumed, including lost
+  // ones
+  void advanceConsumed(Peer& peer, uint64_t seqNum);
+
+  // Grant credits back to peer if due (or if `force`d)
+  void grantCredits(std::string const& peerId, Peer& peer, bool force);
+
+  // Ask peers which are stalled for lack of credit to resync
+  void resyncStalledPeers() noexcept;
+
+  // Send control message of given type and value to peer
+  folly::Expected<folly::Unit, Error> sendControl(
+      std::string const& peerId, uint8_t type, uint64_t value);
+
+  // Send message (with header) to peer on socket
+  folly::Expected<folly::Unit, Error> sendNow(
+      std::string const& peerId, Peer& peer, std::vector<Message>& msg);
+
+  ZmqEventLoop& evl_;
+  detail::SocketImpl& sock_;
+  MessageCallback messageCallback_;
+  DrainedCallback drainedCallback_;
+  const Options options_;
+
+  // Whether messages are prefixed by identity of peer
+  bool isRouter_{false};
+
+  std::unordered_map<std::string, Peer> peers_;
+
+  // Total bytes queued up across peers
+  size_t numQueuedBytes_{0};
+
+  // Timer for resync of stalled peers
+  std::unique_ptr<ZmqTimeout> resyncTimer_;
+
+  // Frames of message being received/sent, reused across messages
+  std::vector<Message> frames_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqProxy.h>
+
+#include <limits>
+
+namespace fbzmq {
+
+namespace {
+
+int
+getSocketType(detail::SocketImpl& sock) {
+  int type{0};
+  size_t len = sizeof(type);
+  sock.getSockOpt(ZMQ_TYPE, &type, &len).value();
+  return type;
+}
+
+bool
+canRecv(int type) {
+  return type != ZMQ_PUB and type != ZMQ_PUSH;
+}
+
+bool
+canSend(int type) {
+  return type != ZMQ_SUB and type != ZMQ_PULL;
+}
+
+void
+addDirectionCounters(
+    std::unordered_map<std::string, int64_t>& counters,
+    std::string const& prefix,
+    ZmqProxyDirectionStats const& stats) {
+  counters[prefix + ".msgs"] = stats.numMsgs;
+  counters[prefix + ".frames"] = stats.numFrames;
+  counters[prefix + ".bytes"] = stats.numBytes;
+  counters[prefix + ".dropped"] = stats.numDropped;
+  counters[prefix + ".captured"] = stats.numCaptured;
+}
+
+} // namespace
+
+std::unordered_map<std::string, int64_t>
+ZmqProxyStats::getCounters(std::string const& prefix) const {
+  std::unordered_map<std::string, int64_t> counters;
+  addDirectionCounters(
+      counters, prefix + ".frontend_to_backend", frontendToBackend);
+  addDirectionCounters(
+      counters, prefix + ".backend_to_frontend", backendToFrontend);
+  return counters;
+}
+
+ZmqProxy::ZmqProxy(
+    ZmqEventLoop& evl,
+    detail::SocketImpl& frontend,
+    detail::SocketImpl& backend,
+    detail::SocketImpl* capture,
+    Options options)
+    : evl_(evl),
+      frontend_(frontend),
+      backend_(backend),
+      capture_(capture),
+      options_(std::move(options)) {
+  CHECK_LT(0, options_.maxBatchSize);
+
+  const int frontendType = getSocketType(frontend_);
+  const int backendType = getSocketType(backend_);
+  isFrontendToBackend_ = canRecv(frontendType) and canSend(backendType);
+  isBackendToFrontend_ = canRecv(backendType) and canSend(frontendType);
+  CHECK(isFrontendToBackend_ or isBackendToFrontend_)
+      << "Messages can't flow between frontend and backend";
+}
+
+ZmqProxy::~ZmqProxy() {
+  CHECK(evl_.isInEventLoop());
+  removeSockets();
+}
+
+void
+ZmqProxy::start() {
+  CHECK(evl_.isInEventLoop());
+  CHECK(getState() == State::IDLE) << "Proxy has already been started";
+  setState(State::RUNNING);
+}
+
+void
+ZmqProxy::pause() {
+  evl_.runImmediatelyOrInEventLoop([this]() noexcept {
+    if (getState() == State::RUNNING) {
+      setState(State::PAUSED);
+    }
+  });
+}
+
+void
+ZmqProxy::resume() {
+  evl_.runImmediatelyOrInEventLoop([this]() noexcept {
+    if (getState() == State::PAUSED) {
+      setState(State::RUNNING);
+    }
+  });
+}
+
+void
+ZmqProxy::terminate() {
+  evl_.runImmediatelyOrInEventLoop(
+      [this]() noexcept { setState(State::TERMINATED); });
+}
+
+ZmqProxyStats
+ZmqProxy::getStats() const {
+  CHECK(evl_.isInEventLoop());
+  return stats_;
+}
+
+void
+ZmqProxy::resetStats() {
+  CHECK(evl_.isInEventLoop());
+  stats_ = ZmqProxyStats();
+}
+
+void
+ZmqProxy::setState(State state) {
+  if (state == State::RUNNING) {
+    addSockets();
+  } else {
+    removeSockets();
+  }
+  state_.store(state, std::memory_order_release);
+}
+
+void
+ZmqProxy::addSockets() {
+  if (socketsAdded_) {
+    return;
+  }
+  if (isFrontendToBackend_) {
+    evl_.addSocket(
+        RawZmqSocketPtr{*frontend_},
+        ZMQ_POLLIN,
+        [this](int) noexcept {
+          forward(
+              frontend_,
+              backend_,
+              options_.captureFrontendToBackend,
+              stats_.frontendToBackend);
+        },
+        options_.dispatchOptions);
+  }
+  if (isBackendToFrontend_) {
+    evl_.addSocket(
+        RawZmqSocketPtr{*backend_},
+        ZMQ_POLLIN,
+        [this](int) noexcept {
+          forward(
+              backend_,
+              frontend_,
+              options_.captureBackendToFrontend,
+              stats_.backendToFrontend);
+        },
+        options_.dispatchOptions);
+  }
+  socketsAdded_ = true;
+}
+
+void
+ZmqProxy::removeSockets() {
+  if (not socketsAdded_) {
+    return;
+  }
+  if (isFrontendToBackend_) {
+    evl_.removeSocket(RawZmqSocketPtr{*frontend_});
+  }
+  if (isBackendToFrontend_) {
+    evl_.removeSocket(RawZmqSocketPtr{*backend_});
+  }
+  socketsAdded_ = false;
+}
+
+void
+ZmqProxy::forward(
+    detail::SocketImpl& src,
+    detail::SocketImpl& dst,
+    bool capture,
+    ZmqProxyDirectionStats& stats) noexcept {
+  // Socket is readable, hence don't wait for the first message
+  auto ret = src.recvBatch(
+      frames_,
+      options_.maxBatchSize,
+      std::numeric_limits<size_t>::max(),
+      std::chrono::milliseconds(0));
+  if (ret.hasError() and frames_.empty()) {
+    if (ret.error().errNum != EAGAIN) {
+      LOG(ERROR) << "Proxy failed to receive message. " << ret.error();
+    }
+    return;
+  }
+
+  // Forward message by message. Frames of a message never get split, hence a
+  // message is either forwarded or dropped as a whole.
+  bool isFirst{true};
+  bool isDropping{false};
+  bool isCapturing{false};
+  for (auto& frame : frames_) {
+    const bool isLast = frame.isLast();
+    if (isFirst and capture and capture_ and options_.captureSampleRate) {
+      isCapturing = ++numSinceCapture_ >= options_.captureSampleRate;
+      if (isCapturing) {
+        numSinceCapture_ = 0;
+      }
+    }
+    if (isCapturing) {
+      // Copy shares payload of the frame
+      auto copy = frame;
+      auto sent = isLast ? capture_->sendOne(std::move(copy))
+                         : capture_->sendMore(std::move(copy));
+      if (isLast) {
+        stats.numCaptured += sent.hasValue() ? 1 : 0;
+        isCapturing = false;
+      }
+    }
+
+    if (not isDropping) {
+      const size_t size = frame.size();
+      auto sent = isLast ? dst.sendOne(std::move(frame))
+                         : dst.sendMore(std::move(frame));
+      if (sent.hasValue()) {
+        ++stats.numFrames;
+        stats.numBytes += size;
+      } else {
+        VLOG(2) << "Proxy failed to forward message. " << sent.error();
+        isDropping = true;
+      }
+    }
+    if (isLast) {
+      ++(isDropping ? stats.numDropped : stats.numMsgs);
+      isDropping = false;
+    }
+    isFirst = isLast;
+  }
+  frames_.clear();
+
+  if (ret.hasError()) {
+    LOG(ERROR) << "Proxy failed to receive message. " << ret.error();
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+struct ZmqProxyOptions {
+  // Max messages forwarded in one go whenever a socket becomes readable.
+  // Bounds the time spent by proxy in an iteration of the loop.
+  size_t maxBatchSize{128};
+
+  // Forward every Nth message (of both directions) to capture socket, if one
+  // is set. 1 captures all the messages (as `zmq_proxy` does), 0 none.
+  uint32_t captureSampleRate{1};
+
+  // Directions copied onto capture socket, e.g. only frontend to backend to
+  // record requests for replaying them later (refer to MessageCaptureWriter)
+  bool captureFrontendToBackend{true};
+  bool captureBackendToFrontend{true};
+
+  // Priority and budget of proxy sockets on the loop
+  SocketDispatchOptions dispatchOptions{};
+};
+
+/**
+ * Stats of one direction of the proxy
+ */
+struct ZmqProxyDirectionStats {
+  // Complete (possibly multipart) messages, their frames and bytes forwarded
+  uint64_t numMsgs{0};
+  uint64_t numFrames{0};
+  uint64_t numBytes{0};
+
+  // Messages which couldn't be forwarded, e.g. EAGAIN on non-blocking
+  // destination socket
+  uint64_t numDropped{0};
+
+  // Messages copied onto capture socket
+  uint64_t numCaptured{0};
+};
+
+struct ZmqProxyStats {
+  ZmqProxyDirectionStats frontendToBackend;
+  ZmqProxyDirectionStats backendToFrontend;
+
+  /**
+   * Flat counters of stats with given key prefix, e.g.
+   * `<prefix>.frontend_to_backend.msgs`. Can be published via
+   * `ThreadData::setCounters`.
+   */
+  std::unordered_map<std::string, int64_t> getCounters(
+      std::string const& prefix) const;
+};
+
+/**
+ * Forwards messages between frontend and backend sockets, just like
+ * `fbzmq::proxy()` (`zmq_proxy`). But rather than taking over a thread it runs
+ * on a ZmqEventLoop alongside other sockets and timers of the loop, and can be
+ * paused, resumed and terminated from any thread.
+ *
+ *  Socket<ZMQ_ROUTER, ZMQ_SERVER> frontend(context);
+ *  Socket<ZMQ_DEALER, ZMQ_SERVER> backend(context);
+ *  frontend.bind(SocketUrl{"tcp://*:5555"});
+ *  backend.bind(SocketUrl{"inproc://workers"});
+ *
+ *  ZmqProxy proxy(evl, frontend, backend);
+ *  proxy.start();
+ *
+ * Messages are moved frame by frame without copying their payload, up to
+ * `maxBatchSize` messages whenever a socket is readable. Direction is only
+ * polled if source can receive and destination can send, e.g. only frontend
+ * to backend for PULL -> PUSH. Optional capture socket gets a sampled copy of
+ * messages (refer to `captureSampleRate`), copies share payload of original.
+ *
+ * Forwarding on blocking sockets blocks the loop if destination is at HWM,
+ * just like `zmq_proxy`. With non-blocking sockets messages are dropped
+ * instead and accounted in stats.
+ *
+ * To scale across cores, run one proxy per loop of a ZmqEventLoopPool, each
+ * with its own pair of sockets, e.g. ROUTER frontends connecting to a
+ * (remote) DEALER and DEALER backends load balancing over workers.
+ *
+ * Sockets are owned by caller and must outlive the proxy. Proxy must be
+ * started and destroyed in the thread of the loop (or before loop is
+ * running).
+ */
+class ZmqProxy {
+ public:
+  using Options = ZmqProxyOptions;
+
+  enum class State {
+    // Created, but not yet started
+    IDLE = 0,
+    // Forwarding messages
+    RUNNING = 1,
+    // Not forwarding messages. Messages queue up in sockets till HWM.
+    PAUSED = 2,
+    // Stopped for good
+    TERMINATED = 3,
+  };
+
+  ZmqProxy(
+      ZmqEventLoop& evl,
+      detail::SocketImpl& frontend,
+      detail::SocketImpl& backend,
+      detail::SocketImpl* capture = nullptr,
+      Options options = Options());
+
+  ~ZmqProxy();
+
+  ZmqProxy(ZmqProxy const&) = delete;
+  ZmqProxy& operator=(ZmqProxy const&) = delete;
+
+  /**
+   * Start forwarding messages
+   */
+  void start();
+
+  /**
+   * Steering of proxy. Thread safe, takes effect right away if invoked from
+   * within the loop else on next iteration of the loop.
+   */
+  void pause();
+  void resume();
+  void terminate();
+
+  State
+  getState() const {
+    return state_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Stats. Can only be accessed from within the loop.
+   */
+  ZmqProxyStats getStats() const;
+  void resetStats();
+
+ private:
+  // Add/remove sockets to/from the loop
+  void addSockets();
+  void removeSockets();
+
+  // Forward up to a batch of messages from `src` to `dst`, sampling them
+  // onto capture socket if `capture` is set
+  void forward(
+      detail::SocketImpl& src,
+      detail::SocketImpl& dst,
+      bool capture,
+      ZmqProxyDirectionStats& stats) noexcept;
+
+  // State transition from within the loop
+  void setState(State state);
+
+  ZmqEventLoop& evl_;
+  detail::SocketImpl& frontend_;
+  detail::SocketImpl& backend_;
+  detail::SocketImpl* capture_{nullptr};
+  const Options options_;
+
+  // Directions in which messages can flow as per socket types
+  bool isFrontendToBackend_{false};
+  bool isBackendToFrontend_{false};
+
+  std::atomic<State> state_{State::IDLE};
+  bool socketsAdded_{false};
+
+  // Frames of received batch, reused across batches
+  std::vector<Message> frames_;
+
+  // Messages seen by sampler since the last captured message
+  uint32_t numSinceCapture_{0};
+
+  ZmqProxyStats stats_;
+};
+
+} // namespace fbzmq
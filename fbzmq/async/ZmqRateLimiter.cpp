@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqRateLimiter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace fbzmq {
+
+ZmqRateLimiter::ZmqRateLimiter(
+    folly::ScheduledExecutor* evl, double ratePerSec, size_t burstSize)
+    : ZmqTimeout(evl),
+      ratePerSec_(ratePerSec),
+      burstSize_(static_cast<double>(burstSize)),
+      tokens_(static_cast<double>(burstSize)),
+      lastRefillTime_(std::chrono::steady_clock::now()) {
+  CHECK_LT(0, ratePerSec);
+  CHECK_LT(0, burstSize);
+}
+
+bool
+ZmqRateLimiter::tryAcquire(size_t tokens) {
+  if (not pending_.empty()) {
+    return false;
+  }
+  refill();
+  if (tokens_ < static_cast<double>(tokens)) {
+    return false;
+  }
+  tokens_ -= static_cast<double>(tokens);
+  return true;
+}
+
+void
+ZmqRateLimiter::run(TimeoutCallback callback) {
+  if (tryAcquire()) {
+    callback();
+    return;
+  }
+
+  pending_.emplace_back(std::move(callback));
+  if (not isScheduled()) {
+    scheduleNextToken();
+  }
+}
+
+double
+ZmqRateLimiter::getAvailableTokens() {
+  refill();
+  return tokens_;
+}
+
+void
+ZmqRateLimiter::clearPending() {
+  pending_.clear();
+  cancelTimeout();
+}
+
+void
+ZmqRateLimiter::timeoutExpired() noexcept {
+  refill();
+  // Callbacks can queue up more callbacks, which go after existing ones
+  while (not pending_.empty() and tokens_ >= 1) {
+    tokens_ -= 1;
+    auto callback = std::move(pending_.front());
+    pending_.pop_front();
+    callback();
+  }
+  if (not pending_.empty() and not isScheduled()) {
+    scheduleNextToken();
+  }
+}
+
+void
+ZmqRateLimiter::refill() {
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> elapsed = now - lastRefillTime_;
+  lastRefillTime_ = now;
+  tokens_ = std::min(burstSize_, tokens_ + elapsed.count() * ratePerSec_);
+}
+
+void
+ZmqRateLimiter::scheduleNextToken() {
+  // Round up, ZmqTimeout has millisecond granularity
+  const double waitMs = std::max(0.0, (1 - tokens_) * 1000 / ratePerSec_);
+  scheduleTimeout(std::chrono::milliseconds(
+      std::max<int64_t>(1, static_cast<int64_t>(std::ceil(waitMs)))));
+}
+
+} // namespace fbzmq
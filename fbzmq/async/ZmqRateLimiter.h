@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+
+namespace fbzmq {
+
+/**
+ * Token bucket rate limiter. Bucket holds up to `burstSize` tokens and gets
+ * refilled at `ratePerSec` tokens per second. Every operation consumes one
+ * token.
+ *
+ * For e.g. to stay under HWM of a peer while sending updates
+ *
+ *  // 1000 msgs per second with bursts of up to 100 msgs
+ *  ZmqRateLimiter limiter(evl, 1000, 100);
+ *
+ *  limiter.run([this, msg = std::move(msg)]() mutable noexcept {
+ *    sock_.sendOne(std::move(msg));
+ *  });
+ *
+ * `run()` invokes callback immediately if a token is available else queues it
+ * up. Queued callbacks are invoked in order from the event loop as tokens
+ * become available. `tryAcquire()` is the non-queueing alternative.
+ *
+ * Not thread safe, must be used from within the event loop.
+ */
+class ZmqRateLimiter final : private ZmqTimeout {
+ public:
+  ZmqRateLimiter(
+      folly::ScheduledExecutor* evl, double ratePerSec, size_t burstSize);
+
+  ~ZmqRateLimiter() override = default;
+
+  /**
+   * Consume `tokens` if available. Always fails while callbacks are waiting
+   * for tokens so that they are not starved.
+   *
+   * @returns: true if tokens have been consumed else false
+   */
+  bool tryAcquire(size_t tokens = 1);
+
+  /**
+   * Invoke callback now if a token is available and no other callback is
+   * waiting, else queue it up for later.
+   */
+  void run(TimeoutCallback callback);
+
+  /**
+   * Tokens in bucket as of now
+   */
+  double getAvailableTokens();
+
+  /**
+   * Number of callbacks waiting for tokens
+   */
+  size_t
+  getNumPending() const {
+    return pending_.size();
+  }
+
+  /**
+   * Drop all the waiting callbacks without invoking them
+   */
+  void clearPending();
+
+ private:
+  /**
+   * Overrides ZmqTimeout's timeout callback
+   */
+  void timeoutExpired() noexcept override;
+
+  // Add tokens accumulated since last refill
+  void refill();
+
+  // Schedule timeout for when next token will be available
+  void scheduleNextToken();
+
+  const double ratePerSec_{0};
+  const double burstSize_{0};
+
+  // Tokens in bucket and time they were last refilled at
+  double tokens_{0};
+  std::chrono::steady_clock::time_point lastRefillTime_;
+
+  // Callbacks waiting for tokens
+  std::deque<TimeoutCallback> pending_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/async/ZmqSocketMonitor.h>
+
+namespace fbzmq {
+
+ZmqSocketMonitor::ZmqSocketMonitor(
+    ZmqEventLoop& evl,
+    detail::SocketImpl const& sock,
+    SocketUrl monitorUrl,
+    SocketMonitor::CallbackT cb)
+    : evl_(evl), monitor_(sock, std::move(monitorUrl), std::move(cb)) {
+  CHECK(evl_.isInEventLoop());
+  evl_.addSocket(
+      RawZmqSocketPtr{*monitor_},
+      ZMQ_POLLIN,
+      [this](int) noexcept { processEvents(); });
+}
+
+ZmqSocketMonitor::~ZmqSocketMonitor() {
+  CHECK(evl_.isInEventLoop());
+  removeSocket();
+}
+
+SocketMonitorStats const&
+ZmqSocketMonitor::getStats() const {
+  CHECK(evl_.isInEventLoop());
+  return monitor_.getStats();
+}
+
+void
+ZmqSocketMonitor::processEvents() noexcept {
+  if (not isRunning_) {
+    return;
+  }
+  auto ret = monitor_.processEvents();
+  if (ret.hasValue() and ret.value()) {
+    return;
+  }
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqSocketMonitor: Failed to receive event. "
+               << ret.error();
+  }
+
+  // Monitoring is over
+  isRunning_ = false;
+  removeSocket();
+}
+
+void
+ZmqSocketMonitor::removeSocket() {
+  evl_.removeSocket(RawZmqSocketPtr{*monitor_});
+}
+
+} // namespace fbzmq
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/SocketMonitor.h>
+
+namespace fbzmq {
+
+/**
+ * SocketMonitor running on a ZmqEventLoop rather than in a thread of its own.
+ * PAIR socket of monitor is polled along with other sockets of the loop and
+ * events are consumed as they arrive, hence any number of sockets can be
+ * monitored from a single thread.
+ *
+ *  ZmqSocketMonitor monitor(evl, sock, SocketUrl{"inproc://sock_monitor"});
+ *  ...
+ *  threadData.setCounters(monitor.getStats().getCounters("sock"));
+ *
+ * Monitor stops once monitored socket is closed. Monitor must be created and
+ * destroyed in the thread of the loop (or before loop is running).
+ */
+class ZmqSocketMonitor {
+ public:
+  /**
+   * Monitor events on `sock`, refer to SocketMonitor for arguments. Callback
+   * is invoked from the loop.
+   */
+  ZmqSocketMonitor(
+      ZmqEventLoop& evl,
+      detail::SocketImpl const& sock,
+      SocketUrl monitorUrl,
+      SocketMonitor::CallbackT cb = nullptr);
+
+  ~ZmqSocketMonitor();
+
+  ZmqSocketMonitor(ZmqSocketMonitor const&) = delete;
+  ZmqSocketMonitor& operator=(ZmqSocketMonitor const&) = delete;
+
+  /**
+   * False once monitored socket has been closed (or monitoring failed)
+   */
+  bool
+  isRunning() const {
+    return isRunning_;
+  }
+
+  /**
+   * Stats by endpoint. Can only be accessed from within the loop.
+   */
+  SocketMonitorStats const& getStats() const;
+
+ private:
+  // Consume pending events, stop on end of monitoring
+  void processEvents() noexcept;
+
+  void removeSocket();
+
+  ZmqEventLoop& evl_;
+  SocketMonitor monitor_;
+  bool isRunning_{true};
+};
+
+} // namespace fbzmq
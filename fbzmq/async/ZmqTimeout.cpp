@@ -32,7 +32,8 @@ struct ZmqTimeoutWrapper : public ZmqTimeout {
 } // anonymous namespace
 
 ZmqTimeout::ZmqTimeout(folly::ScheduledExecutor* eventLoop)
-    : eventLoop_(eventLoop) {
+    : eventLoop_(eventLoop),
+      zmqEventLoop_(dynamic_cast<ZmqEventLoop*>(eventLoop)) {
   token_ = std::make_shared<size_t>(0);
   CHECK(eventLoop);
 }
@@ -52,7 +53,9 @@ ZmqTimeout::~ZmqTimeout() {
 
 void
 ZmqTimeout::scheduleTimeout(
-    std::chrono::milliseconds timeoutPeriod, bool isPeriodic) {
+    std::chrono::milliseconds timeoutPeriod,
+    bool isPeriodic,
+    std::chrono::milliseconds slack) {
   // Cancel already scheduled timeout if any
   if (isScheduled()) {
     cancelTimeout();
@@ -60,6 +63,7 @@ ZmqTimeout::scheduleTimeout(
 
   state_ = isPeriodic ? TimeoutState::PERIODIC : TimeoutState::SCHEDULED;
   timeoutPeriod_ = timeoutPeriod;
+  slack_ = slack;
   scheduleTimeoutHelper();
 }
 
@@ -72,20 +76,36 @@ ZmqTimeout::cancelTimeout() {
 
   state_ = TimeoutState::NONE;
   ++(*token_); // Increment token
+
+  // Release the scheduled timeout from the loop. Token guards the callback if
+  // we are called from outside of the loop.
+  if (zmqEventLoop_ && zmqEventLoop_->isInEventLoop()) {
+    zmqEventLoop_->cancelTimeout(timeoutId_);
+  }
+  timeoutId_ = -1;
 }
 
 void
 ZmqTimeout::scheduleTimeoutHelper() noexcept {
   ++(*token_); // Increment token
-  eventLoop_->scheduleAt(
-      // NOTE: copy absolute as well as reference to token. This is to guarantee
-      // that token is valid memory even if ZmqTimeout is destroyed
-      [this, tokenAbs = *token_, token = token_]() noexcept {
-        if (tokenAbs == *token) {
-          timeoutExpiredHelper();
-        }
-      },
-      std::chrono::steady_clock::now() + timeoutPeriod_);
+
+  // NOTE: copy absolute as well as reference to token. This is to guarantee
+  // that token is valid memory even if ZmqTimeout is destroyed
+  auto callback = [this, tokenAbs = *token_, token = token_]() noexcept {
+    if (tokenAbs == *token) {
+      timeoutId_ = -1;
+      timeoutExpiredHelper();
+    }
+  };
+  // Aligned here rather than in ZmqEventLoop, to apply to any executor
+  const auto scheduledTime = ZmqEventLoop::alignToSlack(
+      std::chrono::steady_clock::now() + timeoutPeriod_, slack_);
+  if (zmqEventLoop_) {
+    timeoutId_ =
+        zmqEventLoop_->scheduleTimeoutAt(scheduledTime, std::move(callback));
+  } else {
+    eventLoop_->scheduleAt(std::move(callback), scheduledTime);
+  }
 }
 
 void
@@ -71,9 +71,16 @@ class ZmqTimeout {
    *
    * If periodic flag is passed then timeoutExpired will be invoked periodically
    * with specified timeout until timeout is cancelled.
+   *
+   * Non-zero `slack` lets the timeout fire up to slack late, aligned with
+   * other timeouts of similar slack so that they are invoked in the same
+   * wakeup of the loop. Refer to `ZmqEventLoop::alignToSlack`. Useful for
+   * periodic housekeeping (stat flushes, health checks, keep-alives).
    */
   void scheduleTimeout(
-      std::chrono::milliseconds timeoutPeriod, bool isPeriodic = false);
+      std::chrono::milliseconds timeoutPeriod,
+      bool isPeriodic = false,
+      std::chrono::milliseconds slack = std::chrono::milliseconds(0));
 
   /**
    * Cancel already scheduled timeout, if it is running.
@@ -117,6 +124,13 @@ class ZmqTimeout {
   // ScheduledExecutor instance in which to run/schedule the timeouts
   folly::ScheduledExecutor* eventLoop_{nullptr};
 
+  // Set if eventLoop_ is a ZmqEventLoop. Allows timeouts to be cancelled in
+  // the loop (releasing their memory) instead of lingering until expiry.
+  ZmqEventLoop* zmqEventLoop_{nullptr};
+
+  // Id of scheduled timeout in zmqEventLoop_
+  int64_t timeoutId_{-1};
+
   // Current timeout state
   TimeoutState state_{TimeoutState::NONE};
 
@@ -125,6 +139,9 @@ class ZmqTimeout {
 
   // Timeout duration associated with periodic timeout
   std::chrono::milliseconds timeoutPeriod_{0};
+
+  // Tolerated delay of the timeout
+  std::chrono::milliseconds slack_{0};
 };
 
 } // namespace fbzmq
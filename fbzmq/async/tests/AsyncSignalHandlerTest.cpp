@@ -7,7 +7,9 @@
 
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <chrono>
+#include <vector>
 
 #include <fbzmq/async/AsyncSignalHandler.h>
 
@@ -60,8 +62,47 @@ class AsyncSignalHandlerTest final : public AsyncSignalHandler {
   std::atomic<bool> signalHandled_;
 };
 
+class BatchSignalHandler final : public AsyncSignalHandler {
+ public:
+  explicit BatchSignalHandler(ZmqEventLoop* evl) : AsyncSignalHandler(evl) {}
+
+  void
+  signalReceived(int /* sig */) noexcept override {
+    ADD_FAILURE() << "Signals must be delivered as a batch";
+  }
+
+  void
+  signalsReceived(folly::Range<const int*> sigs) noexcept override {
+    batches.emplace_back(sigs.begin(), sigs.end());
+    getZmqEventLoop()->stop();
+  }
+
+  std::vector<std::vector<int>> batches;
+};
+
 } // namespace
 
+TEST(AsyncSignalHandlerTest, Batch) {
+  ZmqEventLoop evl;
+  BatchSignalHandler signalHandler(&evl);
+  signalHandler.registerSignalHandler(SIGUSR1);
+  signalHandler.registerSignalHandler(SIGUSR2);
+
+  // Signals are blocked, they remain pending until loop runs and must all be
+  // drained on the single wakeup
+  raise(SIGUSR1);
+  raise(SIGUSR2);
+  evl.run();
+
+  ASSERT_EQ(1, signalHandler.batches.size());
+  auto batch = signalHandler.batches.front();
+  std::sort(batch.begin(), batch.end());
+  EXPECT_EQ((std::vector<int>{SIGUSR1, SIGUSR2}), batch);
+
+  signalHandler.unregisterSignalHandler(SIGUSR1);
+  signalHandler.unregisterSignalHandler(SIGUSR2);
+}
+
 TEST(AsyncSignalHandlerTest, Basic) {
   ZmqEventLoop evl;
   AsyncSignalHandlerTest signalHandler(&evl);
@@ -0,0 +1,299 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <map>
+#include <random>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/TimerWheel.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+using TimePoint = std::chrono::steady_clock::time_point;
+
+} // namespace
+
+TEST(TimerWheelTest, ScheduleAndExpire) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_FALSE(wheel.getNextExpiry().hasValue());
+
+  std::vector<int> fired;
+  wheel.schedule(start + 10ms, [&]() noexcept { fired.push_back(10); });
+  wheel.schedule(start + 5ms, [&]() noexcept { fired.push_back(5); });
+  wheel.schedule(start + 100s, [&]() noexcept { fired.push_back(100000); });
+  EXPECT_EQ(3, wheel.size());
+  EXPECT_EQ(start + 5ms, wheel.getNextExpiry().value());
+
+  // Nothing is due
+  EXPECT_EQ(0, wheel.runExpired(start + 5ms));
+  EXPECT_TRUE(fired.empty());
+
+  // Expiry is strictly after the scheduled time
+  EXPECT_EQ(1, wheel.runExpired(start + 5ms + 1us));
+  EXPECT_EQ(std::vector<int>({5}), fired);
+
+  EXPECT_EQ(1, wheel.runExpired(start + 50ms));
+  EXPECT_EQ(std::vector<int>({5, 10}), fired);
+  EXPECT_EQ(1, wheel.size());
+
+  // Next expiry is at most the scheduled time of remaining timer
+  EXPECT_GE(start + 100s, wheel.getNextExpiry().value());
+  EXPECT_EQ(1, wheel.runExpired(start + 101s));
+  EXPECT_EQ(std::vector<int>({5, 10, 100000}), fired);
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, Cancel) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  // Callback state must be released on cancel
+  auto state = std::make_shared<int>(0);
+  const auto id1 = wheel.schedule(start + 10ms, [state]() noexcept {
+    ADD_FAILURE() << "Cancelled timer invoked";
+  });
+  // Already expired timer
+  const auto id2 = wheel.schedule(start - 1s, [state]() noexcept {
+    ADD_FAILURE() << "Cancelled timer invoked";
+  });
+  EXPECT_EQ(3, state.use_count());
+  EXPECT_EQ(2, wheel.size());
+
+  EXPECT_TRUE(wheel.cancel(id1));
+  EXPECT_FALSE(wheel.cancel(id1));
+  EXPECT_TRUE(wheel.cancel(id2));
+  EXPECT_EQ(1, state.use_count());
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_FALSE(wheel.cancel(-1));
+  EXPECT_FALSE(wheel.cancel(12345));
+
+  // Stale id must not cancel a timer re-using the same entry
+  int count{0};
+  const auto id3 = wheel.schedule(start + 1ms, [&]() noexcept { ++count; });
+  EXPECT_NE(id1, id3);
+  EXPECT_FALSE(wheel.cancel(id1));
+  EXPECT_EQ(1, wheel.runExpired(start + 1s));
+  EXPECT_EQ(1, count);
+  EXPECT_FALSE(wheel.cancel(id3));
+}
+
+TEST(TimerWheelTest, InsertionOrder) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  // Timers with equal scheduled time expire in insertion order. Timers
+  // scheduled from callbacks are not run as part of the same call.
+  std::vector<int> fired;
+  const auto scheduledTime = start + 3s;
+  for (int i = 0; i < 1024; ++i) {
+    wheel.schedule(scheduledTime, [&, i]() noexcept {
+      fired.push_back(i);
+      if (i == 0) {
+        wheel.schedule(scheduledTime, [&]() noexcept { fired.push_back(-1); });
+      }
+    });
+  }
+  EXPECT_EQ(1024, wheel.runExpired(scheduledTime + 1us));
+  ASSERT_EQ(1024, fired.size());
+  for (int i = 0; i < 1024; ++i) {
+    EXPECT_EQ(i, fired[i]);
+  }
+
+  EXPECT_EQ(1, wheel.size());
+  EXPECT_EQ(1, wheel.runExpired(scheduledTime + 2us));
+  EXPECT_EQ(-1, fired.back());
+}
+
+TEST(TimerWheelTest, CancelFromCallback) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  int64_t id2{-1};
+  int count{0};
+  wheel.schedule(start + 1ms, [&]() noexcept {
+    ++count;
+    EXPECT_TRUE(wheel.cancel(id2));
+  });
+  id2 = wheel.schedule(start + 1ms, [&]() noexcept { ++count; });
+  EXPECT_EQ(1, wheel.runExpired(start + 10ms));
+  EXPECT_EQ(1, count);
+  EXPECT_TRUE(wheel.empty());
+}
+
+/**
+ * Randomized test against set of timers ordered by (scheduledTime, seq).
+ * Covers all levels of wheel as well as timers beyond its range.
+ */
+TEST(TimerWheelTest, Invoker) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  int numFired{0};
+  const auto timerId = wheel.schedule(start + 5ms, [&]() { ++numFired; });
+  wheel.schedule(start + 1h, [&]() { ++numFired; });
+
+  std::vector<std::pair<int64_t, TimePoint>> invoked;
+  auto invoker = [&](
+                     int64_t id,
+                     TimePoint scheduledTime,
+                     TimerWheel::Callback& callback) {
+    invoked.emplace_back(id, scheduledTime);
+    callback();
+  };
+  EXPECT_EQ(1, wheel.runExpired(start + 10ms, invoker));
+  EXPECT_EQ(1, numFired);
+  ASSERT_EQ(1, invoked.size());
+  EXPECT_EQ(timerId, invoked[0].first);
+  EXPECT_EQ(start + 5ms, invoked[0].second);
+  EXPECT_EQ(1, wheel.size());
+}
+
+TEST(TimerWheelTest, MaxTimers) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  std::vector<int> fired;
+  for (int i = 0; i < 5; ++i) {
+    wheel.schedule(start + std::chrono::milliseconds(5 - i), [&fired, i]() {
+      fired.push_back(i);
+    });
+  }
+  auto invoker =
+      [](int64_t, TimePoint, TimerWheel::Callback& callback) { callback(); };
+
+  // Remaining expired timers are run in order by subsequent calls
+  EXPECT_EQ(2, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_EQ(std::vector<int>({4, 3}), fired);
+  EXPECT_EQ(3, wheel.size());
+  ASSERT_TRUE(wheel.getNextExpiry().has_value());
+  EXPECT_EQ(start + 3ms, *wheel.getNextExpiry());
+
+  EXPECT_EQ(2, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_EQ(1, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_EQ(std::vector<int>({4, 3, 2, 1, 0}), fired);
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, MaxTimersWithCancel) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+
+  std::vector<int> fired;
+  std::vector<int64_t> timerIds;
+  for (int i = 0; i < 6; ++i) {
+    timerIds.push_back(wheel.schedule(
+        start + std::chrono::milliseconds(1 + i),
+        [&fired, i]() { fired.push_back(i); }));
+  }
+  auto invoker =
+      [](int64_t, TimePoint, TimerWheel::Callback& callback) { callback(); };
+
+  // Cancelling backlog (including its head) keeps it in order
+  EXPECT_EQ(2, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_TRUE(wheel.cancel(timerIds[2]));
+  EXPECT_TRUE(wheel.cancel(timerIds[4]));
+  ASSERT_TRUE(wheel.getNextExpiry().has_value());
+  EXPECT_EQ(start + 4ms, *wheel.getNextExpiry());
+
+  // Timers scheduled in the past go ahead of the backlog
+  wheel.schedule(start, [&fired]() { fired.push_back(6); });
+  EXPECT_EQ(2, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_EQ(std::vector<int>({0, 1, 6, 3}), fired);
+  EXPECT_EQ(1, wheel.runExpired(start + 10ms, invoker, 2));
+  EXPECT_EQ(std::vector<int>({0, 1, 6, 3, 5}), fired);
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, Randomized) {
+  const auto start = std::chrono::steady_clock::now();
+  TimerWheel wheel(start);
+  std::mt19937_64 rng(0);
+
+  std::map<std::pair<TimePoint, int>, int64_t> expected;
+  std::vector<std::pair<TimePoint, int>> fired;
+  for (int i = 0; i < 10000; ++i) {
+    std::chrono::microseconds delay;
+    switch (rng() % 5) {
+    case 0:
+      delay = std::chrono::microseconds(rng() % 10000);
+      break;
+    case 1:
+      delay = std::chrono::microseconds(rng() % 10000000);
+      break;
+    case 2:
+      delay = std::chrono::microseconds(rng() % 10000000000);
+      break;
+    case 3:
+      // Beyond the range of wheel
+      delay = std::chrono::hours(24 * 1000) +
+          std::chrono::microseconds(rng() % 10000000000);
+      break;
+    default:
+      delay = std::chrono::microseconds(0);
+    }
+    const auto scheduledTime = start + delay;
+    const auto id = wheel.schedule(scheduledTime, [&, scheduledTime, i]() {
+      fired.emplace_back(scheduledTime, i);
+    });
+    expected.emplace(std::make_pair(scheduledTime, i), id);
+  }
+
+  // Cancel some of them
+  for (auto it = expected.begin(); it != expected.end();) {
+    if (rng() % 3 == 0) {
+      EXPECT_TRUE(wheel.cancel(it->second));
+      it = expected.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(expected.size(), wheel.size());
+
+  // Advance time in random steps
+  auto now = start;
+  auto nextPending = expected.begin();
+  while (not wheel.empty()) {
+    const auto nextExpiry = wheel.getNextExpiry();
+    ASSERT_TRUE(nextExpiry.hasValue());
+    EXPECT_GE(nextPending->first.first, *nextExpiry);
+    now = std::max(now + std::chrono::microseconds(rng() % 20000), *nextExpiry);
+    now += 1us;
+
+    const auto numFired = fired.size();
+    wheel.runExpired(now);
+    for (size_t i = numFired; i < fired.size(); ++i) {
+      ASSERT_EQ(nextPending->first, fired[i]);
+      EXPECT_LT(fired[i].first, now);
+      ++nextPending;
+    }
+    if (nextPending != expected.end()) {
+      EXPECT_LE(now, nextPending->first.first);
+    }
+  }
+  EXPECT_EQ(expected.size(), fired.size());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
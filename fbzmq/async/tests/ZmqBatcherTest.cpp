@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <string>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqBatcher.h>
+#include <fbzmq/async/ZmqEventLoop.h>
+
+namespace chrono = std::chrono;
+
+namespace fbzmq {
+
+TEST(ZmqBatcherTest, FlushOnSize) {
+  ZmqEventLoop evl;
+  std::vector<std::vector<int>> batches;
+  ZmqBatcher<int> batcher(
+      &evl, chrono::seconds(10), 3, [&](std::vector<int>& batch) noexcept {
+        batches.push_back(batch);
+      });
+
+  for (int i = 0; i < 7; ++i) {
+    batcher.add(i);
+  }
+  ASSERT_EQ(2, batches.size());
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), batches[0]);
+  EXPECT_EQ(std::vector<int>({3, 4, 5}), batches[1]);
+  EXPECT_EQ(1, batcher.size());
+
+  // Explicit flush
+  batcher.flush();
+  ASSERT_EQ(3, batches.size());
+  EXPECT_EQ(std::vector<int>({6}), batches[2]);
+  EXPECT_TRUE(batcher.empty());
+
+  // Empty batch is not flushed
+  batcher.flush();
+  EXPECT_EQ(3, batches.size());
+}
+
+TEST(ZmqBatcherTest, FlushOnDelay) {
+  ZmqEventLoop evl;
+  std::vector<std::string> batches;
+  chrono::steady_clock::time_point addTime;
+  ZmqBatcher<std::string> batcher(
+      &evl,
+      chrono::milliseconds(50),
+      100,
+      [&](std::vector<std::string>& batch) noexcept {
+        EXPECT_LE(
+            chrono::milliseconds(50), chrono::steady_clock::now() - addTime);
+        std::string joined;
+        for (auto& item : batch) {
+          joined += std::move(item);
+        }
+        batches.push_back(joined);
+      });
+
+  evl.scheduleTimeout(chrono::milliseconds(0), [&]() noexcept {
+    addTime = chrono::steady_clock::now();
+    batcher.add("a");
+    batcher.add(2, 'b');
+  });
+
+  // Timeout doesn't get extended by later items
+  evl.scheduleTimeout(chrono::milliseconds(30), [&]() noexcept {
+    batcher.add("c");
+  });
+  evl.scheduleTimeout(chrono::milliseconds(200), [&]() noexcept {
+    EXPECT_TRUE(batcher.empty());
+    evl.stop();
+  });
+  evl.run();
+
+  ASSERT_EQ(1, batches.size());
+  EXPECT_EQ("abbc", batches[0]);
+}
+
+TEST(ZmqBatcherTest, AddFromCallback) {
+  ZmqEventLoop evl;
+  std::vector<size_t> batchSizes;
+  std::unique_ptr<ZmqBatcher<int>> batcher;
+  batcher = std::make_unique<ZmqBatcher<int>>(
+      &evl, chrono::seconds(10), 2, [&](std::vector<int>& batch) noexcept {
+        batchSizes.push_back(batch.size());
+        // Items added while flushing go into next batch
+        if (batchSizes.size() == 1) {
+          batcher->add(100);
+          EXPECT_EQ(1, batcher->size());
+        }
+      });
+
+  batcher->add(1);
+  batcher->add(2);
+  EXPECT_EQ(std::vector<size_t>({2}), batchSizes);
+  EXPECT_EQ(1, batcher->size());
+  batcher->add(3);
+  EXPECT_EQ(std::vector<size_t>({2, 2}), batchSizes);
+  EXPECT_TRUE(batcher->empty());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <unistd.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/synchronization/Baton.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventBaseAdapter.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+using namespace std::chrono_literals;
+
+TEST(ZmqEventBaseAdapterTest, Sockets) {
+  Context context;
+  folly::EventBase evb;
+  ZmqEventBaseAdapter adapter(&evb);
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(
+      context, folly::none, folly::none, NonblockingFlag{true});
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(
+      context, folly::none, folly::none, NonblockingFlag{true});
+  server.bind(SocketUrl{"inproc://adapter_test"}).value();
+  client.connect(SocketUrl{"inproc://adapter_test"}).value();
+
+  // Queued before registration, edge is long gone by the time loop runs
+  const size_t kNumMsgs{100};
+  for (size_t i = 0; i < kNumMsgs / 2; ++i) {
+    client.sendOne(Message::from(i).value()).value();
+  }
+
+  // Reads a single message per callback, socket must be re-checked for rest
+  std::vector<size_t> rcvd;
+  adapter.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int) noexcept {
+    rcvd.emplace_back(server.recvOne().value().read<size_t>().value());
+    if (rcvd.size() == kNumMsgs) {
+      adapter.removeSocket(RawZmqSocketPtr{*server});
+      evb.terminateLoopSoon();
+    }
+  });
+  EXPECT_THROW(
+      adapter.addSocket(
+          RawZmqSocketPtr{*server}, ZMQ_POLLIN, [](int) noexcept {}),
+      std::runtime_error);
+
+  // Rest is sent from within adapter
+  adapter.scheduleTimeout(10ms, [&]() noexcept {
+    for (size_t i = kNumMsgs / 2; i < kNumMsgs; ++i) {
+      client.sendOne(Message::from(i).value()).value();
+    }
+  });
+
+  evb.loopForever();
+  ASSERT_EQ(kNumMsgs, rcvd.size());
+  for (size_t i = 0; i < kNumMsgs; ++i) {
+    EXPECT_EQ(i, rcvd[i]);
+  }
+}
+
+TEST(ZmqEventBaseAdapterTest, SocketFd) {
+  folly::EventBase evb;
+  ZmqEventBaseAdapter adapter(&evb);
+
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+
+  int numCalls{0};
+  adapter.addSocketFd(fds[0], ZMQ_POLLIN, [&](int revents) noexcept {
+    EXPECT_EQ(ZMQ_POLLIN, revents);
+    char buf;
+    EXPECT_EQ(1, ::read(fds[0], &buf, 1));
+    if (++numCalls == 2) {
+      adapter.removeSocketFd(fds[0]);
+      evb.terminateLoopSoon();
+    }
+  });
+  ASSERT_EQ(2, ::write(fds[1], "ab", 2));
+
+  evb.loopForever();
+  EXPECT_EQ(2, numCalls);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(ZmqEventBaseAdapterTest, Timeouts) {
+  folly::EventBase evb;
+  ZmqEventBaseAdapter adapter(&evb);
+
+  // Same scheduled time runs in order of scheduling
+  std::vector<int> order;
+  const auto scheduleTime = std::chrono::steady_clock::now() + 20ms;
+  for (int i = 0; i < 3; ++i) {
+    adapter.scheduleTimeoutAt(
+        scheduleTime, [&order, i]() noexcept { order.emplace_back(i); });
+  }
+  auto cancelled = adapter.scheduleTimeout(
+      5ms, [&]() noexcept { ADD_FAILURE() << "Cancelled timeout ran"; });
+  EXPECT_EQ(4, adapter.getNumPendingTimeouts());
+  EXPECT_TRUE(adapter.cancelTimeout(cancelled));
+  EXPECT_FALSE(adapter.cancelTimeout(cancelled));
+
+  // Earlier timeout scheduled later on re-arms timer
+  const auto start = std::chrono::steady_clock::now();
+  adapter.scheduleTimeout(1ms, [&]() noexcept { order.emplace_back(-1); });
+
+  // ZmqTimeout works on adapter as a ScheduledExecutor
+  int numPeriodic{0};
+  auto periodic = ZmqTimeout::make(&adapter, [&]() noexcept {
+    if (++numPeriodic == 3) {
+      evb.terminateLoopSoon();
+    }
+  });
+  periodic->scheduleTimeout(15ms, true /* periodic */);
+
+  evb.loopForever();
+  EXPECT_LE(45ms, std::chrono::steady_clock::now() - start);
+  EXPECT_EQ(std::vector<int>({-1, 0, 1, 2}), order);
+  periodic->cancelTimeout();
+  EXPECT_EQ(0, adapter.getNumPendingTimeouts());
+}
+
+TEST(ZmqEventBaseAdapterTest, RunInEventLoop) {
+  folly::EventBase evb;
+  auto adapter = std::make_unique<ZmqEventBaseAdapter>(&evb);
+
+  std::thread evbThread([&evb]() { evb.loopForever(); });
+  evb.waitUntilRunning();
+
+  // Callbacks from a single thread run in order, in thread of EventBase
+  std::vector<int> order;
+  const size_t kNumCallbacks{1000};
+  for (size_t i = 0; i < kNumCallbacks; ++i) {
+    adapter->runInEventLoop([&, i]() noexcept {
+      EXPECT_TRUE(adapter->isInEventLoop());
+      order.emplace_back(i);
+    });
+  }
+  folly::Baton<> baton;
+  adapter->scheduleAt(
+      [&]() noexcept { baton.post(); }, std::chrono::steady_clock::now());
+  baton.wait();
+
+  ASSERT_EQ(kNumCallbacks, order.size());
+  for (size_t i = 0; i < kNumCallbacks; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+
+  // Adapter is destroyed in thread of EventBase
+  evb.runInEventBaseThreadAndWait([&adapter]() { adapter.reset(); });
+  evb.terminateLoopSoon();
+  evbThread.join();
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,325 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Micro-benchmarks of ZmqEventLoop internals: timer bookkeeping, cross-thread
+ * callback queue, dispatch cost vs number of polled sockets for both poll
+ * backends, and ZmqTimeout/ZmqThrottle overhead. Throughput benchmarks report
+ * `ops_per_sec`.
+ *
+ *  zmq_eventloop_bench --bm_regex='dispatch_.*'
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/init/Init.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqThrottle.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::vector<size_t> kNumPendingTimeouts = {0, 1000, 100000};
+const std::vector<size_t> kNumProducers = {1, 2, 4, 8};
+const std::vector<size_t> kNumIdleSockets = {0, 16, 128, 512};
+const std::vector<PollBackend> kPollBackends = {
+    PollBackend::ZMQ_POLL, PollBackend::EPOLL};
+
+// Far enough to never expire while benchmark is running
+const std::chrono::hours kNeverExpire{1};
+
+Context&
+getContext() {
+  static Context context;
+  return context;
+}
+
+const char*
+getBackendName(PollBackend pollBackend) {
+  return pollBackend == PollBackend::ZMQ_POLL ? "zmqpoll" : "epoll";
+}
+
+void
+reportThroughput(
+    folly::UserCounters& counters, size_t numOps, Clock::duration elapsed) {
+  const double secs = std::chrono::duration<double>(elapsed).count();
+  if (secs <= 0) {
+    return;
+  }
+  counters["ops_per_sec"] = static_cast<int64_t>(numOps / secs);
+}
+
+/**
+ * scheduleTimeout immediately followed by cancelTimeout with
+ * `numPendingTimeouts` other timeouts already in the queue. Loop is not
+ * running, bookkeeping of timeouts is all that is measured.
+ */
+void
+benchScheduleCancel(unsigned n, size_t numPendingTimeouts) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl;
+  for (size_t i = 0; i < numPendingTimeouts; ++i) {
+    evl.scheduleTimeout(
+        std::chrono::milliseconds(i % 10000) + kNeverExpire, [] {});
+  }
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    auto id = evl.scheduleTimeout(kNeverExpire, [] {});
+    folly::doNotOptimizeAway(evl.cancelTimeout(id));
+  }
+
+  braces.rehire();
+}
+
+/**
+ * Callbacks enqueued with runInEventLoop by `numProducers` threads into a
+ * running loop, measured until the loop has executed all of them
+ */
+void
+benchRunInEventLoop(
+    folly::UserCounters& counters,
+    unsigned n,
+    size_t numProducers,
+    uint64_t queueCapacity) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl(queueCapacity);
+  std::thread loopThread([&evl] { evl.run(); });
+  evl.waitUntilRunning();
+
+  const size_t numPerProducer = std::max<size_t>(1, n / numProducers);
+  const size_t total = numPerProducer * numProducers;
+  size_t numExecuted{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < numProducers; ++i) {
+    producers.emplace_back([&] {
+      while (not go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      for (size_t j = 0; j < numPerProducer; ++j) {
+        evl.runInEventLoop([&] {
+          if (++numExecuted == total) {
+            evl.stop();
+          }
+        });
+      }
+    });
+  }
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  loopThread.join();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  reportThroughput(counters, total, elapsed);
+}
+
+/**
+ * Cost of one loop iteration with `numIdleSockets` registered sockets and a
+ * single active one. Two PAIR sockets ping-pong a message from within their
+ * own callbacks, every message is one wakeup and one dispatch.
+ */
+void
+benchDispatch(
+    folly::UserCounters& counters,
+    unsigned n,
+    size_t numIdleSockets,
+    PollBackend pollBackend) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl(1e2, std::chrono::seconds(30), pollBackend);
+  const auto url = folly::sformat(
+      "inproc://eventloop_bench_dispatch_{}_{}",
+      getBackendName(pollBackend),
+      numIdleSockets);
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(getContext());
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(getContext());
+  server.bind(SocketUrl{url}).value();
+  client.connect(SocketUrl{url}).value();
+
+  std::vector<std::unique_ptr<Socket<ZMQ_PAIR, ZMQ_SERVER>>> idleSockets;
+  for (size_t i = 0; i < numIdleSockets; ++i) {
+    idleSockets.emplace_back(
+        std::make_unique<Socket<ZMQ_PAIR, ZMQ_SERVER>>(getContext()));
+    evl.addSocket(
+        RawZmqSocketPtr{*idleSockets.back()}, ZMQ_POLLIN, [](int) noexcept {
+          LOG(FATAL) << "Idle socket must never be active";
+        });
+  }
+
+  size_t numDispatched{0};
+  auto pingPong = [&](auto& sock) {
+    return [&](int) noexcept {
+      auto msg = sock.recvOne().value();
+      if (++numDispatched >= n) {
+        evl.stop();
+        return;
+      }
+      sock.sendOne(std::move(msg)).value();
+    };
+  };
+  evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, pingPong(server));
+  evl.addSocket(RawZmqSocketPtr{*client}, ZMQ_POLLIN, pingPong(client));
+  client.sendOne(Message()).value();
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  evl.run();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  reportThroughput(counters, numDispatched, elapsed);
+}
+
+/**
+ * Periodic ZmqTimeout with zero period, i.e. fired on every loop iteration.
+ * Includes re-scheduling of periodic timeout after every expiry.
+ */
+void
+benchTimeoutFire(folly::UserCounters& counters, unsigned n) {
+  folly::BenchmarkSuspender braces;
+  ZmqEventLoop evl;
+  size_t numFired{0};
+  auto timeout = ZmqTimeout::make(&evl, [&]() noexcept {
+    if (++numFired >= n) {
+      evl.stop();
+    }
+  });
+  timeout->scheduleTimeout(std::chrono::milliseconds(0), true /* periodic */);
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  evl.run();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  reportThroughput(counters, numFired, elapsed);
+}
+
+} // namespace
+
+} // namespace fbzmq
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+
+  using namespace fbzmq;
+
+  for (auto numPendingTimeouts : kNumPendingTimeouts) {
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("scheduleCancelTimeout_{}", numPendingTimeouts),
+        [numPendingTimeouts](unsigned n) {
+          benchScheduleCancel(n, numPendingTimeouts);
+          return n;
+        });
+  }
+
+  for (auto queueCapacity :
+       {uint64_t{100}, ZmqEventLoop::kUnboundedQueueCapacity}) {
+    for (auto numProducers : kNumProducers) {
+      folly::addBenchmark(
+          __FILE__,
+          folly::sformat(
+              "runInEventLoop_{}_producers_{}",
+              queueCapacity ? "bounded" : "unbounded",
+              numProducers),
+          [numProducers, queueCapacity](
+              folly::UserCounters& counters, unsigned n) {
+            benchRunInEventLoop(counters, n, numProducers, queueCapacity);
+            return n;
+          });
+    }
+  }
+
+  for (auto pollBackend : kPollBackends) {
+    for (auto numIdleSockets : kNumIdleSockets) {
+      folly::addBenchmark(
+          __FILE__,
+          folly::sformat(
+              "dispatch_{}_idle_sockets_{}",
+              getBackendName(pollBackend),
+              numIdleSockets),
+          [numIdleSockets, pollBackend](
+              folly::UserCounters& counters, unsigned n) {
+            benchDispatch(counters, n, numIdleSockets, pollBackend);
+            return n;
+          });
+    }
+  }
+
+  folly::addBenchmark(
+      __FILE__,
+      "ZmqTimeout_periodicFire",
+      [](folly::UserCounters& counters, unsigned n) {
+        benchTimeoutFire(counters, n);
+        return n;
+      });
+
+  // Re-scheduling of an already scheduled timeout
+  folly::addBenchmark(__FILE__, "ZmqTimeout_reschedule", [](unsigned n) {
+    folly::BenchmarkSuspender braces;
+    ZmqEventLoop evl;
+    auto timeout = ZmqTimeout::make(&evl, [] {});
+    braces.dismiss();
+    for (unsigned i = 0; i < n; ++i) {
+      timeout->scheduleTimeout(kNeverExpire);
+    }
+    braces.rehire();
+    return n;
+  });
+
+  // Calls coalesced into an already scheduled throttle, the common case
+  folly::addBenchmark(__FILE__, "ZmqThrottle_coalesced", [](unsigned n) {
+    folly::BenchmarkSuspender braces;
+    ZmqEventLoop evl;
+    ZmqThrottle throttle(&evl, kNeverExpire, [] {});
+    throttle();
+    braces.dismiss();
+    for (unsigned i = 0; i < n; ++i) {
+      throttle();
+    }
+    braces.rehire();
+    return n;
+  });
+
+  // Throttle which is scheduled on every call
+  folly::addBenchmark(__FILE__, "ZmqThrottle_scheduleCancel", [](unsigned n) {
+    folly::BenchmarkSuspender braces;
+    ZmqEventLoop evl;
+    ZmqThrottle throttle(&evl, kNeverExpire, [] {});
+    braces.dismiss();
+    for (unsigned i = 0; i < n; ++i) {
+      throttle();
+      throttle.cancel();
+    }
+    braces.rehire();
+    return n;
+  });
+
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef IS_BSD
+#include <sched.h>
+#endif
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+#include <folly/Format.h>
+#include <folly/synchronization/Baton.h>
+#include <folly/system/ThreadName.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoopPool.h>
+
+namespace fbzmq {
+
+TEST(ZmqEventLoopPoolTest, RunStop) {
+  ZmqEventLoopPool pool(4);
+  EXPECT_EQ(4, pool.getNumLoops());
+  EXPECT_FALSE(pool.isRunning());
+  EXPECT_EQ(nullptr, pool.getCurrentLoop());
+
+  // Run/stop cycle can be repeated
+  for (int i = 0; i < 2; ++i) {
+    std::thread poolThread([&pool]() { pool.run(); });
+    pool.waitUntilRunning();
+    for (size_t j = 0; j < pool.getNumLoops(); ++j) {
+      EXPECT_TRUE(pool.getLoop(j).isRunning());
+    }
+
+    // Pool can be stopped from within one of its loops
+    pool.getLoop(1).runInEventLoop([&pool]() {
+      EXPECT_EQ(&pool.getLoop(1), pool.getCurrentLoop());
+      pool.stop();
+    });
+    poolThread.join();
+    EXPECT_FALSE(pool.isRunning());
+    for (size_t j = 0; j < pool.getNumLoops(); ++j) {
+      EXPECT_FALSE(pool.getLoop(j).isRunning());
+    }
+  }
+}
+
+TEST(ZmqEventLoopPoolTest, RoundRobin) {
+  ZmqEventLoopPool pool(3);
+  std::thread poolThread([&pool]() { pool.run(); });
+  pool.waitUntilRunning();
+
+  // Every loop gets the same share
+  std::atomic<int> numExecuted{0};
+  std::vector<std::atomic<int>> perLoop(pool.getNumLoops());
+  for (int i = 0; i < 30; ++i) {
+    pool.add([&]() {
+      auto current = pool.getCurrentLoop();
+      ASSERT_NE(nullptr, current);
+      for (size_t j = 0; j < pool.getNumLoops(); ++j) {
+        if (current == &pool.getLoop(j)) {
+          ++perLoop[j];
+        }
+      }
+      ++numExecuted;
+    });
+  }
+  while (numExecuted < 30) {
+    std::this_thread::yield();
+  }
+  for (auto& count : perLoop) {
+    EXPECT_EQ(10, count);
+  }
+
+  pool.stop();
+  poolThread.join();
+}
+
+TEST(ZmqEventLoopPoolTest, LeastQueueDepth) {
+  ZmqEventLoopPool::Options options;
+  options.dispatchPolicy = ZmqEventLoopPool::DispatchPolicy::LEAST_QUEUE_DEPTH;
+  ZmqEventLoopPool pool(2, options);
+  std::thread poolThread([&pool]() { pool.run(); });
+  pool.waitUntilRunning();
+
+  // Block loop 0 and fill up its queue
+  folly::Baton<> blocked;
+  folly::Baton<> unblock;
+  pool.getLoop(0).runInEventLoop([&]() {
+    blocked.post();
+    unblock.wait();
+  });
+  blocked.wait();
+  for (int i = 0; i < 10; ++i) {
+    pool.getLoop(0).runInEventLoop([]() {});
+  }
+  EXPECT_EQ(10, pool.getLoop(0).getNumPendingCallbacks());
+
+  // All work goes to idle loop
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(&pool.getLoop(1), &pool.getNextLoop());
+  }
+
+  // Queue gets drained once loop is unblocked
+  unblock.post();
+  while (pool.getLoop(0).getNumPendingCallbacks() > 0) {
+    std::this_thread::yield();
+  }
+
+  pool.stop();
+  poolThread.join();
+}
+
+TEST(ZmqEventLoopPoolTest, LoopForKey) {
+  ZmqEventLoopPool pool(4);
+  std::set<ZmqEventLoop*> loops;
+  for (uint64_t key = 0; key < 100; ++key) {
+    auto& loop = pool.getLoopForKey(key);
+    EXPECT_EQ(&loop, &pool.getLoopForKey(key));
+    loops.insert(&loop);
+  }
+  EXPECT_EQ(4, loops.size());
+}
+
+#ifndef IS_BSD
+TEST(ZmqEventLoopPoolTest, CpuPinning) {
+  ZmqEventLoopPool::Options options;
+  options.cpus = {0};
+  ZmqEventLoopPool pool(2, options);
+  std::thread poolThread([&pool]() { pool.run(); });
+  pool.waitUntilRunning();
+
+  std::atomic<int> numExecuted{0};
+  for (size_t i = 0; i < pool.getNumLoops(); ++i) {
+    EXPECT_EQ(options.cpus, pool.getLoop(i).getThreadOptions().cpus);
+    pool.getLoop(i).runInEventLoop([&, i]() {
+      EXPECT_EQ(0, sched_getcpu());
+      EXPECT_EQ(
+          folly::sformat("ZmqEvlPool{}", i),
+          folly::getCurrentThreadName().value_or(""));
+      ++numExecuted;
+    });
+  }
+  while (numExecuted < 2) {
+    std::this_thread::yield();
+  }
+
+  pool.stop();
+  poolThread.join();
+}
+#endif
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
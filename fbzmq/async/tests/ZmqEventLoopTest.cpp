@@ -5,7 +5,15 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <sched.h>
+
+#include <map>
+#include <set>
+
+#include <folly/CancellationToken.h>
+#include <folly/Format.h>
 #include <folly/Memory.h>
+#include <folly/synchronization/Baton.h>
 #include <folly/system/ThreadName.h>
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
@@ -245,6 +253,61 @@ TEST(ZmqEventLoopTest, RunInEventLoopApi) {
   EXPECT_EQ(100, count);
 }
 
+TEST(ZmqEventLoopTest, RunInEventLoopBatchApi) {
+  // Bounded queue smaller than batch size as well as unbounded queue
+  for (const uint64_t queueCapacity :
+       {uint64_t(10), ZmqEventLoop::kUnboundedQueueCapacity}) {
+    ZmqEventLoop evl(queueCapacity);
+
+    std::thread evlThread([&]() { evl.run(); });
+    evl.waitUntilRunning();
+
+    // Enqueue batches from multiple producers. Order within each producer
+    // must be preserved.
+    const int kNumProducers = 4;
+    const int kNumBatches = 50;
+    const int kBatchSize = 100;
+    std::vector<int> counts(kNumProducers, 0);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kNumProducers; ++p) {
+      producers.emplace_back([&, p]() {
+        for (int b = 0; b < kNumBatches; ++b) {
+          std::vector<TimeoutCallback> callbacks;
+          for (int i = 0; i < kBatchSize; ++i) {
+            callbacks.emplace_back([&, p, b, i]() noexcept {
+              EXPECT_TRUE(evl.isInEventLoop());
+              EXPECT_EQ(b * kBatchSize + i, counts[p]);
+              ++counts[p];
+            });
+          }
+          evl.runInEventLoopBatch(std::move(callbacks));
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+
+    // Empty batch is a no-op
+    evl.runInEventLoopBatch({});
+
+    evl.runInEventLoop([&]() noexcept { evl.stop(); });
+    evlThread.join();
+
+    for (int p = 0; p < kNumProducers; ++p) {
+      EXPECT_EQ(kNumBatches * kBatchSize, counts[p]);
+    }
+
+    // Wakeups are coalesced, at most one per enqueue call in this test
+    // (bounded queue can signal additionally when full)
+    const auto stats = evl.getCallbackQueueStats();
+    EXPECT_EQ(kNumProducers * kNumBatches * kBatchSize + 1, stats.numCallbacks);
+    EXPECT_LE(1, stats.numWakeups);
+    EXPECT_GT(stats.numCallbacks, stats.numWakeups);
+    EXPECT_LE(stats.maxEnqueueLatency, stats.totalEnqueueLatency);
+  }
+}
+
 TEST(ZmqEventLoopTest, RunImmediatelyOrInEventLoopApi) {
   ZmqEventLoop evl(10);
 
@@ -442,6 +505,614 @@ TEST(ZmqEventLoopTest, emptyTimeout) {
   evlThread.join();
 }
 
+TEST(ZmqEventLoopTest, LatencyHistogram) {
+  ZmqEventLoop::LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.getPercentile(50).count());
+
+  for (int i = 0; i < 98; ++i) {
+    histogram.addValue(std::chrono::microseconds(3));
+  }
+  histogram.addValue(std::chrono::microseconds(100));
+  histogram.addValue(std::chrono::milliseconds(5));
+  EXPECT_EQ(100, histogram.count);
+  EXPECT_EQ(std::chrono::milliseconds(5), histogram.max);
+  EXPECT_EQ(98, histogram.buckets[2]); // [2us, 4us)
+  EXPECT_EQ(1, histogram.buckets[7]); // [64us, 128us)
+
+  // Upper bound of bucket, capped by max
+  EXPECT_EQ(std::chrono::microseconds(4), histogram.getPercentile(50));
+  EXPECT_EQ(std::chrono::microseconds(128), histogram.getPercentile(99));
+  EXPECT_EQ(std::chrono::milliseconds(5), histogram.getPercentile(100));
+}
+
+TEST(ZmqEventLoopTest, Instrumentation) {
+  for (auto pollBackend : {PollBackend::ZMQ_POLL, PollBackend::EPOLL}) {
+    Context context;
+    ZmqEventLoop evl(10, std::chrono::seconds(30), pollBackend);
+
+    // Disabled by default
+    EXPECT_FALSE(evl.getInstrumentationOptions().enabled);
+    ZmqEventLoop::InstrumentationOptions options;
+    options.enabled = true;
+    options.slowCallbackThreshold = std::chrono::milliseconds(10);
+    evl.setInstrumentationOptions(options);
+
+    // Fast socket callback and a slow timeout
+    const SocketUrl url{"inproc://instrumentation"};
+    Socket<ZMQ_PAIR, ZMQ_SERVER> server(context);
+    Socket<ZMQ_PAIR, ZMQ_CLIENT> client(context);
+    EXPECT_TRUE(server.bind(url).hasValue());
+    EXPECT_TRUE(client.connect(url).hasValue());
+    evl.addSocket(RawZmqSocketPtr{*server}, ZMQ_POLLIN, [&](int) noexcept {
+      EXPECT_TRUE(server.recvOne().hasValue());
+    });
+    EXPECT_TRUE(client.sendOne(Message()).hasValue());
+    evl.scheduleTimeout(std::chrono::milliseconds(5), [] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+
+    std::thread evlThread([&]() { evl.run(); });
+    evl.waitUntilRunning();
+
+    // Queued callbacks, last one stops the loop once timeout has fired
+    for (int i = 0; i < 5; ++i) {
+      evl.runInEventLoop([] {});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    evl.runInEventLoop([&]() { evl.stop(); });
+    evlThread.join();
+
+    auto stats = evl.getLoopStats();
+    EXPECT_LE(1, stats.numIterations);
+    EXPECT_LE(std::chrono::milliseconds(20), stats.totalBusyTime);
+    EXPECT_LE(std::chrono::milliseconds(20), stats.maxBusyTime);
+    EXPECT_EQ(1, stats.socketCallbacks.count);
+    EXPECT_EQ(1, stats.timeoutCallbacks.count);
+    EXPECT_EQ(1, stats.timeoutLateness.count);
+    EXPECT_LE(std::chrono::milliseconds(20), stats.timeoutCallbacks.max);
+    EXPECT_EQ(6, stats.queuedCallbacks.count);
+    EXPECT_EQ(6, stats.queueWait.count);
+    EXPECT_EQ(1, stats.numSlowCallbacks);
+
+    auto counters = stats.getCounters("evl");
+    EXPECT_EQ(1, counters.at("evl.slow_callbacks"));
+    EXPECT_EQ(6, counters.at("evl.queue_wait_us.count"));
+    EXPECT_LE(20000, counters.at("evl.timeout_callback_us.max"));
+    EXPECT_LE(20000, counters.at("evl.timeout_callback_us.p99"));
+    EXPECT_EQ(1, counters.count("evl.socket_callback_us.p50"));
+    EXPECT_EQ(1, counters.count("evl.poll_wait_us"));
+
+    // Nothing is recorded once disabled
+    evl.resetLoopStats();
+    evl.setInstrumentationOptions(ZmqEventLoop::InstrumentationOptions());
+    evl.scheduleTimeout(std::chrono::milliseconds(0), [&] { evl.stop(); });
+    evl.run();
+    stats = evl.getLoopStats();
+    EXPECT_EQ(0, stats.numIterations);
+    EXPECT_EQ(0, stats.timeoutCallbacks.count);
+  }
+}
+
+TEST(ZmqEventLoopTest, TimeoutSlack) {
+  using std::chrono::milliseconds;
+  using std::chrono::steady_clock;
+
+  // Aligned to largest power of two milliseconds not exceeding slack
+  const auto base = steady_clock::time_point(milliseconds(1024));
+  EXPECT_EQ(base, ZmqEventLoop::alignToSlack(base, milliseconds(100)));
+  EXPECT_EQ(
+      base + milliseconds(64),
+      ZmqEventLoop::alignToSlack(base + milliseconds(1), milliseconds(100)));
+  EXPECT_EQ(
+      base + milliseconds(1),
+      ZmqEventLoop::alignToSlack(base + milliseconds(1), milliseconds(0)));
+
+  ZmqEventLoop evl;
+  ZmqEventLoop::InstrumentationOptions options;
+  options.enabled = true;
+  evl.setInstrumentationOptions(options);
+
+  // Nearby timeouts with slack fire in a single wakeup, never early and
+  // within their slack
+  const milliseconds kSlack(50);
+  const auto boundary = ZmqEventLoop::alignToSlack(steady_clock::now(), kSlack);
+  std::vector<steady_clock::time_point> firedTimes;
+  for (int i = 0; i < 5; ++i) {
+    // All within the same 32ms bucket
+    const auto scheduleTime = boundary + milliseconds(1 + i * 5);
+    evl.scheduleTimeoutAt(
+        scheduleTime,
+        [&, scheduleTime, kSlack]() {
+          const auto now = steady_clock::now();
+          EXPECT_LE(scheduleTime, now);
+          EXPECT_GT(scheduleTime + kSlack + milliseconds(20), now);
+          firedTimes.push_back(now);
+        },
+        kSlack);
+  }
+  evl.scheduleTimeoutAt(boundary + milliseconds(150), [&]() { evl.stop(); });
+  evl.run();
+
+  ASSERT_EQ(5, firedTimes.size());
+  const auto stats = evl.getLoopStats();
+  EXPECT_EQ(4, stats.numCoalescedTimeouts);
+  EXPECT_EQ(4, stats.getCounters("evl").at("evl.coalesced_timeouts"));
+}
+
+namespace {
+
+/**
+ * PULL socket with `numMsgs` messages queued up in it. Callbacks added to
+ * loop read one message per invocation and record `name` into `order`.
+ */
+class QueuedSocket {
+ public:
+  QueuedSocket(Context& context, std::string const& name, int numMsgs)
+      : name_(name), pull_(context), push_(context) {
+    const SocketUrl url{folly::sformat("inproc://queued_{}", name)};
+    pull_.bind(url).value();
+    push_.connect(url).value();
+    for (int i = 0; i < numMsgs; ++i) {
+      push_.sendOne(Message::from(name).value()).value();
+    }
+  }
+
+  void
+  addTo(
+      ZmqEventLoop& evl,
+      std::string& order,
+      SocketDispatchOptions const& options = SocketDispatchOptions()) {
+    evl.addSocket(
+        RawZmqSocketPtr{*pull_},
+        ZMQ_POLLIN,
+        [this, &order](int) noexcept {
+          EXPECT_TRUE(pull_.recvOne().hasValue());
+          order += name_;
+        },
+        options);
+  }
+
+ private:
+  const std::string name_;
+  Socket<ZMQ_PULL, ZMQ_SERVER> pull_;
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> push_;
+};
+
+} // namespace
+
+TEST(ZmqEventLoopTest, DispatchPriority) {
+  for (auto pollBackend : {PollBackend::ZMQ_POLL, PollBackend::EPOLL}) {
+    Context context;
+    ZmqEventLoop evl(10, std::chrono::seconds(30), pollBackend);
+
+    // All of them are ready in the very first iteration
+    std::string order;
+    QueuedSocket low(context, "L", 1);
+    QueuedSocket normal(context, "N", 1);
+    QueuedSocket high(context, "H", 1);
+    low.addTo(evl, order, {EventPriority::LOW});
+    normal.addTo(evl, order);
+    high.addTo(evl, order, {EventPriority::HIGH});
+    evl.scheduleTimeoutAt(
+        std::chrono::steady_clock::now() - std::chrono::milliseconds(1),
+        [&]() noexcept { order += "T"; });
+    evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+      evl.stop();
+    });
+    evl.run();
+    EXPECT_EQ("HNTL", order);
+
+    // Timeouts can be moved ahead of sockets
+    LoopDispatchOptions options;
+    options.timeoutPriority = EventPriority::HIGH;
+    evl.setDispatchOptions(options);
+    EXPECT_EQ(EventPriority::HIGH, evl.getDispatchOptions().timeoutPriority);
+    order.clear();
+    QueuedSocket other(context, "O", 1);
+    other.addTo(evl, order, {EventPriority::HIGH});
+    evl.scheduleTimeoutAt(
+        std::chrono::steady_clock::now() - std::chrono::milliseconds(1),
+        [&]() noexcept { order += "T"; });
+    evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+      evl.stop();
+    });
+    evl.run();
+    EXPECT_EQ("OT", order);
+  }
+}
+
+TEST(ZmqEventLoopTest, DispatchBudget) {
+  for (auto pollBackend : {PollBackend::ZMQ_POLL, PollBackend::EPOLL}) {
+    Context context;
+    ZmqEventLoop evl(10, std::chrono::seconds(30), pollBackend);
+
+    // Busy socket gets up to 4 callbacks per iteration, the other one gets
+    // one callback per iteration
+    std::string order;
+    QueuedSocket busy(context, "B", 10);
+    QueuedSocket other(context, "O", 10);
+    SocketDispatchOptions options;
+    options.priority = EventPriority::HIGH;
+    options.maxCallbacksPerIteration = 4;
+    busy.addTo(evl, order, options);
+    other.addTo(evl, order);
+    evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+      evl.stop();
+    });
+    evl.run();
+    EXPECT_EQ("BBBBOBBBBOBBOOOOOOOO", order);
+  }
+}
+
+TEST(ZmqEventLoopTest, DispatchRoundRobin) {
+  for (auto pollBackend : {PollBackend::ZMQ_POLL, PollBackend::EPOLL}) {
+    Context context;
+    ZmqEventLoop evl(10, std::chrono::seconds(30), pollBackend);
+    LoopDispatchOptions options;
+    options.roundRobin = true;
+    evl.setDispatchOptions(options);
+
+    std::string order;
+    QueuedSocket x(context, "X", 3);
+    QueuedSocket y(context, "Y", 3);
+    QueuedSocket z(context, "Z", 3);
+    x.addTo(evl, order);
+    y.addTo(evl, order);
+    z.addTo(evl, order);
+    evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+      evl.stop();
+    });
+    evl.run();
+
+    // Every socket is dispatched first in one of the iterations
+    ASSERT_EQ(9, order.size());
+    std::set<char> firsts{order[0], order[3], order[6]};
+    EXPECT_EQ(3, firsts.size());
+  }
+}
+
+TEST(ZmqEventLoopTest, DispatchBudgetTimeoutsAndQueue) {
+  ZmqEventLoop evl;
+  ZmqEventLoop::InstrumentationOptions instrumentationOptions;
+  instrumentationOptions.enabled = true;
+  evl.setInstrumentationOptions(instrumentationOptions);
+  LoopDispatchOptions options;
+  options.maxTimeoutsPerIteration = 2;
+  options.maxQueuedCallbacksPerIteration = 2;
+  evl.setDispatchOptions(options);
+
+  // Iteration in which every timeout/callback gets invoked
+  std::vector<uint64_t> timeoutIterations;
+  std::vector<uint64_t> callbackIterations;
+  const auto now = std::chrono::steady_clock::now();
+  for (int i = 0; i < 5; ++i) {
+    evl.scheduleTimeoutAt(
+        now - std::chrono::milliseconds(10 - i), [&]() noexcept {
+          timeoutIterations.push_back(evl.getLoopStats().numIterations);
+        });
+  }
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  // Enqueue all the callbacks while loop is blocked
+  folly::Baton<> blocked;
+  folly::Baton<> unblock;
+  evl.runInEventLoop([&]() {
+    blocked.post();
+    unblock.wait();
+  });
+  blocked.wait();
+  folly::Baton<> done;
+  for (int i = 0; i < 5; ++i) {
+    evl.runInEventLoop([&, i]() {
+      callbackIterations.push_back(evl.getLoopStats().numIterations);
+      if (i == 4) {
+        done.post();
+      }
+    });
+  }
+  unblock.post();
+
+  // Left over work doesn't wait for health check duration
+  EXPECT_TRUE(done.try_wait_for(std::chrono::seconds(5)));
+  evl.stop();
+  evlThread.join();
+
+  // At most two of them per iteration
+  for (auto const& iterations : {timeoutIterations, callbackIterations}) {
+    ASSERT_EQ(5, iterations.size());
+    std::map<uint64_t, int> perIteration;
+    for (auto iteration : iterations) {
+      ++perIteration[iteration];
+    }
+    EXPECT_LE(3, perIteration.size());
+    for (auto const& kv : perIteration) {
+      EXPECT_GE(2, kv.second);
+    }
+  }
+}
+
+TEST(ZmqEventLoopTest, EpollBackend) {
+  Context context;
+  ZmqEventLoop evl(100, std::chrono::seconds(30), PollBackend::EPOLL);
+#ifndef IS_BSD
+  EXPECT_EQ(PollBackend::EPOLL, evl.getPollBackend());
+#endif
+  const int kNumSockets = 16;
+  const int kNumRequests = 10;
+
+  // Many server sockets, out of which only one is active at a time
+  std::vector<std::unique_ptr<Socket<ZMQ_REP, ZMQ_SERVER>>> serverSocks;
+  std::atomic<int> numRequests{0};
+  for (int i = 0; i < kNumSockets; ++i) {
+    serverSocks.emplace_back(
+        std::make_unique<Socket<ZMQ_REP, ZMQ_SERVER>>(context));
+    auto& serverSock = *serverSocks.back();
+    serverSock.bind(SocketUrl{folly::sformat("inproc://epoll_{}", i)}).value();
+    evl.addSocket(
+        RawZmqSocketPtr{*serverSock}, ZMQ_POLLIN, [&](int revents) noexcept {
+          EXPECT_EQ(ZMQ_POLLIN, revents);
+          auto msg = serverSock.recvOne().value();
+          EXPECT_EQ(kRequestStr, msg.read<std::string>().value());
+          serverSock.sendOne(Message::from(kResponseStr).value()).value();
+          ++numRequests;
+        });
+  }
+
+  // Removed socket must not receive any callback
+  Socket<ZMQ_PULL, ZMQ_SERVER> removedSock{context};
+  removedSock.bind(SocketUrl{"inproc://epoll_removed"}).value();
+  evl.addSocket(RawZmqSocketPtr{*removedSock}, ZMQ_POLLIN, [&](int) noexcept {
+    ADD_FAILURE() << "Callback on removed socket";
+  });
+  evl.removeSocket(RawZmqSocketPtr{*removedSock});
+
+  std::thread evlThread([&]() noexcept {
+    LOG(INFO) << "Starting event loop";
+    evl.run();
+    LOG(INFO) << "Event loop stopped";
+  });
+  evl.waitUntilRunning();
+
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> pushSock{context};
+  pushSock.connect(SocketUrl{"inproc://epoll_removed"}).value();
+  pushSock.sendOne(Message::from(kRequestStr).value()).value();
+
+  for (int i = 0; i < kNumSockets; ++i) {
+    Socket<ZMQ_REQ, ZMQ_CLIENT> clientSock{context};
+    clientSock.connect(SocketUrl{folly::sformat("inproc://epoll_{}", i)})
+        .value();
+    for (int j = 0; j < kNumRequests; ++j) {
+      clientSock.sendOne(Message::from(kRequestStr).value()).value();
+      auto msg = clientSock.recvOne().value();
+      EXPECT_EQ(kResponseStr, msg.read<std::string>().value());
+    }
+  }
+  EXPECT_EQ(kNumSockets * kNumRequests, numRequests.load());
+
+  // Timeouts and callbacks (raw fd) must work as well
+  folly::Baton<> baton;
+  evl.runInEventLoop([&]() noexcept {
+    evl.scheduleTimeout(
+        std::chrono::milliseconds(10), [&]() noexcept { baton.post(); });
+  });
+  baton.wait();
+
+  evl.stop();
+  evlThread.join();
+}
+
+/**
+ * I/O on a socket consumes the edge signalled on its ZMQ_FD. Verify that the
+ * EPOLL backend doesn't miss events when I/O on a socket happens from within
+ * callback of another socket.
+ */
+TEST(ZmqEventLoopTest, EpollBackendCrossSocketIo) {
+  Context context;
+  ZmqEventLoop evl(100, std::chrono::seconds(30), PollBackend::EPOLL);
+  const SocketUrl socketUrl{"inproc://epoll_pair"};
+  const int kNumIterations = 100;
+
+  Socket<ZMQ_PAIR, ZMQ_SERVER> sockA{context};
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> sockB{context};
+  sockA.bind(socketUrl).value();
+  sockB.connect(socketUrl).value();
+
+  int countA{0};
+  int countB{0};
+  evl.addSocket(RawZmqSocketPtr{*sockA}, ZMQ_POLLIN, [&](int) noexcept {
+    sockA.recvOne().value();
+    if (++countA == kNumIterations) {
+      evl.stop();
+    }
+  });
+  evl.addSocket(RawZmqSocketPtr{*sockB}, ZMQ_POLLIN, [&](int) noexcept {
+    sockB.recvOne().value();
+    ++countB;
+    // Reply to A and then perform I/O on A from B's callback. This processes
+    // pending commands of A and can consume the edge of B's reply.
+    sockB.sendOne(Message::from(kResponseStr).value()).value();
+    sockA.sendOne(Message::from(kRequestStr).value()).value();
+  });
+
+  // Guard against hang
+  evl.scheduleTimeout(std::chrono::seconds(10), [&]() noexcept {
+    ADD_FAILURE() << "Timed out waiting for messages";
+    evl.stop();
+  });
+
+  // Kick off ping-pong
+  sockA.sendOne(Message::from(kRequestStr).value()).value();
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evlThread.join();
+
+  EXPECT_EQ(kNumIterations, countA);
+  EXPECT_LE(kNumIterations, countB);
+}
+
+TEST(ZmqEventLoopTest, SpinMode) {
+  ZmqEventLoop evl;
+
+  // Spin for long, but only 10% of the time when idle
+  LoopSpinOptions spinOptions;
+  spinOptions.spinDuration = std::chrono::seconds(10);
+  spinOptions.maxIdleSpinPct = 10;
+  evl.setSpinOptions(spinOptions);
+  ZmqEventLoop::InstrumentationOptions instrumentationOptions;
+  instrumentationOptions.enabled = true;
+  evl.setInstrumentationOptions(instrumentationOptions);
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evl.waitUntilRunning();
+
+  // Callbacks enqueued while loop spins don't need a wakeup. Loop spins
+  // right after it started as well as after every callback.
+  const int kNumCallbacks = 100;
+  std::atomic<int> numCalled{0};
+  for (int i = 0; i < kNumCallbacks; ++i) {
+    folly::Baton<> baton;
+    evl.runInEventLoop([&]() noexcept {
+      ++numCalled;
+      baton.post();
+    });
+    baton.wait();
+  }
+  EXPECT_EQ(kNumCallbacks, numCalled.load());
+  const auto queueStats = evl.getCallbackQueueStats();
+  EXPECT_EQ(kNumCallbacks, queueStats.numCallbacks);
+  EXPECT_GT(kNumCallbacks / 2, queueStats.numWakeups);
+
+  // Idle spinning is bounded by the budget, about 100ms of a second
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  folly::Baton<> baton;
+  ZmqEventLoop::LoopStats stats;
+  evl.runInEventLoop([&]() noexcept {
+    stats = evl.getLoopStats();
+    baton.post();
+  });
+  baton.wait();
+  EXPECT_LT(0, stats.numSpinIterations);
+  EXPECT_LT(std::chrono::milliseconds(50), stats.totalIdleSpinTime);
+  EXPECT_GT(std::chrono::milliseconds(400), stats.totalIdleSpinTime);
+
+  // Loop blocks again once spinning is disabled
+  folly::Baton<> disabled;
+  evl.runInEventLoop([&]() noexcept {
+    evl.setSpinOptions(LoopSpinOptions());
+    disabled.post();
+  });
+  disabled.wait();
+  const auto numWakeups = evl.getCallbackQueueStats().numWakeups;
+  folly::Baton<> called;
+  evl.runInEventLoop([&]() noexcept { called.post(); });
+  called.wait();
+  EXPECT_EQ(numWakeups + 1, evl.getCallbackQueueStats().numWakeups);
+
+  evl.stop();
+  evlThread.join();
+}
+
+TEST(ZmqEventLoopTest, ThreadOptions) {
+  ZmqEventLoop evl;
+
+  LoopThreadOptions options;
+  options.cpus = {0};
+  options.name = "evl-pinned";
+  evl.setThreadOptions(options);
+  EXPECT_EQ(options.cpus, evl.getThreadOptions().cpus);
+
+  folly::Optional<std::string> threadName;
+  int numCpus{0};
+  bool isOnCpu0{false};
+  evl.scheduleTimeout(std::chrono::milliseconds(0), [&]() noexcept {
+    threadName = folly::getCurrentThreadName();
+#ifndef IS_BSD
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    EXPECT_EQ(0, sched_getaffinity(0, sizeof(cpuSet), &cpuSet));
+    numCpus = CPU_COUNT(&cpuSet);
+    isOnCpu0 = CPU_ISSET(0, &cpuSet);
+#endif
+    evl.stop();
+  });
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evlThread.join();
+
+  EXPECT_EQ(std::string("evl-pinned"), threadName);
+#ifndef IS_BSD
+  EXPECT_EQ(1, numCpus);
+  EXPECT_TRUE(isOnCpu0);
+#endif
+}
+
+TEST(ZmqEventLoopTest, Coroutines) {
+  Context context;
+  ZmqEventLoop evl;
+
+  const SocketUrl url{"inproc://coroutines"};
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(
+      context, folly::none, folly::none, NonblockingFlag{true});
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(context);
+  server.bind(url).value();
+  client.connect(url).value();
+
+  // Sleeps, then reads messages as they become available
+  bool sleptEnough{false};
+  std::vector<std::string> received;
+  auto reader = [&]() -> folly::coro::Task<void> {
+    const auto start = std::chrono::steady_clock::now();
+    co_await evl.sleepFor(std::chrono::milliseconds(50));
+    sleptEnough = std::chrono::steady_clock::now() - start >=
+        std::chrono::milliseconds(50);
+    while (received.size() < 3) {
+      const int revents = co_await evl.readable(RawZmqSocketPtr{*server});
+      EXPECT_TRUE(revents & ZMQ_POLLIN);
+      while (auto msg = server.recvOne()) {
+        received.emplace_back(msg->read<std::string>().value());
+      }
+    }
+    evl.stop();
+  };
+  evl.addTask(reader());
+
+  // Sleep cancelled long before it is due
+  folly::CancellationSource cancelSource;
+  bool isCancelled{false};
+  auto sleeper = [&]() -> folly::coro::Task<void> {
+    co_await evl.sleepFor(std::chrono::seconds(10));
+  };
+  sleeper().scheduleOn(&evl).start(
+      [&](folly::Try<void>&& result) {
+        isCancelled = result.hasException<folly::OperationCancelled>();
+      },
+      cancelSource.getToken());
+  EXPECT_EQ(2, evl.getNumPendingTimeouts());
+
+  evl.scheduleTimeout(std::chrono::milliseconds(20), [&]() noexcept {
+    cancelSource.requestCancellation();
+    EXPECT_TRUE(isCancelled);
+  });
+  evl.scheduleTimeout(std::chrono::milliseconds(100), [&]() noexcept {
+    client.sendOne(Message::from(std::string("a")).value()).value();
+    client.sendOne(Message::from(std::string("b")).value()).value();
+  });
+  evl.scheduleTimeout(std::chrono::milliseconds(150), [&]() noexcept {
+    client.sendOne(Message::from(std::string("c")).value()).value();
+  });
+
+  std::thread evlThread([&]() noexcept { evl.run(); });
+  evlThread.join();
+
+  EXPECT_TRUE(sleptEnough);
+  EXPECT_TRUE(isCancelled);
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), received);
+  // Waits are unregistered once done
+  EXPECT_EQ(0, evl.getNumPendingTimeouts());
+}
+
 } // namespace fbzmq
 
 int
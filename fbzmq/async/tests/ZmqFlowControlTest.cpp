@@ -0,0 +1,375 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqFlowControl.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+const SocketUrl kRouterUrl{"inproc://flow_control_router"};
+const SocketUrl kRelayUrl{"inproc://flow_control_relay"};
+
+std::vector<Message>
+makeMsg(int i) {
+  std::vector<Message> msg;
+  msg.emplace_back(Message::from(std::string("msg")).value());
+  msg.emplace_back(Message::from(std::to_string(i)).value());
+  return msg;
+}
+
+/**
+ * Relays messages between a DEALER connected to `kRelayUrl` and ROUTER bound
+ * at `kRouterUrl`, dropping those for which `shouldDrop` returns true. Router
+ * sees relay as peer with identity "dealer".
+ */
+class LossyRelay {
+ public:
+  using DropPredicate = std::function<bool(std::vector<Message> const&)>;
+
+  LossyRelay(
+      Context& context,
+      ZmqEventLoop& evl,
+      DropPredicate dropToRouter,
+      DropPredicate dropToDealer)
+      : evl_(evl),
+        front_(context),
+        back_(context, IdentityString{"dealer"}),
+        dropToRouter_(std::move(dropToRouter)),
+        dropToDealer_(std::move(dropToDealer)) {
+    front_.bind(kRelayUrl).value();
+    back_.connect(kRouterUrl).value();
+
+    evl_.addSocket(RawZmqSocketPtr{*front_}, ZMQ_POLLIN, [this](int) noexcept {
+      std::vector<Message> frames;
+      while (front_.recvMultipleInto(frames, 0ms).hasValue()) {
+        dealerId_ = frames.at(0).read<std::string>().value();
+        frames.erase(frames.begin());
+        if (not dropToRouter_(frames)) {
+          back_.sendBatch(std::move(frames)).value();
+        }
+      }
+    });
+    evl_.addSocket(RawZmqSocketPtr{*back_}, ZMQ_POLLIN, [this](int) noexcept {
+      std::vector<Message> frames;
+      while (back_.recvMultipleInto(frames, 0ms).hasValue()) {
+        if (not dropToDealer_(frames)) {
+          frames.insert(frames.begin(), Message::from(dealerId_).value());
+          front_.sendBatch(std::move(frames)).value();
+        }
+      }
+    });
+  }
+
+  ~LossyRelay() {
+    evl_.removeSocket(RawZmqSocketPtr{*front_});
+    evl_.removeSocket(RawZmqSocketPtr{*back_});
+  }
+
+ private:
+  ZmqEventLoop& evl_;
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> front_;
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> back_;
+  DropPredicate dropToRouter_;
+  DropPredicate dropToDealer_;
+  std::string dealerId_;
+};
+
+// Drops first `n` messages it is called with
+LossyRelay::DropPredicate
+dropFirst(int n) {
+  return [n](std::vector<Message> const&) mutable { return n-- > 0; };
+}
+
+// Drops `n`th message (counting from 0) it is called with
+LossyRelay::DropPredicate
+dropNth(int n) {
+  return [n](std::vector<Message> const&) mutable { return n-- == 0; };
+}
+
+LossyRelay::DropPredicate
+dropNone() {
+  return [](std::vector<Message> const&) { return false; };
+}
+
+} // namespace
+
+TEST(ZmqFlowControlTest, CreditsAndQueueing) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> router(context);
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context, IdentityString{"dealer"});
+  router.bind(kRouterUrl).value();
+  dealer.connect(kRouterUrl).value();
+
+  ZmqFlowControl::Options options;
+  options.window = 10;
+  options.grantBatch = 5;
+
+  // Server echoes messages back to their sender
+  std::vector<std::string> received;
+  ZmqFlowControl server(
+      evl,
+      router,
+      [&](std::string const& peer, std::vector<Message>&& msg) noexcept {
+        EXPECT_EQ("dealer", peer);
+        ASSERT_EQ(2, msg.size());
+        received.emplace_back(msg.at(1).read<std::string>().value());
+      },
+      options);
+
+  std::vector<std::string> echoed;
+  ZmqFlowControl client(
+      evl,
+      dealer,
+      [&](std::string const& peer, std::vector<Message>&& msg) noexcept {
+        EXPECT_EQ("", peer);
+        echoed.emplace_back(msg.at(1).read<std::string>().value());
+      },
+      options);
+  int numDrained{0};
+  client.setDrainedCallback([&](std::string const& peer) noexcept {
+    EXPECT_EQ("", peer);
+    ++numDrained;
+  });
+
+  // Only a window worth of messages goes out right away
+  const int kNumMsgs = 100;
+  for (int i = 0; i < kNumMsgs; ++i) {
+    EXPECT_TRUE(client.send("", makeMsg(i)).hasValue());
+  }
+  auto stats = client.getPeerStats("").value();
+  EXPECT_EQ(0, stats.sendCredits);
+  EXPECT_EQ(options.window, stats.numSent);
+  EXPECT_EQ(kNumMsgs - options.window, stats.numQueuedMsgs);
+  EXPECT_EQ(kNumMsgs - options.window, stats.numQueued);
+  EXPECT_LT(0, stats.numQueuedBytes);
+
+  evl.scheduleTimeout(200ms, [&]() noexcept {
+    // All messages made it, in order
+    ASSERT_EQ(kNumMsgs, received.size());
+    for (int i = 0; i < kNumMsgs; ++i) {
+      EXPECT_EQ(std::to_string(i), received[i]);
+    }
+    EXPECT_EQ(1, numDrained);
+
+    const auto clientStats = client.getPeerStats("").value();
+    EXPECT_EQ(kNumMsgs, clientStats.numSent);
+    EXPECT_EQ(0, clientStats.numQueuedMsgs);
+    EXPECT_EQ(0, clientStats.numQueuedBytes);
+    EXPECT_EQ(0, clientStats.numRejected);
+
+    // Server has granted every consumed message back in batches
+    const auto serverStats = server.getPeerStats("dealer").value();
+    EXPECT_EQ(kNumMsgs, serverStats.numReceived);
+    EXPECT_EQ(0, serverStats.numUngranted);
+    EXPECT_EQ(options.window, serverStats.sendCredits);
+
+    const auto counters = client.getCounters("flow");
+    EXPECT_EQ(1, counters.at("flow.peers"));
+    EXPECT_EQ(kNumMsgs, counters.at("flow.sent"));
+    EXPECT_EQ(0, counters.at("flow.queued_msgs"));
+
+    // Server replies go through flow control as well
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_TRUE(server.send("dealer", makeMsg(i)).hasValue());
+    }
+  });
+  evl.scheduleTimeout(300ms, [&]() noexcept {
+    EXPECT_EQ(std::vector<std::string>({"0", "1", "2"}), echoed);
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqFlowControlTest, BoundedQueue) {
+  Context context;
+  ZmqEventLoop evl;
+
+  // Peer never consumes messages, hence never grants credits
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> router(context);
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  router.bind(kRouterUrl).value();
+  dealer.connect(kRouterUrl).value();
+
+  ZmqFlowControl::Options options;
+  options.window = 4;
+  options.grantBatch = 2;
+  options.maxQueuedMsgsPerPeer = 3;
+  ZmqFlowControl client(
+      evl, dealer, [](std::string const&, std::vector<Message>&&) noexcept {},
+      options);
+
+  // Window is sent, queue is filled up and the rest is rejected
+  for (int i = 0; i < 10; ++i) {
+    auto ret = client.send("", makeMsg(i));
+    if (i < 7) {
+      EXPECT_TRUE(ret.hasValue());
+    } else {
+      ASSERT_TRUE(ret.hasError());
+      EXPECT_EQ(ENOBUFS, ret.error().errNum);
+    }
+  }
+  EXPECT_TRUE(client.send("", {}).hasError());
+
+  auto stats = client.getPeerStats("").value();
+  EXPECT_EQ(4, stats.numSent);
+  EXPECT_EQ(3, stats.numQueuedMsgs);
+  EXPECT_EQ(3, stats.numRejected);
+  EXPECT_EQ(3, client.getCounters("flow").at("flow.queued_msgs.max"));
+
+  // Queued messages are dropped along with the peer
+  client.removePeer("");
+  EXPECT_FALSE(client.getPeerStats("").hasValue());
+  EXPECT_EQ(0, client.getCounters("flow").at("flow.queued_bytes"));
+
+  // Total bytes bound applies across peers
+  options.maxQueuedBytes = 0;
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer2(context);
+  dealer2.connect(kRouterUrl).value();
+  ZmqFlowControl client2(
+      evl, dealer2, [](std::string const&, std::vector<Message>&&) noexcept {},
+      options);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(client2.send("", makeMsg(i)).hasValue());
+  }
+  EXPECT_EQ(ENOBUFS, client2.send("", makeMsg(4)).error().errNum);
+}
+
+TEST(ZmqFlowControlTest, ResyncAfterLostGrants) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> router(context);
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context, IdentityString{"client"});
+  router.bind(kRouterUrl).value();
+
+  // Both grants of first window are lost on their way to client
+  LossyRelay relay(context, evl, dropNone(), dropFirst(2));
+  dealer.connect(kRelayUrl).value();
+
+  ZmqFlowControl::Options options;
+  options.window = 10;
+  options.grantBatch = 5;
+  options.resyncInterval = 50ms;
+
+  std::vector<std::string> received;
+  ZmqFlowControl server(
+      evl,
+      router,
+      [&](std::string const&, std::vector<Message>&& msg) noexcept {
+        received.emplace_back(msg.at(1).read<std::string>().value());
+      },
+      options);
+  ZmqFlowControl client(
+      evl, dealer, [](std::string const&, std::vector<Message>&&) noexcept {},
+      options);
+
+  const int kNumMsgs = 100;
+  for (int i = 0; i < kNumMsgs; ++i) {
+    EXPECT_TRUE(client.send("", makeMsg(i)).hasValue());
+  }
+
+  evl.scheduleTimeout(500ms, [&]() noexcept {
+    // Client resynced instead of stalling for good
+    ASSERT_EQ(kNumMsgs, received.size());
+    for (int i = 0; i < kNumMsgs; ++i) {
+      EXPECT_EQ(std::to_string(i), received[i]);
+    }
+
+    const auto clientStats = client.getPeerStats("").value();
+    EXPECT_LE(1, clientStats.numResyncs);
+    EXPECT_EQ(kNumMsgs, clientStats.numSent);
+    EXPECT_EQ(0, clientStats.numQueuedMsgs);
+    EXPECT_EQ(options.window, clientStats.sendCredits);
+    EXPECT_LE(1, client.getCounters("flow").at("flow.resyncs"));
+
+    const auto serverStats = server.getPeerStats("dealer").value();
+    EXPECT_EQ(0, serverStats.numLost);
+    EXPECT_EQ(0, serverStats.numUngranted);
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqFlowControlTest, LostDataMessage) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> router(context);
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context, IdentityString{"client"});
+  router.bind(kRouterUrl).value();
+
+  // Third data message is lost on its way to server
+  LossyRelay relay(context, evl, dropNth(2), dropNone());
+  dealer.connect(kRelayUrl).value();
+
+  ZmqFlowControl::Options options;
+  options.window = 10;
+  options.grantBatch = 5;
+
+  std::vector<std::string> received;
+  ZmqFlowControl server(
+      evl,
+      router,
+      [&](std::string const&, std::vector<Message>&& msg) noexcept {
+        received.emplace_back(msg.at(1).read<std::string>().value());
+      },
+      options);
+  ZmqFlowControl client(
+      evl, dealer, [](std::string const&, std::vector<Message>&&) noexcept {},
+      options);
+
+  const int kNumMsgs = 100;
+  for (int i = 0; i < kNumMsgs; ++i) {
+    EXPECT_TRUE(client.send("", makeMsg(i)).hasValue());
+  }
+
+  evl.scheduleTimeout(300ms, [&]() noexcept {
+    ASSERT_EQ(kNumMsgs - 1, received.size());
+    EXPECT_EQ("1", received.at(1));
+    EXPECT_EQ("3", received.at(2));
+
+    // Lost message is granted back along with the rest
+    const auto serverStats = server.getPeerStats("dealer").value();
+    EXPECT_EQ(1, serverStats.numLost);
+    EXPECT_EQ(0, serverStats.numUngranted);
+    EXPECT_EQ(1, server.getCounters("flow").at("flow.lost"));
+
+    const auto clientStats = client.getPeerStats("").value();
+    EXPECT_EQ(kNumMsgs, clientStats.numSent);
+    EXPECT_EQ(0, clientStats.numQueuedMsgs);
+    EXPECT_EQ(options.window, clientStats.sendCredits);
+    EXPECT_EQ(0, clientStats.numResyncs);
+    evl.stop();
+  });
+  evl.run();
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
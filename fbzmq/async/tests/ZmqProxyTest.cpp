@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cctype>
+#include <string>
+#include <thread>
+
+#include <folly/Format.h>
+#include <folly/synchronization/Baton.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqProxy.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+const SocketUrl kFrontendUrl{"inproc://proxy_frontend"};
+const SocketUrl kBackendUrl{"inproc://proxy_backend"};
+const SocketUrl kCaptureUrl{"inproc://proxy_capture"};
+
+// Receive all readily available messages as strings, frames joined with `|`
+std::vector<std::string>
+recvAll(detail::SocketImpl& sock) {
+  std::vector<std::string> msgs;
+  while (true) {
+    auto frames = sock.recvMultiple(0ms);
+    if (frames.hasError()) {
+      break;
+    }
+    std::string msg;
+    for (auto& frame : frames.value()) {
+      msg += (msg.empty() ? "" : "|") + frame.read<std::string>().value();
+    }
+    msgs.emplace_back(std::move(msg));
+  }
+  return msgs;
+}
+
+} // namespace
+
+TEST(ZmqProxyTest, PushPull) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_PULL, ZMQ_SERVER> frontend(context);
+  Socket<ZMQ_PUSH, ZMQ_SERVER> backend(context);
+  frontend.bind(kFrontendUrl).value();
+  backend.bind(kBackendUrl).value();
+
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> producer(context);
+  Socket<ZMQ_PULL, ZMQ_CLIENT> consumer(context);
+  producer.connect(kFrontendUrl).value();
+  consumer.connect(kBackendUrl).value();
+
+  // Batches of 3, 10 messages need 4 of them
+  ZmqProxy::Options options;
+  options.maxBatchSize = 3;
+  ZmqProxy proxy(evl, frontend, backend, nullptr, options);
+  EXPECT_EQ(ZmqProxy::State::IDLE, proxy.getState());
+  proxy.start();
+  EXPECT_EQ(ZmqProxy::State::RUNNING, proxy.getState());
+
+  for (int i = 0; i < 10; ++i) {
+    producer
+        .sendMultiple(
+            Message::from(std::string("msg")).value(),
+            Message::from(std::to_string(i)).value())
+        .value();
+  }
+
+  evl.scheduleTimeout(100ms, [&]() noexcept {
+    auto msgs = recvAll(consumer);
+    ASSERT_EQ(10, msgs.size());
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(folly::sformat("msg|{}", i), msgs[i]);
+    }
+
+    const auto stats = proxy.getStats();
+    EXPECT_EQ(10, stats.frontendToBackend.numMsgs);
+    EXPECT_EQ(20, stats.frontendToBackend.numFrames);
+    EXPECT_EQ(0, stats.frontendToBackend.numDropped);
+    EXPECT_EQ(0, stats.frontendToBackend.numCaptured);
+    EXPECT_EQ(0, stats.backendToFrontend.numMsgs);
+
+    const auto counters = stats.getCounters("proxy");
+    EXPECT_EQ(10, counters.at("proxy.frontend_to_backend.msgs"));
+    EXPECT_EQ(0, counters.at("proxy.backend_to_frontend.msgs"));
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqProxyTest, RouterDealerWithCapture) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> frontend(context);
+  Socket<ZMQ_DEALER, ZMQ_SERVER> backend(context);
+  Socket<ZMQ_PAIR, ZMQ_SERVER> capture(context);
+  frontend.bind(kFrontendUrl).value();
+  backend.bind(kBackendUrl).value();
+  capture.bind(kCaptureUrl).value();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(context, IdentityString{"client"});
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> worker(context);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> captureSink(context);
+  client.connect(kFrontendUrl).value();
+  worker.connect(kBackendUrl).value();
+  captureSink.connect(kCaptureUrl).value();
+
+  // Every other message gets captured
+  ZmqProxy::Options options;
+  options.captureSampleRate = 2;
+  ZmqProxy proxy(evl, frontend, backend, &capture, options);
+  proxy.start();
+
+  // Worker replies with upper cased request, envelope as is
+  evl.addSocket(RawZmqSocketPtr{*worker}, ZMQ_POLLIN, [&](int) noexcept {
+    auto request = worker.recvMultiple().value();
+    ASSERT_EQ(2, request.size());
+    EXPECT_EQ("client", request.at(0).read<std::string>().value());
+    auto body = request.at(1).read<std::string>().value();
+    for (auto& c : body) {
+      c = std::toupper(c);
+    }
+    request.back() = Message::from(body).value();
+    worker.sendBatch(std::move(request)).value();
+  });
+
+  const int kNumRequests = 4;
+  for (int i = 0; i < kNumRequests; ++i) {
+    client.sendOne(Message::from(folly::sformat("req{}", i)).value()).value();
+  }
+
+  evl.scheduleTimeout(100ms, [&]() noexcept {
+    auto replies = recvAll(client);
+    ASSERT_EQ(kNumRequests, replies.size());
+    for (int i = 0; i < kNumRequests; ++i) {
+      EXPECT_EQ(folly::sformat("REQ{}", i), replies[i]);
+    }
+
+    // Half of the requests plus replies, with their envelope
+    auto captured = recvAll(captureSink);
+    EXPECT_EQ(kNumRequests, captured.size());
+    for (auto const& msg : captured) {
+      EXPECT_EQ(0, msg.find("client|"));
+    }
+
+    const auto stats = proxy.getStats();
+    EXPECT_EQ(kNumRequests, stats.frontendToBackend.numMsgs);
+    EXPECT_EQ(kNumRequests, stats.backendToFrontend.numMsgs);
+    EXPECT_EQ(
+        kNumRequests,
+        stats.frontendToBackend.numCaptured +
+            stats.backendToFrontend.numCaptured);
+
+    evl.removeSocket(RawZmqSocketPtr{*worker});
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqProxyTest, CaptureOneDirection) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> frontend(context);
+  Socket<ZMQ_DEALER, ZMQ_SERVER> backend(context);
+  Socket<ZMQ_PAIR, ZMQ_SERVER> capture(context);
+  frontend.bind(kFrontendUrl).value();
+  backend.bind(kBackendUrl).value();
+  capture.bind(kCaptureUrl).value();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(context, IdentityString{"client"});
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> worker(context);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> captureSink(context);
+  client.connect(kFrontendUrl).value();
+  worker.connect(kBackendUrl).value();
+  captureSink.connect(kCaptureUrl).value();
+
+  // Requests only
+  ZmqProxy::Options options;
+  options.captureBackendToFrontend = false;
+  ZmqProxy proxy(evl, frontend, backend, &capture, options);
+  proxy.start();
+
+  // Worker echoes requests
+  evl.addSocket(RawZmqSocketPtr{*worker}, ZMQ_POLLIN, [&](int) noexcept {
+    worker.sendBatch(worker.recvMultiple().value()).value();
+  });
+
+  const int kNumRequests = 4;
+  for (int i = 0; i < kNumRequests; ++i) {
+    client.sendOne(Message::from(folly::sformat("req{}", i)).value()).value();
+  }
+
+  evl.scheduleTimeout(100ms, [&]() noexcept {
+    EXPECT_EQ(kNumRequests, recvAll(client).size());
+
+    auto captured = recvAll(captureSink);
+    ASSERT_EQ(kNumRequests, captured.size());
+    for (int i = 0; i < kNumRequests; ++i) {
+      EXPECT_EQ(folly::sformat("client|req{}", i), captured[i]);
+    }
+
+    const auto stats = proxy.getStats();
+    EXPECT_EQ(kNumRequests, stats.frontendToBackend.numCaptured);
+    EXPECT_EQ(0, stats.backendToFrontend.numCaptured);
+
+    evl.removeSocket(RawZmqSocketPtr{*worker});
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqProxyTest, DropOnError) {
+  Context context;
+  ZmqEventLoop evl;
+
+  // Router backend drops messages for unknown identities with error
+  Socket<ZMQ_PULL, ZMQ_SERVER> frontend(context);
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> backend(context);
+  frontend.bind(kFrontendUrl).value();
+  backend.bind(kBackendUrl).value();
+
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> producer(context);
+  producer.connect(kFrontendUrl).value();
+
+  ZmqProxy proxy(evl, frontend, backend);
+  proxy.start();
+  producer
+      .sendMultiple(
+          Message::from(std::string("unknown")).value(),
+          Message::from(std::string("body")).value())
+      .value();
+
+  evl.scheduleTimeout(100ms, [&]() noexcept {
+    const auto stats = proxy.getStats();
+    EXPECT_EQ(0, stats.frontendToBackend.numMsgs);
+    EXPECT_EQ(1, stats.frontendToBackend.numDropped);
+    evl.stop();
+  });
+  evl.run();
+}
+
+TEST(ZmqProxyTest, PauseResumeTerminate) {
+  Context context;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_PULL, ZMQ_SERVER> frontend(context);
+  Socket<ZMQ_PUSH, ZMQ_SERVER> backend(context);
+  frontend.bind(kFrontendUrl).value();
+  backend.bind(kBackendUrl).value();
+
+  Socket<ZMQ_PUSH, ZMQ_CLIENT> producer(context);
+  Socket<ZMQ_PULL, ZMQ_CLIENT> consumer(context);
+  producer.connect(kFrontendUrl).value();
+  consumer.connect(kBackendUrl).value();
+
+  ZmqProxy proxy(evl, frontend, backend);
+  proxy.start();
+
+  std::thread evlThread([&]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  auto send = [&](std::string const& str) {
+    evl.runInEventLoop([&producer, str]() noexcept {
+      producer.sendOne(Message::from(str).value()).value();
+    });
+  };
+  auto recv = [&]() {
+    std::vector<std::string> msgs;
+    folly::Baton<> baton;
+    evl.runInEventLoop([&]() noexcept {
+      msgs = recvAll(consumer);
+      baton.post();
+    });
+    baton.wait();
+    return msgs;
+  };
+
+  // Paused from another thread, messages queue up on frontend
+  proxy.pause();
+  send("a");
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(ZmqProxy::State::PAUSED, proxy.getState());
+  EXPECT_TRUE(recv().empty());
+
+  // Queued up messages get forwarded on resume
+  proxy.resume();
+  send("b");
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(ZmqProxy::State::RUNNING, proxy.getState());
+  EXPECT_EQ(std::vector<std::string>({"a", "b"}), recv());
+
+  // Can't be resumed once terminated
+  proxy.terminate();
+  proxy.resume();
+  send("c");
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(ZmqProxy::State::TERMINATED, proxy.getState());
+  EXPECT_TRUE(recv().empty());
+
+  evl.stop();
+  evlThread.join();
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqRateLimiter.h>
+
+namespace chrono = std::chrono;
+
+namespace fbzmq {
+
+TEST(ZmqRateLimiterTest, TryAcquire) {
+  ZmqEventLoop evl;
+  ZmqRateLimiter limiter(&evl, 10 /* ratePerSec */, 5 /* burstSize */);
+
+  // Burst is available right away
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.tryAcquire());
+  }
+  EXPECT_FALSE(limiter.tryAcquire());
+  EXPECT_GT(1, limiter.getAvailableTokens());
+
+  // Bucket gets refilled over time but never beyond burst size
+  std::this_thread::sleep_for(chrono::milliseconds(250));
+  EXPECT_TRUE(limiter.tryAcquire(2));
+  std::this_thread::sleep_for(chrono::milliseconds(1000));
+  EXPECT_DOUBLE_EQ(5, limiter.getAvailableTokens());
+  EXPECT_FALSE(limiter.tryAcquire(6));
+  EXPECT_TRUE(limiter.tryAcquire(5));
+}
+
+TEST(ZmqRateLimiterTest, Run) {
+  ZmqEventLoop evl;
+  ZmqRateLimiter limiter(&evl, 100 /* ratePerSec */, 10 /* burstSize */);
+
+  const int kNumCallbacks = 30;
+  std::vector<int> order;
+  chrono::steady_clock::time_point start;
+  chrono::steady_clock::time_point end;
+  evl.scheduleTimeout(chrono::milliseconds(0), [&]() noexcept {
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < kNumCallbacks; ++i) {
+      limiter.run([&, i]() noexcept {
+        order.push_back(i);
+        if (order.size() == kNumCallbacks) {
+          end = chrono::steady_clock::now();
+          evl.stop();
+        }
+      });
+    }
+
+    // Burst is invoked inline, rest are queued
+    EXPECT_EQ(10, order.size());
+    EXPECT_EQ(kNumCallbacks - 10, limiter.getNumPending());
+
+    // Queued callbacks are served ahead of new acquisitions
+    EXPECT_FALSE(limiter.tryAcquire());
+  });
+  evl.run();
+
+  // Callbacks are invoked in order at the configured rate
+  ASSERT_EQ(kNumCallbacks, order.size());
+  for (int i = 0; i < kNumCallbacks; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+  EXPECT_EQ(0, limiter.getNumPending());
+  EXPECT_LE(chrono::milliseconds(190), end - start);
+}
+
+TEST(ZmqRateLimiterTest, ClearPending) {
+  ZmqEventLoop evl;
+  ZmqRateLimiter limiter(&evl, 10 /* ratePerSec */, 1 /* burstSize */);
+
+  int count{0};
+  evl.scheduleTimeout(chrono::milliseconds(0), [&]() noexcept {
+    for (int i = 0; i < 3; ++i) {
+      limiter.run([&]() noexcept { ++count; });
+    }
+    EXPECT_EQ(1, count);
+    EXPECT_EQ(2, limiter.getNumPending());
+    limiter.clearPending();
+    EXPECT_EQ(0, limiter.getNumPending());
+  });
+  evl.scheduleTimeout(chrono::milliseconds(300), [&]() noexcept {
+    EXPECT_EQ(1, count);
+    evl.stop();
+  });
+  evl.run();
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqSocketMonitor.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/service/stats/ThreadData.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+std::string
+getSocketUrl(const std::string& urlPrefix) {
+  auto tid = std::hash<std::thread::id>()(std::this_thread::get_id());
+  return folly::sformat("ipc://{}_{}", urlPrefix, tid);
+}
+
+} // namespace
+
+TEST(ZmqSocketMonitorTest, ReconnectChurn) {
+  Context ctx;
+  ZmqEventLoop evl;
+  const std::string kServerUrl{getSocketUrl("zmq_socket_monitor_churn")};
+
+  // Client keeps on retrying until server shows up
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(ctx);
+  const int reconnectIvl = 10;
+  client.setSockOpt(ZMQ_RECONNECT_IVL, &reconnectIvl, sizeof(reconnectIvl))
+      .value();
+  Socket<ZMQ_DEALER, ZMQ_SERVER> server(ctx);
+
+  int numEvents{0};
+  ZmqSocketMonitor monitor(
+      evl,
+      client,
+      SocketUrl{"inproc://zmq_socket_monitor_churn"},
+      [&numEvents](SocketMonitorMessage, SocketUrl) { ++numEvents; });
+  client.connect(SocketUrl{kServerUrl}).value();
+
+  evl.scheduleTimeout(
+      100ms, [&]() noexcept { server.bind(SocketUrl{kServerUrl}).value(); });
+
+  ThreadData threadData;
+  auto checkTimer = ZmqTimeout::make(&evl, [&]() noexcept {
+    auto const& endpoints = monitor.getStats().endpoints;
+    auto it = endpoints.find(kServerUrl);
+    if (it == endpoints.end() or it->second.numActivePeers == 0) {
+      return;
+    }
+    auto const& stats = it->second;
+    EXPECT_LT(0, stats.numConnectRetried);
+    EXPECT_EQ(1, stats.numConnected);
+    EXPECT_EQ(0, stats.numDisconnected);
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(4, 3, 0)
+    EXPECT_EQ(1, stats.numHandshakeSucceeded);
+#endif
+    EXPECT_LT(0, numEvents);
+
+    threadData.setCounters(monitor.getStats().getCounters("client"));
+    const auto counters = threadData.getCounters();
+    EXPECT_EQ(1, counters.at("client." + kServerUrl + ".active_peers"));
+    EXPECT_EQ(
+        stats.numConnectRetried,
+        counters.at("client." + kServerUrl + ".connect_retried"));
+    evl.stop();
+  });
+  checkTimer->scheduleTimeout(10ms, true /* isPeriodic */);
+
+  evl.run();
+  EXPECT_TRUE(monitor.isRunning());
+}
+
+TEST(ZmqSocketMonitorTest, StopsWithSocket) {
+  Context ctx;
+  ZmqEventLoop evl;
+
+  Socket<ZMQ_DEALER, ZMQ_SERVER> server(ctx);
+  server.bind(SocketUrl{getSocketUrl("zmq_socket_monitor_stop")}).value();
+  ZmqSocketMonitor monitor(
+      evl, server, SocketUrl{"inproc://zmq_socket_monitor_stop"});
+
+  evl.scheduleTimeout(10ms, [&]() noexcept { server.close(); });
+  auto checkTimer = ZmqTimeout::make(&evl, [&]() noexcept {
+    if (not monitor.isRunning()) {
+      evl.stop();
+    }
+  });
+  checkTimer->scheduleTimeout(10ms, true /* isPeriodic */);
+
+  evl.run();
+  EXPECT_FALSE(monitor.isRunning());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
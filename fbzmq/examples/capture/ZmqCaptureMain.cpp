@@ -0,0 +1,138 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fbzmq/async/StopEventLoopSignalHandler.h>
+#include <fbzmq/async/ZmqProxy.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/examples/common/Constants.h>
+#include <fbzmq/zmq/MessageCapture.h>
+#include <fbzmq/zmq/Zmq.h>
+
+DEFINE_string(
+    frontend_url,
+    "tcp://[::1]:55560",
+    "Url clients connect to instead of the service");
+DEFINE_string(
+    backend_url,
+    fbzmq::example::Constants::kStringCmdUrl.data(),
+    "Url of the service (ROUTER) traffic is forwarded to");
+DEFINE_string(output, "capture.fbzmq", "Capture file, appended to");
+DEFINE_int32(sample_rate, 1, "Capture every Nth message");
+DEFINE_string(
+    directions, "requests", "Captured directions: requests | replies | both");
+DEFINE_int32(flush_interval_ms, 1000, "Interval of flushing capture file");
+
+namespace {
+
+const fbzmq::SocketUrl kCaptureUrl{"inproc://zmq_capture"};
+
+} // namespace
+
+/**
+ * Transparent ROUTER-DEALER proxy in front of a service, recording the
+ * traffic passing through into a capture file (refer to MessageCaptureWriter)
+ * for `zmq_replay`. Frames are recorded as seen by the proxy, i.e. requests
+ * start with the identity of client added by the ROUTER frontend.
+ */
+int
+main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  CHECK(
+      FLAGS_directions == "requests" or FLAGS_directions == "replies" or
+      FLAGS_directions == "both")
+      << "Unknown directions " << FLAGS_directions;
+  CHECK_LT(0, FLAGS_sample_rate);
+  CHECK_LT(0, FLAGS_flush_interval_ms);
+
+  // Stop on signals, capture file is flushed on the way out
+  fbzmq::ZmqEventLoop evl;
+  fbzmq::StopEventLoopSignalHandler handler(&evl);
+  handler.registerSignalHandler(SIGINT);
+  handler.registerSignalHandler(SIGQUIT);
+  handler.registerSignalHandler(SIGTERM);
+
+  auto writer = fbzmq::MessageCaptureWriter::open(FLAGS_output);
+  if (writer.hasError()) {
+    LOG(FATAL) << "Failed to open " << FLAGS_output << ". " << writer.error();
+  }
+
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_ROUTER, fbzmq::ZMQ_SERVER> frontend(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> backend(ctx);
+  frontend.bind(fbzmq::SocketUrl{FLAGS_frontend_url}).value();
+  backend.connect(fbzmq::SocketUrl{FLAGS_backend_url}).value();
+
+  // Proxy copies messages onto capture socket, peer records them
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> capture(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> recorder(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{true});
+  capture.bind(kCaptureUrl).value();
+  recorder.connect(kCaptureUrl).value();
+
+  std::vector<fbzmq::Message> frames;
+  evl.addSocket(
+      fbzmq::RawZmqSocketPtr{*recorder}, ZMQ_POLLIN, [&](int) noexcept {
+        while (true) {
+          auto ret = recorder.recvMultipleInto(frames);
+          if (ret.hasError()) {
+            if (ret.error().errNum != EAGAIN) {
+              LOG(ERROR) << "Failed to receive captured message. "
+                         << ret.error();
+            }
+            return;
+          }
+          auto written = writer.value()->write(frames);
+          if (written.hasError()) {
+            LOG(ERROR) << "Failed to write capture file. " << written.error();
+          }
+        }
+      });
+
+  // Records are buffered, flush them regularly for readers of a capture in
+  // progress
+  auto flushTimer = fbzmq::ZmqTimeout::make(&evl, [&]() noexcept {
+    auto ret = writer.value()->flush();
+    if (ret.hasError()) {
+      LOG(ERROR) << "Failed to flush capture file. " << ret.error();
+    }
+  });
+  flushTimer->scheduleTimeout(
+      std::chrono::milliseconds(FLAGS_flush_interval_ms),
+      true /* isPeriodic */);
+
+  fbzmq::ZmqProxy::Options options;
+  options.captureSampleRate = FLAGS_sample_rate;
+  options.captureFrontendToBackend = FLAGS_directions != "replies";
+  options.captureBackendToFrontend = FLAGS_directions != "requests";
+  fbzmq::ZmqProxy proxy(evl, frontend, backend, &capture, options);
+  proxy.start();
+
+  LOG(INFO) << "Capturing " << FLAGS_directions << " between "
+            << FLAGS_frontend_url << " and " << FLAGS_backend_url << " into "
+            << FLAGS_output << " ...";
+  evl.run();
+
+  // Loop has stopped, hence proxy and loop can be accessed from here
+  proxy.terminate();
+  evl.removeSocket(fbzmq::RawZmqSocketPtr{*recorder});
+  flushTimer.reset();
+
+  const auto stats = proxy.getStats();
+  LOG(INFO) << "Captured " << writer.value()->getNumMessages()
+            << " messages, " << writer.value()->getNumBytes() << " bytes";
+  LOG(INFO) << "Forwarded " << stats.frontendToBackend.numMsgs
+            << " requests, " << stats.backendToFrontend.numMsgs << " replies";
+
+  return 0;
+}
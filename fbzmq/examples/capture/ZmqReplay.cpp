@@ -0,0 +1,217 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fbzmq/examples/capture/ZmqReplay.h>
+
+#include <algorithm>
+
+namespace fbzmq {
+namespace example {
+
+namespace {
+
+// Max messages sent in one go, keeps loop responsive to replies
+constexpr size_t kMaxBatchSize{1024};
+
+// Retry interval of sends while socket is at HWM
+constexpr std::chrono::milliseconds kBackoffInterval{1};
+
+int64_t
+toMicros(ZmqReplay::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+} // namespace
+
+ZmqReplay::ZmqReplay(
+    fbzmq::Context& zmqContext,
+    ZmqReplayOptions options,
+    std::vector<fbzmq::CapturedMessage> messages)
+    : options_(std::move(options)), messages_(std::move(messages)) {
+  CHECK(not messages_.empty()) << "Nothing to replay";
+  CHECK_LE(0, options_.speed);
+
+  const fbzmq::SocketUrl url{options_.url};
+  if (options_.socketType == ReplaySocketType::DEALER) {
+    dealer_ = std::make_unique<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>>(
+        zmqContext, folly::none, folly::none, fbzmq::NonblockingFlag{true});
+    dealer_->connect(url).value();
+    addSocket(
+        fbzmq::RawZmqSocketPtr{**dealer_},
+        ZMQ_POLLIN,
+        [this](int) noexcept { processReplies(); });
+    sock_ = dealer_.get();
+  } else {
+    push_ = std::make_unique<fbzmq::Socket<ZMQ_PUSH, fbzmq::ZMQ_CLIENT>>(
+        zmqContext, folly::none, folly::none, fbzmq::NonblockingFlag{true});
+    push_->connect(url).value();
+    sock_ = push_.get();
+  }
+
+  results_.captured = std::chrono::duration_cast<Clock::duration>(
+      messages_.back().timestamp - messages_.front().timestamp);
+
+  // Kick off once loop is running
+  isSendScheduled_ = true;
+  scheduleTimeout(std::chrono::milliseconds(0), [this]() noexcept {
+    startTime_ = Clock::now();
+    lastSendTime_ = startTime_;
+    isSendScheduled_ = false;
+    sendDue();
+  });
+}
+
+ZmqReplay::~ZmqReplay() {
+  if (dealer_) {
+    removeSocket(fbzmq::RawZmqSocketPtr{**dealer_});
+  }
+}
+
+void
+ZmqReplay::sendDue() noexcept {
+  if (isDone_ or isSendScheduled_) {
+    return;
+  }
+  auto resume = [this]() noexcept {
+    isSendScheduled_ = false;
+    sendDue();
+  };
+
+  for (size_t numSent = 0; next_ < messages_.size(); ++numSent) {
+    if (numSent == kMaxBatchSize) {
+      isSendScheduled_ = true;
+      scheduleTimeout(std::chrono::milliseconds(0), resume);
+      return;
+    }
+
+    const auto now = Clock::now();
+    auto const& msg = messages_[next_];
+    auto intended = now;
+    if (options_.speed > 0) {
+      // Offset from the first message, scaled by speed
+      intended = startTime_ +
+          std::chrono::duration_cast<Clock::duration>(
+                     (msg.timestamp - messages_.front().timestamp) /
+                     options_.speed);
+      if (intended > now) {
+        isSendScheduled_ = true;
+        scheduleTimeoutAt(intended, resume);
+        return;
+      }
+    } else if (
+        dealer_ and options_.maxInflight > 0 and
+        pending_.size() >= options_.maxInflight) {
+      // Replies resume sending
+      return;
+    }
+
+    if (not sendMessage(msg, intended)) {
+      ++results_.numBackoffs;
+      isSendScheduled_ = true;
+      scheduleTimeout(kBackoffInterval, resume);
+      return;
+    }
+    ++next_;
+  }
+
+  // All sent, wait for replies
+  if (pending_.empty()) {
+    finish();
+    return;
+  }
+  scheduleTimeout(options_.timeout, [this]() noexcept { finish(); });
+}
+
+bool
+ZmqReplay::sendMessage(
+    fbzmq::CapturedMessage const& msg, Clock::time_point intended) {
+  if (msg.frames.size() <= options_.skipFrames) {
+    ++results_.numErrors;
+    return true;
+  }
+
+  // Copies share payload of captured frames
+  std::vector<fbzmq::Message> frames(
+      msg.frames.begin() + options_.skipFrames, msg.frames.end());
+  size_t numBytes{0};
+  for (auto const& frame : frames) {
+    numBytes += frame.size();
+  }
+  auto ret = sock_->sendBatch(std::move(frames));
+  if (ret.hasError()) {
+    if (ret.error().errNum == EAGAIN) {
+      return false;
+    }
+    VLOG(2) << "ZmqReplay: Failed to send message. " << ret.error();
+    ++results_.numErrors;
+    return true;
+  }
+
+  const auto now = Clock::now();
+  ++results_.numSent;
+  results_.numBytes += numBytes;
+  results_.lateness.record(std::max<int64_t>(0, toMicros(now - intended)));
+  lastSendTime_ = now;
+  if (dealer_) {
+    pending_.emplace_back(intended);
+  }
+  return true;
+}
+
+void
+ZmqReplay::processReplies() noexcept {
+  while (true) {
+    auto ret = dealer_->recvMultipleInto(frames_);
+    if (ret.hasError()) {
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqReplay: Failed to receive reply. " << ret.error();
+      }
+      break;
+    }
+    if (isDone_) {
+      continue;
+    }
+
+    // Replies come back in order of requests, as a single service would send
+    // them. Unsolicited ones are counted as errors.
+    if (pending_.empty()) {
+      ++results_.numErrors;
+      continue;
+    }
+    const auto latencyUs =
+        std::max<int64_t>(0, toMicros(Clock::now() - pending_.front()));
+    pending_.pop_front();
+    ++results_.numReplies;
+    results_.latency.record(latencyUs);
+  }
+
+  if (isDone_) {
+    return;
+  }
+  if (next_ < messages_.size()) {
+    sendDue();
+  } else if (pending_.empty()) {
+    finish();
+  }
+}
+
+void
+ZmqReplay::finish() noexcept {
+  if (isDone_) {
+    return;
+  }
+  isDone_ = true;
+  results_.numMissingReplies = pending_.size();
+  results_.elapsed = lastSendTime_ - startTime_;
+  pending_.clear();
+  stop();
+}
+
+} // namespace example
+} // namespace fbzmq
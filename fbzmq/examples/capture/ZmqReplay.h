@@ -0,0 +1,137 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/examples/loadgen/LatencyHistogram.h>
+#include <fbzmq/zmq/MessageCapture.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+namespace example {
+
+enum class ReplaySocketType {
+  // Messages are requests, replies are matched to them in order
+  DEALER,
+  // One way messages, no replies
+  PUSH,
+};
+
+struct ZmqReplayOptions {
+  std::string url;
+  ReplaySocketType socketType{ReplaySocketType::DEALER};
+
+  // Multiple of the captured rate, i.e. 2 replays twice as fast, keeping
+  // inter-arrival times in proportion. 0 for max speed.
+  double speed{1};
+
+  // Leading frames of captured messages which aren't sent, e.g. 1 for the
+  // identity of client recorded by `zmq_capture`
+  size_t skipFrames{0};
+
+  // Max requests in flight at max speed (DEALER only), 0 for no limit
+  size_t maxInflight{128};
+
+  // Replies still missing this long after the last message are given up on
+  std::chrono::milliseconds timeout{1000};
+};
+
+/**
+ * Replays messages of a capture file (refer to MessageCaptureWriter) against
+ * a service, preserving their multipart boundaries and inter-arrival times
+ * (scaled by `speed`). Sends are open loop, i.e. independent of replies, and
+ * latency counts from the intended time of sending, as with ZmqLoadGen. Stops
+ * the loop once all messages are sent and replied to (or timed out).
+ *
+ *  ZmqReplay replay(context, options, std::move(messages));
+ *  replay.run();
+ *  replay.getResults().latency.printPercentiles(std::cout, 1000);
+ */
+class ZmqReplay final : public fbzmq::ZmqEventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Results {
+    // Latencies of replies in microseconds
+    LatencyHistogram latency;
+    // Delay of sends behind their intended time in microseconds
+    LatencyHistogram lateness;
+    uint64_t numSent{0};
+    uint64_t numBytes{0};
+    uint64_t numReplies{0};
+    uint64_t numMissingReplies{0};
+    uint64_t numErrors{0};
+    // Times sends backed off as socket was at HWM
+    uint64_t numBackoffs{0};
+    // Span of the capture, and of the replay from first to last send
+    Clock::duration captured{0};
+    Clock::duration elapsed{0};
+  };
+
+  ZmqReplay(
+      fbzmq::Context& zmqContext,
+      ZmqReplayOptions options,
+      std::vector<fbzmq::CapturedMessage> messages);
+
+  ~ZmqReplay() override;
+
+  /**
+   * Results of the run. Must be called once loop has stopped.
+   */
+  Results const&
+  getResults() const {
+    return results_;
+  }
+
+ private:
+  // Send messages which are due, and schedule the next send
+  void sendDue() noexcept;
+
+  // Returns false if socket is at HWM and send should be retried
+  bool sendMessage(
+      fbzmq::CapturedMessage const& msg, Clock::time_point intended);
+
+  void processReplies() noexcept;
+
+  // Stop once replies are in, or given up on
+  void finish() noexcept;
+
+  const ZmqReplayOptions options_;
+  const std::vector<fbzmq::CapturedMessage> messages_;
+
+  std::unique_ptr<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>> dealer_;
+  std::unique_ptr<fbzmq::Socket<ZMQ_PUSH, fbzmq::ZMQ_CLIENT>> push_;
+  fbzmq::detail::SocketImpl* sock_{nullptr};
+
+  // Next message to send
+  size_t next_{0};
+  // Send (or backoff) is scheduled on the loop
+  bool isSendScheduled_{false};
+
+  // Intended send times of requests waiting for a reply, in order
+  std::deque<Clock::time_point> pending_;
+
+  Clock::time_point startTime_;
+  Clock::time_point lastSendTime_;
+  bool isDone_{false};
+
+  Results results_;
+
+  // Frames of replies, reused across replies
+  std::vector<fbzmq::Message> frames_;
+};
+
+} // namespace example
+} // namespace fbzmq
@@ -0,0 +1,137 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fbzmq/examples/capture/ZmqReplay.h>
+#include <fbzmq/examples/common/Constants.h>
+
+DEFINE_string(input, "capture.fbzmq", "Capture file to replay");
+DEFINE_string(
+    url,
+    fbzmq::example::Constants::kStringCmdUrl.data(),
+    "Url of service to replay against");
+DEFINE_string(socket_type, "dealer", "Socket type: dealer | push");
+DEFINE_double(
+    speed, 1, "Multiple of captured rate, e.g. 2 for twice, 0 for max speed");
+DEFINE_int32(
+    skip_frames,
+    1,
+    "Leading frames not sent, 1 for client identity recorded by zmq_capture");
+DEFINE_int32(
+    max_inflight, 128, "Max requests in flight at max speed, 0 for no limit");
+DEFINE_int32(timeout_ms, 1000, "Wait for missing replies in milliseconds");
+DEFINE_int32(io_threads, 1, "ZMQ I/O threads");
+DEFINE_string(
+    hgrm_output,
+    "",
+    "File to write latency distribution to, in HdrHistogram (.hgrm) format");
+
+namespace {
+
+std::vector<fbzmq::CapturedMessage>
+readCapture(std::string const& path) {
+  auto reader = fbzmq::MessageCaptureReader::open(path);
+  if (reader.hasError()) {
+    LOG(FATAL) << "Failed to open " << path << ". " << reader.error();
+  }
+
+  // Whole capture is loaded upfront, reading it doesn't skew the replay
+  std::vector<fbzmq::CapturedMessage> messages;
+  while (true) {
+    auto msg = reader.value()->next();
+    if (msg.hasError()) {
+      // Capture may still be in progress, replay what is complete
+      LOG(WARNING) << "Stopped reading " << path << " after "
+                   << messages.size() << " messages. " << msg.error();
+      break;
+    }
+    if (not msg.value()) {
+      break;
+    }
+    messages.emplace_back(std::move(msg.value().value()));
+  }
+  return messages;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  CHECK(FLAGS_socket_type == "dealer" or FLAGS_socket_type == "push")
+      << "Unknown socket type " << FLAGS_socket_type;
+  CHECK_LE(0, FLAGS_skip_frames);
+  CHECK_LE(0, FLAGS_max_inflight);
+
+  auto messages = readCapture(FLAGS_input);
+  CHECK(not messages.empty()) << "No messages in " << FLAGS_input;
+
+  fbzmq::example::ZmqReplayOptions options;
+  options.url = FLAGS_url;
+  options.socketType = FLAGS_socket_type == "dealer"
+      ? fbzmq::example::ReplaySocketType::DEALER
+      : fbzmq::example::ReplaySocketType::PUSH;
+  options.speed = FLAGS_speed;
+  options.skipFrames = FLAGS_skip_frames;
+  options.maxInflight = FLAGS_max_inflight;
+  options.timeout = std::chrono::milliseconds(FLAGS_timeout_ms);
+
+  // Zmq Context
+  fbzmq::Context ctx(static_cast<uint16_t>(FLAGS_io_threads));
+
+  const auto numMessages = messages.size();
+  fbzmq::example::ZmqReplay replay(ctx, options, std::move(messages));
+  LOG(INFO) << "Replaying " << numMessages << " messages against "
+            << FLAGS_url << " ...";
+  replay.run();
+
+  auto const& results = replay.getResults();
+  const double captured =
+      std::chrono::duration<double>(results.captured).count();
+  const double seconds =
+      std::chrono::duration<double>(results.elapsed).count();
+  std::cout << folly::sformat(
+      "sent {}, replies {}, missing replies {}, errors {}, backoffs {}\n"
+      "replayed {:.3f} s of capture in {:.3f} s ({:.2f}x)\n"
+      "throughput {:.1f} msgs/s, {:.2f} MB/s\n"
+      "send lateness p50 {} us, p99 {} us, max {} us\n\n",
+      results.numSent,
+      results.numReplies,
+      results.numMissingReplies,
+      results.numErrors,
+      results.numBackoffs,
+      captured,
+      seconds,
+      seconds > 0 ? captured / seconds : 0,
+      seconds > 0 ? results.numSent / seconds : 0,
+      seconds > 0 ? results.numBytes / seconds / 1e6 : 0,
+      results.lateness.getValueAtPercentile(50),
+      results.lateness.getValueAtPercentile(99),
+      results.lateness.getMax());
+
+  // Latencies are recorded in microseconds, printed in milliseconds
+  if (results.latency.getCount() > 0) {
+    results.latency.printPercentiles(std::cout, 1000.0);
+  }
+  if (not FLAGS_hgrm_output.empty()) {
+    std::ofstream file(FLAGS_hgrm_output);
+    results.latency.printPercentiles(file, 1000.0);
+    LOG(INFO) << "Wrote latency distribution to " << FLAGS_hgrm_output;
+  }
+
+  return 0;
+}
@@ -19,6 +19,8 @@ constexpr folly::StringPiece Constants::kThriftCmdUrl;
 
 constexpr folly::StringPiece Constants::kMultipleCmdUrl;
 
+constexpr folly::StringPiece Constants::kRpcCmdUrl;
+
 constexpr folly::StringPiece Constants::kPubUrl;
 
 constexpr std::chrono::milliseconds Constants::kReadTimeout;
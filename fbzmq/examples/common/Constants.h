@@ -30,6 +30,9 @@ class Constants {
   // the zmq url for request/reply multiple message
   static constexpr folly::StringPiece kMultipleCmdUrl = "tcp://127.0.0.1:55558";
 
+  // the zmq url for pipelined rpc requests
+  static constexpr folly::StringPiece kRpcCmdUrl = "tcp://127.0.0.1:55560";
+
   // the zmq url for subscribe/publish primitive message
   static constexpr folly::StringPiece kPubUrl = "tcp://127.0.0.1:55559";
 
@@ -0,0 +1,178 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fbzmq/examples/loadgen/LatencyHistogram.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <folly/Format.h>
+
+namespace fbzmq {
+namespace example {
+
+namespace {
+
+constexpr uint64_t kLinearLimit{1ULL << LatencyHistogram::kSubBucketBits};
+constexpr uint64_t kSubBuckets{kLinearLimit / 2};
+
+// Exact buckets, followed by sub-buckets of every power of two above them
+constexpr size_t kNumBuckets{
+    kLinearLimit + (64 - LatencyHistogram::kSubBucketBits) * kSubBuckets};
+
+} // namespace
+
+constexpr uint32_t LatencyHistogram::kSubBucketBits;
+
+LatencyHistogram::LatencyHistogram() : counts_(kNumBuckets, 0) {}
+
+size_t
+LatencyHistogram::getBucketIndex(uint64_t value) {
+  if (value < kLinearLimit) {
+    return value;
+  }
+  const uint32_t msb = 63 - __builtin_clzll(value);
+  const uint32_t shift = msb - (kSubBucketBits - 1);
+  const uint64_t subBucket = value >> shift;
+  return kLinearLimit + (shift - 1) * kSubBuckets + (subBucket - kSubBuckets);
+}
+
+uint64_t
+LatencyHistogram::getHighestEquivalentValue(size_t index) {
+  if (index < kLinearLimit) {
+    return index;
+  }
+  const size_t offset = index - kLinearLimit;
+  const uint32_t shift = offset / kSubBuckets + 1;
+  const uint64_t subBucket = offset % kSubBuckets + kSubBuckets;
+  const uint64_t lowest = subBucket << shift;
+  return lowest + ((1ULL << shift) - 1);
+}
+
+void
+LatencyHistogram::record(uint64_t value, uint64_t count) {
+  if (count == 0) {
+    return;
+  }
+  counts_[getBucketIndex(value)] += count;
+  count_ += count;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+  sum_ += static_cast<long double>(value) * count;
+  sumSquares_ += static_cast<long double>(value) * value * count;
+}
+
+void
+LatencyHistogram::merge(LatencyHistogram const& other) {
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  sum_ += other.sum_;
+  sumSquares_ += other.sumSquares_;
+}
+
+void
+LatencyHistogram::reset() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+  sum_ = 0;
+  sumSquares_ = 0;
+}
+
+uint64_t
+LatencyHistogram::getMin() const {
+  return count_ ? min_ : 0;
+}
+
+double
+LatencyHistogram::getMean() const {
+  return count_ ? static_cast<double>(sum_ / count_) : 0;
+}
+
+double
+LatencyHistogram::getStdDev() const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const long double mean = sum_ / count_;
+  const long double variance = sumSquares_ / count_ - mean * mean;
+  return variance > 0 ? std::sqrt(static_cast<double>(variance)) : 0;
+}
+
+uint64_t
+LatencyHistogram::getValueAtPercentile(double pct) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  pct = std::min(std::max(pct, 0.0), 100.0);
+  const uint64_t target = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(pct / 100.0 * count_)));
+  uint64_t seen{0};
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += counts_[i];
+    if (seen >= target) {
+      return std::min(getHighestEquivalentValue(i), max_);
+    }
+  }
+  return max_;
+}
+
+void
+LatencyHistogram::printPercentiles(
+    std::ostream& os, double unitScale, uint32_t ticksPerHalfDistance) const {
+  os << folly::sformat(
+      "{:>12} {:>14} {:>10} {:>14}\n\n",
+      "Value",
+      "Percentile",
+      "TotalCount",
+      "1/(1-Percentile)");
+
+  // Percentiles get denser towards the tail, `ticksPerHalfDistance` steps for
+  // every halving of distance to 100%
+  double pct{0};
+  while (count_ and pct < 100.0) {
+    const uint64_t value = getValueAtPercentile(pct);
+    const uint64_t totalCount = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(pct / 100.0 * count_)));
+    os << folly::sformat(
+        "{:12.3f} {:14.12f} {:10d} {:14.2f}\n",
+        value / unitScale,
+        pct / 100.0,
+        totalCount,
+        1.0 / (1.0 - pct / 100.0));
+    if (value >= max_ or totalCount >= count_) {
+      break;
+    }
+    const double halfDistance =
+        std::pow(2.0, std::floor(std::log2(100.0 / (100.0 - pct))) + 1);
+    pct += 100.0 / (ticksPerHalfDistance * halfDistance);
+  }
+  os << folly::sformat(
+      "{:12.3f} {:14.12f} {:10d}\n", max_ / unitScale, 1.0, count_);
+
+  os << folly::sformat(
+      "#[Mean    = {:12.3f}, StdDeviation   = {:12.3f}]\n",
+      getMean() / unitScale,
+      getStdDev() / unitScale);
+  os << folly::sformat(
+      "#[Max     = {:12.3f}, Total count    = {:12d}]\n",
+      max_ / unitScale,
+      count_);
+  os << folly::sformat(
+      "#[Buckets = {:12d}, SubBuckets     = {:12d}]\n",
+      64 - kSubBucketBits,
+      kSubBuckets);
+}
+
+} // namespace example
+} // namespace fbzmq
@@ -0,0 +1,82 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace fbzmq {
+namespace example {
+
+/**
+ * HDR-style histogram of latencies (or any non-negative integer values) with
+ * bounded relative error. Values below 2^kSubBucketBits are kept exactly,
+ * larger ones in log-linear buckets of 2^(kSubBucketBits - 1) sub-buckets per
+ * power of two, i.e. within 0.8% of the recorded value. Memory is fixed (about
+ * 60KB) regardless of the range of values.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr uint32_t kSubBucketBits{8};
+
+  LatencyHistogram();
+
+  void record(uint64_t value, uint64_t count = 1);
+
+  // Add all the values of other histogram
+  void merge(LatencyHistogram const& other);
+
+  void reset();
+
+  uint64_t
+  getCount() const {
+    return count_;
+  }
+
+  uint64_t getMin() const;
+
+  uint64_t
+  getMax() const {
+    return max_;
+  }
+
+  double getMean() const;
+  double getStdDev() const;
+
+  /**
+   * Highest value (equivalent within precision) at or below which `pct`
+   * percent of values are. Returns 0 if empty.
+   */
+  uint64_t getValueAtPercentile(double pct) const;
+
+  /**
+   * Print percentile distribution in the text format of HdrHistogram (.hgrm)
+   * which plotting tools understand. Values are divided by `unitScale`, e.g.
+   * 1000 for recorded microseconds to be printed as milliseconds.
+   */
+  void printPercentiles(
+      std::ostream& os,
+      double unitScale = 1.0,
+      uint32_t ticksPerHalfDistance = 5) const;
+
+ private:
+  static size_t getBucketIndex(uint64_t value);
+  static uint64_t getHighestEquivalentValue(size_t index);
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_{0};
+  uint64_t min_{UINT64_MAX};
+  uint64_t max_{0};
+  long double sum_{0};
+  long double sumSquares_{0};
+};
+
+} // namespace example
+} // namespace fbzmq
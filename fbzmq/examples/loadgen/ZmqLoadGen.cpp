@@ -0,0 +1,343 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fbzmq/examples/loadgen/ZmqLoadGen.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <folly/Format.h>
+
+namespace fbzmq {
+namespace example {
+
+namespace {
+
+constexpr std::chrono::milliseconds kTickInterval{1};
+
+int64_t
+toMicros(ZmqLoadGen::Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+} // namespace
+
+ZmqLoadGen::ZmqLoadGen(fbzmq::Context& zmqContext, ZmqLoadGenOptions options)
+    : options_(std::move(options)), rng_(std::random_device()()) {
+  CHECK_LT(0, options_.numSockets);
+  CHECK_LT(0, options_.maxInflightPerSocket);
+  CHECK_LE(sizeof(uint64_t), options_.payloadSizeMin);
+  CHECK_LE(options_.payloadSizeMin, options_.payloadSizeMax);
+
+  // Random, hence incompressible payload bytes
+  payloadPool_.resize(options_.payloadSizeMax);
+  std::uniform_int_distribution<int> byteDist(0, 255);
+  for (auto& c : payloadPool_) {
+    c = static_cast<char>(byteDist(rng_));
+  }
+
+  const fbzmq::SocketUrl url{options_.url};
+  slots_.resize(options_.numSockets);
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    auto& slot = slots_[i];
+    if (options_.pattern == LoadGenPattern::RPC) {
+      fbzmq::ZmqRpcClient::Options rpcOptions;
+      rpcOptions.defaultTimeout = options_.timeout;
+      slot.rpcClient = std::make_unique<fbzmq::ZmqRpcClient>(
+          *this, zmqContext, url, rpcOptions);
+      continue;
+    }
+
+    slot.sock = std::make_unique<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>>(
+        zmqContext,
+        folly::none,
+        folly::none,
+        fbzmq::NonblockingFlag{true});
+    slot.sock->connect(url).value();
+    addSocket(
+        fbzmq::RawZmqSocketPtr{**slot.sock},
+        ZMQ_POLLIN,
+        [this, i](int) noexcept { processReplies(i); });
+  }
+
+  // Kick off once loop is running
+  scheduleTimeout(std::chrono::milliseconds(0), [this]() noexcept {
+    startTime_ = Clock::now();
+    measureStartTime_ = startTime_ + options_.warmup;
+    endTime_ = measureStartTime_ + options_.duration;
+    nextArrival_ = startTime_;
+    lastReportTime_ = startTime_;
+    dispatch(startTime_);
+    tick();
+  });
+}
+
+ZmqLoadGen::~ZmqLoadGen() {
+  for (auto& slot : slots_) {
+    if (slot.sock) {
+      removeSocket(fbzmq::RawZmqSocketPtr{**slot.sock});
+    }
+  }
+  // Clients must go before the loop they are bound to
+  slots_.clear();
+}
+
+void
+ZmqLoadGen::tick() noexcept {
+  const auto now = Clock::now();
+
+  // Arrivals due by now, open loop
+  if (options_.qps > 0 and not isDone_) {
+    while (nextArrival_ <= now and nextArrival_ < endTime_) {
+      if (backlog_.size() < options_.maxBacklog) {
+        backlog_.emplace_back(nextArrival_);
+      } else if (nextArrival_ >= measureStartTime_) {
+        ++results_.numDroppedArrivals;
+      }
+      nextArrival_ += nextInterArrival();
+    }
+  }
+
+  expireRequests(now);
+  dispatch(now);
+
+  if (options_.reportInterval.count() > 0 and
+      now - lastReportTime_ >= options_.reportInterval) {
+    report(now);
+  }
+
+  // Stop generating at the end, and stop the loop once in flight requests are
+  // done (or timed out)
+  if (not isDone_ and now >= endTime_) {
+    isDone_ = true;
+    results_.elapsed = now - measureStartTime_;
+    backlog_.clear();
+  }
+  if (isDone_) {
+    bool isIdle{true};
+    for (auto const& slot : slots_) {
+      if (slot.numInflight > 0) {
+        isIdle = false;
+      }
+    }
+    if (isIdle or now >= endTime_ + options_.timeout) {
+      stop();
+      return;
+    }
+  }
+
+  scheduleTimeout(kTickInterval, [this]() noexcept { tick(); });
+}
+
+void
+ZmqLoadGen::dispatch(Clock::time_point now) {
+  if (isDone_) {
+    return;
+  }
+  const uint32_t maxInflight = options_.pattern == LoadGenPattern::REQ
+      ? 1
+      : options_.maxInflightPerSocket;
+
+  // Round robin over slots with a free slot
+  for (size_t tries = 0; tries < slots_.size();) {
+    if (options_.qps > 0 and backlog_.empty()) {
+      return;
+    }
+    const size_t slotIndex = nextSlot_;
+    if (slots_[slotIndex].numInflight >= maxInflight) {
+      nextSlot_ = (nextSlot_ + 1) % slots_.size();
+      ++tries;
+      continue;
+    }
+    tries = 0;
+
+    Clock::time_point intended = now;
+    if (options_.qps > 0) {
+      intended = backlog_.front();
+      backlog_.pop_front();
+    }
+    if (not sendRequest(slotIndex, intended)) {
+      // Don't spin on a broken socket
+      nextSlot_ = (nextSlot_ + 1) % slots_.size();
+      ++tries;
+      continue;
+    }
+    if (slots_[slotIndex].numInflight >= maxInflight) {
+      nextSlot_ = (nextSlot_ + 1) % slots_.size();
+    }
+  }
+}
+
+bool
+ZmqLoadGen::sendRequest(size_t slotIndex, Clock::time_point intended) {
+  auto& slot = slots_[slotIndex];
+  const auto requestId = nextRequestId_++;
+  ++results_.numSent;
+  ++slot.numInflight;
+
+  if (slot.rpcClient) {
+    slot.rpcClient->call(options_.rpcMethod, makePayload(requestId))
+        .via(this)
+        .thenTry([this, slotIndex, intended](folly::Try<fbzmq::Message>&& t) {
+          --slots_[slotIndex].numInflight;
+          if (t.hasException<folly::FutureTimeout>()) {
+            ++results_.numTimeouts;
+            ++intervalTimeouts_;
+          } else {
+            complete(intended, t.hasValue());
+          }
+          dispatch(Clock::now());
+        });
+    return true;
+  }
+
+  // Empty delimiter, as REQ sockets do
+  auto ret =
+      slot.sock->sendMultiple(fbzmq::Message(), makePayload(requestId));
+  if (ret.hasError()) {
+    VLOG(2) << "ZmqLoadGen: Failed to send request. " << ret.error();
+    --slot.numInflight;
+    ++results_.numErrors;
+    return false;
+  }
+  slot.pending.emplace(requestId, Pending{intended, Clock::now()});
+  return true;
+}
+
+void
+ZmqLoadGen::processReplies(size_t slotIndex) noexcept {
+  auto& slot = slots_[slotIndex];
+  while (true) {
+    auto ret = slot.sock->recvMultipleInto(frames_);
+    if (ret.hasError()) {
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqLoadGen: Failed to receive reply. " << ret.error();
+      }
+      break;
+    }
+
+    // [empty][reply starting with id of request]
+    if (frames_.size() != 2 or frames_[1].size() < sizeof(uint64_t)) {
+      ++results_.numErrors;
+      continue;
+    }
+    uint64_t requestId{0};
+    ::memcpy(&requestId, frames_[1].data().data(), sizeof(requestId));
+
+    // Late replies of timed out requests are ignored
+    auto it = slot.pending.find(requestId);
+    if (it == slot.pending.end()) {
+      continue;
+    }
+    const auto intended = it->second.intended;
+    slot.pending.erase(it);
+    --slot.numInflight;
+    complete(intended, true);
+  }
+  dispatch(Clock::now());
+}
+
+void
+ZmqLoadGen::complete(Clock::time_point intended, bool success) {
+  if (not success) {
+    ++results_.numErrors;
+    return;
+  }
+  if (intended < measureStartTime_ or intended >= endTime_) {
+    return;
+  }
+  const auto latencyUs =
+      std::max<int64_t>(0, toMicros(Clock::now() - intended));
+  ++results_.numReplies;
+  results_.latency.record(latencyUs);
+  intervalLatency_.record(latencyUs);
+}
+
+void
+ZmqLoadGen::expireRequests(Clock::time_point now) {
+  for (auto& slot : slots_) {
+    while (not slot.pending.empty() and
+           now - slot.pending.begin()->second.sent >= options_.timeout) {
+      slot.pending.erase(slot.pending.begin());
+      --slot.numInflight;
+      ++results_.numTimeouts;
+      ++intervalTimeouts_;
+    }
+  }
+}
+
+void
+ZmqLoadGen::report(Clock::time_point now) {
+  const double seconds =
+      std::chrono::duration<double>(now - lastReportTime_).count();
+  size_t numInflight{0};
+  for (auto const& slot : slots_) {
+    numInflight += slot.numInflight;
+  }
+  LOG(INFO) << folly::sformat(
+      "{}{:.1f} replies/s, p50 {} us, p99 {} us, p99.9 {} us, max {} us, "
+      "{} timeouts, {} in flight, {} backlogged",
+      now < measureStartTime_ ? "[warmup] " : "",
+      intervalLatency_.getCount() / seconds,
+      intervalLatency_.getValueAtPercentile(50),
+      intervalLatency_.getValueAtPercentile(99),
+      intervalLatency_.getValueAtPercentile(99.9),
+      intervalLatency_.getMax(),
+      intervalTimeouts_,
+      numInflight,
+      backlog_.size());
+  intervalLatency_.reset();
+  intervalTimeouts_ = 0;
+  lastReportTime_ = now;
+}
+
+fbzmq::Message
+ZmqLoadGen::makePayload(uint64_t requestId) {
+  size_t size = options_.payloadSize;
+  switch (options_.payloadDistribution) {
+  case PayloadDistribution::FIXED:
+    break;
+  case PayloadDistribution::UNIFORM: {
+    std::uniform_int_distribution<size_t> dist(
+        options_.payloadSizeMin, options_.payloadSizeMax);
+    size = dist(rng_);
+    break;
+  }
+  case PayloadDistribution::EXPONENTIAL: {
+    std::exponential_distribution<double> dist(1.0 / options_.payloadSize);
+    size = static_cast<size_t>(dist(rng_));
+    break;
+  }
+  }
+  size = std::min(
+      std::max(size, options_.payloadSizeMin), options_.payloadSizeMax);
+
+  auto msg = fbzmq::Message::allocate(size).value();
+  auto buf = msg.writeableData();
+  ::memcpy(buf.data(), &requestId, sizeof(requestId));
+  ::memcpy(
+      buf.data() + sizeof(requestId),
+      payloadPool_.data(),
+      size - sizeof(requestId));
+  return msg;
+}
+
+ZmqLoadGen::Clock::duration
+ZmqLoadGen::nextInterArrival() {
+  double seconds = 1.0 / options_.qps;
+  if (options_.poissonArrivals) {
+    std::exponential_distribution<double> dist(options_.qps);
+    seconds = dist(rng_);
+  }
+  return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(seconds));
+}
+
+} // namespace example
+} // namespace fbzmq
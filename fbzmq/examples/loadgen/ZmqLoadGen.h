@@ -0,0 +1,190 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/examples/loadgen/LatencyHistogram.h>
+#include <fbzmq/service/rpc/ZmqRpc.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+namespace example {
+
+enum class LoadGenPattern {
+  // Lockstep request/reply, one request in flight per socket. Speaks REQ
+  // framing (empty delimiter), works against REP or ROUTER servers.
+  REQ,
+  // Same framing as REQ but with many requests in flight per socket
+  DEALER,
+  // Calls of `rpcMethod` against a ZmqRpcServer
+  RPC,
+};
+
+enum class PayloadDistribution {
+  // Always `payloadSize`
+  FIXED,
+  // Uniform in [payloadSizeMin, payloadSizeMax]
+  UNIFORM,
+  // Exponential of mean `payloadSize`, clamped to [min, max]
+  EXPONENTIAL,
+};
+
+struct ZmqLoadGenOptions {
+  std::string url;
+  LoadGenPattern pattern{LoadGenPattern::DEALER};
+
+  // Connections to server, and requests in flight per connection (forced to 1
+  // for REQ pattern)
+  uint32_t numSockets{1};
+  uint32_t maxInflightPerSocket{16};
+
+  // Target rate of requests. Arrivals are open loop, i.e. independent of
+  // replies, and latency counts from the intended time of arrival, hence it
+  // includes any wait for a free slot. 0 for closed loop, as fast as replies
+  // come back.
+  double qps{0};
+  // Exponential inter-arrival times instead of evenly spaced ones
+  bool poissonArrivals{false};
+  // Arrivals waiting for a free slot beyond it are dropped (and counted)
+  size_t maxBacklog{100000};
+
+  // Payload sizes. Payload is at least 8 bytes as it starts with the id of
+  // request, which REQ/DEALER patterns expect echoed back ahead of the reply.
+  PayloadDistribution payloadDistribution{PayloadDistribution::FIXED};
+  size_t payloadSize{64};
+  size_t payloadSizeMin{8};
+  size_t payloadSizeMax{4096};
+
+  // Requests completing within warmup aren't recorded
+  std::chrono::seconds warmup{0};
+  std::chrono::seconds duration{10};
+  std::chrono::milliseconds timeout{1000};
+
+  // Interval of progress logs, 0 to disable
+  std::chrono::seconds reportInterval{1};
+
+  std::string rpcMethod{"echo"};
+};
+
+/**
+ * Load generator against fbzmq services, reproducing a given traffic shape
+ * (concurrency, arrival rate and process, payload sizes) and recording
+ * latencies in an HDR-style histogram. Runs till `warmup + duration` has
+ * passed and requests in flight are done, then stops the loop.
+ *
+ *  ZmqLoadGen loadGen(context, options);
+ *  loadGen.run();
+ *  loadGen.getResults().latency.printPercentiles(std::cout, 1000);
+ */
+class ZmqLoadGen final : public fbzmq::ZmqEventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Results {
+    // Latencies of successful requests in microseconds
+    LatencyHistogram latency;
+    uint64_t numSent{0};
+    uint64_t numReplies{0};
+    uint64_t numTimeouts{0};
+    uint64_t numErrors{0};
+    uint64_t numDroppedArrivals{0};
+    // Measured part of the run, excluding warmup
+    Clock::duration elapsed{0};
+  };
+
+  ZmqLoadGen(fbzmq::Context& zmqContext, ZmqLoadGenOptions options);
+
+  ~ZmqLoadGen() override;
+
+  /**
+   * Results of the run. Must be called once loop has stopped.
+   */
+  Results const&
+  getResults() const {
+    return results_;
+  }
+
+ private:
+  // Request in flight on a REQ/DEALER socket
+  struct Pending {
+    Clock::time_point intended;
+    Clock::time_point sent;
+  };
+
+  struct Slot {
+    std::unique_ptr<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT>> sock;
+    std::unique_ptr<fbzmq::ZmqRpcClient> rpcClient;
+    // Ordered by id, hence by time of sending
+    std::map<uint64_t, Pending> pending;
+    uint32_t numInflight{0};
+  };
+
+  // Called every millisecond, generates arrivals, expires requests and ends
+  // the run
+  void tick() noexcept;
+
+  // Send backlog of arrivals (or new requests in closed loop) on free slots
+  void dispatch(Clock::time_point now);
+
+  // Returns false if request couldn't be sent
+  bool sendRequest(size_t slotIndex, Clock::time_point intended);
+
+  void processReplies(size_t slotIndex) noexcept;
+
+  void complete(Clock::time_point intended, bool success);
+
+  void expireRequests(Clock::time_point now);
+
+  void report(Clock::time_point now);
+
+  fbzmq::Message makePayload(uint64_t requestId);
+
+  Clock::duration nextInterArrival();
+
+  const ZmqLoadGenOptions options_;
+
+  std::vector<Slot> slots_;
+  size_t nextSlot_{0};
+
+  uint64_t nextRequestId_{1};
+
+  // Arrivals waiting for a free slot, by intended time
+  std::deque<Clock::time_point> backlog_;
+  Clock::time_point nextArrival_;
+
+  Clock::time_point startTime_;
+  Clock::time_point measureStartTime_;
+  Clock::time_point endTime_;
+  bool isDone_{false};
+
+  Results results_;
+
+  // Progress of current report interval
+  LatencyHistogram intervalLatency_;
+  uint64_t intervalTimeouts_{0};
+  Clock::time_point lastReportTime_;
+
+  std::mt19937_64 rng_;
+  // Random bytes payloads are cut from
+  std::string payloadPool_;
+
+  // Frames of replies, reused across replies
+  std::vector<fbzmq::Message> frames_;
+};
+
+} // namespace example
+} // namespace fbzmq
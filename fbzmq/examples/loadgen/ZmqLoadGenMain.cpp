@@ -0,0 +1,136 @@
+/**
+ * Copyright 2014-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE-examples file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include <folly/Format.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fbzmq/examples/common/Constants.h>
+#include <fbzmq/examples/loadgen/ZmqLoadGen.h>
+
+DEFINE_string(
+    url,
+    fbzmq::example::Constants::kStringCmdUrl.data(),
+    "Url of server, defaults to the string command of zmq_server_example");
+DEFINE_string(pattern, "dealer", "Socket pattern: req | dealer | rpc");
+DEFINE_string(rpc_method, "echo", "Method called with rpc pattern");
+DEFINE_int32(sockets, 1, "Connections to server");
+DEFINE_int32(
+    inflight_per_socket,
+    16,
+    "Max requests in flight per connection (1 for req pattern)");
+DEFINE_double(
+    qps, 0, "Target rate of requests (open loop), 0 for closed loop");
+DEFINE_string(arrival, "uniform", "Inter-arrival times: uniform | poisson");
+DEFINE_string(
+    payload_dist, "fixed", "Payload size distribution: fixed | uniform | exp");
+DEFINE_int32(payload_size, 64, "Payload size (fixed), or mean (exp)");
+DEFINE_int32(payload_size_min, 8, "Min payload size, at least 8");
+DEFINE_int32(payload_size_max, 4096, "Max payload size");
+DEFINE_int32(warmup_s, 0, "Warmup, not recorded, in seconds");
+DEFINE_int32(duration_s, 10, "Duration of the measured run in seconds");
+DEFINE_int32(timeout_ms, 1000, "Timeout of requests in milliseconds");
+DEFINE_int32(report_interval_s, 1, "Interval of progress logs, 0 to disable");
+DEFINE_int32(io_threads, 1, "ZMQ I/O threads");
+DEFINE_string(
+    hgrm_output,
+    "",
+    "File to write latency distribution to, in HdrHistogram (.hgrm) format");
+
+namespace {
+
+fbzmq::example::LoadGenPattern
+parsePattern(std::string const& pattern) {
+  if (pattern == "req") {
+    return fbzmq::example::LoadGenPattern::REQ;
+  }
+  if (pattern == "dealer") {
+    return fbzmq::example::LoadGenPattern::DEALER;
+  }
+  if (pattern == "rpc") {
+    return fbzmq::example::LoadGenPattern::RPC;
+  }
+  LOG(FATAL) << "Unknown pattern " << pattern;
+}
+
+fbzmq::example::PayloadDistribution
+parsePayloadDistribution(std::string const& dist) {
+  if (dist == "fixed") {
+    return fbzmq::example::PayloadDistribution::FIXED;
+  }
+  if (dist == "uniform") {
+    return fbzmq::example::PayloadDistribution::UNIFORM;
+  }
+  if (dist == "exp") {
+    return fbzmq::example::PayloadDistribution::EXPONENTIAL;
+  }
+  LOG(FATAL) << "Unknown payload distribution " << dist;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  CHECK(FLAGS_arrival == "uniform" or FLAGS_arrival == "poisson")
+      << "Unknown arrival " << FLAGS_arrival;
+
+  fbzmq::example::ZmqLoadGenOptions options;
+  options.url = FLAGS_url;
+  options.pattern = parsePattern(FLAGS_pattern);
+  options.numSockets = FLAGS_sockets;
+  options.maxInflightPerSocket = FLAGS_inflight_per_socket;
+  options.qps = FLAGS_qps;
+  options.poissonArrivals = FLAGS_arrival == "poisson";
+  options.payloadDistribution = parsePayloadDistribution(FLAGS_payload_dist);
+  options.payloadSize = FLAGS_payload_size;
+  options.payloadSizeMin = FLAGS_payload_size_min;
+  options.payloadSizeMax = FLAGS_payload_size_max;
+  options.warmup = std::chrono::seconds(FLAGS_warmup_s);
+  options.duration = std::chrono::seconds(FLAGS_duration_s);
+  options.timeout = std::chrono::milliseconds(FLAGS_timeout_ms);
+  options.reportInterval = std::chrono::seconds(FLAGS_report_interval_s);
+  options.rpcMethod = FLAGS_rpc_method;
+
+  // Zmq Context
+  fbzmq::Context ctx(static_cast<uint16_t>(FLAGS_io_threads));
+
+  fbzmq::example::ZmqLoadGen loadGen(ctx, options);
+  LOG(INFO) << "Starting load against " << FLAGS_url << " ...";
+  loadGen.run();
+
+  auto const& results = loadGen.getResults();
+  const double seconds =
+      std::chrono::duration<double>(results.elapsed).count();
+  std::cout << folly::sformat(
+      "sent {}, replies {}, timeouts {}, errors {}, dropped arrivals {}\n"
+      "throughput {:.1f} replies/s over {:.1f} s\n\n",
+      results.numSent,
+      results.numReplies,
+      results.numTimeouts,
+      results.numErrors,
+      results.numDroppedArrivals,
+      seconds > 0 ? results.numReplies / seconds : 0,
+      seconds);
+
+  // Latencies are recorded in microseconds, printed in milliseconds
+  results.latency.printPercentiles(std::cout, 1000.0);
+  if (not FLAGS_hgrm_output.empty()) {
+    std::ofstream file(FLAGS_hgrm_output);
+    results.latency.printPercentiles(file, 1000.0);
+    LOG(INFO) << "Wrote latency distribution to " << FLAGS_hgrm_output;
+  }
+
+  return 0;
+}
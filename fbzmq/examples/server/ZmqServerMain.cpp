@@ -11,6 +11,7 @@
 #include <fbzmq/async/StopEventLoopSignalHandler.h>
 #include <fbzmq/examples/common/Constants.h>
 #include <fbzmq/examples/server/ZmqServer.h>
+#include <fbzmq/service/rpc/ZmqRpc.h>
 
 int
 main(int argc, char** argv) {
@@ -38,6 +39,18 @@ main(int argc, char** argv) {
       fbzmq::example::Constants::kThriftCmdUrl.str(),
       fbzmq::example::Constants::kMultipleCmdUrl.str(),
       fbzmq::example::Constants::kPubUrl.str());
+
+  // pipelined rpc echo on the same loop, e.g. for zmq_loadgen
+  fbzmq::ZmqRpcServer rpcServer(
+      server,
+      ctx,
+      fbzmq::SocketUrl{fbzmq::example::Constants::kRpcCmdUrl.str()});
+  rpcServer.registerHandler(
+      "echo", [](fbzmq::ZmqRpcServer::Request&& request) {
+        return fbzmq::ZmqRpcServer::Reply(std::move(request.payload));
+      });
+  rpcServer.start().value();
+
   std::thread serverThread([&server]() noexcept {
     LOG(INFO) << "Starting Server thread ...";
     server.run();
@@ -20,9 +20,28 @@ enum MonitorCommand {
   DUMP_ALL_COUNTER_DATA = 4,
   BUMP_COUNTER = 5,
   GET_EVENT_LOGS = 6,
+  // filtered and paginated dumps of counter data, see CounterDumpParams
+  GET_COUNTER_DATA_PAGE = 7,
+  STREAM_COUNTER_DATA = 8,
+  // numeric counter ids, see CounterRegisterParams
+  REGISTER_COUNTERS = 9,
+  SET_COUNTER_VALUES_BY_ID = 10,
+  // bump counters by arbitrary amounts, see CounterBumpByParams
+  BUMP_COUNTER_VALUES = 12,
+  // counters of a co-located client in shared memory, see
+  // SharedCountersParams
+  ATTACH_SHARED_COUNTERS = 13,
+  DETACH_SHARED_COUNTERS = 14,
 
   // operations on logs, which are not saved in the monitor
   LOG_EVENT = 11,
+  // filtered and incremental reads of last event logs, see
+  // EventLogQueryParams
+  QUERY_EVENT_LOGS = 15,
+
+  // counters along with sequence number of the last publication they
+  // reflect, for late subscribers to catch up with, see SnapshotParams
+  GET_SNAPSHOT = 16,
 }
 
 //
@@ -62,11 +81,98 @@ struct CounterBumpParams {
   1: list<string> counterNames
 }
 
+// parameters for BUMP_COUNTER_VALUES command. Same as BUMP_COUNTER but every
+// counter is incremented by its own amount instead of one.
+struct CounterBumpByParams {
+  // counter name -> increment
+  1: map<string, i64> increments
+}
+
+// parameters for ATTACH_SHARED_COUNTERS and DETACH_SHARED_COUNTERS commands.
+// Monitor maps the counter table file of the client (see SharedCounterTable)
+// and scans it for changed counters whenever counters are read.
+struct SharedCountersParams {
+  1: string path
+}
+
+// parameters for GET_COUNTER_DATA_PAGE and STREAM_COUNTER_DATA commands.
+// Pages are ordered by counter name. GET_COUNTER_DATA_PAGE replies with the
+// page following `cursor` while STREAM_COUNTER_DATA replies with all pages as
+// separate messages, the one with empty `nextCursor` being the last.
+struct CounterDumpParams {
+  // only counters with name starting with this prefix
+  1: string prefix
+  // only counters with name (partially) matching this ECMAScript regex
+  2: string regex
+  // only counters updated at or after this time (microseconds since epoch),
+  // e.g. `dumpTime` of the previous dump
+  3: i64 changedSince
+  // max number of counters per page, 0 for no limit
+  4: i32 pageSize
+  // `nextCursor` of the previous page, empty for the first page
+  5: string cursor
+}
+
+// parameters for REGISTER_COUNTERS command. Monitor replies with
+// CounterIdsResponse carrying numeric ids for counter names along with the
+// epoch of the monitor. Ids stay valid for the lifetime of the monitor (i.e.
+// of its epoch) and can be used instead of names with
+// SET_COUNTER_VALUES_BY_ID to save on encoding and lookup of names.
+struct CounterRegisterParams {
+  1: list<string> counterNames
+}
+
+// parameters for SET_COUNTER_VALUES_BY_ID command. Monitor replies with
+// CounterSetByIdResponse. Counters are set only if `epoch` is the one of the
+// monitor, else ids are stale (e.g. monitor restarted) and the request is
+// rejected, names must be registered again. Unknown ids are ignored.
+struct CounterSetByIdParams {
+  // counter id -> Counter struct
+  1: map<i64, Counter> counters
+  // `epoch` of CounterIdsResponse which ids are from
+  2: i64 epoch
+}
+
+// Typed columns of a log sample (refer to fbzmq::LogSample), compact
+// alternative to its JSON representation
+struct LogSampleData {
+  1: map<string, i64> ints
+  2: map<string, double> doubles
+  3: map<string, string> normals
+  4: map<string, list<string>> normvectors
+  5: map<string, set<string>> tagsets
+}
+
 // parameters for LOG_EVENT
 struct EventLog {
   // name/id of the event log
   1: string category
+  // samples as JSON
   2: list<string> samples
+  // samples in binary form. Monitor merges and forwards them without any
+  // JSON conversion, consumers convert them to JSON only if they need to.
+  3: list<LogSampleData> binarySamples
+}
+
+// parameters for QUERY_EVENT_LOGS command. Monitor numbers event logs with
+// increasing sequence numbers as they arrive. Filters are combined, defaults
+// match all retained event logs.
+struct EventLogQueryParams {
+  // only event logs of this category, any if empty
+  1: string category
+  // only event logs with greater sequence number, pass `lastSeqNum` of the
+  // previous reply to tail event logs
+  2: i64 sinceSeqNum
+  // only event logs received at or after this time (milliseconds since epoch)
+  3: i64 sinceTimestamp
+  // max number of event logs in reply (oldest first), unlimited if zero
+  4: i32 limit
+}
+
+// parameters for GET_SNAPSHOT command
+struct SnapshotParams {
+  // only counters with name starting with this prefix
+  1: string prefix
 }
 
 //
@@ -80,6 +186,13 @@ struct MonitorRequest {
   3: CounterGetParams counterGetParams
   4: CounterBumpParams counterBumpParams
   5: EventLog eventLog
+  6: CounterDumpParams counterDumpParams
+  7: CounterRegisterParams counterRegisterParams
+  8: CounterSetByIdParams counterSetByIdParams
+  9: CounterBumpByParams counterBumpByParams
+  10: SharedCountersParams sharedCountersParams
+  11: EventLogQueryParams eventLogQueryParams
+  12: SnapshotParams snapshotParams
 }
 
 //
@@ -90,14 +203,95 @@ struct CounterValuesResponse {
   1: CounterMap counters
 }
 
+struct CounterDumpPage {
+  1: CounterMap counters
+  // cursor of the next page, empty if this is the last page
+  2: string nextCursor
+  // time of the dump in monitor (microseconds since epoch)
+  3: i64 dumpTime
+}
+
+struct CounterIdsResponse {
+  // counter name -> counter id
+  1: map<string, i64> counterIds
+  // random non-zero number picked by monitor on start, ids of a different
+  // epoch are stale
+  2: i64 epoch
+}
+
+// reply to SET_COUNTER_VALUES_BY_ID
+struct CounterSetByIdResponse {
+  // false if ids were rejected because of epoch mismatch
+  1: bool accepted
+  // current epoch of monitor
+  2: i64 epoch
+  // reason when not accepted
+  3: string error
+}
+
+// reply to ATTACH_SHARED_COUNTERS
+struct SharedCountersResponse {
+  1: bool attached
+  // reason when not attached
+  2: string error
+}
+
 struct EventLogsResponse {
   1: list<EventLog> eventLogs
 }
 
+struct EventLogQueryResponse {
+  1: list<EventLog> eventLogs
+  // sequence number of every event log
+  2: list<i64> seqNums
+  // sequence number to continue from, i.e. `sinceSeqNum` of the next query
+  3: i64 lastSeqNum
+  // sequence number of the oldest retained event log. Event logs between
+  // `sinceSeqNum` and it have been dropped.
+  4: i64 firstSeqNum
+}
+
 struct CounterNamesResponse {
   1: list<string> counterNames
 }
 
+// reply to GET_SNAPSHOT. Subscribers connect to the PUB socket first, then
+// request a snapshot and apply publications with greater sequence number on
+// top of it, skipping the older ones.
+struct MonitorSnapshot {
+  1: CounterMap counters
+  // sequence number of the last publication reflected in the snapshot. Later
+  // updates may be reflected as well, publications carry latest values.
+  2: i64 seqNum
+}
+
+//
+// Persisted state of ZmqMonitor, see MonitorPersistOptions
+//
+
+struct PersistedCounter {
+  1: Counter counter
+  // time since last update of counter when persisted, in milliseconds
+  2: i64 ageMs
+}
+
+struct PersistedEventLog {
+  // compact serialized EventLog
+  1: binary eventLog
+  // receive time, milliseconds since epoch
+  2: i64 timestamp
+}
+
+struct MonitorPersistedState {
+  1: map<string, PersistedCounter> counters
+  // oldest first
+  2: list<PersistedEventLog> eventLogs
+  // sequence number of the first event log
+  3: i64 firstEventLogSeqNum
+  // time state was persisted, milliseconds since epoch
+  4: i64 persistTime
+}
+
 //
 // Publication
 //
@@ -111,4 +305,7 @@ struct MonitorPub {
   1: PubType pubType
   2: CounterValuesResponse counterPub
   3: EventLog eventLogPub
+  // incremented by one for every publication sent, starting from 1.
+  // Subscribers filtering on topic frames see gaps.
+  4: i64 seqNum
 }
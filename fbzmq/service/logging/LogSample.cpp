@@ -8,6 +8,7 @@
 #include "LogSample.h"
 
 #include <folly/DynamicConverter.h>
+#include <folly/Format.h>
 #include <folly/json.h>
 
 namespace {
@@ -23,6 +24,74 @@ const std::string STRINGTAGSET_KEY{"tagset"};
 
 const std::string kTimeCol{"time"};
 
+folly::dynamic
+toDynamic(int64_t value) {
+  return value;
+}
+
+folly::dynamic
+toDynamic(double value) {
+  return value;
+}
+
+folly::dynamic
+toDynamic(std::string const& value) {
+  return value;
+}
+
+template <typename Container>
+folly::dynamic
+toDynamic(Container const& values) {
+  return folly::dynamic(values.begin(), values.end());
+}
+
+// Add values of a type to json
+template <typename Column>
+void
+addToJson(
+    folly::dynamic& json, std::string const& keyType, Column const& column) {
+  if (column.empty()) {
+    return;
+  }
+  auto& obj = json[keyType] = folly::dynamic::object;
+  for (auto const& kv : column) {
+    obj[kv.first] = toDynamic(kv.second);
+  }
+}
+
+// Read values of a type from json
+template <typename Column>
+void
+readFromJson(folly::dynamic const& obj, Column& column) {
+  for (auto const& kv : obj.items()) {
+    column.emplace(
+        kv.first.asString(),
+        folly::convertTo<typename Column::mapped_type>(kv.second));
+  }
+}
+
+// Merge values of a type, keeping existing ones. Merged only if this type
+// exists in target.
+template <typename Column>
+void
+mergeColumn(Column& column, Column const& other) {
+  if (not column.empty()) {
+    column.insert(other.begin(), other.end());
+  }
+}
+
+template <typename Column>
+typename Column::mapped_type const&
+getValue(
+    Column const& column, folly::StringPiece keyType, folly::StringPiece key) {
+  auto it = column.find(key.str());
+  if (it == column.end()) {
+    throw std::invalid_argument(
+        folly::sformat("invalid key: {} with keyType: {} ", key, keyType));
+  }
+  return it->second;
+}
+
 } // anonymous namespace
 
 namespace fbzmq {
@@ -31,8 +100,6 @@ LogSample::LogSample() : LogSample(std::chrono::system_clock::now()) {}
 
 LogSample::LogSample(std::chrono::system_clock::time_point timestamp)
     : timestamp_(timestamp) {
-  json_ = folly::dynamic::object;
-
   // add the timestamp to the json sample
   addInt(
       kTimeCol,
@@ -43,7 +110,29 @@ LogSample::LogSample(std::chrono::system_clock::time_point timestamp)
 
 LogSample::LogSample(
     folly::dynamic json, std::chrono::system_clock::time_point timestamp)
-    : json_(json), timestamp_(timestamp) {}
+    : timestamp_(timestamp) {
+  for (auto& kv : json.items()) {
+    auto const& keyType = kv.first.asString();
+    if (keyType == INT_KEY) {
+      readFromJson(kv.second, *data_.ints_ref());
+    } else if (keyType == DOUBLE_KEY) {
+      readFromJson(kv.second, *data_.doubles_ref());
+    } else if (keyType == STRING_KEY) {
+      readFromJson(kv.second, *data_.normals_ref());
+    } else if (keyType == STRINGVECTOR_KEY) {
+      readFromJson(kv.second, *data_.normvectors_ref());
+    } else if (keyType == STRINGTAGSET_KEY) {
+      readFromJson(kv.second, *data_.tagsets_ref());
+    } else {
+      unknownTypes_[kv.first] = std::move(kv.second);
+    }
+  }
+}
+
+LogSample::LogSample(
+    thrift::LogSampleData data,
+    std::chrono::system_clock::time_point timestamp)
+    : data_(std::move(data)), timestamp_(timestamp) {}
 
 LogSample
 LogSample::fromJson(const std::string& json) {
@@ -51,150 +140,136 @@ LogSample::fromJson(const std::string& json) {
   // will throw if this sample doesn't have a timestamp
   auto timestamp = std::chrono::system_clock::time_point(
       std::chrono::seconds(dynamic[INT_KEY][kTimeCol].getInt()));
-  return LogSample(dynamic, timestamp);
+  return LogSample(std::move(dynamic), timestamp);
+}
+
+LogSample
+LogSample::fromThrift(thrift::LogSampleData data) {
+  // will throw if this sample doesn't have a timestamp
+  auto timestamp = std::chrono::system_clock::time_point(
+      std::chrono::seconds(data.ints_ref()->at(kTimeCol)));
+  return LogSample(std::move(data), timestamp);
 }
 
 std::string
 LogSample::toJson() const {
+  folly::dynamic json = unknownTypes_;
+  addToJson(json, INT_KEY, *data_.ints_ref());
+  addToJson(json, DOUBLE_KEY, *data_.doubles_ref());
+  addToJson(json, STRING_KEY, *data_.normals_ref());
+  addToJson(json, STRINGVECTOR_KEY, *data_.normvectors_ref());
+  addToJson(json, STRINGTAGSET_KEY, *data_.tagsets_ref());
+
   folly::json::serialization_opts opts;
   opts.sort_keys = true;
-  return folly::json::serialize(json_, opts);
+  return folly::json::serialize(json, opts);
+}
+
+thrift::LogSampleData
+LogSample::toThrift() const& {
+  return data_;
+}
+
+thrift::LogSampleData
+LogSample::toThrift() && {
+  return std::move(data_);
 }
 
 void
 LogSample::mergeSample(const LogSample& sample) {
-  auto dynamic = folly::parseJson(sample.toJson());
-  for (auto& kv : json_.items()) {
-    const auto& search = dynamic.find(kv.first);
-    if (search != dynamic.items().end()) {
+  sample.mergeInto(data_);
+  for (auto& kv : unknownTypes_.items()) {
+    const auto& search = sample.unknownTypes_.find(kv.first);
+    if (search != sample.unknownTypes_.items().end()) {
       kv.second.update_missing(search->second);
     }
   }
 }
 
 void
-LogSample::addInt(folly::StringPiece key, int64_t value) {
-  if (json_.find(INT_KEY) == json_.items().end()) {
-    json_.insert(INT_KEY, folly::dynamic::object());
-  }
+LogSample::mergeInto(thrift::LogSampleData& data) const {
+  mergeColumn(*data.ints_ref(), *data_.ints_ref());
+  mergeColumn(*data.doubles_ref(), *data_.doubles_ref());
+  mergeColumn(*data.normals_ref(), *data_.normals_ref());
+  mergeColumn(*data.normvectors_ref(), *data_.normvectors_ref());
+  mergeColumn(*data.tagsets_ref(), *data_.tagsets_ref());
+}
 
-  json_[INT_KEY][key] = value;
+void
+LogSample::addInt(folly::StringPiece key, int64_t value) {
+  (*data_.ints_ref())[key.str()] = value;
 }
 
 void
 LogSample::addDouble(folly::StringPiece key, double value) {
-  if (json_.find(DOUBLE_KEY) == json_.items().end()) {
-    json_.insert(DOUBLE_KEY, folly::dynamic::object());
-  }
-
-  json_[DOUBLE_KEY][key] = value;
+  (*data_.doubles_ref())[key.str()] = value;
 }
 
 void
 LogSample::addString(folly::StringPiece key, folly::StringPiece value) {
-  if (json_.find(STRING_KEY) == json_.items().end()) {
-    json_.insert(STRING_KEY, folly::dynamic::object());
-  }
-
-  json_[STRING_KEY][key] = value;
+  (*data_.normals_ref())[key.str()] = value.str();
 }
 
 void
 LogSample::addStringVector(
     folly::StringPiece key, const std::vector<std::string>& values) {
-  if (json_.find(STRINGVECTOR_KEY) == json_.items().end()) {
-    json_.insert(STRINGVECTOR_KEY, folly::dynamic::object());
-  }
-
-  json_[STRINGVECTOR_KEY][key] = folly::dynamic(values.begin(), values.end());
+  (*data_.normvectors_ref())[key.str()] = values;
 }
 
 void
 LogSample::addStringTagset(
     folly::StringPiece key, const std::set<std::string>& tags) {
-  if (json_.find(STRINGTAGSET_KEY) == json_.items().end()) {
-    json_.insert(STRINGTAGSET_KEY, folly::dynamic::object());
-  }
-
-  json_[STRINGTAGSET_KEY][key] = folly::dynamic(tags.begin(), tags.end());
+  (*data_.tagsets_ref())[key.str()] = tags;
 }
 
 int64_t
 LogSample::getInt(folly::StringPiece key) const {
-  return folly::convertTo<int64_t>(getInnerValue(INT_KEY, key));
+  return getValue(*data_.ints_ref(), INT_KEY, key);
 }
 
 double
 LogSample::getDouble(folly::StringPiece key) const {
-  return folly::convertTo<double>(getInnerValue(DOUBLE_KEY, key));
+  return getValue(*data_.doubles_ref(), DOUBLE_KEY, key);
 }
 
 std::string
 LogSample::getString(folly::StringPiece key) const {
-  return folly::convertTo<std::string>(getInnerValue(STRING_KEY, key));
+  return getValue(*data_.normals_ref(), STRING_KEY, key);
 }
 
 std::vector<std::string>
 LogSample::getStringVector(folly::StringPiece key) const {
-  return folly::convertTo<std::vector<std::string>>(
-      getInnerValue(STRINGVECTOR_KEY, key));
+  return getValue(*data_.normvectors_ref(), STRINGVECTOR_KEY, key);
 }
 
 std::set<std::string>
 LogSample::getStringTagset(folly::StringPiece key) const {
-  return folly::convertTo<std::set<std::string>>(
-      getInnerValue(STRINGTAGSET_KEY, key));
+  return getValue(*data_.tagsets_ref(), STRINGTAGSET_KEY, key);
 }
 
 bool
 LogSample::isIntSet(folly::StringPiece key) const {
-  return isInnerValueSet(INT_KEY, key);
+  return data_.ints_ref()->count(key.str());
 }
 
 bool
 LogSample::isDoubleSet(folly::StringPiece key) const {
-  return isInnerValueSet(DOUBLE_KEY, key);
+  return data_.doubles_ref()->count(key.str());
 }
 
 bool
 LogSample::isStringSet(folly::StringPiece key) const {
-  return isInnerValueSet(STRING_KEY, key);
+  return data_.normals_ref()->count(key.str());
 }
 
 bool
 LogSample::isStringVectorSet(folly::StringPiece key) const {
-  return isInnerValueSet(STRINGVECTOR_KEY, key);
+  return data_.normvectors_ref()->count(key.str());
 }
 
 bool
 LogSample::isStringTagsetSet(folly::StringPiece key) const {
-  return isInnerValueSet(STRINGTAGSET_KEY, key);
-}
-
-bool
-LogSample::isInnerValueSet(
-    folly::StringPiece keyType, folly::StringPiece key) const {
-  if (auto obj = json_.get_ptr(keyType)) {
-    if (auto data = obj->get_ptr(key)) {
-      (void)data;
-      return true;
-    }
-  }
-
-  return false;
-}
-
-const folly::dynamic&
-LogSample::getInnerValue(
-    folly::StringPiece keyType, folly::StringPiece key) const {
-  if (auto obj = json_.get_ptr(keyType)) {
-    if (auto data = obj->get_ptr(key)) {
-      return *data;
-    }
-  }
-
-  throw std::invalid_argument(
-      folly::sformat("invalid key: {} with keyType: {} ", key, keyType));
+  return data_.tagsets_ref()->count(key.str());
 }
 
 } // namespace fbzmq
@@ -15,6 +15,8 @@
 #include <folly/Range.h>
 #include <folly/dynamic.h>
 
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+
 namespace fbzmq {
 
 /**
@@ -36,6 +38,11 @@ namespace fbzmq {
  *    auto json = sample.toJson();
  *    myMonitoringServiceClient.send(sample.json)
  *
+ * Values are stored in typed columns (thrift::LogSampleData). JSON is only
+ * produced on `toJson()`. Binary form (`toThrift()`/`fromThrift()`) can be
+ * sent via `thrift::EventLog::binarySamples` instead, which saves the JSON
+ * encoding and parsing altogether.
+ *
  * NOTE: Timestamp is critical part of Sample as it tells when event/log was
  * generated. It must be a measurement related to system clock (no steady
  * clock) to get absolute notion of time.
@@ -57,12 +64,25 @@ class LogSample {
 
   static LogSample fromJson(const std::string& json);
 
+  /**
+   * Construct from binary representation. Throws if sample doesn't have a
+   * timestamp, just like `fromJson()`.
+   */
+  static LogSample fromThrift(thrift::LogSampleData data);
+
   /**
    * Get json representation of the Sample. Can easily be sent to monitoring
    * service over write.
    */
   std::string toJson() const;
 
+  /**
+   * Get binary representation of the Sample. Rvalue version moves the data
+   * out instead of copying.
+   */
+  thrift::LogSampleData toThrift() const&;
+  thrift::LogSampleData toThrift() &&;
+
   /**
    * Get the timestamp associated with this sample.
    */
@@ -72,9 +92,17 @@ class LogSample {
   }
 
   /**
-   * Merges two LogSample objects, preferring the values in this.
+   * Merges two LogSample objects, preferring the values in this. Only the
+   * value types which this sample already has are merged.
    */
   void mergeSample(const LogSample& sample);
+
+  /**
+   * Same as above, but merges values of this sample into binary
+   * representation of another sample in place, preferring values in `data`.
+   */
+  void mergeInto(thrift::LogSampleData& data) const;
+
   /**
    * APIs to add different types of values
    */
@@ -106,13 +134,16 @@ class LogSample {
   bool isStringTagsetSet(folly::StringPiece key) const;
 
  private:
-  bool isInnerValueSet(
-      folly::StringPiece keyType, folly::StringPiece key) const;
-  const folly::dynamic& getInnerValue(
-      folly::StringPiece keyType, folly::StringPiece key) const;
+  LogSample(
+      thrift::LogSampleData data,
+      std::chrono::system_clock::time_point timestamp);
+
+  // Typed values of this sample
+  thrift::LogSampleData data_;
 
-  // Internal json representation of this sample
-  folly::dynamic json_ = folly::dynamic::object;
+  // Value types unknown to this class, if any, as received in JSON. Retained
+  // as is for JSON output.
+  folly::dynamic unknownTypes_ = folly::dynamic::object;
 
   // Timepoint associated with this sample
   const std::chrono::system_clock::time_point timestamp_;
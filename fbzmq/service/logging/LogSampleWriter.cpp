@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LogSampleWriter.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/json.h>
+
+namespace {
+
+/**
+ * Names of value types, must match the ones of LogSample. Listed in sorted
+ * order, just like keys of LogSample::toJson().
+ */
+const std::array<folly::StringPiece, 5> kTypeNames{
+    {"double", "int", "normal", "normvector", "tagset"}};
+
+constexpr folly::StringPiece kTimeCol{"time"};
+
+// Keys can be created during static initialization, hence no global options
+folly::json::serialization_opts const&
+jsonOpts() {
+  static const folly::json::serialization_opts opts;
+  return opts;
+}
+
+} // anonymous namespace
+
+namespace fbzmq {
+
+LogSampleKey::LogSampleKey(folly::StringPiece key) {
+  folly::json::escapeString(key, encoded_, jsonOpts());
+  encoded_.push_back(':');
+}
+
+LogSampleWriter::LogSampleWriter() {
+  begin();
+}
+
+void
+LogSampleWriter::begin(std::chrono::system_clock::time_point timestamp) {
+  for (auto& column : columns_) {
+    column.clear();
+  }
+  json_.clear();
+
+  // add the timestamp to the sample
+  addInt(
+      kTimeCol,
+      std::chrono::duration_cast<std::chrono::seconds>(
+          timestamp.time_since_epoch())
+          .count());
+}
+
+std::string&
+LogSampleWriter::appendKey(ValueType type, folly::StringPiece key) {
+  auto& column = columns_[type];
+  if (not column.empty()) {
+    column.push_back(',');
+  }
+  folly::json::escapeString(key, column, jsonOpts());
+  column.push_back(':');
+  return column;
+}
+
+std::string&
+LogSampleWriter::appendKey(ValueType type, LogSampleKey const& key) {
+  auto& column = columns_[type];
+  if (not column.empty()) {
+    column.push_back(',');
+  }
+  column.append(key.encoded_);
+  return column;
+}
+
+void
+LogSampleWriter::checkDouble(double value) {
+  if (not std::isfinite(value)) {
+    throw std::invalid_argument(
+        folly::to<std::string>("Can't write double value ", value));
+  }
+}
+
+template <typename Container>
+void
+LogSampleWriter::appendStrings(std::string& column, Container const& values) {
+  column.push_back('[');
+  bool isFirst{true};
+  for (auto const& value : values) {
+    if (not isFirst) {
+      column.push_back(',');
+    }
+    folly::json::escapeString(value, column, jsonOpts());
+    isFirst = false;
+  }
+  column.push_back(']');
+}
+
+void
+LogSampleWriter::addInt(folly::StringPiece key, int64_t value) {
+  folly::toAppend(value, &appendKey(INT, key));
+}
+
+void
+LogSampleWriter::addInt(LogSampleKey const& key, int64_t value) {
+  folly::toAppend(value, &appendKey(INT, key));
+}
+
+void
+LogSampleWriter::addDouble(folly::StringPiece key, double value) {
+  checkDouble(value);
+  folly::toAppend(value, &appendKey(DOUBLE, key));
+}
+
+void
+LogSampleWriter::addDouble(LogSampleKey const& key, double value) {
+  checkDouble(value);
+  folly::toAppend(value, &appendKey(DOUBLE, key));
+}
+
+void
+LogSampleWriter::addString(folly::StringPiece key, folly::StringPiece value) {
+  folly::json::escapeString(value, appendKey(STRING, key), jsonOpts());
+}
+
+void
+LogSampleWriter::addString(LogSampleKey const& key, folly::StringPiece value) {
+  folly::json::escapeString(value, appendKey(STRING, key), jsonOpts());
+}
+
+void
+LogSampleWriter::addStringVector(
+    folly::StringPiece key, std::vector<std::string> const& values) {
+  appendStrings(appendKey(STRINGVECTOR, key), values);
+}
+
+void
+LogSampleWriter::addStringVector(
+    LogSampleKey const& key, std::vector<std::string> const& values) {
+  appendStrings(appendKey(STRINGVECTOR, key), values);
+}
+
+void
+LogSampleWriter::addStringTagset(
+    folly::StringPiece key, std::set<std::string> const& tags) {
+  appendStrings(appendKey(STRINGTAGSET, key), tags);
+}
+
+void
+LogSampleWriter::addStringTagset(
+    LogSampleKey const& key, std::set<std::string> const& tags) {
+  appendStrings(appendKey(STRINGTAGSET, key), tags);
+}
+
+folly::StringPiece
+LogSampleWriter::finish() {
+  json_.clear();
+  json_.push_back('{');
+  for (size_t i = 0; i < NUM_TYPES; ++i) {
+    auto const& column = columns_[i];
+    if (column.empty()) {
+      continue;
+    }
+    if (json_.size() > 1) {
+      json_.push_back(',');
+    }
+    json_.push_back('"');
+    json_.append(kTypeNames[i].data(), kTypeNames[i].size());
+    json_.append("\":{");
+    json_.append(column);
+    json_.push_back('}');
+  }
+  json_.push_back('}');
+  return json_;
+}
+
+} // namespace fbzmq
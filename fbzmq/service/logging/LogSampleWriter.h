@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+/**
+ * Precompiled key of a sample value. Key is escaped (and encoded) once rather
+ * than on every sample. A set of keys makes for a schema of samples with fixed
+ * keys, e.g.
+ *
+ *  struct NeighborEventSchema {
+ *    LogSampleKey event{"event"};
+ *    LogSampleKey neighbor{"neighbor"};
+ *    LogSampleKey rttMs{"rtt_ms"};
+ *  };
+ */
+class LogSampleKey {
+ public:
+  explicit LogSampleKey(folly::StringPiece key);
+
+ private:
+  friend class LogSampleWriter;
+
+  // `"<escaped key>":`
+  std::string encoded_;
+};
+
+/**
+ * Writes samples as JSON directly into reusable buffers, skipping the
+ * `folly::dynamic` tree of LogSample. Output has the same layout as
+ * `LogSample::toJson()`, hence consumers (including `LogSample::fromJson()`)
+ * are unaffected. Buffers retain their capacity across samples, hence writing
+ * samples of similar size doesn't allocate in steady state.
+ *
+ *  LogSampleWriter writer;
+ *  NeighborEventSchema schema;
+ *  for (auto const& event : events) {
+ *    writer.begin();
+ *    writer.addString(schema.event, "NEIGHBOR_UP");
+ *    writer.addString(schema.neighbor, event.neighbor);
+ *    writer.addInt(schema.rttMs, event.rttMs);
+ *    send(writer.finish());
+ *  }
+ *
+ * Unlike LogSample, keys of a value type appear in the order they are added
+ * and keys are not de-duplicated, hence every key must be added only once per
+ * sample.
+ */
+class LogSampleWriter {
+ public:
+  LogSampleWriter();
+
+  /**
+   * Start a new sample with given timestamp, discarding the current one
+   */
+  void begin(
+      std::chrono::system_clock::time_point timestamp =
+          std::chrono::system_clock::now());
+
+  /**
+   * APIs to add different types of values, with ad-hoc or precompiled keys
+   */
+  void addInt(folly::StringPiece key, int64_t value);
+  void addInt(LogSampleKey const& key, int64_t value);
+
+  // Throws std::invalid_argument for NaN and infinite values, just like
+  // LogSample::toJson()
+  void addDouble(folly::StringPiece key, double value);
+  void addDouble(LogSampleKey const& key, double value);
+
+  void addString(folly::StringPiece key, folly::StringPiece value);
+  void addString(LogSampleKey const& key, folly::StringPiece value);
+
+  void addStringVector(
+      folly::StringPiece key, std::vector<std::string> const& values);
+  void addStringVector(
+      LogSampleKey const& key, std::vector<std::string> const& values);
+
+  void addStringTagset(
+      folly::StringPiece key, std::set<std::string> const& tags);
+  void addStringTagset(
+      LogSampleKey const& key, std::set<std::string> const& tags);
+
+  /**
+   * JSON of current sample. Returned range is valid till the next call to
+   * `begin()` or `finish()`.
+   */
+  folly::StringPiece finish();
+
+ private:
+  // Value types, in the order of their keys in JSON
+  enum ValueType {
+    DOUBLE = 0,
+    INT = 1,
+    STRING = 2,
+    STRINGVECTOR = 3,
+    STRINGTAGSET = 4,
+    NUM_TYPES = 5,
+  };
+
+  // Append key to column of given type and return the column
+  std::string& appendKey(ValueType type, folly::StringPiece key);
+  std::string& appendKey(ValueType type, LogSampleKey const& key);
+
+  // Throw if double can't be represented in JSON
+  static void checkDouble(double value);
+
+  template <typename Container>
+  static void appendStrings(std::string& column, Container const& values);
+
+  // `"<key>":<value>` pairs of every value type, comma separated
+  std::array<std::string, NUM_TYPES> columns_;
+
+  // JSON of sample
+  std::string json_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Micro-benchmarks of LogSample on the request path: building samples,
+ * JSON and binary (thrift) round trips, and merging, for samples of 4 to 64
+ * keys of mixed value types. JSON benchmarks report `bytes`, the size of
+ * serialized sample.
+ *
+ *  fbzmq_log_sample_bench --bm_regex='LogSample_toJson.*'
+ */
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/init/Init.h>
+
+#include <fbzmq/service/logging/LogSample.h>
+
+namespace fbzmq {
+
+namespace {
+
+const std::vector<size_t> kNumKeys = {4, 16, 64};
+
+const std::vector<std::string> kAddresses = {"10.0.0.1", "fe80::1"};
+const std::set<std::string> kTags = {"bench", "fbzmq", "log_sample"};
+
+struct SampleKeys {
+  explicit SampleKeys(size_t numKeys) {
+    for (size_t i = 0; i < numKeys; ++i) {
+      keys.emplace_back(folly::sformat("key_{}", i));
+    }
+  }
+  std::vector<std::string> keys;
+};
+
+/**
+ * Sample with as many keys of every value type, strings being the most
+ * common ones
+ */
+void
+fillSample(LogSample& sample, SampleKeys const& sampleKeys) {
+  auto const& keys = sampleKeys.keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    switch (i % 8) {
+    case 0:
+      sample.addInt(keys[i], i);
+      break;
+    case 1:
+      sample.addDouble(keys[i], i * 0.5);
+      break;
+    case 2:
+      sample.addStringVector(keys[i], kAddresses);
+      break;
+    case 3:
+      sample.addStringTagset(keys[i], kTags);
+      break;
+    default:
+      sample.addString(keys[i], "node111.po1201.NEIGHBOR_UP");
+    }
+  }
+}
+
+LogSample
+makeSample(SampleKeys const& sampleKeys) {
+  LogSample sample(std::chrono::system_clock::now());
+  fillSample(sample, sampleKeys);
+  return sample;
+}
+
+void
+benchBuild(unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  const SampleKeys keys(numKeys);
+  const auto timestamp = std::chrono::system_clock::now();
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    LogSample sample(timestamp);
+    fillSample(sample, keys);
+    folly::doNotOptimizeAway(sample);
+  }
+
+  braces.rehire();
+}
+
+void
+benchToJson(folly::UserCounters& counters, unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  const auto sample = makeSample(SampleKeys(numKeys));
+  size_t numBytes{0};
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    auto json = sample.toJson();
+    numBytes = json.size();
+    folly::doNotOptimizeAway(json);
+  }
+
+  braces.rehire();
+  counters["bytes"] = numBytes;
+}
+
+void
+benchFromJson(folly::UserCounters& counters, unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  const auto json = makeSample(SampleKeys(numKeys)).toJson();
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    folly::doNotOptimizeAway(LogSample::fromJson(json));
+  }
+
+  braces.rehire();
+  counters["bytes"] = json.size();
+}
+
+void
+benchToThrift(unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  const auto sample = makeSample(SampleKeys(numKeys));
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    folly::doNotOptimizeAway(sample.toThrift());
+  }
+
+  braces.rehire();
+}
+
+void
+benchFromThrift(unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  const auto data = makeSample(SampleKeys(numKeys)).toThrift();
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    // Copy is part of the cost, as received data is usually kept as is
+    folly::doNotOptimizeAway(LogSample::fromThrift(data));
+  }
+
+  braces.rehire();
+}
+
+/**
+ * Merge of a sample of `numKeys` keys into a sample of as many other keys,
+ * e.g. common fields ZmqMonitor merges into every event log. Keys of merged
+ * sample are overwritten after the first iteration.
+ */
+void
+benchMergeSample(unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  auto target = makeSample(SampleKeys(numKeys));
+  LogSample toMerge(std::chrono::system_clock::now());
+  for (size_t i = 0; i < numKeys; ++i) {
+    toMerge.addString(folly::sformat("merged_{}", i), "terragraph");
+  }
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    target.mergeSample(toMerge);
+  }
+
+  braces.rehire();
+  folly::doNotOptimizeAway(target);
+}
+
+} // namespace
+
+} // namespace fbzmq
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+
+  using namespace fbzmq;
+
+  for (auto numKeys : kNumKeys) {
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_build_keys_{}", numKeys),
+        [numKeys](unsigned n) {
+          benchBuild(n, numKeys);
+          return n;
+        });
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_toJson_keys_{}", numKeys),
+        [numKeys](folly::UserCounters& counters, unsigned n) {
+          benchToJson(counters, n, numKeys);
+          return n;
+        });
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_fromJson_keys_{}", numKeys),
+        [numKeys](folly::UserCounters& counters, unsigned n) {
+          benchFromJson(counters, n, numKeys);
+          return n;
+        });
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_toThrift_keys_{}", numKeys),
+        [numKeys](unsigned n) {
+          benchToThrift(n, numKeys);
+          return n;
+        });
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_fromThrift_keys_{}", numKeys),
+        [numKeys](unsigned n) {
+          benchFromThrift(n, numKeys);
+          return n;
+        });
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("LogSample_mergeSample_keys_{}", numKeys),
+        [numKeys](unsigned n) {
+          benchMergeSample(n, numKeys);
+          return n;
+        });
+  }
+
+  folly::runBenchmarks();
+  return 0;
+}
@@ -192,6 +192,60 @@ TEST(LogSampleTest, updateMissingJsonTest) {
   auto resultDynamic = folly::parseJson(sample.toJson());
 }
 
+TEST(LogSampleTest, thriftTest) {
+  const auto timestamp =
+      std::chrono::system_clock::time_point(std::chrono::seconds(111));
+  LogSample sample(timestamp);
+  sample.addInt("int-key", 123);
+  sample.addDouble("double-key", 123.456);
+  sample.addString("string-key", "hello world");
+  sample.addStringVector("vector-key", {"val1", "val2"});
+  sample.addStringTagset("tagset-key", {"tag1", "tag2"});
+
+  // Binary and json representations carry the same sample
+  auto data = sample.toThrift();
+  EXPECT_EQ(123, data.ints_ref()->at("int-key"));
+  EXPECT_EQ("hello world", data.normals_ref()->at("string-key"));
+  auto fromThrift = LogSample::fromThrift(data);
+  EXPECT_EQ(timestamp, fromThrift.getTimestamp());
+  EXPECT_EQ(sample.toJson(), fromThrift.toJson());
+  EXPECT_EQ(sample.toJson(), LogSample::fromJson(sample.toJson()).toJson());
+  EXPECT_EQ(data, LogSample::fromJson(sample.toJson()).toThrift());
+
+  // Timestamp is mandatory
+  data.ints_ref()->erase("time");
+  EXPECT_THROW(LogSample::fromThrift(data), std::exception);
+
+  // Merge in place, preferring existing values
+  LogSample sampleToMerge;
+  sampleToMerge.addString("string-key", "should not overwrite prior val");
+  sampleToMerge.addString("string-key2", "should be added");
+  sampleToMerge.addDouble("double-key2", 1.5);
+  auto merged = std::move(fromThrift).toThrift();
+  sampleToMerge.mergeInto(merged);
+  EXPECT_EQ("hello world", merged.normals_ref()->at("string-key"));
+  EXPECT_EQ("should be added", merged.normals_ref()->at("string-key2"));
+  EXPECT_EQ(1.5, merged.doubles_ref()->at("double-key2"));
+  EXPECT_EQ(111, merged.ints_ref()->at("time"));
+}
+
+TEST(LogSampleTest, unknownTypeJsonTest) {
+  // Value types unknown to LogSample are retained
+  const std::string jsonSample = R"config(
+    {
+     "int":{
+        "time":111
+     },
+     "custom":{
+        "custom-key":{"a":1}
+     }
+    }
+  )config";
+  auto sample = LogSample::fromJson(jsonSample);
+  EXPECT_EQ(111, sample.getInt("time"));
+  EXPECT_EQ(folly::parseJson(jsonSample), folly::parseJson(sample.toJson()));
+}
+
 } // namespace fbzmq
 
 int
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <folly/json.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/logging/LogSample.h>
+#include <fbzmq/service/logging/LogSampleWriter.h>
+
+namespace fbzmq {
+
+namespace {
+
+const auto kTimestamp =
+    std::chrono::system_clock::time_point(std::chrono::seconds(111));
+
+// Schema of samples with fixed keys
+struct TestSchema {
+  LogSampleKey intKey{"int-key"};
+  LogSampleKey doubleKey{"double-key"};
+  LogSampleKey stringKey{"string-key"};
+  LogSampleKey vectorKey{"vector-key"};
+  LogSampleKey tagsetKey{"tagset-key"};
+};
+
+} // namespace
+
+TEST(LogSampleWriterTest, SameAsLogSample) {
+  const std::vector<std::string> values = {{"val1", "val2", "val3"}};
+  const std::set<std::string> tags = {{"tag1", "tag2", "tag3"}};
+
+  LogSample sample(kTimestamp);
+  sample.addInt("int-key", 123);
+  sample.addDouble("double-key", 123.456);
+  sample.addString("string-key", "hello world");
+  sample.addStringVector("vector-key", values);
+  sample.addStringTagset("tagset-key", tags);
+
+  // Ad-hoc keys
+  LogSampleWriter writer;
+  writer.begin(kTimestamp);
+  writer.addInt("int-key", 123);
+  writer.addDouble("double-key", 123.456);
+  writer.addString("string-key", "hello world");
+  writer.addStringVector("vector-key", values);
+  writer.addStringTagset("tagset-key", tags);
+  const auto json = writer.finish().str();
+  EXPECT_EQ(folly::parseJson(sample.toJson()), folly::parseJson(json));
+
+  // Precompiled keys
+  TestSchema schema;
+  writer.begin(kTimestamp);
+  writer.addInt(schema.intKey, 123);
+  writer.addDouble(schema.doubleKey, 123.456);
+  writer.addString(schema.stringKey, "hello world");
+  writer.addStringVector(schema.vectorKey, values);
+  writer.addStringTagset(schema.tagsetKey, tags);
+  EXPECT_EQ(json, writer.finish());
+
+  // Readable as LogSample
+  auto parsed = LogSample::fromJson(json);
+  EXPECT_EQ(kTimestamp, parsed.getTimestamp());
+  EXPECT_EQ(123, parsed.getInt("int-key"));
+  EXPECT_EQ(123.456, parsed.getDouble("double-key"));
+  EXPECT_EQ("hello world", parsed.getString("string-key"));
+  EXPECT_EQ(values, parsed.getStringVector("vector-key"));
+  EXPECT_EQ(tags, parsed.getStringTagset("tagset-key"));
+}
+
+TEST(LogSampleWriterTest, Reuse) {
+  LogSampleWriter writer;
+
+  // Only timestamp
+  writer.begin(kTimestamp);
+  EXPECT_EQ(R"({"int":{"time":111}})", writer.finish());
+
+  // Previous sample is discarded, finish can be called repeatedly
+  writer.begin(kTimestamp);
+  writer.addString("key", "value");
+  const std::string expected{
+      R"({"int":{"time":111},"normal":{"key":"value"}})"};
+  EXPECT_EQ(expected, writer.finish());
+  EXPECT_EQ(expected, writer.finish());
+  writer.begin(kTimestamp);
+  writer.addInt("a", 1);
+  writer.addInt("b", -2);
+  EXPECT_EQ(R"({"int":{"time":111,"a":1,"b":-2}})", writer.finish());
+}
+
+TEST(LogSampleWriterTest, Escaping) {
+  LogSampleWriter writer;
+  writer.begin(kTimestamp);
+
+  const std::string special{"quote\" backslash\\ newline\n tab\t"};
+  LogSampleKey key{special};
+  writer.addString(key, special);
+  writer.addString("plain", special);
+  writer.addStringVector(special, {special, ""});
+
+  auto sample = LogSample::fromJson(writer.finish().str());
+  EXPECT_EQ(special, sample.getString(special));
+  EXPECT_EQ(special, sample.getString("plain"));
+  EXPECT_EQ(
+      std::vector<std::string>({special, ""}), sample.getStringVector(special));
+}
+
+TEST(LogSampleWriterTest, InvalidDouble) {
+  LogSampleWriter writer;
+  writer.begin(kTimestamp);
+  EXPECT_THROW(writer.addDouble("nan", std::nan("")), std::invalid_argument);
+  EXPECT_THROW(
+      writer.addDouble("inf", std::numeric_limits<double>::infinity()),
+      std::invalid_argument);
+
+  // Sample stays intact
+  writer.addDouble("valid", 1.5);
+  EXPECT_EQ(
+      R"({"double":{"valid":1.5},"int":{"time":111}})", writer.finish());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
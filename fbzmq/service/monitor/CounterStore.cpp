@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CounterStore.h"
+
+#include <algorithm>
+
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Names of expired counters logged per summary
+const size_t kMaxLoggedExpiredCounters{10};
+
+} // namespace
+
+constexpr CounterStore::CounterId CounterStore::kInvalidId;
+
+CounterStore::CounterId
+CounterStore::intern(folly::StringPiece name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  CHECK_GT(kInvalidId, names_.size()) << "Too many counters";
+  const CounterId id = names_.size();
+  names_.emplace_back(name.str());
+  ids_.emplace(folly::StringPiece(names_.back()), id);
+  byName_.emplace(folly::StringPiece(names_.back()), id);
+  values_.emplace_back(0);
+  valueTypes_.emplace_back(thrift::CounterValueType::GAUGE);
+  timestamps_.emplace_back(0);
+  updateTimes_.emplace_back();
+  isLive_.emplace_back(0);
+  prev_.emplace_back(kInvalidId);
+  next_.emplace_back(kInvalidId);
+  return id;
+}
+
+CounterStore::CounterId
+CounterStore::find(folly::StringPiece name) const {
+  auto it = ids_.find(name);
+  return it == ids_.end() ? kInvalidId : it->second;
+}
+
+std::vector<std::string>
+CounterStore::getNames() const {
+  std::vector<std::string> names;
+  names.reserve(numLive_);
+  forEach([&](CounterId id) { names.emplace_back(names_[id]); });
+  return names;
+}
+
+void
+CounterStore::set(
+    CounterId id,
+    thrift::Counter const& counter,
+    std::chrono::steady_clock::time_point updateTime) {
+  DCHECK(isValid(id));
+  values_[id] = *counter.value_ref();
+  valueTypes_[id] = *counter.valueType_ref();
+  timestamps_[id] = *counter.timestamp_ref();
+  touch(id, updateTime);
+}
+
+thrift::Counter
+CounterStore::bump(
+    CounterId id,
+    std::chrono::steady_clock::time_point updateTime,
+    int64_t timestamp,
+    int64_t amount) {
+  DCHECK(isValid(id));
+  if (not isLive_[id]) {
+    values_[id] = 0;
+    valueTypes_[id] = thrift::CounterValueType::COUNTER;
+    timestamps_[id] = timestamp;
+  }
+  values_[id] += amount;
+  touch(id, updateTime);
+  return getLive(id);
+}
+
+folly::Optional<thrift::Counter>
+CounterStore::get(CounterId id) const {
+  if (not isLive(id)) {
+    return folly::none;
+  }
+  return getLive(id);
+}
+
+thrift::Counter
+CounterStore::getLive(CounterId id) const {
+  DCHECK(isLive(id));
+  thrift::Counter counter;
+  *counter.value_ref() = values_[id];
+  *counter.valueType_ref() = valueTypes_[id];
+  *counter.timestamp_ref() = timestamps_[id];
+  return counter;
+}
+
+void
+CounterStore::touch(
+    CounterId id, std::chrono::steady_clock::time_point updateTime) {
+  if (isLive_[id]) {
+    if (updateTimes_[id] == updateTime) {
+      return;
+    }
+    unlink(id);
+  } else {
+    isLive_[id] = 1;
+    ++numLive_;
+  }
+  updateTimes_[id] = updateTime;
+
+  // Usually the newest, otherwise walk back to the last counter not updated
+  // later
+  auto after = newest_;
+  while (after != kInvalidId && updateTimes_[after] > updateTime) {
+    after = prev_[after];
+  }
+  prev_[id] = after;
+  if (after == kInvalidId) {
+    next_[id] = oldest_;
+    oldest_ = id;
+  } else {
+    next_[id] = next_[after];
+    next_[after] = id;
+  }
+  if (next_[id] == kInvalidId) {
+    newest_ = id;
+  } else {
+    prev_[next_[id]] = id;
+  }
+}
+
+void
+CounterStore::unlink(CounterId id) {
+  if (prev_[id] == kInvalidId) {
+    oldest_ = next_[id];
+  } else {
+    next_[prev_[id]] = next_[id];
+  }
+  if (next_[id] == kInvalidId) {
+    newest_ = prev_[id];
+  } else {
+    prev_[next_[id]] = prev_[id];
+  }
+  prev_[id] = kInvalidId;
+  next_[id] = kInvalidId;
+}
+
+void
+logExpiredCounters(std::vector<std::string> const& names) {
+  if (names.empty()) {
+    return;
+  }
+  const auto numLogged = std::min(names.size(), kMaxLoggedExpiredCounters);
+  auto msg = folly::join(", ", names.begin(), names.begin() + numLogged);
+  if (numLogged < names.size()) {
+    msg += folly::sformat(" and {} more", names.size() - numLogged);
+  }
+  LOG(INFO) << "Expired " << names.size() << " counters: " << msg;
+}
+
+} // namespace fbzmq
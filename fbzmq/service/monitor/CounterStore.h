@@ -0,0 +1,242 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/container/F14Map.h>
+
+namespace fbzmq {
+
+/**
+ * Storage of counters for ZmqMonitor.
+ *
+ * Counter names are interned on first use and every name is assigned a
+ * numeric id which stays stable for the lifetime of the store (even if the
+ * counter expires and is set again later). Ids are dense and index into
+ * flat arrays of values and update timestamps (struct-of-arrays). Lookup of a
+ * name goes through a single open-addressing hash map, updates via id need no
+ * hashing at all. Names are also indexed in order, so that ranges of names
+ * (e.g. pages of a dump) are visited without going over every counter.
+ *
+ * Live counters are also linked into an intrusive list ordered by last update
+ * time, so that expiry only touches counters which are actually due. Updates
+ * are expected in (mostly) increasing order of time, e.g. `now`. An update
+ * older than the latest one is inserted by walking the list back from its
+ * newest end.
+ *
+ * Memory for interned names is never released. Expired counters only release
+ * their value.
+ *
+ * Not thread-safe.
+ */
+class CounterStore {
+ public:
+  using CounterId = uint32_t;
+
+  static constexpr CounterId kInvalidId{std::numeric_limits<CounterId>::max()};
+
+  /**
+   * Id of counter name. Name is interned with a new id on first use.
+   */
+  CounterId intern(folly::StringPiece name);
+
+  /**
+   * Id of counter name, `kInvalidId` if name is not interned
+   */
+  CounterId find(folly::StringPiece name) const;
+
+  /**
+   * Name of an interned id. id must be valid
+   */
+  std::string const&
+  getName(CounterId id) const {
+    return names_[id];
+  }
+
+  /**
+   * Return true if id has been assigned to a name
+   */
+  bool
+  isValid(CounterId id) const {
+    return id < names_.size();
+  }
+
+  /**
+   * Return true if counter of id has a value (i.e. set and not expired)
+   */
+  bool
+  isLive(CounterId id) const {
+    return isValid(id) && isLive_[id];
+  }
+
+  /**
+   * Set value of counter and its last update time
+   */
+  void set(
+      CounterId id,
+      thrift::Counter const& counter,
+      std::chrono::steady_clock::time_point updateTime);
+
+  /**
+   * Increment value of counter by `amount` and update its last update time.
+   * Counter is created with value zero (with `timestamp` as timestamp) if not
+   * live. Returns updated counter.
+   */
+  thrift::Counter bump(
+      CounterId id,
+      std::chrono::steady_clock::time_point updateTime,
+      int64_t timestamp,
+      int64_t amount = 1);
+
+  /**
+   * Value of a live counter, none otherwise
+   */
+  folly::Optional<thrift::Counter> get(CounterId id) const;
+
+  /**
+   * Value of a live counter. id must be live
+   */
+  thrift::Counter getLive(CounterId id) const;
+
+  /**
+   * Last update time of a live counter. id must be live
+   */
+  std::chrono::steady_clock::time_point
+  getUpdateTime(CounterId id) const {
+    return updateTimes_[id];
+  }
+
+  /**
+   * Number of live counters
+   */
+  size_t
+  size() const {
+    return numLive_;
+  }
+
+  /**
+   * Number of interned names
+   */
+  size_t
+  getNumIds() const {
+    return names_.size();
+  }
+
+  /**
+   * Names of all the live counters, in order of their ids
+   */
+  std::vector<std::string> getNames() const;
+
+  /**
+   * Invoke `fn(CounterId)` for every live counter
+   */
+  template <typename Fn>
+  void
+  forEach(Fn&& fn) const {
+    for (CounterId id = 0; id < isLive_.size(); ++id) {
+      if (isLive_[id]) {
+        fn(id);
+      }
+    }
+  }
+
+  /**
+   * Invoke `fn(CounterId)` for every live counter with name not less than
+   * `from`, in order of names, for as long as `fn` returns true. Cost is
+   * proportional to the number of names visited.
+   */
+  template <typename Fn>
+  void
+  forEachByName(folly::StringPiece from, Fn&& fn) const {
+    for (auto it = byName_.lower_bound(from); it != byName_.end(); ++it) {
+      if (isLive_[it->second] && not fn(it->second)) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * Remove all counters last updated before `cutoff`, oldest first.
+   * `fn(CounterId)` is invoked for every removed counter. Returns number of
+   * removed counters. Cost is proportional to the number of removed counters.
+   */
+  template <typename Fn>
+  size_t
+  purge(std::chrono::steady_clock::time_point cutoff, Fn&& fn) {
+    size_t numPurged{0};
+    while (oldest_ != kInvalidId && updateTimes_[oldest_] < cutoff) {
+      const auto id = oldest_;
+      unlink(id);
+      isLive_[id] = 0;
+      --numLive_;
+      ++numPurged;
+      fn(id);
+    }
+    return numPurged;
+  }
+
+  /**
+   * Last update time of the least recently updated counter, none if empty
+   */
+  folly::Optional<std::chrono::steady_clock::time_point>
+  getOldestUpdateTime() const {
+    if (oldest_ == kInvalidId) {
+      return folly::none;
+    }
+    return updateTimes_[oldest_];
+  }
+
+ private:
+  // Set update time of a counter and (re)link it at its position in expiry
+  // list, making it live
+  void touch(CounterId id, std::chrono::steady_clock::time_point updateTime);
+
+  // Remove live counter from expiry list
+  void unlink(CounterId id);
+
+  // Interned names indexed by id. Deque keeps references stable for keys of
+  // `ids_`.
+  std::deque<std::string> names_;
+  folly::F14FastMap<folly::StringPiece, CounterId> ids_;
+
+  // Interned names in order, keys reference `names_`
+  std::map<folly::StringPiece, CounterId> byName_;
+
+  // Counter values, indexed by id
+  std::vector<double> values_;
+  std::vector<thrift::CounterValueType> valueTypes_;
+  std::vector<int64_t> timestamps_;
+  std::vector<std::chrono::steady_clock::time_point> updateTimes_;
+  std::vector<uint8_t> isLive_;
+
+  // Expiry list of live counters, from least to most recently updated
+  std::vector<CounterId> prev_;
+  std::vector<CounterId> next_;
+  CounterId oldest_{kInvalidId};
+  CounterId newest_{kInvalidId};
+
+  size_t numLive_{0};
+};
+
+/**
+ * Log expired counters as a single line, with their number and names of the
+ * first few of them
+ */
+void logExpiredCounters(std::vector<std::string> const& names);
+
+} // namespace fbzmq
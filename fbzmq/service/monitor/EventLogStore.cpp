@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "EventLogStore.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <glog/logging.h>
+
+#include <fbzmq/zmq/Common.h>
+
+namespace fbzmq {
+
+EventLogStore::EventLogStore(size_t capacity) : entries_(capacity) {}
+
+uint64_t
+EventLogStore::add(thrift::EventLog const& eventLog, int64_t timestamp) {
+  const auto seqNum = nextSeqNum_++;
+  if (entries_.empty()) {
+    return seqNum;
+  }
+
+  auto& entry = getEntry(seqNum);
+  if (size_ == entries_.size()) {
+    // Overwrite the oldest entry, which is also the oldest of its category
+    auto& seqNums = entry.category->second;
+    seqNums.pop_front();
+    if (seqNums.empty()) {
+      const auto category = entry.category->first;
+      categories_.erase(category);
+    }
+  } else {
+    ++size_;
+  }
+
+  lastTimestamp_ = std::max(lastTimestamp_, timestamp);
+  entry.timestamp = lastTimestamp_;
+  auto it = categories_.find(*eventLog.category_ref());
+  if (it == categories_.end()) {
+    it = categories_.emplace(*eventLog.category_ref(), std::deque<uint64_t>())
+             .first;
+  }
+  it->second.push_back(seqNum);
+  entry.category = &*it;
+  entry.data.clear();
+  serializer_.serialize(eventLog, &entry.data);
+  return seqNum;
+}
+
+thrift::EventLogQueryResponse
+EventLogStore::query(thrift::EventLogQueryParams const& params) {
+  thrift::EventLogQueryResponse response;
+  *response.firstSeqNum_ref() = getFirstSeqNum();
+  *response.lastSeqNum_ref() = getLastSeqNum();
+
+  const auto sinceSeqNum = std::max<int64_t>(*params.sinceSeqNum_ref(), 0);
+  auto fromSeqNum = std::max<uint64_t>(
+      getFirstSeqNum(), static_cast<uint64_t>(sinceSeqNum) + 1);
+  if (*params.sinceTimestamp_ref() > 0) {
+    fromSeqNum = lowerBound(fromSeqNum, *params.sinceTimestamp_ref());
+  }
+  const size_t limit = *params.limit_ref() > 0
+      ? static_cast<size_t>(*params.limit_ref())
+      : std::numeric_limits<size_t>::max();
+
+  auto append = [&](uint64_t seqNum) {
+    if (response.eventLogs_ref()->size() == limit) {
+      // Continue after the last returned event log
+      *response.lastSeqNum_ref() = response.seqNums_ref()->back();
+      return false;
+    }
+    response.eventLogs_ref()->emplace_back(read(getEntry(seqNum)));
+    response.seqNums_ref()->emplace_back(seqNum);
+    return true;
+  };
+
+  if (params.category_ref()->empty()) {
+    for (auto seqNum = fromSeqNum; seqNum < nextSeqNum_; ++seqNum) {
+      if (not append(seqNum)) {
+        break;
+      }
+    }
+    return response;
+  }
+
+  auto it = categories_.find(*params.category_ref());
+  if (it == categories_.end()) {
+    return response;
+  }
+  auto const& seqNums = it->second;
+  auto seqIt = std::lower_bound(seqNums.begin(), seqNums.end(), fromSeqNum);
+  for (; seqIt != seqNums.end(); ++seqIt) {
+    if (not append(*seqIt)) {
+      break;
+    }
+  }
+  return response;
+}
+
+std::vector<thrift::EventLog>
+EventLogStore::getAll() {
+  std::vector<thrift::EventLog> eventLogs;
+  eventLogs.reserve(size_);
+  for (auto seqNum = getFirstSeqNum(); seqNum < nextSeqNum_; ++seqNum) {
+    eventLogs.emplace_back(read(getEntry(seqNum)));
+  }
+  return eventLogs;
+}
+
+void
+EventLogStore::forEachSerialized(
+    folly::FunctionRef<void(int64_t, std::string const&)> fn) const {
+  for (auto seqNum = getFirstSeqNum(); seqNum < nextSeqNum_; ++seqNum) {
+    auto const& entry = entries_[(seqNum - 1) % entries_.size()];
+    fn(entry.timestamp, entry.data);
+  }
+}
+
+void
+EventLogStore::setNextSeqNum(uint64_t seqNum) {
+  CHECK_EQ(0, size_);
+  nextSeqNum_ = std::max<uint64_t>(seqNum, 1);
+}
+
+uint64_t
+EventLogStore::lowerBound(uint64_t fromSeqNum, int64_t timestamp) {
+  auto low = fromSeqNum;
+  auto high = nextSeqNum_;
+  while (low < high) {
+    const auto mid = low + (high - low) / 2;
+    if (getEntry(mid).timestamp < timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+thrift::EventLog
+EventLogStore::read(Entry const& entry) {
+  return util::readThriftObjStr<thrift::EventLog>(entry.data, serializer_);
+}
+
+} // namespace fbzmq
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <folly/Function.h>
+#include <folly/container/F14Map.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace fbzmq {
+
+/**
+ * Storage of last event logs for ZmqMonitor.
+ *
+ * Event logs are kept serialized in a ring buffer which is allocated upfront
+ * for `capacity` entries, the oldest event log is overwritten once it's full.
+ * Buffers of overwritten entries are reused, hence a full store doesn't
+ * allocate per event log in the common case.
+ *
+ * Every event log is assigned an increasing sequence number (starting at 1)
+ * and its receive time. Entries are indexed by sequence number (position in
+ * the ring), by receive time (binary search, times are never decreasing) and
+ * by category (sequence numbers of every category), so queries only touch
+ * the event logs they return.
+ *
+ * Not thread-safe.
+ */
+class EventLogStore {
+ public:
+  explicit EventLogStore(size_t capacity);
+
+  /**
+   * Add an event log received at `timestamp` (milliseconds since epoch).
+   * Returns its sequence number.
+   */
+  uint64_t add(thrift::EventLog const& eventLog, int64_t timestamp);
+
+  /**
+   * Event logs matching all filters of `params`, oldest first
+   */
+  thrift::EventLogQueryResponse query(
+      thrift::EventLogQueryParams const& params);
+
+  /**
+   * All event logs, oldest first
+   */
+  std::vector<thrift::EventLog> getAll();
+
+  /**
+   * Invoke `fn(timestamp, data)` for every event log, oldest first, with its
+   * receive time and compact serialized form
+   */
+  void forEachSerialized(
+      folly::FunctionRef<void(int64_t, std::string const&)> fn) const;
+
+  /**
+   * Number event logs from `seqNum` on, e.g. to carry on numbering of a
+   * restored store. Store must be empty.
+   */
+  void setNextSeqNum(uint64_t seqNum);
+
+  size_t
+  size() const {
+    return size_;
+  }
+
+  size_t
+  getCapacity() const {
+    return entries_.size();
+  }
+
+  /**
+   * Sequence number of the oldest event log, or of the next one if empty
+   */
+  uint64_t
+  getFirstSeqNum() const {
+    return nextSeqNum_ - size_;
+  }
+
+  /**
+   * Sequence number of the latest event log, zero if none was ever added
+   */
+  uint64_t
+  getLastSeqNum() const {
+    return nextSeqNum_ - 1;
+  }
+
+ private:
+  using CategoryMap = folly::F14NodeMap<std::string, std::deque<uint64_t>>;
+
+  struct Entry {
+    int64_t timestamp{0};
+    // Category of entry in index. Nodes of the map are stable.
+    CategoryMap::value_type* category{nullptr};
+    std::string data;
+  };
+
+  Entry&
+  getEntry(uint64_t seqNum) {
+    return entries_[(seqNum - 1) % entries_.size()];
+  }
+
+  // Sequence number of the first entry received at or after timestamp, within
+  // [fromSeqNum, nextSeqNum_]
+  uint64_t lowerBound(uint64_t fromSeqNum, int64_t timestamp);
+
+  // Deserialize entry
+  thrift::EventLog read(Entry const& entry);
+
+  // Ring buffer of entries
+  std::vector<Entry> entries_;
+
+  // Number of entries in ring buffer
+  size_t size_{0};
+
+  // Sequence number of the next event log
+  uint64_t nextSeqNum_{1};
+
+  // Latest receive time, receive times are clamped to never decrease
+  int64_t lastTimestamp_{0};
+
+  // Sequence numbers of entries per category
+  CategoryMap categories_;
+
+  apache::thrift::CompactSerializer serializer_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,304 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SharedCounterTable.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+const uint64_t kMagic{0x66627a6d71637472}; // "fbzmqctr"
+const uint32_t kVersion{1};
+
+// Max attempts to read a slot which is being updated
+const int kMaxReadAttempts{16};
+
+uint64_t
+toBits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double
+fromBits(uint64_t bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+/**
+ * Layout of the segment is a header followed by `numSlots` slots. Fields
+ * which are read concurrently are atomics, which are lock-free and hence
+ * address-free for these sizes.
+ */
+struct alignas(64) SharedCounterTable::Header {
+  uint64_t magic{0};
+  uint32_t version{0};
+  uint32_t numSlots{0};
+  // Slots below are allocated and their names are written
+  std::atomic<uint32_t> numUsedSlots{0};
+};
+
+struct alignas(64) SharedCounterTable::Slot {
+  // Odd while writer updates the slot, zero until first update
+  std::atomic<uint32_t> seq{0};
+  std::atomic<int32_t> valueType{0};
+  std::atomic<uint64_t> valueBits{0};
+  std::atomic<int64_t> timestamp{0};
+  char name[kMaxNameLength + 1];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "");
+
+folly::Expected<std::unique_ptr<SharedCounterTable>, Error>
+SharedCounterTable::create(std::string const& path, size_t numSlots) {
+  if (numSlots == 0 or numSlots > std::numeric_limits<uint32_t>::max()) {
+    return folly::makeUnexpected(Error(EINVAL));
+  }
+  const size_t size = sizeof(Header) + numSlots * sizeof(Slot);
+
+  // Replace the file so that readers of a previous table keep their own copy
+  ::unlink(path.c_str());
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  if (::ftruncate(fd, size) != 0) {
+    const int err = errno;
+    ::close(fd);
+    ::unlink(path.c_str());
+    return folly::makeUnexpected(Error(err));
+  }
+  void* addr =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    const int err = errno;
+    ::close(fd);
+    ::unlink(path.c_str());
+    return folly::makeUnexpected(Error(err));
+  }
+
+  // File is zero filled which is a valid initial state for all slots. Magic is
+  // written last, readers reject the table until then.
+  auto header = new (addr) Header();
+  header->version = kVersion;
+  header->numSlots = numSlots;
+  for (size_t i = 0; i < numSlots; ++i) {
+    new (static_cast<char*>(addr) + sizeof(Header) + i * sizeof(Slot)) Slot();
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kMagic;
+
+  return std::unique_ptr<SharedCounterTable>(new SharedCounterTable(
+      path, fd, addr, size, numSlots, true /* isOwner */));
+}
+
+folly::Expected<std::unique_ptr<SharedCounterTable>, Error>
+SharedCounterTable::open(std::string const& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    const int err = errno;
+    ::close(fd);
+    return folly::makeUnexpected(Error(err));
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(Header)) {
+    ::close(fd);
+    return folly::makeUnexpected(Error(EINVAL, "Invalid counter table size"));
+  }
+  void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    const int err = errno;
+    ::close(fd);
+    return folly::makeUnexpected(Error(err));
+  }
+
+  auto header = static_cast<Header const*>(addr);
+  const bool isValid = header->magic == kMagic and
+      header->version == kVersion and
+      size >= sizeof(Header) + header->numSlots * sizeof(Slot);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (not isValid) {
+    ::munmap(addr, size);
+    ::close(fd);
+    return folly::makeUnexpected(Error(EINVAL, "Invalid counter table"));
+  }
+
+  return std::unique_ptr<SharedCounterTable>(new SharedCounterTable(
+      path, fd, addr, size, header->numSlots, false /* isOwner */));
+}
+
+SharedCounterTable::SharedCounterTable(
+    std::string const& path,
+    int fd,
+    void* addr,
+    size_t size,
+    size_t numSlots,
+    bool isOwner)
+    : path_(path),
+      fd_(fd),
+      addr_(addr),
+      size_(size),
+      numSlots_(numSlots),
+      isOwner_(isOwner) {
+  if (not isOwner_) {
+    lastSeqs_.resize(numSlots_, 0);
+  }
+}
+
+SharedCounterTable::~SharedCounterTable() {
+  ::munmap(addr_, size_);
+  ::close(fd_);
+  if (isOwner_) {
+    // Readers keep their mapping, file only goes away once all of them unmap
+    ::unlink(path_.c_str());
+  }
+}
+
+SharedCounterTable::Header*
+SharedCounterTable::header() const {
+  return static_cast<Header*>(addr_);
+}
+
+SharedCounterTable::Slot*
+SharedCounterTable::slot(size_t index) const {
+  return reinterpret_cast<Slot*>(
+      static_cast<char*>(addr_) + sizeof(Header) + index * sizeof(Slot));
+}
+
+folly::Optional<size_t>
+SharedCounterTable::getSlot(folly::StringPiece name) {
+  DCHECK(isOwner_);
+  auto it = slots_.find(name.str());
+  if (it != slots_.end()) {
+    return it->second;
+  }
+  if (numUsedSlots_ >= numSlots_ or name.size() > kMaxNameLength) {
+    return folly::none;
+  }
+
+  // Name must be complete before slot is published to readers
+  const size_t index = numUsedSlots_++;
+  auto s = slot(index);
+  std::memcpy(s->name, name.data(), name.size());
+  s->name[name.size()] = '\0';
+  header()->numUsedSlots.store(numUsedSlots_, std::memory_order_release);
+  slots_.emplace(name.str(), index);
+  return index;
+}
+
+void
+SharedCounterTable::set(size_t index, thrift::Counter const& counter) {
+  DCHECK(isOwner_);
+  DCHECK_LT(index, numUsedSlots_);
+  auto s = slot(index);
+  const auto seq = s->seq.load(std::memory_order_relaxed);
+  s->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s->valueType.store(
+      static_cast<int32_t>(*counter.valueType_ref()),
+      std::memory_order_relaxed);
+  s->valueBits.store(toBits(*counter.value_ref()), std::memory_order_relaxed);
+  s->timestamp.store(*counter.timestamp_ref(), std::memory_order_relaxed);
+  s->seq.store(seq + 2, std::memory_order_release);
+}
+
+void
+SharedCounterTable::bump(size_t index, int64_t amount, int64_t timestamp) {
+  DCHECK(isOwner_);
+  DCHECK_LT(index, numUsedSlots_);
+  auto s = slot(index);
+  const auto seq = s->seq.load(std::memory_order_relaxed);
+  s->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  if (seq == 0) {
+    s->valueType.store(
+        static_cast<int32_t>(thrift::CounterValueType::COUNTER),
+        std::memory_order_relaxed);
+    s->timestamp.store(timestamp, std::memory_order_relaxed);
+  }
+  // Only writer modifies the value, no need for an atomic read-modify-write
+  const auto value = fromBits(s->valueBits.load(std::memory_order_relaxed));
+  s->valueBits.store(toBits(value + amount), std::memory_order_relaxed);
+  s->seq.store(seq + 2, std::memory_order_release);
+}
+
+void
+SharedCounterTable::forEachChanged(
+    folly::FunctionRef<void(SlotValue const&)> callback) {
+  DCHECK(not isOwner_);
+  const size_t numUsedSlots = getNumUsedSlots();
+
+  SlotValue value;
+  for (size_t i = 0; i < numUsedSlots; ++i) {
+    auto s = slot(i);
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+      const auto seq = s->seq.load(std::memory_order_acquire);
+      if (seq == lastSeqs_[i]) {
+        break;
+      }
+      if (seq & 1) {
+        continue;
+      }
+      const auto valueType = s->valueType.load(std::memory_order_relaxed);
+      const auto valueBits = s->valueBits.load(std::memory_order_relaxed);
+      const auto timestamp = s->timestamp.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s->seq.load(std::memory_order_relaxed) != seq) {
+        continue;
+      }
+
+      lastSeqs_[i] = seq;
+      value.name =
+          folly::StringPiece(s->name, ::strnlen(s->name, kMaxNameLength));
+      *value.counter.valueType_ref() =
+          static_cast<thrift::CounterValueType>(valueType);
+      *value.counter.value_ref() = fromBits(valueBits);
+      *value.counter.timestamp_ref() = timestamp;
+      callback(value);
+      break;
+    }
+  }
+}
+
+bool
+SharedCounterTable::isRemoved() const {
+  struct stat pathStat;
+  struct stat fdStat;
+  if (::stat(path_.c_str(), &pathStat) != 0 or ::fstat(fd_, &fdStat) != 0) {
+    return true;
+  }
+  return pathStat.st_dev != fdStat.st_dev or pathStat.st_ino != fdStat.st_ino;
+}
+
+size_t
+SharedCounterTable::getNumUsedSlots() const {
+  return std::min<size_t>(
+      header()->numUsedSlots.load(std::memory_order_acquire), numSlots_);
+}
+
+} // namespace fbzmq
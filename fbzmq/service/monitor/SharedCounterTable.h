@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/zmq/Common.h>
+#include <folly/Expected.h>
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+namespace fbzmq {
+
+/**
+ * Fixed-slot table of counters in a file backed shared memory segment, used
+ * by co-located ZmqMonitorClient and ZmqMonitor to exchange counter values
+ * without going through sockets and serialization.
+ *
+ * Table has a single writer (the client) which allocates a slot per counter
+ * name and then updates its value in place. Any number of readers (monitor)
+ * can map the same file and scan it. Every slot is protected by a seqlock:
+ * writer bumps sequence number of the slot to odd before and back to even
+ * after an update, readers retry reads which overlap an update. Writes never
+ * block or wait on readers.
+ *
+ * Names are written once when a slot is allocated and never change. Slots
+ * are never released, a full table rejects new names.
+ */
+class SharedCounterTable {
+ public:
+  // Max length of a counter name in a slot
+  static constexpr size_t kMaxNameLength{103};
+
+  /**
+   * A changed slot reported by `forEachChanged`
+   */
+  struct SlotValue {
+    folly::StringPiece name;
+    thrift::Counter counter;
+  };
+
+  /**
+   * Create a table with `numSlots` slots in a new file at `path` (replaced if
+   * it exists) and map it for writing. File is removed on destruction.
+   */
+  static folly::Expected<std::unique_ptr<SharedCounterTable>, Error> create(
+      std::string const& path, size_t numSlots);
+
+  /**
+   * Map an existing table at `path` for reading
+   */
+  static folly::Expected<std::unique_ptr<SharedCounterTable>, Error> open(
+      std::string const& path);
+
+  ~SharedCounterTable();
+
+  SharedCounterTable(SharedCounterTable const&) = delete;
+  SharedCounterTable& operator=(SharedCounterTable const&) = delete;
+
+  //
+  // Writer APIs, must be called from a single thread
+  //
+
+  /**
+   * Slot of counter name, allocated on first use. Returns none if the table
+   * is full or name is too long.
+   */
+  folly::Optional<size_t> getSlot(folly::StringPiece name);
+
+  /**
+   * Set value of a counter
+   */
+  void set(size_t slot, thrift::Counter const& counter);
+
+  /**
+   * Increment value of a counter. Counter which wasn't set before starts from
+   * zero as a COUNTER with `timestamp`.
+   */
+  void bump(size_t slot, int64_t amount, int64_t timestamp);
+
+  //
+  // Reader APIs
+  //
+
+  /**
+   * Invoke callback for every counter which changed since the last call.
+   * Counters which are being updated concurrently are retried a few times and
+   * skipped (reported by the next call) if writer keeps on updating them.
+   */
+  void forEachChanged(folly::FunctionRef<void(SlotValue const&)> callback);
+
+  /**
+   * Return true if file of the table has been removed or replaced, i.e.
+   * writer is gone and table won't change anymore
+   */
+  bool isRemoved() const;
+
+  /**
+   * Number of allocated slots
+   */
+  size_t getNumUsedSlots() const;
+
+  size_t
+  getNumSlots() const {
+    return numSlots_;
+  }
+
+  std::string const&
+  getPath() const {
+    return path_;
+  }
+
+ private:
+  struct Header;
+  struct Slot;
+
+  SharedCounterTable(
+      std::string const& path,
+      int fd,
+      void* addr,
+      size_t size,
+      size_t numSlots,
+      bool isOwner);
+
+  Header* header() const;
+  Slot* slot(size_t index) const;
+
+  const std::string path_;
+  const int fd_{-1};
+  void* const addr_{nullptr};
+  const size_t size_{0};
+  const size_t numSlots_{0};
+
+  // Writer owns the file and removes it on destruction
+  const bool isOwner_{false};
+
+  // Writer: number of slots allocated so far
+  size_t numUsedSlots_{0};
+
+  // Writer: slot of counter names
+  std::unordered_map<std::string, size_t> slots_;
+
+  // Reader: sequence number of every slot as of the last scan
+  std::vector<uint32_t> lastSeqs_;
+};
+
+} // namespace fbzmq
@@ -2,6 +2,12 @@
 
 #include "SystemMetrics.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+
 #if defined(IS_BSD) && defined(__APPLE__)
 #include <mach/mach_init.h>
 #include <mach/task.h>
@@ -11,8 +17,60 @@
 #include <sys/types.h>
 #endif
 
+namespace {
+
+/* Parse name and CPU time (user + system, in clock ticks) of a thread from
+ / its /proc/self/task/<tid>/stat, formatted as
+ / "<tid> (<comm>) <state> <ppid> ... <utime> <stime> ...". Name may contain
+ / spaces and parentheses, hence fields are counted from the last ')'.
+*/
+bool
+parseThreadStat(const char* buf, std::string& name, uint64_t& ticks) {
+  const char* nameBegin = std::strchr(buf, '(');
+  const char* nameEnd = std::strrchr(buf, ')');
+  if (nameBegin == nullptr || nameEnd == nullptr || nameEnd < nameBegin) {
+    return false;
+  }
+  name.assign(nameBegin + 1, nameEnd);
+
+  // utime and stime are fields 14 and 15, field after ')' is 3rd
+  const char* pos = nameEnd + 1;
+  for (int field = 3; field < 14; ++field) {
+    pos = std::strchr(pos + 1, ' ');
+    if (pos == nullptr) {
+      return false;
+    }
+  }
+  char* end = nullptr;
+  const uint64_t utime = std::strtoull(pos, &end, 10);
+  if (end == pos) {
+    return false;
+  }
+  pos = end;
+  const uint64_t stime = std::strtoull(pos, &end, 10);
+  if (end == pos) {
+    return false;
+  }
+  ticks = utime + stime;
+  return true;
+}
+
+// per second rate of a cumulative count
+double
+getRate(long now, long prev, uint64_t elapsedNs) {
+  return now > prev ? (double)(now - prev) * 1.0e9 / (double)elapsedNs : 0;
+}
+
+} // namespace
+
 namespace fbzmq {
 
+SystemMetrics::~SystemMetrics() {
+  for (auto& kv : threads_) {
+    ::close(kv.second.fd);
+  }
+}
+
 /* Return RSS memory the process currently used from /proc/[pid]/status.
  / The /proc is a pseudo-filesystem providing an API to kernel data
  / structures.
@@ -90,6 +148,138 @@ SystemMetrics::getCPUpercentage() {
   return cpuPct;
 }
 
+/* Return rates of page faults and context switches of the process
+ / This need to be called twice to get the time difference, like CPU%.
+*/
+folly::Optional<ProcEventRates>
+SystemMetrics::getEventRates() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return folly::none;
+  }
+  const uint64_t now = getCurrentNanoTime();
+
+  folly::Optional<ProcEventRates> rates{folly::none};
+  if (prevUsageTimestamp != 0 && now > prevUsageTimestamp) {
+    const uint64_t elapsed = now - prevUsageTimestamp;
+    rates = ProcEventRates();
+    rates->minorFaults = getRate(usage.ru_minflt, prevUsage.ru_minflt, elapsed);
+    rates->majorFaults = getRate(usage.ru_majflt, prevUsage.ru_majflt, elapsed);
+    rates->voluntaryCtxSwitches =
+        getRate(usage.ru_nvcsw, prevUsage.ru_nvcsw, elapsed);
+    rates->involuntaryCtxSwitches =
+        getRate(usage.ru_nivcsw, prevUsage.ru_nivcsw, elapsed);
+  }
+
+  // update the cache for next query
+  prevUsage = usage;
+  prevUsageTimestamp = now;
+
+  return rates;
+}
+
+/* Return number of open file descriptors from entries of /proc/self/fd,
+ / excluding the one used for listing them.
+*/
+folly::Optional<size_t>
+SystemMetrics::getNumOpenFds() {
+#if !defined(IS_BSD)
+  DIR* dir = ::opendir("/proc/self/fd");
+  if (dir == nullptr) {
+    return folly::none;
+  }
+  size_t numFds{0};
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      ++numFds;
+    }
+  }
+  ::closedir(dir);
+  return numFds > 0 ? numFds - 1 : 0;
+#else
+  return folly::none;
+#endif
+}
+
+/* Return CPU% of threads by name from /proc/self/task/<tid>/stat
+ / Threads are listed on every query to discover new ones, however `stat`
+ / files stay open across queries and are re-read from the start. Files of
+ / exited threads are closed.
+*/
+std::unordered_map<std::string, double>
+SystemMetrics::getThreadCPUpercentage() {
+  std::unordered_map<std::string, double> cpuPcts;
+#if !defined(IS_BSD)
+  DIR* dir = ::opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return cpuPcts;
+  }
+  const uint64_t now = getCurrentNanoTime();
+  const bool hasPrev =
+      prevThreadsTimestamp_ != 0 && now > prevThreadsTimestamp_;
+  const double nsPerTick = 1.0e9 / (double)::sysconf(_SC_CLK_TCK);
+  ++threadsGeneration_;
+
+  char path[64];
+  char buf[1024];
+  std::string name;
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    const int tid = std::atoi(entry->d_name);
+    auto it = threads_.find(tid);
+    const bool isNew = it == threads_.end();
+    if (isNew) {
+      snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+      const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        continue; // exited in the meantime
+      }
+      it = threads_.emplace(tid, ThreadCpuTime()).first;
+      it->second.fd = fd;
+    }
+
+    auto& thread = it->second;
+    const ssize_t len = ::pread(thread.fd, buf, sizeof(buf) - 1, 0);
+    uint64_t ticks{0};
+    if (len > 0) {
+      buf[len] = '\0';
+    }
+    if (len <= 0 || !parseThreadStat(buf, name, ticks)) {
+      // file of an exited thread fails to read even if its tid got reused,
+      // a new thread of the same tid is picked up on next query
+      ::close(thread.fd);
+      threads_.erase(it);
+      continue;
+    }
+
+    // calculate the CPU% = (thread time diff) / (time elapsed) * 100
+    if (!isNew && hasPrev) {
+      const uint64_t tickDiff =
+          ticks > thread.ticks ? ticks - thread.ticks : 0;
+      cpuPcts[name] += (double)tickDiff * nsPerTick /
+          (double)(now - prevThreadsTimestamp_) * 100;
+    }
+    thread.ticks = ticks;
+    thread.generation = threadsGeneration_;
+  }
+  ::closedir(dir);
+
+  // forget threads which exited since previous query
+  for (auto it = threads_.begin(); it != threads_.end();) {
+    if (it->second.generation != threadsGeneration_) {
+      ::close(it->second.fd);
+      it = threads_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  prevThreadsTimestamp_ = now;
+#endif
+  return cpuPcts;
+}
+
 // get current timestamp
 uint64_t
 SystemMetrics::getCurrentNanoTime() {
@@ -9,22 +9,63 @@
 #include <chrono>
 #include <fstream>
 #include <regex>
+#include <string>
+#include <unordered_map>
 
 namespace fbzmq {
 
+/**
+ * Rates (per second) of scheduling and memory events of the process
+ */
+struct ProcEventRates {
+  double minorFaults{0}; /* page faults served without IO */
+  double majorFaults{0}; /* page faults requiring IO */
+  double voluntaryCtxSwitches{0}; /* blocked, e.g. waiting on IO or lock */
+  double involuntaryCtxSwitches{0}; /* preempted, e.g. time slice expired */
+};
+
 /**
  * This class provides the API to get the system usage for monitoring,
  * including the CPU, memory usage, etc.
  */
 class SystemMetrics {
  public:
+  SystemMetrics() = default;
+  ~SystemMetrics();
+
   // get RSS memory the process used
   folly::Optional<size_t> getRSSMemBytes();
 
   // get CPU% the process used
   folly::Optional<double> getCPUpercentage();
 
+  // get rates of faults and context switches of the process. Like CPU%, it
+  // needs to be called twice to get a value.
+  folly::Optional<ProcEventRates> getEventRates();
+
+  // get number of file descriptors the process has open
+  folly::Optional<size_t> getNumOpenFds();
+
+  // get CPU% of threads by their name (comm), refer to pthread_setname_np().
+  // Threads sharing a name are summed up, e.g. the IO threads of libzmq
+  // named `ZMQbg/IO/<n>` can be told apart from user threads. Like CPU%, a
+  // thread is reported from its second query onwards.
+  std::unordered_map<std::string, double> getThreadCPUpercentage();
+
  private:
+  SystemMetrics(SystemMetrics const&) = delete;
+  SystemMetrics& operator=(SystemMetrics const&) = delete;
+
+  /**
+  / Per thread state. `stat` file of a thread is kept open across queries,
+  / hence a query takes a single read per thread.
+  */
+  struct ThreadCpuTime {
+    int fd{-1}; /* open /proc/self/task/<tid>/stat */
+    uint64_t ticks{0}; /* CPU time used in user and system mode */
+    uint64_t generation{0}; /* query the thread was last seen in */
+  };
+
   /**
   / To record CPU used time of current process (in nanoseconds)
   */
@@ -46,6 +87,15 @@ class SystemMetrics {
   // cache for CPU used time of previous query
   ProcCpuTime prevCpuTime;
 
+  // cache for event counts of previous query
+  struct rusage prevUsage {};
+  uint64_t prevUsageTimestamp{0};
+
+  // threads of previous query, by tid
+  std::unordered_map<int, ThreadCpuTime> threads_;
+  uint64_t threadsGeneration_{0};
+  uint64_t prevThreadsTimestamp_{0};
+
   // get current timestamp (in nanoseconds)
   uint64_t static getCurrentNanoTime();
 };
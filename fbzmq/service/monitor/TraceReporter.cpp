@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TraceReporter.h"
+
+#include <algorithm>
+
+#include <folly/Conv.h>
+
+#include <fbzmq/service/logging/LogSample.h>
+
+namespace fbzmq {
+
+namespace {
+
+int64_t
+toUs(std::chrono::system_clock::duration duration) {
+  return std::max<int64_t>(
+      0,
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+} // namespace
+
+TraceReporter::TraceReporter(
+    ThreadData& threadData, ZmqMonitorClient& monitorClient, Options options)
+    : threadData_(threadData),
+      monitorClient_(monitorClient),
+      options_(std::move(options)) {
+  *eventLog_.category_ref() = options_.eventLogCategory;
+}
+
+TraceReporter::~TraceReporter() {
+  flush();
+}
+
+void
+TraceReporter::record(
+    folly::StringPiece name,
+    TraceContext const& context,
+    std::chrono::system_clock::time_point recvTime) {
+  const auto prefix = folly::to<std::string>(options_.statPrefix, ".", name);
+  const auto hopKey = prefix + ".hop_latency_us";
+  const auto e2eKey = prefix + ".e2e_latency_us";
+  if (knownHops_.insert(name.str()).second) {
+    for (auto const& key : {hopKey, e2eKey}) {
+      for (auto type : {AVG, COUNT, P50, P99, P999}) {
+        threadData_.addStatExportType(key, type);
+      }
+    }
+  }
+
+  const auto hopLatencyUs = toUs(recvTime - context.sendTime);
+  const auto e2eLatencyUs = toUs(recvTime - context.originTime);
+  threadData_.addStatValue(hopKey, hopLatencyUs);
+  threadData_.addStatValue(e2eKey, e2eLatencyUs);
+
+  if (not context.isSampled) {
+    return;
+  }
+  LogSample sample(recvTime);
+  sample.addString("hop_name", name);
+  // Unsigned, hence may not fit in an int
+  sample.addString("trace_id", folly::to<std::string>(context.traceId));
+  sample.addInt("hop", context.hop);
+  sample.addInt("hop_latency_us", hopLatencyUs);
+  sample.addInt("e2e_latency_us", e2eLatencyUs);
+  eventLog_.binarySamples_ref()->emplace_back(std::move(sample).toThrift());
+  if (getNumBufferedSamples() >= options_.maxBufferedSamples) {
+    flush();
+  }
+}
+
+folly::Function<void(
+    TraceContext const&, std::chrono::system_clock::time_point)>
+TraceReporter::getCallback(std::string name) {
+  return [this, name = std::move(name)](
+             TraceContext const& context,
+             std::chrono::system_clock::time_point recvTime) {
+    record(name, context, recvTime);
+  };
+}
+
+void
+TraceReporter::flush() {
+  if (eventLog_.binarySamples_ref()->empty()) {
+    return;
+  }
+  monitorClient_.addEventLog(eventLog_);
+  eventLog_.binarySamples_ref()->clear();
+}
+
+} // namespace fbzmq
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_set>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/stats/ThreadData.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <folly/Function.h>
+#include <folly/Range.h>
+
+#include "ZmqMonitorClient.h"
+
+namespace fbzmq {
+
+struct TraceReporterOptions {
+  // Latencies are exported as `<statPrefix>.<hop name>.hop_latency_us` and
+  // `<statPrefix>.<hop name>.e2e_latency_us` stats
+  std::string statPrefix{"zmq.trace"};
+
+  // Category of event logs of sampled traces
+  std::string eventLogCategory{"zmq_traces"};
+
+  // Sampled traces are sent to monitor once this many are buffered, or on
+  // `flush()`
+  size_t maxBufferedSamples{64};
+};
+
+/**
+ * Exports traces received on sockets with tracing enabled (refer to
+ * `SocketImpl::setTraceOptions`). Latencies since previous hop and since start
+ * of trace are recorded into ThreadData stats (avg and percentiles), and
+ * sampled traces are sent to ZmqMonitor as LogSamples with trace id, hop and
+ * latencies, so that hops of a trace can be joined by trace id.
+ *
+ *  TraceReporter reporter(threadData, monitorClient);
+ *  SocketTraceOptions traceOptions;
+ *  traceOptions.onTrace = reporter.getCallback("frontend");
+ *  frontendSock.setTraceOptions(std::move(traceOptions));
+ *
+ * Not thread safe, just like ThreadData. Must outlive sockets it reports for.
+ */
+class TraceReporter {
+ public:
+  using Options = TraceReporterOptions;
+
+  TraceReporter(
+      ThreadData& threadData,
+      ZmqMonitorClient& monitorClient,
+      Options options = Options());
+
+  // Flushes buffered samples
+  ~TraceReporter();
+
+  /**
+   * Record trace received on hop of given name at `recvTime`
+   */
+  void record(
+      folly::StringPiece name,
+      TraceContext const& context,
+      std::chrono::system_clock::time_point recvTime);
+
+  /**
+   * Callback for `SocketTraceOptions::onTrace` recording traces as the hop
+   * of given name
+   */
+  folly::Function<void(
+      TraceContext const&, std::chrono::system_clock::time_point)>
+  getCallback(std::string name);
+
+  /**
+   * Send buffered samples to monitor
+   */
+  void flush();
+
+  size_t
+  getNumBufferedSamples() const {
+    return eventLog_.binarySamples_ref()->size();
+  }
+
+ private:
+  ThreadData& threadData_;
+  ZmqMonitorClient& monitorClient_;
+  const Options options_;
+
+  // Hops whose stats have export types set
+  std::unordered_set<std::string> knownHops_;
+
+  // Sampled traces yet to be sent
+  thrift::EventLog eventLog_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,1358 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ZmqMonitor.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <regex>
+
+#include <folly/Format.h>
+#include <folly/Random.h>
+#include <folly/ScopeGuard.h>
+#include <folly/hash/Checksum.h>
+
+namespace fbzmq {
+
+namespace {
+
+using PersistedCounters = std::map<std::string, thrift::PersistedCounter>;
+
+// Header of persisted state file, followed by `size` bytes of compact
+// serialized thrift::MonitorPersistedState
+struct PersistHeader {
+  uint64_t magic{0};
+  uint32_t version{0};
+  // crc32c of the serialized state
+  uint32_t checksum{0};
+  uint64_t size{0};
+};
+
+const uint64_t kPersistMagic{0x66627a6d71737473}; // "fbzmqsts"
+const uint32_t kPersistVersion{1};
+
+uint32_t
+getChecksum(const void* data, size_t size) {
+  return folly::crc32c(static_cast<const uint8_t*>(data), size);
+}
+
+/**
+ * Write state into a file next to `path` which then replaces it. Both file
+ * and its directory are synced, so that after a crash `path` holds either
+ * previous or new state in full.
+ */
+folly::Expected<folly::Unit, Error>
+writeStateFile(std::string const& path, std::string const& data) {
+  const auto tmpPath = path + ".tmp";
+  const size_t size = sizeof(PersistHeader) + data.size();
+  const int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  SCOPE_EXIT {
+    ::close(fd);
+  };
+  auto fail = [&tmpPath]() {
+    const int err = errno;
+    ::unlink(tmpPath.c_str());
+    return folly::makeUnexpected(Error(err));
+  };
+
+  if (::ftruncate(fd, size) != 0) {
+    return fail();
+  }
+  void* addr =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    return fail();
+  }
+  PersistHeader header;
+  header.magic = kPersistMagic;
+  header.version = kPersistVersion;
+  header.checksum = getChecksum(data.data(), data.size());
+  header.size = data.size();
+  std::memcpy(addr, &header, sizeof(header));
+  std::memcpy(
+      static_cast<char*>(addr) + sizeof(header), data.data(), data.size());
+  ::munmap(addr, size);
+
+  // Data must be durable before rename is, else a crash can leave behind a
+  // renamed but truncated file
+  if (::fsync(fd) != 0) {
+    return fail();
+  }
+  if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    return fail();
+  }
+
+  // Make rename itself durable
+  const auto slash = path.rfind('/');
+  const auto dirPath = slash == std::string::npos
+      ? std::string(".")
+      : (slash == 0 ? std::string("/") : path.substr(0, slash));
+  const int dirFd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dirFd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  SCOPE_EXIT {
+    ::close(dirFd);
+  };
+  if (::fsync(dirFd) != 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  return folly::unit;
+}
+
+/**
+ * Read state written by `writeStateFile`
+ */
+folly::Expected<std::string, Error>
+readStateFile(std::string const& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  SCOPE_EXIT {
+    ::close(fd);
+  };
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(PersistHeader)) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid state file size"));
+  }
+  void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  SCOPE_EXIT {
+    ::munmap(addr, size);
+  };
+
+  PersistHeader header;
+  std::memcpy(&header, addr, sizeof(header));
+  const char* data = static_cast<const char*>(addr) + sizeof(header);
+  if (header.magic != kPersistMagic or header.version != kPersistVersion or
+      header.size != size - sizeof(header) or
+      header.checksum != getChecksum(data, header.size)) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid state file"));
+  }
+  return std::string(data, header.size);
+}
+
+PersistedCounters
+getPersistedCounters(
+    CounterStore const& counters, std::chrono::steady_clock::time_point now) {
+  PersistedCounters result;
+  counters.forEach([&](CounterStore::CounterId id) {
+    thrift::PersistedCounter persisted;
+    *persisted.counter_ref() = counters.getLive(id);
+    *persisted.ageMs_ref() =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - counters.getUpdateTime(id))
+            .count();
+    result.emplace(counters.getName(id), std::move(persisted));
+  });
+  return result;
+}
+
+int64_t
+getSystemMilliTime() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Random non-zero epoch of counter ids
+int64_t
+makeEpoch() {
+  int64_t epoch{0};
+  while (epoch == 0) {
+    epoch = static_cast<int64_t>(folly::Random::rand64() >> 1);
+  }
+  return epoch;
+}
+
+// Merge partial results of shards, refer to ZmqMonitor::scatterGather
+template <typename Map>
+void
+mergeResult(Map& result, Map&& partial) {
+  for (auto& kv : partial) {
+    result.emplace(kv.first, std::move(kv.second));
+  }
+}
+
+template <typename T>
+void
+mergeResult(std::vector<T>& result, std::vector<T>&& partial) {
+  result.insert(
+      result.end(),
+      std::make_move_iterator(partial.begin()),
+      std::make_move_iterator(partial.end()));
+}
+
+} // namespace
+
+/**
+ * Shard of counters with its own event loop and thread. Counters are only
+ * accessed from within shard's event loop.
+ */
+struct ZmqMonitor::Shard {
+  explicit Shard(size_t id)
+      : id(id), evl(ZmqEventLoop::kUnboundedQueueCapacity) {}
+
+  const size_t id{0};
+  ZmqEventLoop evl;
+  CounterStore counters;
+  std::thread thread;
+};
+
+template <typename Fn>
+void
+ZmqMonitor::scatterGather(
+    Fn fn,
+    folly::Function<void(std::invoke_result_t<Fn&, size_t, CounterStore&>&&)>
+        callback) {
+  using Result = std::invoke_result_t<Fn&, size_t, CounterStore&>;
+
+  if (shards_.empty()) {
+    callback(fn(0, counters_));
+    return;
+  }
+
+  // State of an in-flight request. Accessed only from monitor's event loop.
+  struct GatherState {
+    size_t numPending{0};
+    Result result;
+    folly::Function<void(Result&&)> callback;
+  };
+  auto state = std::make_shared<GatherState>();
+  state->numPending = shards_.size();
+  state->callback = std::move(callback);
+
+  // Shards process requests in order and they reply into monitor's loop in
+  // order as well. Hence replies are completed in order of requests.
+  for (auto& shardPtr : shards_) {
+    auto shard = shardPtr.get();
+    shard->evl.runInEventLoop([this, shard, fn, state]() mutable {
+      auto result = fn(shard->id, shard->counters);
+      runInEventLoop(
+          [state = std::move(state), result = std::move(result)]() mutable {
+            if (state->result.empty()) {
+              state->result = std::move(result);
+            } else {
+              mergeResult(state->result, std::move(result));
+            }
+            if (--state->numPending == 0) {
+              state->callback(std::move(state->result));
+            }
+          });
+    });
+  }
+}
+
+template <typename ThriftType>
+void
+ZmqMonitor::sendReply(ReplyEnvelope const& envelope, ThriftType const& reply) {
+  auto frames = envelope;
+  frames.emplace_back(Message::fromThriftObj(reply, serializer_).value());
+  const auto ret = monitorReceiveSock_.sendBatch(std::move(frames));
+  if (ret.hasError()) {
+    LOG(ERROR) << "Error sending reply: " << ret.error();
+  }
+}
+
+ZmqMonitor::ZmqMonitor(
+    const std::string& monitorSubmitUrl,
+    const std::string& monitorPubUrl,
+    Context& zmqContext,
+    const folly::Optional<LogSample>& logSampleToMerge,
+    const std::chrono::seconds alivenessCheckInterval,
+    const size_t maxLogEvents,
+    const std::chrono::seconds profilingStatInterval,
+    const size_t numShards,
+    const MonitorPubOptions& pubOptions,
+    const MonitorResourceOptions& resourceOptions,
+    const MonitorPersistOptions& persistOptions)
+    : ZmqEventLoop(numShards > 1 ? kUnboundedQueueCapacity : 100),
+      eventLogs_{maxLogEvents},
+      pubOptions_(pubOptions),
+      monitorSubmitUrl_(monitorSubmitUrl),
+      monitorPubUrl_(monitorPubUrl),
+      monitorReceiveSock_{zmqContext},
+      monitorPubSock_{zmqContext},
+      numShards_{std::max<size_t>(numShards, 1)},
+      epoch_{makeEpoch()},
+      startTime_{std::chrono::steady_clock::now()},
+      alivenessCheckInterval_{alivenessCheckInterval},
+      logSampleToMerge_{logSampleToMerge},
+      resourceOptions_{resourceOptions},
+      persistOptions_{persistOptions} {
+  // Start shard loops
+  if (numShards_ > 1) {
+    for (size_t i = 0; i < numShards_; ++i) {
+      auto shard = std::make_unique<Shard>(i);
+      auto evl = &shard->evl;
+      shard->thread = std::thread([i, evl]() noexcept {
+        VLOG(2) << "ZmqMonitor: Shard " << i << " starting";
+        evl->run();
+        VLOG(2) << "ZmqMonitor: Shard " << i << " stopped";
+      });
+      evl->waitUntilRunning();
+      shards_.emplace_back(std::move(shard));
+    }
+  }
+
+  // Warm up with the state of previous monitor
+  restoreState();
+
+  // Schedule periodic timer for counters aliveness check. Housekeeping timers
+  // tolerate a tenth of their interval of delay, so that they share wakeups.
+  const bool isPeriodic = true;
+  auto slackOf = [](std::chrono::milliseconds interval) {
+    return interval / 10;
+  };
+  monitorTimer_ = fbzmq::ZmqTimeout::make(
+      this, [this]() noexcept { purgeStaleCounters(); });
+  monitorTimer_->scheduleTimeout(
+      alivenessCheckInterval_, isPeriodic, slackOf(alivenessCheckInterval_));
+  updateMemStat();
+  updateCpuStat();
+  updateProcDetailStats();
+  updateThreadCpuStats();
+  profilingTimer_ = fbzmq::ZmqTimeout::make(
+      this, [this]() noexcept { updateResourceStats(); });
+  profilingTimer_->scheduleTimeout(
+      profilingStatInterval, isPeriodic, slackOf(profilingStatInterval));
+  pubTimer_ = fbzmq::ZmqTimeout::make(
+      this, [this]() noexcept { flushPendingCounters(); });
+  if (not persistOptions_.path.empty()) {
+    persistTimer_ =
+        fbzmq::ZmqTimeout::make(this, [this]() noexcept { persistState(); });
+    persistTimer_->scheduleTimeout(
+        persistOptions_.interval,
+        isPeriodic,
+        slackOf(persistOptions_.interval));
+  }
+
+  // Prepare router socket to talk to Broker/other processes
+  const int handover = 1;
+  const auto handoverRet = monitorReceiveSock_.setSockOpt(
+      ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
+  if (handoverRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_ROUTER_HANDOVER "
+               << handoverRet.error();
+  }
+
+  // bind monitor router socket
+  VLOG(2) << "ZmqMonitor: Binding to monitorSubmitUrl '" << monitorSubmitUrl_
+          << "'";
+  const auto receiveBindRet =
+      monitorReceiveSock_.bind(SocketUrl{monitorSubmitUrl_});
+  if (receiveBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorSubmitUrl_
+               << "' " << receiveBindRet.error();
+  }
+
+  // Prepare PUB socket for updating monitor
+  const int hwm = 1024;
+  const auto hwmRet = monitorPubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
+  if (hwmRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_SNDHWM " << hwmRet.error();
+  }
+
+  // bind monitor pub socket
+  // bind monitor router socket
+  VLOG(2) << "ZmqMonitor: Binding to monitorPubUrl '" << monitorPubUrl_
+          << "'";
+  const auto pubBindRet = monitorPubSock_.bind(SocketUrl{monitorPubUrl_});
+  if (pubBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorPubUrl_ << "' "
+               << pubBindRet.error();
+  }
+
+  // Keep track of subscriptions to publications
+  addSocket(
+      RawZmqSocketPtr{*monitorPubSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        monitorPubSock_.processSubscriptions();
+      });
+
+  // Attach callback on monitor socket for read events
+  addSocket(
+      RawZmqSocketPtr{*monitorReceiveSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        VLOG(4) << "ZmqMonitor: monitor request received...";
+        try {
+          processRequest();
+        } catch (std::exception const& e) {
+          LOG(ERROR) << "Error processing MonitorRequest: "
+                     << folly::exceptionStr(e);
+        }
+      });
+}
+
+ZmqMonitor::~ZmqMonitor() {
+  // Callbacks posted by shards into monitor's loop after this are never run
+  for (auto& shard : shards_) {
+    shard->evl.stop();
+    shard->thread.join();
+  }
+  persistState(true /* isStopped */);
+}
+
+void
+ZmqMonitor::updateResourceStats() {
+  runImmediatelyOrInEventLoop([&]() {
+    updateMemStat();
+    updateCpuStat();
+    updateProcDetailStats();
+    updateThreadCpuStats();
+  });
+}
+
+void
+ZmqMonitor::updateMemStat() {
+  auto rssMem = systemMetrics_.getRSSMemBytes();
+  if (rssMem.has_value()) {
+    thrift::Counter counter;
+    *counter.value_ref() = static_cast<uint64_t>(rssMem.value());
+    *counter.valueType_ref() = fbzmq::thrift::CounterValueType::GAUGE;
+    *counter.timestamp_ref() = getCurrentMilliTime();
+    setCounter(
+        "process.memory.rss", counter, std::chrono::steady_clock::now());
+  }
+}
+
+void
+ZmqMonitor::updateCpuStat() {
+  auto cpuPct = systemMetrics_.getCPUpercentage();
+  if (cpuPct.has_value()) {
+    thrift::Counter counter;
+    *counter.value_ref() = static_cast<double>(cpuPct.value());
+    *counter.valueType_ref() = fbzmq::thrift::CounterValueType::GAUGE;
+    *counter.timestamp_ref() = getCurrentMilliTime();
+    setCounter("process.cpu.pct", counter, std::chrono::steady_clock::now());
+  }
+}
+
+void
+ZmqMonitor::updateProcDetailStats() {
+  if (not resourceOptions_.processDetails) {
+    return;
+  }
+
+  auto rates = systemMetrics_.getEventRates();
+  if (rates.has_value()) {
+    setGauge("process.faults.minor.rate", rates->minorFaults);
+    setGauge("process.faults.major.rate", rates->majorFaults);
+    setGauge(
+        "process.context_switches.voluntary.rate",
+        rates->voluntaryCtxSwitches);
+    setGauge(
+        "process.context_switches.involuntary.rate",
+        rates->involuntaryCtxSwitches);
+  }
+
+  auto numFds = systemMetrics_.getNumOpenFds();
+  if (numFds.has_value()) {
+    setGauge("process.fds.open", static_cast<double>(numFds.value()));
+  }
+}
+
+void
+ZmqMonitor::updateThreadCpuStats() {
+  if (not resourceOptions_.threadCpu) {
+    return;
+  }
+
+  // libzmq names its IO threads `[<prefix>/]ZMQbg/IO/<n>`
+  const folly::StringPiece kZmqIoThreadName{"ZMQbg/IO/"};
+  auto cpuPcts = systemMetrics_.getThreadCPUpercentage();
+  if (cpuPcts.empty()) {
+    return;
+  }
+  double zmqIoCpuPct{0};
+  for (auto const& kv : cpuPcts) {
+    if (folly::StringPiece(kv.first).find(kZmqIoThreadName) !=
+        folly::StringPiece::npos) {
+      zmqIoCpuPct += kv.second;
+    }
+    setGauge("process.threads." + kv.first + ".cpu.pct", kv.second);
+  }
+  setGauge("process.cpu.zmq_io.pct", zmqIoCpuPct);
+}
+
+void
+ZmqMonitor::setGauge(std::string const& name, double value) {
+  thrift::Counter counter;
+  *counter.value_ref() = value;
+  *counter.valueType_ref() = fbzmq::thrift::CounterValueType::GAUGE;
+  *counter.timestamp_ref() = getCurrentMilliTime();
+  setCounter(name, counter, std::chrono::steady_clock::now());
+}
+
+void
+ZmqMonitor::setCounter(
+    std::string const& name,
+    thrift::Counter const& counter,
+    std::chrono::steady_clock::time_point const& ts) {
+  runOnShard(
+      getShardId(name),
+      [name, counter, ts](CounterStore& counters) {
+        counters.set(counters.intern(name), counter, ts);
+      });
+}
+
+void
+ZmqMonitor::processRequest() {
+  thrift::MonitorPub thriftPub;
+
+  // Request is preceded by the identity supplied by router socket and an
+  // optional tag of the requester. Both are sent back with the reply.
+  ReplyEnvelope envelope;
+  const auto ret = monitorReceiveSock_.recvMultipleInto(envelope);
+  if (ret.hasError()) {
+    LOG(ERROR) << "processRequest: Error receiving command: " << ret.error();
+    return;
+  }
+  if (envelope.size() < 2 or envelope.size() > 3) {
+    LOG(ERROR) << "processRequest: Unexpected number of frames "
+               << envelope.size();
+    return;
+  }
+  auto thriftReqMsg = std::move(envelope.back());
+  envelope.pop_back();
+
+  // read actual request
+  auto maybeThriftReq =
+      thriftReqMsg.readThriftObj<thrift::MonitorRequest>(serializer_);
+
+  if (maybeThriftReq.hasError()) {
+    LOG(ERROR) << "processRequest: failed reading thrift::MonitorRequest "
+               << maybeThriftReq.error();
+    return;
+  }
+
+  auto& thriftReq = maybeThriftReq.value();
+  const auto now = std::chrono::steady_clock::now();
+
+  // Always update uptime counter counter
+  const std::string kUptimeCounter{"process.uptime.seconds"};
+  setCounter(
+      kUptimeCounter,
+      [&] {
+        thrift::Counter counter;
+        *counter.value_ref() =
+            std::chrono::duration_cast<std::chrono::seconds>(now - startTime_)
+                .count();
+        *counter.valueType_ref() = thrift::CounterValueType::COUNTER;
+        *counter.timestamp_ref() =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now.time_since_epoch())
+                .count();
+        return counter;
+      }(),
+      now);
+
+  // Reply to the requester with counter values
+  auto sendValuesRep = [this, envelope](CounterMap&& counters) mutable {
+    thrift::CounterValuesResponse thriftValueRep;
+    *thriftValueRep.counters_ref() = std::move(counters);
+    sendReply(envelope, thriftValueRep);
+  };
+
+  // Split counter names by the shard they belong to
+  auto partitionNames = [this](std::vector<std::string> const& names) {
+    auto partitions =
+        std::make_shared<std::vector<std::vector<std::string>>>(numShards_);
+    for (auto const& name : names) {
+      partitions->at(getShardId(name)).emplace_back(name);
+    }
+    return partitions;
+  };
+
+  // Shared counter tables are scanned for changes whenever counters are read
+  switch (*thriftReq.cmd_ref()) {
+  case thrift::MonitorCommand::GET_COUNTER_VALUES:
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
+  case thrift::MonitorCommand::GET_COUNTER_DATA_PAGE:
+  case thrift::MonitorCommand::STREAM_COUNTER_DATA:
+  case thrift::MonitorCommand::GET_SNAPSHOT:
+    syncSharedCounters(now);
+    break;
+  default:
+    break;
+  }
+
+  switch (*thriftReq.cmd_ref()) {
+  case thrift::MonitorCommand::SET_COUNTER_VALUES:
+    setCounters(
+        std::move(*thriftReq.counterSetParams_ref()->counters_ref()), now);
+    break;
+
+  case thrift::MonitorCommand::GET_COUNTER_VALUES: {
+    auto partitions =
+        partitionNames(*thriftReq.counterGetParams_ref()->counterNames_ref());
+    scatterGather(
+        [partitions](size_t shardId, CounterStore& counters) {
+          CounterMap result;
+          for (auto const& counterName : partitions->at(shardId)) {
+            const auto id = counters.find(counterName);
+            if (counters.isLive(id)) {
+              result[counterName] = counters.getLive(id);
+            }
+          }
+          return result;
+        },
+        std::move(sendValuesRep));
+  } break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
+    scatterGather(
+        [](size_t /* shardId */, CounterStore& counters) {
+          return counters.getNames();
+        },
+        [this, envelope](std::vector<std::string>&& names) {
+          thrift::CounterNamesResponse thriftNameRep;
+          *thriftNameRep.counterNames_ref() = std::move(names);
+          sendReply(envelope, thriftNameRep);
+        });
+    break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
+    scatterGather(
+        [](size_t /* shardId */, CounterStore& counters) {
+          CounterMap result;
+          counters.forEach([&](CounterStore::CounterId id) {
+            result.emplace(counters.getName(id), counters.getLive(id));
+          });
+          return result;
+        },
+        std::move(sendValuesRep));
+    break;
+
+  case thrift::MonitorCommand::REGISTER_COUNTERS: {
+    auto partitions = partitionNames(
+        *thriftReq.counterRegisterParams_ref()->counterNames_ref());
+    scatterGather(
+        [this, partitions](size_t shardId, CounterStore& counters) {
+          std::map<std::string, int64_t> result;
+          for (auto const& name : partitions->at(shardId)) {
+            result.emplace(name, toGlobalId(shardId, counters.intern(name)));
+          }
+          return result;
+        },
+        [this, envelope](std::map<std::string, int64_t>&& ids) {
+          thrift::CounterIdsResponse thriftIdsRep;
+          *thriftIdsRep.counterIds_ref() = std::move(ids);
+          *thriftIdsRep.epoch_ref() = epoch_;
+          sendReply(envelope, thriftIdsRep);
+        });
+  } break;
+
+  case thrift::MonitorCommand::SET_COUNTER_VALUES_BY_ID: {
+    // Ids of another epoch would silently address the wrong counters
+    thrift::CounterSetByIdResponse thriftSetRep;
+    *thriftSetRep.epoch_ref() = epoch_;
+    const auto epoch = *thriftReq.counterSetByIdParams_ref()->epoch_ref();
+    if (epoch != epoch_) {
+      VLOG(2) << "Rejecting counter ids of epoch " << epoch;
+      *thriftSetRep.accepted_ref() = false;
+      *thriftSetRep.error_ref() = folly::sformat(
+          "Stale counter ids of epoch {}, monitor epoch is {}", epoch, epoch_);
+      sendReply(envelope, thriftSetRep);
+      break;
+    }
+    *thriftSetRep.accepted_ref() = true;
+    sendReply(envelope, thriftSetRep);
+
+    // Split counters by shard, names are resolved by shards for publication
+    using IdCounters =
+        std::vector<std::pair<CounterStore::CounterId, thrift::Counter>>;
+    auto partitions = std::make_shared<std::vector<IdCounters>>(numShards_);
+    for (auto const& kv :
+         *thriftReq.counterSetByIdParams_ref()->counters_ref()) {
+      if (kv.first < 0) {
+        continue;
+      }
+      partitions->at(kv.first % numShards_)
+          .emplace_back(toShardId(kv.first), kv.second);
+    }
+    scatterGather(
+        [partitions, now](size_t shardId, CounterStore& counters) {
+          CounterMap result;
+          for (auto const& idCounter : partitions->at(shardId)) {
+            if (not counters.isValid(idCounter.first)) {
+              VLOG(2) << "Ignoring unknown counter id";
+              continue;
+            }
+            counters.set(idCounter.first, idCounter.second, now);
+            result.emplace(counters.getName(idCounter.first), idCounter.second);
+          }
+          return result;
+        },
+        [this](CounterMap&& counters) {
+          // Dump new counter values to the publish socket.
+          publishCounters(std::move(counters));
+        });
+  } break;
+
+  case thrift::MonitorCommand::GET_COUNTER_DATA_PAGE:
+    sendCounterDumpPage(
+        envelope,
+        std::move(*thriftReq.counterDumpParams_ref()),
+        false /* isStream */);
+    break;
+
+  case thrift::MonitorCommand::STREAM_COUNTER_DATA:
+    sendCounterDumpPage(
+        envelope,
+        std::move(*thriftReq.counterDumpParams_ref()),
+        true /* isStream */);
+    break;
+
+  case thrift::MonitorCommand::BUMP_COUNTER: {
+    auto partitions =
+        partitionNames(*thriftReq.counterBumpParams_ref()->counterNames_ref());
+    scatterGather(
+        [partitions, now](size_t shardId, CounterStore& counters) {
+          CounterMap result;
+          for (auto const& name : partitions->at(shardId)) {
+            // New counters start from zero
+            auto counter =
+                counters.bump(counters.intern(name), now, std::time(nullptr));
+            result.emplace(name, std::move(counter));
+          }
+          return result;
+        },
+        [this](CounterMap&& counters) {
+          // Dump new counter values to the publish socket.
+          publishCounters(std::move(counters));
+        });
+  } break;
+
+  case thrift::MonitorCommand::BUMP_COUNTER_VALUES: {
+    using Increments = std::vector<std::pair<std::string, int64_t>>;
+    auto partitions = std::make_shared<std::vector<Increments>>(numShards_);
+    for (auto const& kv :
+         *thriftReq.counterBumpByParams_ref()->increments_ref()) {
+      partitions->at(getShardId(kv.first)).emplace_back(kv.first, kv.second);
+    }
+    scatterGather(
+        [partitions, now](size_t shardId, CounterStore& counters) {
+          CounterMap result;
+          for (auto const& increment : partitions->at(shardId)) {
+            auto counter = counters.bump(
+                counters.intern(increment.first),
+                now,
+                std::time(nullptr),
+                increment.second);
+            result.emplace(increment.first, std::move(counter));
+          }
+          return result;
+        },
+        [this](CounterMap&& counters) {
+          // Dump new counter values to the publish socket.
+          publishCounters(std::move(counters));
+        });
+  } break;
+
+  case thrift::MonitorCommand::ATTACH_SHARED_COUNTERS: {
+    auto const& path = *thriftReq.sharedCountersParams_ref()->path_ref();
+    thrift::SharedCountersResponse thriftSharedRep;
+    auto table = SharedCounterTable::open(path);
+    if (table.hasValue()) {
+      LOG(INFO) << "Attached shared counters " << path;
+      // Replaces an earlier table at the same path
+      sharedCounterTables_[path] = std::move(table.value());
+      syncSharedCounters(now);
+      *thriftSharedRep.attached_ref() = true;
+    } else {
+      LOG(ERROR) << "Error attaching shared counters " << path << ": "
+                 << table.error();
+      *thriftSharedRep.attached_ref() = false;
+      *thriftSharedRep.error_ref() = table.error().errString;
+    }
+    sendReply(envelope, thriftSharedRep);
+  } break;
+
+  case thrift::MonitorCommand::DETACH_SHARED_COUNTERS: {
+    auto it = sharedCounterTables_.find(
+        *thriftReq.sharedCountersParams_ref()->path_ref());
+    if (it != sharedCounterTables_.end()) {
+      // Pick up last updates, counters stay until they expire
+      syncSharedCounters(now);
+      LOG(INFO) << "Detached shared counters " << it->first;
+      sharedCounterTables_.erase(it);
+    }
+  } break;
+
+  case thrift::MonitorCommand::LOG_EVENT:
+    // simply forward, do not store logs
+    *thriftPub.pubType_ref() = thrift::PubType::EVENT_LOG_PUB;
+    *thriftPub.eventLogPub_ref() = std::move(*thriftReq.eventLog_ref());
+    if (logSampleToMerge_) {
+      for (auto& sample : *thriftPub.eventLogPub_ref()->samples_ref()) {
+        try {
+          // throws if this sample doesn't have a timestamp
+          // in that case, lets just pass this sample along without appending
+          auto ls = LogSample::fromJson(sample);
+          ls.mergeSample(*logSampleToMerge_);
+          sample = ls.toJson();
+        } catch (...) {
+        }
+      }
+      // binary samples are merged in place without any JSON conversion
+      for (auto& sample : *thriftPub.eventLogPub_ref()->binarySamples_ref()) {
+        logSampleToMerge_->mergeInto(sample);
+      }
+    }
+    // save the event log in local queue
+    eventLogs_.add(
+        *thriftPub.eventLogPub_ref(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    sendEventLogPub(std::move(thriftPub));
+    break;
+
+  case thrift::MonitorCommand::GET_EVENT_LOGS: {
+    thrift::EventLogsResponse thriftEventLogsRep;
+    *thriftEventLogsRep.eventLogs_ref() = eventLogs_.getAll();
+    sendReply(envelope, thriftEventLogsRep);
+  } break;
+
+  case thrift::MonitorCommand::QUERY_EVENT_LOGS:
+    sendReply(
+        envelope, eventLogs_.query(*thriftReq.eventLogQueryParams_ref()));
+    break;
+
+  case thrift::MonitorCommand::GET_SNAPSHOT:
+    sendSnapshot(
+        envelope, std::move(*thriftReq.snapshotParams_ref()->prefix_ref()));
+    break;
+
+  default:
+    LOG(ERROR) << "Unknown monitor command received";
+  }
+
+  VLOG(4) << "processMonitorRequest has finished";
+}
+
+void
+ZmqMonitor::setCounters(
+    CounterMap&& counters, std::chrono::steady_clock::time_point now) {
+  std::vector<CounterMap> partitions(numShards_);
+  for (auto const& kv : counters) {
+    partitions[getShardId(kv.first)].emplace(kv.first, kv.second);
+  }
+  for (size_t i = 0; i < numShards_; ++i) {
+    if (partitions[i].empty()) {
+      continue;
+    }
+    runOnShard(
+        i,
+        [partition = std::move(partitions[i]),
+         now](CounterStore& shardCounters) {
+          for (auto const& kv : partition) {
+            shardCounters.set(shardCounters.intern(kv.first), kv.second, now);
+          }
+        });
+  }
+  // Dump new monitor values to the publish socket.
+  publishCounters(std::move(counters));
+}
+
+void
+ZmqMonitor::syncSharedCounters(std::chrono::steady_clock::time_point now) {
+  if (sharedCounterTables_.empty()) {
+    return;
+  }
+
+  CounterMap counters;
+  for (auto& kv : sharedCounterTables_) {
+    kv.second->forEachChanged(
+        [&counters](SharedCounterTable::SlotValue const& value) {
+          counters[value.name.str()] = value.counter;
+        });
+  }
+  if (not counters.empty()) {
+    setCounters(std::move(counters), now);
+  }
+}
+
+void
+ZmqMonitor::sendCounterDumpPage(
+    ReplyEnvelope envelope, thrift::CounterDumpParams params, bool isStream) {
+  // Regex is compiled once for all the pages of a stream
+  std::shared_ptr<std::regex const> regex;
+  if (not params.regex_ref()->empty()) {
+    try {
+      regex = std::make_shared<std::regex const>(*params.regex_ref());
+    } catch (std::regex_error const& e) {
+      LOG(ERROR) << "Invalid counter regex '" << *params.regex_ref()
+                 << "': " << e.what();
+      // Reply with an empty last page
+      thrift::CounterDumpPage page;
+      *page.dumpTime_ref() =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::system_clock::now().time_since_epoch())
+              .count();
+      sendReply(envelope, page);
+      return;
+    }
+  }
+  sendCounterDumpPage(
+      std::move(envelope), std::move(params), std::move(regex), isStream);
+}
+
+void
+ZmqMonitor::sendCounterDumpPage(
+    ReplyEnvelope envelope,
+    thrift::CounterDumpParams params,
+    std::shared_ptr<std::regex const> regex,
+    bool isStream) {
+  const auto now = std::chrono::steady_clock::now();
+  const int64_t dumpTime =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  // Counters keep their last update time in steady clock
+  auto changedSince = std::chrono::steady_clock::time_point::min();
+  if (*params.changedSince_ref() > 0) {
+    const auto age =
+        std::max<int64_t>(0, dumpTime - *params.changedSince_ref());
+    changedSince = now - std::chrono::microseconds(age);
+  }
+  const size_t pageSize = std::max<int32_t>(0, *params.pageSize_ref());
+  auto prefix = *params.prefix_ref();
+  auto cursor = *params.cursor_ref();
+
+  scatterGather(
+      [prefix = std::move(prefix),
+       cursor = std::move(cursor),
+       regex,
+       changedSince,
+       pageSize](size_t /* shardId */, CounterStore& counters) {
+        // Counters are visited in order of names, starting from the cursor
+        // (or the prefix, whichever comes later), until one more than the
+        // page size is found to tell if more pages follow
+        CounterMap result;
+        counters.forEachByName(
+            std::max(folly::StringPiece(cursor), folly::StringPiece(prefix)),
+            [&](CounterStore::CounterId id) {
+              auto const& name = counters.getName(id);
+              if (name.compare(0, prefix.size(), prefix) != 0) {
+                // Past the names with prefix
+                return false;
+              }
+              if ((not cursor.empty() && name == cursor) ||
+                  counters.getUpdateTime(id) < changedSince ||
+                  (regex && not std::regex_search(name, *regex))) {
+                return true;
+              }
+              result.emplace(name, counters.getLive(id));
+              return pageSize == 0 || result.size() <= pageSize;
+            });
+        return result;
+      },
+      [this,
+       envelope,
+       params = std::move(params),
+       regex,
+       pageSize,
+       dumpTime,
+       isStream](CounterMap&& counters) mutable {
+        thrift::CounterDumpPage page;
+        *page.dumpTime_ref() = dumpTime;
+        if (pageSize && counters.size() > pageSize) {
+          // Keep the first `pageSize` counters ordered by name
+          std::vector<std::string> names;
+          names.reserve(counters.size());
+          for (auto const& kv : counters) {
+            names.emplace_back(kv.first);
+          }
+          std::nth_element(
+              names.begin(), names.begin() + pageSize - 1, names.end());
+          *page.nextCursor_ref() = names[pageSize - 1];
+          for (auto& kv : counters) {
+            if (kv.first <= *page.nextCursor_ref()) {
+              page.counters_ref()->emplace(kv.first, std::move(kv.second));
+            }
+          }
+        } else {
+          *page.counters_ref() = std::move(counters);
+        }
+        sendReply(envelope, page);
+
+        if (not isStream || page.nextCursor_ref()->empty()) {
+          return;
+        }
+        // Next page is dumped in a later loop iteration so that other
+        // requests are served in between
+        *params.cursor_ref() = std::move(*page.nextCursor_ref());
+        scheduleTimeout(
+            std::chrono::milliseconds(0),
+            [this,
+             envelope = std::move(envelope),
+             params = std::move(params),
+             regex = std::move(regex)]() mutable {
+              sendCounterDumpPage(
+                  std::move(envelope),
+                  std::move(params),
+                  std::move(regex),
+                  true /* isStream */);
+            });
+      });
+}
+
+void
+ZmqMonitor::sendSnapshot(ReplyEnvelope const& envelope, std::string prefix) {
+  // Publications up to this one have been applied to the counter stores, as
+  // counters are published only once they are set
+  const int64_t seqNum = pubSeqNum_;
+
+  if (pubOptions_.lastValueCache) {
+    thrift::MonitorSnapshot snapshot;
+    *snapshot.seqNum_ref() = seqNum;
+    for (auto const& kv : lastPubCounters_) {
+      if (kv.first.compare(0, prefix.size(), prefix) == 0) {
+        snapshot.counters_ref()->emplace(kv.first, kv.second.first);
+      }
+    }
+    sendReply(envelope, snapshot);
+    return;
+  }
+
+  scatterGather(
+      [prefix = std::move(prefix)](
+          size_t /* shardId */, CounterStore& counters) {
+        CounterMap result;
+        counters.forEach([&](CounterStore::CounterId id) {
+          auto const& name = counters.getName(id);
+          if (name.compare(0, prefix.size(), prefix) == 0) {
+            result.emplace(name, counters.getLive(id));
+          }
+        });
+        return result;
+      },
+      [this, envelope, seqNum](CounterMap&& counters) {
+        thrift::MonitorSnapshot snapshot;
+        *snapshot.seqNum_ref() = seqNum;
+        *snapshot.counters_ref() = std::move(counters);
+        sendReply(envelope, snapshot);
+      });
+}
+
+void
+ZmqMonitor::restoreState() {
+  if (persistOptions_.path.empty()) {
+    return;
+  }
+  auto data = readStateFile(persistOptions_.path);
+  if (data.hasError()) {
+    if (data.error().errNum != ENOENT) {
+      LOG(ERROR) << "ZmqMonitor: Error reading state from '"
+                 << persistOptions_.path << "' " << data.error();
+    }
+    return;
+  }
+  thrift::MonitorPersistedState state;
+  try {
+    serializer_.deserialize(data.value(), state);
+  } catch (std::exception const& e) {
+    LOG(ERROR) << "ZmqMonitor: Error decoding state from '"
+               << persistOptions_.path << "' " << folly::exceptionStr(e);
+    return;
+  }
+
+  // Counters age over downtime as well
+  const auto now = std::chrono::steady_clock::now();
+  const auto downtime = std::chrono::milliseconds(
+      std::max<int64_t>(0, getSystemMilliTime() - *state.persistTime_ref()));
+  // Oldest first, counter stores keep counters ordered by update time
+  std::vector<PersistedCounters::value_type*> persisted;
+  persisted.reserve(state.counters_ref()->size());
+  for (auto& kv : *state.counters_ref()) {
+    persisted.emplace_back(&kv);
+  }
+  std::sort(persisted.begin(), persisted.end(), [](auto lhs, auto rhs) {
+    return *lhs->second.ageMs_ref() > *rhs->second.ageMs_ref();
+  });
+  for (auto kv : persisted) {
+    const auto updateTime = now - downtime -
+        std::chrono::milliseconds(
+            std::max<int64_t>(0, *kv->second.ageMs_ref()));
+    setCounter(kv->first, *kv->second.counter_ref(), updateTime);
+    if (pubOptions_.lastValueCache) {
+      lastPubCounters_[kv->first] =
+          std::make_pair(*kv->second.counter_ref(), updateTime);
+    }
+  }
+
+  eventLogs_.setNextSeqNum(*state.firstEventLogSeqNum_ref());
+  for (auto const& persisted : *state.eventLogs_ref()) {
+    thrift::EventLog eventLog;
+    try {
+      serializer_.deserialize(*persisted.eventLog_ref(), eventLog);
+    } catch (std::exception const& e) {
+      LOG(ERROR) << "ZmqMonitor: Error decoding event log "
+                 << folly::exceptionStr(e);
+    }
+    // Added regardless to keep sequence numbers
+    eventLogs_.add(eventLog, *persisted.timestamp_ref());
+  }
+
+  LOG(INFO) << "ZmqMonitor: Restored " << state.counters_ref()->size()
+            << " counters and " << state.eventLogs_ref()->size()
+            << " event logs from '" << persistOptions_.path << "'";
+}
+
+void
+ZmqMonitor::persistState(bool isStopped) {
+  if (persistOptions_.path.empty()) {
+    return;
+  }
+
+  auto write = [this](PersistedCounters&& counters) {
+    thrift::MonitorPersistedState state;
+    *state.counters_ref() = std::move(counters);
+    *state.firstEventLogSeqNum_ref() = eventLogs_.getFirstSeqNum();
+    eventLogs_.forEachSerialized(
+        [&state](int64_t timestamp, std::string const& data) {
+          thrift::PersistedEventLog persisted;
+          *persisted.eventLog_ref() = data;
+          *persisted.timestamp_ref() = timestamp;
+          state.eventLogs_ref()->emplace_back(std::move(persisted));
+        });
+    *state.persistTime_ref() = getSystemMilliTime();
+
+    std::string data;
+    serializer_.serialize(state, &data);
+    const auto ret = writeStateFile(persistOptions_.path, data);
+    if (ret.hasError()) {
+      LOG(ERROR) << "ZmqMonitor: Error persisting state to '"
+                 << persistOptions_.path << "' " << ret.error();
+      return;
+    }
+    VLOG(2) << "ZmqMonitor: Persisted " << state.counters_ref()->size()
+            << " counters and " << state.eventLogs_ref()->size()
+            << " event logs, " << data.size() << " bytes";
+  };
+
+  const auto now = std::chrono::steady_clock::now();
+  if (shards_.empty()) {
+    write(getPersistedCounters(counters_, now));
+    return;
+  }
+  if (isStopped) {
+    PersistedCounters counters;
+    for (auto const& shard : shards_) {
+      auto shardCounters = getPersistedCounters(shard->counters, now);
+      counters.insert(
+          std::make_move_iterator(shardCounters.begin()),
+          std::make_move_iterator(shardCounters.end()));
+    }
+    write(std::move(counters));
+    return;
+  }
+  scatterGather(
+      [now](size_t /* shardId */, CounterStore& counters) {
+        return getPersistedCounters(counters, now);
+      },
+      std::move(write));
+}
+
+void
+ZmqMonitor::purgeStaleCounters() {
+  // Scan through all counters to find out those have not been updated for
+  // longer than alivenessCheckInterval
+  auto const& current = std::chrono::steady_clock::now();
+  const auto alivenessCheckInterval = alivenessCheckInterval_;
+
+  // Drop shared counter tables whose client went away without detaching
+  syncSharedCounters(current);
+  for (auto it = sharedCounterTables_.begin();
+       it != sharedCounterTables_.end();) {
+    if (it->second->isRemoved()) {
+      LOG(INFO) << "Detached removed shared counters " << it->first;
+      it = sharedCounterTables_.erase(it);
+      continue;
+    }
+    ++it;
+  }
+
+  // Only counters which are due are touched. Last published values are
+  // updated along with counters, hence expire along with them.
+  const bool hasLastPubCounters =
+      pubOptions_.changedOnly or pubOptions_.lastValueCache;
+  for (size_t i = 0; i < numShards_; ++i) {
+    runOnShard(
+        i,
+        [this, current, alivenessCheckInterval, hasLastPubCounters](
+            CounterStore& counters) {
+          std::vector<std::string> expired;
+          counters.purge(
+              current - alivenessCheckInterval,
+              [&counters, &expired](CounterStore::CounterId id) {
+                expired.emplace_back(counters.getName(id));
+              });
+          if (expired.empty()) {
+            return;
+          }
+          logExpiredCounters(expired);
+          if (hasLastPubCounters) {
+            runImmediatelyOrInEventLoop(
+                [this, expired = std::move(expired)]() {
+                  for (auto const& name : expired) {
+                    lastPubCounters_.erase(name);
+                  }
+                });
+          }
+        });
+  }
+}
+
+void
+ZmqMonitor::publishCounters(CounterMap&& counters) {
+  if (pubOptions_.coalesceInterval.count() <= 0) {
+    sendCounterPub(std::move(counters));
+    return;
+  }
+
+  for (auto& kv : counters) {
+    pendingPubCounters_[kv.first] = std::move(kv.second);
+  }
+  if (not pendingPubCounters_.empty() && not pubTimer_->isScheduled()) {
+    pubTimer_->scheduleTimeout(pubOptions_.coalesceInterval);
+  }
+}
+
+void
+ZmqMonitor::flushPendingCounters() {
+  CounterMap counters;
+  counters.swap(pendingPubCounters_);
+  sendCounterPub(std::move(counters));
+}
+
+void
+ZmqMonitor::sendCounterPub(CounterMap&& counters) {
+  if (pubOptions_.changedOnly or pubOptions_.lastValueCache) {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = counters.begin(); it != counters.end();) {
+      auto lastIt = lastPubCounters_.find(it->first);
+      if (pubOptions_.changedOnly && lastIt != lastPubCounters_.end() &&
+          *lastIt->second.first.value_ref() == *it->second.value_ref() &&
+          *lastIt->second.first.valueType_ref() ==
+              *it->second.valueType_ref()) {
+        lastIt->second.second = now;
+        it = counters.erase(it);
+        continue;
+      }
+      lastPubCounters_[it->first] = std::make_pair(it->second, now);
+      ++it;
+    }
+    if (counters.empty()) {
+      return;
+    }
+  }
+
+  // Publications are built only if anyone subscribed to them. Skipped ones
+  // still take up a sequence number, as if they were filtered by socket.
+  if (not pubOptions_.topicFrames) {
+    const auto seqNum = ++pubSeqNum_;
+    monitorPubSock_.publish([&]() {
+      thrift::MonitorPub thriftPub;
+      *thriftPub.pubType_ref() = thrift::PubType::COUNTER_PUB;
+      *thriftPub.counterPub_ref()->counters_ref() = std::move(counters);
+      *thriftPub.seqNum_ref() = seqNum;
+      return Message::fromThriftObj(thriftPub, serializer_);
+    });
+    return;
+  }
+
+  // One publication per topic
+  std::unordered_map<std::string, CounterMap> pubs;
+  for (auto& kv : counters) {
+    pubs[getCounterTopic(kv.first)].emplace(kv.first, std::move(kv.second));
+  }
+  for (auto& kv : pubs) {
+    const auto seqNum = ++pubSeqNum_;
+    monitorPubSock_.publish(kv.first, [&]() {
+      thrift::MonitorPub thriftPub;
+      *thriftPub.pubType_ref() = thrift::PubType::COUNTER_PUB;
+      *thriftPub.counterPub_ref()->counters_ref() = std::move(kv.second);
+      *thriftPub.seqNum_ref() = seqNum;
+      return Message::fromThriftObj(thriftPub, serializer_);
+    });
+  }
+}
+
+void
+ZmqMonitor::sendEventLogPub(thrift::MonitorPub thriftPub) {
+  *thriftPub.seqNum_ref() = ++pubSeqNum_;
+  auto build = [&]() { return Message::fromThriftObj(thriftPub, serializer_); };
+  if (not pubOptions_.topicFrames) {
+    monitorPubSock_.publish(build);
+    return;
+  }
+  monitorPubSock_.publish(*thriftPub.eventLogPub_ref()->category_ref(), build);
+}
+
+std::string
+ZmqMonitor::getCounterTopic(std::string const& name) const {
+  return name.substr(0, name.find(pubOptions_.topicDelimiter));
+}
+
+size_t
+ZmqMonitor::getShardId(std::string const& name) const {
+  if (numShards_ == 1) {
+    return 0;
+  }
+  return std::hash<std::string>()(name) % numShards_;
+}
+
+int64_t
+ZmqMonitor::toGlobalId(size_t shardId, CounterStore::CounterId id) const {
+  return static_cast<int64_t>(id) * numShards_ + shardId;
+}
+
+CounterStore::CounterId
+ZmqMonitor::toShardId(int64_t globalId) const {
+  const auto id = globalId / numShards_;
+  return id < CounterStore::kInvalidId ? id : CounterStore::kInvalidId;
+}
+
+void
+ZmqMonitor::runOnShard(
+    size_t shardId, folly::Function<void(CounterStore&)> fn) {
+  if (shards_.empty()) {
+    fn(counters_);
+    return;
+  }
+
+  auto shard = shards_.at(shardId).get();
+  shard->evl.runInEventLoop(
+      [shard, fn = std::move(fn)]() mutable { fn(shard->counters); });
+}
+
+} // namespace fbzmq
@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <memory>
+#include <regex>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 
 #include <boost/serialization/strong_typedef.hpp>
@@ -14,11 +18,15 @@
 #include <fbzmq/async/ZmqTimeout.h>
 #include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
 #include <fbzmq/service/logging/LogSample.h>
+#include <fbzmq/zmq/Publisher.h>
 #include <fbzmq/zmq/Zmq.h>
 #include <folly/Optional.h>
 #include <folly/gen/Base.h>
 #include <thrift/lib/cpp2/Thrift.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
+#include "CounterStore.h"
+#include "EventLogStore.h"
+#include "SharedCounterTable.h"
 #include "SystemMetrics.h"
 
 namespace fbzmq {
@@ -34,7 +42,89 @@ using CounterTimestampMap = std::unordered_map<
 const std::chrono::seconds kAlivenessCheckInterval{180};
 const std::chrono::seconds kProfilingStatInterval{5};
 const size_t kMaxLogEvents{100};
+const size_t kNumMonitorShards{1};
 
+/**
+ * Options for publications on monitor's PUB socket. Defaults publish every
+ * update right away as a single-frame `thrift::MonitorPub`.
+ */
+struct MonitorPubOptions {
+  // Counter updates are accumulated over this interval and published
+  // together (latest value of a counter wins). Zero disables coalescing.
+  std::chrono::milliseconds coalesceInterval{0};
+
+  // Publish a counter only if its value (or type) changed since its last
+  // publication
+  bool changedOnly{false};
+
+  // Prefix every publication with a topic frame so that subscribers can use
+  // ZMQ_SUBSCRIBE filtering. Topic of a counter is its name up to the first
+  // `topicDelimiter` (or the whole name) and counters are grouped into one
+  // publication per topic. Topic of an event log is its category.
+  bool topicFrames{false};
+  char topicDelimiter{'.'};
+
+  // Keep last published value of every counter, so that snapshots
+  // (GET_SNAPSHOT) are served right away in monitor's loop instead of being
+  // gathered from counter shards. Snapshots then cover published counters
+  // only, i.e. not the ones of monitor itself.
+  bool lastValueCache{false};
+};
+
+/**
+ * Options for resource usage counters of the monitor process, sampled every
+ * `profilingStatInterval`. RSS memory and CPU% are always reported.
+ */
+struct MonitorResourceOptions {
+  // Report rates (per second) of page faults and context switches, under
+  // `process.faults.*` and `process.context_switches.*`, and the number of
+  // open file descriptors as `process.fds.open`
+  bool processDetails{false};
+
+  // Report CPU% of threads as `process.threads.<thread name>.cpu.pct` and of
+  // libzmq IO threads together as `process.cpu.zmq_io.pct`. Name threads
+  // (e.g. those running a ZmqEventLoop) to tell them apart.
+  bool threadCpu{false};
+};
+
+/**
+ * Options for persisting counters and event logs of the monitor into a file,
+ * so that a restarted monitor comes up with the state of its predecessor
+ * instead of an empty one. Disabled unless `path` is set.
+ *
+ * State is written in compact thrift encoding into a memory mapped file next
+ * to `path` which then replaces it, hence `path` always holds a complete
+ * state. Restored counters keep their age, i.e. expire as they would have
+ * had monitor not restarted, unless clients refresh them.
+ */
+struct MonitorPersistOptions {
+  std::string path;
+
+  // Interval of persisting state. State is persisted on destruction as well.
+  std::chrono::seconds interval{60};
+};
+
+/**
+ * ZmqMonitor collects counters and event logs reported by processes over its
+ * ROUTER socket and publishes updates over its PUB socket.
+ *
+ * By default all requests are handled serially in monitor's own event loop.
+ * With `numShards > 1` counters are partitioned by hash of their name across
+ * `numShards` worker loops, each running in its own thread. Monitor loop
+ * then only de-serializes and dispatches requests, updates are applied by
+ * shards in parallel and get/dump requests are scatter-gathered across all of
+ * them without blocking updates. Replies of scatter-gathered requests keep
+ * the order of requests, but replies of requests served by monitor loop
+ * alone (e.g. event logs, cached snapshots and id based updates) may come
+ * back ahead of earlier gathered ones. Clients pipelining requests must
+ * match replies by an envelope of their own (e.g. request id, as
+ * `ZmqMonitorAsyncClient` does). Callback queues are unbounded in sharded
+ * mode so that monitor and shard loops never block on each other.
+ *
+ * Co-located clients can also write counters into a shared memory table
+ * (refer to `ZmqMonitorClient::attachSharedCounters`) which monitor scans for
+ * changes whenever counters are read, and on every aliveness check.
+ */
 class ZmqMonitor final : public ZmqEventLoop {
  public:
   ZmqMonitor(
@@ -45,295 +135,143 @@ class ZmqMonitor final : public ZmqEventLoop {
       const std::chrono::seconds alivenessCheckInterval =
           kAlivenessCheckInterval,
       const size_t maxLogEvents = kMaxLogEvents,
-      const std::chrono::seconds profilingStatInterval = kProfilingStatInterval)
-      : monitorSubmitUrl_(monitorSubmitUrl),
-        monitorPubUrl_(monitorPubUrl),
-        monitorReceiveSock_{zmqContext},
-        monitorPubSock_{zmqContext},
-        startTime_{std::chrono::steady_clock::now()},
-        alivenessCheckInterval_{alivenessCheckInterval},
-        maxLogEvents_{maxLogEvents},
-        logSampleToMerge_{logSampleToMerge} {
-    // Schedule periodic timer for counters aliveness check
-    const bool isPeriodic = true;
-    monitorTimer_ = fbzmq::ZmqTimeout::make(
-        this, [this]() noexcept { purgeStaleCounters(); });
-    monitorTimer_->scheduleTimeout(alivenessCheckInterval_, isPeriodic);
-    updateMemStat();
-    updateCpuStat();
-    profilingTimer_ = fbzmq::ZmqTimeout::make(
-        this, [this]() noexcept { updateResourceStats(); });
-    profilingTimer_->scheduleTimeout(profilingStatInterval, isPeriodic);
-
-    // Prepare router socket to talk to Broker/other processes
-    const int handover = 1;
-    const auto handoverRet = monitorReceiveSock_.setSockOpt(
-        ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
-    if (handoverRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_ROUTER_HANDOVER "
-                 << handoverRet.error();
-    }
-
-    // bind monitor router socket
-    VLOG(2) << "ZmqMonitor: Binding to monitorSubmitUrl '" << monitorSubmitUrl_
-            << "'";
-    const auto receiveBindRet =
-        monitorReceiveSock_.bind(SocketUrl{monitorSubmitUrl_});
-    if (receiveBindRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorSubmitUrl_
-                 << "' " << receiveBindRet.error();
-    }
-
-    // Prepare PUB socket for updating monitor
-    const int hwm = 1024;
-    const auto hwmRet =
-        monitorPubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
-    if (hwmRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Could not set ZMQ_SNDHWM " << hwmRet.error();
-    }
-
-    // bind monitor pub socket
-    // bind monitor router socket
-    VLOG(2) << "ZmqMonitor: Binding to monitorPubUrl '" << monitorPubUrl_
-            << "'";
-    const auto pubBindRet = monitorPubSock_.bind(SocketUrl{monitorPubUrl_});
-    if (pubBindRet.hasError()) {
-      LOG(FATAL) << "ZmqMonitor: Error binding to '" << monitorPubUrl_ << "' "
-                 << pubBindRet.error();
-    }
-
-    // Attach callback on monitor socket for read events
-    addSocket(
-        RawZmqSocketPtr{*monitorReceiveSock_},
-        ZMQ_POLLIN,
-        [this](int /* revents */) noexcept {
-          VLOG(4) << "ZmqMonitor: monitor request received...";
-          try {
-            processRequest();
-          } catch (std::exception const& e) {
-            LOG(ERROR) << "Error processing MonitorRequest: "
-                       << folly::exceptionStr(e);
-          }
-        });
+      const std::chrono::seconds profilingStatInterval = kProfilingStatInterval,
+      const size_t numShards = kNumMonitorShards,
+      const MonitorPubOptions& pubOptions = MonitorPubOptions(),
+      const MonitorResourceOptions& resourceOptions = MonitorResourceOptions(),
+      const MonitorPersistOptions& persistOptions = MonitorPersistOptions());
+
+  ~ZmqMonitor() override;
+
+  /**
+   * Number of counter shards
+   */
+  size_t
+  getNumShards() const {
+    return numShards_;
+  }
+
+  /**
+   * Epoch of counter ids handed out by REGISTER_COUNTERS. Random and
+   * non-zero, picked anew by every instance as ids aren't preserved across
+   * restarts (or restore of persisted state).
+   */
+  int64_t
+  getEpoch() const {
+    return epoch_;
   }
 
  private:
   ZmqMonitor(ZmqMonitor const&) = delete;
   ZmqMonitor& operator=(ZmqMonitor const&) = delete;
-  std::list<thrift::EventLog> eventLogs_;
+
+  /**
+   * Worker event loop owning a partition of counters. Defined in .cpp
+   */
+  struct Shard;
 
   // update stats from within ZmqMonitor
-  void
-  updateResourceStats() {
-    runImmediatelyOrInEventLoop([&]() {
-      updateMemStat();
-      updateCpuStat();
-    });
-  }
+  void updateResourceStats();
 
   // update memory stat using getrusage
-  void
-  updateMemStat() {
-    std::string key{"process.memory.rss"};
-    auto rssMem = systemMetrics_.getRSSMemBytes();
-    if (rssMem.has_value()) {
-      *counters_[key].first.value_ref() = static_cast<uint64_t>(rssMem.value());
-      *counters_[key].first.valueType_ref() =
-          fbzmq::thrift::CounterValueType::GAUGE;
-      *counters_[key].first.timestamp_ref() = getCurrentMilliTime();
-      counters_[key].second = std::chrono::steady_clock::now();
-    }
-  }
+  void updateMemStat();
 
   // update CPU stat using getrusage
-  void
-  updateCpuStat() {
-    std::string key{"process.cpu.pct"};
-    auto cpuPct = systemMetrics_.getCPUpercentage();
-    if (cpuPct.has_value()) {
-      *counters_[key].first.value_ref() = static_cast<double>(cpuPct.value());
-      *counters_[key].first.valueType_ref() =
-          fbzmq::thrift::CounterValueType::GAUGE;
-      *counters_[key].first.timestamp_ref() = getCurrentMilliTime();
-      counters_[key].second = std::chrono::steady_clock::now();
-    }
-  }
+  void updateCpuStat();
+
+  // update faults, context switches and open fds, if enabled
+  void updateProcDetailStats();
+
+  // update CPU stat of threads, if enabled
+  void updateThreadCpuStats();
+
+  // set value of a GAUGE counter owned by ZmqMonitor itself
+  void setGauge(std::string const& name, double value);
+
+  // set value of a counter owned by ZmqMonitor itself
+  void setCounter(
+      std::string const& name,
+      thrift::Counter const& counter,
+      std::chrono::steady_clock::time_point const& ts);
+
+  // Set counters (of any shard) and publish them
+  void setCounters(
+      CounterMap&& counters, std::chrono::steady_clock::time_point now);
+
+  // Set counters which changed in shared counter tables since last sync
+  void syncSharedCounters(std::chrono::steady_clock::time_point now);
+
+  // Publish updated counters, right away or after coalescing interval
+  void publishCounters(CounterMap&& counters);
+
+  // Publish pending coalesced counters
+  void flushPendingCounters();
+
+  // Send counter publication(s) on PUB socket
+  void sendCounterPub(CounterMap&& counters);
+
+  // Send event log publication on PUB socket
+  void sendEventLogPub(thrift::MonitorPub thriftPub);
+
+
+  // Topic of a counter for topic frames
+  std::string getCounterTopic(std::string const& name) const;
+
+  // Frames preceding a request (requester identity and optional tag), sent
+  // back as-is ahead of the reply
+  using ReplyEnvelope = std::vector<Message>;
 
   // process a monitor request pending oni monitorReceiveSock_
-  void
-  processRequest() {
-    thrift::CounterValuesResponse thriftValueRep;
-    thrift::CounterNamesResponse thriftNameRep;
-    thrift::MonitorPub thriftPub;
-
-    Message requestIdMsg, thriftReqMsg;
-    const auto ret =
-        monitorReceiveSock_.recvMultiple(requestIdMsg, thriftReqMsg);
-    if (ret.hasError()) {
-      LOG(ERROR) << "processRequest: Error receiving command: " << ret.error();
-      return;
-    }
-
-    // read the request id supplied by router socket
-    const auto requestId = requestIdMsg.read<std::string>().value();
-
-    // read actual request
-    const auto maybeThriftReq =
-        thriftReqMsg.readThriftObj<thrift::MonitorRequest>(serializer_);
-
-    if (maybeThriftReq.hasError()) {
-      LOG(ERROR) << "processRequest: failed reading thrift::MonitorRequest "
-                 << maybeThriftReq.error();
-      return;
-    }
-
-    const auto thriftReq = maybeThriftReq.value();
-    const auto now = std::chrono::steady_clock::now();
-
-    // Always update uptime counter counter
-    const std::string kUptimeCounter{"process.uptime.seconds"};
-    counters_[kUptimeCounter] = std::make_pair(
-        [&] {
-          thrift::Counter counter;
-          *counter.value_ref() =
-              std::chrono::duration_cast<std::chrono::seconds>(now - startTime_)
-                  .count();
-          *counter.valueType_ref() = thrift::CounterValueType::COUNTER;
-          *counter.timestamp_ref() =
-              std::chrono::duration_cast<std::chrono::microseconds>(
-                  now.time_since_epoch())
-                  .count();
-          return counter;
-        }(),
-        now);
-
-    switch (*thriftReq.cmd_ref()) {
-    case thrift::MonitorCommand::SET_COUNTER_VALUES: {
-      for (auto const& kv : *thriftReq.counterSetParams_ref()->counters_ref()) {
-        counters_[kv.first].first = kv.second;
-        counters_[kv.first].second = now;
-      }
-      // Dump new monitor values to the publish socket.
-      *thriftPub.pubType_ref() = thrift::PubType::COUNTER_PUB;
-      *thriftPub.counterPub_ref()->counters_ref() =
-          *thriftReq.counterSetParams_ref()->counters_ref();
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-    } break;
-
-    case thrift::MonitorCommand::GET_COUNTER_VALUES:
-      for (auto const& counterName :
-           *thriftReq.counterGetParams_ref()->counterNames_ref()) {
-        auto it = counters_.find(counterName);
-        if (it != counters_.end()) {
-          thriftValueRep.counters_ref()[counterName] = it->second.first;
-        }
-      }
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftValueRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES:
-      *thriftNameRep.counterNames_ref() = folly::gen::from(counters_) |
-          folly::gen::get<0>() | folly::gen::as<std::vector<std::string>>();
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftNameRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA:
-      for (auto const& kv : counters_) {
-        thriftValueRep.counters_ref()->emplace(kv.first, kv.second.first);
-      }
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftValueRep, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::BUMP_COUNTER: {
-      for (auto const& name :
-           *thriftReq.counterBumpParams_ref()->counterNames_ref()) {
-        if (counters_.find(name) == counters_.end()) {
-          thrift::Counter counter;
-          *counter.value_ref() = 0;
-          *counter.valueType_ref() = thrift::CounterValueType::COUNTER;
-          *counter.timestamp_ref() = std::time(nullptr);
-          counters_.emplace(name, std::make_pair(counter, now));
-        }
-        auto& counter = counters_[name].first;
-        ++(*counter.value_ref());
-        counters_[name].second = now;
-        thriftPub.counterPub_ref()->counters_ref()->emplace(name, counter);
-      }
-      // Dump new counter values to the publish socket.
-      *thriftPub.pubType_ref() = thrift::PubType::COUNTER_PUB;
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-    } break;
-
-    case thrift::MonitorCommand::LOG_EVENT:
-      // simply forward, do not store logs
-      *thriftPub.pubType_ref() = thrift::PubType::EVENT_LOG_PUB;
-      *thriftPub.eventLogPub_ref() = std::move(*thriftReq.eventLog_ref());
-      if (logSampleToMerge_) {
-        for (auto& sample : *thriftPub.eventLogPub_ref()->samples_ref()) {
-          try {
-            // throws if this sample doesn't have a timestamp
-            // in that case, lets just pass this sample along without appending
-            auto ls = LogSample::fromJson(sample);
-            ls.mergeSample(*logSampleToMerge_);
-            sample = ls.toJson();
-          } catch (...) {
-          }
-        }
-      }
-      // save the event log in local queue
-      if (eventLogs_.size() >= maxLogEvents_) {
-        eventLogs_.pop_front();
-      }
-      eventLogs_.push_back(*thriftPub.eventLogPub_ref());
-      monitorPubSock_.sendOne(
-          Message::fromThriftObj(thriftPub, serializer_).value());
-      break;
-
-    case thrift::MonitorCommand::GET_EVENT_LOGS: {
-      thrift::EventLogsResponse thriftEventLogsRep;
-      for (auto it = eventLogs_.begin(); it != eventLogs_.end(); ++it) {
-        thriftEventLogsRep.eventLogs_ref()->emplace_back(*it);
-      }
-      monitorReceiveSock_.sendMultiple(
-          requestIdMsg,
-          Message::fromThriftObj(thriftEventLogsRep, serializer_).value());
-    } break;
-
-    default:
-      LOG(ERROR) << "Unknown monitor command received";
-    }
-
-    VLOG(4) << "processMonitorRequest has finished";
-  }
+  void processRequest();
+
+  // Send reply to the requester of envelope
+  template <typename ThriftType>
+  void sendReply(ReplyEnvelope const& envelope, ThriftType const& reply);
+
+  // Reply with the page of counters following the cursor of `params`. Pages
+  // keep on following (one per loop iteration) if `isStream` is set.
+  void sendCounterDumpPage(
+      ReplyEnvelope envelope, thrift::CounterDumpParams params, bool isStream);
+
+  // Same as above, with regex of `params` compiled already (null if none)
+  void sendCounterDumpPage(
+      ReplyEnvelope envelope,
+      thrift::CounterDumpParams params,
+      std::shared_ptr<std::regex const> regex,
+      bool isStream);
+
+  // Reply with snapshot of counters and sequence number of publications
+  void sendSnapshot(ReplyEnvelope const& envelope, std::string prefix);
+
+  // Restore persisted state, if any. Called on construction.
+  void restoreState();
+
+  // Persist state. Counters are gathered from shards, unless shards have
+  // been stopped already (`isStopped`).
+  void persistState(bool isStopped = false);
 
   // Check last update timestamp of each counter
   // If the counter is not active for long time, remove this counter
-  void
-  purgeStaleCounters() {
-    // Scan through all counters to find out those have not been updated for
-    // longer than alivenessCheckInterval
-    auto const& current = std::chrono::steady_clock::now();
-
-    for (auto it = counters_.begin(); it != counters_.end();) {
-      auto const& key = it->first;
-      auto const& lastTs = it->second.second;
-      // remove expired counter
-      if (current - lastTs > alivenessCheckInterval_) {
-        LOG(INFO) << "Expired Counter: " << key;
-        it = counters_.erase(it);
-        continue;
-      }
-      ++it;
-    }
-  }
+  void purgeStaleCounters();
+
+  // Shard owning the counter
+  size_t getShardId(std::string const& name) const;
+
+  // Global id of a counter from its id in shard's store and vice versa
+  int64_t toGlobalId(size_t shardId, CounterStore::CounterId id) const;
+  CounterStore::CounterId toShardId(int64_t globalId) const;
+
+  // Run function on counters of a shard. Runs inline if not sharded.
+  void runOnShard(size_t shardId, folly::Function<void(CounterStore&)> fn);
+
+  // Run `fn(shardId, CounterStore&)` on counters of all shards and invoke
+  // callback with merged results (maps, or concatenated vectors) in monitor's
+  // event loop. Runs inline if not sharded. `fn` is copied for every shard.
+  template <typename Fn>
+  void scatterGather(
+      Fn fn,
+      folly::Function<void(std::invoke_result_t<Fn&, size_t, CounterStore&>&&)>
+          callback);
 
   // get current timestamp (in milliseconds)
   uint64_t
@@ -343,21 +281,56 @@ class ZmqMonitor final : public ZmqEventLoop {
         .count();
   }
 
+  // Last event logs, up to `maxLogEvents`
+  EventLogStore eventLogs_;
+
   // Timer for checking counter aliveness periodically
   std::unique_ptr<ZmqTimeout> monitorTimer_;
 
   std::unique_ptr<ZmqTimeout> profilingTimer_;
+
+  // Options for publications
+  const MonitorPubOptions pubOptions_;
+
+  // Timer for flushing coalesced counter publications
+  std::unique_ptr<ZmqTimeout> pubTimer_;
+
+  // Counter updates pending publication when coalescing
+  CounterMap pendingPubCounters_;
+
+  // Last published counters for `changedOnly` filtering and the last value
+  // cache. Purged along with stale counters.
+  CounterTimestampMap lastPubCounters_;
+
+  // Sequence number of the last publication
+  int64_t pubSeqNum_{0};
+
   const std::string monitorSubmitUrl_;
   const std::string monitorPubUrl_;
 
   Socket<ZMQ_ROUTER, ZMQ_SERVER> monitorReceiveSock_;
-  Socket<ZMQ_PUB, ZMQ_SERVER> monitorPubSock_;
+  // Publications are skipped when nobody subscribed to them
+  Publisher monitorPubSock_;
 
   // the serializer/deserializer helper we'll be using
   apache::thrift::CompactSerializer serializer_;
 
-  // track critical statistics, e.g., number of times functions are called
-  CounterTimestampMap counters_;
+  // track critical statistics, e.g., number of times functions are called.
+  // Used only if not sharded.
+  CounterStore counters_;
+
+  // Shared counter tables of co-located clients, by path
+  std::unordered_map<std::string, std::unique_ptr<SharedCounterTable>>
+      sharedCounterTables_;
+
+  // Number of counter shards
+  const size_t numShards_{1};
+
+  // Epoch of counter ids, refer to getEpoch()
+  const int64_t epoch_{0};
+
+  // Counter shards, empty if not sharded
+  std::vector<std::unique_ptr<Shard>> shards_;
 
   // Start timestamp
   const std::chrono::steady_clock::time_point startTime_;
@@ -365,12 +338,18 @@ class ZmqMonitor final : public ZmqEventLoop {
   // time interval of counter aliveness check
   const std::chrono::seconds alivenessCheckInterval_;
 
-  // Number of last log events to queue
-  const size_t maxLogEvents_{0};
-
   // LogSample to merge to each LogSample we recv
   const folly::Optional<LogSample> logSampleToMerge_;
 
+  // Options for resource usage counters
+  const MonitorResourceOptions resourceOptions_;
+
+  // Options for persisting state
+  const MonitorPersistOptions persistOptions_;
+
+  // Timer for persisting state periodically
+  std::unique_ptr<ZmqTimeout> persistTimer_;
+
   // Get the system metrics for resource usage counters
   fbzmq::SystemMetrics systemMetrics_{};
 };
@@ -0,0 +1,488 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ZmqMonitorAggregator.h"
+
+#include <algorithm>
+
+#include "ZmqMonitorAsyncClient.h"
+
+namespace fbzmq {
+
+struct ZmqMonitorAggregator::Source {
+  Source(
+      size_t id, MonitorAggregatorSource const& config, Context& zmqContext)
+      : id(id),
+        config(config),
+        subSock(zmqContext, folly::none, folly::none, NonblockingFlag{true}) {}
+
+  const size_t id{0};
+  const MonitorAggregatorSource config;
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> subSock;
+
+  // Client for snapshots, if source has a submit url
+  std::unique_ptr<ZmqMonitorAsyncClient> client;
+
+  // Update times of its counters contributing to aggregates, untagged
+  CounterStore aggregated;
+
+  // Sequence number of the last applied publication
+  int64_t lastSeqNum{0};
+
+  // Publications received while waiting for a snapshot
+  bool isSyncing{false};
+  std::vector<thrift::MonitorPub> pendingPubs;
+};
+
+template <typename ThriftType>
+void
+ZmqMonitorAggregator::sendReply(
+    ReplyEnvelope const& envelope, ThriftType const& reply) {
+  auto frames = envelope;
+  frames.emplace_back(Message::fromThriftObj(reply, serializer_).value());
+  const auto ret = receiveSock_.sendBatch(std::move(frames));
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqMonitorAggregator: Error sending reply: " << ret.error();
+  }
+}
+
+ZmqMonitorAggregator::ZmqMonitorAggregator(
+    std::string const& submitUrl,
+    std::string const& pubUrl,
+    std::vector<MonitorAggregatorSource> const& sources,
+    Context& zmqContext,
+    MonitorAggregatorOptions const& options)
+    : options_(options),
+      receiveSock_{zmqContext},
+      pubSock_{zmqContext},
+      eventLogs_{options.maxLogEvents} {
+  const int handover = 1;
+  const auto handoverRet =
+      receiveSock_.setSockOpt(ZMQ_ROUTER_HANDOVER, &handover, sizeof(int));
+  if (handoverRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitorAggregator: Could not set ZMQ_ROUTER_HANDOVER "
+               << handoverRet.error();
+  }
+  const auto receiveBindRet = receiveSock_.bind(SocketUrl{submitUrl});
+  if (receiveBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitorAggregator: Error binding to '" << submitUrl
+               << "' " << receiveBindRet.error();
+  }
+  const int hwm = 1024;
+  const auto hwmRet = pubSock_.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(int));
+  if (hwmRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitorAggregator: Could not set ZMQ_SNDHWM "
+               << hwmRet.error();
+  }
+  const auto pubBindRet = pubSock_.bind(SocketUrl{pubUrl});
+  if (pubBindRet.hasError()) {
+    LOG(FATAL) << "ZmqMonitorAggregator: Error binding to '" << pubUrl << "' "
+               << pubBindRet.error();
+  }
+
+  addSocket(
+      RawZmqSocketPtr{*pubSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept { pubSock_.processSubscriptions(); });
+
+  addSocket(
+      RawZmqSocketPtr{*receiveSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        try {
+          processRequest();
+        } catch (std::exception const& e) {
+          LOG(ERROR) << "ZmqMonitorAggregator: Error processing request: "
+                     << folly::exceptionStr(e);
+        }
+      });
+
+  // Subscribe to sources, then catch up with their snapshots
+  for (auto const& config : sources) {
+    CHECK(config.name.find(options_.sourceDelimiter) == std::string::npos)
+        << "Source name '" << config.name << "' contains delimiter";
+    auto source =
+        std::make_unique<Source>(sources_.size(), config, zmqContext);
+    if (source->subSock.connect(SocketUrl{config.pubUrl}).hasError()) {
+      LOG(FATAL) << "ZmqMonitorAggregator: Error connecting to '"
+                 << config.pubUrl << "'";
+    }
+    source->subSock.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+    if (not config.submitUrl.empty()) {
+      source->client = std::make_unique<ZmqMonitorAsyncClient>(
+          *this, zmqContext, config.submitUrl, options_.snapshotTimeout);
+    }
+    auto sourcePtr = source.get();
+    addSocket(
+        RawZmqSocketPtr{*source->subSock},
+        ZMQ_POLLIN,
+        [this, sourcePtr](int /* revents */) noexcept {
+          processSourcePubs(*sourcePtr);
+        });
+    sources_.emplace_back(std::move(source));
+    syncSource(*sources_.back());
+  }
+
+  const bool isPeriodic = true;
+  purgeTimer_ =
+      ZmqTimeout::make(this, [this]() noexcept { purgeStaleCounters(); });
+  purgeTimer_->scheduleTimeout(options_.alivenessCheckInterval, isPeriodic);
+}
+
+ZmqMonitorAggregator::~ZmqMonitorAggregator() {
+  // Clients fail their pending snapshots on destruction
+  isStopping_ = true;
+  for (auto& source : sources_) {
+    removeSocket(RawZmqSocketPtr{*source->subSock});
+    source->client.reset();
+  }
+}
+
+void
+ZmqMonitorAggregator::processSourcePubs(Source& source) {
+  std::vector<Message> frames;
+  while (true) {
+    auto ret = source.subSock.recvMultipleInto(frames);
+    if (ret.hasError()) {
+      // EAGAIN once all publications are drained
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqMonitorAggregator: Error receiving publication of "
+                   << source.config.name << ": " << ret.error();
+      }
+      return;
+    }
+    // Publication may be preceded by a topic frame
+    if (frames.empty() or frames.size() > 2) {
+      LOG(ERROR) << "ZmqMonitorAggregator: Unexpected publication of "
+                 << frames.size() << " frames from " << source.config.name;
+      continue;
+    }
+    auto pub = frames.back().readThriftObj<thrift::MonitorPub>(serializer_);
+    if (pub.hasError()) {
+      LOG(ERROR) << "ZmqMonitorAggregator: Error reading publication of "
+                 << source.config.name << ": " << pub.error();
+      continue;
+    }
+    processSourcePub(source, std::move(pub.value()));
+  }
+}
+
+void
+ZmqMonitorAggregator::processSourcePub(
+    Source& source, thrift::MonitorPub&& pub) {
+  if (source.isSyncing) {
+    source.pendingPubs.emplace_back(std::move(pub));
+    return;
+  }
+
+  // Sequence numbers start over when source restarts
+  const auto seqNum = *pub.seqNum_ref();
+  if (seqNum != source.lastSeqNum + 1 and source.client) {
+    LOG(INFO) << "ZmqMonitorAggregator: Publication " << seqNum << " of "
+              << source.config.name << " doesn't follow "
+              << source.lastSeqNum << ", syncing";
+    syncSource(source);
+    source.pendingPubs.emplace_back(std::move(pub));
+    return;
+  }
+  source.lastSeqNum = seqNum;
+
+  switch (*pub.pubType_ref()) {
+  case thrift::PubType::COUNTER_PUB:
+    setSourceCounters(
+        source,
+        std::move(*pub.counterPub_ref()->counters_ref()),
+        std::chrono::steady_clock::now());
+    break;
+  case thrift::PubType::EVENT_LOG_PUB:
+    forwardEventLog(source, std::move(*pub.eventLogPub_ref()));
+    break;
+  default:
+    LOG(ERROR) << "ZmqMonitorAggregator: Unknown publication type from "
+               << source.config.name;
+  }
+}
+
+void
+ZmqMonitorAggregator::syncSource(Source& source) {
+  if (not source.client or source.isSyncing) {
+    return;
+  }
+  source.isSyncing = true;
+  auto sourcePtr = &source;
+  source.client->getSnapshot().via(this).thenTry(
+      [this, sourcePtr](folly::Try<thrift::MonitorSnapshot>&& snapshot) {
+        if (isStopping_) {
+          return;
+        }
+        applySnapshot(*sourcePtr, std::move(snapshot));
+      });
+}
+
+void
+ZmqMonitorAggregator::applySnapshot(
+    Source& source, folly::Try<thrift::MonitorSnapshot>&& snapshot) {
+  source.isSyncing = false;
+  if (snapshot.hasException()) {
+    // Carry on with publications, next gap retries
+    LOG(ERROR) << "ZmqMonitorAggregator: Error getting snapshot of "
+               << source.config.name << ": "
+               << snapshot.exception().what();
+    if (not source.pendingPubs.empty()) {
+      source.lastSeqNum = *source.pendingPubs.front().seqNum_ref() - 1;
+    }
+  } else {
+    VLOG(2) << "ZmqMonitorAggregator: Synced " << source.config.name
+            << " at publication " << *snapshot->seqNum_ref();
+    source.lastSeqNum = *snapshot->seqNum_ref();
+    setSourceCounters(
+        source,
+        std::move(*snapshot->counters_ref()),
+        std::chrono::steady_clock::now());
+  }
+
+  auto pendingPubs = std::move(source.pendingPubs);
+  source.pendingPubs.clear();
+  for (auto& pub : pendingPubs) {
+    // Skip publications already reflected in snapshot
+    if (*pub.seqNum_ref() > source.lastSeqNum) {
+      processSourcePub(source, std::move(pub));
+    }
+  }
+}
+
+void
+ZmqMonitorAggregator::setSourceCounters(
+    Source& source,
+    CounterMap&& counters,
+    std::chrono::steady_clock::time_point now) {
+  CounterMap updates;
+  for (auto& kv : counters) {
+    auto aggregation = getAggregation(kv.first);
+    if (aggregation) {
+      auto& aggregate = aggregates_[kv.first];
+      aggregate.aggregation = *aggregation;
+      aggregate.values[source.id] = kv.second;
+      recompute(aggregate);
+      source.aggregated.set(source.aggregated.intern(kv.first), kv.second, now);
+      counters_.set(counters_.intern(kv.first), aggregate.counter, now);
+      updates[kv.first] = aggregate.counter;
+    }
+    if (options_.keepSourceCounters) {
+      auto name = source.config.name + options_.sourceDelimiter + kv.first;
+      counters_.set(counters_.intern(name), kv.second, now);
+      updates.emplace(std::move(name), std::move(kv.second));
+    }
+  }
+  if (updates.empty()) {
+    return;
+  }
+
+  thrift::MonitorPub pub;
+  *pub.pubType_ref() = thrift::PubType::COUNTER_PUB;
+  *pub.counterPub_ref()->counters_ref() = std::move(updates);
+  sendPub(std::move(pub));
+}
+
+void
+ZmqMonitorAggregator::forwardEventLog(
+    Source& source, thrift::EventLog&& eventLog) {
+  *eventLog.category_ref() =
+      source.config.name + options_.sourceDelimiter + *eventLog.category_ref();
+  eventLogs_.add(
+      eventLog,
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+
+  thrift::MonitorPub pub;
+  *pub.pubType_ref() = thrift::PubType::EVENT_LOG_PUB;
+  *pub.eventLogPub_ref() = std::move(eventLog);
+  sendPub(std::move(pub));
+}
+
+folly::Optional<CounterAggregation>
+ZmqMonitorAggregator::getAggregation(std::string const& name) const {
+  if (name.find(options_.sourceDelimiter) != std::string::npos) {
+    return folly::none;
+  }
+  for (auto const& kv : options_.aggregations) {
+    if (name.compare(0, kv.first.size(), kv.first) == 0) {
+      return kv.second;
+    }
+  }
+  return folly::none;
+}
+
+void
+ZmqMonitorAggregator::recompute(Aggregate& aggregate) {
+  // Number of sources is small compared to number of counters, values are
+  // simply folded on every update
+  folly::Optional<double> value;
+  int64_t timestamp{0};
+  for (auto const& kv : aggregate.values) {
+    auto const& counter = kv.second;
+    const double counterValue = *counter.value_ref();
+    if (not value) {
+      value = counterValue;
+      *aggregate.counter.valueType_ref() = *counter.valueType_ref();
+    } else if (aggregate.aggregation == CounterAggregation::SUM) {
+      *value += counterValue;
+    } else {
+      value = std::max(*value, counterValue);
+    }
+    timestamp = std::max(timestamp, *counter.timestamp_ref());
+  }
+  *aggregate.counter.value_ref() = value.value_or(0);
+  *aggregate.counter.timestamp_ref() = timestamp;
+}
+
+void
+ZmqMonitorAggregator::processRequest() {
+  ReplyEnvelope envelope;
+  const auto ret = receiveSock_.recvMultipleInto(envelope);
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqMonitorAggregator: Error receiving request: "
+               << ret.error();
+    return;
+  }
+  if (envelope.size() < 2 or envelope.size() > 3) {
+    LOG(ERROR) << "ZmqMonitorAggregator: Unexpected number of frames "
+               << envelope.size();
+    return;
+  }
+  auto thriftReqMsg = std::move(envelope.back());
+  envelope.pop_back();
+  auto maybeThriftReq =
+      thriftReqMsg.readThriftObj<thrift::MonitorRequest>(serializer_);
+  if (maybeThriftReq.hasError()) {
+    LOG(ERROR) << "ZmqMonitorAggregator: Failed reading request "
+               << maybeThriftReq.error();
+    return;
+  }
+  auto& thriftReq = maybeThriftReq.value();
+
+  switch (*thriftReq.cmd_ref()) {
+  case thrift::MonitorCommand::GET_COUNTER_VALUES: {
+    thrift::CounterValuesResponse thriftValueRep;
+    for (auto const& name :
+         *thriftReq.counterGetParams_ref()->counterNames_ref()) {
+      const auto id = counters_.find(name);
+      if (counters_.isLive(id)) {
+        thriftValueRep.counters_ref()->emplace(name, counters_.getLive(id));
+      }
+    }
+    sendReply(envelope, thriftValueRep);
+  } break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES: {
+    thrift::CounterNamesResponse thriftNameRep;
+    thriftNameRep.counterNames_ref()->reserve(counters_.size());
+    counters_.forEach([&](CounterStore::CounterId id) {
+      thriftNameRep.counterNames_ref()->emplace_back(counters_.getName(id));
+    });
+    sendReply(envelope, thriftNameRep);
+  } break;
+
+  case thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA: {
+    thrift::CounterValuesResponse thriftValueRep;
+    counters_.forEach([&](CounterStore::CounterId id) {
+      thriftValueRep.counters_ref()->emplace(
+          counters_.getName(id), counters_.getLive(id));
+    });
+    sendReply(envelope, thriftValueRep);
+  } break;
+
+  case thrift::MonitorCommand::GET_EVENT_LOGS: {
+    thrift::EventLogsResponse thriftEventLogsRep;
+    *thriftEventLogsRep.eventLogs_ref() = eventLogs_.getAll();
+    sendReply(envelope, thriftEventLogsRep);
+  } break;
+
+  case thrift::MonitorCommand::QUERY_EVENT_LOGS:
+    sendReply(
+        envelope, eventLogs_.query(*thriftReq.eventLogQueryParams_ref()));
+    break;
+
+  case thrift::MonitorCommand::GET_SNAPSHOT: {
+    // Every publication is applied to the merged view before it is sent
+    auto const& prefix = *thriftReq.snapshotParams_ref()->prefix_ref();
+    thrift::MonitorSnapshot snapshot;
+    *snapshot.seqNum_ref() = pubSeqNum_;
+    counters_.forEach([&](CounterStore::CounterId id) {
+      auto const& name = counters_.getName(id);
+      if (name.compare(0, prefix.size(), prefix) == 0) {
+        snapshot.counters_ref()->emplace(name, counters_.getLive(id));
+      }
+    });
+    sendReply(envelope, snapshot);
+  } break;
+
+  default:
+    LOG(ERROR) << "ZmqMonitorAggregator: Unsupported command "
+               << static_cast<int>(*thriftReq.cmd_ref());
+  }
+}
+
+void
+ZmqMonitorAggregator::purgeStaleCounters() {
+  const auto cutoff =
+      std::chrono::steady_clock::now() - options_.alivenessCheckInterval;
+
+  // Drop stale contributions to aggregates. Aggregates left without any are
+  // stale themselves and purged from merged view below.
+  CounterMap updates;
+  for (auto& source : sources_) {
+    auto& aggregated = source->aggregated;
+    aggregated.purge(cutoff, [&](CounterStore::CounterId id) {
+      auto const& name = aggregated.getName(id);
+      auto it = aggregates_.find(name);
+      if (it == aggregates_.end()) {
+        return;
+      }
+      auto& aggregate = it->second;
+      aggregate.values.erase(source->id);
+      if (aggregate.values.empty()) {
+        aggregates_.erase(it);
+        updates.erase(name);
+        return;
+      }
+      // Latest contribution is still there, so is update time of aggregate
+      recompute(aggregate);
+      const auto aggregateId = counters_.find(name);
+      counters_.set(
+          aggregateId, aggregate.counter, counters_.getUpdateTime(aggregateId));
+      updates[name] = aggregate.counter;
+    });
+  }
+
+  std::vector<std::string> expired;
+  counters_.purge(cutoff, [this, &expired](CounterStore::CounterId id) {
+    expired.emplace_back(counters_.getName(id));
+  });
+  logExpiredCounters(expired);
+
+  if (not updates.empty()) {
+    thrift::MonitorPub pub;
+    *pub.pubType_ref() = thrift::PubType::COUNTER_PUB;
+    *pub.counterPub_ref()->counters_ref() = std::move(updates);
+    sendPub(std::move(pub));
+  }
+}
+
+void
+ZmqMonitorAggregator::sendPub(thrift::MonitorPub&& pub) {
+  *pub.seqNum_ref() = ++pubSeqNum_;
+  const auto ret = pubSock_.publish(
+      [&]() { return Message::fromThriftObj(pub, serializer_); });
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqMonitorAggregator: Error publishing " << ret.error();
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/async/ZmqTimeout.h>
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/zmq/Publisher.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <folly/Optional.h>
+#include <folly/Try.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include "CounterStore.h"
+#include "EventLogStore.h"
+#include "ZmqMonitor.h"
+
+namespace fbzmq {
+
+/**
+ * Aggregation of a counter across sources
+ */
+enum class CounterAggregation {
+  SUM = 1,
+  MAX = 2,
+};
+
+/**
+ * Monitor (or downstream aggregator) subscribed to by ZmqMonitorAggregator
+ */
+struct MonitorAggregatorSource {
+  // Tag of the source, must not contain `sourceDelimiter`
+  std::string name;
+
+  // PUB url of the source
+  std::string pubUrl;
+
+  // ROUTER (submit) url of the source, to catch up with a snapshot on
+  // subscription and whenever publications are missed. Empty to rely on
+  // publications only.
+  std::string submitUrl;
+};
+
+/**
+ * Options for ZmqMonitorAggregator
+ */
+struct MonitorAggregatorOptions {
+  // Counters of a source are tagged as `<source name><delimiter><name>`, and
+  // so are categories of its event logs
+  char sourceDelimiter{':'};
+
+  // Counters aggregated across sources, by prefix of their name (first
+  // match wins). Aggregate of a counter is kept under its untagged name.
+  // Tagged counters, i.e. per-source counters of a downstream aggregator,
+  // are never aggregated, its aggregates are instead.
+  std::vector<std::pair<std::string, CounterAggregation>> aggregations;
+
+  // Keep (and publish) tagged counters of every source. Disable to keep
+  // aggregates only, e.g. on upper levels of an aggregation tree.
+  bool keepSourceCounters{true};
+
+  // Counters of a source not updated for this long are dropped, along with
+  // their contribution to aggregates
+  std::chrono::seconds alivenessCheckInterval{kAlivenessCheckInterval};
+
+  size_t maxLogEvents{kMaxLogEvents};
+
+  std::chrono::milliseconds snapshotTimeout{std::chrono::seconds(5)};
+};
+
+/**
+ * ZmqMonitorAggregator subscribes to the PUB sockets of many ZmqMonitors and
+ * maintains a merged view of their counters and event logs, plus aggregates
+ * of counters across sources. Collectors then query a single aggregator
+ * instead of polling every monitor.
+ *
+ * Aggregator speaks the monitor protocol itself: it serves read requests
+ * (GET_COUNTER_VALUES, DUMP_ALL_COUNTER_NAMES, DUMP_ALL_COUNTER_DATA,
+ * GET_EVENT_LOGS, QUERY_EVENT_LOGS and GET_SNAPSHOT) on its ROUTER socket and
+ * publishes every update on its PUB socket, hence aggregators can subscribe
+ * to aggregators to form a tree. Write requests are ignored.
+ *
+ * Sources with `submitUrl` are synced with a snapshot (GET_SNAPSHOT) on
+ * subscription, and again whenever a gap in sequence numbers of their
+ * publications shows that updates were missed (or source restarted).
+ */
+class ZmqMonitorAggregator final : public ZmqEventLoop {
+ public:
+  ZmqMonitorAggregator(
+      std::string const& submitUrl,
+      std::string const& pubUrl,
+      std::vector<MonitorAggregatorSource> const& sources,
+      Context& zmqContext,
+      MonitorAggregatorOptions const& options = MonitorAggregatorOptions());
+
+  ~ZmqMonitorAggregator() override;
+
+ private:
+  ZmqMonitorAggregator(ZmqMonitorAggregator const&) = delete;
+  ZmqMonitorAggregator& operator=(ZmqMonitorAggregator const&) = delete;
+
+  /**
+   * Subscription to a source. Defined in .cpp
+   */
+  struct Source;
+
+  /**
+   * Values of a counter across sources
+   */
+  struct Aggregate {
+    CounterAggregation aggregation{CounterAggregation::SUM};
+    // Counter by source id. Update times are kept by sources, for expiry.
+    std::unordered_map<size_t, thrift::Counter> values;
+    // Aggregated counter
+    thrift::Counter counter;
+  };
+
+  // Receive pending publications of a source
+  void processSourcePubs(Source& source);
+
+  // Apply a publication of a source, or request a snapshot if publications
+  // were missed
+  void processSourcePub(Source& source, thrift::MonitorPub&& pub);
+
+  // Request a snapshot of a source, publications are held back until it
+  // arrives
+  void syncSource(Source& source);
+
+  // Apply snapshot of a source (if any) and held back publications
+  void applySnapshot(
+      Source& source, folly::Try<thrift::MonitorSnapshot>&& snapshot);
+
+  // Update counters of a source and publish them
+  void setSourceCounters(
+      Source& source,
+      CounterMap&& counters,
+      std::chrono::steady_clock::time_point now);
+
+  // Forward an event log of a source
+  void forwardEventLog(Source& source, thrift::EventLog&& eventLog);
+
+  // Aggregation of a counter, none if not aggregated
+  folly::Optional<CounterAggregation> getAggregation(
+      std::string const& name) const;
+
+  // Recompute aggregated counter from values of sources
+  static void recompute(Aggregate& aggregate);
+
+  // Process a monitor request pending on receiveSock_
+  void processRequest();
+
+  // Remove counters of sources not updated for alivenessCheckInterval
+  void purgeStaleCounters();
+
+  // Send counter/event log publication on PUB socket
+  void sendPub(thrift::MonitorPub&& pub);
+
+  // Frames preceding a request, sent back as-is ahead of the reply
+  using ReplyEnvelope = std::vector<Message>;
+
+  template <typename ThriftType>
+  void sendReply(ReplyEnvelope const& envelope, ThriftType const& reply);
+
+  const MonitorAggregatorOptions options_;
+
+  // Set on destruction, snapshot replies arriving after are dropped
+  bool isStopping_{false};
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> receiveSock_;
+  // Publications are skipped when nobody subscribed to them
+  Publisher pubSock_;
+
+  apache::thrift::CompactSerializer serializer_;
+
+  // Merged view, tagged counters of sources and aggregates
+  CounterStore counters_;
+
+  // Aggregates by counter name
+  std::unordered_map<std::string, Aggregate> aggregates_;
+
+  // Event logs of all sources
+  EventLogStore eventLogs_;
+
+  // Sequence number of the last publication
+  int64_t pubSeqNum_{0};
+
+  std::unique_ptr<ZmqTimeout> purgeTimer_;
+
+  std::vector<std::unique_ptr<Source>> sources_;
+};
+
+} // namespace fbzmq
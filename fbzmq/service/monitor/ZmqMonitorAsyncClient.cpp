@@ -0,0 +1,292 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ZmqMonitorAsyncClient.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace fbzmq {
+
+namespace {
+
+/**
+ * Read thrift object of reply, throws on error to fail the future
+ */
+template <typename ThriftType>
+ThriftType
+readReply(Message const& msg) {
+  apache::thrift::CompactSerializer serializer;
+  auto obj = msg.readThriftObj<ThriftType>(serializer);
+  if (obj.hasError()) {
+    std::ostringstream oss;
+    oss << "ZmqMonitorAsyncClient: error reading reply " << obj.error();
+    throw std::runtime_error(oss.str());
+  }
+  return std::move(obj.value());
+}
+
+} // namespace
+
+ZmqMonitorAsyncClient::ZmqMonitorAsyncClient(
+    ZmqEventLoop& evl,
+    Context& zmqContext,
+    std::string const& monitorCmdUrl,
+    std::chrono::milliseconds defaultTimeout)
+    : evl_(evl),
+      defaultTimeout_(defaultTimeout),
+      monitorCmdSock_{
+          zmqContext, folly::none, folly::none, NonblockingFlag{true}} {
+  CHECK(evl_.isInEventLoop());
+  if (monitorCmdSock_.connect(SocketUrl{monitorCmdUrl}).hasError()) {
+    LOG(FATAL) << "Error connecting to monitor '" << monitorCmdUrl << "'";
+  }
+  evl_.addSocket(
+      RawZmqSocketPtr{*monitorCmdSock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept {
+        processReplies();
+      });
+}
+
+ZmqMonitorAsyncClient::~ZmqMonitorAsyncClient() {
+  CHECK(evl_.isInEventLoop());
+  evl_.removeSocket(RawZmqSocketPtr{*monitorCmdSock_});
+  for (auto& kv : pendingRequests_) {
+    evl_.cancelTimeout(kv.second.timeoutId);
+  }
+  // Promises are broken as they get destroyed
+  pendingRequests_.clear();
+}
+
+folly::SemiFuture<folly::Optional<thrift::Counter>>
+ZmqMonitorAsyncClient::getCounter(
+    std::string const& name,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  return getCounters({name}, timeout)
+      .deferValue([name](CounterMap&& counters) {
+        folly::Optional<thrift::Counter> counter;
+        auto it = counters.find(name);
+        if (it != counters.end()) {
+          counter = std::move(it->second);
+        }
+        return counter;
+      });
+}
+
+folly::SemiFuture<CounterMap>
+ZmqMonitorAsyncClient::getCounters(
+    std::vector<std::string> const& names,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  *thriftReq.counterGetParams_ref()->counterNames_ref() = names;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    auto response = readReply<thrift::CounterValuesResponse>(msg);
+    return std::move(*response.counters_ref());
+  });
+}
+
+folly::SemiFuture<std::vector<std::string>>
+ZmqMonitorAsyncClient::dumpCounterNames(
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    auto response = readReply<thrift::CounterNamesResponse>(msg);
+    return std::move(*response.counterNames_ref());
+  });
+}
+
+folly::SemiFuture<CounterMap>
+ZmqMonitorAsyncClient::dumpCounters(
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    auto response = readReply<thrift::CounterValuesResponse>(msg);
+    return std::move(*response.counters_ref());
+  });
+}
+
+folly::SemiFuture<thrift::CounterDumpPage>
+ZmqMonitorAsyncClient::getCounterPage(
+    thrift::CounterDumpParams const& params,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_DATA_PAGE;
+  *thriftReq.counterDumpParams_ref() = params;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    return readReply<thrift::CounterDumpPage>(msg);
+  });
+}
+
+folly::SemiFuture<std::map<std::string, int64_t>>
+ZmqMonitorAsyncClient::registerCounters(
+    std::vector<std::string> const& names,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::REGISTER_COUNTERS;
+  *thriftReq.counterRegisterParams_ref()->counterNames_ref() = names;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    auto response = readReply<thrift::CounterIdsResponse>(msg);
+    return std::move(*response.counterIds_ref());
+  });
+}
+
+folly::SemiFuture<std::vector<thrift::EventLog>>
+ZmqMonitorAsyncClient::getLastEventLogs(
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_EVENT_LOGS;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    auto response = readReply<thrift::EventLogsResponse>(msg);
+    return std::move(*response.eventLogs_ref());
+  });
+}
+
+folly::SemiFuture<thrift::EventLogQueryResponse>
+ZmqMonitorAsyncClient::queryEventLogs(
+    thrift::EventLogQueryParams const& params,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::QUERY_EVENT_LOGS;
+  *thriftReq.eventLogQueryParams_ref() = params;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    return readReply<thrift::EventLogQueryResponse>(msg);
+  });
+}
+
+folly::SemiFuture<thrift::MonitorSnapshot>
+ZmqMonitorAsyncClient::getSnapshot(
+    std::string const& prefix,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_SNAPSHOT;
+  *thriftReq.snapshotParams_ref()->prefix_ref() = prefix;
+  return sendRequest(thriftReq, timeout).deferValue([](Message&& msg) {
+    return readReply<thrift::MonitorSnapshot>(msg);
+  });
+}
+
+void
+ZmqMonitorAsyncClient::setCounters(CounterMap const& counters) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  *thriftReq.counterSetParams_ref()->counters_ref() = counters;
+  sendOneWay(thriftReq);
+}
+
+void
+ZmqMonitorAsyncClient::bumpCounter(std::string const& name) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER;
+  thriftReq.counterBumpParams_ref()->counterNames_ref()->emplace_back(name);
+  sendOneWay(thriftReq);
+}
+
+void
+ZmqMonitorAsyncClient::addEventLog(thrift::EventLog const& eventLog) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::LOG_EVENT;
+  *thriftReq.eventLog_ref() = eventLog;
+  sendOneWay(thriftReq);
+}
+
+folly::SemiFuture<Message>
+ZmqMonitorAsyncClient::sendRequest(
+    thrift::MonitorRequest const& request,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  auto contract = folly::makePromiseContract<Message>();
+  auto requestMsg = Message::fromThriftObj(request, serializer_).value();
+
+  evl_.runImmediatelyOrInEventLoop(
+      [this,
+       promise = std::move(contract.first),
+       requestMsg = std::move(requestMsg),
+       timeout = timeout.value_or(defaultTimeout_)]() mutable {
+        const auto requestId = nextRequestId_++;
+        const auto ret = monitorCmdSock_.sendMultiple(
+            Message::from(requestId).value(), std::move(requestMsg));
+        if (ret.hasError()) {
+          LOG(ERROR) << "ZmqMonitorAsyncClient: error sending request "
+                     << ret.error();
+          std::ostringstream oss;
+          oss << "Error sending request " << ret.error();
+          promise.setException(std::runtime_error(oss.str()));
+          return;
+        }
+
+        auto& pending = pendingRequests_[requestId];
+        pending.promise = std::move(promise);
+        pending.timeoutId = evl_.scheduleTimeout(timeout, [this, requestId]() {
+          auto it = pendingRequests_.find(requestId);
+          if (it == pendingRequests_.end()) {
+            return;
+          }
+          auto pendingPromise = std::move(it->second.promise);
+          pendingRequests_.erase(it);
+          pendingPromise.setException(folly::FutureTimeout());
+        });
+      });
+
+  return std::move(contract.second);
+}
+
+void
+ZmqMonitorAsyncClient::sendOneWay(thrift::MonitorRequest const& request) {
+  auto requestMsg = Message::fromThriftObj(request, serializer_).value();
+  evl_.runImmediatelyOrInEventLoop(
+      [this, requestMsg = std::move(requestMsg)]() mutable {
+        const auto ret = monitorCmdSock_.sendOne(std::move(requestMsg));
+        if (ret.hasError()) {
+          LOG(ERROR) << "ZmqMonitorAsyncClient: error sending request "
+                     << ret.error();
+        }
+      });
+}
+
+void
+ZmqMonitorAsyncClient::processReplies() {
+  std::vector<Message> frames;
+  while (true) {
+    auto ret = monitorCmdSock_.recvMultipleInto(frames);
+    if (ret.hasError()) {
+      // EAGAIN once all replies are drained
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqMonitorAsyncClient: error receiving reply "
+                   << ret.error();
+      }
+      return;
+    }
+
+    if (frames.size() != 2) {
+      LOG(ERROR) << "ZmqMonitorAsyncClient: unexpected reply of "
+                 << frames.size() << " frames";
+      continue;
+    }
+    const auto requestId = frames[0].read<uint64_t>();
+    if (requestId.hasError()) {
+      LOG(ERROR) << "ZmqMonitorAsyncClient: invalid request id of reply";
+      continue;
+    }
+
+    // Reply of timed out request is dropped
+    auto it = pendingRequests_.find(requestId.value());
+    if (it == pendingRequests_.end()) {
+      VLOG(2) << "ZmqMonitorAsyncClient: dropping reply of unknown request "
+              << requestId.value();
+      continue;
+    }
+    auto promise = std::move(it->second.promise);
+    evl_.cancelTimeout(it->second.timeoutId);
+    pendingRequests_.erase(it);
+    promise.setValue(std::move(frames[1]));
+  }
+}
+
+} // namespace fbzmq
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/zmq/Zmq.h>
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include "ZmqMonitor.h"
+
+namespace fbzmq {
+
+/**
+ * Asynchronous counterpart of ZmqMonitorClient driven by a ZmqEventLoop.
+ *
+ * Every request is tagged with a unique id (sent as an extra frame ahead of
+ * the request, which ZmqMonitor echoes back with the reply), so any number of
+ * requests can be in flight at once on a single DEALER socket and replies are
+ * matched to their requests regardless of order. Each request completes its
+ * SemiFuture with the reply, or with `folly::FutureTimeout` if the reply
+ * doesn't arrive within the timeout.
+ *
+ * APIs can be called from any thread, the socket is only ever touched from the
+ * event loop thread. Client must be created and destroyed either from within
+ * the event loop thread or while the loop is not running. Requests pending at
+ * destruction fail with `folly::BrokenPromise`.
+ *
+ *  ZmqMonitorAsyncClient client(evl, context, monitorCmdUrl);
+ *  auto counters = client.dumpCounters().via(&evl).thenValue(...);
+ */
+class ZmqMonitorAsyncClient {
+ public:
+  ZmqMonitorAsyncClient(
+      ZmqEventLoop& evl,
+      Context& zmqContext,
+      std::string const& monitorCmdUrl,
+      std::chrono::milliseconds defaultTimeout = std::chrono::seconds(5));
+
+  ~ZmqMonitorAsyncClient();
+
+  ZmqMonitorAsyncClient(ZmqMonitorAsyncClient const&) = delete;
+  ZmqMonitorAsyncClient& operator=(ZmqMonitorAsyncClient const&) = delete;
+
+  //
+  // Requests with reply. `timeout` defaults to the one of constructor.
+  //
+
+  /**
+   * Get counter(s) from ZmqMonitor. Missing counters are absent in the map.
+   */
+  folly::SemiFuture<folly::Optional<thrift::Counter>> getCounter(
+      std::string const& name,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+  folly::SemiFuture<CounterMap> getCounters(
+      std::vector<std::string> const& names,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Dump all counter names / counters in ZmqMonitor.
+   */
+  folly::SemiFuture<std::vector<std::string>> dumpCounterNames(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+  folly::SemiFuture<CounterMap> dumpCounters(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Get a page of filtered counter dump. Refer to `CounterDumpParams`.
+   */
+  folly::SemiFuture<thrift::CounterDumpPage> getCounterPage(
+      thrift::CounterDumpParams const& params,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Register counter names and get their numeric ids. Ids are raw ids of the
+   * current epoch of ZmqMonitor (see CounterIdsResponse), use
+   * ZmqMonitorClient to set counters by ids across restarts of ZmqMonitor.
+   */
+  folly::SemiFuture<std::map<std::string, int64_t>> registerCounters(
+      std::vector<std::string> const& names,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Get last event logs from ZmqMonitor
+   */
+  folly::SemiFuture<std::vector<thrift::EventLog>> getLastEventLogs(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Get event logs matching filters of `params`
+   */
+  folly::SemiFuture<thrift::EventLogQueryResponse> queryEventLogs(
+      thrift::EventLogQueryParams const& params,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Snapshot of counters with name starting with `prefix`, along with sequence
+   * number of the last publication it reflects. Refer to `MonitorSnapshot`.
+   */
+  folly::SemiFuture<thrift::MonitorSnapshot> getSnapshot(
+      std::string const& prefix = "",
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  //
+  // One-way requests
+  //
+
+  void setCounters(CounterMap const& counters);
+  void bumpCounter(std::string const& name);
+  void addEventLog(thrift::EventLog const& eventLog);
+
+  /**
+   * Number of requests waiting for reply. Must be called from within the
+   * event loop thread.
+   */
+  size_t
+  getNumPendingRequests() const {
+    return pendingRequests_.size();
+  }
+
+ private:
+  struct PendingRequest {
+    folly::Promise<Message> promise;
+    int64_t timeoutId{-1};
+  };
+
+  /**
+   * Send request and get a future of its reply
+   */
+  folly::SemiFuture<Message> sendRequest(
+      thrift::MonitorRequest const& request,
+      folly::Optional<std::chrono::milliseconds> timeout);
+
+  /**
+   * Send request without waiting for reply
+   */
+  void sendOneWay(thrift::MonitorRequest const& request);
+
+  /**
+   * Receive all pending replies and complete their requests
+   */
+  void processReplies();
+
+  ZmqEventLoop& evl_;
+
+  const std::chrono::milliseconds defaultTimeout_;
+
+  // DEALER socket
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> monitorCmdSock_;
+
+  // Serializer object for thrift-obj <-> string conversion
+  apache::thrift::CompactSerializer serializer_;
+
+  //
+  // State below is accessed only from the event loop thread
+  //
+
+  // Id of next request
+  uint64_t nextRequestId_{1};
+
+  // Requests waiting for reply, by request id
+  std::unordered_map<uint64_t, PendingRequest> pendingRequests_;
+};
+
+} // namespace fbzmq
@@ -7,15 +7,20 @@
 
 #include "ZmqMonitorClient.h"
 
+#include <algorithm>
+
 namespace fbzmq {
 
 ZmqMonitorClient::ZmqMonitorClient(
     Context& zmqContext,
     const std::string& monitorSubmitUrl,
-    std::string const& socketId)
+    std::string const& socketId,
+    MonitorClientBufferOptions bufferOptions)
     : monitorCmdUrl_(std::move(monitorSubmitUrl)),
       monitorCmdSock_{
-          zmqContext, folly::none, folly::none, NonblockingFlag{false}} {
+          zmqContext, folly::none, folly::none, NonblockingFlag{false}},
+      bufferOptions_(bufferOptions),
+      lastFlushTime_(std::chrono::steady_clock::now()) {
   if (!socketId.empty()) {
     const auto idRet = monitorCmdSock_.setSockOpt(
         ZMQ_IDENTITY, socketId.c_str(), socketId.length());
@@ -32,9 +37,98 @@ ZmqMonitorClient::ZmqMonitorClient(
   }
 }
 
+ZmqMonitorClient::~ZmqMonitorClient() {
+  flush();
+
+  if (sharedCounters_) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::DETACH_SHARED_COUNTERS;
+    *thriftReq.sharedCountersParams_ref()->path_ref() =
+        sharedCounters_->getPath();
+    const auto ret = monitorCmdSock_.sendOne(
+        Message::fromThriftObj(thriftReq, serializer_).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "~ZmqMonitorClient: error sending message " << ret.error();
+    }
+  }
+}
+
+bool
+ZmqMonitorClient::attachSharedCounters(
+    std::string const& path, size_t numSlots) {
+  CHECK(not sharedCounters_) << "Shared counters are already attached";
+
+  auto table = SharedCounterTable::create(path, numSlots);
+  if (table.hasError()) {
+    LOG(ERROR) << "attachSharedCounters: error creating table " << path
+               << ": " << table.error();
+    return false;
+  }
+
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::ATTACH_SHARED_COUNTERS;
+  *thriftReq.sharedCountersParams_ref()->path_ref() = path;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "attachSharedCounters: error sending message "
+               << sendRet.error();
+    return false;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "attachSharedCounters: error receiving message "
+               << respMsg.error();
+    return false;
+  }
+
+  auto response = respMsg.value().readThriftObj<thrift::SharedCountersResponse>(
+      serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "attachSharedCounters: error reading message"
+               << response.error();
+    return false;
+  }
+  if (not *response.value().attached_ref()) {
+    LOG(ERROR) << "attachSharedCounters: monitor couldn't attach " << path
+               << ": " << *response.value().error_ref();
+    return false;
+  }
+
+  sharedCounters_ = std::move(table.value());
+  return true;
+}
+
+bool
+ZmqMonitorClient::setSharedCounter(
+    std::string const& name, thrift::Counter const& counter) {
+  if (not sharedCounters_) {
+    return false;
+  }
+  auto slot = sharedCounters_->getSlot(name);
+  if (not slot.hasValue()) {
+    return false;
+  }
+  sharedCounters_->set(slot.value(), counter);
+  return true;
+}
+
 void
 ZmqMonitorClient::setCounter(
     std::string const& name, thrift::Counter const& counter) {
+  if (setSharedCounter(name, counter)) {
+    return;
+  }
+
+  if (isBuffered()) {
+    bufferedBumps_.erase(name);
+    bufferedSets_[name] = counter;
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
   thriftReq.counterSetParams_ref()->counters_ref()->emplace(name, counter);
@@ -47,7 +141,30 @@ ZmqMonitorClient::setCounter(
 }
 
 void
-ZmqMonitorClient::setCounters(CounterMap const& counters) {
+ZmqMonitorClient::setCounters(CounterMap const& allCounters) {
+  // Counters which don't fit into shared counter table go the regular way
+  CounterMap remaining;
+  if (sharedCounters_) {
+    for (auto const& kv : allCounters) {
+      if (not setSharedCounter(kv.first, kv.second)) {
+        remaining.emplace(kv.first, kv.second);
+      }
+    }
+    if (remaining.empty()) {
+      return;
+    }
+  }
+  auto const& counters = sharedCounters_ ? remaining : allCounters;
+
+  if (isBuffered()) {
+    for (auto const& kv : counters) {
+      bufferedBumps_.erase(kv.first);
+      bufferedSets_[kv.first] = kv.second;
+    }
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
   *thriftReq.counterSetParams_ref()->counters_ref() = counters;
@@ -59,8 +176,165 @@ ZmqMonitorClient::setCounters(CounterMap const& counters) {
   }
 }
 
+folly::Optional<std::map<std::string, int64_t>>
+ZmqMonitorClient::registerCounters(std::vector<std::string> const& names) {
+  flush();
+
+  for (auto const& name : names) {
+    if (nameHandles_.count(name) == 0) {
+      nameHandles_.emplace(name, handleNames_.size());
+      handleNames_.emplace_back(name);
+      handleMonitorIds_.emplace_back(-1);
+    }
+  }
+  if (not requestCounterIds(names)) {
+    return folly::none;
+  }
+
+  std::map<std::string, int64_t> handles;
+  for (auto const& name : names) {
+    handles.emplace(name, nameHandles_.at(name));
+  }
+  return handles;
+}
+
+bool
+ZmqMonitorClient::setCountersById(
+    std::map<int64_t, thrift::Counter> const& counters) {
+  flush();
+
+  // Ids are translated on every attempt as they change on re-registration
+  auto toMonitorIds = [this, &counters]() {
+    std::map<int64_t, thrift::Counter> monitorCounters;
+    for (auto const& kv : counters) {
+      if (kv.first < 0 or
+          static_cast<size_t>(kv.first) >= handleMonitorIds_.size() or
+          handleMonitorIds_[kv.first] < 0) {
+        VLOG(2) << "setCountersById: Ignoring unknown counter id " << kv.first;
+        continue;
+      }
+      monitorCounters.emplace(handleMonitorIds_[kv.first], kv.second);
+    }
+    return monitorCounters;
+  };
+
+  auto response = sendCountersById(toMonitorIds());
+  if (not response) {
+    return false;
+  }
+  if (*response->accepted_ref()) {
+    return true;
+  }
+
+  // ZmqMonitor restarted since registration, register all names again
+  LOG(WARNING) << "setCountersById: " << *response->error_ref()
+               << ". Registering counters again.";
+  if (not requestCounterIds(handleNames_)) {
+    return false;
+  }
+  response = sendCountersById(toMonitorIds());
+  if (not response) {
+    return false;
+  }
+  if (not *response->accepted_ref()) {
+    LOG(ERROR) << "setCountersById: " << *response->error_ref();
+    return false;
+  }
+  return true;
+}
+
+bool
+ZmqMonitorClient::requestCounterIds(std::vector<std::string> const& names) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::REGISTER_COUNTERS;
+  *thriftReq.counterRegisterParams_ref()->counterNames_ref() = names;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "registerCounters: error sending message "
+               << sendRet.error();
+    return false;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "registerCounters: error receiving message "
+               << respMsg.error();
+    return false;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::CounterIdsResponse>(serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "registerCounters: error reading message"
+               << response.error();
+    return false;
+  }
+
+  // Ids of all the other names are stale as well on a new epoch
+  const auto epoch = *response.value().epoch_ref();
+  const bool isNewEpoch = epoch != monitorEpoch_;
+  if (isNewEpoch) {
+    std::fill(handleMonitorIds_.begin(), handleMonitorIds_.end(), -1);
+    monitorEpoch_ = epoch;
+  }
+  for (auto const& kv : *response.value().counterIds_ref()) {
+    auto it = nameHandles_.find(kv.first);
+    if (it != nameHandles_.end()) {
+      handleMonitorIds_[it->second] = kv.second;
+    }
+  }
+  if (not isNewEpoch) {
+    return true;
+  }
+
+  std::vector<std::string> unmapped;
+  for (size_t i = 0; i < handleNames_.size(); ++i) {
+    if (handleMonitorIds_[i] < 0) {
+      unmapped.emplace_back(handleNames_[i]);
+    }
+  }
+  return unmapped.empty() or requestCounterIds(unmapped);
+}
+
+folly::Optional<thrift::CounterSetByIdResponse>
+ZmqMonitorClient::sendCountersById(
+    std::map<int64_t, thrift::Counter> const& counters) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES_BY_ID;
+  *thriftReq.counterSetByIdParams_ref()->counters_ref() = counters;
+  *thriftReq.counterSetByIdParams_ref()->epoch_ref() = monitorEpoch_;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "setCountersById: error sending message "
+               << sendRet.error();
+    return folly::none;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "setCountersById: error receiving message "
+               << respMsg.error();
+    return folly::none;
+  }
+
+  auto response = respMsg.value().readThriftObj<thrift::CounterSetByIdResponse>(
+      serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "setCountersById: error reading message"
+               << response.error();
+    return folly::none;
+  }
+  return std::move(response.value());
+}
+
 folly::Optional<thrift::Counter>
 ZmqMonitorClient::getCounter(std::string const& name) {
+  flush();
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
   thriftReq.counterGetParams_ref()->counterNames_ref()->emplace_back(name);
@@ -95,6 +369,8 @@ ZmqMonitorClient::getCounter(std::string const& name) {
 
 std::vector<std::string /* name */>
 ZmqMonitorClient::dumpCounterNames() {
+  flush();
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
 
@@ -124,6 +400,8 @@ ZmqMonitorClient::dumpCounterNames() {
 
 CounterMap
 ZmqMonitorClient::dumpCounters() {
+  flush();
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
 
@@ -152,11 +430,130 @@ ZmqMonitorClient::dumpCounters() {
   return *response.value().counters_ref();
 }
 
+folly::Optional<CounterMap>
+ZmqMonitorClient::CounterPageIterator::next() {
+  if (isDone_) {
+    return folly::none;
+  }
+
+  const bool isFirst = params_.cursor_ref()->empty();
+  auto page = client_.requestCounterPage(
+      thrift::MonitorCommand::GET_COUNTER_DATA_PAGE, params_);
+  if (not page) {
+    isDone_ = true;
+    return folly::none;
+  }
+
+  if (isFirst) {
+    dumpTime_ = *page->dumpTime_ref();
+  }
+  isDone_ = page->nextCursor_ref()->empty();
+  *params_.cursor_ref() = std::move(*page->nextCursor_ref());
+  return std::move(*page->counters_ref());
+}
+
+ZmqMonitorClient::CounterPageIterator
+ZmqMonitorClient::dumpCountersPaged(thrift::CounterDumpParams params) {
+  params.cursor_ref()->clear();
+  return CounterPageIterator(*this, std::move(params));
+}
+
+folly::Optional<int64_t>
+ZmqMonitorClient::streamCounters(
+    thrift::CounterDumpParams params,
+    folly::Function<void(CounterMap&&)> callback) {
+  params.cursor_ref()->clear();
+  auto page =
+      requestCounterPage(thrift::MonitorCommand::STREAM_COUNTER_DATA, params);
+  if (not page) {
+    return folly::none;
+  }
+
+  const int64_t dumpTime = *page->dumpTime_ref();
+  while (true) {
+    callback(std::move(*page->counters_ref()));
+    if (page->nextCursor_ref()->empty()) {
+      break;
+    }
+    page = recvCounterPage("streamCounters");
+    if (not page) {
+      return folly::none;
+    }
+  }
+  return dumpTime;
+}
+
+folly::Optional<thrift::CounterDumpPage>
+ZmqMonitorClient::requestCounterPage(
+    thrift::MonitorCommand cmd, thrift::CounterDumpParams const& params) {
+  flush();
+
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = cmd;
+  *thriftReq.counterDumpParams_ref() = params;
+
+  const auto sendRet = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (sendRet.hasError()) {
+    LOG(ERROR) << "requestCounterPage: error sending message "
+               << sendRet.error();
+    return folly::none;
+  }
+  return recvCounterPage("requestCounterPage");
+}
+
+folly::Optional<thrift::CounterDumpPage>
+ZmqMonitorClient::recvCounterPage(char const* caller) {
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << caller << ": error receiving message " << respMsg.error();
+    return folly::none;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::CounterDumpPage>(serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << caller << ": error reading message" << response.error();
+    return folly::none;
+  }
+  return std::move(response.value());
+}
+
 void
-ZmqMonitorClient::bumpCounter(std::string const& name) {
+ZmqMonitorClient::bumpCounter(std::string const& name, int64_t amount) {
+  if (sharedCounters_) {
+    auto slot = sharedCounters_->getSlot(name);
+    if (slot.hasValue()) {
+      sharedCounters_->bump(
+          slot.value(),
+          amount,
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::system_clock::now().time_since_epoch())
+              .count());
+      return;
+    }
+  }
+
+  if (isBuffered()) {
+    auto it = bufferedSets_.find(name);
+    if (it != bufferedSets_.end()) {
+      *it->second.value_ref() += amount;
+    } else {
+      bufferedBumps_[name] += amount;
+    }
+    maybeFlush();
+    return;
+  }
+
   thrift::MonitorRequest thriftReq;
-  *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER;
-  thriftReq.counterBumpParams_ref()->counterNames_ref()->emplace_back(name);
+  if (amount == 1) {
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER;
+    thriftReq.counterBumpParams_ref()->counterNames_ref()->emplace_back(name);
+  } else {
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER_VALUES;
+    thriftReq.counterBumpByParams_ref()->increments_ref()->emplace(
+        name, amount);
+  }
 
   const auto ret = monitorCmdSock_.sendOne(
       Message::fromThriftObj(thriftReq, serializer_).value());
@@ -166,6 +563,49 @@ ZmqMonitorClient::bumpCounter(std::string const& name) {
   }
 }
 
+void
+ZmqMonitorClient::flush() {
+  lastFlushTime_ = std::chrono::steady_clock::now();
+
+  if (not bufferedSets_.empty()) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+    *thriftReq.counterSetParams_ref()->counters_ref() =
+        std::move(bufferedSets_);
+    bufferedSets_.clear();
+
+    const auto ret = monitorCmdSock_.sendOne(
+        Message::fromThriftObj(thriftReq, serializer_).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "flush: error sending message " << ret.error();
+    }
+  }
+
+  if (not bufferedBumps_.empty()) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER_VALUES;
+    auto& increments = *thriftReq.counterBumpByParams_ref()->increments_ref();
+    increments.insert(bufferedBumps_.begin(), bufferedBumps_.end());
+    bufferedBumps_.clear();
+
+    const auto ret = monitorCmdSock_.sendOne(
+        Message::fromThriftObj(thriftReq, serializer_).value());
+    if (ret.hasError()) {
+      LOG(ERROR) << "flush: error sending message " << ret.error();
+    }
+  }
+}
+
+void
+ZmqMonitorClient::maybeFlush() {
+  if (bufferedSets_.size() + bufferedBumps_.size() >=
+          bufferOptions_.maxBufferedCounters or
+      std::chrono::steady_clock::now() - lastFlushTime_ >=
+          bufferOptions_.flushInterval) {
+    flush();
+  }
+}
+
 void
 ZmqMonitorClient::addEventLog(thrift::EventLog const& eventLog) {
   thrift::MonitorRequest thriftReq;
@@ -182,6 +622,8 @@ ZmqMonitorClient::addEventLog(thrift::EventLog const& eventLog) {
 
 folly::Optional<std::vector<thrift::EventLog>>
 ZmqMonitorClient::getLastEventLogs() {
+  flush();
+
   thrift::MonitorRequest thriftReq;
   *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_EVENT_LOGS;
 
@@ -209,4 +651,67 @@ ZmqMonitorClient::getLastEventLogs() {
   return *response.value().eventLogs_ref();
 }
 
+folly::Optional<thrift::EventLogQueryResponse>
+ZmqMonitorClient::queryEventLogs(thrift::EventLogQueryParams const& params) {
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::QUERY_EVENT_LOGS;
+  *thriftReq.eventLogQueryParams_ref() = params;
+
+  const auto ret = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "queryEventLogs: error sending message " << ret.error();
+    return folly::none;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "queryEventLogs: error receiving message "
+               << respMsg.error();
+    return folly::none;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::EventLogQueryResponse>(
+          serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "queryEventLogs: error reading message" << response.error();
+    return folly::none;
+  }
+
+  return std::move(response.value());
+}
+
+
+folly::Optional<thrift::MonitorSnapshot>
+ZmqMonitorClient::getSnapshot(std::string const& prefix) {
+  flush();
+
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_SNAPSHOT;
+  *thriftReq.snapshotParams_ref()->prefix_ref() = prefix;
+
+  const auto ret = monitorCmdSock_.sendOne(
+      Message::fromThriftObj(thriftReq, serializer_).value());
+  if (ret.hasError()) {
+    LOG(ERROR) << "getSnapshot: error sending message " << ret.error();
+    return folly::none;
+  }
+
+  const auto respMsg = monitorCmdSock_.recvOne();
+  if (respMsg.hasError()) {
+    LOG(ERROR) << "getSnapshot: error receiving message " << respMsg.error();
+    return folly::none;
+  }
+
+  auto response =
+      respMsg.value().readThriftObj<thrift::MonitorSnapshot>(serializer_);
+  if (response.hasError()) {
+    LOG(ERROR) << "getSnapshot: error reading message" << response.error();
+    return folly::none;
+  }
+
+  return std::move(response.value());
+}
+
 } // namespace fbzmq
@@ -7,15 +7,38 @@
 
 #pragma once
 
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
 #include <boost/serialization/strong_typedef.hpp>
 #include <fbzmq/zmq/Zmq.h>
+#include <folly/Function.h>
 #include <folly/Optional.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
+#include "SharedCounterTable.h"
 #include "ZmqMonitor.h"
 
 namespace fbzmq {
 
+/**
+ * Client side buffering of counter updates of ZmqMonitorClient. When enabled,
+ * `setCounter(s)` and `bumpCounter` only update a local buffer (bumps of a
+ * counter are coalesced into a single increment) which is flushed as a batch
+ * once it holds `maxBufferedCounters` counters or `flushInterval` has passed
+ * since the last flush. Interval is checked on updates, call `flush()`
+ * periodically if updates can stop for long.
+ */
+struct MonitorClientBufferOptions {
+  // Max number of buffered counters, 0 disables buffering
+  size_t maxBufferedCounters{0};
+
+  // Max time updates stay buffered (as long as updates keep on coming)
+  std::chrono::milliseconds flushInterval{1000};
+};
+
 /**
  * This class abstracts out many client side operations of ZmqMonitor into
  * very simple APIs to use.
@@ -32,7 +55,26 @@ class ZmqMonitorClient {
   ZmqMonitorClient(
       fbzmq::Context& zmqContext,
       std::string const& monitorCmdUrl,
-      std::string const& socketId = "");
+      std::string const& socketId = "",
+      MonitorClientBufferOptions bufferOptions = MonitorClientBufferOptions());
+
+  /**
+   * Flushes buffered counter updates
+   */
+  ~ZmqMonitorClient();
+
+  /**
+   * For a ZmqMonitor on the same host: create a shared memory counter table
+   * at `path` (a file, preferably on tmpfs e.g. /dev/shm) and have monitor
+   * map it. `setCounter(s)` and `bumpCounter` then write counters straight
+   * into the table (a few nanoseconds, no syscall or serialization) and
+   * monitor picks up changes when counters are read. Counters which don't fit
+   * into the table (`numSlots` are full or name is too long) keep on going
+   * over the socket. Counters written through the table must not be updated
+   * by other clients. Returns false if table couldn't be created or monitor
+   * couldn't map it, in which case client keeps working as before.
+   */
+  bool attachSharedCounters(std::string const& path, size_t numSlots = 4096);
 
   //
   // Synchronous wrapper calls around ZmqMonitor
@@ -45,6 +87,25 @@ class ZmqMonitorClient {
   void setCounter(std::string const& name, thrift::Counter const& counter);
   void setCounters(const CounterMap& counters);
 
+  /**
+   * Register counter names with ZmqMonitor and get their numeric ids. Ids
+   * can be used with `setCountersById` to avoid sending names on updates.
+   * Returns none on error.
+   *
+   * Ids are handles of this client, mapped onto ids of ZmqMonitor. They stay
+   * valid across restarts of ZmqMonitor, names are registered again whenever
+   * ZmqMonitor rejects ids of a past epoch.
+   */
+  folly::Optional<std::map<std::string /* name */, int64_t /* id */>>
+  registerCounters(std::vector<std::string> const& names);
+
+  /**
+   * Add counter(s) into ZmqMonitor by their ids. Unknown ids are ignored.
+   * Waits for ZmqMonitor to accept ids, and re-registers names and retries
+   * once if they are stale. Returns false on error.
+   */
+  bool setCountersById(std::map<int64_t, thrift::Counter> const& counters);
+
   /**
    * Get name from ZmqMonitor.
    */
@@ -61,9 +122,68 @@ class ZmqMonitorClient {
   CounterMap dumpCounters();
 
   /**
-   * Bump counter.
+   * Iterator over pages of a filtered counter dump. Pages are fetched from
+   * ZmqMonitor one at a time as `next()` is called.
+   *
+   *  auto pages = client.dumpCountersPaged(params);
+   *  while (auto counters = pages.next()) {
+   *    ...
+   *  }
+   */
+  class CounterPageIterator {
+   public:
+    /**
+     * Fetch the next page. Returns none after the last page or on error.
+     */
+    folly::Optional<CounterMap> next();
+
+    /**
+     * Time of the dump in ZmqMonitor (microseconds since epoch) as reported
+     * with the first page. Pass it as `changedSince` to only fetch counters
+     * which changed since.
+     */
+    int64_t
+    getDumpTime() const {
+      return dumpTime_;
+    }
+
+   private:
+    friend class ZmqMonitorClient;
+
+    CounterPageIterator(
+        ZmqMonitorClient& client, thrift::CounterDumpParams params)
+        : client_(client), params_(std::move(params)) {}
+
+    ZmqMonitorClient& client_;
+    thrift::CounterDumpParams params_;
+    int64_t dumpTime_{0};
+    bool isDone_{false};
+  };
+
+  /**
+   * Dump counters matching filters of `params` page by page.
+   */
+  CounterPageIterator dumpCountersPaged(thrift::CounterDumpParams params);
+
+  /**
+   * Dump counters matching filters of `params` with ZmqMonitor streaming all
+   * pages back to back. Callback is invoked for every page. Returns time of
+   * the dump (refer to `CounterPageIterator::getDumpTime`) or none on error.
+   */
+  folly::Optional<int64_t> streamCounters(
+      thrift::CounterDumpParams params,
+      folly::Function<void(CounterMap&&)> callback);
+
+  /**
+   * Bump counter, by `amount` instead of one if specified.
+   */
+  void bumpCounter(std::string const& name, int64_t amount = 1);
+
+  /**
+   * Send all buffered counter updates to ZmqMonitor. No-op if buffering is
+   * not enabled. Requests reading counters flush implicitly.
    */
-  void bumpCounter(std::string const& name);
+  void flush();
 
   /**
    * Add an event log.
@@ -75,7 +195,64 @@ class ZmqMonitorClient {
    */
   folly::Optional<std::vector<thrift::EventLog>> getLastEventLogs();
 
+  /**
+   * Get event logs matching filters of `params`. Pass `lastSeqNum` of a reply
+   * as `sinceSeqNum` of the next query to only get new event logs.
+   */
+  folly::Optional<thrift::EventLogQueryResponse> queryEventLogs(
+      thrift::EventLogQueryParams const& params);
+
+  /**
+   * Snapshot of counters with name starting with `prefix`, along with sequence
+   * number of the last publication it reflects. Late subscribers subscribe to
+   * publications first, then fetch a snapshot and apply publications with
+   * greater `seqNum` on top of it. Returns none on error.
+   */
+  folly::Optional<thrift::MonitorSnapshot> getSnapshot(
+      std::string const& prefix = "");
+
  private:
+  /**
+   * Receive a page of counter dump
+   */
+  folly::Optional<thrift::CounterDumpPage> recvCounterPage(char const* caller);
+
+  /**
+   * Send request for counter dump and receive the first page
+   */
+  folly::Optional<thrift::CounterDumpPage> requestCounterPage(
+      thrift::MonitorCommand cmd, thrift::CounterDumpParams const& params);
+
+  /**
+   * Set counter in shared counter table. Returns false if there is no table
+   * or counter doesn't fit into it.
+   */
+  bool setSharedCounter(
+      std::string const& name, thrift::Counter const& counter);
+
+  /**
+   * Request ids of `names` from ZmqMonitor and map handles of names onto
+   * them. Names of all the handles are registered again if epoch of ZmqMonitor
+   * has changed. Returns false on error.
+   */
+  bool requestCounterIds(std::vector<std::string> const& names);
+
+  /**
+   * Send counters by ids of ZmqMonitor. Returns reply or none on error.
+   */
+  folly::Optional<thrift::CounterSetByIdResponse> sendCountersById(
+      std::map<int64_t, thrift::Counter> const& counters);
+
+  /**
+   * Flush the buffer if it is full or flush interval has passed
+   */
+  void maybeFlush();
+
+  bool
+  isBuffered() const {
+    return bufferOptions_.maxBufferedCounters > 0;
+  }
+
   //
   // Mutable state
   //
@@ -87,6 +264,25 @@ class ZmqMonitorClient {
 
   // Serializer object for thrift-obj <-> string conversion
   apache::thrift::CompactSerializer serializer_;
+
+  const MonitorClientBufferOptions bufferOptions_;
+
+  // Buffered updates. A counter is either in sets or in bumps, bumps of a
+  // buffered set are applied on the set.
+  CounterMap bufferedSets_;
+  std::unordered_map<std::string, int64_t> bufferedBumps_;
+
+  std::chrono::steady_clock::time_point lastFlushTime_;
+
+  // Shared counter table, if attached
+  std::unique_ptr<SharedCounterTable> sharedCounters_;
+
+  // Registered counters. Handles (indices) are given out as ids and mapped
+  // onto ids of ZmqMonitor of `monitorEpoch_`, -1 until known.
+  std::vector<std::string> handleNames_;
+  std::vector<int64_t> handleMonitorIds_;
+  std::unordered_map<std::string, int64_t> nameHandles_;
+  int64_t monitorEpoch_{0};
 };
 
 } // namespace fbzmq
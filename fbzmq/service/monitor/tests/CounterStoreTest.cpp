@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/CounterStore.h>
+
+namespace fbzmq {
+
+namespace {
+
+thrift::Counter
+makeCounter(double value) {
+  thrift::Counter counter;
+  *counter.value_ref() = value;
+  *counter.valueType_ref() = thrift::CounterValueType::GAUGE;
+  *counter.timestamp_ref() = 1234;
+  return counter;
+}
+
+} // namespace
+
+TEST(CounterStoreTest, InternAndSet) {
+  CounterStore store;
+  EXPECT_EQ(CounterStore::kInvalidId, store.find("foo"));
+  EXPECT_FALSE(store.isLive(CounterStore::kInvalidId));
+
+  const auto fooId = store.intern("foo");
+  const auto barId = store.intern("bar");
+  EXPECT_NE(fooId, barId);
+  EXPECT_EQ(fooId, store.intern("foo"));
+  EXPECT_EQ(fooId, store.find("foo"));
+  EXPECT_EQ("foo", store.getName(fooId));
+  EXPECT_EQ(2, store.getNumIds());
+
+  // Interned counters have no value
+  EXPECT_EQ(0, store.size());
+  EXPECT_FALSE(store.get(fooId).hasValue());
+
+  const auto now = std::chrono::steady_clock::now();
+  store.set(fooId, makeCounter(10), now);
+  EXPECT_EQ(1, store.size());
+  EXPECT_EQ(makeCounter(10), store.get(fooId).value());
+  EXPECT_EQ(now, store.getUpdateTime(fooId));
+
+  store.set(fooId, makeCounter(20), now);
+  EXPECT_EQ(1, store.size());
+  EXPECT_EQ(20, *store.getLive(fooId).value_ref());
+}
+
+TEST(CounterStoreTest, Bump) {
+  CounterStore store;
+  const auto now = std::chrono::steady_clock::now();
+  const auto id = store.intern("foo");
+
+  auto counter = store.bump(id, now, 5678);
+  EXPECT_EQ(1, *counter.value_ref());
+  EXPECT_EQ(thrift::CounterValueType::COUNTER, *counter.valueType_ref());
+  EXPECT_EQ(5678, *counter.timestamp_ref());
+
+  counter = store.bump(id, now, 9999);
+  EXPECT_EQ(2, *counter.value_ref());
+  EXPECT_EQ(5678, *counter.timestamp_ref());
+
+  counter = store.bump(id, now, 9999, 40);
+  EXPECT_EQ(42, *counter.value_ref());
+
+  // Bumping a gauge keeps its type
+  store.set(id, makeCounter(10), now);
+  counter = store.bump(id, now, 0);
+  EXPECT_EQ(11, *counter.value_ref());
+  EXPECT_EQ(thrift::CounterValueType::GAUGE, *counter.valueType_ref());
+}
+
+TEST(CounterStoreTest, PurgeAndForEach) {
+  CounterStore store;
+  const auto now = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100; ++i) {
+    const auto id = store.intern(std::to_string(i));
+    store.set(
+        id, makeCounter(i), now - std::chrono::seconds(i % 2 ? 100 : 0));
+  }
+  EXPECT_EQ(100, store.size());
+
+  std::vector<std::string> purged;
+  EXPECT_EQ(
+      50,
+      store.purge(
+          now - std::chrono::seconds(10), [&](CounterStore::CounterId id) {
+            purged.emplace_back(store.getName(id));
+          }));
+  EXPECT_EQ(50, purged.size());
+  EXPECT_EQ(50, store.size());
+
+  size_t numLive{0};
+  store.forEach([&](CounterStore::CounterId id) {
+    ++numLive;
+    EXPECT_EQ(0, std::stoi(store.getName(id)) % 2);
+  });
+  EXPECT_EQ(50, numLive);
+  const auto names = store.getNames();
+  ASSERT_EQ(50, names.size());
+  EXPECT_EQ("0", names.front());
+  EXPECT_EQ("98", names.back());
+
+  // Ids of expired counters are retained
+  const auto id = store.find("1");
+  EXPECT_TRUE(store.isValid(id));
+  EXPECT_FALSE(store.isLive(id));
+  store.set(store.intern("1"), makeCounter(1), now);
+  EXPECT_EQ(id, store.find("1"));
+  EXPECT_EQ(51, store.size());
+}
+
+TEST(CounterStoreTest, ExpiryOrder) {
+  CounterStore store;
+  const auto now = std::chrono::steady_clock::now();
+  EXPECT_FALSE(store.getOldestUpdateTime().has_value());
+
+  // In order, out of order and updated counters
+  for (int i = 0; i < 10; ++i) {
+    store.set(
+        store.intern(std::to_string(i)),
+        makeCounter(i),
+        now + std::chrono::seconds(i));
+  }
+  store.set(store.intern("old"), makeCounter(0), now - std::chrono::seconds(1));
+  store.set(store.find("5"), makeCounter(5), now + std::chrono::seconds(20));
+  store.bump(store.find("2"), now + std::chrono::seconds(15), 0);
+  EXPECT_EQ(now - std::chrono::seconds(1), store.getOldestUpdateTime());
+
+  std::vector<std::string> purged;
+  auto purge = [&](std::chrono::seconds cutoff) {
+    purged.clear();
+    store.purge(now + cutoff, [&](CounterStore::CounterId id) {
+      purged.emplace_back(store.getName(id));
+    });
+  };
+  purge(std::chrono::seconds(4));
+  EXPECT_EQ(std::vector<std::string>({"old", "0", "1", "3"}), purged);
+  EXPECT_EQ(now + std::chrono::seconds(4), store.getOldestUpdateTime());
+
+  purge(std::chrono::seconds(16));
+  EXPECT_EQ(
+      std::vector<std::string>({"4", "6", "7", "8", "9", "2"}), purged);
+  EXPECT_EQ(1, store.size());
+
+  // Expired counter is linked again when set
+  store.set(store.find("0"), makeCounter(0), now + std::chrono::seconds(30));
+  purge(std::chrono::seconds(40));
+  EXPECT_EQ(std::vector<std::string>({"5", "0"}), purged);
+  EXPECT_EQ(0, store.size());
+  EXPECT_FALSE(store.getOldestUpdateTime().has_value());
+}
+
+TEST(CounterStoreTest, ForEachByName) {
+  CounterStore store;
+  const auto now = std::chrono::steady_clock::now();
+
+  // Interned out of order, one of them expired
+  for (auto name : {"b.2", "a.1", "b.1", "c.1", "b.3", "a.2"}) {
+    store.set(store.intern(name), makeCounter(0), now);
+  }
+  store.set(store.find("b.2"), makeCounter(0), now - std::chrono::seconds(1));
+  store.purge(now, [](CounterStore::CounterId) {});
+
+  std::vector<std::string> names;
+  auto visit = [&](folly::StringPiece from, size_t limit) {
+    names.clear();
+    store.forEachByName(from, [&](CounterStore::CounterId id) {
+      names.emplace_back(store.getName(id));
+      return names.size() < limit;
+    });
+  };
+  visit("", 100);
+  EXPECT_EQ(
+      std::vector<std::string>({"a.1", "a.2", "b.1", "b.3", "c.1"}), names);
+
+  // Seek to a name (interned or not) and stop early
+  visit("b", 2);
+  EXPECT_EQ(std::vector<std::string>({"b.1", "b.3"}), names);
+  visit("b.2", 100);
+  EXPECT_EQ(std::vector<std::string>({"b.3", "c.1"}), names);
+  visit("d", 100);
+  EXPECT_TRUE(names.empty());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
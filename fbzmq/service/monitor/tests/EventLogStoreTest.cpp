@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/EventLogStore.h>
+
+namespace fbzmq {
+
+namespace {
+
+thrift::EventLog
+createEventLog(std::string const& category, std::string const& sample) {
+  thrift::EventLog eventLog;
+  *eventLog.category_ref() = category;
+  eventLog.samples_ref()->emplace_back(sample);
+  return eventLog;
+}
+
+thrift::EventLogQueryParams
+createParams(
+    std::string const& category = "",
+    int64_t sinceSeqNum = 0,
+    int64_t sinceTimestamp = 0,
+    int32_t limit = 0) {
+  thrift::EventLogQueryParams params;
+  *params.category_ref() = category;
+  *params.sinceSeqNum_ref() = sinceSeqNum;
+  *params.sinceTimestamp_ref() = sinceTimestamp;
+  *params.limit_ref() = limit;
+  return params;
+}
+
+std::vector<std::string>
+getSamples(thrift::EventLogQueryResponse const& response) {
+  std::vector<std::string> samples;
+  for (auto const& eventLog : *response.eventLogs_ref()) {
+    samples.emplace_back(eventLog.samples_ref()->at(0));
+  }
+  return samples;
+}
+
+} // namespace
+
+TEST(EventLogStoreTest, RingBuffer) {
+  EventLogStore store(3);
+  EXPECT_EQ(3, store.getCapacity());
+  EXPECT_EQ(0, store.size());
+  EXPECT_EQ(0, store.getLastSeqNum());
+  EXPECT_TRUE(store.getAll().empty());
+
+  EXPECT_EQ(1, store.add(createEventLog("a", "1"), 100));
+  EXPECT_EQ(2, store.add(createEventLog("b", "2"), 200));
+  EXPECT_EQ(3, store.add(createEventLog("a", "3"), 300));
+  EXPECT_EQ(3, store.size());
+  EXPECT_EQ(1, store.getFirstSeqNum());
+
+  // Oldest event logs are overwritten
+  EXPECT_EQ(4, store.add(createEventLog("a", "4"), 400));
+  EXPECT_EQ(5, store.add(createEventLog("c", "5"), 500));
+  EXPECT_EQ(3, store.size());
+  EXPECT_EQ(3, store.getFirstSeqNum());
+  EXPECT_EQ(5, store.getLastSeqNum());
+
+  auto all = store.getAll();
+  ASSERT_EQ(3, all.size());
+  EXPECT_EQ("a", *all[0].category_ref());
+  EXPECT_EQ("3", all[0].samples_ref()->at(0));
+  EXPECT_EQ("c", *all[2].category_ref());
+
+  // Category "b" has been dropped along with its only event log
+  EXPECT_TRUE(store.query(createParams("b")).eventLogs_ref()->empty());
+  EXPECT_EQ(
+      std::vector<std::string>({"3", "4"}),
+      getSamples(store.query(createParams("a"))));
+}
+
+TEST(EventLogStoreTest, Query) {
+  EventLogStore store(100);
+  for (int i = 1; i <= 10; ++i) {
+    store.add(
+        createEventLog(i % 2 ? "odd" : "even", std::to_string(i)), i * 100);
+  }
+
+  // Everything
+  auto response = store.query(createParams());
+  EXPECT_EQ(10, response.eventLogs_ref()->size());
+  EXPECT_EQ(1, *response.firstSeqNum_ref());
+  EXPECT_EQ(10, *response.lastSeqNum_ref());
+  EXPECT_EQ(1, response.seqNums_ref()->front());
+  EXPECT_EQ(10, response.seqNums_ref()->back());
+
+  // Since sequence number
+  EXPECT_EQ(
+      std::vector<std::string>({"9", "10"}),
+      getSamples(store.query(createParams("", 8))));
+  EXPECT_TRUE(store.query(createParams("", 10)).eventLogs_ref()->empty());
+
+  // Since timestamp
+  EXPECT_EQ(
+      std::vector<std::string>({"8", "9", "10"}),
+      getSamples(store.query(createParams("", 0, 750))));
+  EXPECT_EQ(
+      std::vector<std::string>({"4", "6", "8", "10"}),
+      getSamples(store.query(createParams("even", 0, 400))));
+
+  // Category with limit, tailing with lastSeqNum
+  response = store.query(createParams("odd", 0, 0, 2));
+  EXPECT_EQ(std::vector<std::string>({"1", "3"}), getSamples(response));
+  EXPECT_EQ(3, *response.lastSeqNum_ref());
+  response = store.query(createParams("odd", *response.lastSeqNum_ref(), 0, 2));
+  EXPECT_EQ(std::vector<std::string>({"5", "7"}), getSamples(response));
+  response = store.query(createParams("odd", *response.lastSeqNum_ref(), 0, 2));
+  EXPECT_EQ(std::vector<std::string>({"9"}), getSamples(response));
+  EXPECT_EQ(10, *response.lastSeqNum_ref());
+  store.add(createEventLog("odd", "11"), 1100);
+  response = store.query(createParams("odd", *response.lastSeqNum_ref(), 0, 2));
+  EXPECT_EQ(std::vector<std::string>({"11"}), getSamples(response));
+
+  // Unknown category
+  EXPECT_TRUE(store.query(createParams("none")).eventLogs_ref()->empty());
+}
+
+TEST(EventLogStoreTest, NonMonotonicTimestamps) {
+  EventLogStore store(10);
+  store.add(createEventLog("a", "1"), 500);
+  // Receive time never goes backwards
+  store.add(createEventLog("a", "2"), 100);
+  store.add(createEventLog("a", "3"), 600);
+  EXPECT_EQ(
+      std::vector<std::string>({"1", "2", "3"}),
+      getSamples(store.query(createParams("", 0, 500))));
+  EXPECT_EQ(
+      std::vector<std::string>({"3"}),
+      getSamples(store.query(createParams("", 0, 501))));
+}
+
+TEST(EventLogStoreTest, ZeroCapacity) {
+  EventLogStore store(0);
+  EXPECT_EQ(1, store.add(createEventLog("a", "1"), 100));
+  EXPECT_EQ(0, store.size());
+  auto response = store.query(createParams());
+  EXPECT_TRUE(response.eventLogs_ref()->empty());
+  EXPECT_EQ(2, *response.firstSeqNum_ref());
+  EXPECT_EQ(1, *response.lastSeqNum_ref());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/SharedCounterTable.h>
+
+namespace fbzmq {
+
+namespace {
+
+std::string
+getTablePath(std::string const& name) {
+  return "/tmp/fbzmq_" + name + "_" + std::to_string(::getpid());
+}
+
+thrift::Counter
+createCounter(double value, int64_t timestamp = 0) {
+  thrift::Counter counter;
+  *counter.value_ref() = value;
+  *counter.valueType_ref() = thrift::CounterValueType::GAUGE;
+  *counter.timestamp_ref() = timestamp;
+  return counter;
+}
+
+std::map<std::string, thrift::Counter>
+readChanged(SharedCounterTable& table) {
+  std::map<std::string, thrift::Counter> counters;
+  table.forEachChanged([&](SharedCounterTable::SlotValue const& value) {
+    counters[value.name.str()] = value.counter;
+  });
+  return counters;
+}
+
+} // namespace
+
+TEST(SharedCounterTableTest, ApiTest) {
+  const auto path = getTablePath("api");
+  auto writer = SharedCounterTable::create(path, 2);
+  ASSERT_TRUE(writer.hasValue());
+  auto reader = SharedCounterTable::open(path);
+  ASSERT_TRUE(reader.hasValue());
+  EXPECT_EQ(2, reader.value()->getNumSlots());
+
+  // Slots are stable and limited
+  auto fooSlot = writer.value()->getSlot("foo");
+  ASSERT_TRUE(fooSlot.hasValue());
+  EXPECT_EQ(fooSlot.value(), writer.value()->getSlot("foo").value());
+  EXPECT_FALSE(
+      writer.value()
+          ->getSlot(std::string(SharedCounterTable::kMaxNameLength + 1, 'x'))
+          .hasValue());
+  auto barSlot = writer.value()->getSlot("bar");
+  ASSERT_TRUE(barSlot.hasValue());
+  EXPECT_FALSE(writer.value()->getSlot("baz").hasValue());
+  EXPECT_EQ(2, reader.value()->getNumUsedSlots());
+
+  // Nothing to report until a counter is written
+  EXPECT_TRUE(readChanged(*reader.value()).empty());
+
+  writer.value()->set(fooSlot.value(), createCounter(1.5, 10));
+  writer.value()->bump(barSlot.value(), 2, 20);
+  writer.value()->bump(barSlot.value(), 3, 30);
+  auto counters = readChanged(*reader.value());
+  ASSERT_EQ(2, counters.size());
+  EXPECT_EQ(1.5, *counters.at("foo").value_ref());
+  EXPECT_EQ(10, *counters.at("foo").timestamp_ref());
+  EXPECT_EQ(
+      thrift::CounterValueType::GAUGE, *counters.at("foo").valueType_ref());
+  EXPECT_EQ(5, *counters.at("bar").value_ref());
+  EXPECT_EQ(20, *counters.at("bar").timestamp_ref());
+  EXPECT_EQ(
+      thrift::CounterValueType::COUNTER, *counters.at("bar").valueType_ref());
+
+  // Only changes are reported
+  EXPECT_TRUE(readChanged(*reader.value()).empty());
+  writer.value()->bump(barSlot.value(), 1, 0);
+  counters = readChanged(*reader.value());
+  ASSERT_EQ(1, counters.size());
+  EXPECT_EQ(6, *counters.at("bar").value_ref());
+
+  // Writer removes the file, reader keeps its mapping
+  EXPECT_FALSE(reader.value()->isRemoved());
+  writer.value().reset();
+  EXPECT_TRUE(reader.value()->isRemoved());
+  EXPECT_EQ(2, reader.value()->getNumUsedSlots());
+  EXPECT_FALSE(SharedCounterTable::open(path).hasValue());
+}
+
+TEST(SharedCounterTableTest, InvalidTable) {
+  EXPECT_FALSE(SharedCounterTable::open(getTablePath("missing")).hasValue());
+  EXPECT_FALSE(
+      SharedCounterTable::create(getTablePath("empty"), 0).hasValue());
+
+  const auto path = getTablePath("invalid");
+  FILE* file = ::fopen(path.c_str(), "w");
+  ASSERT_NE(nullptr, file);
+  ::fputs(std::string(1024, 'x').c_str(), file);
+  ::fclose(file);
+  EXPECT_FALSE(SharedCounterTable::open(path).hasValue());
+  ::unlink(path.c_str());
+}
+
+TEST(SharedCounterTableTest, ConcurrentReader) {
+  const auto path = getTablePath("concurrent");
+  auto writer = std::move(SharedCounterTable::create(path, 1).value());
+  auto reader = std::move(SharedCounterTable::open(path).value());
+  const auto slot = writer->getSlot("counter").value();
+
+  // Value and timestamp are always written together, reader must never see
+  // them torn apart
+  const int64_t kNumUpdates{200000};
+  std::atomic<bool> isDone{false};
+  std::thread readerThread([&]() {
+    double lastValue = 0;
+    while (not isDone.load()) {
+      reader->forEachChanged([&](SharedCounterTable::SlotValue const& value) {
+        EXPECT_EQ(
+            *value.counter.value_ref(),
+            static_cast<double>(*value.counter.timestamp_ref()));
+        EXPECT_LE(lastValue, *value.counter.value_ref());
+        lastValue = *value.counter.value_ref();
+      });
+    }
+  });
+
+  for (int64_t i = 1; i <= kNumUpdates; ++i) {
+    writer->set(slot, createCounter(i, i));
+  }
+  isDone = true;
+  readerThread.join();
+
+  // Last update is reported unless reader has seen it already
+  auto counters = readChanged(*reader);
+  if (not counters.empty()) {
+    EXPECT_EQ(kNumUpdates, *counters.at("counter").value_ref());
+  }
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/Format.h>
+#include <folly/Function.h>
+
+#include <fbzmq/service/monitor/ZmqMonitor.h>
+#include <fbzmq/service/monitor/ZmqMonitorAggregator.h>
+#include <fbzmq/service/monitor/ZmqMonitorClient.h>
+
+using namespace fbzmq;
+
+namespace {
+
+/**
+ * Event loop running in its own thread for the lifetime of the object
+ */
+template <typename EventLoop>
+class LoopThread {
+ public:
+  template <typename... Args>
+  explicit LoopThread(Args&&... args)
+      : evl(std::make_unique<EventLoop>(std::forward<Args>(args)...)) {
+    thread = std::thread([this]() { evl->run(); });
+    evl->waitUntilRunning();
+  }
+
+  ~LoopThread() {
+    evl->stop();
+    thread.join();
+  }
+
+  std::unique_ptr<EventLoop> evl;
+  std::thread thread;
+};
+
+std::string
+submitUrl(std::string const& name) {
+  return folly::sformat("inproc://{}-rep", name);
+}
+
+std::string
+pubUrl(std::string const& name) {
+  return folly::sformat("inproc://{}-pub", name);
+}
+
+std::unique_ptr<LoopThread<ZmqMonitor>>
+makeMonitor(Context& context, std::string const& name) {
+  return std::make_unique<LoopThread<ZmqMonitor>>(
+      submitUrl(name), pubUrl(name), context);
+}
+
+thrift::Counter
+makeCounter(double value) {
+  thrift::Counter counter;
+  *counter.value_ref() = value;
+  *counter.valueType_ref() = thrift::CounterValueType::GAUGE;
+  return counter;
+}
+
+/**
+ * Poll counters of a monitor until `predicate` holds, returns last counters
+ */
+CounterMap
+waitForCounters(
+    ZmqMonitorClient& client,
+    folly::Function<bool(CounterMap const&)> predicate) {
+  CounterMap counters;
+  for (int i = 0; i < 100; ++i) {
+    counters = client.dumpCounters();
+    if (predicate(counters)) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return counters;
+}
+
+bool
+hasValue(CounterMap const& counters, std::string const& name, double value) {
+  auto it = counters.find(name);
+  return it != counters.end() and *it->second.value_ref() == value;
+}
+
+} // namespace
+
+TEST(ZmqMonitorAggregatorTest, MergeAndAggregate) {
+  Context context;
+  auto monitor1 = makeMonitor(context, "monitor1");
+  auto monitor2 = makeMonitor(context, "monitor2");
+  ZmqMonitorClient client1(context, submitUrl("monitor1"));
+  ZmqMonitorClient client2(context, submitUrl("monitor2"));
+
+  // Published before aggregator subscribes, picked up from snapshot
+  client1.setCounter("foo.requests", makeCounter(1));
+  client1.setCounter("foo.latency", makeCounter(10));
+  client1.setCounter("bar", makeCounter(7));
+  client1.getCounter("bar");
+
+  MonitorAggregatorOptions options;
+  options.aggregations = {
+      {"foo.requests", CounterAggregation::SUM},
+      {"foo.", CounterAggregation::MAX},
+  };
+  LoopThread<ZmqMonitorAggregator> aggregator(
+      submitUrl("aggregator"),
+      pubUrl("aggregator"),
+      std::vector<MonitorAggregatorSource>{
+          {"m1", pubUrl("monitor1"), submitUrl("monitor1")},
+          {"m2", pubUrl("monitor2"), submitUrl("monitor2")},
+      },
+      context,
+      options);
+  ZmqMonitorClient aggregatorClient(context, submitUrl("aggregator"));
+
+  // Second level aggregator keeps aggregates only
+  MonitorAggregatorOptions topOptions;
+  topOptions.aggregations = {{"foo.requests", CounterAggregation::SUM}};
+  topOptions.keepSourceCounters = false;
+  LoopThread<ZmqMonitorAggregator> topAggregator(
+      submitUrl("top"),
+      pubUrl("top"),
+      std::vector<MonitorAggregatorSource>{
+          {"aggregator", pubUrl("aggregator"), submitUrl("aggregator")},
+      },
+      context,
+      topOptions);
+  ZmqMonitorClient topClient(context, submitUrl("top"));
+
+  // Snapshot of monitor1
+  auto counters =
+      waitForCounters(aggregatorClient, [](CounterMap const& result) {
+        return hasValue(result, "foo.requests", 1);
+      });
+  EXPECT_TRUE(hasValue(counters, "m1:foo.requests", 1));
+  EXPECT_TRUE(hasValue(counters, "m1:foo.latency", 10));
+  EXPECT_TRUE(hasValue(counters, "m1:bar", 7));
+  EXPECT_TRUE(hasValue(counters, "foo.latency", 10));
+  // Not aggregated
+  EXPECT_EQ(0, counters.count("bar"));
+
+  // Publications of both monitors
+  client2.setCounter("foo.requests", makeCounter(2));
+  client2.setCounter("foo.latency", makeCounter(20));
+  counters = waitForCounters(aggregatorClient, [](CounterMap const& result) {
+    return hasValue(result, "foo.requests", 3) and
+        hasValue(result, "foo.latency", 20);
+  });
+  EXPECT_TRUE(hasValue(counters, "m2:foo.requests", 2));
+  EXPECT_TRUE(hasValue(counters, "foo.requests", 3));
+  EXPECT_TRUE(hasValue(counters, "foo.latency", 20));
+
+  // Max drops along with the value of its source
+  client2.setCounter("foo.latency", makeCounter(5));
+  counters = waitForCounters(aggregatorClient, [](CounterMap const& result) {
+    return hasValue(result, "foo.latency", 10);
+  });
+  EXPECT_TRUE(hasValue(counters, "foo.latency", 10));
+  EXPECT_TRUE(hasValue(counters, "m2:foo.latency", 5));
+
+  // Aggregates of the level below are aggregated, tagged counters are not
+  counters = waitForCounters(topClient, [](CounterMap const& result) {
+    return hasValue(result, "foo.requests", 3);
+  });
+  EXPECT_TRUE(hasValue(counters, "foo.requests", 3));
+  EXPECT_EQ(1, counters.size());
+
+  // Event logs are tagged with their source
+  thrift::EventLog eventLog;
+  *eventLog.category_ref() = "category";
+  eventLog.samples_ref()->emplace_back("sample");
+  client1.addEventLog(eventLog);
+  std::vector<thrift::EventLog> eventLogs;
+  for (int i = 0; i < 100 and eventLogs.empty(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    eventLogs = aggregatorClient.getLastEventLogs().value();
+  }
+  ASSERT_EQ(1, eventLogs.size());
+  EXPECT_EQ("m1:category", *eventLogs.at(0).category_ref());
+  EXPECT_EQ(*eventLog.samples_ref(), *eventLogs.at(0).samples_ref());
+}
+
+TEST(ZmqMonitorAggregatorTest, Resync) {
+  Context context;
+  auto monitor = makeMonitor(context, "resync-monitor");
+
+  LoopThread<ZmqMonitorAggregator> aggregator(
+      submitUrl("resync-aggregator"),
+      pubUrl("resync-aggregator"),
+      std::vector<MonitorAggregatorSource>{
+          {"m", pubUrl("resync-monitor"), submitUrl("resync-monitor")},
+      },
+      context);
+  ZmqMonitorClient aggregatorClient(context, submitUrl("resync-aggregator"));
+
+  {
+    ZmqMonitorClient client(context, submitUrl("resync-monitor"));
+    client.setCounter("foo", makeCounter(1));
+    auto counters =
+        waitForCounters(aggregatorClient, [](CounterMap const& result) {
+          return hasValue(result, "m:foo", 1);
+        });
+    EXPECT_TRUE(hasValue(counters, "m:foo", 1));
+  }
+
+  // Restarted monitor numbers its publications from 1 again, aggregator
+  // syncs with its snapshot
+  monitor.reset();
+  monitor = makeMonitor(context, "resync-monitor");
+  ZmqMonitorClient client(context, submitUrl("resync-monitor"));
+  client.setCounter("bar", makeCounter(2));
+  client.getCounter("bar");
+  client.setCounter("baz", makeCounter(3));
+  auto counters =
+      waitForCounters(aggregatorClient, [](CounterMap const& result) {
+        return hasValue(result, "m:bar", 2) and hasValue(result, "m:baz", 3);
+      });
+  EXPECT_TRUE(hasValue(counters, "m:bar", 2));
+  EXPECT_TRUE(hasValue(counters, "m:baz", 3));
+}
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
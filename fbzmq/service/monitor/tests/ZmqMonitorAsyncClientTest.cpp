@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <folly/futures/Future.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/monitor/ZmqMonitorAsyncClient.h>
+#include <fbzmq/service/monitor/ZmqMonitorClient.h>
+
+namespace fbzmq {
+
+namespace {
+
+const std::string kMonitorCmdUrl{"inproc://async-monitor-rep"};
+const std::string kMonitorPubUrl{"inproc://async-monitor-pub"};
+
+thrift::Counter
+createCounter(int64_t value) {
+  thrift::Counter counter;
+  *counter.value_ref() = value;
+  return counter;
+}
+
+} // namespace
+
+class ZmqMonitorAsyncClientFixture : public ::testing::Test {
+ public:
+  void
+  SetUp() override {
+    monitor_ =
+        std::make_unique<ZmqMonitor>(kMonitorCmdUrl, kMonitorPubUrl, context_);
+    monitorThread_ = std::thread([this]() { monitor_->run(); });
+    monitor_->waitUntilRunning();
+  }
+
+  void
+  TearDown() override {
+    monitor_->stop();
+    monitorThread_.join();
+  }
+
+  Context context_;
+  std::unique_ptr<ZmqMonitor> monitor_;
+  std::thread monitorThread_;
+};
+
+TEST_F(ZmqMonitorAsyncClientFixture, PipelinedRequests) {
+  ZmqEventLoop evl;
+  auto client =
+      std::make_unique<ZmqMonitorAsyncClient>(evl, context_, kMonitorCmdUrl);
+  std::thread evlThread([&evl]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  CounterMap counters;
+  for (int i = 0; i < 100; ++i) {
+    counters.emplace("counter" + std::to_string(i), createCounter(i));
+  }
+  client->setCounters(counters);
+  client->bumpCounter("bumped");
+
+  // Many requests in flight at once
+  std::vector<folly::SemiFuture<folly::Optional<thrift::Counter>>> futures;
+  for (int i = 0; i < 100; ++i) {
+    futures.emplace_back(client->getCounter("counter" + std::to_string(i)));
+  }
+  auto dumpFuture = client->dumpCounters();
+  auto namesFuture = client->dumpCounterNames();
+  auto missingFuture = client->getCounter("missing");
+
+  auto results = folly::collectAll(std::move(futures)).get();
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(results[i].hasValue());
+    ASSERT_TRUE(results[i].value().hasValue());
+    EXPECT_EQ(i, *results[i].value()->value_ref());
+  }
+  auto dump = std::move(dumpFuture).get();
+  EXPECT_EQ(100, dump.count("counter99"));
+  EXPECT_EQ(1, *dump.at("bumped").value_ref());
+  EXPECT_LT(100, std::move(namesFuture).get().size());
+  EXPECT_FALSE(std::move(missingFuture).get().hasValue());
+
+  // Ids and pages
+  auto ids = client->registerCounters({"counter1", "new_counter"}).get();
+  EXPECT_EQ(2, ids.size());
+  thrift::CounterDumpParams params;
+  *params.prefix_ref() = "counter1";
+  auto page = client->getCounterPage(params).get();
+  EXPECT_EQ(11, page.counters_ref()->size()); // counter1, counter10-19
+
+  // Synchronous client on the same monitor is unaffected
+  ZmqMonitorClient syncClient(context_, kMonitorCmdUrl);
+  EXPECT_EQ(5, *syncClient.getCounter("counter5")->value_ref());
+
+  evl.runInEventLoop([&]() {
+    EXPECT_EQ(0, client->getNumPendingRequests());
+    client.reset();
+    evl.stop();
+  });
+  evlThread.join();
+}
+
+TEST_F(ZmqMonitorAsyncClientFixture, Timeout) {
+  ZmqEventLoop evl;
+
+  // Nobody is listening at this url
+  auto client = std::make_unique<ZmqMonitorAsyncClient>(
+      evl, context_, "inproc://async-monitor-nowhere");
+  std::thread evlThread([&evl]() { evl.run(); });
+  evl.waitUntilRunning();
+
+  const auto start = std::chrono::steady_clock::now();
+  auto result = client->dumpCounters(std::chrono::milliseconds(100)).getTry();
+  EXPECT_TRUE(result.hasException<folly::FutureTimeout>());
+  EXPECT_LE(
+      std::chrono::milliseconds(100), std::chrono::steady_clock::now() - start);
+
+  // Pending requests are broken on destruction
+  auto pending = client->dumpCounters(std::chrono::seconds(60));
+  evl.runInEventLoop([&]() {
+    EXPECT_EQ(1, client->getNumPendingRequests());
+    client.reset();
+    evl.stop();
+  });
+  evlThread.join();
+  auto pendingResult = std::move(pending).getTry();
+  EXPECT_TRUE(pendingResult.hasException<folly::BrokenPromise>());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
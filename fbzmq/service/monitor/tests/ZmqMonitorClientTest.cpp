@@ -7,10 +7,18 @@
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <set>
 #include <thread>
 
+#include <folly/Format.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
+#include <fbzmq/service/logging/LogSample.h>
+#include <fbzmq/service/monitor/TraceReporter.h>
 #include <fbzmq/service/monitor/ZmqMonitorClient.h>
 
 using namespace std;
@@ -196,6 +204,464 @@ TEST(ZmqMonitorClientTest, BasicOperation) {
   EXPECT_EQ("log1", lastEventLogs->at(0).samples_ref()[0]);
   EXPECT_EQ("log2", lastEventLogs->at(0).samples_ref()[1]);
   LOG(INFO) << "done with last event logs...";
+
+  // query event logs incrementally
+  *eventLog.category_ref() = "other_category";
+  zmqMonitorClient->addEventLog(eventLog);
+  *eventLog.category_ref() = "log_category";
+  zmqMonitorClient->addEventLog(eventLog);
+
+  thrift::EventLogQueryParams queryParams;
+  *queryParams.category_ref() = "log_category";
+  *queryParams.limit_ref() = 1;
+  auto queryResult = zmqMonitorClient->queryEventLogs(queryParams);
+  ASSERT_TRUE(queryResult.hasValue());
+  ASSERT_EQ(1, queryResult->eventLogs_ref()->size());
+  EXPECT_EQ(1, queryResult->seqNums_ref()->at(0));
+
+  *queryParams.sinceSeqNum_ref() = *queryResult->lastSeqNum_ref();
+  queryResult = zmqMonitorClient->queryEventLogs(queryParams);
+  ASSERT_TRUE(queryResult.hasValue());
+  ASSERT_EQ(1, queryResult->eventLogs_ref()->size());
+  EXPECT_EQ(3, queryResult->seqNums_ref()->at(0));
+  EXPECT_EQ(3, *queryResult->lastSeqNum_ref());
+  LOG(INFO) << "done with event log queries...";
+}
+
+TEST(ZmqMonitorClientTest, PagedDump) {
+  Context context;
+
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-paged-rep"},
+      std::string{"inproc://monitor-paged-pub"},
+      context,
+      folly::none, // logSampleToMerge
+      kAlivenessCheckInterval,
+      kMaxLogEvents,
+      kProfilingStatInterval,
+      3 // numShards
+  );
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  ZmqMonitorClient client(context, std::string{"inproc://monitor-paged-rep"});
+
+  CounterMap initCounters;
+  for (int i = 0; i < 250; ++i) {
+    thrift::Counter counter;
+    *counter.value_ref() = i;
+    initCounters[folly::sformat("app.c{:03d}", i)] = counter;
+  }
+  initCounters["other.counter"] = thrift::Counter();
+  client.setCounters(initCounters);
+
+  // Paginated dump by prefix. Pages are ordered by name.
+  thrift::CounterDumpParams params;
+  *params.prefix_ref() = "app.";
+  *params.pageSize_ref() = 100;
+  auto pages = client.dumpCountersPaged(params);
+  std::vector<size_t> pageSizes;
+  std::string lastName;
+  CounterMap allCounters;
+  while (auto page = pages.next()) {
+    pageSizes.emplace_back(page->size());
+    for (auto& kv : *page) {
+      EXPECT_LT(lastName, kv.first);
+      allCounters.emplace(kv.first, kv.second);
+    }
+    for (auto& kv : *page) {
+      lastName = std::max(lastName, kv.first);
+    }
+  }
+  EXPECT_EQ(std::vector<size_t>({100, 100, 50}), pageSizes);
+  EXPECT_EQ(250, allCounters.size());
+  EXPECT_EQ(42, *allCounters.at("app.c042").value_ref());
+  EXPECT_LT(0, pages.getDumpTime());
+
+  // Regex filter
+  *params.prefix_ref() = "";
+  *params.regex_ref() = "c00[0-9]$";
+  auto regexPages = client.dumpCountersPaged(params);
+  auto regexCounters = regexPages.next();
+  ASSERT_TRUE(regexCounters.hasValue());
+  EXPECT_EQ(10, regexCounters->size());
+  EXPECT_FALSE(regexPages.next().hasValue());
+
+  // Invalid regex yields an empty dump
+  *params.regex_ref() = "(";
+  auto badPages = client.dumpCountersPaged(params);
+  auto badCounters = badPages.next();
+  ASSERT_TRUE(badCounters.hasValue());
+  EXPECT_TRUE(badCounters->empty());
+
+  // Streamed dump of counters changed since the last dump
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  thrift::Counter counter;
+  *counter.value_ref() = 1000;
+  client.setCounters({{"app.c007", counter}, {"app.c249", counter}});
+
+  thrift::CounterDumpParams changedParams;
+  *changedParams.prefix_ref() = "app.";
+  *changedParams.changedSince_ref() = pages.getDumpTime();
+  *changedParams.pageSize_ref() = 1;
+  CounterMap changedCounters;
+  size_t numPages{0};
+  auto dumpTime = client.streamCounters(
+      changedParams, [&](CounterMap&& counters) {
+        ++numPages;
+        for (auto& kv : counters) {
+          changedCounters.emplace(kv.first, kv.second);
+        }
+      });
+  ASSERT_TRUE(dumpTime.hasValue());
+  EXPECT_LT(pages.getDumpTime(), *dumpTime);
+  EXPECT_EQ(2, numPages);
+  EXPECT_EQ(2, changedCounters.size());
+  EXPECT_EQ(1000, *changedCounters.at("app.c007").value_ref());
+  EXPECT_EQ(1000, *changedCounters.at("app.c249").value_ref());
+
+  // Regular requests are served after the stream
+  EXPECT_EQ(1000, *client.getCounter("app.c007")->value_ref());
+}
+
+TEST(ZmqMonitorClientTest, CounterIds) {
+  Context context;
+
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-ids-rep"},
+      std::string{"inproc://monitor-ids-pub"},
+      context,
+      folly::none, // logSampleToMerge
+      kAlivenessCheckInterval,
+      kMaxLogEvents,
+      kProfilingStatInterval,
+      2 // numShards
+  );
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  ZmqMonitorClient client(context, std::string{"inproc://monitor-ids-rep"});
+
+  // Ids are unique and stable
+  auto ids = client.registerCounters({"a", "b", "c", "d"});
+  ASSERT_TRUE(ids.hasValue());
+  ASSERT_EQ(4, ids->size());
+  std::set<int64_t> uniqueIds;
+  for (auto const& kv : *ids) {
+    uniqueIds.emplace(kv.second);
+  }
+  EXPECT_EQ(4, uniqueIds.size());
+  EXPECT_EQ(ids->at("b"), client.registerCounters({"b"})->at("b"));
+
+  // Registered counters have no value until set
+  EXPECT_FALSE(client.getCounter("a").hasValue());
+
+  thrift::Counter counterA;
+  *counterA.value_ref() = 10;
+  thrift::Counter counterC;
+  *counterC.value_ref() = 30;
+  EXPECT_TRUE(client.setCountersById({{ids->at("a"), counterA},
+                                      {ids->at("c"), counterC},
+                                      {12345, counterA}}));
+  EXPECT_EQ(10, *client.getCounter("a")->value_ref());
+  EXPECT_EQ(30, *client.getCounter("c")->value_ref());
+  EXPECT_FALSE(client.getCounter("b").hasValue());
+
+  // Set by name and by id address the same counter
+  thrift::Counter counterB;
+  *counterB.value_ref() = 20;
+  client.setCounter("b", counterB);
+  *counterB.value_ref() = 21;
+  EXPECT_TRUE(client.setCountersById({{ids->at("b"), counterB}}));
+  EXPECT_EQ(21, *client.getCounter("b")->value_ref());
+}
+
+TEST(ZmqMonitorClientTest, CounterIdsAcrossRestart) {
+  Context context;
+  const auto monitorUrl =
+      folly::sformat("ipc:///tmp/zmq_monitor_ids_restart_{}", ::getpid());
+
+  auto startMonitor = [&]() {
+    auto monitor = make_shared<ZmqMonitor>(
+        monitorUrl,
+        std::string{"inproc://monitor-ids-restart-pub"},
+        context);
+    auto thread =
+        std::make_unique<std::thread>([monitor]() { monitor->run(); });
+    monitor->waitUntilRunning();
+    return std::make_pair(monitor, std::move(thread));
+  };
+
+  thrift::Counter counter;
+  *counter.value_ref() = 1;
+  ZmqMonitorClient client(context, monitorUrl);
+  std::map<std::string, int64_t> ids;
+  int64_t firstEpoch{0};
+  {
+    auto monitor = startMonitor();
+    ids = client.registerCounters({"a", "b"}).value();
+    EXPECT_TRUE(client.setCountersById({{ids.at("a"), counter}}));
+    EXPECT_EQ(1, *client.getCounter("a")->value_ref());
+    firstEpoch = monitor.first->getEpoch();
+    monitor.first->stop();
+    monitor.second->join();
+  }
+
+  // Restarted monitor hands out ids in a different order. Stale ids are
+  // rejected and client registers its names again.
+  auto monitor = startMonitor();
+  SCOPE_EXIT {
+    monitor.first->stop();
+    monitor.second->join();
+  };
+  EXPECT_NE(firstEpoch, monitor.first->getEpoch());
+  ZmqMonitorClient otherClient(context, monitorUrl);
+  ASSERT_TRUE(otherClient.registerCounters({"x", "y", "b", "a"}).hasValue());
+
+  *counter.value_ref() = 2;
+  EXPECT_TRUE(client.setCountersById({{ids.at("b"), counter}}));
+  EXPECT_EQ(2, *client.getCounter("b")->value_ref());
+  EXPECT_FALSE(client.getCounter("a").hasValue());
+  EXPECT_FALSE(client.getCounter("x").hasValue());
+  EXPECT_FALSE(client.getCounter("y").hasValue());
+
+  // Handles are unchanged
+  EXPECT_EQ(ids, client.registerCounters({"a", "b"}).value());
+}
+
+TEST(ZmqMonitorClientTest, BufferedUpdates) {
+  Context context;
+
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-buffered-rep"},
+      std::string{"inproc://monitor-buffered-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  MonitorClientBufferOptions bufferOptions;
+  bufferOptions.maxBufferedCounters = 3;
+  bufferOptions.flushInterval = std::chrono::seconds(60);
+  ZmqMonitorClient client(
+      context, std::string{"inproc://monitor-buffered-rep"}, "", bufferOptions);
+  // Unbuffered client to check updates are held back. Flushed updates are read
+  // back over `client` as messages of different sockets aren't ordered.
+  ZmqMonitorClient reader(
+      context, std::string{"inproc://monitor-buffered-rep"});
+
+  // Bumps are coalesced and bumps of a set counter apply on the set value
+  thrift::Counter counter;
+  *counter.value_ref() = 100;
+  client.setCounter("set", counter);
+  client.bumpCounter("set", 5);
+  client.bumpCounter("bumped");
+  client.bumpCounter("bumped", 9);
+  EXPECT_FALSE(reader.getCounter("set").hasValue());
+  EXPECT_FALSE(reader.getCounter("bumped").hasValue());
+
+  // Third counter fills up the buffer
+  client.bumpCounter("other");
+  EXPECT_EQ(105, *client.getCounter("set")->value_ref());
+  EXPECT_EQ(10, *client.getCounter("bumped")->value_ref());
+  EXPECT_EQ(1, *client.getCounter("other")->value_ref());
+
+  // Set overrides earlier buffered bumps
+  client.bumpCounter("bumped", 7);
+  *counter.value_ref() = 1;
+  client.setCounters({{"bumped", counter}});
+  EXPECT_EQ(10, *reader.getCounter("bumped")->value_ref());
+  EXPECT_EQ(1, *client.getCounter("bumped")->value_ref());
+
+  // Unbuffered bump by amount
+  reader.bumpCounter("other", 41);
+  EXPECT_EQ(42, *reader.getCounter("other")->value_ref());
+}
+
+TEST(ZmqMonitorClientTest, SharedCounters) {
+  Context context;
+
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-shared-rep"},
+      std::string{"inproc://monitor-shared-pub"},
+      context,
+      folly::none, // logSampleToMerge
+      kAlivenessCheckInterval,
+      kMaxLogEvents,
+      kProfilingStatInterval,
+      2 // numShards
+  );
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  const auto path = folly::sformat("/tmp/fbzmq_monitor_{}", ::getpid());
+  auto client = std::make_unique<ZmqMonitorClient>(
+      context, std::string{"inproc://monitor-shared-rep"});
+  ASSERT_TRUE(client->attachSharedCounters(path, 2));
+
+  // Counters go through the table until it is full
+  thrift::Counter counter;
+  *counter.value_ref() = 10;
+  client->setCounter("a", counter);
+  client->bumpCounter("b", 5);
+  client->bumpCounter("b");
+  *counter.value_ref() = 30;
+  client->setCounters({{"a", counter}, {"c", counter}});
+  EXPECT_EQ(30, *client->getCounter("a")->value_ref());
+  EXPECT_EQ(6, *client->getCounter("b")->value_ref());
+  EXPECT_EQ(30, *client->getCounter("c")->value_ref());
+
+  // Updates are visible to other clients as well
+  ZmqMonitorClient reader(context, std::string{"inproc://monitor-shared-rep"});
+  client->bumpCounter("b", 4);
+  auto counters = reader.dumpCounters();
+  EXPECT_EQ(10, *counters.at("b").value_ref());
+
+  // Table is removed with the client, counters stay
+  client.reset();
+  EXPECT_NE(0, ::access(path.c_str(), F_OK));
+  EXPECT_EQ(10, *reader.getCounter("b")->value_ref());
+}
+
+TEST(ZmqMonitorClientTest, ResourceCounters) {
+  Context context;
+
+  MonitorResourceOptions resourceOptions;
+  resourceOptions.processDetails = true;
+  resourceOptions.threadCpu = true;
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-resource-rep"},
+      std::string{"inproc://monitor-resource-pub"},
+      context,
+      folly::none, // logSampleToMerge
+      kAlivenessCheckInterval,
+      kMaxLogEvents,
+      std::chrono::seconds(1), // profilingStatInterval
+      kNumMonitorShards,
+      MonitorPubOptions(),
+      resourceOptions);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  // Busy thread with a name to look for
+  std::atomic<bool> isDone{false};
+  std::thread busyThread([&isDone]() {
+    pthread_setname_np(pthread_self(), "busy-thread");
+    while (not isDone.load()) {
+    }
+  });
+  SCOPE_EXIT {
+    isDone = true;
+    busyThread.join();
+  };
+
+  // sleep for 2.5s to ensure querying twice after busy thread started
+  std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+
+  ZmqMonitorClient client(
+      context, std::string{"inproc://monitor-resource-rep"});
+  auto counters = client.dumpCounters();
+  for (auto const& name :
+       {"process.faults.minor.rate",
+        "process.faults.major.rate",
+        "process.context_switches.voluntary.rate",
+        "process.context_switches.involuntary.rate",
+        "process.fds.open",
+        "process.cpu.zmq_io.pct",
+        "process.threads.busy-thread.cpu.pct"}) {
+    ASSERT_EQ(1, counters.count(name)) << name;
+    EXPECT_EQ(
+        thrift::CounterValueType::GAUGE, *counters.at(name).valueType_ref());
+  }
+  EXPECT_LT(0, *counters.at("process.fds.open").value_ref());
+  EXPECT_LT(
+      10, *counters.at("process.threads.busy-thread.cpu.pct").value_ref());
+}
+
+TEST(ZmqMonitorClientTest, TraceReporter) {
+  Context context;
+
+  auto zmqMonitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-trace-rep"},
+      std::string{"inproc://monitor-trace-pub"},
+      context);
+  std::thread monitorThread([zmqMonitor]() { zmqMonitor->run(); });
+  SCOPE_EXIT {
+    zmqMonitor->stop();
+    monitorThread.join();
+  };
+  zmqMonitor->waitUntilRunning();
+
+  ZmqMonitorClient client(context, std::string{"inproc://monitor-trace-rep"});
+  ThreadData threadData;
+  TraceReporterOptions options;
+  options.maxBufferedSamples = 2;
+  auto reporter = std::make_unique<TraceReporter>(threadData, client, options);
+
+  const auto now = std::chrono::system_clock::now();
+  TraceContext context1;
+  context1.traceId = 1;
+  context1.hop = 1;
+  context1.isSampled = true;
+  context1.originTime = now - std::chrono::milliseconds(30);
+  context1.sendTime = now - std::chrono::milliseconds(10);
+  TraceContext context2 = context1;
+  context2.traceId = 2;
+  context2.isSampled = false;
+
+  // Latencies of all traces are recorded, samples of sampled ones buffered
+  auto callback = reporter->getCallback("backend");
+  callback(context1, now);
+  callback(context2, now);
+  EXPECT_EQ(1, reporter->getNumBufferedSamples());
+  auto counters = threadData.getCounters();
+  EXPECT_EQ(2, counters.at("zmq.trace.backend.hop_latency_us.count.0"));
+  EXPECT_EQ(10000, counters.at("zmq.trace.backend.hop_latency_us.avg.0"));
+  EXPECT_EQ(30000, counters.at("zmq.trace.backend.e2e_latency_us.avg.0"));
+  EXPECT_EQ(1, counters.count("zmq.trace.backend.e2e_latency_us.p99.60"));
+
+  thrift::EventLogQueryParams queryParams;
+  *queryParams.category_ref() = "zmq_traces";
+  EXPECT_EQ(0, client.queryEventLogs(queryParams)->eventLogs_ref()->size());
+
+  // Buffer fills up, the rest is flushed on destruction
+  reporter->record("frontend", context1, now);
+  EXPECT_EQ(0, reporter->getNumBufferedSamples());
+  reporter->record("frontend", context1, now);
+  reporter.reset();
+
+  auto result = client.queryEventLogs(queryParams);
+  ASSERT_TRUE(result.hasValue());
+  ASSERT_EQ(2, result->eventLogs_ref()->size());
+  auto const& samples = *result->eventLogs_ref()->at(0).binarySamples_ref();
+  ASSERT_EQ(2, samples.size());
+  auto sample = LogSample::fromThrift(samples.at(0));
+  EXPECT_EQ("backend", sample.getString("hop_name"));
+  EXPECT_EQ("1", sample.getString("trace_id"));
+  EXPECT_EQ(1, sample.getInt("hop"));
+  EXPECT_EQ(10000, sample.getInt("hop_latency_us"));
+  EXPECT_EQ(30000, sample.getInt("e2e_latency_us"));
+  EXPECT_EQ(
+      1, result->eventLogs_ref()->at(1).binarySamples_ref()->size());
 }
 
 int
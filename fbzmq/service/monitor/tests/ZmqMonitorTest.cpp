@@ -7,8 +7,15 @@
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
 #include <thread>
 
+#include <unistd.h>
+
+#include <folly/Format.h>
+#include <folly/Function.h>
 #include <thrift/lib/cpp2/protocol/Serializer.h>
 
 #include <fbzmq/service/monitor/ZmqMonitor.h>
@@ -149,6 +156,12 @@ TEST(ZmqMonitorTest, BasicOperation) {
       EXPECT_EQ(ls1.getString("domain"), "terragraph");
       EXPECT_EQ(ls2.getString("key"), "second sample");
       EXPECT_EQ(ls2.getString("domain"), "terragraph");
+
+      // binary samples are merged as well
+      auto ls3 = LogSample::fromThrift(
+          publication.eventLogPub_ref()->binarySamples_ref()->at(0));
+      EXPECT_EQ(ls3.getString("key"), "first sample");
+      EXPECT_EQ(ls3.getString("domain"), "terragraph");
     }
 
     LOG(INFO) << "subscriber thread finishing";
@@ -231,10 +244,561 @@ TEST(ZmqMonitorTest, BasicOperation) {
   *thriftReq.eventLog_ref()->category_ref() = "log_category";
   *thriftReq.eventLog_ref()->samples_ref() = {
       sample1.toJson(), sample2.toJson()};
+  *thriftReq.eventLog_ref()->binarySamples_ref() = {sample1.toThrift()};
   dealer.sendThriftObj(thriftReq, serializer).value();
   LOG(INFO) << "done publishing logs...";
 }
 
+TEST(ZmqMonitorTest, ShardedOperation) {
+  Context context;
+  apache::thrift::CompactSerializer serializer;
+
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-sharded-rep"}, // monitorSubmitUrl
+      std::string{"inproc://monitor-sharded-pub"}, // monitorPubUrl_
+      context, // zmqContext
+      folly::none, // logSampleToMerge
+      std::chrono::seconds(180), // alivenessCheckInterval
+      100, // maxLogEvents
+      std::chrono::seconds(1), // profilingStatInterval
+      4 // numShards
+  );
+  EXPECT_EQ(4, monitor->getNumShards());
+
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+  monitor->waitUntilRunning();
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-sharded-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-sharded-rep"}).value();
+
+  // Let subscription propagate to the monitor
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  // Set plenty of counters to spread them across all shards
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  for (int i = 0; i < 100; ++i) {
+    thrift::Counter counter;
+    *counter.value_ref() = i;
+    thriftReq.counterSetParams_ref()
+        ->counters_ref()["counter" + std::to_string(i)] = counter;
+  }
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // All counters are published in a single publication
+  auto publication = sub.recvThriftObj<thrift::MonitorPub>(serializer).value();
+  EXPECT_EQ(thrift::PubType::COUNTER_PUB, *publication.pubType_ref());
+  EXPECT_EQ(100, publication.counterPub_ref()->counters_ref()->size());
+
+  // Get values from multiple shards
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  *thriftReq.counterGetParams_ref()->counterNames_ref() = {
+      "counter1", "counter42", "counter99", "unknown"};
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // Bump counters of multiple shards, they are published together
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::BUMP_COUNTER;
+  *thriftReq.counterBumpParams_ref()->counterNames_ref() = {
+      "counter1", "counter42", "counter99", "new"};
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_DATA;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // Replies of gathered requests are received in order of requests
+  {
+    auto rep =
+        dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer).value();
+    auto& counters = *rep.counters_ref();
+    EXPECT_EQ(3, counters.size());
+    EXPECT_EQ(1, *counters["counter1"].value_ref());
+    EXPECT_EQ(42, *counters["counter42"].value_ref());
+    EXPECT_EQ(99, *counters["counter99"].value_ref());
+  }
+
+  publication = sub.recvThriftObj<thrift::MonitorPub>(serializer).value();
+  EXPECT_EQ(thrift::PubType::COUNTER_PUB, *publication.pubType_ref());
+  {
+    auto& counters = *publication.counterPub_ref()->counters_ref();
+    EXPECT_EQ(4, counters.size());
+    EXPECT_EQ(2, *counters["counter1"].value_ref());
+    EXPECT_EQ(43, *counters["counter42"].value_ref());
+    EXPECT_EQ(100, *counters["counter99"].value_ref());
+    EXPECT_EQ(1, *counters["new"].value_ref());
+  }
+
+  {
+    auto rep =
+        dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer).value();
+    auto& counters = *rep.counters_ref();
+    // 100 + new + process.* counters
+    EXPECT_LE(103, counters.size());
+    EXPECT_EQ(1, counters.count("process.uptime.seconds"));
+    EXPECT_EQ(0, *counters["counter0"].value_ref());
+    EXPECT_EQ(2, *counters["counter1"].value_ref());
+    EXPECT_EQ(1, *counters["new"].value_ref());
+  }
+
+  {
+    auto rep =
+        dealer.recvThriftObj<thrift::CounterNamesResponse>(serializer).value();
+    EXPECT_LE(103, rep.counterNames_ref()->size());
+  }
+}
+
+TEST(ZmqMonitorTest, PipelinedRepliesInShardedMode) {
+  Context context;
+  apache::thrift::CompactSerializer serializer;
+
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-pipelined-rep"}, // monitorSubmitUrl
+      std::string{"inproc://monitor-pipelined-pub"}, // monitorPubUrl_
+      context, // zmqContext
+      folly::none, // logSampleToMerge
+      std::chrono::seconds(180), // alivenessCheckInterval
+      100, // maxLogEvents
+      std::chrono::seconds(1), // profilingStatInterval
+      4 // numShards
+  );
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+  monitor->waitUntilRunning();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-pipelined-rep"}).value();
+
+  // Requests are prefixed by their id, which monitor sends back as envelope
+  auto sendRequest = [&](uint64_t requestId,
+                         thrift::MonitorRequest const& req) {
+    dealer
+        .sendMultiple(
+            Message::from(requestId).value(),
+            Message::fromThriftObj(req, serializer).value())
+        .value();
+  };
+
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+  for (int i = 0; i < 100; ++i) {
+    thrift::Counter counter;
+    *counter.value_ref() = i;
+    thriftReq.counterSetParams_ref()
+        ->counters_ref()["counter" + std::to_string(i)] = counter;
+  }
+  dealer.sendThriftObj(thriftReq, serializer).value();
+
+  // Gathered, inline and gathered again
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
+  *thriftReq.counterGetParams_ref()->counterNames_ref() = {
+      "counter1", "counter42", "counter99"};
+  sendRequest(1, thriftReq);
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_EVENT_LOGS;
+  sendRequest(2, thriftReq);
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::DUMP_ALL_COUNTER_NAMES;
+  sendRequest(3, thriftReq);
+
+  std::vector<uint64_t> order;
+  for (int i = 0; i < 3; ++i) {
+    auto frames = dealer.recvMultiple(std::chrono::seconds(5)).value();
+    ASSERT_EQ(2, frames.size());
+    const auto requestId = frames.at(0).read<uint64_t>().value();
+    order.emplace_back(requestId);
+    if (requestId == 1) {
+      auto rep =
+          frames.at(1)
+              .readThriftObj<thrift::CounterValuesResponse>(serializer)
+              .value();
+      EXPECT_EQ(3, rep.counters_ref()->size());
+    } else if (requestId == 2) {
+      EXPECT_TRUE(frames.at(1)
+                      .readThriftObj<thrift::EventLogsResponse>(serializer)
+                      .hasValue());
+    } else {
+      EXPECT_EQ(3, requestId);
+      auto rep = frames.at(1)
+                     .readThriftObj<thrift::CounterNamesResponse>(serializer)
+                     .value();
+      EXPECT_LE(100, rep.counterNames_ref()->size());
+    }
+  }
+
+  // Every request is replied once. Only gathered replies keep their order,
+  // reply of event logs may overtake them.
+  std::vector<uint64_t> sorted(order);
+  std::sort(sorted.begin(), sorted.end());
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), sorted);
+  EXPECT_LT(
+      std::find(order.begin(), order.end(), 1),
+      std::find(order.begin(), order.end(), 3));
+}
+
+TEST(ZmqMonitorTest, StaleCounterIds) {
+  Context context;
+  apache::thrift::CompactSerializer serializer;
+
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-epoch-rep"},
+      std::string{"inproc://monitor-epoch-pub"},
+      context);
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+  monitor->waitUntilRunning();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-epoch-rep"}).value();
+
+  thrift::MonitorRequest thriftReq;
+  *thriftReq.cmd_ref() = thrift::MonitorCommand::REGISTER_COUNTERS;
+  thriftReq.counterRegisterParams_ref()->counterNames_ref()->emplace_back(
+      "foo");
+  dealer.sendThriftObj(thriftReq, serializer).value();
+  auto idsRep =
+      dealer.recvThriftObj<thrift::CounterIdsResponse>(serializer).value();
+  EXPECT_NE(0, *idsRep.epoch_ref());
+  EXPECT_EQ(monitor->getEpoch(), *idsRep.epoch_ref());
+  const auto id = idsRep.counterIds_ref()->at("foo");
+
+  auto setById = [&](int64_t epoch) {
+    thrift::MonitorRequest setReq;
+    *setReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES_BY_ID;
+    thrift::Counter counter;
+    *counter.value_ref() = 7;
+    (*setReq.counterSetByIdParams_ref()->counters_ref())[id] = counter;
+    *setReq.counterSetByIdParams_ref()->epoch_ref() = epoch;
+    dealer.sendThriftObj(setReq, serializer).value();
+    return dealer.recvThriftObj<thrift::CounterSetByIdResponse>(serializer)
+        .value();
+  };
+  auto getFoo = [&]() {
+    thrift::MonitorRequest getReq;
+    *getReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
+    getReq.counterGetParams_ref()->counterNames_ref()->emplace_back("foo");
+    dealer.sendThriftObj(getReq, serializer).value();
+    return dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+        .value();
+  };
+
+  // Ids of another epoch are rejected, with the current epoch
+  auto rejected = setById(*idsRep.epoch_ref() + 1);
+  EXPECT_FALSE(*rejected.accepted_ref());
+  EXPECT_EQ(monitor->getEpoch(), *rejected.epoch_ref());
+  EXPECT_FALSE(rejected.error_ref()->empty());
+  EXPECT_EQ(0, getFoo().counters_ref()->count("foo"));
+
+  auto accepted = setById(*idsRep.epoch_ref());
+  EXPECT_TRUE(*accepted.accepted_ref());
+  EXPECT_EQ(7, *getFoo().counters_ref()->at("foo").value_ref());
+}
+
+TEST(ZmqMonitorTest, CoalescedTopicPublication) {
+  Context context;
+  apache::thrift::CompactSerializer serializer;
+
+  MonitorPubOptions pubOptions;
+  pubOptions.coalesceInterval = std::chrono::milliseconds(100);
+  pubOptions.changedOnly = true;
+  pubOptions.topicFrames = true;
+  auto monitor = make_shared<ZmqMonitor>(
+      std::string{"inproc://monitor-coalesce-rep"}, // monitorSubmitUrl
+      std::string{"inproc://monitor-coalesce-pub"}, // monitorPubUrl_
+      context, // zmqContext
+      folly::none, // logSampleToMerge
+      kAlivenessCheckInterval, // alivenessCheckInterval
+      kMaxLogEvents, // maxLogEvents
+      kProfilingStatInterval, // profilingStatInterval
+      kNumMonitorShards, // numShards
+      pubOptions // pubOptions
+  );
+
+  std::thread monitorThread([monitor]() { monitor->run(); });
+  SCOPE_EXIT {
+    monitor->stop();
+    monitorThread.join();
+  };
+  monitor->waitUntilRunning();
+
+  // Subscribe to `foo` counters only
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://monitor-coalesce-pub"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "foo", 3).value();
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+  dealer.connect(SocketUrl{"inproc://monitor-coalesce-rep"}).value();
+
+  // Let subscription propagate to the monitor
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  auto setCounters = [&](std::map<std::string, int64_t> const& values) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+    for (auto const& kv : values) {
+      thrift::Counter counter;
+      *counter.value_ref() = kv.second;
+      thriftReq.counterSetParams_ref()->counters_ref()[kv.first] = counter;
+    }
+    dealer.sendThriftObj(thriftReq, serializer).value();
+  };
+
+  auto recvPub = [&]() {
+    Message topicMsg, pubMsg;
+    sub.recvMultiple(topicMsg, pubMsg).value();
+    EXPECT_EQ("foo", topicMsg.read<std::string>().value());
+    auto pub = pubMsg.readThriftObj<thrift::MonitorPub>(serializer).value();
+    EXPECT_EQ(thrift::PubType::COUNTER_PUB, *pub.pubType_ref());
+    return *pub.counterPub_ref()->counters_ref();
+  };
+
+  // Updates within interval are coalesced into one publication
+  setCounters({{"foo.a", 1}, {"foo.b", 2}, {"bar.c", 3}});
+  setCounters({{"foo.a", 5}});
+  {
+    auto counters = recvPub();
+    EXPECT_EQ(2, counters.size());
+    EXPECT_EQ(5, *counters["foo.a"].value_ref());
+    EXPECT_EQ(2, *counters["foo.b"].value_ref());
+  }
+
+  // Only changed counters are published
+  setCounters({{"foo.a", 5}, {"foo.b", 3}, {"bar.c", 4}});
+  {
+    auto counters = recvPub();
+    EXPECT_EQ(1, counters.size());
+    EXPECT_EQ(3, *counters["foo.b"].value_ref());
+  }
+
+  // Nothing more to receive
+  EXPECT_TRUE(sub.recvOne(std::chrono::milliseconds(300)).hasError());
+}
+
+TEST(ZmqMonitorTest, SnapshotAndStream) {
+  for (const bool lastValueCache : {false, true}) {
+    Context context;
+    apache::thrift::CompactSerializer serializer;
+
+    MonitorPubOptions pubOptions;
+    pubOptions.lastValueCache = lastValueCache;
+    const auto submitUrl =
+        folly::sformat("inproc://monitor-snapshot-rep-{}", lastValueCache);
+    const auto pubUrl =
+        folly::sformat("inproc://monitor-snapshot-pub-{}", lastValueCache);
+    auto monitor = make_shared<ZmqMonitor>(
+        submitUrl, // monitorSubmitUrl
+        pubUrl, // monitorPubUrl_
+        context, // zmqContext
+        folly::none, // logSampleToMerge
+        kAlivenessCheckInterval, // alivenessCheckInterval
+        kMaxLogEvents, // maxLogEvents
+        kProfilingStatInterval, // profilingStatInterval
+        kNumMonitorShards, // numShards
+        pubOptions // pubOptions
+    );
+
+    std::thread monitorThread([monitor]() { monitor->run(); });
+    SCOPE_EXIT {
+      monitor->stop();
+      monitorThread.join();
+    };
+    monitor->waitUntilRunning();
+
+    Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(context);
+    dealer.connect(SocketUrl{submitUrl}).value();
+
+    auto setCounters = [&](std::map<std::string, int64_t> const& values) {
+      thrift::MonitorRequest thriftReq;
+      *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+      for (auto const& kv : values) {
+        thrift::Counter counter;
+        *counter.value_ref() = kv.second;
+        thriftReq.counterSetParams_ref()->counters_ref()[kv.first] = counter;
+      }
+      dealer.sendThriftObj(thriftReq, serializer).value();
+    };
+
+    auto getSnapshot = [&](std::string const& prefix) {
+      thrift::MonitorRequest thriftReq;
+      *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_SNAPSHOT;
+      *thriftReq.snapshotParams_ref()->prefix_ref() = prefix;
+      dealer.sendThriftObj(thriftReq, serializer).value();
+      return dealer.recvThriftObj<thrift::MonitorSnapshot>(serializer).value();
+    };
+
+    // Updates published before subscriber joins
+    setCounters({{"foo.a", 1}, {"foo.b", 2}, {"bar.c", 3}});
+
+    Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+    sub.connect(SocketUrl{pubUrl}).value();
+    sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto recvPub = [&]() {
+      return sub.recvThriftObj<thrift::MonitorPub>(serializer).value();
+    };
+
+    // Late joiner catches up with a snapshot
+    {
+      auto snapshot = getSnapshot("foo.");
+      EXPECT_EQ(1, *snapshot.seqNum_ref());
+      auto& counters = *snapshot.counters_ref();
+      EXPECT_EQ(2, counters.size());
+      EXPECT_EQ(1, *counters["foo.a"].value_ref());
+      EXPECT_EQ(2, *counters["foo.b"].value_ref());
+    }
+
+    // Stream continues after the snapshot
+    setCounters({{"foo.a", 5}});
+    {
+      auto pub = recvPub();
+      EXPECT_EQ(2, *pub.seqNum_ref());
+      EXPECT_EQ(5, *pub.counterPub_ref()->counters_ref()["foo.a"].value_ref());
+    }
+    {
+      auto snapshot = getSnapshot("");
+      EXPECT_EQ(2, *snapshot.seqNum_ref());
+      auto& counters = *snapshot.counters_ref();
+      EXPECT_EQ(5, *counters["foo.a"].value_ref());
+      // Counters of monitor itself are not published
+      EXPECT_EQ(
+          not lastValueCache, counters.count("process.uptime.seconds") == 1);
+    }
+
+    // Event logs are numbered along with counters
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::LOG_EVENT;
+    *thriftReq.eventLog_ref()->category_ref() = "category";
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    {
+      auto pub = recvPub();
+      EXPECT_EQ(thrift::PubType::EVENT_LOG_PUB, *pub.pubType_ref());
+      EXPECT_EQ(3, *pub.seqNum_ref());
+    }
+  }
+}
+
+TEST(ZmqMonitorTest, PersistedState) {
+  Context context;
+  apache::thrift::CompactSerializer serializer;
+
+  MonitorPersistOptions persistOptions;
+  persistOptions.path =
+      folly::sformat("/tmp/zmq_monitor_state_{}", ::getpid());
+  SCOPE_EXIT {
+    ::unlink(persistOptions.path.c_str());
+  };
+
+  using Dealer = Socket<ZMQ_DEALER, ZMQ_CLIENT>;
+  auto runMonitor = [&](folly::Function<void(Dealer&)> fn) {
+    auto monitor = make_shared<ZmqMonitor>(
+        std::string{"inproc://monitor-persist-rep"}, // monitorSubmitUrl
+        std::string{"inproc://monitor-persist-pub"}, // monitorPubUrl_
+        context, // zmqContext
+        folly::none, // logSampleToMerge
+        kAlivenessCheckInterval, // alivenessCheckInterval
+        kMaxLogEvents, // maxLogEvents
+        kProfilingStatInterval, // profilingStatInterval
+        kNumMonitorShards, // numShards
+        MonitorPubOptions(), // pubOptions
+        MonitorResourceOptions(), // resourceOptions
+        persistOptions // persistOptions
+    );
+    std::thread monitorThread([monitor]() { monitor->run(); });
+    monitor->waitUntilRunning();
+
+    Dealer dealer(context);
+    dealer.connect(SocketUrl{"inproc://monitor-persist-rep"}).value();
+    fn(dealer);
+
+    monitor->stop();
+    monitorThread.join();
+    // State is persisted on destruction
+    monitor.reset();
+  };
+
+  auto queryEventLogs = [&](Dealer& dealer) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::QUERY_EVENT_LOGS;
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    return dealer.recvThriftObj<thrift::EventLogQueryResponse>(serializer)
+        .value();
+  };
+
+  auto getCounter = [&](Dealer& dealer) {
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::GET_COUNTER_VALUES;
+    thriftReq.counterGetParams_ref()->counterNames_ref()->emplace_back("foo");
+    dealer.sendThriftObj(thriftReq, serializer).value();
+    auto counters =
+        dealer.recvThriftObj<thrift::CounterValuesResponse>(serializer)
+            .value();
+    auto it = counters.counters_ref()->find("foo");
+    return it == counters.counters_ref()->end() ? -1 : *it->second.value_ref();
+  };
+
+  // Nothing to restore at first
+  runMonitor([&](Dealer& dealer) {
+    EXPECT_EQ(0, queryEventLogs(dealer).eventLogs_ref()->size());
+
+    thrift::MonitorRequest thriftReq;
+    *thriftReq.cmd_ref() = thrift::MonitorCommand::SET_COUNTER_VALUES;
+    thrift::Counter counter;
+    *counter.value_ref() = 42;
+    thriftReq.counterSetParams_ref()->counters_ref()["foo"] = counter;
+    dealer.sendThriftObj(thriftReq, serializer).value();
+
+    for (const auto category : {"first", "second"}) {
+      thrift::MonitorRequest logReq;
+      *logReq.cmd_ref() = thrift::MonitorCommand::LOG_EVENT;
+      *logReq.eventLog_ref()->category_ref() = category;
+      dealer.sendThriftObj(logReq, serializer).value();
+    }
+    EXPECT_EQ(42, getCounter(dealer));
+    EXPECT_EQ(2, queryEventLogs(dealer).eventLogs_ref()->size());
+  });
+
+  // Counters and event logs survive restart, and numbering resumes
+  runMonitor([&](Dealer& dealer) {
+    EXPECT_EQ(42, getCounter(dealer));
+
+    auto before = queryEventLogs(dealer);
+    ASSERT_EQ(2, before.eventLogs_ref()->size());
+    EXPECT_EQ("first", *before.eventLogs_ref()->at(0).category_ref());
+    EXPECT_EQ("second", *before.eventLogs_ref()->at(1).category_ref());
+    EXPECT_EQ(std::vector<int64_t>({1, 2}), *before.seqNums_ref());
+
+    thrift::MonitorRequest logReq;
+    *logReq.cmd_ref() = thrift::MonitorCommand::LOG_EVENT;
+    *logReq.eventLog_ref()->category_ref() = "third";
+    dealer.sendThriftObj(logReq, serializer).value();
+    EXPECT_EQ(3, *queryEventLogs(dealer).lastSeqNum_ref());
+  });
+
+  // Corrupt state is ignored
+  {
+    std::ofstream file(persistOptions.path, std::ios::binary | std::ios::app);
+    file << "garbage";
+  }
+  runMonitor([&](Dealer& dealer) {
+    EXPECT_EQ(-1, getCounter(dealer));
+    EXPECT_EQ(0, queryEventLogs(dealer).eventLogs_ref()->size());
+  });
+}
+
 int
 main(int argc, char* argv[]) {
   // Parse command line flags
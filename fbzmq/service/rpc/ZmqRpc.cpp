@@ -0,0 +1,359 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ZmqRpc.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+namespace fbzmq {
+
+namespace {
+
+// Status frame of replies
+constexpr uint8_t kReplyOk{0};
+constexpr uint8_t kReplyError{1};
+
+} // namespace
+
+//
+// ZmqRpcClient
+//
+
+ZmqRpcClient::ZmqRpcClient(
+    ZmqEventLoop& evl,
+    Context& zmqContext,
+    SocketUrl const& serverUrl,
+    Options options)
+    : evl_(evl),
+      options_(std::move(options)),
+      sock_{zmqContext, folly::none, folly::none, NonblockingFlag{true}} {
+  CHECK(evl_.isInEventLoop());
+  CHECK_LT(0, options_.maxBatchSize);
+  if (sock_.connect(serverUrl).hasError()) {
+    LOG(FATAL) << "Error connecting to rpc server '" << std::string(serverUrl)
+               << "'";
+  }
+  evl_.addSocket(
+      RawZmqSocketPtr{*sock_}, ZMQ_POLLIN, [this](int /* revents */) noexcept {
+        processReplies();
+      });
+}
+
+ZmqRpcClient::~ZmqRpcClient() {
+  CHECK(evl_.isInEventLoop());
+  evl_.removeSocket(RawZmqSocketPtr{*sock_});
+  for (auto& kv : pendingRequests_) {
+    evl_.cancelTimeout(kv.second.timeoutId);
+  }
+  // Promises are broken as they get destroyed
+  pendingRequests_.clear();
+}
+
+folly::SemiFuture<Message>
+ZmqRpcClient::call(
+    std::string const& method,
+    Message payload,
+    folly::Optional<std::chrono::milliseconds> timeout) {
+  auto contract = folly::makePromiseContract<Message>();
+  const auto requestTimeout = std::min<std::chrono::milliseconds>(
+      timeout.value_or(options_.defaultTimeout),
+      std::chrono::milliseconds(std::numeric_limits<uint32_t>::max()));
+
+  evl_.runImmediatelyOrInEventLoop(
+      [this,
+       promise = std::move(contract.first),
+       method = Message::from(method).value(),
+       payload = std::move(payload),
+       requestTimeout]() mutable {
+        const auto requestId = nextRequestId_++;
+        const auto ret = sock_.sendMultiple(
+            Message::from(requestId).value(),
+            std::move(method),
+            Message::from(static_cast<uint32_t>(requestTimeout.count()))
+                .value(),
+            std::move(payload));
+        if (ret.hasError()) {
+          LOG(ERROR) << "ZmqRpcClient: error sending request " << ret.error();
+          std::ostringstream oss;
+          oss << "Error sending request " << ret.error();
+          promise.setException(ZmqRpcError(oss.str()));
+          return;
+        }
+
+        auto& pending = pendingRequests_[requestId];
+        pending.promise = std::move(promise);
+        pending.timeoutId =
+            evl_.scheduleTimeout(requestTimeout, [this, requestId]() noexcept {
+              auto it = pendingRequests_.find(requestId);
+              if (it == pendingRequests_.end()) {
+                return;
+              }
+              auto pendingPromise = std::move(it->second.promise);
+              pendingRequests_.erase(it);
+              pendingPromise.setException(folly::FutureTimeout());
+            });
+      });
+
+  return std::move(contract.second);
+}
+
+void
+ZmqRpcClient::processReplies() noexcept {
+  for (size_t i = 0; i < options_.maxBatchSize; ++i) {
+    auto ret = sock_.recvMultipleInto(frames_);
+    if (ret.hasError()) {
+      // EAGAIN once all replies are drained
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqRpcClient: error receiving reply " << ret.error();
+      }
+      return;
+    }
+
+    if (frames_.size() != 3) {
+      LOG(ERROR) << "ZmqRpcClient: unexpected reply of " << frames_.size()
+                 << " frames";
+      continue;
+    }
+    const auto requestId = frames_[0].read<uint64_t>();
+    const auto status = frames_[1].read<uint8_t>();
+    if (requestId.hasError() or status.hasError()) {
+      LOG(ERROR) << "ZmqRpcClient: invalid reply header";
+      continue;
+    }
+
+    // Reply of timed out request is dropped
+    auto it = pendingRequests_.find(requestId.value());
+    if (it == pendingRequests_.end()) {
+      VLOG(2) << "ZmqRpcClient: dropping reply of unknown request "
+              << requestId.value();
+      continue;
+    }
+    auto promise = std::move(it->second.promise);
+    evl_.cancelTimeout(it->second.timeoutId);
+    pendingRequests_.erase(it);
+
+    if (status.value() == kReplyOk) {
+      promise.setValue(std::move(frames_[2]));
+    } else {
+      promise.setException(ZmqRpcError(
+          frames_[2].read<std::string>().value_or("Unknown error")));
+    }
+  }
+}
+
+//
+// ZmqRpcServer
+//
+
+ZmqRpcServer::ZmqRpcServer(
+    ZmqEventLoop& evl, Context& zmqContext, SocketUrl url, Options options)
+    : evl_(evl),
+      url_(std::move(url)),
+      options_(std::move(options)),
+      sock_{zmqContext, folly::none, folly::none, NonblockingFlag{true}} {
+  CHECK(evl_.isInEventLoop());
+  CHECK_LT(0, options_.maxBatchSize);
+}
+
+ZmqRpcServer::~ZmqRpcServer() {
+  CHECK(evl_.isInEventLoop());
+  if (isRunning_) {
+    stop();
+  }
+}
+
+void
+ZmqRpcServer::registerHandler(std::string const& method, Handler handler) {
+  CHECK(evl_.isInEventLoop());
+  CHECK(handler);
+  methods_[method] = Method{std::move(handler), nullptr};
+}
+
+void
+ZmqRpcServer::registerAsyncHandler(
+    std::string const& method, AsyncHandler handler) {
+  CHECK(evl_.isInEventLoop());
+  CHECK(handler);
+  methods_[method] = Method{nullptr, std::move(handler)};
+}
+
+folly::Expected<folly::Unit, Error>
+ZmqRpcServer::start() {
+  CHECK(evl_.isInEventLoop());
+  CHECK(not isRunning_) << "Server is already running";
+  auto ret = sock_.bind(url_);
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqRpcServer: Failed to bind on " << std::string(url_)
+               << ". " << ret.error();
+    return ret;
+  }
+
+  isRunning_ = true;
+  runToken_ = std::make_shared<folly::Unit>();
+  evl_.addSocket(
+      RawZmqSocketPtr{*sock_},
+      ZMQ_POLLIN,
+      [this](int /* revents */) noexcept { processRequests(); },
+      options_.dispatchOptions);
+  return folly::unit;
+}
+
+void
+ZmqRpcServer::stop() {
+  CHECK(evl_.isInEventLoop());
+  CHECK(isRunning_) << "Server is not running";
+  isRunning_ = false;
+  runToken_.reset();
+  stats_.numInflightRequests = 0;
+  evl_.removeSocket(RawZmqSocketPtr{*sock_});
+  sock_.close();
+}
+
+void
+ZmqRpcServer::processRequests() noexcept {
+  for (size_t i = 0; i < options_.maxBatchSize and isRunning_; ++i) {
+    auto ret = sock_.recvMultipleInto(frames_);
+    if (ret.hasError()) {
+      if (ret.error().errNum != EAGAIN) {
+        LOG(ERROR) << "ZmqRpcServer: Failed to receive request. "
+                   << ret.error();
+      }
+      return;
+    }
+    const auto now = Clock::now();
+    ++stats_.numRequests;
+
+    // [identity][id][method][timeout][payload]
+    if (frames_.size() != 5) {
+      ++stats_.numMalformedRequests;
+      VLOG(2) << "ZmqRpcServer: Request of " << frames_.size() << " frames";
+      continue;
+    }
+    auto method = frames_[2].read<std::string>();
+    const auto timeoutMs = frames_[3].read<uint32_t>();
+    if (frames_[1].size() != sizeof(uint64_t) or method.hasError() or
+        timeoutMs.hasError()) {
+      ++stats_.numMalformedRequests;
+      VLOG(2) << "ZmqRpcServer: Invalid request header";
+      continue;
+    }
+    auto identity = std::move(frames_[0]);
+    auto requestId = std::move(frames_[1]);
+
+    auto it = methods_.find(method.value());
+    if (it == methods_.end()) {
+      sendError(
+          std::move(identity),
+          std::move(requestId),
+          "Unknown method " + method.value());
+      continue;
+    }
+
+    Request request;
+    request.method = std::move(method.value());
+    request.payload = std::move(frames_[4]);
+    request.deadline = now + std::chrono::milliseconds(timeoutMs.value());
+
+    // Earlier requests of batch might have taken all of its time
+    if (Clock::now() >= request.deadline) {
+      ++stats_.numExpired;
+      continue;
+    }
+
+    if (it->second.handler) {
+      auto reply = it->second.handler(std::move(request));
+      if (reply.hasError()) {
+        sendError(std::move(identity), std::move(requestId), reply.error());
+      } else {
+        sendReply(
+            std::move(identity),
+            std::move(requestId),
+            folly::Try<Message>(std::move(reply.value())));
+      }
+      continue;
+    }
+
+    if (stats_.numInflightRequests >= options_.maxInflightRequests) {
+      ++stats_.numOverloaded;
+      sendError(std::move(identity), std::move(requestId), "Overloaded");
+      continue;
+    }
+    ++stats_.numInflightRequests;
+
+    // Reply is sent from the loop once handler completes
+    const auto deadline = request.deadline;
+    folly::makeSemiFutureWith([&]() {
+      return it->second.asyncHandler(std::move(request));
+    })
+        .via(&evl_)
+        .thenTry([this,
+                  token = std::weak_ptr<folly::Unit>(runToken_),
+                  identity = std::move(identity),
+                  requestId = std::move(requestId),
+                  deadline](folly::Try<Message>&& reply) mutable {
+          // Server has been stopped or destroyed meanwhile
+          if (token.expired()) {
+            return;
+          }
+          --stats_.numInflightRequests;
+          if (Clock::now() > deadline) {
+            ++stats_.numExpired;
+            return;
+          }
+          sendReply(
+              std::move(identity), std::move(requestId), std::move(reply));
+        });
+  }
+}
+
+void
+ZmqRpcServer::sendReply(
+    Message&& identity, Message&& requestId, folly::Try<Message>&& reply) {
+  if (reply.hasException()) {
+    sendError(
+        std::move(identity),
+        std::move(requestId),
+        reply.exception().what().toStdString());
+    return;
+  }
+
+  frames_.clear();
+  frames_.emplace_back(std::move(identity));
+  frames_.emplace_back(std::move(requestId));
+  frames_.emplace_back(Message::from(kReplyOk).value());
+  frames_.emplace_back(std::move(reply.value()));
+  auto ret = sock_.sendBatch(std::move(frames_));
+  if (ret.hasError()) {
+    // e.g. requester has gone away
+    ++stats_.numSendErrors;
+    VLOG(2) << "ZmqRpcServer: Failed to send reply. " << ret.error();
+    return;
+  }
+  ++stats_.numReplies;
+}
+
+void
+ZmqRpcServer::sendError(
+    Message&& identity, Message&& requestId, std::string const& error) {
+  ++stats_.numErrors;
+  frames_.clear();
+  frames_.emplace_back(std::move(identity));
+  frames_.emplace_back(std::move(requestId));
+  frames_.emplace_back(Message::from(kReplyError).value());
+  frames_.emplace_back(Message::from(error).value());
+  auto ret = sock_.sendBatch(std::move(frames_));
+  if (ret.hasError()) {
+    ++stats_.numSendErrors;
+    VLOG(2) << "ZmqRpcServer: Failed to send error. " << ret.error();
+    return;
+  }
+  ++stats_.numReplies;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Expected.h>
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/futures/Future.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbzmq/async/ZmqEventLoop.h>
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+/**
+ * Pipelined RPC over DEALER (client) and ROUTER (server) sockets.
+ *
+ * Unlike REQ/REP, any number of requests can be in flight on a connection and
+ * replies may come back in any order. Every request is tagged with an id and
+ * carries the time left till its deadline, so that server can skip the work
+ * (and the reply) of requests the client has already given up on.
+ *
+ * Wire format (after the identity frame on ROUTER)
+ *  request: [id (uint64_t)][method (string)][timeout ms (uint32_t)][payload]
+ *  reply:   [id (uint64_t)][status (uint8_t)][payload or error string]
+ */
+
+/**
+ * Error reported by server for a request, fails the future of request
+ */
+class ZmqRpcError : public std::runtime_error {
+ public:
+  explicit ZmqRpcError(std::string const& what) : std::runtime_error(what) {}
+};
+
+struct ZmqRpcClientOptions {
+  // Timeout of requests which don't specify one
+  std::chrono::milliseconds defaultTimeout{5000};
+
+  // Max replies received in one go whenever socket becomes readable
+  size_t maxBatchSize{128};
+};
+
+/**
+ * RPC client on a DEALER socket driven by a ZmqEventLoop. Each request
+ * completes its SemiFuture with the reply payload, with `ZmqRpcError` if
+ * server failed it, or with `folly::FutureTimeout` past its deadline.
+ *
+ * APIs can be called from any thread, the socket is only ever touched from the
+ * event loop thread. Client must be created and destroyed either from within
+ * the event loop thread or while the loop is not running. Requests pending at
+ * destruction fail with `folly::BrokenPromise`.
+ *
+ *  ZmqRpcClient client(evl, context, SocketUrl{url});
+ *  auto reply = client.callThrift<thrift::Resp>("getStuff", req)
+ *                   .via(&evl).thenValue(...);
+ */
+class ZmqRpcClient {
+ public:
+  using Options = ZmqRpcClientOptions;
+
+  ZmqRpcClient(
+      ZmqEventLoop& evl,
+      Context& zmqContext,
+      SocketUrl const& serverUrl,
+      Options options = Options());
+
+  ~ZmqRpcClient();
+
+  ZmqRpcClient(ZmqRpcClient const&) = delete;
+  ZmqRpcClient& operator=(ZmqRpcClient const&) = delete;
+
+  /**
+   * Call `method` with raw payload. `timeout` defaults to the one of options.
+   */
+  folly::SemiFuture<Message> call(
+      std::string const& method,
+      Message payload,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Call `method` with thrift request, and read thrift reply
+   */
+  template <typename ReplyType, typename RequestType>
+  folly::SemiFuture<ReplyType>
+  callThrift(
+      std::string const& method,
+      RequestType const& request,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none) {
+    auto payload = Message::fromThriftObj(request, serializer_);
+    if (payload.hasError()) {
+      return folly::makeSemiFuture<ReplyType>(
+          ZmqRpcError("Error serializing request"));
+    }
+    return call(method, std::move(payload.value()), timeout)
+        .deferValue([](Message&& msg) {
+          apache::thrift::CompactSerializer serializer;
+          auto obj = msg.readThriftObj<ReplyType>(serializer);
+          if (obj.hasError()) {
+            throw ZmqRpcError("Error reading reply");
+          }
+          return std::move(obj.value());
+        });
+  }
+
+  /**
+   * Number of requests waiting for reply. Must be called from within the
+   * event loop thread.
+   */
+  size_t
+  getNumPendingRequests() const {
+    return pendingRequests_.size();
+  }
+
+ private:
+  struct PendingRequest {
+    folly::Promise<Message> promise;
+    int64_t timeoutId{-1};
+  };
+
+  /**
+   * Receive replies and complete their requests
+   */
+  void processReplies() noexcept;
+
+  ZmqEventLoop& evl_;
+  const Options options_;
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> sock_;
+
+  // Serializer object for thrift-obj <-> string conversion
+  apache::thrift::CompactSerializer serializer_;
+
+  //
+  // State below is accessed only from the event loop thread
+  //
+
+  uint64_t nextRequestId_{1};
+
+  std::unordered_map<uint64_t, PendingRequest> pendingRequests_;
+
+  // Frames of reply being received, reused across replies
+  std::vector<Message> frames_;
+};
+
+struct ZmqRpcServerOptions {
+  // Max requests of async handlers in flight at once. Requests beyond it are
+  // failed right away with an overload error.
+  size_t maxInflightRequests{1024};
+
+  // Max requests received in one go whenever socket becomes readable
+  size_t maxBatchSize{128};
+
+  // Priority and budget of the socket on the loop
+  SocketDispatchOptions dispatchOptions{};
+};
+
+/**
+ * RPC server on a ROUTER socket driven by a ZmqEventLoop. Requests are
+ * dispatched by method into registered handlers
+ * - Sync handlers run inline on the loop and must be quick
+ * - Async handlers return a SemiFuture, hence can hand work over to any
+ *   executor, e.g. a thread or fiber pool, without blocking the loop. Reply is
+ *   sent from the loop once the future completes.
+ *
+ * Deadline of a request counts from its receipt. A request whose deadline
+ * passes before it is dispatched or before its reply is ready is dropped, as
+ * the client has timed it out already.
+ *
+ * Not thread safe. Server must be created, used and destroyed in the thread
+ * of the loop (or while loop is not running).
+ *
+ *  ZmqRpcServer server(evl, context, SocketUrl{url});
+ *  server.registerThriftHandler<thrift::Req, thrift::Resp>(
+ *      "getStuff", [](thrift::Req&& req) { return ...; });
+ *  server.start().value();
+ */
+class ZmqRpcServer {
+ public:
+  using Options = ZmqRpcServerOptions;
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    std::string method;
+    Message payload;
+    // Time by which client expects the reply
+    Clock::time_point deadline;
+  };
+
+  // Reply payload, or error string reported to client
+  using Reply = folly::Expected<Message, std::string>;
+
+  using Handler = folly::Function<Reply(Request&& request)>;
+  using AsyncHandler = folly::Function<folly::SemiFuture<Message>(
+      Request&& request)>;
+
+  /**
+   * Cumulative stats of server
+   */
+  struct Stats {
+    uint64_t numRequests{0};
+    uint64_t numReplies{0};
+    // Replies carrying an error, e.g. unknown method, handler failure
+    uint64_t numErrors{0};
+    uint64_t numMalformedRequests{0};
+    // Requests dropped past their deadline
+    uint64_t numExpired{0};
+    // Requests rejected at max in flight
+    uint64_t numOverloaded{0};
+    uint64_t numSendErrors{0};
+    size_t numInflightRequests{0};
+  };
+
+  ZmqRpcServer(
+      ZmqEventLoop& evl,
+      Context& zmqContext,
+      SocketUrl url,
+      Options options = Options());
+
+  ~ZmqRpcServer();
+
+  ZmqRpcServer(ZmqRpcServer const&) = delete;
+  ZmqRpcServer& operator=(ZmqRpcServer const&) = delete;
+
+  /**
+   * Register handler of a method, replacing the existing one if any
+   */
+  void registerHandler(std::string const& method, Handler handler);
+  void registerAsyncHandler(std::string const& method, AsyncHandler handler);
+
+  /**
+   * Register handler of a method with thrift request and reply
+   */
+  template <typename RequestType, typename ReplyType>
+  void
+  registerThriftHandler(
+      std::string const& method,
+      folly::Function<ReplyType(RequestType&& request)> handler) {
+    registerHandler(
+        method,
+        [handler = std::move(handler)](Request&& request) mutable -> Reply {
+          apache::thrift::CompactSerializer serializer;
+          auto obj = request.payload.readThriftObj<RequestType>(serializer);
+          if (obj.hasError()) {
+            return folly::makeUnexpected(std::string("Invalid request"));
+          }
+          auto reply = Message::fromThriftObj(
+              handler(std::move(obj.value())), serializer);
+          if (reply.hasError()) {
+            return folly::makeUnexpected(std::string("Invalid reply"));
+          }
+          return std::move(reply.value());
+        });
+  }
+
+  /**
+   * Bind the socket and start serving requests
+   */
+  folly::Expected<folly::Unit, Error> start();
+
+  /**
+   * Stop serving and close the socket. Replies of async requests in flight
+   * are dropped.
+   */
+  void stop();
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+  /**
+   * Underlying ROUTER socket, e.g. for setting options before `start()`
+   */
+  Socket<ZMQ_ROUTER, ZMQ_SERVER>&
+  getSocket() {
+    return sock_;
+  }
+
+ private:
+  struct Method {
+    Handler handler;
+    AsyncHandler asyncHandler;
+  };
+
+  void processRequests() noexcept;
+
+  void sendReply(
+      Message&& identity, Message&& requestId, folly::Try<Message>&& reply);
+  void sendError(
+      Message&& identity, Message&& requestId, std::string const& error);
+
+  ZmqEventLoop& evl_;
+  const SocketUrl url_;
+  const Options options_;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> sock_;
+
+  std::unordered_map<std::string, Method> methods_;
+
+  bool isRunning_{false};
+
+  // Held by async requests in flight, reset on stop. Replies of requests of
+  // an earlier run (or of a destroyed server) are dropped.
+  std::shared_ptr<folly::Unit> runToken_;
+
+  Stats stats_;
+
+  // Frames of message being received/sent, reused across messages
+  std::vector<Message> frames_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <folly/futures/Future.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/service/rpc/ZmqRpc.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+const SocketUrl kServerUrl{"inproc://rpc_server_test"};
+
+/**
+ * Runs server and client in loop threads of their own
+ */
+class ZmqRpcFixture : public ::testing::Test {
+ public:
+  void
+  SetUp() override {
+    server = std::make_unique<ZmqRpcServer>(serverEvl, context, kServerUrl);
+
+    // Echo with a suffix
+    server->registerHandler(
+        "echo", [](ZmqRpcServer::Request&& request) -> ZmqRpcServer::Reply {
+          auto str = request.payload.read<std::string>().value();
+          return Message::from(str + " world").value();
+        });
+    server->registerHandler("fail", [](ZmqRpcServer::Request&&) {
+      return ZmqRpcServer::Reply(folly::makeUnexpected(std::string("oops")));
+    });
+
+    // Replies after as many milliseconds as requested, off the loop
+    server->registerAsyncHandler(
+        "delay", [this](ZmqRpcServer::Request&& request) {
+          auto contract = folly::makePromiseContract<Message>();
+          const auto delay = request.payload.read<uint32_t>().value();
+          serverEvl.scheduleTimeout(
+              std::chrono::milliseconds(delay),
+              [promise = std::move(contract.first),
+               delay]() mutable noexcept {
+                promise.setValue(Message::from(delay).value());
+              });
+          return std::move(contract.second);
+        });
+
+    // Thrift request and reply
+    server->registerThriftHandler<thrift::Counter, thrift::Counter>(
+        "double", [](thrift::Counter&& counter) {
+          *counter.value_ref() *= 2;
+          return std::move(counter);
+        });
+    server->start().value();
+
+    client = std::make_unique<ZmqRpcClient>(clientEvl, context, kServerUrl);
+    serverThread = std::thread([this]() { serverEvl.run(); });
+    clientThread = std::thread([this]() { clientEvl.run(); });
+    serverEvl.waitUntilRunning();
+    clientEvl.waitUntilRunning();
+  }
+
+  void
+  TearDown() override {
+    clientEvl.runInEventLoop([this]() {
+      client.reset();
+      clientEvl.stop();
+    });
+    serverEvl.runInEventLoop([this]() {
+      server.reset();
+      serverEvl.stop();
+    });
+    clientThread.join();
+    serverThread.join();
+  }
+
+  ZmqRpcServer::Stats
+  getServerStats() {
+    auto contract = folly::makePromiseContract<ZmqRpcServer::Stats>();
+    serverEvl.runInEventLoop(
+        [this, promise = std::move(contract.first)]() mutable {
+          promise.setValue(server->getStats());
+        });
+    return std::move(contract.second).get();
+  }
+
+  Context context;
+  ZmqEventLoop serverEvl;
+  ZmqEventLoop clientEvl;
+  std::unique_ptr<ZmqRpcServer> server;
+  std::unique_ptr<ZmqRpcClient> client;
+  std::thread serverThread;
+  std::thread clientThread;
+};
+
+} // namespace
+
+TEST_F(ZmqRpcFixture, PipelinedRequests) {
+  // Slow requests don't hold back the ones behind them
+  std::vector<folly::SemiFuture<Message>> delayed;
+  for (uint32_t delay : {200, 100, 0}) {
+    delayed.emplace_back(
+        client->call("delay", Message::from(delay).value()));
+  }
+  std::vector<folly::SemiFuture<Message>> echoed;
+  for (int i = 0; i < 100; ++i) {
+    echoed.emplace_back(
+        client->call("echo", Message::from(std::to_string(i)).value()));
+  }
+
+  auto echoResults = folly::collectAll(std::move(echoed)).get();
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(echoResults[i].hasValue());
+    EXPECT_EQ(
+        std::to_string(i) + " world",
+        echoResults[i].value().read<std::string>().value());
+  }
+
+  auto delayResults = folly::collectAll(std::move(delayed)).get();
+  EXPECT_EQ(200, delayResults[0].value().read<uint32_t>().value());
+  EXPECT_EQ(100, delayResults[1].value().read<uint32_t>().value());
+  EXPECT_EQ(0, delayResults[2].value().read<uint32_t>().value());
+
+  thrift::Counter counter;
+  *counter.value_ref() = 21;
+  auto doubled =
+      client->callThrift<thrift::Counter>("double", counter).get();
+  EXPECT_EQ(42, *doubled.value_ref());
+
+  // Errors reported by server
+  auto failed = client->call("fail", Message()).getTry();
+  ASSERT_TRUE(failed.hasException<ZmqRpcError>());
+  EXPECT_EQ("oops", std::string(failed.exception().what()));
+  auto unknown = client->call("unknown", Message()).getTry();
+  EXPECT_TRUE(unknown.hasException<ZmqRpcError>());
+
+  const auto stats = getServerStats();
+  EXPECT_EQ(106, stats.numRequests);
+  EXPECT_EQ(106, stats.numReplies);
+  EXPECT_EQ(2, stats.numErrors);
+  EXPECT_EQ(0, stats.numExpired);
+  EXPECT_EQ(0, stats.numInflightRequests);
+}
+
+TEST_F(ZmqRpcFixture, Deadline) {
+  // Reply comes too late, client times out and server drops the reply
+  const auto start = std::chrono::steady_clock::now();
+  auto result =
+      client->call("delay", Message::from(uint32_t(300)).value(), 100ms)
+          .getTry();
+  EXPECT_TRUE(result.hasException<folly::FutureTimeout>());
+  EXPECT_LE(100ms, std::chrono::steady_clock::now() - start);
+
+  /* sleep override */
+  std::this_thread::sleep_for(300ms);
+  const auto stats = getServerStats();
+  EXPECT_EQ(1, stats.numExpired);
+  EXPECT_EQ(0, stats.numReplies);
+
+  // Client is still good for further requests
+  auto reply = client->call("echo", Message::from(std::string("hello")).value())
+                   .get();
+  EXPECT_EQ("hello world", reply.read<std::string>().value());
+}
+
+TEST(ZmqRpcTest, Overload) {
+  Context context;
+  ZmqEventLoop evl;
+
+  ZmqRpcServer::Options options;
+  options.maxInflightRequests = 1;
+  ZmqRpcServer server(evl, context, kServerUrl, options);
+  std::vector<folly::Promise<Message>> promises;
+  server.registerAsyncHandler("hold", [&](ZmqRpcServer::Request&&) {
+    auto contract = folly::makePromiseContract<Message>();
+    promises.emplace_back(std::move(contract.first));
+    return std::move(contract.second);
+  });
+  server.start().value();
+  ZmqRpcClient client(evl, context, kServerUrl);
+
+  auto held = client.call("hold", Message());
+  auto rejected = client.call("hold", Message());
+  evl.scheduleTimeout(100ms, [&]() noexcept {
+    EXPECT_EQ(1, server.getStats().numOverloaded);
+    EXPECT_EQ(1, server.getStats().numInflightRequests);
+    ASSERT_EQ(1, promises.size());
+    promises.at(0).setValue(Message::from(std::string("done")).value());
+  });
+  evl.scheduleTimeout(200ms, [&]() noexcept {
+    EXPECT_EQ(0, server.getStats().numInflightRequests);
+    EXPECT_EQ(0, client.getNumPendingRequests());
+    evl.stop();
+  });
+  evl.run();
+
+  EXPECT_EQ("done", std::move(held).get().read<std::string>().value());
+  EXPECT_TRUE(std::move(rejected).getTry().hasException<ZmqRpcError>());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ZmqFiberServer.h"
+
+#include <algorithm>
+
+#include <folly/ScopeGuard.h>
+#include <folly/fibers/EventBaseLoopController.h>
+
+namespace fbzmq {
+
+ZmqFiberServer::ZmqFiberServer(
+    folly::EventBase& evb,
+    Context& zmqContext,
+    SocketUrl url,
+    Handler handler,
+    Options options)
+    : evb_(evb),
+      url_(std::move(url)),
+      handler_(std::move(handler)),
+      options_(std::move(options)),
+      sock_(zmqContext, folly::none, folly::none, NonblockingFlag{true}, &evb),
+      fiberManager_(
+          std::make_unique<folly::fibers::EventBaseLoopController>(),
+          options_.fiberOptions) {
+  CHECK(handler_);
+  CHECK_LT(0, options_.maxConcurrentRequests);
+  static_cast<folly::fibers::EventBaseLoopController&>(
+      fiberManager_.loopController())
+      .attachEventBase(evb_);
+}
+
+ZmqFiberServer::~ZmqFiberServer() {
+  if (isRunning_) {
+    stop();
+  }
+  // Fibers must be done before FiberManager can be destroyed
+  while (fiberManager_.hasTasks()) {
+    evb_.loopOnce();
+  }
+}
+
+folly::Expected<folly::Unit, Error>
+ZmqFiberServer::start() {
+  CHECK(not isRunning_) << "Server is already running";
+  auto ret = sock_.bind(url_);
+  if (ret.hasError()) {
+    LOG(ERROR) << "ZmqFiberServer: Failed to bind on " << std::string(url_)
+               << ". " << ret.error();
+    return ret;
+  }
+
+  isRunning_ = true;
+  fiberManager_.addTask([this]() { readLoop(); });
+  fiberManager_.addTask([this]() { writeLoop(); });
+  return folly::unit;
+}
+
+void
+ZmqFiberServer::stop() {
+  CHECK(isRunning_) << "Server is not running";
+  isRunning_ = false;
+
+  // Closing socket unblocks reader and writer waiting on it
+  sock_.close();
+  readerBaton_.post();
+  writerBaton_.post();
+}
+
+void
+ZmqFiberServer::readLoop() {
+  while (isRunning_) {
+    // Backpressure, let requests queue up in socket
+    if (stats_.numInflightRequests >= options_.maxConcurrentRequests) {
+      ++stats_.numThrottled;
+      readerBaton_.reset();
+      readerBaton_.wait();
+      continue;
+    }
+
+    auto frames = sock_.recvMultiple();
+    if (not isRunning_) {
+      break;
+    }
+    if (frames.hasError()) {
+      LOG(ERROR) << "ZmqFiberServer: Failed to receive request. "
+                 << frames.error();
+      continue;
+    }
+
+    ++stats_.numRequests;
+    ++stats_.numInflightRequests;
+    stats_.maxInflightRequests =
+        std::max(stats_.maxInflightRequests, stats_.numInflightRequests);
+    fiberManager_.addTask(
+        [this, frames = std::move(frames.value())]() mutable {
+          handleRequest(std::move(frames));
+        });
+  }
+}
+
+void
+ZmqFiberServer::writeLoop() {
+  while (isRunning_) {
+    if (replyQueue_.empty()) {
+      writerBaton_.reset();
+      writerBaton_.wait();
+      continue;
+    }
+
+    auto frames = std::move(replyQueue_.front());
+    replyQueue_.pop_front();
+    auto ret = sock_.sendBatch(std::move(frames));
+    if (ret.hasError()) {
+      // e.g. requester has gone away
+      ++stats_.numSendErrors;
+      VLOG(2) << "ZmqFiberServer: Failed to send reply. " << ret.error();
+      continue;
+    }
+    ++stats_.numReplies;
+  }
+  replyQueue_.clear();
+}
+
+void
+ZmqFiberServer::handleRequest(std::vector<Message>&& frames) {
+  SCOPE_EXIT {
+    // Free up the slot and resume reader if it got throttled
+    if (stats_.numInflightRequests-- == options_.maxConcurrentRequests) {
+      readerBaton_.post();
+    }
+  };
+
+  if (frames.size() < 2) {
+    ++stats_.numMalformedRequests;
+    VLOG(2) << "ZmqFiberServer: Request without body";
+    return;
+  }
+
+  // Split envelope and body of request
+  auto delimiter =
+      std::find_if(frames.begin(), frames.end(), [](Message const& msg) {
+        return msg.empty();
+      });
+  const auto bodyBegin = delimiter != frames.end()
+      ? std::next(delimiter)
+      : std::next(frames.begin());
+  if (bodyBegin == frames.end()) {
+    ++stats_.numMalformedRequests;
+    VLOG(2) << "ZmqFiberServer: Request without body";
+    return;
+  }
+  std::vector<Message> request(
+      std::make_move_iterator(bodyBegin),
+      std::make_move_iterator(frames.end()));
+  frames.erase(bodyBegin, frames.end());
+
+  auto reply = handler_(std::move(request));
+  if (reply.empty() or not isRunning_) {
+    return;
+  }
+
+  // Envelope followed by reply
+  frames.insert(
+      frames.end(),
+      std::make_move_iterator(reply.begin()),
+      std::make_move_iterator(reply.end()));
+  replyQueue_.emplace_back(std::move(frames));
+  writerBaton_.post();
+}
+
+} // namespace fbzmq
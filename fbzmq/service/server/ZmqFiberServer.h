@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <folly/Expected.h>
+#include <folly/Function.h>
+#include <folly/fibers/Baton.h>
+#include <folly/fibers/FiberManager.h>
+#include <folly/io/async/EventBase.h>
+
+#include <fbzmq/zmq/Zmq.h>
+
+namespace fbzmq {
+
+struct ZmqFiberServerOptions {
+  // Max requests being handled at once
+  size_t maxConcurrentRequests{1024};
+
+  // Options of fibers of reader, writer and handlers. Stack size must
+  // accommodate the handlers.
+  folly::fibers::FiberManager::Options fiberOptions{};
+};
+
+/**
+ * Request/reply server on a ROUTER socket with many requests in flight at
+ * once. Every request is handled in its own fiber, hence handlers can do
+ * blocking-style (fiber) I/O, e.g. on other evb backed sockets, without
+ * blocking other requests.
+ *
+ * - A single reader fiber receives requests and dispatches each of them to a
+ *   new fiber task. It stops reading once `maxConcurrentRequests` are in
+ *   flight, leaving further requests queued in the socket (backpressure).
+ * - Replies are funneled through a queue and sent by a single writer fiber,
+ *   as frames of concurrent replies must not interleave on the socket.
+ *
+ * Routing envelope of a request is all frames till the first empty frame
+ * (inclusive) if there is one, e.g. for REQ clients or proxies, else just the
+ * identity frame, e.g. for DEALER clients. Envelope is sent back ahead of the
+ * reply frames.
+ *
+ * Not thread safe. All methods must be called from the thread of EventBase
+ * (or while it is not running).
+ *
+ *  ZmqFiberServer server(evb, context, SocketUrl{url}, [](auto&& request) {
+ *    return handle(std::move(request));
+ *  });
+ *  server.start().value();
+ *  evb.loopForever();
+ */
+class ZmqFiberServer {
+ public:
+  /**
+   * Handler of a request, invoked in a fiber of its own. Returns frames of
+   * the reply, none are sent if empty.
+   */
+  using Handler =
+      folly::Function<std::vector<Message>(std::vector<Message>&& request)>;
+
+  using Options = ZmqFiberServerOptions;
+
+  /**
+   * Cumulative stats of server
+   */
+  struct Stats {
+    uint64_t numRequests{0};
+    uint64_t numReplies{0};
+    // Requests without any body frame after the envelope
+    uint64_t numMalformedRequests{0};
+    uint64_t numSendErrors{0};
+    // Times reader stopped reading as max concurrency had been hit
+    uint64_t numThrottled{0};
+    size_t numInflightRequests{0};
+    size_t maxInflightRequests{0};
+  };
+
+  ZmqFiberServer(
+      folly::EventBase& evb,
+      Context& zmqContext,
+      SocketUrl url,
+      Handler handler,
+      Options options = Options());
+
+  /**
+   * Stops the server if running. Drives the EventBase until handlers in
+   * flight have returned.
+   */
+  ~ZmqFiberServer();
+
+  ZmqFiberServer(ZmqFiberServer const&) = delete;
+  ZmqFiberServer& operator=(ZmqFiberServer const&) = delete;
+
+  /**
+   * Bind the socket and start reader/writer fibers
+   */
+  folly::Expected<folly::Unit, Error> start();
+
+  /**
+   * Stop receiving requests and close the socket. Replies of requests in
+   * flight are dropped.
+   */
+  void stop();
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+  /**
+   * Underlying ROUTER socket, e.g. for setting options before `start()`
+   */
+  Socket<ZMQ_ROUTER, ZMQ_SERVER>&
+  getSocket() {
+    return sock_;
+  }
+
+ private:
+  void readLoop();
+  void writeLoop();
+  void handleRequest(std::vector<Message>&& frames);
+
+  folly::EventBase& evb_;
+  const SocketUrl url_;
+  Handler handler_;
+  const Options options_;
+
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> sock_;
+  folly::fibers::FiberManager fiberManager_;
+
+  // Replies waiting to be sent, including envelope
+  std::deque<std::vector<Message>> replyQueue_;
+
+  // Wakes up writer on new reply or stop
+  folly::fibers::Baton writerBaton_;
+
+  // Wakes up reader throttled on max concurrency or stop
+  folly::fibers::Baton readerBaton_;
+
+  bool isRunning_{false};
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
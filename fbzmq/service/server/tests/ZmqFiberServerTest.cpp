@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <set>
+#include <thread>
+
+#include <folly/Format.h>
+#include <folly/fibers/Baton.h>
+#include <folly/io/async/EventBase.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/server/ZmqFiberServer.h>
+
+using namespace std::chrono_literals;
+
+namespace fbzmq {
+
+namespace {
+
+const SocketUrl kServerUrl{"inproc://fiber_server_test"};
+
+/**
+ * Runs server in an EventBase thread of its own. Clients are regular blocking
+ * sockets of test thread.
+ */
+class ZmqFiberServerFixture : public ::testing::Test {
+ public:
+  void
+  startServer(
+      ZmqFiberServer::Handler handler,
+      ZmqFiberServer::Options options = ZmqFiberServer::Options()) {
+    server = std::make_unique<ZmqFiberServer>(
+        evb, context, kServerUrl, std::move(handler), std::move(options));
+    server->start().value();
+    evbThread = std::thread([this]() { evb.loopForever(); });
+    evb.waitUntilRunning();
+  }
+
+  void
+  TearDown() override {
+    if (evbThread.joinable()) {
+      evb.runInEventBaseThreadAndWait([this]() { server->stop(); });
+      evb.terminateLoopSoon();
+      evbThread.join();
+    }
+    server.reset();
+  }
+
+  ZmqFiberServer::Stats
+  getStats() {
+    ZmqFiberServer::Stats stats;
+    evb.runInEventBaseThreadAndWait([&]() { stats = server->getStats(); });
+    return stats;
+  }
+
+  // Echo with a suffix
+  static std::vector<Message>
+  echo(std::vector<Message>&& request) {
+    auto str = request.at(0).read<std::string>().value();
+    return {Message::from(str + " world").value()};
+  }
+
+  Context context;
+  folly::EventBase evb;
+  std::unique_ptr<ZmqFiberServer> server;
+  std::thread evbThread;
+};
+
+} // namespace
+
+TEST_F(ZmqFiberServerFixture, DealerClient) {
+  startServer(&ZmqFiberServerFixture::echo);
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(context);
+  client.connect(kServerUrl).value();
+  for (int i = 0; i < 3; ++i) {
+    client.sendOne(Message::from(std::string("hello")).value()).value();
+    auto reply = client.recvOne(3000ms).value();
+    EXPECT_EQ("hello world", reply.read<std::string>().value());
+  }
+
+  const auto stats = getStats();
+  EXPECT_EQ(3, stats.numRequests);
+  EXPECT_EQ(3, stats.numReplies);
+  EXPECT_EQ(0, stats.numInflightRequests);
+}
+
+TEST_F(ZmqFiberServerFixture, ReqClient) {
+  // REQ adds empty delimiter, handler must only see the body
+  startServer([](std::vector<Message>&& request) {
+    EXPECT_EQ(2, request.size());
+    auto first = request.at(0).read<std::string>().value();
+    auto second = request.at(1).read<std::string>().value();
+    return std::vector<Message>{Message::from(second + first).value()};
+  });
+
+  Socket<ZMQ_REQ, ZMQ_CLIENT> client(context);
+  client.connect(kServerUrl).value();
+  client
+      .sendMultiple(
+          Message::from(std::string("a")).value(),
+          Message::from(std::string("b")).value())
+      .value();
+  auto reply = client.recvOne(3000ms).value();
+  EXPECT_EQ("ba", reply.read<std::string>().value());
+}
+
+TEST_F(ZmqFiberServerFixture, EmptyReply) {
+  startServer([](std::vector<Message>&& request) {
+    if (request.at(0).read<std::string>().value() == "drop") {
+      return std::vector<Message>{};
+    }
+    return echo(std::move(request));
+  });
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(context);
+  client.connect(kServerUrl).value();
+  client.sendOne(Message::from(std::string("drop")).value()).value();
+  client.sendOne(Message::from(std::string("hello")).value()).value();
+  auto reply = client.recvOne(3000ms).value();
+  EXPECT_EQ("hello world", reply.read<std::string>().value());
+
+  const auto stats = getStats();
+  EXPECT_EQ(2, stats.numRequests);
+  EXPECT_EQ(1, stats.numReplies);
+}
+
+TEST_F(ZmqFiberServerFixture, ConcurrentRequests) {
+  // Every handler suspends its fiber, requests must overlap
+  const int kNumRequests = 10;
+  startServer([](std::vector<Message>&& request) {
+    folly::fibers::Baton baton;
+    baton.try_wait_for(100ms);
+    return echo(std::move(request));
+  });
+
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> client(context);
+  client.connect(kServerUrl).value();
+  for (int i = 0; i < kNumRequests; ++i) {
+    client.sendOne(Message::from(std::to_string(i)).value()).value();
+  }
+  std::set<std::string> replies;
+  for (int i = 0; i < kNumRequests; ++i) {
+    auto reply = client.recvOne(3000ms).value();
+    replies.insert(reply.read<std::string>().value());
+  }
+  EXPECT_EQ(kNumRequests, replies.size());
+
+  const auto stats = getStats();
+  EXPECT_EQ(kNumRequests, stats.numReplies);
+  EXPECT_EQ(kNumRequests, stats.maxInflightRequests);
+  EXPECT_EQ(0, stats.numThrottled);
+}
+
+TEST_F(ZmqFiberServerFixture, MaxConcurrentRequests) {
+  ZmqFiberServer::Options options;
+  options.maxConcurrentRequests = 2;
+  startServer(
+      [](std::vector<Message>&& request) {
+        folly::fibers::Baton baton;
+        baton.try_wait_for(20ms);
+        return echo(std::move(request));
+      },
+      options);
+
+  // Multiple clients, replies must be routed back to the right one
+  const int kNumClients = 3;
+  std::vector<Socket<ZMQ_DEALER, ZMQ_CLIENT>> clients;
+  for (int i = 0; i < kNumClients; ++i) {
+    clients.emplace_back(context);
+    clients.back().connect(kServerUrl).value();
+  }
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < kNumClients; ++i) {
+      clients[i].sendOne(Message::from(std::to_string(i)).value()).value();
+    }
+  }
+  for (int i = 0; i < kNumClients; ++i) {
+    for (int round = 0; round < 2; ++round) {
+      auto reply = clients[i].recvOne(3000ms).value();
+      EXPECT_EQ(
+          folly::sformat("{} world", i), reply.read<std::string>().value());
+    }
+  }
+
+  const auto stats = getStats();
+  EXPECT_EQ(2 * kNumClients, stats.numReplies);
+  EXPECT_EQ(2, stats.maxInflightRequests);
+  EXPECT_LT(0, stats.numThrottled);
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
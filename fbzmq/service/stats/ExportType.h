@@ -16,6 +16,11 @@ enum ExportType {
   // MAX        = 0x08,   // Not Available yet
   RATE = 0x10,
   COUNT = 0x20,
-  COUNT_RATE = 0x40
+  COUNT_RATE = 0x40,
+  // Percentiles, estimated from a fixed-size digest per level
+  P50 = 0x80,
+  P90 = 0x100,
+  P99 = 0x200,
+  P999 = 0x400,
 };
 } // namespace fbzmq
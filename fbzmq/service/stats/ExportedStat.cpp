@@ -7,6 +7,9 @@
 
 #include "ExportedStat.h"
 
+#include <algorithm>
+#include <array>
+#include <utility>
 #include <vector>
 
 #include <folly/Format.h>
@@ -16,44 +19,144 @@ namespace fbzmq {
 namespace {
 
 /**
- * Number of buckets to use for folly::BucketedTimeSeries
+ * All export types along with their names, in the order in which counters are
+ * reported for a level.
  */
-static const uint64_t kTsBuckets{60};
+static const std::array<std::pair<ExportType, const char*>, 9> kExportTypes = {{
+    {SUM, "sum"},
+    {AVG, "avg"},
+    {RATE, "rate"},
+    {COUNT, "count"},
+    {COUNT_RATE, "count_rate"},
+    {P50, "p50"},
+    {P90, "p90"},
+    {P99, "p99"},
+    {P999, "p999"},
+}};
 
 /**
- * Statically defined levels for multi level timeseries.
+ * Mask of percentile export types and their quantiles, in the same order.
  */
-static const std::vector<std::chrono::seconds> kLevelDurations = {
-    std::chrono::seconds(60), // One minute
-    std::chrono::seconds(600), // Ten minutes
-    std::chrono::seconds(3600), // One hour
-    std::chrono::seconds(0), // All time
+static const uint32_t kPercentileTypeBits{P50 | P90 | P99 | P999};
+static const std::array<double, 4> kQuantiles = {{0.5, 0.9, 0.99, 0.999}};
+
+/**
+ * Export types which need a timeseries
+ */
+static const uint32_t kTimeSeriesTypeBits{RATE | COUNT_RATE};
+
+/**
+ * Number of digests in sliding window of a level. Memory of a digest is
+ * bounded, so is memory of a level.
+ */
+static const size_t kQuantileWindows{12};
+
+/**
+ * Values of a level for all export types
+ */
+struct LevelValues {
+  int64_t sum{0};
+  int64_t avg{0};
+  int64_t rate{0};
+  int64_t count{0};
+  int64_t countRate{0};
+  std::array<int64_t, 4> quantiles{};
 };
 
 /**
- * Utility function to get the current timestamp in seconds since epoch.
+ * Value of the given export type for a level
+ */
+int64_t
+getLevelValue(LevelValues const& values, ExportType type) {
+  switch (type) {
+  case SUM:
+    return values.sum;
+  case AVG:
+    return values.avg;
+  case RATE:
+    return values.rate;
+  case COUNT:
+    return values.count;
+  case COUNT_RATE:
+    return values.countRate;
+  case P50:
+    return values.quantiles[0];
+  case P90:
+    return values.quantiles[1];
+  case P99:
+    return values.quantiles[2];
+  case P999:
+    return values.quantiles[3];
+  }
+  return 0;
+}
+
+/**
+ * Name of a level. Whole seconds are named "<seconds>" and the rest
+ * "<milliseconds>ms".
  */
-std::chrono::seconds
-getTsInSeconds() {
-  return std::chrono::duration_cast<std::chrono::seconds>(
+std::string
+getLevelName(std::chrono::milliseconds duration) {
+  if (duration.count() % 1000 == 0) {
+    return folly::sformat("{}", duration.count() / 1000);
+  }
+  return folly::sformat("{}ms", duration.count());
+}
+
+/**
+ * Utility function to get the current timestamp in milliseconds since epoch.
+ */
+std::chrono::milliseconds
+getTsInMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
       std::chrono::steady_clock::now().time_since_epoch());
 }
 
 } // namespace
 
-ExportedStat::ExportedStat(std::string const& key) : key_(key) {
-  multiTs_.reset(new folly::MultiLevelTimeSeries<int64_t>(
-      kTsBuckets, kLevelDurations.size(), &kLevelDurations[0]));
+ExportedStatOptions
+ExportedStatOptions::singleLevel(
+    std::chrono::milliseconds duration, size_t numBuckets) {
+  ExportedStatOptions options;
+  options.numBuckets = numBuckets;
+  options.levelDurations = {duration};
+  return options;
+}
+
+ExportedStatOptions
+ExportedStatOptions::counterOnly() {
+  ExportedStatOptions options;
+  options.levelDurations.clear();
+  return options;
+}
+
+ExportedStat::ExportedStat(
+    std::string const& key, ExportedStatOptions const& options)
+    : key_(key) {
+  if (not options.levelDurations.empty()) {
+    multiTs_.reset(new TimeSeries(
+        options.numBuckets,
+        options.levelDurations.size(),
+        options.levelDurations.data()));
+  }
 }
 
 void
 ExportedStat::setExportType(ExportType type) {
-  exportTypeBits_ |= type;
+  if ((exportTypeBits_ & type) != static_cast<uint32_t>(type)) {
+    exportTypeBits_ |= type;
+    updateCounterNames();
+    updateQuantileEstimators();
+  }
 }
 
 void
 ExportedStat::unsetExportType(ExportType type) {
-  exportTypeBits_ &= ~type;
+  if (exportTypeBits_ & type) {
+    exportTypeBits_ &= ~type;
+    updateCounterNames();
+    updateQuantileEstimators();
+  }
 }
 
 /**
@@ -61,7 +164,34 @@ ExportedStat::unsetExportType(ExportType type) {
  */
 void
 ExportedStat::addValue(int64_t value) {
-  multiTs_->addValue(getTsInSeconds(), value);
+  if (multiTs_) {
+    multiTs_->addValue(getTsInMillis(), value);
+  } else {
+    sum_ += value;
+    ++count_;
+  }
+
+  if (quantileLevels_.empty()) {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& quantileLevel : quantileLevels_) {
+    if (quantileLevel.window) {
+      quantileLevel.window->addValue(value, now);
+    } else {
+      quantileLevel.allTime->addValue(value, now);
+    }
+  }
+}
+
+void
+ExportedStat::addValueAggregated(int64_t sum, uint64_t count) {
+  if (multiTs_) {
+    multiTs_->addValueAggregated(getTsInMillis(), sum, count);
+  } else {
+    sum_ += sum;
+    count_ += count;
+  }
 }
 
 /**
@@ -70,37 +200,122 @@ ExportedStat::addValue(int64_t value) {
  */
 void
 ExportedStat::getCounters(std::unordered_map<std::string, int64_t>& counters) {
+  getCounters([&counters](std::string const& name, int64_t value) {
+    counters[name] = value;
+  });
+}
+
+void
+ExportedStat::getCounters(
+    folly::FunctionRef<void(std::string const&, int64_t)> visitor) {
+  if (counterNames_.empty()) {
+    return;
+  }
+
   // Update timeseries
-  multiTs_->update(getTsInSeconds());
+  if (multiTs_) {
+    multiTs_->update(getTsInMillis());
+  }
 
-  for (size_t i = 0; i < kLevelDurations.size(); i++) {
-    auto const& level = multiTs_->getLevel(i);
-    auto const interval = level.duration().count();
+  const auto now = std::chrono::steady_clock::now();
+  const folly::Range<const double*> quantileRange(
+      kQuantiles.data(), kQuantiles.size());
+  const uint32_t typeBits =
+      multiTs_ ? exportTypeBits_ : exportTypeBits_ & ~kTimeSeriesTypeBits;
 
-    if (exportTypeBits_ & SUM) {
-      auto key = folly::sformat("{}.sum.{}", key_, interval);
-      counters[key] = level.sum();
+  auto name = counterNames_.begin();
+  for (size_t i = 0; i < getNumLevels(); i++) {
+    LevelValues values;
+    if (multiTs_) {
+      auto const& level = multiTs_->getLevel(i);
+      values.sum = level.sum();
+      values.avg = level.avg();
+      values.rate = level.rate<double, std::chrono::seconds>();
+      values.count = level.count();
+      values.countRate =
+          level.countRate<double, std::chrono::seconds>();
+    } else {
+      values.sum = sum_;
+      values.avg = count_ ? sum_ / static_cast<int64_t>(count_) : 0;
+      values.count = count_;
     }
 
-    if (exportTypeBits_ & AVG) {
-      auto key = folly::sformat("{}.avg.{}", key_, interval);
-      counters[key] = level.avg();
+    if (not quantileLevels_.empty()) {
+      auto& quantileLevel = quantileLevels_[i];
+      auto const estimates = quantileLevel.window
+          ? quantileLevel.window->estimateQuantiles(quantileRange, now)
+          : quantileLevel.allTime->estimateQuantiles(quantileRange, now);
+      for (size_t j = 0; j < values.quantiles.size(); j++) {
+        values.quantiles[j] =
+            static_cast<int64_t>(estimates.quantiles[j].second);
+      }
     }
 
-    if (exportTypeBits_ & RATE) {
-      auto key = folly::sformat("{}.rate.{}", key_, interval);
-      counters[key] = level.rate();
+    for (auto const& exportType : kExportTypes) {
+      if (typeBits & exportType.first) {
+        visitor(*name++, getLevelValue(values, exportType.first));
+      }
     }
+  }
+}
+
+void
+ExportedStat::updateCounterNames() {
+  const uint32_t typeBits =
+      multiTs_ ? exportTypeBits_ : exportTypeBits_ & ~kTimeSeriesTypeBits;
 
-    if (exportTypeBits_ & COUNT) {
-      auto key = folly::sformat("{}.count.{}", key_, interval);
-      counters[key] = level.count();
+  counterNames_.clear();
+  for (size_t i = 0; i < getNumLevels(); i++) {
+    auto const levelName = getLevelName(getLevelDuration(i));
+    for (auto const& exportType : kExportTypes) {
+      if (typeBits & exportType.first) {
+        counterNames_.emplace_back(
+            folly::sformat("{}.{}.{}", key_, exportType.second, levelName));
+      }
     }
+  }
+}
 
-    if (exportTypeBits_ & COUNT_RATE) {
-      auto key = folly::sformat("{}.count_rate.{}", key_, interval);
-      counters[key] = level.countRate();
+void
+ExportedStat::updateQuantileEstimators() {
+  if (not(exportTypeBits_ & kPercentileTypeBits)) {
+    quantileLevels_.clear();
+    return;
+  }
+  if (not quantileLevels_.empty()) {
+    return;
+  }
+
+  // Windows are at least a second long, hence sub-second levels get a single
+  // window of a second.
+  quantileLevels_.resize(getNumLevels());
+  for (size_t i = 0; i < getNumLevels(); i++) {
+    const auto duration =
+        std::chrono::duration_cast<std::chrono::seconds>(getLevelDuration(i));
+    if (getLevelDuration(i).count() == 0) {
+      quantileLevels_[i].allTime =
+          std::make_unique<folly::SimpleQuantileEstimator<>>();
+    } else {
+      const auto numWindows = std::max<size_t>(
+          1, std::min<size_t>(kQuantileWindows, duration.count()));
+      quantileLevels_[i].window =
+          std::make_unique<folly::SlidingWindowQuantileEstimator<>>(
+              std::max(
+                  duration / static_cast<int>(numWindows),
+                  std::chrono::seconds(1)),
+              numWindows);
     }
   }
 }
+
+size_t
+ExportedStat::getNumLevels() const {
+  return multiTs_ ? multiTs_->numLevels() : 1;
+}
+
+std::chrono::milliseconds
+ExportedStat::getLevelDuration(size_t level) const {
+  return multiTs_ ? multiTs_->getLevel(level).duration()
+                  : std::chrono::milliseconds(0);
+}
 } // namespace fbzmq
@@ -9,29 +9,73 @@
 
 #include <chrono>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
+#include <folly/Function.h>
 #include <folly/String.h>
 #include <folly/stats/MultiLevelTimeSeries.h>
+#include <folly/stats/QuantileEstimator.h>
 
 #include "ExportType.h"
 
 namespace fbzmq {
 
 /**
- * Class which stores the multi-level timeseries data for a certain key and
- * wraps up the logic for updating and building-counters.
- *
- * We are using most common levels (derived from fbcode::ServiceData) which are
+ * Levels of the timeseries of an ExportedStat. Defaults are the most common
+ * levels (derived from fbcode::ServiceData) which are
  * - 1 minute (.60)
  * - 10 minutes (.600)
  * - 1 hour (.3600)
  * - all time (.0)
+ *
+ * Level of zero duration is all time. Levels with whole seconds are named by
+ * seconds (e.g. ".60") and sub-second levels by milliseconds (e.g. ".500ms").
+ */
+struct ExportedStatOptions {
+  /**
+   * Single level of given duration, e.g. for cheap short-term rates
+   */
+  static ExportedStatOptions singleLevel(
+      std::chrono::milliseconds duration, size_t numBuckets = 10);
+
+  /**
+   * No timeseries at all. Only all time sum, avg and count (and percentiles)
+   * are maintained, exported as level ".0". RATE and COUNT_RATE are not
+   * available.
+   */
+  static ExportedStatOptions counterOnly();
+
+  // Number of buckets of every level (all time level has no buckets)
+  size_t numBuckets{60};
+
+  // Durations of levels. Empty for counter only mode.
+  std::vector<std::chrono::milliseconds> levelDurations{
+      std::chrono::seconds(60), // One minute
+      std::chrono::seconds(600), // Ten minutes
+      std::chrono::seconds(3600), // One hour
+      std::chrono::seconds(0), // All time
+  };
+};
+
+/**
+ * Class which stores the multi-level timeseries data for a certain key and
+ * wraps up the logic for updating and building-counters. We use levels of
+ * `ExportedStatOptions`.
+ *
+ * Percentile export types (P50, P90, P99, P999) are backed by t-digests,
+ * a sliding window of digests for every finite level and a single digest for
+ * all time, so memory is bounded regardless of number of values. Digests are
+ * allocated only once a percentile export type is set.
  */
 class ExportedStat : public boost::noncopyable {
  public:
-  explicit ExportedStat(std::string const& key);
+  explicit ExportedStat(
+      std::string const& key,
+      ExportedStatOptions const& options = ExportedStatOptions());
 
   /**
    * Set/unset export-type for this statistic.
@@ -44,20 +88,75 @@ class ExportedStat : public boost::noncopyable {
    */
   void addValue(int64_t value);
 
+  /**
+   * Add `count` values with a total of `sum` at once, e.g. when merging
+   * pre-aggregated samples from another thread. Individual values are not
+   * known, hence these don't contribute to percentiles.
+   */
+  void addValueAggregated(int64_t sum, uint64_t count);
+
   /**
    * API to get the counters for exported stat-types among all the levels.
    * Counters are named as "<key>.<export-type>.<level>". e.g. "foo.avg.60"
    */
   void getCounters(std::unordered_map<std::string, int64_t>& counters);
 
+  /**
+   * Same as above but invokes `visitor(name, value)` for every counter instead
+   * of building a map. Counter names are cached and only re-built when export
+   * types change, hence this doesn't allocate.
+   */
+  void getCounters(
+      folly::FunctionRef<void(std::string const&, int64_t)> visitor);
+
  private:
+  /**
+   * Rebuild the cached counter names for current export types.
+   */
+  void updateCounterNames();
+
+  /**
+   * Allocate quantile estimators if any of percentile types is exported.
+   */
+  void updateQuantileEstimators();
+
+  /**
+   * Number of levels and their durations. Counter only mode is a single all
+   * time level.
+   */
+  size_t getNumLevels() const;
+  std::chrono::milliseconds getLevelDuration(size_t level) const;
+
+  // MultiLevelTimeSeries with millisecond granularity to allow sub-second
+  // levels
+  using TimeSeries = folly::MultiLevelTimeSeries<
+      int64_t,
+      folly::LegacyStatsClock<std::chrono::milliseconds>>;
+
   // The associated key
   std::string key_{""};
 
-  // MultiLevelTimeSeries associated with this statistics
-  std::unique_ptr<folly::MultiLevelTimeSeries<int64_t>> multiTs_;
+  // MultiLevelTimeSeries associated with this statistics, null in counter
+  // only mode
+  std::unique_ptr<TimeSeries> multiTs_;
+
+  // All time sum and count in counter only mode
+  int64_t sum_{0};
+  uint64_t count_{0};
 
   // Masked bitset for export types. #efficiency
   uint32_t exportTypeBits_{0};
+
+  // Cached counter names of exported types for each level, laid out level by
+  // level in the order of export types
+  std::vector<std::string> counterNames_;
+
+  // Quantile estimators per level, allocated only if needed. `allTime` is set
+  // for all time level and `window` for the rest.
+  struct QuantileLevel {
+    std::unique_ptr<folly::SlidingWindowQuantileEstimator<>> window;
+    std::unique_ptr<folly::SimpleQuantileEstimator<>> allTime;
+  };
+  std::vector<QuantileLevel> quantileLevels_;
 };
 } // namespace fbzmq
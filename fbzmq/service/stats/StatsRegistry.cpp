@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "StatsRegistry.h"
+
+#include <algorithm>
+
+namespace fbzmq {
+
+constexpr uint32_t StatHandle::kInvalidIndex;
+constexpr size_t StatsRegistry::kMaxKeys;
+constexpr size_t StatsRegistry::kChunkSize;
+constexpr size_t StatsRegistry::kMaxChunks;
+
+StatsRegistry::Shard::~Shard() {
+  for (auto& chunk : chunks) {
+    delete chunk.load(std::memory_order_acquire);
+  }
+}
+
+StatHandle
+StatsRegistry::get(std::string const& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = indices_.find(key);
+  if (it != indices_.end()) {
+    return StatHandle(it->second);
+  }
+  getEntryLocked(key);
+  return StatHandle(entries_.size() - 1);
+}
+
+void
+StatsRegistry::addStatExportType(std::string const& key, ExportType type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  getStatLocked(getEntryLocked(key)).setExportType(type);
+}
+
+void
+StatsRegistry::clearStatExportType(std::string const& key, ExportType type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = indices_.find(key);
+  if (it != indices_.end() and entries_[it->second].stat) {
+    entries_[it->second].stat->unsetExportType(type);
+  }
+}
+
+void
+StatsRegistry::setCounter(StatHandle handle, int64_t value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK_LT(handle.index_, entries_.size());
+
+  // Discard increments accumulated in shards so far
+  for (auto& shard : shards_) {
+    auto slot = shard->findSlot(handle.index_);
+    if (slot) {
+      slot->counterDelta.exchange(0, std::memory_order_relaxed);
+    }
+  }
+
+  auto& entry = entries_[handle.index_];
+  entry.counter = value;
+  entry.hasCounter = true;
+}
+
+void
+StatsRegistry::clearCounter(StatHandle handle) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK_LT(handle.index_, entries_.size());
+
+  for (auto& shard : shards_) {
+    auto slot = shard->findSlot(handle.index_);
+    if (slot) {
+      slot->hasCounter.store(false, std::memory_order_relaxed);
+      slot->counterDelta.exchange(0, std::memory_order_relaxed);
+    }
+  }
+
+  auto& entry = entries_[handle.index_];
+  entry.counter = 0;
+  entry.hasCounter = false;
+}
+
+void
+StatsRegistry::aggregate() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  aggregateLocked();
+}
+
+std::unordered_map<std::string, int64_t>
+StatsRegistry::getCounters() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  aggregateLocked();
+
+  std::unordered_map<std::string, int64_t> counters;
+  for (auto& entry : entries_) {
+    if (entry.hasCounter) {
+      counters[entry.key] = entry.counter;
+    }
+    if (entry.stat) {
+      entry.stat->getCounters(counters);
+    }
+  }
+  return counters;
+}
+
+size_t
+StatsRegistry::getNumShards() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return shards_.size();
+}
+
+StatsRegistry::ShardRef*
+StatsRegistry::createShard() {
+  auto ref = new ShardRef(new Shard());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.emplace_back(ref->shard);
+  }
+  threadShard_.reset(ref);
+  return ref;
+}
+
+StatsRegistry::Entry&
+StatsRegistry::getEntryLocked(std::string const& key) {
+  auto it = indices_.find(key);
+  if (it != indices_.end()) {
+    return entries_[it->second];
+  }
+
+  CHECK_GT(kMaxKeys, entries_.size()) << "Too many keys in StatsRegistry";
+  indices_.emplace(key, entries_.size());
+  entries_.emplace_back(key);
+  return entries_.back();
+}
+
+ExportedStat&
+StatsRegistry::getStatLocked(Entry& entry) {
+  if (not entry.stat) {
+    entry.stat = std::make_unique<ExportedStat>(entry.key, statOptions_);
+  }
+  return *entry.stat;
+}
+
+void
+StatsRegistry::aggregateLocked() {
+  for (auto it = shards_.begin(); it != shards_.end();) {
+    auto& shard = **it;
+
+    // Read orphaned flag before the slots. Nothing is written to an orphaned
+    // shard, hence it can be released once folded.
+    const bool isOrphaned = shard.isOrphaned.load(std::memory_order_acquire);
+
+    for (size_t i = 0; i < kMaxChunks; ++i) {
+      auto chunk = shard.chunks[i].load(std::memory_order_acquire);
+      if (not chunk) {
+        continue;
+      }
+      const size_t begin = i * kChunkSize;
+      const size_t end = std::min(begin + kChunkSize, entries_.size());
+      for (size_t index = begin; index < end; ++index) {
+        auto& slot = (*chunk)[index - begin];
+        auto& entry = entries_[index];
+
+        if (slot.hasCounter.exchange(false, std::memory_order_relaxed)) {
+          entry.counter +=
+              slot.counterDelta.exchange(0, std::memory_order_relaxed);
+          entry.hasCounter = true;
+        }
+
+        const auto count =
+            slot.statCount.exchange(0, std::memory_order_relaxed);
+        if (count) {
+          const auto sum =
+              slot.statSum.exchange(0, std::memory_order_relaxed);
+          getStatLocked(entry).addValueAggregated(sum, count);
+        }
+      }
+    }
+
+    if (isOrphaned) {
+      it = shards_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+} // namespace fbzmq
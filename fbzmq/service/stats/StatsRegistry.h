@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <folly/Likely.h>
+#include <folly/ThreadLocal.h>
+#include <glog/logging.h>
+
+#include "ExportedStat.h"
+
+namespace fbzmq {
+
+/**
+ * Cached handle of a key in StatsRegistry. Obtain it once via
+ * `StatsRegistry::get(key)` and use it on the hot path to avoid hashing of
+ * the key on every update. Handles are only valid with the registry which
+ * created them.
+ */
+class StatHandle {
+ public:
+  StatHandle() = default;
+
+  bool
+  isValid() const {
+    return index_ != kInvalidIndex;
+  }
+
+ private:
+  friend class StatsRegistry;
+
+  static constexpr uint32_t kInvalidIndex{
+      std::numeric_limits<uint32_t>::max()};
+
+  explicit StatHandle(uint32_t index) : index_(index) {}
+
+  uint32_t index_{kInvalidIndex};
+};
+
+/**
+ * Thread safe counterpart of ThreadData, which can be shared among many
+ * threads.
+ *
+ * Every thread updating the registry gets its own thread-local shard, and
+ * updates only touch the shard of calling thread with relaxed atomics (no
+ * locks, no hashing, no shared cache lines). Shards are folded into the
+ * flat counters and ExportedStats when `getCounters()` (or `aggregate()`) is
+ * called, which is expected to happen periodically, e.g. from a thread which
+ * submits counters to ZmqMonitor. Shards of exited threads are folded and
+ * released on next aggregation.
+ *
+ * Usage
+ *
+ *  StatsRegistry registry;
+ *  registry.addStatExportType("latency_ms", AVG);
+ *  auto latencyHandle = registry.get("latency_ms");
+ *  auto requestsHandle = registry.get("requests");
+ *
+ *  // Any thread
+ *  registry.addStatValue(latencyHandle, 12);
+ *  registry.incrementCounter(requestsHandle);
+ *
+ *  // Any thread, periodically
+ *  auto counters = registry.getCounters();
+ *
+ * NOTE: Aggregation reads sum and count of a stat one after another, hence
+ * a sample being added concurrently may be accounted in two consecutive
+ * aggregations (sum in one, count in next). Only sum and count of values are
+ * kept in shards, hence percentile export types are not supported.
+ */
+class StatsRegistry : public boost::noncopyable {
+ public:
+  // Max number of keys in a registry
+  static constexpr size_t kMaxKeys{1 << 16};
+
+  StatsRegistry() = default;
+  ~StatsRegistry() = default;
+
+  /**
+   * Use given timeseries levels for all the stats instead of the default ones
+   */
+  explicit StatsRegistry(ExportedStatOptions statOptions)
+      : statOptions_(std::move(statOptions)) {}
+
+  /**
+   * Handle for the given key. Key is registered on first use. This acquires
+   * a lock, cache the handle instead of calling this on hot path.
+   */
+  StatHandle get(std::string const& key);
+
+  /**
+   * Equivalent of ThreadData APIs for export types of stats. Acquires a lock.
+   */
+  void addStatExportType(std::string const& key, ExportType type);
+  void clearStatExportType(std::string const& key, ExportType type);
+
+  /**
+   * Add value to the stat of handle. Lock free.
+   */
+  void
+  addStatValue(StatHandle handle, int64_t value) {
+    auto& slot = getSlot(handle);
+    slot.statSum.fetch_add(value, std::memory_order_relaxed);
+    slot.statCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Increment the flat-counter of handle. Lock free.
+   */
+  void
+  incrementCounter(StatHandle handle, int64_t amount = 1) {
+    auto& slot = getSlot(handle);
+    slot.counterDelta.fetch_add(amount, std::memory_order_relaxed);
+    // Flag is reset on every aggregation
+    if (not slot.hasCounter.load(std::memory_order_relaxed)) {
+      slot.hasCounter.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Set/Clear the flat-counter of handle, overriding increments from all
+   * threads made so far. Acquires a lock.
+   */
+  void setCounter(StatHandle handle, int64_t value);
+  void clearCounter(StatHandle handle);
+
+  /**
+   * Fold all thread-local shards into the exported counters.
+   */
+  void aggregate();
+
+  /**
+   * Aggregate and return all the counters (flat + exportedStats) as a map of
+   * key, vals.
+   */
+  std::unordered_map<std::string, int64_t> getCounters();
+
+  /**
+   * Number of shards (threads which updated the registry and whose shards
+   * haven't been released yet).
+   */
+  size_t getNumShards();
+
+ private:
+  // Thread-local state of a key
+  struct Slot {
+    std::atomic<int64_t> counterDelta{0};
+    std::atomic<int64_t> statSum{0};
+    std::atomic<uint64_t> statCount{0};
+    std::atomic<bool> hasCounter{false};
+  };
+
+  static constexpr size_t kChunkSize{256};
+  static constexpr size_t kMaxChunks{kMaxKeys / kChunkSize};
+  using Chunk = std::array<Slot, kChunkSize>;
+
+  /**
+   * Slots of a thread. Slots are allocated in chunks by the owning thread so
+   * that existing slots never move while aggregator is reading them.
+   */
+  struct Shard {
+    ~Shard();
+
+    /**
+     * Slot of index, allocated on first access. Must be called only from the
+     * owning thread.
+     */
+    Slot&
+    getSlot(uint32_t index) {
+      auto& chunkPtr = chunks[index / kChunkSize];
+      auto chunk = chunkPtr.load(std::memory_order_relaxed);
+      if (UNLIKELY(not chunk)) {
+        chunk = new Chunk();
+        chunkPtr.store(chunk, std::memory_order_release);
+      }
+      return (*chunk)[index % kChunkSize];
+    }
+
+    /**
+     * Slot of index if already allocated, nullptr otherwise. Safe to be called
+     * from any thread.
+     */
+    Slot*
+    findSlot(uint32_t index) {
+      auto chunk = chunks[index / kChunkSize].load(std::memory_order_acquire);
+      return chunk ? &(*chunk)[index % kChunkSize] : nullptr;
+    }
+
+    std::array<std::atomic<Chunk*>, kMaxChunks> chunks{};
+
+    // Set when owning thread exits (or registry is destroyed)
+    std::atomic<bool> isOrphaned{false};
+  };
+
+  /**
+   * Thread-local reference to a shard owned by registry. Marks the shard as
+   * orphaned on thread exit.
+   */
+  struct ShardRef {
+    explicit ShardRef(Shard* shard) : shard(shard) {}
+    ~ShardRef() {
+      shard->isOrphaned.store(true, std::memory_order_release);
+    }
+    Shard* shard{nullptr};
+  };
+
+  // Aggregated state of a key
+  struct Entry {
+    explicit Entry(std::string const& key) : key(key) {}
+
+    std::string key;
+    int64_t counter{0};
+    bool hasCounter{false};
+    std::unique_ptr<ExportedStat> stat;
+  };
+
+  Slot&
+  getSlot(StatHandle handle) {
+    DCHECK(handle.isValid());
+    auto ref = threadShard_.get();
+    if (UNLIKELY(not ref)) {
+      ref = createShard();
+    }
+    return ref->shard->getSlot(handle.index_);
+  }
+
+  ShardRef* createShard();
+
+  Entry& getEntryLocked(std::string const& key);
+
+  ExportedStat& getStatLocked(Entry& entry);
+
+  void aggregateLocked();
+
+  // Levels of exported stats
+  const ExportedStatOptions statOptions_{};
+
+  // Guards everything below except thread-local references
+  std::mutex mutex_;
+
+  // Aggregated state indexed by handle
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, uint32_t> indices_;
+
+  // All shards, including orphaned ones not yet folded
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // Shard of the current thread. Declared last so that thread-local
+  // references are gone before the shards are released.
+  folly::ThreadLocalPtr<ShardRef> threadShard_;
+};
+} // namespace fbzmq
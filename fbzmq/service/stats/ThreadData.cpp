@@ -22,7 +22,7 @@ ThreadData::addStatExportType(std::string const& key, ExportType type) {
     std::tie(it, std::ignore) = stats_.emplace(
         std::piecewise_construct,
         std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
+        std::forward_as_tuple(key, statOptions_));
   }
 
   it->second.setExportType(type);
@@ -43,7 +43,7 @@ ThreadData::addStatValue(std::string const& key, int64_t value) {
     std::tie(it, std::ignore) = stats_.emplace(
         std::piecewise_construct,
         std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
+        std::forward_as_tuple(key, statOptions_));
   }
 
   it->second.addValue(value);
@@ -57,7 +57,7 @@ ThreadData::addStatValue(
     std::tie(it, std::ignore) = stats_.emplace(
         std::piecewise_construct,
         std::forward_as_tuple(key),
-        std::forward_as_tuple(key));
+        std::forward_as_tuple(key, statOptions_));
   }
 
   it->second.setExportType(type);
@@ -69,6 +69,14 @@ ThreadData::setCounter(std::string const& key, int64_t value) {
   counters_[key] = value;
 }
 
+void
+ThreadData::setCounters(
+    std::unordered_map<std::string, int64_t> const& counters) {
+  for (auto const& kv : counters) {
+    counters_[kv.first] = kv.second;
+  }
+}
+
 void
 ThreadData::clearCounter(std::string const& key) {
   counters_.erase(key);
@@ -93,4 +101,16 @@ ThreadData::getCounters() {
 
   return counters;
 }
+
+void
+ThreadData::getCounters(
+    folly::FunctionRef<void(std::string const&, int64_t)> visitor) {
+  for (auto const& kv : counters_) {
+    visitor(kv.first, kv.second);
+  }
+
+  for (auto& kv : stats_) {
+    kv.second.getCounters(visitor);
+  }
+}
 } // namespace fbzmq
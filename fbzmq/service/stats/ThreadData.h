@@ -11,6 +11,7 @@
 #include <unordered_map>
 
 #include <boost/noncopyable.hpp>
+#include <folly/Function.h>
 
 #include "ExportedStat.h"
 
@@ -31,6 +32,13 @@ class ThreadData : public boost::noncopyable {
   ThreadData() = default;
   ~ThreadData() = default;
 
+  /**
+   * Use given timeseries levels for all the stats instead of the default ones,
+   * e.g. `ExportedStatOptions::counterOnly()` to avoid timeseries altogether.
+   */
+  explicit ThreadData(ExportedStatOptions statOptions)
+      : statOptions_(std::move(statOptions)) {}
+
   /**
    * Clear all counters and exported stats etc. You must call
    * addStatExportType/addStatExports/addHistogram again to
@@ -68,6 +76,12 @@ class ThreadData : public boost::noncopyable {
    */
   void setCounter(std::string const& key, int64_t value);
 
+  /**
+   * Set flat counters in bulk, e.g. to publish stats snapshots such as
+   * `SocketStats::getCounters()` or `ZmqEventLoop::LoopStats::getCounters()`
+   */
+  void setCounters(std::unordered_map<std::string, int64_t> const& counters);
+
   /**
    * Clear/Remove the counter from internal map.
    */
@@ -83,7 +97,17 @@ class ThreadData : public boost::noncopyable {
    */
   std::unordered_map<std::string, int64_t> getCounters();
 
+  /**
+   * Same as above but invokes `visitor(name, value)` for every counter instead
+   * of building a map.
+   */
+  void getCounters(
+      folly::FunctionRef<void(std::string const&, int64_t)> visitor);
+
  private:
+  // Levels of exported stats
+  const ExportedStatOptions statOptions_{};
+
   // Exported stats
   std::unordered_map<std::string /* key */, ExportedStat> stats_{};
 
@@ -0,0 +1,295 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Micro-benchmarks of stats on the request path: ThreadData updates and
+ * exports at 1k-100k keys, and ExportedStat updates and exports per mask of
+ * export types. Export benchmarks report `num_counters`, the number of
+ * counters built by every call.
+ *
+ *  fbzmq_stats_bench --bm_regex='ThreadData_.*'
+ */
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/init/Init.h>
+
+#include <fbzmq/service/stats/ExportedStat.h>
+#include <fbzmq/service/stats/ThreadData.h>
+
+namespace fbzmq {
+
+namespace {
+
+const std::vector<size_t> kNumKeys = {1000, 10000, 100000};
+
+struct StatsLevels {
+  const char* name;
+  ExportedStatOptions options;
+};
+
+const std::vector<StatsLevels>&
+getStatsLevels() {
+  static const std::vector<StatsLevels> levels = {
+      {"multiLevel", ExportedStatOptions()},
+      {"counterOnly", ExportedStatOptions::counterOnly()},
+  };
+  return levels;
+}
+
+struct ExportTypeMask {
+  const char* name;
+  int mask;
+};
+
+const std::vector<ExportTypeMask> kExportTypeMasks = {
+    {"sum", SUM},
+    {"avg", AVG},
+    {"sum_avg_count", SUM | AVG | COUNT},
+    {"rate_countRate", RATE | COUNT_RATE},
+    {"p50_p99", P50 | P99},
+    {"all", SUM | AVG | RATE | COUNT | COUNT_RATE | P50 | P90 | P99 | P999},
+};
+
+// Number of values stats are warmed up with before exports are measured
+const size_t kNumWarmupValues{1000};
+
+std::vector<std::string>
+makeKeys(size_t numKeys) {
+  std::vector<std::string> keys;
+  keys.reserve(numKeys);
+  for (size_t i = 0; i < numKeys; ++i) {
+    keys.emplace_back(folly::sformat("fbzmq.bench.stat_{}", i));
+  }
+  return keys;
+}
+
+void
+setExportTypes(ExportedStat& stat, int mask) {
+  for (int bit = 1; bit <= mask; bit <<= 1) {
+    if (mask & bit) {
+      stat.setExportType(static_cast<ExportType>(bit));
+    }
+  }
+}
+
+/**
+ * addStatValue on `numKeys` existing stats (AVG only), round robin, with
+ * export types set either once upfront or on every call
+ */
+void
+benchAddStatValue(
+    unsigned n,
+    size_t numKeys,
+    ExportedStatOptions const& options,
+    bool withType) {
+  folly::BenchmarkSuspender braces;
+  ThreadData threadData(options);
+  const auto keys = makeKeys(numKeys);
+  for (auto const& key : keys) {
+    threadData.addStatExportType(key, AVG);
+  }
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    auto const& key = keys[i % numKeys];
+    if (withType) {
+      threadData.addStatValue(key, i, AVG);
+    } else {
+      threadData.addStatValue(key, i);
+    }
+  }
+
+  braces.rehire();
+}
+
+/**
+ * incrementCounter on `numKeys` existing flat counters, round robin
+ */
+void
+benchIncrementCounter(unsigned n, size_t numKeys) {
+  folly::BenchmarkSuspender braces;
+  ThreadData threadData;
+  const auto keys = makeKeys(numKeys);
+  for (auto const& key : keys) {
+    threadData.setCounter(key, 0);
+  }
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    folly::doNotOptimizeAway(threadData.incrementCounter(keys[i % numKeys]));
+  }
+
+  braces.rehire();
+}
+
+/**
+ * getCounters with `numKeys` flat counters and as many stats (SUM | AVG),
+ * either building a map or visiting counters
+ */
+void
+benchThreadDataGetCounters(
+    folly::UserCounters& counters,
+    unsigned n,
+    size_t numKeys,
+    ExportedStatOptions const& options,
+    bool withVisitor) {
+  folly::BenchmarkSuspender braces;
+  ThreadData threadData(options);
+  const auto keys = makeKeys(numKeys);
+  for (auto const& key : keys) {
+    threadData.setCounter(key + ".count", 1);
+    threadData.addStatValue(key, 1, SUM);
+    threadData.addStatValue(key, 1, AVG);
+  }
+  size_t numCounters{0};
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    if (withVisitor) {
+      numCounters = 0;
+      threadData.getCounters([&numCounters](std::string const&, int64_t) {
+        ++numCounters;
+      });
+    } else {
+      auto result = threadData.getCounters();
+      numCounters = result.size();
+      folly::doNotOptimizeAway(result);
+    }
+  }
+
+  braces.rehire();
+  counters["num_counters"] = numCounters;
+}
+
+void
+benchExportedStatAddValue(
+    unsigned n, int mask, ExportedStatOptions const& options) {
+  folly::BenchmarkSuspender braces;
+  ExportedStat stat("fbzmq.bench.stat", options);
+  setExportTypes(stat, mask);
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    stat.addValue(i);
+  }
+
+  braces.rehire();
+}
+
+void
+benchExportedStatGetCounters(
+    folly::UserCounters& counters,
+    unsigned n,
+    int mask,
+    ExportedStatOptions const& options) {
+  folly::BenchmarkSuspender braces;
+  ExportedStat stat("fbzmq.bench.stat", options);
+  setExportTypes(stat, mask);
+  for (size_t i = 0; i < kNumWarmupValues; ++i) {
+    stat.addValue(i);
+  }
+  std::unordered_map<std::string, int64_t> result;
+  braces.dismiss();
+
+  for (unsigned i = 0; i < n; ++i) {
+    result.clear();
+    stat.getCounters(result);
+    folly::doNotOptimizeAway(result);
+  }
+
+  braces.rehire();
+  counters["num_counters"] = result.size();
+}
+
+} // namespace
+
+} // namespace fbzmq
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+
+  using namespace fbzmq;
+
+  for (auto const& levels : getStatsLevels()) {
+    for (auto numKeys : kNumKeys) {
+      for (const bool withType : {false, true}) {
+        folly::addBenchmark(
+            __FILE__,
+            folly::sformat(
+                "ThreadData_addStatValue{}_{}_keys_{}",
+                withType ? "WithType" : "",
+                levels.name,
+                numKeys),
+            [&levels, numKeys, withType](unsigned n) {
+              benchAddStatValue(n, numKeys, levels.options, withType);
+              return n;
+            });
+      }
+    }
+  }
+
+  for (auto numKeys : kNumKeys) {
+    folly::addBenchmark(
+        __FILE__,
+        folly::sformat("ThreadData_incrementCounter_keys_{}", numKeys),
+        [numKeys](unsigned n) {
+          benchIncrementCounter(n, numKeys);
+          return n;
+        });
+  }
+
+  for (auto const& levels : getStatsLevels()) {
+    for (auto numKeys : kNumKeys) {
+      for (const bool withVisitor : {false, true}) {
+        folly::addBenchmark(
+            __FILE__,
+            folly::sformat(
+                "ThreadData_getCounters{}_{}_keys_{}",
+                withVisitor ? "Visitor" : "",
+                levels.name,
+                numKeys),
+            [&levels, numKeys, withVisitor](
+                folly::UserCounters& counters, unsigned n) {
+              benchThreadDataGetCounters(
+                  counters, n, numKeys, levels.options, withVisitor);
+              return n;
+            });
+      }
+    }
+  }
+
+  for (auto const& levels : getStatsLevels()) {
+    for (auto const& exportTypes : kExportTypeMasks) {
+      folly::addBenchmark(
+          __FILE__,
+          folly::sformat(
+              "ExportedStat_addValue_{}_{}", levels.name, exportTypes.name),
+          [&levels, &exportTypes](unsigned n) {
+            benchExportedStatAddValue(n, exportTypes.mask, levels.options);
+            return n;
+          });
+      folly::addBenchmark(
+          __FILE__,
+          folly::sformat(
+              "ExportedStat_getCounters_{}_{}", levels.name, exportTypes.name),
+          [&levels, &exportTypes](folly::UserCounters& counters, unsigned n) {
+            benchExportedStatGetCounters(
+                counters, n, exportTypes.mask, levels.options);
+            return n;
+          });
+    }
+  }
+
+  folly::runBenchmarks();
+  return 0;
+}
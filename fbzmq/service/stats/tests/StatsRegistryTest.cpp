@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/service/stats/StatsRegistry.h>
+
+namespace fbzmq {
+
+TEST(StatsRegistryTest, ApiTest) {
+  StatsRegistry registry;
+
+  auto counterHandle = registry.get("counter_key");
+  EXPECT_TRUE(counterHandle.isValid());
+  EXPECT_FALSE(StatHandle().isValid());
+  registry.setCounter(counterHandle, 0);
+  registry.addStatExportType("stats_key", AVG);
+  registry.addStatExportType("stats_key", SUM);
+
+  // counters must have 9 (1 + 4 + 4) keys
+  auto counters = registry.getCounters();
+  EXPECT_EQ(9, counters.size());
+  for (auto const& kv : counters) {
+    EXPECT_EQ(0, kv.second);
+  }
+  EXPECT_EQ(1, counters.count("counter_key"));
+  EXPECT_EQ(1, counters.count("stats_key.avg.60"));
+  EXPECT_EQ(1, counters.count("stats_key.sum.0"));
+
+  // Add some values. Same key gives out the same handle
+  auto statHandle = registry.get("stats_key");
+  registry.setCounter(counterHandle, 10);
+  registry.incrementCounter(registry.get("counter_key"));
+  registry.addStatValue(statHandle, 10);
+  registry.addStatValue(statHandle, 20);
+
+  counters = registry.getCounters();
+  EXPECT_EQ(9, counters.size());
+  EXPECT_EQ(11, counters["counter_key"]);
+  EXPECT_EQ(15, counters["stats_key.avg.60"]);
+  EXPECT_EQ(30, counters["stats_key.sum.60"]);
+
+  // Set overrides previous increments. Values are aggregated only once
+  registry.incrementCounter(counterHandle, 5);
+  registry.setCounter(counterHandle, 100);
+  registry.incrementCounter(counterHandle, 1);
+  counters = registry.getCounters();
+  EXPECT_EQ(101, counters["counter_key"]);
+  EXPECT_EQ(30, counters["stats_key.sum.60"]);
+
+  // Clear counter and an export type
+  registry.clearCounter(counterHandle);
+  registry.clearStatExportType("stats_key", AVG);
+  counters = registry.getCounters();
+  EXPECT_EQ(4, counters.size());
+  EXPECT_EQ(0, counters.count("counter_key"));
+  EXPECT_EQ(30, counters["stats_key.sum.0"]);
+
+  // Stats without export type are not exported
+  registry.addStatValue(registry.get("hidden_key"), 1);
+  EXPECT_EQ(4, registry.getCounters().size());
+}
+
+TEST(StatsRegistryTest, MultipleThreads) {
+  const int kNumThreads = 8;
+  const int kNumIterations = 10000;
+
+  StatsRegistry registry;
+  registry.addStatExportType("stats_key", SUM);
+  registry.addStatExportType("stats_key", COUNT);
+  auto statHandle = registry.get("stats_key");
+  auto counterHandle = registry.get("counter_key");
+
+  // Many keys so that shards span multiple chunks
+  std::vector<StatHandle> handles;
+  for (int i = 0; i < 1000; ++i) {
+    handles.emplace_back(registry.get("key" + std::to_string(i)));
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kNumIterations; ++j) {
+        registry.addStatValue(statHandle, 2);
+        registry.incrementCounter(counterHandle);
+        registry.incrementCounter(handles[j % handles.size()]);
+      }
+    });
+  }
+
+  // Aggregate concurrently with updates
+  for (int i = 0; i < 10; ++i) {
+    registry.aggregate();
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto counters = registry.getCounters();
+  EXPECT_EQ(kNumThreads * kNumIterations, counters["counter_key"]);
+  EXPECT_EQ(kNumThreads * kNumIterations * 2, counters["stats_key.sum.0"]);
+  EXPECT_EQ(kNumThreads * kNumIterations, counters["stats_key.count.0"]);
+  EXPECT_EQ(kNumThreads * kNumIterations / 1000, counters["key999"]);
+
+  // Shards of exited threads are released after being folded
+  EXPECT_EQ(0, registry.getNumShards());
+
+  // Thread of test gets its own shard
+  registry.incrementCounter(counterHandle);
+  EXPECT_EQ(1, registry.getNumShards());
+  EXPECT_EQ(kNumThreads * kNumIterations + 1,
+      registry.getCounters()["counter_key"]);
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
@@ -71,6 +71,144 @@ TEST(ThreadDataTest, ApiTest) {
   EXPECT_EQ(2, counters["stats_key.count.600"]);
   EXPECT_EQ(2, counters["stats_key.count.3600"]);
   EXPECT_EQ(2, counters["stats_key.count.0"]);
+
+  // Bulk set of flat counters
+  tData.setCounters({{"sock.msgs_sent", 3}, {"sock.bytes_sent", 30}});
+  tData.setCounters({{"sock.msgs_sent", 4}});
+  counters = tData.getCounters();
+  EXPECT_EQ(10, counters.size());
+  EXPECT_EQ(4, counters["sock.msgs_sent"]);
+  EXPECT_EQ(30, counters["sock.bytes_sent"]);
+}
+
+TEST(ThreadDataTest, VisitCounters) {
+  fbzmq::ThreadData tData;
+
+  tData.setCounter("counter_key", 5);
+  tData.addStatExportType("stats_key", fbzmq::SUM);
+  tData.addStatExportType("stats_key", fbzmq::COUNT);
+  tData.addStatValue("stats_key", 10);
+
+  // Visitor reports the same counters as the map API
+  for (int i = 0; i < 2; i++) {
+    std::unordered_map<std::string, int64_t> counters;
+    tData.getCounters([&](std::string const& key, int64_t value) {
+      EXPECT_TRUE(counters.emplace(key, value).second);
+    });
+    EXPECT_EQ(tData.getCounters(), counters);
+    EXPECT_EQ(9, counters.size());
+    EXPECT_EQ(5, counters["counter_key"]);
+    EXPECT_EQ(10, counters["stats_key.sum.60"]);
+    EXPECT_EQ(1, counters["stats_key.count.0"]);
+  }
+
+  // Cached names follow export type changes
+  tData.clearStatExportType("stats_key", fbzmq::SUM);
+  tData.addStatExportType("stats_key", fbzmq::AVG);
+  tData.addStatExportType("stats_key", fbzmq::AVG);
+  std::unordered_map<std::string, int64_t> counters;
+  tData.getCounters([&](std::string const& key, int64_t value) {
+    EXPECT_TRUE(counters.emplace(key, value).second);
+  });
+  EXPECT_EQ(9, counters.size());
+  EXPECT_EQ(0, counters.count("stats_key.sum.60"));
+  EXPECT_EQ(10, counters["stats_key.avg.600"]);
+  EXPECT_EQ(1, counters["stats_key.count.3600"]);
+}
+
+TEST(ThreadDataTest, Percentiles) {
+  fbzmq::ThreadData tData;
+
+  tData.addStatExportType("latency", fbzmq::P50);
+  tData.addStatExportType("latency", fbzmq::P99);
+  tData.addStatExportType("latency", fbzmq::COUNT);
+  for (int i = 1; i <= 1000; i++) {
+    tData.addStatValue("latency", i);
+  }
+
+  // 4 levels of 3 types
+  auto counters = tData.getCounters();
+  EXPECT_EQ(12, counters.size());
+  for (auto const& level : {"60", "600", "3600", "0"}) {
+    auto const suffix = std::string(".") + level;
+    EXPECT_EQ(1000, counters.at("latency.count" + suffix));
+    EXPECT_NEAR(500, counters.at("latency.p50" + suffix), 20);
+    EXPECT_NEAR(990, counters.at("latency.p99" + suffix), 10);
+  }
+
+  // Remaining percentile types use the same digests
+  tData.addStatExportType("latency", fbzmq::P90);
+  tData.addStatExportType("latency", fbzmq::P999);
+  counters = tData.getCounters();
+  EXPECT_EQ(20, counters.size());
+  EXPECT_NEAR(900, counters.at("latency.p90.60"), 20);
+  EXPECT_NEAR(999, counters.at("latency.p999.0"), 5);
+
+  // Digests are released with the last percentile type
+  for (auto type : {fbzmq::P50, fbzmq::P90, fbzmq::P99, fbzmq::P999}) {
+    tData.clearStatExportType("latency", type);
+  }
+  tData.addStatExportType("latency", fbzmq::P50);
+  counters = tData.getCounters();
+  EXPECT_EQ(8, counters.size());
+  EXPECT_EQ(0, counters.at("latency.p50.60"));
+}
+
+TEST(ThreadDataTest, StatOptions) {
+  // Custom levels including a sub-second one
+  {
+    fbzmq::ExportedStatOptions options;
+    options.numBuckets = 5;
+    options.levelDurations = {
+        std::chrono::milliseconds(500), std::chrono::seconds(10)};
+    fbzmq::ThreadData tData(options);
+    tData.addStatExportType("stats_key", fbzmq::SUM);
+    tData.addStatExportType("stats_key", fbzmq::P50);
+    tData.addStatValue("stats_key", 10);
+
+    auto counters = tData.getCounters();
+    EXPECT_EQ(4, counters.size());
+    EXPECT_EQ(10, counters.at("stats_key.sum.500ms"));
+    EXPECT_EQ(10, counters.at("stats_key.sum.10"));
+    EXPECT_EQ(10, counters.at("stats_key.p50.500ms"));
+    EXPECT_EQ(10, counters.at("stats_key.p50.10"));
+  }
+
+  // Single level
+  {
+    fbzmq::ThreadData tData(
+        fbzmq::ExportedStatOptions::singleLevel(std::chrono::seconds(10)));
+    tData.addStatValue("stats_key", 10, fbzmq::COUNT);
+    tData.addStatValue("stats_key", 20, fbzmq::AVG);
+
+    auto counters = tData.getCounters();
+    EXPECT_EQ(2, counters.size());
+    EXPECT_EQ(2, counters.at("stats_key.count.10"));
+    EXPECT_EQ(15, counters.at("stats_key.avg.10"));
+  }
+
+  // Counter only, rates are not available
+  {
+    fbzmq::ExportedStat stat(
+        "stats_key", fbzmq::ExportedStatOptions::counterOnly());
+    stat.setExportType(fbzmq::SUM);
+    stat.setExportType(fbzmq::AVG);
+    stat.setExportType(fbzmq::COUNT);
+    stat.setExportType(fbzmq::RATE);
+    stat.setExportType(fbzmq::P99);
+    stat.addValue(10);
+    stat.addValue(20);
+    stat.addValueAggregated(30, 1);
+
+    std::unordered_map<std::string, int64_t> counters;
+    stat.getCounters(counters);
+    EXPECT_EQ(4, counters.size());
+    EXPECT_EQ(60, counters.at("stats_key.sum.0"));
+    EXPECT_EQ(20, counters.at("stats_key.avg.0"));
+    EXPECT_EQ(3, counters.at("stats_key.count.0"));
+    EXPECT_LE(10, counters.at("stats_key.p99.0"));
+    EXPECT_GE(20, counters.at("stats_key.p99.0"));
+  }
 }
 
 int
@@ -6,6 +6,10 @@
  */
 
 #include <fbzmq/zmq/Common.h>
+
+#include <algorithm>
+#include <cmath>
+
 #ifdef IS_BSD
 #include <fcntl.h>
 #endif
@@ -25,6 +29,39 @@ operator<<(std::ostream& out, Error const& err) {
   return out;
 }
 
+void
+LatencyHistogram::addValue(std::chrono::nanoseconds value) {
+  const auto us = std::max<int64_t>(
+      0, std::chrono::duration_cast<std::chrono::microseconds>(value).count());
+  // Index of bucket is the number of significant bits of microseconds
+  size_t index{0};
+  for (auto bits = static_cast<uint64_t>(us); bits; bits >>= 1) {
+    ++index;
+  }
+  ++buckets[std::min(index, kNumBuckets - 1)];
+  ++count;
+  sum += value;
+  max = std::max(max, value);
+}
+
+std::chrono::nanoseconds
+LatencyHistogram::getPercentile(double percentile) const {
+  if (count == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  const auto rank = static_cast<uint64_t>(
+      std::ceil(std::min(100.0, std::max(0.0, percentile)) / 100 * count));
+  uint64_t seen{0};
+  for (size_t i = 0; i < kNumBuckets - 1; ++i) {
+    seen += buckets[i];
+    if (seen >= std::max<uint64_t>(rank, 1)) {
+      return std::min<std::chrono::nanoseconds>(
+          max, std::chrono::microseconds(1ULL << i));
+    }
+  }
+  return max;
+}
+
 folly::Expected<int, Error>
 poll(zmq_pollitem_t const* items_, int nitems_, long timeout_ = -1) {
   while (true) {
@@ -93,5 +130,45 @@ genKeyPair() {
   return KeyPair{privateKey, publicKey};
 }
 
+folly::Expected<folly::Unit, Error>
+prepareKeyPair(KeyPair& keyPair) {
+  if (keyPair.curveKeys) {
+    return folly::unit;
+  }
+  if (keyPair.publicKey.length() != crypto_sign_ed25519_PUBLICKEYBYTES or
+      keyPair.privateKey.length() != crypto_sign_ed25519_SECRETKEYBYTES) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid key pair length"));
+  }
+
+  auto curveKeys = std::make_shared<CurveKeyPair>();
+  if (::crypto_sign_ed25519_pk_to_curve25519(
+          curveKeys->publicKey.data(),
+          reinterpret_cast<const uint8_t*>(keyPair.publicKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid public key"));
+  }
+  if (::crypto_sign_ed25519_sk_to_curve25519(
+          curveKeys->secretKey.data(),
+          reinterpret_cast<const uint8_t*>(keyPair.privateKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid private key"));
+  }
+  keyPair.curveKeys = std::move(curveKeys);
+  return folly::unit;
+}
+
+folly::Expected<CurveKey, Error>
+toCurvePublicKey(std::string const& publicKey) {
+  if (publicKey.length() != crypto_sign_ed25519_PUBLICKEYBYTES) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid public key length"));
+  }
+
+  CurveKey curveKey;
+  if (::crypto_sign_ed25519_pk_to_curve25519(
+          curveKey.data(),
+          reinterpret_cast<const uint8_t*>(publicKey.data())) != 0) {
+    return folly::makeUnexpected(Error(EINVAL, "Invalid public key"));
+  }
+  return curveKey;
+}
+
 } // namespace util
 } // namespace fbzmq
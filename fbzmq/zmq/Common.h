@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <memory>
 #include <ostream>
 #include <string>
 
+#include <folly/Expected.h>
 #include <folly/Optional.h>
 #include <folly/String.h>
 #include <folly/io/IOBuf.h>
@@ -35,12 +39,50 @@ struct Error {
 
 std::ostream& operator<<(std::ostream&, Error const&);
 
+/**
+ * Curve25519 encryption key, converted from ed25519 signature key
+ */
+using CurveKey = std::array<uint8_t, crypto_scalarmult_curve25519_BYTES>;
+
+struct CurveKeyPair {
+  CurveKey publicKey;
+  CurveKey secretKey;
+};
+
 /**
  * Crypto key pair
  */
 struct KeyPair {
   std::string privateKey;
   std::string publicKey;
+
+  // Curve25519 form of above keys as applied on sockets. Shared by all copies
+  // of key pair and filled in by `util::prepareKeyPair()` or by the first
+  // socket key pair is applied on.
+  std::shared_ptr<const CurveKeyPair> curveKeys{nullptr};
+};
+
+/**
+ * Histogram of durations with power of two buckets. Bucket `i` counts
+ * durations in [2^(i-1), 2^i) microseconds, bucket 0 durations below a
+ * microsecond and the last bucket everything above. Cheap enough to be
+ * updated on hot paths, e.g. on every loop callback or socket wait.
+ */
+struct LatencyHistogram {
+  static constexpr size_t kNumBuckets{24};
+
+  void addValue(std::chrono::nanoseconds value);
+
+  /**
+   * Estimate of given percentile (0-100), upper bound of the bucket capped
+   * by the max value
+   */
+  std::chrono::nanoseconds getPercentile(double percentile) const;
+
+  uint64_t count{0};
+  std::chrono::nanoseconds sum{0};
+  std::chrono::nanoseconds max{0};
+  std::array<uint64_t, kNumBuckets> buckets{};
 };
 
 /**
@@ -59,6 +101,8 @@ folly::Expected<int, Error> poll(
  * Proxy connects a frontend socket to a backend socket.
  * Conceptually, data flows from frontend to backend.
  * Depending on the socket types, replies may flow in the opposite direction.
+ * Blocks calling thread for good, refer to `ZmqProxy` for a proxy which runs
+ * on ZmqEventLoop and can be paused/terminated.
  */
 folly::Expected<folly::Unit, Error> proxy(
     void* frontend, void* backend, void* capture);
@@ -74,6 +118,18 @@ void setFdCloExec(int fd);
  */
 KeyPair genKeyPair();
 
+/**
+ * Convert keys of key pair into their curve25519 form once, so that sockets
+ * created with it (or its copies) don't redo the conversion. Useful when
+ * same key pair is used on many sockets. No-op if already prepared.
+ */
+folly::Expected<folly::Unit, Error> prepareKeyPair(KeyPair& keyPair);
+
+/**
+ * Convert ed25519 public key into curve25519 form
+ */
+folly::Expected<CurveKey, Error> toCurvePublicKey(std::string const& publicKey);
+
 /**
  * Utility functions for conversion between thrift objects and string/IOBuf
  */
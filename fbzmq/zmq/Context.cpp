@@ -7,23 +7,161 @@
 
 #include <fbzmq/zmq/Context.h>
 
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 namespace fbzmq {
 
+namespace {
+
+void
+setContextOption(void* ptr, int option, int value, const char* name) {
+  const int rc = zmq_ctx_set(ptr, option, value);
+  CHECK_EQ(0, rc) << "Failed setting " << name << ": "
+                  << zmq_strerror(zmq_errno());
+}
+
+// Number of entries of a directory whose name starts with `prefix`
+size_t
+countDirEntries(std::string const& path, const char* prefix) {
+  DIR* dir = ::opendir(path.c_str());
+  if (dir == nullptr) {
+    return 0;
+  }
+  size_t count{0};
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (std::strncmp(entry->d_name, prefix, std::strlen(prefix)) == 0) {
+      ++count;
+    }
+  }
+  ::closedir(dir);
+  return count;
+}
+
+} // namespace
+
 Context::Context(
     folly::Optional<uint16_t> numIoThreads,
     folly::Optional<uint16_t> numMaxSockets) noexcept
+    : Context([&] {
+        ContextOptions options;
+        options.numIoThreads = numIoThreads;
+        options.numMaxSockets = numMaxSockets;
+        return options;
+      }()) {}
+
+Context::Context(ContextOptions const& options) noexcept
     : ptr_(zmq_ctx_new()) {
   CHECK(ptr_);
 
-  if (numIoThreads) {
-    const int rc = zmq_ctx_set(ptr_, ZMQ_IO_THREADS, numIoThreads.value());
-    CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+  if (options.numIoThreads) {
+    setContextOption(
+        ptr_, ZMQ_IO_THREADS, options.numIoThreads.value(), "ZMQ_IO_THREADS");
+  }
+
+  if (options.numMaxSockets) {
+    setContextOption(
+        ptr_,
+        ZMQ_MAX_SOCKETS,
+        options.numMaxSockets.value(),
+        "ZMQ_MAX_SOCKETS");
+  }
+
+  // Options of IO threads take effect as threads get started, i.e. on
+  // creation of the first socket
+  if (not options.ioThreadCpus.empty()) {
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+    for (const int cpu : options.ioThreadCpus) {
+      setContextOption(
+          ptr_,
+          ZMQ_THREAD_AFFINITY_CPU_ADD,
+          cpu,
+          "ZMQ_THREAD_AFFINITY_CPU_ADD");
+    }
+#else
+    LOG(FATAL) << "ZMQ_THREAD_AFFINITY_CPU_ADD is not supported by libzmq";
+#endif
+  }
+
+  if (options.ioThreadSchedPolicy) {
+#ifdef ZMQ_THREAD_SCHED_POLICY
+    setContextOption(
+        ptr_,
+        ZMQ_THREAD_SCHED_POLICY,
+        options.ioThreadSchedPolicy.value(),
+        "ZMQ_THREAD_SCHED_POLICY");
+#else
+    LOG(FATAL) << "ZMQ_THREAD_SCHED_POLICY is not supported by libzmq";
+#endif
   }
 
-  if (numMaxSockets) {
-    const int rc = zmq_ctx_set(ptr_, ZMQ_MAX_SOCKETS, numMaxSockets.value());
-    CHECK_EQ(0, rc) << zmq_strerror(zmq_errno());
+  if (options.ioThreadPriority) {
+#ifdef ZMQ_THREAD_PRIORITY
+    setContextOption(
+        ptr_,
+        ZMQ_THREAD_PRIORITY,
+        options.ioThreadPriority.value(),
+        "ZMQ_THREAD_PRIORITY");
+#else
+    LOG(FATAL) << "ZMQ_THREAD_PRIORITY is not supported by libzmq";
+#endif
   }
+
+  if (options.ioThreadNamePrefix) {
+#ifdef ZMQ_THREAD_NAME_PREFIX
+    setContextOption(
+        ptr_,
+        ZMQ_THREAD_NAME_PREFIX,
+        options.ioThreadNamePrefix.value(),
+        "ZMQ_THREAD_NAME_PREFIX");
+#else
+    LOG(FATAL) << "ZMQ_THREAD_NAME_PREFIX is not supported by libzmq";
+#endif
+  }
+}
+
+uint16_t
+Context::getAutoNumIoThreads(std::vector<int> const& cpus) {
+  size_t numCpus = cpus.size();
+  if (numCpus == 0) {
+    const long numOnline = ::sysconf(_SC_NPROCESSORS_ONLN);
+    numCpus = numOnline > 0 ? numOnline : 1;
+  }
+
+  // Most receive queues of any NIC, excluding loopback
+  size_t numQueues{0};
+  DIR* dir = ::opendir("/sys/class/net");
+  if (dir != nullptr) {
+    while (struct dirent* entry = ::readdir(dir)) {
+      if (entry->d_name[0] == '.' or std::strcmp(entry->d_name, "lo") == 0) {
+        continue;
+      }
+      numQueues = std::max(
+          numQueues,
+          countDirEntries(
+              std::string("/sys/class/net/") + entry->d_name + "/queues",
+              "rx-"));
+    }
+    ::closedir(dir);
+  }
+
+  return static_cast<uint16_t>(std::min(
+      std::max<size_t>(numQueues, 1),
+      std::min<size_t>(numCpus, std::numeric_limits<uint16_t>::max())));
+}
+
+size_t
+Context::getMsgTSize() const {
+#ifdef ZMQ_MSG_T_SIZE
+  const int size = zmq_ctx_get(ptr_, ZMQ_MSG_T_SIZE);
+  CHECK_LE(0, size) << zmq_strerror(zmq_errno());
+  return size;
+#else
+  return sizeof(zmq_msg_t);
+#endif
 }
 
 Context::~Context() {
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <fbzmq/zmq/Common.h>
 
 namespace fbzmq {
@@ -16,6 +18,33 @@ namespace detail {
 class SocketImpl;
 } // namespace detail
 
+/**
+ * Options of a context and its IO threads. Unset options keep defaults of
+ * libzmq. Options of IO threads require libzmq built with support for them
+ * (4.3 or later), context creation fails otherwise.
+ */
+struct ContextOptions {
+  // Number of IO threads. Refer to `Context::getAutoNumIoThreads()` to
+  // derive it from the host instead.
+  folly::Optional<uint16_t> numIoThreads{folly::none};
+
+  // Cap on number of sockets supported by the context
+  folly::Optional<uint16_t> numMaxSockets{folly::none};
+
+  // Pin IO threads on these CPUs (ZMQ_THREAD_AFFINITY_CPU_ADD). Threads can
+  // run on any CPU if empty.
+  std::vector<int> ioThreadCpus{};
+
+  // Scheduling policy (e.g. SCHED_FIFO) and priority of IO threads
+  // (ZMQ_THREAD_SCHED_POLICY, ZMQ_THREAD_PRIORITY)
+  folly::Optional<int> ioThreadSchedPolicy{folly::none};
+  folly::Optional<int> ioThreadPriority{folly::none};
+
+  // Prefix of IO thread names (ZMQ_THREAD_NAME_PREFIX), e.g. `1` names them
+  // `1/ZMQbg/IO/<n>`, to tell apart threads of different contexts
+  folly::Optional<int> ioThreadNamePrefix{folly::none};
+};
+
 /**
  * RAII over zmq_context
  */
@@ -33,6 +62,26 @@ class Context {
       folly::Optional<uint16_t> numIoThreads = folly::none,
       folly::Optional<uint16_t> numMaxSockets = folly::none) noexcept;
 
+  /**
+   * Context with given options. Dies if libzmq rejects any of them.
+   */
+  explicit Context(ContextOptions const& options) noexcept;
+
+  /**
+   * Number of IO threads suited for the host, i.e. most receive queues of
+   * any of its NICs (a thread per queue lets interrupts and IO thread of a
+   * connection share a CPU) bounded by number of `cpus`. Number of online
+   * CPUs is used if `cpus` is empty. Defaults to 1 if NIC queues can't be
+   * determined.
+   */
+  static uint16_t getAutoNumIoThreads(std::vector<int> const& cpus = {});
+
+  /**
+   * Size of `zmq_msg_t` of the linked libzmq (ZMQ_MSG_T_SIZE), e.g. to check
+   * that it matches the headers fbzmq was built with.
+   */
+  size_t getMsgTSize() const;
+
   // non-copyable
   Context(Context const&) = delete;
   Context& operator=(Context const&) = delete;
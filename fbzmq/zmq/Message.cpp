@@ -7,6 +7,14 @@
 
 #include <fbzmq/zmq/Message.h>
 
+#include <atomic>
+
+#include <folly/Demangle.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
+
+#include <fbzmq/zmq/MessagePool.h>
+
 namespace {
 
 /**
@@ -18,6 +26,63 @@ freeIOBuf(void* /* ptr */, void* hint) {
   delete buf;
 }
 
+/**
+ * userData points to heap allocated Message owning the buffer
+ */
+void
+freeMessage(void* /* buf */, void* userData) {
+  auto* msg = reinterpret_cast<fbzmq::Message*>(userData);
+  delete msg;
+}
+
+/**
+ * Create IOBuf adopting the heap allocated message
+ */
+std::unique_ptr<folly::IOBuf>
+adoptMessage(fbzmq::Message* msg) {
+  // NOTE: Small messages store data inline, hence data must be referenced
+  // from the message at its final location
+  auto data = msg->writeableData();
+  return folly::IOBuf::takeOwnership(
+      data.data(), data.size(), data.size(), freeMessage, msg);
+}
+
+/**
+ * Payload of object messages. Receiver validates that a payload is an
+ * envelope of this process (rather than lookalike bytes from the wire) before
+ * dereferencing any of its pointers.
+ */
+struct ObjectEnvelope {
+  // Address of envelope itself and process wide secret
+  const ObjectEnvelope* self{nullptr};
+  uint64_t secret{0};
+
+  std::type_info const* type{nullptr};
+  void (*deleter)(void*){nullptr};
+
+  // Object, null once released
+  std::atomic<void*> obj{nullptr};
+};
+
+uint64_t
+getEnvelopeSecret() {
+  static const uint64_t secret = folly::Random::secureRand64();
+  return secret;
+}
+
+/**
+ * ptr points to envelope, object is deleted unless it has been released
+ */
+void
+freeObject(void* ptr, void* /* hint */) {
+  auto* envelope = reinterpret_cast<ObjectEnvelope*>(ptr);
+  auto* obj = envelope->obj.exchange(nullptr);
+  if (obj) {
+    envelope->deleter(obj);
+  }
+  delete envelope;
+}
+
 } // namespace
 
 namespace fbzmq {
@@ -38,6 +103,44 @@ Message::allocate(size_t size) noexcept {
   return msg;
 }
 
+folly::Expected<Message, Error>
+Message::allocate(size_t size, MessagePool& pool) noexcept {
+  return pool.allocate(size);
+}
+
+MessagePool&
+Message::getThreadLocalPool() noexcept {
+  return MessagePool::getThreadLocal();
+}
+
+folly::IOBufQueue&
+Message::beginThriftOutput(MessagePool& pool) noexcept {
+  return pool.beginOutput();
+}
+
+folly::Expected<Message, Error>
+Message::finishThriftOutput(MessagePool& pool) noexcept {
+  return pool.finishOutput();
+}
+
+folly::Expected<Message, Error>
+Message::from(folly::StringPiece str) noexcept {
+  return allocate(str.size()).then([&str](Message&& msg) {
+    if (not str.empty()) {
+      ::memcpy(msg.writeableData().data(), str.data(), str.size());
+    }
+    return std::move(msg);
+  });
+}
+
+folly::Expected<Message, Error>
+Message::from(folly::StringPiece str, MessagePool& pool) noexcept {
+  return pool.allocate(str.size()).then([&str](Message&& msg) {
+    ::memcpy(msg.writeableData().data(), str.data(), str.size());
+    return std::move(msg);
+  });
+}
+
 folly::Expected<Message, Error>
 Message::wrapBuffer(std::unique_ptr<folly::IOBuf> buf) noexcept {
   Message msg;
@@ -61,6 +164,94 @@ Message::wrapBuffer(std::unique_ptr<folly::IOBuf> buf) noexcept {
   return msg;
 }
 
+folly::Expected<Message, Error>
+Message::wrapObject(
+    void* obj, std::type_info const& type, void (*deleter)(void*)) noexcept {
+  auto* envelope = new ObjectEnvelope();
+  envelope->self = envelope;
+  envelope->secret = getEnvelopeSecret();
+  envelope->type = &type;
+  envelope->deleter = deleter;
+  envelope->obj.store(obj);
+
+  Message msg;
+  zmq_msg_close(&(msg.msg_));
+  const auto rc = zmq_msg_init_data(
+      &msg.msg_, envelope, sizeof(ObjectEnvelope), freeObject, nullptr);
+  if (rc != 0) {
+    // object has been passed to us via unique_ptr, no way to return it back
+    freeObject(envelope, nullptr);
+    return folly::makeUnexpected(Error());
+  }
+  return msg;
+}
+
+bool
+Message::isObject() const noexcept {
+  if (size() != sizeof(ObjectEnvelope)) {
+    return false;
+  }
+  // Payload must be the very envelope created by wrapObject, not a copy
+  auto* envelope = reinterpret_cast<const ObjectEnvelope*>(data().data());
+  return envelope->self == envelope and
+      envelope->secret == getEnvelopeSecret();
+}
+
+folly::Expected<void*, Error>
+Message::releaseObjectImpl(std::type_info const& type) noexcept {
+  if (not isObject()) {
+    return folly::makeUnexpected(Error(EPROTO, "Not an object message"));
+  }
+  auto* envelope = reinterpret_cast<ObjectEnvelope*>(writeableData().data());
+  if (*envelope->type != type) {
+    return folly::makeUnexpected(Error(
+        EINVAL,
+        folly::sformat(
+            "Object type mismatch. Expected {}, got {}",
+            folly::demangle(type),
+            folly::demangle(*envelope->type))));
+  }
+  auto* obj = envelope->obj.exchange(nullptr);
+  if (not obj) {
+    return folly::makeUnexpected(Error(ENOENT, "Object already released"));
+  }
+  return obj;
+}
+
+folly::Expected<std::vector<Message>, Error>
+Message::wrapBufferChain(std::unique_ptr<folly::IOBuf> buf) noexcept {
+  std::vector<Message> msgs;
+  msgs.reserve(buf ? buf->countChainElements() : 0);
+
+  // Detach buffers from chain one by one and wrap them individually
+  while (buf) {
+    auto next = buf->pop();
+    if (not buf->empty()) {
+      auto msg = wrapBuffer(std::move(buf));
+      if (msg.hasError()) {
+        return folly::makeUnexpected(msg.error());
+      }
+      msgs.emplace_back(std::move(msg.value()));
+    }
+    buf = std::move(next);
+  }
+
+  if (msgs.empty()) {
+    msgs.emplace_back();
+  }
+  return msgs;
+}
+
+std::unique_ptr<folly::IOBuf>
+Message::toIOBuf() const& {
+  return adoptMessage(new Message(*this));
+}
+
+std::unique_ptr<folly::IOBuf>
+Message::toIOBuf() && {
+  return adoptMessage(new Message(std::move(*this)));
+}
+
 Message&
 Message::operator=(Message&& other) noexcept {
   Message tmp(std::move(other));
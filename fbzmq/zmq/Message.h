@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <memory>
+#include <typeinfo>
+
 #include <folly/Expected.h>
 #include <folly/Range.h>
 
@@ -19,6 +22,9 @@ namespace detail {
 class SocketImpl;
 }
 
+// forward declaration of MessagePool
+class MessagePool;
+
 /**
  * Wrapper over zmq_msg_t with lot of convenience methods for creating from
  * various data types and reading binary blob into various data types.
@@ -42,6 +48,12 @@ class Message {
    */
   static folly::Expected<Message, Error> allocate(size_t size) noexcept;
 
+  /**
+   * Same as above but buffer is drawn from the pool. Refer to MessagePool
+   */
+  static folly::Expected<Message, Error> allocate(
+      size_t size, MessagePool& pool) noexcept;
+
   /**
    * Wrap existing IOBuf. Notice that this does not copy buffer, rather adopts
    * its content. The IOBuf pointer will be released when Message destructs.
@@ -50,12 +62,55 @@ class Message {
       std::unique_ptr<folly::IOBuf> buf) noexcept;
 
   /**
-   * construct message from Thrift object using supplied serializer
+   * Wrap every buffer of IOBuf chain into a separate message without copying
+   * (no coalesce). Each message adopts its buffer. Empty buffers are skipped,
+   * and an empty chain results in a single empty message. Intended to be sent
+   * as a multi-part message.
+   */
+  static folly::Expected<std::vector<Message>, Error> wrapBufferChain(
+      std::unique_ptr<folly::IOBuf> buf) noexcept;
+
+  /**
+   * construct message from Thrift object using supplied serializer. Object is
+   * serialized into the reused output buffer of the current thread's pool and
+   * copied into a pooled message, no allocation in steady state. Objects
+   * bigger than the largest size class of pool are wrapped without the copy.
    */
   template <typename ThriftType, typename Serializer>
   static folly::Expected<Message, Error>
   fromThriftObj(ThriftType const& obj, Serializer& serializer) noexcept {
-    return wrapBuffer(util::writeThriftObj(obj, serializer));
+    return fromThriftObj(obj, serializer, getThreadLocalPool());
+  }
+
+  /**
+   * Same as above but through the specified pool. Refer to MessagePool
+   */
+  template <typename ThriftType, typename Serializer>
+  static folly::Expected<Message, Error>
+  fromThriftObj(
+      ThriftType const& obj,
+      Serializer& serializer,
+      MessagePool& pool) noexcept {
+    serializer.serialize(obj, &beginThriftOutput(pool));
+    return finishThriftOutput(pool);
+  }
+
+  /**
+   * Transfer ownership of heap object through message without serializing
+   * it, e.g. between producer and consumer threads over `inproc://` sockets.
+   * Message references the object and deletes it on destruction, unless it
+   * has been released by `releaseObject<T>()` on the receiving end.
+   *
+   * NOTE: Object messages must never leave the process. Receiving end only
+   * accepts messages created by this process and of matching type.
+   */
+  template <typename T>
+  static folly::Expected<Message, Error>
+  fromObject(std::unique_ptr<T> obj) noexcept {
+    return wrapObject(
+        obj.release(), typeid(T), [](void* ptr) noexcept {
+          delete static_cast<T*>(ptr);
+        });
   }
 
   /**
@@ -73,12 +128,18 @@ class Message {
   }
 
   /**
-   * Construct message by copying string contents
+   * Construct message by copying string contents (e.g. of std::string). Data
+   * is copied straight into the zmq message, small strings (e.g. identities,
+   * keys) are stored inline in it without any allocation.
    */
-  static folly::Expected<Message, Error>
-  from(std::string const& str) noexcept {
-    return Message::wrapBuffer(folly::IOBuf::copyBuffer(str));
-  }
+  static folly::Expected<Message, Error> from(folly::StringPiece str) noexcept;
+
+  /**
+   * Construct message by copying string contents into buffer drawn from the
+   * pool
+   */
+  static folly::Expected<Message, Error> from(
+      folly::StringPiece str, MessagePool& pool) noexcept;
 
   /**
    * Read concrete type from message. All methods treat message atomically.
@@ -114,6 +175,77 @@ class Message {
     return std::string(reinterpret_cast<const char*>(data().data()), size());
   }
 
+  /**
+   * Non-owning views of message data, without copying. Views are valid for as
+   * long as message is alive and unmodified, hence not available on rvalues.
+   */
+
+  /**
+   * View data as string or bytes
+   */
+  template <
+      typename T,
+      std::enable_if_t<
+          std::is_same<T, folly::StringPiece>::value or
+          std::is_same<T, folly::ByteRange>::value>* = nullptr>
+  folly::Expected<T, Error>
+  view() const& noexcept {
+    auto bytes = data();
+    return T(
+        reinterpret_cast<typename T::const_iterator>(bytes.begin()),
+        reinterpret_cast<typename T::const_iterator>(bytes.end()));
+  }
+
+  /**
+   * View data as trivially copyable type, e.g. a packed header struct, in
+   * place. Errors
+   * - EPROTO: Message size doesn't match sizeof(T)
+   * - EINVAL: Data isn't aligned for T. Small messages are stored inline in
+   *   zmq_msg_t and may not be aligned beyond a byte, use read<T>() instead.
+   */
+  template <
+      typename T,
+      std::enable_if_t<
+          std::is_trivially_copyable<T>::value and
+          not std::is_same<T, folly::StringPiece>::value and
+          not std::is_same<T, folly::ByteRange>::value>* = nullptr>
+  folly::Expected<T const*, Error>
+  view() const& noexcept {
+    if (sizeof(T) != size()) {
+      return folly::makeUnexpected(Error(EPROTO));
+    }
+    const auto ptr = data().data();
+    if (reinterpret_cast<uintptr_t>(ptr) % alignof(T) != 0) {
+      return folly::makeUnexpected(Error(EINVAL, "Misaligned message data"));
+    }
+    return reinterpret_cast<T const*>(ptr);
+  }
+
+  template <typename T>
+  void view() && = delete;
+
+  /**
+   * Take ownership of object passed via `fromObject<T>()`. Object can be
+   * released only once, copies of message share the object. Errors
+   * - EPROTO: Not an object message (of this process)
+   * - EINVAL: Object is not of type T
+   * - ENOENT: Object has already been released
+   */
+  template <typename T>
+  folly::Expected<std::unique_ptr<T>, Error>
+  releaseObject() noexcept {
+    auto ptr = releaseObjectImpl(typeid(T));
+    if (ptr.hasError()) {
+      return folly::makeUnexpected(ptr.error());
+    }
+    return std::unique_ptr<T>(static_cast<T*>(ptr.value()));
+  }
+
+  /**
+   * Tells if message carries an object, refer to `fromObject()`
+   */
+  bool isObject() const noexcept;
+
   /**
    * Read thrift object from message payload
    */
@@ -132,6 +264,39 @@ class Message {
     return folly::makeUnexpected(Error(EPROTO));
   }
 
+  /**
+   * Same as above but deserializes from a shared IOBuf referencing message
+   * data (refer to `toIOBuf`). Binary fields of IOBuf type in thrift object
+   * reference message data directly instead of copying it, and keep the
+   * underlying zmq message alive as long as they exist.
+   */
+  template <typename ThriftType, typename Serializer>
+  folly::Expected<ThriftType, Error>
+  readThriftObjShared(Serializer& serializer) const noexcept {
+    try {
+      auto buf = toIOBuf();
+      return util::readThriftObj<ThriftType>(*buf, serializer);
+    } catch (std::exception const& e) {
+      LOG(ERROR) << "Failed to serialize thrift object. "
+                 << "Exception: " << folly::exceptionStr(e) << "Received: "
+                 << folly::humanify(std::string(
+                        reinterpret_cast<const char*>(data().data()), size()));
+    }
+    return folly::makeUnexpected(Error(EPROTO));
+  }
+
+  /**
+   * Get IOBuf referencing message data without copying. Underlying zmq message
+   * is ref-counted (via zmq_msg_copy) and released when both, IOBuf and this
+   * Message, are destroyed. Rvalue version avoids the ref-count by adopting
+   * the message.
+   *
+   * NOTE: Data is shared, writes into the message are visible in IOBuf. Small
+   * messages (stored inline within zmq_msg_t) are copied.
+   */
+  std::unique_ptr<folly::IOBuf> toIOBuf() const&;
+  std::unique_ptr<folly::IOBuf> toIOBuf() &&;
+
   /**
    * Message is movable and copyable
    */
@@ -181,6 +346,19 @@ class Message {
 
  private:
   friend class detail::SocketImpl;
+  friend class MessagePool;
+
+  // Non-template parts of fromThriftObj
+  static MessagePool& getThreadLocalPool() noexcept;
+  static folly::IOBufQueue& beginThriftOutput(MessagePool& pool) noexcept;
+  static folly::Expected<Message, Error> finishThriftOutput(
+      MessagePool& pool) noexcept;
+
+  // Non-template parts of fromObject/releaseObject
+  static folly::Expected<Message, Error> wrapObject(
+      void* obj, std::type_info const& type, void (*deleter)(void*)) noexcept;
+  folly::Expected<void*, Error> releaseObjectImpl(
+      std::type_info const& type) noexcept;
 
   // we wrap zmq message
   zmq_msg_t msg_;
@@ -0,0 +1,304 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/zmq/MessageCapture.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <folly/FileUtil.h>
+#include <folly/Varint.h>
+#include <glog/logging.h>
+
+namespace fbzmq {
+
+namespace {
+
+constexpr folly::StringPiece kMagic{"FBZMQCAP"};
+constexpr uint8_t kVersion{1};
+constexpr size_t kHeaderSize{kMagic.size() + sizeof(kVersion)};
+
+constexpr char kSessionTag{'S'};
+constexpr char kMessageTag{'M'};
+
+// Frames claiming a larger size are taken for corruption
+constexpr uint64_t kMaxFrameSize{256 * 1024 * 1024};
+
+// Granularity of reads from file
+constexpr size_t kReadSize{64 * 1024};
+
+int64_t
+toMicros(std::chrono::system_clock::time_point timestamp) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             timestamp.time_since_epoch())
+      .count();
+}
+
+std::string
+makeHeader() {
+  std::string header = kMagic.str();
+  header.push_back(static_cast<char>(kVersion));
+  return header;
+}
+
+folly::Expected<folly::Unit, Error>
+checkHeader(int fd) {
+  char header[kHeaderSize];
+  const auto size = folly::preadFull(fd, header, sizeof(header), 0);
+  if (size < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  if (size != sizeof(header) or
+      folly::StringPiece(header, kMagic.size()) != kMagic) {
+    return folly::makeUnexpected(Error(EPROTO, "Not a capture file"));
+  }
+  if (static_cast<uint8_t>(header[kMagic.size()]) != kVersion) {
+    return folly::makeUnexpected(
+        Error(EPROTO, "Unsupported capture file version"));
+  }
+  return folly::unit;
+}
+
+} // namespace
+
+//
+// MessageCaptureWriter
+//
+
+folly::Expected<std::unique_ptr<MessageCaptureWriter>, Error>
+MessageCaptureWriter::open(std::string const& path) {
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  folly::File file(fd, true /* ownsFd */);
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  if (st.st_size == 0) {
+    const auto header = makeHeader();
+    if (folly::writeFull(fd, header.data(), header.size()) < 0) {
+      return folly::makeUnexpected(Error(errno));
+    }
+  } else {
+    auto ret = checkHeader(fd);
+    if (ret.hasError()) {
+      return folly::makeUnexpected(ret.error());
+    }
+  }
+
+  return std::unique_ptr<MessageCaptureWriter>(
+      new MessageCaptureWriter(std::move(file)));
+}
+
+MessageCaptureWriter::MessageCaptureWriter(folly::File file)
+    : file_(std::move(file)) {
+  buffer_.reserve(kFlushSize);
+}
+
+MessageCaptureWriter::~MessageCaptureWriter() {
+  auto ret = flush();
+  if (ret.hasError()) {
+    LOG(ERROR) << "Failed to flush capture file. " << ret.error();
+  }
+}
+
+void
+MessageCaptureWriter::appendVarint(uint64_t value) {
+  uint8_t buf[folly::kMaxVarintLength64];
+  const size_t size = folly::encodeVarint(value, buf);
+  buffer_.append(reinterpret_cast<const char*>(buf), size);
+}
+
+folly::Expected<folly::Unit, Error>
+MessageCaptureWriter::write(
+    std::vector<Message> const& frames,
+    std::chrono::system_clock::time_point timestamp) {
+  const int64_t micros = toMicros(timestamp);
+  if (not lastTimestamp_) {
+    buffer_.push_back(kSessionTag);
+    appendVarint(std::max<int64_t>(micros, 0));
+    lastTimestamp_ = std::max<int64_t>(micros, 0);
+  }
+
+  // Clock may step back, deltas are clamped so that replay never goes back
+  // in time
+  const int64_t delta = std::max<int64_t>(micros - *lastTimestamp_, 0);
+  *lastTimestamp_ += delta;
+
+  buffer_.push_back(kMessageTag);
+  appendVarint(delta);
+  appendVarint(frames.size());
+  for (auto const& frame : frames) {
+    const auto data = frame.data();
+    appendVarint(data.size());
+    buffer_.append(reinterpret_cast<const char*>(data.data()), data.size());
+    numBytes_ += data.size();
+  }
+  ++numMessages_;
+
+  if (buffer_.size() >= kFlushSize) {
+    return flush();
+  }
+  return folly::unit;
+}
+
+folly::Expected<folly::Unit, Error>
+MessageCaptureWriter::flush() {
+  if (buffer_.empty()) {
+    return folly::unit;
+  }
+  // Records are written in one go, hence readers of a file being captured
+  // into only ever see a truncated record at its end
+  const auto ret = folly::writeFull(file_.fd(), buffer_.data(), buffer_.size());
+  buffer_.clear();
+  if (ret < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  return folly::unit;
+}
+
+//
+// MessageCaptureReader
+//
+
+folly::Expected<std::unique_ptr<MessageCaptureReader>, Error>
+MessageCaptureReader::open(std::string const& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+  folly::File file(fd, true /* ownsFd */);
+
+  auto ret = checkHeader(fd);
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  if (::lseek(fd, kHeaderSize, SEEK_SET) < 0) {
+    return folly::makeUnexpected(Error(errno));
+  }
+
+  return std::unique_ptr<MessageCaptureReader>(
+      new MessageCaptureReader(std::move(file)));
+}
+
+MessageCaptureReader::MessageCaptureReader(folly::File file)
+    : file_(std::move(file)) {}
+
+folly::Expected<bool, Error>
+MessageCaptureReader::fill(size_t size) {
+  while (buffer_.size() - pos_ < size) {
+    // Drop consumed bytes before reading more
+    buffer_.erase(0, pos_);
+    pos_ = 0;
+
+    const size_t oldSize = buffer_.size();
+    buffer_.resize(oldSize + std::max(kReadSize, size - oldSize));
+    const auto ret = folly::readFull(
+        file_.fd(), &buffer_[oldSize], buffer_.size() - oldSize);
+    if (ret < 0) {
+      buffer_.resize(oldSize);
+      return folly::makeUnexpected(Error(errno));
+    }
+    buffer_.resize(oldSize + ret);
+    if (ret == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+folly::Expected<uint64_t, Error>
+MessageCaptureReader::readVarint() {
+  // Varint may be shorter than max and end right at end of file
+  auto filled = fill(folly::kMaxVarintLength64);
+  if (filled.hasError()) {
+    return folly::makeUnexpected(filled.error());
+  }
+  folly::ByteRange range(
+      reinterpret_cast<const uint8_t*>(buffer_.data()) + pos_,
+      buffer_.size() - pos_);
+  const auto begin = range.begin();
+  auto value = folly::tryDecodeVarint(range);
+  if (value.hasError()) {
+    return folly::makeUnexpected(Error(EPROTO, "Truncated capture record"));
+  }
+  pos_ += range.begin() - begin;
+  return value.value();
+}
+
+folly::Expected<folly::Optional<CapturedMessage>, Error>
+MessageCaptureReader::next() {
+  while (true) {
+    auto filled = fill(1);
+    if (filled.hasError()) {
+      return folly::makeUnexpected(filled.error());
+    }
+    if (not filled.value()) {
+      return folly::Optional<CapturedMessage>();
+    }
+
+    const char tag = buffer_[pos_++];
+    if (tag == kSessionTag) {
+      auto timestamp = readVarint();
+      if (timestamp.hasError()) {
+        return folly::makeUnexpected(timestamp.error());
+      }
+      lastTimestamp_ = timestamp.value();
+      continue;
+    }
+    if (tag != kMessageTag or not lastTimestamp_) {
+      return folly::makeUnexpected(Error(EPROTO, "Corrupt capture record"));
+    }
+
+    auto delta = readVarint();
+    if (delta.hasError()) {
+      return folly::makeUnexpected(delta.error());
+    }
+    auto numFrames = readVarint();
+    if (numFrames.hasError()) {
+      return folly::makeUnexpected(numFrames.error());
+    }
+    *lastTimestamp_ += delta.value();
+
+    CapturedMessage msg;
+    msg.timestamp = std::chrono::system_clock::time_point(
+        std::chrono::microseconds(*lastTimestamp_));
+    for (uint64_t i = 0; i < numFrames.value(); ++i) {
+      auto size = readVarint();
+      if (size.hasError()) {
+        return folly::makeUnexpected(size.error());
+      }
+      if (size.value() > kMaxFrameSize) {
+        return folly::makeUnexpected(Error(EPROTO, "Corrupt capture record"));
+      }
+      filled = fill(size.value());
+      if (filled.hasError()) {
+        return folly::makeUnexpected(filled.error());
+      }
+      if (not filled.value()) {
+        return folly::makeUnexpected(
+            Error(EPROTO, "Truncated capture record"));
+      }
+      auto frame =
+          Message::from(folly::StringPiece(&buffer_[pos_], size.value()));
+      if (frame.hasError()) {
+        return folly::makeUnexpected(frame.error());
+      }
+      pos_ += size.value();
+      msg.frames.emplace_back(std::move(frame.value()));
+    }
+    return folly::make_optional(std::move(msg));
+  }
+}
+
+} // namespace fbzmq
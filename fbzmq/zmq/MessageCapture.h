@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Expected.h>
+#include <folly/File.h>
+#include <folly/Optional.h>
+
+#include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Message.h>
+
+namespace fbzmq {
+
+/**
+ * Multipart message read back from a capture file, along with the time it
+ * was captured at
+ */
+struct CapturedMessage {
+  std::chrono::system_clock::time_point timestamp;
+  std::vector<Message> frames;
+};
+
+/**
+ * Capture files record multipart messages with their timestamps, e.g. the
+ * messages copied onto the capture socket of ZmqProxy, for replaying them
+ * later (refer to examples/capture). Format is compact and append-only:
+ *
+ *  file    := "FBZMQCAP" version:u8 record*
+ *  record  := 'S' timestamp:varint           -- start of a writer session
+ *           | 'M' delta:varint numFrames:varint (size:varint bytes)*
+ *
+ * Timestamps are microseconds since epoch, deltas microseconds since the
+ * previous record (clamped at zero). Every writer opens a new session, hence
+ * files can be appended to by successive captures.
+ */
+class MessageCaptureWriter {
+ public:
+  // Buffered records are written out once buffer grows beyond this
+  static constexpr size_t kFlushSize{64 * 1024};
+
+  /**
+   * Open capture file at `path` for appending, creating it if necessary.
+   * Fails if an existing file is not a capture file.
+   */
+  static folly::Expected<std::unique_ptr<MessageCaptureWriter>, Error> open(
+      std::string const& path);
+
+  // Flushes buffered records
+  ~MessageCaptureWriter();
+
+  MessageCaptureWriter(MessageCaptureWriter const&) = delete;
+  MessageCaptureWriter& operator=(MessageCaptureWriter const&) = delete;
+
+  /**
+   * Append frames of a multipart message. Records are buffered, call
+   * `flush()` to write them out right away.
+   */
+  folly::Expected<folly::Unit, Error> write(
+      std::vector<Message> const& frames,
+      std::chrono::system_clock::time_point timestamp =
+          std::chrono::system_clock::now());
+
+  folly::Expected<folly::Unit, Error> flush();
+
+  /**
+   * Messages and bytes (of frames) written so far
+   */
+  uint64_t
+  getNumMessages() const {
+    return numMessages_;
+  }
+
+  uint64_t
+  getNumBytes() const {
+    return numBytes_;
+  }
+
+ private:
+  explicit MessageCaptureWriter(folly::File file);
+
+  void appendVarint(uint64_t value);
+
+  folly::File file_;
+
+  // Encoded records not yet written out
+  std::string buffer_;
+
+  // Timestamp of the last record, none until session record is written
+  folly::Optional<int64_t> lastTimestamp_;
+
+  uint64_t numMessages_{0};
+  uint64_t numBytes_{0};
+};
+
+/**
+ * Sequential reader of a capture file
+ *
+ *  auto reader = MessageCaptureReader::open(path).value();
+ *  while (auto msg = reader->next().value()) {
+ *    ...
+ *  }
+ */
+class MessageCaptureReader {
+ public:
+  /**
+   * Open capture file at `path` for reading. Fails if it is not a capture
+   * file (of a known version).
+   */
+  static folly::Expected<std::unique_ptr<MessageCaptureReader>, Error> open(
+      std::string const& path);
+
+  MessageCaptureReader(MessageCaptureReader const&) = delete;
+  MessageCaptureReader& operator=(MessageCaptureReader const&) = delete;
+
+  /**
+   * Next message, none at end of file. Fails with EPROTO if file is corrupt
+   * or ends in the middle of a record, e.g. as capture is still running.
+   */
+  folly::Expected<folly::Optional<CapturedMessage>, Error> next();
+
+ private:
+  explicit MessageCaptureReader(folly::File file);
+
+  // Make at least `size` bytes available from `pos_`, false on end of file
+  folly::Expected<bool, Error> fill(size_t size);
+
+  folly::Expected<uint64_t, Error> readVarint();
+
+  folly::File file_;
+
+  // Bytes read ahead from file, consumed from `pos_`
+  std::string buffer_;
+  size_t pos_{0};
+
+  // Timestamp of the last record, none until session record is read
+  folly::Optional<int64_t> lastTimestamp_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/zmq/MessageCodec.h>
+
+#include <cstring>
+
+#include <folly/Format.h>
+#include <folly/compression/Compression.h>
+#include <folly/lang/Bits.h>
+#include <zstd.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Header of encoded frames
+//  [0..2] magic
+//  [3]    CompressionType
+//  [4..7] uncompressed size, little endian
+const uint8_t kMagic[3] = {0xFB, 0x5A, 0x43};
+const size_t kHeaderSize{8};
+
+void
+writeHeader(uint8_t* buf, CompressionType type, uint32_t size) {
+  std::memcpy(buf, kMagic, sizeof(kMagic));
+  buf[3] = static_cast<uint8_t>(type);
+  const uint32_t sizeLE = folly::Endian::little(size);
+  std::memcpy(buf + 4, &sizeLE, sizeof(sizeLE));
+}
+
+int64_t
+toUs(std::chrono::nanoseconds value) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+}
+
+} // namespace
+
+double
+CompressionStats::getCompressionRatio() const {
+  if (numBytesOut == 0) {
+    return 1;
+  }
+  return static_cast<double>(numBytesIn) / numBytesOut;
+}
+
+std::unordered_map<std::string, int64_t>
+CompressionStats::getCounters(std::string const& prefix) const {
+  std::unordered_map<std::string, int64_t> counters;
+  counters[prefix + ".compressed"] = numCompressed;
+  counters[prefix + ".uncompressed"] = numUncompressed;
+  counters[prefix + ".decompressed"] = numDecompressed;
+  counters[prefix + ".bytes_in"] = numBytesIn;
+  counters[prefix + ".bytes_out"] = numBytesOut;
+  // Ratio in percent, counters are integers
+  counters[prefix + ".ratio_pct"] =
+      static_cast<int64_t>(getCompressionRatio() * 100);
+  counters[prefix + ".compress_us"] = toUs(compressTime);
+  counters[prefix + ".decompress_us"] = toUs(decompressTime);
+  return counters;
+}
+
+MessageCodec::MessageCodec(CompressionOptions options)
+    : options_(std::move(options)) {
+  switch (options_.type) {
+  case CompressionType::ZSTD: {
+    const int level = options_.level ? options_.level : ZSTD_CLEVEL_DEFAULT;
+    zstdCCtx_ = ZSTD_createCCtx();
+    zstdDCtx_ = ZSTD_createDCtx();
+    CHECK(zstdCCtx_ and zstdDCtx_) << "Failed to create zstd contexts";
+    if (not options_.dictionary.empty()) {
+      zstdCDict_ = ZSTD_createCDict(
+          options_.dictionary.data(), options_.dictionary.size(), level);
+      zstdDDict_ = ZSTD_createDDict(
+          options_.dictionary.data(), options_.dictionary.size());
+      CHECK(zstdCDict_ and zstdDDict_) << "Invalid zstd dictionary";
+    }
+    break;
+  }
+  case CompressionType::LZ4: {
+    CHECK(options_.dictionary.empty()) << "LZ4 doesn't support dictionaries";
+    lz4Codec_ = folly::io::getCodec(
+        folly::io::CodecType::LZ4,
+        options_.level ? options_.level : folly::io::COMPRESSION_LEVEL_DEFAULT);
+    break;
+  }
+  case CompressionType::NONE:
+    break;
+  }
+}
+
+MessageCodec::~MessageCodec() {
+  ZSTD_freeCCtx(zstdCCtx_);
+  ZSTD_freeDCtx(zstdDCtx_);
+  ZSTD_freeCDict(zstdCDict_);
+  ZSTD_freeDDict(zstdDDict_);
+}
+
+bool
+MessageCodec::isEncoded(Message const& msg) noexcept {
+  const auto data = msg.data();
+  return data.size() >= kHeaderSize and
+      std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0;
+}
+
+folly::Expected<Message, Error>
+MessageCodec::compress(Message&& msg) {
+  const auto data = msg.data();
+  if (options_.type == CompressionType::NONE or
+      data.size() < options_.minSize or data.size() > options_.maxFrameSize) {
+    ++stats_.numUncompressed;
+    return passThrough(std::move(msg));
+  }
+
+  const auto startTime = std::chrono::steady_clock::now();
+  auto compressedSize = compressInto(data);
+  if (compressedSize.hasError()) {
+    return folly::makeUnexpected(compressedSize.error());
+  }
+
+  // Not worth it
+  if (compressedSize.value() + kHeaderSize >= data.size()) {
+    stats_.compressTime += std::chrono::steady_clock::now() - startTime;
+    ++stats_.numUncompressed;
+    return passThrough(std::move(msg));
+  }
+
+  auto encoded = Message::allocate(kHeaderSize + compressedSize.value());
+  if (encoded.hasError()) {
+    return folly::makeUnexpected(encoded.error());
+  }
+  auto buf = encoded->writeableData();
+  writeHeader(buf.data(), options_.type, static_cast<uint32_t>(data.size()));
+  std::memcpy(buf.data() + kHeaderSize, buffer_.data(), compressedSize.value());
+
+  stats_.compressTime += std::chrono::steady_clock::now() - startTime;
+  ++stats_.numCompressed;
+  stats_.numBytesIn += data.size();
+  stats_.numBytesOut += encoded->size();
+  return encoded;
+}
+
+folly::Expected<Message, Error>
+MessageCodec::decompress(Message&& msg) {
+  if (not isEncoded(msg)) {
+    return std::move(msg);
+  }
+
+  const auto data = msg.data();
+  const auto type = static_cast<CompressionType>(data[3]);
+  uint32_t size;
+  std::memcpy(&size, data.data() + 4, sizeof(size));
+  size = folly::Endian::little(size);
+  const auto payload = data.subpiece(kHeaderSize);
+  if (size > options_.maxFrameSize) {
+    return folly::makeUnexpected(Error(
+        EMSGSIZE,
+        folly::sformat("Encoded frame of size {} exceeds max size", size)));
+  }
+
+  const auto startTime = std::chrono::steady_clock::now();
+  auto decoded = Message::allocate(size);
+  if (decoded.hasError()) {
+    return folly::makeUnexpected(decoded.error());
+  }
+  auto buf = decoded->writeableData();
+
+  switch (type) {
+  case CompressionType::NONE: {
+    if (payload.size() != size) {
+      return folly::makeUnexpected(Error(EPROTO, "Corrupt escaped frame"));
+    }
+    std::memcpy(buf.data(), payload.data(), size);
+    return decoded;
+  }
+  case CompressionType::ZSTD: {
+    // Decompression contexts are created lazily on receivers which
+    // themselves compress with some other algorithm
+    if (not zstdDCtx_) {
+      zstdDCtx_ = ZSTD_createDCtx();
+      CHECK(zstdDCtx_) << "Failed to create zstd context";
+    }
+    const size_t ret = zstdDDict_
+        ? ZSTD_decompress_usingDDict(
+              zstdDCtx_,
+              buf.data(),
+              buf.size(),
+              payload.data(),
+              payload.size(),
+              zstdDDict_)
+        : ZSTD_decompressDCtx(
+              zstdDCtx_,
+              buf.data(),
+              buf.size(),
+              payload.data(),
+              payload.size());
+    if (ZSTD_isError(ret) or ret != size) {
+      return folly::makeUnexpected(Error(
+          EPROTO,
+          folly::sformat(
+              "Failed to decompress zstd frame. {}",
+              ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "size mismatch")));
+    }
+    break;
+  }
+  case CompressionType::LZ4: {
+    if (not lz4Codec_) {
+      lz4Codec_ = folly::io::getCodec(folly::io::CodecType::LZ4);
+    }
+    try {
+      const auto uncompressed = lz4Codec_->uncompress(
+          folly::StringPiece(
+              reinterpret_cast<const char*>(payload.data()), payload.size()),
+          static_cast<uint64_t>(size));
+      if (uncompressed.size() != size) {
+        return folly::makeUnexpected(
+            Error(EPROTO, "Failed to decompress lz4 frame. size mismatch"));
+      }
+      std::memcpy(buf.data(), uncompressed.data(), size);
+    } catch (std::exception const& e) {
+      return folly::makeUnexpected(Error(
+          EPROTO,
+          folly::sformat("Failed to decompress lz4 frame. {}", e.what())));
+    }
+    break;
+  }
+  default:
+    return folly::makeUnexpected(Error(
+        EPROTO,
+        folly::sformat(
+            "Unknown compression type {}", static_cast<int>(data[3]))));
+  }
+
+  stats_.decompressTime += std::chrono::steady_clock::now() - startTime;
+  ++stats_.numDecompressed;
+  return decoded;
+}
+
+folly::Expected<Message, Error>
+MessageCodec::passThrough(Message&& msg) {
+  if (not isEncoded(msg)) {
+    return std::move(msg);
+  }
+
+  // Payload looks like an encoded frame, escape it for the receiver
+  const auto data = msg.data();
+  auto encoded = Message::allocate(kHeaderSize + data.size());
+  if (encoded.hasError()) {
+    return folly::makeUnexpected(encoded.error());
+  }
+  auto buf = encoded->writeableData();
+  writeHeader(
+      buf.data(), CompressionType::NONE, static_cast<uint32_t>(data.size()));
+  std::memcpy(buf.data() + kHeaderSize, data.data(), data.size());
+  return encoded;
+}
+
+folly::Expected<size_t, Error>
+MessageCodec::compressInto(folly::ByteRange data) {
+  if (options_.type == CompressionType::ZSTD) {
+    buffer_.resize(ZSTD_compressBound(data.size()));
+    const int level = options_.level ? options_.level : ZSTD_CLEVEL_DEFAULT;
+    const size_t ret = zstdCDict_
+        ? ZSTD_compress_usingCDict(
+              zstdCCtx_,
+              &buffer_[0],
+              buffer_.size(),
+              data.data(),
+              data.size(),
+              zstdCDict_)
+        : ZSTD_compressCCtx(
+              zstdCCtx_,
+              &buffer_[0],
+              buffer_.size(),
+              data.data(),
+              data.size(),
+              level);
+    if (ZSTD_isError(ret)) {
+      return folly::makeUnexpected(Error(
+          EINVAL,
+          folly::sformat(
+              "Failed to compress zstd frame. {}", ZSTD_getErrorName(ret))));
+    }
+    return ret;
+  }
+
+  try {
+    buffer_ = lz4Codec_->compress(folly::StringPiece(
+        reinterpret_cast<const char*>(data.data()), data.size()));
+  } catch (std::exception const& e) {
+    return folly::makeUnexpected(Error(
+        EINVAL,
+        folly::sformat("Failed to compress lz4 frame. {}", e.what())));
+  }
+  return buffer_.size();
+}
+
+} // namespace fbzmq
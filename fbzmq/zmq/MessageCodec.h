@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <folly/Expected.h>
+
+#include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Message.h>
+
+// forward declaration of zstd contexts
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace folly {
+namespace io {
+class Codec;
+} // namespace io
+} // namespace folly
+
+namespace fbzmq {
+
+/**
+ * Compression algorithm of a frame. Values are part of the wire format.
+ */
+enum class CompressionType : uint8_t {
+  // Frame is stored as is. Used for escaping uncompressed frames which happen
+  // to start with the codec header.
+  NONE = 0,
+  LZ4 = 1,
+  ZSTD = 2,
+};
+
+struct CompressionOptions {
+  CompressionType type{CompressionType::ZSTD};
+
+  // Compression level, zero for default level of the algorithm
+  int level{0};
+
+  // Frames smaller than this are sent as is. Small frames don't compress well
+  // and aren't worth the CPU.
+  size_t minSize{1024};
+
+  // Trained dictionary (zstd only), must be the same on both ends. Improves
+  // ratio of small frames with similar content, e.g. thrift objects of the
+  // same type. Refer to `zstd --train`.
+  std::string dictionary{};
+
+  // Decompression of frames claiming a larger size fails
+  size_t maxFrameSize{256 * 1024 * 1024};
+};
+
+/**
+ * Cumulative stats of a codec
+ */
+struct CompressionStats {
+  // Frames which have been compressed vs sent as is, because they are too
+  // small or didn't get any smaller
+  uint64_t numCompressed{0};
+  uint64_t numUncompressed{0};
+  uint64_t numDecompressed{0};
+
+  // Size of compressed frames before and after compression
+  uint64_t numBytesIn{0};
+  uint64_t numBytesOut{0};
+
+  // CPU (wall) time spent in compression and decompression
+  std::chrono::nanoseconds compressTime{0};
+  std::chrono::nanoseconds decompressTime{0};
+
+  /**
+   * Ratio of bytes before to after compression, 1 if nothing is compressed
+   */
+  double getCompressionRatio() const;
+
+  /**
+   * Flat counters of stats with given key prefix, e.g.
+   * `<prefix>.bytes_in`. Can be published via `ThreadData::setCounters`.
+   */
+  std::unordered_map<std::string, int64_t> getCounters(
+      std::string const& prefix) const;
+};
+
+/**
+ * Per frame compression of Messages. Compressed frames carry a small header,
+ * hence `decompress()` detects and passes through uncompressed frames. A
+ * receiver without the codec can't decode compressed frames, hence receivers
+ * must be upgraded to decompress first, and then compression be enabled on
+ * senders.
+ *
+ *  MessageCodec codec(CompressionOptions{CompressionType::LZ4});
+ *  auto compressed = codec.compress(std::move(msg)).value();
+ *  ...
+ *  auto msg = codec.decompress(std::move(compressed)).value();
+ *
+ * Codec can be set on a socket to compress thrift objects transparently,
+ * refer to `SocketImpl::setCodec`.
+ *
+ * Codec keeps compression contexts and buffers across calls, hence it is not
+ * thread safe. Use one codec per thread.
+ */
+class MessageCodec {
+ public:
+  explicit MessageCodec(CompressionOptions options);
+  ~MessageCodec();
+
+  MessageCodec(MessageCodec const&) = delete;
+  MessageCodec& operator=(MessageCodec const&) = delete;
+
+  /**
+   * Compress frame if it is large enough and gets smaller, else return it as
+   * is (without copying).
+   */
+  folly::Expected<Message, Error> compress(Message&& msg);
+
+  /**
+   * Decompress frame if it has been compressed, else return it as is
+   * (without copying).
+   */
+  folly::Expected<Message, Error> decompress(Message&& msg);
+
+  /**
+   * Tells if frame has been encoded by a codec
+   */
+  static bool isEncoded(Message const& msg) noexcept;
+
+  CompressionOptions const&
+  getOptions() const {
+    return options_;
+  }
+
+  CompressionStats const&
+  getStats() const {
+    return stats_;
+  }
+
+  void
+  resetStats() {
+    stats_ = CompressionStats();
+  }
+
+ private:
+  // Return frame as is, escaped with NONE header if it looks encoded
+  folly::Expected<Message, Error> passThrough(Message&& msg);
+
+  // Compress payload into `buffer_` and return compressed size
+  folly::Expected<size_t, Error> compressInto(folly::ByteRange data);
+
+  const CompressionOptions options_;
+
+  // zstd contexts reused across frames
+  ZSTD_CCtx_s* zstdCCtx_{nullptr};
+  ZSTD_DCtx_s* zstdDCtx_{nullptr};
+  ZSTD_CDict_s* zstdCDict_{nullptr};
+  ZSTD_DDict_s* zstdDDict_{nullptr};
+
+  // LZ4 codec from folly
+  std::unique_ptr<folly::io::Codec> lz4Codec_;
+
+  // Scratch buffer of compressed output, reused across frames
+  std::string buffer_;
+
+  CompressionStats stats_;
+};
+
+} // namespace fbzmq
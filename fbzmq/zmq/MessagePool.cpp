@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/zmq/MessagePool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace fbzmq {
+
+constexpr size_t MessagePool::kNumSizeClasses;
+constexpr std::array<size_t, MessagePool::kNumSizeClasses>
+    MessagePool::kSizeClasses;
+constexpr size_t MessagePool::kMinPooledSize;
+constexpr size_t MessagePool::kInitialOutputSize;
+constexpr size_t MessagePool::kThreadLocalMaxCachedBuffers;
+
+/**
+ * Header of every buffer. Payload follows the header.
+ */
+struct alignas(std::max_align_t) MessagePool::Block {
+  // Shared state of owning pool
+  State* state{nullptr};
+
+  // Link in free/returned lists
+  Block* next{nullptr};
+
+  size_t sizeClass{0};
+
+  uint8_t*
+  data() {
+    return reinterpret_cast<uint8_t*>(this + 1);
+  }
+};
+
+/**
+ * State shared by the pool and its in-flight blocks. It is ref-counted so
+ * that blocks can be returned after the pool is destroyed.
+ */
+struct MessagePool::State {
+  ~State() {
+    for (auto& returned : returnedBlocks) {
+      auto block = returned.load(std::memory_order_acquire);
+      while (block) {
+        auto next = block->next;
+        std::free(block);
+        block = next;
+      }
+    }
+  }
+
+  // One reference for pool and one for every in-flight block
+  std::atomic<size_t> refCount{1};
+
+  // Lock-free stacks of blocks returned from any thread
+  std::array<std::atomic<Block*>, kNumSizeClasses> returnedBlocks{};
+
+  void
+  release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+};
+
+MessagePool::MessagePool(size_t maxCachedBuffers)
+    : state_(new State()), maxCachedBuffers_(maxCachedBuffers) {}
+
+MessagePool::~MessagePool() {
+  for (auto block : freeBlocks_) {
+    while (block) {
+      auto next = block->next;
+      std::free(block);
+      block = next;
+    }
+  }
+  state_->release();
+}
+
+MessagePool&
+MessagePool::getThreadLocal() {
+  static thread_local MessagePool pool{kThreadLocalMaxCachedBuffers};
+  return pool;
+}
+
+folly::Expected<Message, Error>
+MessagePool::allocate(size_t size) noexcept {
+  ++stats_.numAllocations;
+
+  auto it = std::lower_bound(kSizeClasses.begin(), kSizeClasses.end(), size);
+  if (size < kMinPooledSize || it == kSizeClasses.end()) {
+    ++stats_.numUnpooled;
+    return Message::allocate(size);
+  }
+  const size_t sizeClass = it - kSizeClasses.begin();
+
+  auto block = popFreeBlock(sizeClass);
+  if (block) {
+    ++stats_.numHits;
+  } else {
+    ++stats_.numMisses;
+    auto mem = std::malloc(sizeof(Block) + kSizeClasses[sizeClass]);
+    if (not mem) {
+      return folly::makeUnexpected(Error(ENOMEM));
+    }
+    block = new (mem) Block();
+    block->state = state_;
+    block->sizeClass = sizeClass;
+  }
+
+  // Every in-flight block holds a reference to the state
+  state_->refCount.fetch_add(1, std::memory_order_relaxed);
+
+  Message msg;
+  zmq_msg_close(&(msg.msg_));
+  const int rc = zmq_msg_init_data(
+      &(msg.msg_), block->data(), size, &MessagePool::returnBlock, block);
+  if (rc != 0) {
+    // Free function is not called on failure
+    const Error error;
+    state_->refCount.fetch_sub(1, std::memory_order_relaxed);
+    pushFreeBlock(block);
+    zmq_msg_init(&(msg.msg_));
+    return folly::makeUnexpected(error);
+  }
+  return msg;
+}
+
+folly::IOBufQueue&
+MessagePool::beginOutput() noexcept {
+  DCHECK(output_.empty());
+  if (not outputBuffer_) {
+    outputBuffer_ = folly::IOBuf::create(kInitialOutputSize);
+  }
+  output_.append(std::move(outputBuffer_));
+  return output_;
+}
+
+folly::Expected<Message, Error>
+MessagePool::finishOutput() noexcept {
+  auto buf = output_.move();
+  const auto size = buf->computeChainDataLength();
+
+  if (size > kSizeClasses.back()) {
+    // Too big to pool, message adopts the output instead of a copy of it.
+    // Output buffer (grown to largest size class) is replaced.
+    ++stats_.numAllocations;
+    ++stats_.numUnpooled;
+    outputBuffer_ = folly::IOBuf::create(kSizeClasses.back());
+    return Message::wrapBuffer(std::move(buf));
+  }
+
+  auto msg = allocate(size);
+  if (msg.hasValue()) {
+    auto data = msg->writeableData().data();
+    for (auto range : *buf) {
+      ::memcpy(data, range.data(), range.size());
+      data += range.size();
+    }
+  }
+
+  // Serializer grew the queue (or appended shared buffers). Keep output
+  // buffer only, replaced by one which fits messages of this size from now on
+  // if it's too small (up to largest size class).
+  if (buf->isChained()) {
+    buf->pop();
+    const auto outputSize = std::min(size, kSizeClasses.back());
+    if (buf->capacity() < outputSize) {
+      ++stats_.numOutputGrowths;
+      buf = folly::IOBuf::create(outputSize);
+    }
+  }
+  buf->clear();
+  outputBuffer_ = std::move(buf);
+  return msg;
+}
+
+MessagePool::Block*
+MessagePool::popFreeBlock(size_t sizeClass) noexcept {
+  if (not freeBlocks_[sizeClass]) {
+    // Grab all of the returned blocks at once. Only the owner thread takes
+    // blocks out of the stack, hence there is no ABA problem.
+    auto block = state_->returnedBlocks[sizeClass].exchange(
+        nullptr, std::memory_order_acquire);
+    while (block) {
+      auto next = block->next;
+      pushFreeBlock(block);
+      block = next;
+    }
+  }
+
+  auto block = freeBlocks_[sizeClass];
+  if (block) {
+    freeBlocks_[sizeClass] = block->next;
+    --numFreeBlocks_[sizeClass];
+  }
+  return block;
+}
+
+void
+MessagePool::pushFreeBlock(Block* block) noexcept {
+  const auto sizeClass = block->sizeClass;
+  if (numFreeBlocks_[sizeClass] >= maxCachedBuffers_) {
+    std::free(block);
+    return;
+  }
+  block->next = freeBlocks_[sizeClass];
+  freeBlocks_[sizeClass] = block;
+  ++numFreeBlocks_[sizeClass];
+}
+
+void
+MessagePool::returnBlock(void* /* data */, void* hint) {
+  auto block = reinterpret_cast<Block*>(hint);
+  auto state = block->state;
+
+  // Push on to the returned stack of owning pool
+  auto& returned = state->returnedBlocks[block->sizeClass];
+  block->next = returned.load(std::memory_order_relaxed);
+  while (not returned.compare_exchange_weak(
+      block->next,
+      block,
+      std::memory_order_release,
+      std::memory_order_relaxed)) {
+  }
+
+  state->release();
+}
+
+} // namespace fbzmq
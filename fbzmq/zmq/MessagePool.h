@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <folly/Expected.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Message.h>
+
+namespace fbzmq {
+
+/**
+ * Slab allocator for message buffers. Buffers are carved out of fixed size
+ * classes and recycled once libzmq releases the message, which saves the
+ * allocation of payload for every message sent at high rates.
+ *
+ * Messages are constructed via `zmq_msg_init_data` with a free callback which
+ * returns the buffer to its pool. Buffers can be released from any thread
+ * (e.g. zmq I/O threads or receiving thread for inproc) and they are handed
+ * back to the owning pool via a lock-free list. Buffers can outlive the pool.
+ *
+ * Sizes smaller than `kMinPooledSize` and bigger than largest size class are
+ * not pooled. Only frames up to ZMQ_MAX_VSM_SIZE (~33 bytes) are stored
+ * inline in zmq_msg_t. Bigger ones take a single allocation holding both
+ * payload and ref-count header, whereas a pooled message still needs libzmq
+ * to allocate its header. The allocator serves small payloads from thread
+ * caches at about that cost, hence pooling them saves little and adds the
+ * cross thread return. 128 bytes is a conservative cutoff, not a measured
+ * crossover.
+ *
+ * Pool also keeps an output buffer for serializing thrift objects, refer to
+ * `Message::fromThriftObj`. It is reused for every serialization and grows to
+ * fit the largest pooled message, hence serializing into a pooled message
+ * doesn't allocate in steady state. Messages bigger than the largest size
+ * class adopt the output (coalesced if needed) without a copy into a pooled
+ * buffer.
+ *
+ * Allocation APIs of a pool must be used from a single thread. Use
+ * `getThreadLocal()` to get pool of the current thread.
+ *
+ *  auto& pool = MessagePool::getThreadLocal();
+ *  auto msg = Message::allocate(1024, pool).value();
+ */
+class MessagePool {
+ public:
+  struct Stats {
+    // Total number of allocations requested from pool
+    uint64_t numAllocations{0};
+
+    // Allocations served with recycled buffers
+    uint64_t numHits{0};
+
+    // Allocations for which a new buffer had to be created
+    uint64_t numMisses{0};
+
+    // Allocations not served by pool because of their size
+    uint64_t numUnpooled{0};
+
+    // Serializations which outgrew the output buffer
+    uint64_t numOutputGrowths{0};
+  };
+
+  static constexpr size_t kNumSizeClasses{5};
+  static constexpr std::array<size_t, kNumSizeClasses> kSizeClasses{
+      {256, 1024, 4096, 16384, 65536}};
+  static constexpr size_t kMinPooledSize{128};
+  static constexpr size_t kInitialOutputSize{1024};
+  static constexpr size_t kThreadLocalMaxCachedBuffers{16};
+
+  /**
+   * At most `maxCachedBuffers` free buffers are cached for every size class.
+   */
+  explicit MessagePool(size_t maxCachedBuffers = 1024);
+  ~MessagePool();
+
+  /**
+   * non-copyable and non-movable
+   */
+  MessagePool(MessagePool const&) = delete;
+  MessagePool& operator=(MessagePool const&) = delete;
+
+  /**
+   * Pool of the current thread. It caches at most
+   * `kThreadLocalMaxCachedBuffers` free buffers per size class (~1.4MB), as
+   * every thread serializing thrift objects owns one.
+   */
+  static MessagePool& getThreadLocal();
+
+  /**
+   * Allocate message of specified size, content undefined
+   */
+  folly::Expected<Message, Error> allocate(size_t size) noexcept;
+
+  Stats
+  getStats() const noexcept {
+    return stats_;
+  }
+
+ private:
+  friend class Message;
+
+  struct Block;
+  struct State;
+
+  // Output queue for serializing a message, holding the output buffer
+  folly::IOBufQueue& beginOutput() noexcept;
+
+  // Copy serialized data into a message and take back the output buffer.
+  // Output bigger than largest size class is adopted by message instead.
+  folly::Expected<Message, Error> finishOutput() noexcept;
+
+  // Pop a free block of size class from local list (replenishing it from the
+  // returned blocks if needed)
+  Block* popFreeBlock(size_t sizeClass) noexcept;
+  void pushFreeBlock(Block* block) noexcept;
+
+  // Free-callback of zmq message
+  static void returnBlock(void* data, void* hint);
+
+  // Returned blocks get back to the pool through `state_` which is shared
+  // with all in-flight blocks
+  State* state_{nullptr};
+
+  // Free blocks owned by this pool's thread
+  std::array<Block*, kNumSizeClasses> freeBlocks_{};
+  std::array<size_t, kNumSizeClasses> numFreeBlocks_{};
+
+  const size_t maxCachedBuffers_{0};
+
+  // Output buffer, in `output_` while serializing
+  folly::IOBufQueue output_{folly::IOBufQueue::cacheChainLength()};
+  std::unique_ptr<folly::IOBuf> outputBuffer_;
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fbzmq/zmq/Publisher.h>
+
+namespace fbzmq {
+
+Publisher::Publisher(
+    Context& ctx,
+    folly::Optional<IdentityString> identity,
+    folly::Optional<KeyPair> keyPair)
+    : sock_(ctx, std::move(identity), std::move(keyPair)) {}
+
+void
+Publisher::processSubscriptions() noexcept {
+  while (true) {
+    auto msg = sock_.recvOne();
+    if (msg.hasError()) {
+      if (msg.error().errNum != EAGAIN) {
+        LOG(ERROR) << "Publisher: Failed to receive subscription. "
+                   << msg.error();
+      }
+      return;
+    }
+
+    // First byte tells subscription (1) from unsubscription (0), rest is
+    // topic. Anything else is plain data sent by XSUB peers.
+    const auto data = msg->data();
+    if (data.empty() or data[0] > 1) {
+      continue;
+    }
+    std::string topic(
+        reinterpret_cast<const char*>(data.data()) + 1, data.size() - 1);
+    const auto length = topic.size();
+    if (data[0] == 1) {
+      if (topics_.insert(std::move(topic)).second) {
+        ++numTopicsByLength_[length];
+      }
+      continue;
+    }
+    if (topics_.erase(topic)) {
+      auto it = numTopicsByLength_.find(length);
+      if (--it->second == 0) {
+        numTopicsByLength_.erase(it);
+      }
+    }
+  }
+}
+
+bool
+Publisher::hasSubscribers() noexcept {
+  processSubscriptions();
+  return not topics_.empty();
+}
+
+bool
+Publisher::hasSubscribers(folly::StringPiece topic) noexcept {
+  processSubscriptions();
+  for (auto const& kv : numTopicsByLength_) {
+    if (kv.first > topic.size()) {
+      break;
+    }
+    if (topics_.count(topic.subpiece(0, kv.first))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+folly::Expected<bool, Error>
+Publisher::send(Message msg) noexcept {
+  auto ret = sock_.sendOne(std::move(msg));
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  ++stats_.numPublished;
+  return true;
+}
+
+folly::Expected<bool, Error>
+Publisher::send(folly::StringPiece topic, Message msg) noexcept {
+  auto topicMsg = Message::from(topic);
+  if (topicMsg.hasError()) {
+    return folly::makeUnexpected(topicMsg.error());
+  }
+  auto ret = sock_.sendMultiple(std::move(topicMsg.value()), std::move(msg));
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  ++stats_.numPublished;
+  return true;
+}
+
+} // namespace fbzmq
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <folly/Expected.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+#include <folly/container/F14Set.h>
+
+#include <fbzmq/zmq/Common.h>
+#include <fbzmq/zmq/Context.h>
+#include <fbzmq/zmq/Message.h>
+#include <fbzmq/zmq/Socket.h>
+
+namespace fbzmq {
+
+/**
+ * Publisher which knows its subscriptions. It publishes over an XPUB socket
+ * and keeps track of the topics subscribed to by live subscribers, so that
+ * publications nobody subscribed to are neither built nor serialized. It is a
+ * drop-in replacement for a PUB socket, subscribers use SUB sockets as usual.
+ *
+ *  Publisher publisher(context);
+ *  publisher.bind(SocketUrl{"tcp://[::]:5555"}).value();
+ *  publisher.publish("stats", [&] {
+ *    return Message::fromThriftObj(stats, serializer);
+ *  });
+ *
+ * Subscriptions arrive as messages on socket. They are read off before every
+ * check, hence publisher is as up to date as the socket's own filtering.
+ * Owners should also call `processSubscriptions()` whenever socket becomes
+ * readable (e.g. via `ZmqEventLoop::addSocket`) to keep its queue drained.
+ *
+ * Publisher does not do any locking and must be used from a single thread.
+ */
+class Publisher {
+ public:
+  struct Stats {
+    // Publications built and sent
+    uint64_t numPublished{0};
+
+    // Publications skipped for lack of matching subscriptions
+    uint64_t numSkipped{0};
+  };
+
+  explicit Publisher(
+      Context& ctx,
+      folly::Optional<IdentityString> identity = folly::none,
+      folly::Optional<KeyPair> keyPair = folly::none);
+
+  /**
+   * non-copyable and non-movable
+   */
+  Publisher(Publisher const&) = delete;
+  Publisher& operator=(Publisher const&) = delete;
+
+  folly::Expected<folly::Unit, Error>
+  bind(SocketUrl url) noexcept {
+    return sock_.bind(std::move(url));
+  }
+
+  folly::Expected<folly::Unit, Error>
+  setSockOpt(int option, const void* optval, size_t len) noexcept {
+    return sock_.setSockOpt(option, optval, len);
+  }
+
+  /**
+   * Raw socket, e.g. for polling on subscription messages
+   */
+  uintptr_t
+  operator*() {
+    return *sock_;
+  }
+
+  /**
+   * Read off all pending subscription messages
+   */
+  void processSubscriptions() noexcept;
+
+  /**
+   * Is there any subscription at all. Topic of single-frame publications is
+   * their content, hence any subscription might match.
+   */
+  bool hasSubscribers() noexcept;
+
+  /**
+   * Is there a subscription matching topic, i.e. prefix of topic
+   */
+  bool hasSubscribers(folly::StringPiece topic) noexcept;
+
+  /**
+   * Publish single-frame message returned by `build` (returning
+   * `folly::Expected<Message, Error>`), if there is any subscription.
+   *
+   * @returns: true if message was built and sent, false if skipped
+   */
+  template <typename Builder>
+  folly::Expected<bool, Error>
+  publish(Builder&& build) noexcept {
+    if (not hasSubscribers()) {
+      ++stats_.numSkipped;
+      return false;
+    }
+    auto msg = build();
+    if (msg.hasError()) {
+      return folly::makeUnexpected(msg.error());
+    }
+    return send(std::move(msg.value()));
+  }
+
+  /**
+   * Publish `[topic, body]`, where body is returned by `build`, if there is a
+   * subscription matching topic.
+   *
+   * @returns: true if message was built and sent, false if skipped
+   */
+  template <typename Builder>
+  folly::Expected<bool, Error>
+  publish(folly::StringPiece topic, Builder&& build) noexcept {
+    if (not hasSubscribers(topic)) {
+      ++stats_.numSkipped;
+      return false;
+    }
+    auto msg = build();
+    if (msg.hasError()) {
+      return folly::makeUnexpected(msg.error());
+    }
+    return send(topic, std::move(msg.value()));
+  }
+
+  /**
+   * Topics of live subscriptions
+   */
+  folly::F14FastSet<std::string> const&
+  getTopics() const {
+    return topics_;
+  }
+
+  Stats
+  getStats() const {
+    return stats_;
+  }
+
+ private:
+  folly::Expected<bool, Error> send(Message msg) noexcept;
+  folly::Expected<bool, Error> send(
+      folly::StringPiece topic, Message msg) noexcept;
+
+  Socket<ZMQ_XPUB, ZMQ_SERVER, NonBlockingIo> sock_;
+
+  // Subscribed topics, along with number of topics of every length for
+  // matching prefixes of a topic. XPUB delivers a subscription only for the
+  // first subscriber of a topic and unsubscription for the last one, hence a
+  // set of topics is enough.
+  folly::F14FastSet<std::string> topics_;
+  std::map<size_t, size_t> numTopicsByLength_;
+
+  Stats stats_;
+};
+
+} // namespace fbzmq
@@ -7,12 +7,148 @@
 
 #include <fbzmq/zmq/Socket.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include <folly/Random.h>
+#include <folly/ScopeGuard.h>
 #include <folly/fibers/EventBaseLoopController.h>
+#include <folly/lang/Bits.h>
 #include <folly/net/NetworkSocket.h>
 
 namespace fbzmq {
+
+namespace {
+
+// Trace frame, integers are big endian
+//  [0..3]   magic
+//  [4]      version
+//  [5]      flags, bit 0 set if sampled
+//  [6..7]   hop
+//  [8..15]  trace id
+//  [16..23] origin time, microseconds since epoch
+//  [24..31] send time, microseconds since epoch
+const uint8_t kTraceMagic[4] = {0xFB, 0x5A, 0x54, 0x43};
+const uint8_t kTraceVersion{1};
+const uint8_t kTraceSampledFlag{0x01};
+const size_t kTraceFrameSize{32};
+
+template <typename T>
+void
+writeBE(uint8_t* buf, T value) {
+  value = folly::Endian::big(value);
+  std::memcpy(buf, &value, sizeof(value));
+}
+
+template <typename T>
+T
+readBE(const uint8_t* buf) {
+  T value;
+  std::memcpy(&value, buf, sizeof(value));
+  return folly::Endian::big(value);
+}
+
+int64_t
+toEpochUs(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+std::chrono::system_clock::time_point
+fromEpochUs(int64_t us) {
+  return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::microseconds(us)));
+}
+
+Message
+encodeTrace(TraceContext const& context) {
+  auto msg = Message::allocate(kTraceFrameSize).value();
+  auto buf = msg.writeableData().data();
+  std::memcpy(buf, kTraceMagic, sizeof(kTraceMagic));
+  buf[4] = kTraceVersion;
+  buf[5] = context.isSampled ? kTraceSampledFlag : 0;
+  writeBE<uint16_t>(buf + 6, context.hop);
+  writeBE<uint64_t>(buf + 8, context.traceId);
+  writeBE<int64_t>(buf + 16, toEpochUs(context.originTime));
+  writeBE<int64_t>(buf + 24, toEpochUs(context.sendTime));
+  return msg;
+}
+
+folly::Optional<TraceContext>
+decodeTrace(Message const& msg) {
+  auto data = msg.data();
+  if (data.size() != kTraceFrameSize or
+      std::memcmp(data.data(), kTraceMagic, sizeof(kTraceMagic)) != 0 or
+      data[4] != kTraceVersion) {
+    return folly::none;
+  }
+  TraceContext context;
+  context.isSampled = data[5] & kTraceSampledFlag;
+  context.hop = readBE<uint16_t>(data.data() + 6);
+  context.traceId = readBE<uint64_t>(data.data() + 8);
+  context.originTime = fromEpochUs(readBE<int64_t>(data.data() + 16));
+  context.sendTime = fromEpochUs(readBE<int64_t>(data.data() + 24));
+  return context;
+}
+
+} // namespace
+
+std::unordered_map<std::string, int64_t>
+SocketStats::getCounters(std::string const& prefix) const {
+  std::unordered_map<std::string, int64_t> counters;
+  counters[prefix + ".msgs_sent"] = numMsgsSent;
+  counters[prefix + ".bytes_sent"] = numBytesSent;
+  counters[prefix + ".more_msgs_sent"] = numMoreMsgsSent;
+  counters[prefix + ".msgs_recvd"] = numMsgsRecvd;
+  counters[prefix + ".bytes_recvd"] = numBytesRecvd;
+  counters[prefix + ".more_msgs_recvd"] = numMoreMsgsRecvd;
+  counters[prefix + ".send_eagain"] = numSendEagain;
+  counters[prefix + ".recv_eagain"] = numRecvEagain;
+  counters[prefix + ".send_errors"] = numSendErrors;
+  counters[prefix + ".recv_errors"] = numRecvErrors;
+
+  auto toUs = [](std::chrono::nanoseconds value) {
+    return static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(value).count());
+  };
+  auto addHistogram = [&](std::string const& name, auto const& histogram) {
+    const auto key = prefix + "." + name + "_us";
+    counters[key + ".count"] = histogram.count;
+    counters[key + ".p50"] = toUs(histogram.getPercentile(50));
+    counters[key + ".p99"] = toUs(histogram.getPercentile(99));
+    counters[key + ".max"] = toUs(histogram.max);
+  };
+  addHistogram("read_wait", readWait);
+  addHistogram("write_wait", writeWait);
+  counters[prefix + ".traces_sent"] = numTracesSent;
+  addHistogram("hop_latency", hopLatency);
+  return counters;
+}
+
 namespace detail {
 
+thread_local std::vector<void*>* tlsSocketActivity{nullptr};
+
+struct SocketImpl::TraceState {
+  SocketTraceOptions options;
+
+  // Frames ahead of the trace frame, e.g. identity on ROUTER sockets
+  size_t numSendLeadingFrames{0};
+  size_t numRecvLeadingFrames{0};
+
+  // Position in message being sent/received, and whether the trace frame
+  // has been sent/looked for
+  size_t sendFrameIndex{0};
+  bool isSendTraceDone{false};
+  size_t recvFrameIndex{0};
+  bool isRecvTraceDone{false};
+
+  folly::Optional<TraceContext> nextSendTrace;
+  folly::Optional<TraceContext> lastRecvTrace;
+};
+
 SocketImpl::SocketImpl(
     int type,
     bool isServer,
@@ -92,6 +228,9 @@ SocketImpl::~SocketImpl() noexcept {
 SocketImpl::SocketImpl(SocketImpl&& other) noexcept
     : folly::EventHandler(),
       baseFlags_(other.baseFlags_),
+      stats_(std::move(other.stats_)),
+      traceState_(std::move(other.traceState_)),
+      codec_(std::move(other.codec_)),
       ptr_(other.ptr_),
       ctxPtr_(other.ctxPtr_),
       keyPair_(std::move(other.keyPair_)),
@@ -103,6 +242,9 @@ SocketImpl::SocketImpl(SocketImpl&& other) noexcept
 SocketImpl&
 SocketImpl::operator=(SocketImpl&& other) noexcept {
   baseFlags_ = other.baseFlags_;
+  stats_ = std::move(other.stats_);
+  traceState_ = std::move(other.traceState_);
+  codec_ = std::move(other.codec_);
   ptr_ = other.ptr_;
   ctxPtr_ = other.ctxPtr_;
   keyPair_ = std::move(other.keyPair_);
@@ -182,6 +324,9 @@ SocketImpl::setKeepAlive(
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::getSockOpt(int option, void* optval, size_t* len) noexcept {
+  if (option == ZMQ_EVENTS && tlsSocketActivity) {
+    tlsSocketActivity->push_back(ptr_);
+  }
   const int rc = zmq_getsockopt(ptr_, option, optval, len);
   if (rc != 0) {
     return folly::makeUnexpected(Error());
@@ -238,6 +383,65 @@ SocketImpl::sendOneCoro(Message msg) {
   co_return send(std::move(msg), baseFlags_);
 }
 
+folly::coro::AsyncGenerator<folly::Expected<Message, Error>&&>
+SocketImpl::recvStream() {
+  CHECK(evb_);
+
+  while (true) {
+    auto ret = recv(baseFlags_);
+    if (ret.hasValue()) {
+      co_yield std::move(ret);
+      continue;
+    }
+    if (ret.error().errNum != EAGAIN) {
+      co_yield std::move(ret);
+      co_return;
+    }
+
+    // Socket is drained - Wait for socket to become readable again
+    co_await coroWaitImpl(true /* isReadElseWrite */);
+  }
+}
+
+folly::coro::AsyncGenerator<folly::Expected<std::vector<Message>, Error>&&>
+SocketImpl::recvMultipleStream() {
+  CHECK(evb_);
+
+  while (true) {
+    auto msg = recv(baseFlags_);
+    if (msg.hasError()) {
+      if (msg.error().errNum == EAGAIN) {
+        // Socket is drained - Wait for socket to become readable again
+        co_await coroWaitImpl(true /* isReadElseWrite */);
+        continue;
+      }
+      co_yield folly::Expected<std::vector<Message>, Error>(
+          folly::makeUnexpected(msg.error()));
+      co_return;
+    }
+
+    // If the first frame arrives, the rest shall have arrived, so no wait
+    std::vector<Message> msgs;
+    while (true) {
+      const bool isLast = msg->isLast();
+      msgs.emplace_back(std::move(msg.value()));
+      if (isLast) {
+        break;
+      }
+      msg = recv(baseFlags_ | ZMQ_DONTWAIT);
+      if (msg.hasError()) {
+        break;
+      }
+    }
+    if (msg.hasError()) {
+      co_yield folly::Expected<std::vector<Message>, Error>(
+          folly::makeUnexpected(msg.error()));
+      co_return;
+    }
+    co_yield folly::Expected<std::vector<Message>, Error>(std::move(msgs));
+  }
+}
+
 folly::coro::Task<void>
 SocketImpl::coroWaitImpl(bool isReadElseWrite) noexcept {
   folly::coro::Baton* waitBaton{nullptr};
@@ -251,7 +455,10 @@ SocketImpl::coroWaitImpl(bool isReadElseWrite) noexcept {
   CHECK(waitBaton);
   waitBaton->reset(); // Reset baton
   registerHandler(waitEvents_ | EventHandler::PERSIST);
+  const auto startTime = stats_ ? std::chrono::steady_clock::now()
+                                : std::chrono::steady_clock::time_point();
   co_await *waitBaton;
+  recordWait(isReadElseWrite, startTime);
   co_return;
 }
 #endif
@@ -272,6 +479,11 @@ SocketImpl::fiberWaitImpl(
   waitEvents_ |= waitEvent;
   waitBaton->reset(); // Reset baton
   registerHandler(waitEvents_ | EventHandler::PERSIST);
+  const auto startTime = stats_ ? std::chrono::steady_clock::now()
+                                : std::chrono::steady_clock::time_point();
+  SCOPE_EXIT {
+    recordWait(isReadElseWrite, startTime);
+  };
   if (timeout.has_value()) {
     const auto hasEvent = waitBaton->timed_wait(timeout.value());
     if (not hasEvent) {
@@ -290,6 +502,155 @@ SocketImpl::fiberWaitImpl(
   return true;
 }
 
+void
+SocketImpl::recordWait(
+    bool isReadElseWrite,
+    std::chrono::steady_clock::time_point startTime) noexcept {
+  // Stats might have been enabled while waiting
+  if (not stats_ or startTime == std::chrono::steady_clock::time_point()) {
+    return;
+  }
+  auto& histogram = isReadElseWrite ? stats_->readWait : stats_->writeWait;
+  histogram.addValue(std::chrono::steady_clock::now() - startTime);
+}
+
+void
+SocketImpl::setStatsEnabled(bool enabled) {
+  if (not enabled) {
+    stats_.reset();
+  } else if (not stats_) {
+    stats_ = std::make_unique<SocketStats>();
+  }
+}
+
+folly::Optional<SocketStats>
+SocketImpl::getStats() const {
+  if (not stats_) {
+    return folly::none;
+  }
+  return *stats_;
+}
+
+void
+SocketImpl::resetStats() {
+  if (stats_) {
+    *stats_ = SocketStats();
+  }
+}
+
+void
+SocketImpl::setTraceOptions(folly::Optional<SocketTraceOptions> options) {
+  if (not options) {
+    traceState_.reset();
+    return;
+  }
+
+  int type{0};
+  size_t size = sizeof(type);
+  getSockOpt(ZMQ_TYPE, &type, &size).value();
+
+  traceState_ = std::make_unique<TraceState>();
+  traceState_->options = std::move(options.value());
+  // Routing envelope and topic must remain the leading frames
+  traceState_->numSendLeadingFrames =
+      (type == ZMQ_ROUTER or type == ZMQ_PUB or type == ZMQ_XPUB) ? 1 : 0;
+  traceState_->numRecvLeadingFrames =
+      (type == ZMQ_ROUTER or type == ZMQ_SUB or type == ZMQ_XSUB) ? 1 : 0;
+}
+
+folly::Optional<TraceContext>
+SocketImpl::getLastTrace() const {
+  if (not traceState_) {
+    return folly::none;
+  }
+  return traceState_->lastRecvTrace;
+}
+
+void
+SocketImpl::continueTrace(TraceContext const& context) {
+  if (traceState_) {
+    traceState_->nextSendTrace = context;
+  }
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::sendTrace(Message const& msg, int flags) noexcept {
+  auto& state = *traceState_;
+  const bool isLast = not(flags & ZMQ_SNDMORE);
+  // Trace frame goes ahead of the first non-empty frame (or the last one),
+  // leaving empty delimiters of REQ/REP envelopes in place
+  if (state.isSendTraceDone or
+      state.sendFrameIndex < state.numSendLeadingFrames or
+      (msg.empty() and not isLast)) {
+    return folly::unit;
+  }
+
+  const auto now = std::chrono::system_clock::now();
+  TraceContext context;
+  if (state.nextSendTrace) {
+    context = state.nextSendTrace.value();
+    ++context.hop;
+  } else {
+    context.traceId = folly::Random::rand64();
+    context.isSampled =
+        folly::Random::randDouble01() < state.options.sampleRate;
+    context.originTime = now;
+  }
+  context.sendTime = now;
+
+  auto frame = encodeTrace(context);
+  auto ret = sendRaw(frame, flags | ZMQ_SNDMORE);
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
+  state.isSendTraceDone = true;
+  state.nextSendTrace.reset();
+  if (stats_) {
+    ++stats_->numTracesSent;
+  }
+  return folly::unit;
+}
+
+bool
+SocketImpl::recvTrace(Message const& msg) noexcept {
+  auto& state = *traceState_;
+  const bool isLast = msg.isLast();
+  // Mirrors placement of trace frame on send
+  const bool isCandidate = not state.isRecvTraceDone and
+      state.recvFrameIndex >= state.numRecvLeadingFrames and
+      (not msg.empty() or isLast);
+  if (state.recvFrameIndex == 0) {
+    state.lastRecvTrace.reset();
+  }
+  if (isLast) {
+    state.recvFrameIndex = 0;
+    state.isRecvTraceDone = false;
+    return false;
+  }
+  ++state.recvFrameIndex;
+  state.isRecvTraceDone = state.isRecvTraceDone or isCandidate;
+  if (not isCandidate) {
+    return false;
+  }
+
+  auto context = decodeTrace(msg);
+  if (not context) {
+    return false;
+  }
+  const auto now = std::chrono::system_clock::now();
+  state.lastRecvTrace = context;
+  if (stats_) {
+    stats_->hopLatency.addValue(std::max(
+        std::chrono::nanoseconds(0),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now - context->sendTime)));
+  }
+  if (state.options.onTrace) {
+    state.options.onTrace(context.value(), now);
+  }
+  return true;
+}
+
 void
 SocketImpl::handlerReady(uint16_t events) noexcept {
   // Event must be of our interest
@@ -370,6 +731,77 @@ SocketImpl::sendMultiple(std::vector<Message> const& msgs, bool hasMore) {
   return size += last.value();
 }
 
+folly::Expected<size_t, Error>
+SocketImpl::sendBatch(std::vector<Message>&& msgs, bool hasMore) {
+  if (msgs.empty()) {
+    return 0;
+  }
+
+  // Wait (if needed) only for the first part, rest follow right away
+  const bool isSingle = (msgs.size() == 1) && not hasMore;
+  auto first = isSingle ? sendOne(std::move(msgs.front()))
+                        : sendMore(std::move(msgs.front()));
+  if (first.hasError()) {
+    msgs.clear();
+    return folly::makeUnexpected(first.error());
+  }
+
+  size_t size = first.value();
+  for (size_t i = 1; i < msgs.size(); ++i) {
+    const bool isLast = (i == msgs.size() - 1) && not hasMore;
+    auto ret = send(
+        std::move(msgs[i]), isLast ? baseFlags_ : baseFlags_ | ZMQ_SNDMORE);
+    if (ret.hasError()) {
+      msgs.clear();
+      return folly::makeUnexpected(ret.error());
+    }
+    size += ret.value();
+  }
+  msgs.clear();
+  return size;
+}
+
+folly::Expected<size_t, Error>
+SocketImpl::sendIOBufChain(std::unique_ptr<folly::IOBuf> buf, bool hasMore) {
+  auto msgs = Message::wrapBufferChain(std::move(buf));
+  if (msgs.hasError()) {
+    return folly::makeUnexpected(msgs.error());
+  }
+
+  size_t size{0};
+  auto& frames = msgs.value();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const bool isLast = (i == frames.size() - 1) && not hasMore;
+    auto ret = isLast ? sendOne(std::move(frames[i]))
+                      : sendMore(std::move(frames[i]));
+    if (ret.hasError()) {
+      return folly::makeUnexpected(ret.error());
+    }
+    size += ret.value();
+  }
+  return size;
+}
+
+folly::Expected<std::unique_ptr<folly::IOBuf>, Error>
+SocketImpl::recvIOBufChain(
+    folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
+  auto msgs = recvMultiple(timeout);
+  if (msgs.hasError()) {
+    return folly::makeUnexpected(msgs.error());
+  }
+
+  std::unique_ptr<folly::IOBuf> head;
+  for (auto& msg : msgs.value()) {
+    auto buf = std::move(msg).toIOBuf();
+    if (head) {
+      head->prependChain(std::move(buf));
+    } else {
+      head = std::move(buf);
+    }
+  }
+  return head;
+}
+
 folly::Expected<Message, Error>
 SocketImpl::recvAsync(
     folly::Optional<std::chrono::milliseconds> timeout) noexcept {
@@ -409,26 +841,57 @@ SocketImpl::recvOne(folly::Optional<std::chrono::milliseconds>
   return folly::makeUnexpected(Error());
 }
 
-folly::Expected<std::vector<Message>, Error>
-SocketImpl::recvMultiple(
-    folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
-  std::vector<Message> result;
+void
+SocketImpl::initIoMode(bool isNonBlocking, bool needsEventBase) noexcept {
+  // Context-less socket, mode applies once moved into
+  if (not ptr_) {
+    return;
+  }
+  baseFlags_ = isNonBlocking ? ZMQ_DONTWAIT : 0;
+  CHECK(evb_ or not needsEventBase) << "I/O mode of socket needs EventBase";
+}
 
-  auto msg = recvOne(timeout);
-  if (not msg.hasValue()) {
-    return folly::makeUnexpected(msg.error());
+folly::Expected<Message, Error>
+SocketImpl::recvOneBlocking(
+    folly::Optional<std::chrono::milliseconds> timeout) noexcept {
+  if (not timeout) {
+    return recv(0);
   }
 
-  result.emplace_back(std::move(msg.value()));
+  // Poll on stack, rather than vector of fbzmq::poll()
+  zmq_pollitem_t item{ptr_, 0, ZMQ_POLLIN, 0};
+  while (true) {
+    const int rc = zmq_poll(&item, 1, timeout->count());
+    if (rc > 0) {
+      return recv(0);
+    }
+    if (rc == 0) {
+      return folly::makeUnexpected(Error(EAGAIN, "recv timeout"));
+    }
+    const int err = zmq_errno();
+    if (err != EINTR) {
+      return folly::makeUnexpected(Error(err));
+    }
+  }
+}
 
-  // as long as there is more message, we expect
-  // them to be received. this will throw if
-  // the condition does not hold
-  while (hasMore()) {
-    // if the first message arrives, the rest shall have arrived, so no timeout
-    result.emplace_back(recvOne(std::chrono::milliseconds(0)).value());
+folly::Expected<size_t, Error>
+SocketImpl::sendFiber(Message msg, int flags) noexcept {
+  // Wait only if sending first part
+  if (not isSendingMore_) {
+    fiberWaitImpl(false /* isReadElseWrite */, folly::none);
   }
+  return send(std::move(msg), flags | ZMQ_DONTWAIT);
+}
 
+folly::Expected<std::vector<Message>, Error>
+SocketImpl::recvMultiple(
+    folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
+  std::vector<Message> result;
+  auto ret = recvMultipleInto(result, timeout);
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
+  }
   return result;
 }
 
@@ -469,6 +932,49 @@ SocketImpl::drain(
   return result;
 }
 
+folly::Expected<size_t, Error>
+SocketImpl::recvBatch(
+    std::vector<Message>& frames,
+    size_t maxMessages,
+    size_t maxBytes /* = std::numeric_limits<size_t>::max() */,
+    folly::Optional<std::chrono::milliseconds> timeout /* = folly::none */) {
+  frames.clear();
+  if (maxMessages == 0) {
+    return 0;
+  }
+
+  // Only the first frame goes through the wait (poll or fiber) path
+  auto msg = recvOne(timeout);
+  if (msg.hasError()) {
+    return folly::makeUnexpected(msg.error());
+  }
+
+  size_t numMessages{0};
+  size_t numBytes{0};
+  while (true) {
+    const bool isLast = msg->isLast();
+    numBytes += msg->size();
+    frames.emplace_back(std::move(msg.value()));
+    if (isLast) {
+      ++numMessages;
+      if (numMessages >= maxMessages || numBytes >= maxBytes) {
+        break;
+      }
+    }
+
+    // Rest of the frames of a multipart message are always available. Next
+    // message is received only if it is readily available.
+    msg = recv(baseFlags_ | ZMQ_DONTWAIT);
+    if (msg.hasError()) {
+      if (isLast && msg.error().errNum == EAGAIN) {
+        break;
+      }
+      return folly::makeUnexpected(msg.error());
+    }
+  }
+  return numMessages;
+}
+
 folly::Expected<folly::Unit, Error>
 SocketImpl::bind(SocketUrl addr) noexcept {
   const int rc = zmq_bind(ptr_, static_cast<std::string>(addr).c_str());
@@ -489,14 +995,41 @@ SocketImpl::unbind(SocketUrl addr) noexcept {
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::connect(SocketUrl addr) noexcept {
+  CurveKey const* appliedServerKey{nullptr};
+  return connectImpl(addr, appliedServerKey);
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::connectMany(std::vector<SocketUrl> const& addrs) noexcept {
+  folly::Optional<Error> firstError;
+  CurveKey const* appliedServerKey{nullptr};
+  for (auto const& addr : addrs) {
+    auto ret = connectImpl(addr, appliedServerKey);
+    if (ret.hasError() and not firstError) {
+      firstError.emplace(ret.error());
+    }
+  }
+  if (firstError) {
+    return folly::makeUnexpected(*firstError);
+  }
+  return folly::unit;
+}
+
+folly::Expected<folly::Unit, Error>
+SocketImpl::connectImpl(
+    SocketUrl const& addr, CurveKey const*& appliedServerKey) noexcept {
   if (keyPair_) {
-    try {
-      auto const serverKey = serverKeys_.at(addr);
-      setCurveServerSocketKey(serverKey);
-    } catch (std::out_of_range const& err) {
+    auto it = serverKeys_.find(addr);
+    if (it == serverKeys_.end()) {
       VLOG(2) << "Crypto key for " << std::string(addr) << " not found";
       return folly::makeUnexpected(Error(EINVAL));
     }
+    // Server key option only affects subsequent connects, skip re-applying
+    // the same key on consecutive connects
+    if (not appliedServerKey or *appliedServerKey != it->second) {
+      setCurveServerSocketKey(it->second);
+      appliedServerKey = &it->second;
+    }
   }
   const int rc = zmq_connect(ptr_, static_cast<std::string>(addr).c_str());
   if (rc != 0) {
@@ -517,9 +1050,37 @@ SocketImpl::disconnect(SocketUrl addr) noexcept {
 folly::Expected<size_t, Error>
 SocketImpl::send(Message msg, int flags) noexcept {
   isSendingMore_ = flags & ZMQ_SNDMORE;
+  if (traceState_) {
+    auto ret = sendTrace(msg, flags);
+    if (ret.hasError()) {
+      return folly::makeUnexpected(ret.error());
+    }
+  }
+  auto ret = sendRaw(msg, flags);
+  if (traceState_ and ret.hasValue()) {
+    if (isSendingMore_) {
+      ++traceState_->sendFrameIndex;
+    } else {
+      traceState_->sendFrameIndex = 0;
+      traceState_->isSendTraceDone = false;
+    }
+  }
+  return ret;
+}
+
+folly::Expected<size_t, Error>
+SocketImpl::sendRaw(Message& msg, int flags) noexcept {
+  if (tlsSocketActivity) {
+    tlsSocketActivity->push_back(ptr_);
+  }
   while (true) {
     const int n = zmq_msg_send(&(msg.msg_), ptr_, flags);
     if (n >= 0) {
+      if (stats_) {
+        ++stats_->numMsgsSent;
+        stats_->numBytesSent += n;
+        stats_->numMoreMsgsSent += (flags & ZMQ_SNDMORE) ? 1 : 0;
+      }
       return n;
     }
 
@@ -528,13 +1089,21 @@ SocketImpl::send(Message msg, int flags) noexcept {
     if (err == EINTR) {
       continue;
     }
+    if (stats_) {
+      ++(err == EAGAIN ? stats_->numSendEagain : stats_->numSendErrors);
+    }
     return folly::makeUnexpected(Error(err));
   }
 }
 
 folly::Expected<folly::Unit, Error>
 SocketImpl::addServerKey(SocketUrl server, PublicKey serverPubKey) noexcept {
-  serverKeys_[server] = serverPubKey;
+  // Convert once here rather than on every connect
+  auto curveKey = util::toCurvePublicKey(serverPubKey);
+  if (curveKey.hasError()) {
+    return folly::makeUnexpected(curveKey.error());
+  }
+  serverKeys_[server] = curveKey.value();
   return folly::unit;
 }
 
@@ -547,9 +1116,21 @@ SocketImpl::delServerKey(SocketUrl server) noexcept {
 folly::Expected<Message, Error>
 SocketImpl::recv(int flags) noexcept {
   Message msg;
+  if (tlsSocketActivity) {
+    tlsSocketActivity->push_back(ptr_);
+  }
   while (true) {
     const int n = zmq_msg_recv(&(msg.msg_), ptr_, flags);
     if (n >= 0) {
+      if (stats_) {
+        ++stats_->numMsgsRecvd;
+        stats_->numBytesRecvd += n;
+        stats_->numMoreMsgsRecvd += msg.isLast() ? 0 : 1;
+      }
+      // Rest of the message is readily available after trace frame
+      if (traceState_ and recvTrace(msg)) {
+        continue;
+      }
       return msg;
     }
 
@@ -558,65 +1139,46 @@ SocketImpl::recv(int flags) noexcept {
     if (err == EINTR) {
       continue;
     }
+    if (stats_) {
+      ++(err == EAGAIN ? stats_->numRecvEagain : stats_->numRecvErrors);
+    }
     return folly::makeUnexpected(Error(err));
   }
 }
 
 folly::Expected<folly::Unit, Error>
-SocketImpl::applyKeyPair(const KeyPair& keyPair) noexcept {
+SocketImpl::applyKeyPair(KeyPair& keyPair) noexcept {
   CHECK_EQ(crypto_sign_ed25519_PUBLICKEYBYTES, keyPair.publicKey.length());
   CHECK_EQ(crypto_sign_ed25519_SECRETKEYBYTES, keyPair.privateKey.length());
 
-  // 1) string -> byte
-  std::array<uint8_t, crypto_sign_ed25519_PUBLICKEYBYTES> ed25519Pk;
-  std::array<uint8_t, crypto_sign_ed25519_SECRETKEYBYTES> ed25519Sk;
-  ::memcpy(
-      ed25519Pk.data(), keyPair.publicKey.data(), keyPair.publicKey.length());
-  ::memcpy(
-      ed25519Sk.data(), keyPair.privateKey.data(), keyPair.privateKey.length());
-
-  // 2) convert signature ed25519 key to encryption curve25519 key
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Pk;
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Sk;
-  if (::crypto_sign_ed25519_pk_to_curve25519(
-          curve25519Pk.data(), ed25519Pk.data()) != 0) {
-    return folly::makeUnexpected(Error());
-  }
-  if (::crypto_sign_ed25519_sk_to_curve25519(
-          curve25519Sk.data(), ed25519Sk.data()) != 0) {
-    return folly::makeUnexpected(Error());
+  // Convert signature ed25519 keys to encryption curve25519 keys, unless key
+  // pair has been prepared already
+  auto ret = util::prepareKeyPair(keyPair);
+  if (ret.hasError()) {
+    return folly::makeUnexpected(ret.error());
   }
+  auto const& curveKeys = *keyPair.curveKeys;
 
   // Apply secrete-key on the socket
-  setSockOpt(ZMQ_CURVE_SECRETKEY, curve25519Sk.data(), curve25519Sk.size())
+  setSockOpt(
+      ZMQ_CURVE_SECRETKEY,
+      curveKeys.secretKey.data(),
+      curveKeys.secretKey.size())
       .value();
 
   // Apply public-key on the socket
-  setSockOpt(ZMQ_CURVE_PUBLICKEY, curve25519Pk.data(), curve25519Pk.size())
+  setSockOpt(
+      ZMQ_CURVE_PUBLICKEY,
+      curveKeys.publicKey.data(),
+      curveKeys.publicKey.size())
       .value();
 
   return folly::unit;
 }
 
 void
-SocketImpl::setCurveServerSocketKey(const std::string& publicKey) noexcept {
-  CHECK_EQ(crypto_sign_ed25519_PUBLICKEYBYTES, publicKey.length());
-  // first convert signature ed25519 key to encoded encryption curve25519 key
-
-  // 1) string -> byte
-  std::array<uint8_t, crypto_sign_ed25519_PUBLICKEYBYTES> ed25519Pk;
-  ::memcpy(ed25519Pk.data(), publicKey.data(), publicKey.length());
-
-  // 2) convert signature ed25519 key to encryption curve25519 key
-  std::array<uint8_t, crypto_scalarmult_curve25519_BYTES> curve25519Pk;
-  if (::crypto_sign_ed25519_pk_to_curve25519(
-          curve25519Pk.data(), ed25519Pk.data()) != 0) {
-    return;
-  }
-
-  // 3) set server's public key
-  setSockOpt(ZMQ_CURVE_SERVERKEY, curve25519Pk.data(), curve25519Pk.size())
-      .value();
+SocketImpl::setCurveServerSocketKey(CurveKey const& serverKey) noexcept {
+  setSockOpt(ZMQ_CURVE_SERVERKEY, serverKey.data(), serverKey.size()).value();
 }
 
 } // namespace detail
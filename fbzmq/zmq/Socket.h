@@ -8,17 +8,25 @@
 #pragma once
 
 #include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/serialization/strong_typedef.hpp>
 
 #include <folly/Expected.h>
+#include <folly/Function.h>
 #if FOLLY_HAS_COROUTINES
+#include <folly/experimental/coro/AsyncGenerator.h>
 #include <folly/experimental/coro/Baton.h>
 #include <folly/experimental/coro/Task.h>
 #endif
 #include <fbzmq/zmq/Common.h>
 #include <fbzmq/zmq/Context.h>
 #include <fbzmq/zmq/Message.h>
+#include <fbzmq/zmq/MessageCodec.h>
 #include <folly/fibers/Baton.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/EventHandler.h>
@@ -41,15 +49,133 @@ BOOST_STRONG_TYPEDEF(bool, NonblockingFlag)
  */
 enum SocketMode { ZMQ_CLIENT, ZMQ_SERVER, UNKNOWN };
 
+/**
+ * I/O modes, optionally used as part of type signature of socket. By default
+ * (`DynamicIo`) mode follows constructor arguments (NonblockingFlag and
+ * EventBase) and is checked on every send/receive. Other modes are fixed at
+ * compile time, NonblockingFlag argument is ignored and send/receive go
+ * straight to the code path of mode without any branch or allocation.
+ *
+ *  Socket<ZMQ_DEALER, ZMQ_CLIENT, NonBlockingIo> sock(ctx);
+ */
+struct DynamicIo {};
+
+// Waits for socket, receive with timeout polls it
+struct BlockingIo {
+  static constexpr bool kNonBlocking{false};
+  static constexpr bool kNeedsEventBase{false};
+  static constexpr bool kFiberWait{false};
+};
+
+// Fails with EAGAIN instead of waiting
+struct NonBlockingIo {
+  static constexpr bool kNonBlocking{true};
+  static constexpr bool kNeedsEventBase{false};
+  static constexpr bool kFiberWait{false};
+};
+
+// Waits on EventBase from within a fiber, EventBase must be given
+struct FiberIo {
+  static constexpr bool kNonBlocking{true};
+  static constexpr bool kNeedsEventBase{true};
+  static constexpr bool kFiberWait{true};
+};
+
+// Waits on EventBase with recvOneCoro/sendOneCoro, EventBase must be given.
+// recvOne/sendOne don't wait, like with NonBlockingIo.
+struct CoroutineIo {
+  static constexpr bool kNonBlocking{true};
+  static constexpr bool kNeedsEventBase{true};
+  static constexpr bool kFiberWait{false};
+};
+
 /**
  * Forward declaration of socket. Defined via `SocketImpl`.
  * e.g of SocketType are ZMQ_PUB, ZMQ_ROUTER etc.
  */
-template <int SocketType, int SocketMode = UNKNOWN>
+template <int SocketType, int SocketMode = UNKNOWN, typename IoMode = DynamicIo>
 class Socket;
 
+/**
+ * Per-socket I/O stats, maintained only if enabled on socket via
+ * `SocketImpl::setStatsEnabled`. Frames are counted individually, i.e. a
+ * multipart message of three frames counts as three messages of which two
+ * are `more` frames.
+ */
+struct SocketStats {
+  uint64_t numMsgsSent{0};
+  uint64_t numBytesSent{0};
+  uint64_t numMoreMsgsSent{0};
+  uint64_t numMsgsRecvd{0};
+  uint64_t numBytesRecvd{0};
+  uint64_t numMoreMsgsRecvd{0};
+
+  // Sends/receives which failed with EAGAIN. For sends that is mostly high
+  // water mark being hit (or no peer) on a non-blocking socket.
+  uint64_t numSendEagain{0};
+  uint64_t numRecvEagain{0};
+
+  // Sends/receives which failed with any other error, e.g. EHOSTUNREACH on
+  // ROUTER sockets
+  uint64_t numSendErrors{0};
+  uint64_t numRecvErrors{0};
+
+  // Time spent by fibers/coroutines waiting for socket to become readable
+  // or writable
+  LatencyHistogram readWait;
+  LatencyHistogram writeWait;
+
+  // Latency of traced messages from the previous hop, refer to
+  // `SocketImpl::setTraceOptions`
+  uint64_t numTracesSent{0};
+  LatencyHistogram hopLatency;
+
+  /**
+   * Flat counters of stats with given key prefix, e.g.
+   * `<prefix>.bytes_sent`. Can be published via `ThreadData::setCounters`.
+   */
+  std::unordered_map<std::string, int64_t> getCounters(
+      std::string const& prefix) const;
+};
+
+/**
+ * Trace context carried by traced messages in a frame ahead of the payload,
+ * refer to `SocketImpl::setTraceOptions`. Times are of the system clock, hence
+ * latencies across hosts are only as accurate as the clock synchronization.
+ */
+struct TraceContext {
+  // Shared by all hops of a message through a pipeline
+  uint64_t traceId{0};
+  // Incremented on every hop, 0 on the socket which started the trace
+  uint16_t hop{0};
+  // Traces are sampled by the socket which starts them
+  bool isSampled{false};
+  // Time the trace was started, and time message was sent on this hop
+  std::chrono::system_clock::time_point originTime;
+  std::chrono::system_clock::time_point sendTime;
+};
+
+struct SocketTraceOptions {
+  // Fraction of the traces started by this socket which are sampled
+  double sampleRate{0.01};
+
+  // Invoked for every traced message received, along with time of receive.
+  // e.g. `TraceReporter::getCallback()` to export it.
+  folly::Function<void(
+      TraceContext const&, std::chrono::system_clock::time_point)>
+      onTrace;
+};
+
 namespace detail {
 
+/**
+ * If set, every I/O (send/recv/ZMQ_EVENTS query) performed by SocketImpl on
+ * the current thread records the raw zmq socket pointer in this list. Such an
+ * I/O can consume the edge signalled on ZMQ_FD of the socket. ZmqEventLoop
+ * with EPOLL backend sets this while running to re-check those sockets.
+ */
+extern thread_local std::vector<void*>* tlsSocketActivity;
+
 /**
  * This is not expected to be used directly. Rather, the descdendant template
  * Socket<> should be used instead
@@ -145,6 +271,31 @@ class SocketImpl : public folly::EventHandler {
    * socket is not writable
    */
   folly::coro::Task<folly::Expected<size_t, Error>> sendOneCoro(Message msg);
+
+  /**
+   * Stream of received messages in a co-routine. All readily available
+   * messages are yielded back to back, coroutine is suspended only once the
+   * socket has been drained (i.e. recv returned EAGAIN, which also re-arms
+   * edge on ZMQ_FD). This amortizes suspend/resume over bursts compared to
+   * calling `recvOneCoro()` per message.
+   *
+   * Stream ends after yielding an error, e.g. when socket is closed. Socket
+   * must outlive the generator.
+   *
+   *  auto stream = sock.recvStream();
+   *  while (auto item = co_await stream.next()) {
+   *    auto msg = std::move(*item);
+   *    ...
+   *  }
+   */
+  folly::coro::AsyncGenerator<folly::Expected<Message, Error>&&> recvStream();
+
+  /**
+   * Same as above but yields whole multipart messages (all frames till the
+   * one without more flag)
+   */
+  folly::coro::AsyncGenerator<folly::Expected<std::vector<Message>, Error>&&>
+  recvMultipleStream();
 #endif
 
   /**
@@ -220,6 +371,41 @@ class SocketImpl : public folly::EventHandler {
   folly::Expected<std::vector<Message>, Error> recvMultiple(
       folly::Optional<std::chrono::milliseconds> timeout = folly::none);
 
+  /**
+   * Same as above, but frames are received into the caller-provided container
+   * (e.g. `folly::small_vector<Message, N>`) which is cleared first. Re-using
+   * the container across calls avoids heap allocations in steady state.
+   *
+   * Returns number of frames received. Error on any of the continuation frames
+   * is reported as well, in which case `msgs` holds the frames received so far.
+   */
+  template <typename Container>
+  folly::Expected<size_t, Error>
+  recvMultipleInto(
+      Container& msgs,
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none) {
+    msgs.clear();
+
+    auto msg = recvOne(timeout);
+    if (msg.hasError()) {
+      return folly::makeUnexpected(msg.error());
+    }
+
+    while (true) {
+      const bool isLast = msg->isLast();
+      msgs.emplace_back(std::move(msg.value()));
+      if (isLast) {
+        break;
+      }
+      // if the first message arrives, the rest shall have arrived, so no wait
+      msg = recv(baseFlags_ | ZMQ_DONTWAIT);
+      if (msg.hasError()) {
+        return folly::makeUnexpected(msg.error());
+      }
+    }
+    return msgs.size();
+  }
+
   /**
    * Receive all pending messages on socket (till socket return EAGAIN)
    * This will return an error if one of the message recv returns unexpected
@@ -228,6 +414,26 @@ class SocketImpl : public folly::EventHandler {
   folly::Expected<std::vector<Message>, Error> drain(
       folly::Optional<std::chrono::milliseconds> timeout = folly::none);
 
+  /**
+   * Receive up to `maxMessages` complete multipart messages in a single call.
+   * Frames of all messages are stored back to back in `frames` (which is
+   * cleared first, retaining its capacity, so that it can be reused across
+   * calls). Boundaries of messages can be identified by `Message::isLast()`.
+   *
+   * Only the first frame honours the timeout, the rest are received only if
+   * they are readily available. Receiving stops after the message which
+   * takes total size of frames to `maxBytes` or beyond.
+   *
+   * Returns number of complete messages received. On an error in the middle
+   * of a multipart message, error is returned and `frames` contains the
+   * frames received so far.
+   */
+  folly::Expected<size_t, Error> recvBatch(
+      std::vector<Message>& frames,
+      size_t maxMessages,
+      size_t maxBytes = std::numeric_limits<size_t>::max(),
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
   /**
    * Send has two modes: first one ships standalone message the second one sets
    * the "more" flag, allowing for atomic message chaining
@@ -280,7 +486,31 @@ class SocketImpl : public folly::EventHandler {
       std::vector<Message> const& msgs, bool hasMore = false);
 
   /**
-   * Convenience methods to recv/send thrift objects as messages
+   * Same as above, but frames are moved instead of copied. `msgs` is cleared
+   * after send so that it can be re-used.
+   */
+  folly::Expected<size_t, Error> sendBatch(
+      std::vector<Message>&& msgs, bool hasMore = false);
+
+  /**
+   * Zero-copy send/receive of IOBuf chains.
+   *
+   * `sendIOBufChain` ships every buffer of chain as a separate frame of a
+   * multipart message without copying (or coalescing) it. Pass `hasMore` if
+   * more frames are to follow.
+   *
+   * `recvIOBufChain` receives all frames of a multipart message and chains
+   * them as IOBufs which reference the received frames without copying.
+   */
+  folly::Expected<size_t, Error> sendIOBufChain(
+      std::unique_ptr<folly::IOBuf> buf, bool hasMore = false);
+
+  folly::Expected<std::unique_ptr<folly::IOBuf>, Error> recvIOBufChain(
+      folly::Optional<std::chrono::milliseconds> timeout = folly::none);
+
+  /**
+   * Convenience methods to recv/send thrift objects as messages. Objects are
+   * compressed/decompressed with codec of socket if one is set.
    */
 
   template <typename ThriftType, typename Serializer>
@@ -290,6 +520,9 @@ class SocketImpl : public folly::EventHandler {
       folly::Optional<std::chrono::milliseconds> timeout =
           folly::none) noexcept {
     auto maybeMessage = recvOne(timeout);
+    if (maybeMessage.hasValue() and codec_) {
+      maybeMessage = codec_->decompress(std::move(maybeMessage.value()));
+    }
 
     return maybeMessage.hasError()
         ? folly::makeUnexpected(maybeMessage.error())
@@ -300,10 +533,109 @@ class SocketImpl : public folly::EventHandler {
   folly::Expected<size_t, Error>
   sendThriftObj(const ThriftType& obj, Serializer& serializer) noexcept {
     auto msg = Message::fromThriftObj(obj, serializer);
+    if (msg.hasValue() and codec_) {
+      msg = codec_->compress(std::move(msg.value()));
+    }
+    return msg.hasError() ? folly::makeUnexpected(msg.error())
+                          : sendOne(std::move(msg.value()));
+  }
+
+  /**
+   * Typed handoff of heap objects between threads of the process over
+   * `inproc://` sockets, without serialization. Refer to
+   * `Message::fromObject()`. Object is destroyed if send fails. Receive fails
+   * with EINVAL if object is not of the expected type (and is destroyed).
+   */
+  template <typename T>
+  folly::Expected<std::unique_ptr<T>, Error>
+  recvObject(
+      folly::Optional<std::chrono::milliseconds> timeout =
+          folly::none) noexcept {
+    auto maybeMessage = recvOne(timeout);
+    return maybeMessage.hasError()
+        ? folly::makeUnexpected(maybeMessage.error())
+        : maybeMessage.value().releaseObject<T>();
+  }
+
+  template <typename T>
+  folly::Expected<size_t, Error>
+  sendObject(std::unique_ptr<T> obj) noexcept {
+    auto msg = Message::fromObject(std::move(obj));
     return msg.hasError() ? folly::makeUnexpected(msg.error())
-                          : sendOne(msg.value());
+                          : sendOne(std::move(msg.value()));
+  }
+
+  /**
+   * Set codec for compressing thrift objects sent/received via
+   * `sendThriftObj`/`recvThriftObj`, nullptr to unset. Receivers detect
+   * compressed frames, hence a receiving socket with any codec can read
+   * uncompressed objects as well. Codec is not thread safe, share it only
+   * among sockets of the same thread.
+   */
+  void
+  setCodec(std::shared_ptr<MessageCodec> codec) {
+    codec_ = std::move(codec);
+  }
+
+  std::shared_ptr<MessageCodec> const&
+  getCodec() const {
+    return codec_;
+  }
+
+  /**
+   * Enable/disable per-socket I/O stats. Disabled by default. Disabling
+   * discards stats recorded so far.
+   */
+  void setStatsEnabled(bool enabled);
+
+  /**
+   * Snapshot of I/O stats, none if stats are not enabled
+   */
+  folly::Optional<SocketStats> getStats() const;
+
+  void resetStats();
+
+  /**
+   * Enable tracing of messages, none to disable. Disabled by default.
+   *
+   * Every message sent carries a 32 bytes trace frame (trace id, hop and send
+   * timestamp) ahead of its first non-empty frame, i.e. after routing
+   * envelope of ROUTER sockets and after topic of PUB sockets. The trace frame
+   * of received messages is stripped, latency since previous hop recorded in
+   * `SocketStats::hopLatency` and reported to `onTrace`. Messages received
+   * without trace frame are passed through as is.
+   *
+   * Sockets at both ends must have tracing enabled, peers without tracing
+   * receive trace frame as part of the message. Messages of a single frame
+   * can't be traced on PUB/ROUTER sockets as they have no frame after topic/
+   * identity.
+   *
+   * Sent messages start a new trace unless `continueTrace()` has been called,
+   * e.g. to forward a message received on another socket as the next hop.
+   *
+   *  auto msgs = frontend.recvMultiple().value();
+   *  if (auto const& trace = frontend.getLastTrace()) {
+   *    backend.continueTrace(*trace);
+   *  }
+   *  backend.sendMultiple(msgs);
+   */
+  void setTraceOptions(folly::Optional<SocketTraceOptions> options);
+
+  bool
+  isTracingEnabled() const {
+    return traceState_ != nullptr;
   }
 
+  /**
+   * Trace context of the message last received, none if it wasn't traced
+   */
+  folly::Optional<TraceContext> getLastTrace() const;
+
+  /**
+   * Send next message as the next hop of given trace
+   */
+  void continueTrace(TraceContext const& context);
+
   /**
    * Return true if there are more parts of a message pending on the socket
    */
@@ -345,6 +677,9 @@ class SocketImpl : public folly::EventHandler {
 
   folly::Expected<folly::Unit, Error> connect(SocketUrl) noexcept;
 
+  folly::Expected<folly::Unit, Error> connectMany(
+      std::vector<SocketUrl> const&) noexcept;
+
   folly::Expected<folly::Unit, Error> disconnect(SocketUrl) noexcept;
 
   folly::Expected<folly::Unit, Error> addServerKey(
@@ -352,6 +687,33 @@ class SocketImpl : public folly::EventHandler {
 
   folly::Expected<folly::Unit, Error> delServerKey(SocketUrl) noexcept;
 
+  /**
+   * Send/receive of sockets with I/O mode fixed at compile time, see
+   * `IoModeSocketImpl`. No checks of mode at runtime.
+   */
+
+  void initIoMode(bool isNonBlocking, bool needsEventBase) noexcept;
+
+  folly::Expected<Message, Error> recvOneBlocking(
+      folly::Optional<std::chrono::milliseconds> timeout) noexcept;
+
+  folly::Expected<Message, Error>
+  recvOneNonBlocking() noexcept {
+    return recv(ZMQ_DONTWAIT);
+  }
+
+  folly::Expected<Message, Error>
+  recvOneFiber(folly::Optional<std::chrono::milliseconds> timeout) noexcept {
+    return recvAsync(timeout);
+  }
+
+  folly::Expected<size_t, Error>
+  sendWithFlags(Message msg, int flags) noexcept {
+    return send(std::move(msg), flags);
+  }
+
+  folly::Expected<size_t, Error> sendFiber(Message msg, int flags) noexcept;
+
  private:
   friend class fbzmq::SocketMonitor;
 
@@ -362,11 +724,25 @@ class SocketImpl : public folly::EventHandler {
       bool isReadElseWrite,
       folly::Optional<std::chrono::milliseconds> timeout) noexcept;
 
+  /**
+   * Connect to url. Server key of url is applied unless it is the one
+   * applied by the previous connect, as tracked by `appliedServerKey`.
+   */
+  folly::Expected<folly::Unit, Error> connectImpl(
+      SocketUrl const& addr, CurveKey const*& appliedServerKey) noexcept;
+
   /**
    * Utility function to initialize handler
    */
   void initHandlerHelper() noexcept;
 
+  /**
+   * Record wait for socket events in stats
+   */
+  void recordWait(
+      bool isReadElseWrite,
+      std::chrono::steady_clock::time_point startTime) noexcept;
+
   /**
    * EventHandler callback. Unblocks read/write wait
    */
@@ -376,6 +752,19 @@ class SocketImpl : public folly::EventHandler {
    * low-level send method
    */
   folly::Expected<size_t, Error> send(Message msg, int flags) noexcept;
+  folly::Expected<size_t, Error> sendRaw(Message& msg, int flags) noexcept;
+
+  /**
+   * Send trace frame ahead of `msg` if it is due
+   */
+  folly::Expected<folly::Unit, Error> sendTrace(
+      Message const& msg, int flags) noexcept;
+
+  /**
+   * Consume `msg` if it is the trace frame of the message being received.
+   * Returns true if so.
+   */
+  bool recvTrace(Message const& msg) noexcept;
 
   /**
    * low-level recv method
@@ -389,20 +778,30 @@ class SocketImpl : public folly::EventHandler {
    */
 
   /**
-   * generate and apply certificate to the socket
+   * generate and apply certificate to the socket. Curve25519 keys get cached
+   * in key pair.
    */
-  folly::Expected<folly::Unit, Error> applyKeyPair(
-      const KeyPair& keyPair) noexcept;
+  folly::Expected<folly::Unit, Error> applyKeyPair(KeyPair& keyPair) noexcept;
 
   /**
    * attach server key to the socket
    */
-  void setCurveServerSocketKey(const std::string& publicKey) noexcept;
+  void setCurveServerSocketKey(CurveKey const& serverKey) noexcept;
 
   // used to store ZMQ_DONTWAIT
   int baseFlags_{0};
   bool isSendingMore_{false};
 
+  // I/O stats, only allocated if enabled
+  std::unique_ptr<SocketStats> stats_;
+
+  // Tracing state, only allocated if enabled
+  struct TraceState;
+  std::unique_ptr<TraceState> traceState_;
+
+  // Codec for thrift objects, if any
+  std::shared_ptr<MessageCodec> codec_;
+
   // pointer to socket object. alas, this can not be const
   // since we update it in move constructor
   void* ptr_{nullptr};
@@ -414,9 +813,8 @@ class SocketImpl : public folly::EventHandler {
   // the crypto key pair.
   folly::Optional<KeyPair> keyPair_;
 
-  // public keys for use with servers
-  std::unordered_map<std::string /* server url */, std::string /* pub key */>
-      serverKeys_;
+  // public keys for use with servers, in curve25519 form
+  std::unordered_map<std::string /* server url */, CurveKey> serverKeys_;
 
   //
   // Asynchronous read/write primitives
@@ -476,6 +874,16 @@ class ClientSocketImpl : public SocketImpl {
     return SocketImpl::connect(std::move(url));
   }
 
+  /**
+   * Connect to many urls at once, e.g. on mass reconnects. Attempts all the
+   * urls and returns the first error, if any. Urls without error remain
+   * connected.
+   */
+  folly::Expected<folly::Unit, Error>
+  connectMany(std::vector<SocketUrl> const& urls) noexcept {
+    return SocketImpl::connectMany(urls);
+  }
+
   folly::Expected<folly::Unit, Error>
   disconnect(SocketUrl url) noexcept {
     return SocketImpl::disconnect(std::move(url));
@@ -496,26 +904,136 @@ class ClientSocketImpl : public SocketImpl {
   }
 };
 
+constexpr bool
+canSend(int socketType) {
+  return socketType != ZMQ_SUB and socketType != ZMQ_PULL;
+}
+
+constexpr bool
+canRecv(int socketType) {
+  return socketType != ZMQ_PUB and socketType != ZMQ_PUSH;
+}
+
+/**
+ * Send/receive per I/O mode, on top of server/client sockets. Operations
+ * invalid for socket type (e.g. receiving on PUB) fail to compile.
+ */
+template <typename Base, int SocketType, typename IoMode>
+class IoModeSocketImpl : public Base {
+ public:
+  template <typename... Args>
+  explicit IoModeSocketImpl(Args&&... args)
+      : Base(std::forward<Args>(args)...) {
+    this->initIoMode(IoMode::kNonBlocking, IoMode::kNeedsEventBase);
+  }
+
+  folly::Expected<Message, Error>
+  recvOne(folly::Optional<std::chrono::milliseconds> timeout =
+              folly::none) noexcept {
+    static_assert(canRecv(SocketType), "Socket type can't receive");
+    if constexpr (IoMode::kFiberWait) {
+      return this->recvOneFiber(timeout);
+    } else if constexpr (IoMode::kNonBlocking) {
+      return this->recvOneNonBlocking();
+    } else {
+      return this->recvOneBlocking(timeout);
+    }
+  }
+
+  folly::Expected<size_t, Error>
+  sendOne(Message msg) noexcept {
+    static_assert(canSend(SocketType), "Socket type can't send");
+    return sendImpl(std::move(msg), 0);
+  }
+
+  folly::Expected<size_t, Error>
+  sendMore(Message msg) noexcept {
+    static_assert(canSend(SocketType), "Socket type can't send");
+    return sendImpl(std::move(msg), ZMQ_SNDMORE);
+  }
+
+#if FOLLY_HAS_COROUTINES
+  folly::coro::Task<folly::Expected<Message, Error>>
+  recvOneCoro() {
+    static_assert(canRecv(SocketType), "Socket type can't receive");
+    static_assert(IoMode::kNeedsEventBase, "Coroutines need EventBase");
+    return Base::recvOneCoro();
+  }
+
+  folly::coro::Task<folly::Expected<size_t, Error>>
+  sendOneCoro(Message msg) {
+    static_assert(canSend(SocketType), "Socket type can't send");
+    static_assert(IoMode::kNeedsEventBase, "Coroutines need EventBase");
+    return Base::sendOneCoro(std::move(msg));
+  }
+#endif
+
+ private:
+  folly::Expected<size_t, Error>
+  sendImpl(Message msg, int flags) noexcept {
+    if constexpr (IoMode::kFiberWait) {
+      return this->sendFiber(std::move(msg), flags);
+    } else {
+      return this->sendWithFlags(
+          std::move(msg), flags | (IoMode::kNonBlocking ? ZMQ_DONTWAIT : 0));
+    }
+  }
+};
+
+/**
+ * Mode checked at runtime, as set up by constructor arguments
+ */
+template <typename Base, int SocketType>
+class IoModeSocketImpl<Base, SocketType, DynamicIo> : public Base {
+ public:
+  using Base::Base;
+
+  folly::Expected<Message, Error>
+  recvOne(folly::Optional<std::chrono::milliseconds> timeout =
+              folly::none) noexcept {
+    static_assert(canRecv(SocketType), "Socket type can't receive");
+    return Base::recvOne(timeout);
+  }
+
+  folly::Expected<size_t, Error>
+  sendOne(Message msg) noexcept {
+    static_assert(canSend(SocketType), "Socket type can't send");
+    return Base::sendOne(std::move(msg));
+  }
+
+  folly::Expected<size_t, Error>
+  sendMore(Message msg) noexcept {
+    static_assert(canSend(SocketType), "Socket type can't send");
+    return Base::sendMore(std::move(msg));
+  }
+};
+
 } // namespace detail
 
 /**
  * Define specializations for SERVER/CLIENT sockets
  */
 
-template <int SocketType>
-class Socket<SocketType, ZMQ_SERVER> : public detail::ServerSocketImpl {
+template <int SocketType, typename IoMode>
+class Socket<SocketType, ZMQ_SERVER, IoMode>
+    : public detail::
+          IoModeSocketImpl<detail::ServerSocketImpl, SocketType, IoMode> {
  public:
   template <typename... Args>
   explicit Socket(Args&&... args)
-      : ServerSocketImpl(SocketType, true, std::forward<Args>(args)...) {}
+      : detail::IoModeSocketImpl<detail::ServerSocketImpl, SocketType, IoMode>(
+            SocketType, true, std::forward<Args>(args)...) {}
 };
 
-template <int SocketType>
-class Socket<SocketType, ZMQ_CLIENT> : public detail::ClientSocketImpl {
+template <int SocketType, typename IoMode>
+class Socket<SocketType, ZMQ_CLIENT, IoMode>
+    : public detail::
+          IoModeSocketImpl<detail::ClientSocketImpl, SocketType, IoMode> {
  public:
   template <typename... Args>
   explicit Socket(Args&&... args)
-      : ClientSocketImpl(SocketType, false, std::forward<Args>(args)...) {}
+      : detail::IoModeSocketImpl<detail::ClientSocketImpl, SocketType, IoMode>(
+            SocketType, false, std::forward<Args>(args)...) {}
 };
 
 } // namespace fbzmq
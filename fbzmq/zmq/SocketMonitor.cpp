@@ -7,8 +7,84 @@
 
 #include <fbzmq/zmq/SocketMonitor.h>
 
+#include <cstring>
+
 namespace fbzmq {
 
+namespace {
+
+folly::Optional<SocketMonitorMessage>
+toMonitorMessage(uint16_t event) {
+  switch (event) {
+  case ZMQ_EVENT_CONNECTED:
+    return SocketMonitorMessage::CONNECTED;
+  case ZMQ_EVENT_CONNECT_DELAYED:
+    return SocketMonitorMessage::CONNECT_DELAYED;
+  case ZMQ_EVENT_CONNECT_RETRIED:
+    return SocketMonitorMessage::CONNECT_RETRIED;
+  case ZMQ_EVENT_LISTENING:
+    return SocketMonitorMessage::LISTENING;
+  case ZMQ_EVENT_BIND_FAILED:
+    return SocketMonitorMessage::BIND_FAILED;
+  case ZMQ_EVENT_ACCEPTED:
+    return SocketMonitorMessage::ACCEPTED;
+  case ZMQ_EVENT_ACCEPT_FAILED:
+    return SocketMonitorMessage::ACCEPT_FAILED;
+  case ZMQ_EVENT_CLOSED:
+    return SocketMonitorMessage::CLOSED;
+  case ZMQ_EVENT_CLOSE_FAILED:
+    return SocketMonitorMessage::CLOSE_FAILED;
+  case ZMQ_EVENT_DISCONNECTED:
+    return SocketMonitorMessage::DISCONNECTED;
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(4, 3, 0)
+  case ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL:
+    return SocketMonitorMessage::HANDSHAKE_FAILED_NO_DETAIL;
+  case ZMQ_EVENT_HANDSHAKE_SUCCEEDED:
+    return SocketMonitorMessage::HANDSHAKE_SUCCEEDED;
+  case ZMQ_EVENT_HANDSHAKE_FAILED_PROTOCOL:
+    return SocketMonitorMessage::HANDSHAKE_FAILED_PROTOCOL;
+  case ZMQ_EVENT_HANDSHAKE_FAILED_AUTH:
+    return SocketMonitorMessage::HANDSHAKE_FAILED_AUTH;
+#endif
+  default:
+    return folly::none;
+  } // switch
+}
+
+} // namespace
+
+std::unordered_map<std::string, int64_t>
+SocketMonitorStats::getCounters(std::string const& prefix) const {
+  std::unordered_map<std::string, int64_t> counters;
+  auto toUs = [](std::chrono::nanoseconds value) {
+    return static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(value).count());
+  };
+  counters[prefix + ".events"] = numEvents;
+  for (auto const& kv : endpoints) {
+    const auto key = prefix + "." + kv.first;
+    auto const& stats = kv.second;
+    counters[key + ".connected"] = stats.numConnected;
+    counters[key + ".accepted"] = stats.numAccepted;
+    counters[key + ".disconnected"] = stats.numDisconnected;
+    counters[key + ".connect_delayed"] = stats.numConnectDelayed;
+    counters[key + ".connect_retried"] = stats.numConnectRetried;
+    counters[key + ".handshake_succeeded"] = stats.numHandshakeSucceeded;
+    counters[key + ".handshake_failed"] = stats.numHandshakeFailed;
+    counters[key + ".errors"] = stats.numErrors;
+    counters[key + ".active_peers"] = stats.numActivePeers;
+
+    auto const& latency = stats.connectLatency;
+    counters[key + ".connect_latency_us.count"] = latency.count;
+    counters[key + ".connect_latency_us.p50"] =
+        toUs(latency.getPercentile(50));
+    counters[key + ".connect_latency_us.p99"] =
+        toUs(latency.getPercentile(99));
+    counters[key + ".connect_latency_us.max"] = toUs(latency.max);
+  }
+  return counters;
+}
+
 SocketMonitor::SocketMonitor(
     detail::SocketImpl const& sock, SocketUrl monitorUrl, CallbackT cb) noexcept
     : pairSock_{const_cast<void*>(sock.ctxPtr_)}, cb_{std::move(cb)} {
@@ -18,7 +94,9 @@ SocketMonitor::SocketMonitor(
 
   CHECK_EQ(0, rc) << "Failed attaching monitor: " << Error();
   pairSock_.connect(SocketUrl{monitorUrl});
-  cb_(SocketMonitorMessage::STARTED, SocketUrl{});
+  if (cb_) {
+    cb_(SocketMonitorMessage::STARTED, SocketUrl{});
+  }
 }
 
 // public
@@ -46,85 +124,132 @@ SocketMonitor::runForever() noexcept {
 
 folly::Expected<bool, Error>
 SocketMonitor::runOnce() noexcept {
-  EventT event;
-  std::string address;
+  return recvEvent(0);
+}
 
-  {
-    auto maybeMsg = pairSock_.recvOne();
-    if (maybeMsg.hasError()) {
-      return folly::makeUnexpected(maybeMsg.error());
+folly::Expected<bool, Error>
+SocketMonitor::processEvents() noexcept {
+  while (true) {
+    auto ret = recvEvent(ZMQ_DONTWAIT);
+    if (ret.hasError()) {
+      if (ret.error().errNum == EAGAIN) {
+        return true;
+      }
+      return folly::makeUnexpected(ret.error());
+    }
+    if (not ret.value()) {
+      return false;
     }
-    ::memcpy(
-        static_cast<void*>(&event),
-        maybeMsg->writeableData().begin(),
-        sizeof(EventT));
   }
+}
 
-  {
-    auto maybeMsg = pairSock_.recvOne();
-    if (maybeMsg.hasError()) {
-      return folly::makeUnexpected(maybeMsg.error());
-    }
-    address = maybeMsg->read<std::string>().value();
+folly::Expected<bool, Error>
+SocketMonitor::recvEvent(int flags) noexcept {
+  // [event:u16 value:u32][address], frames of an event arrive together
+  auto eventMsg = pairSock_.recv(flags);
+  if (eventMsg.hasError()) {
+    return folly::makeUnexpected(eventMsg.error());
+  }
+  auto addressMsg = pairSock_.recv(flags);
+  if (addressMsg.hasError()) {
+    return folly::makeUnexpected(addressMsg.error());
   }
 
-  if (event.event == ZMQ_EVENT_MONITOR_STOPPED) {
+  const auto data = eventMsg->data();
+  uint16_t event{0};
+  if (data.size() < sizeof(event)) {
+    LOG(ERROR) << "Invalid monitor event of size " << data.size();
+    return true;
+  }
+  ::memcpy(&event, data.data(), sizeof(event));
+  if (event == ZMQ_EVENT_MONITOR_STOPPED) {
     return false;
   }
 
-  const auto url = SocketUrl{address};
+  const auto address = addressMsg->data();
+  handleEvent(
+      event,
+      folly::StringPiece(
+          reinterpret_cast<const char*>(address.data()), address.size()));
+  return true;
+}
 
-  switch (event.event) {
-  case ZMQ_EVENT_CONNECTED:
-    cb_(SocketMonitorMessage::CONNECTED, url);
-    break;
-  case ZMQ_EVENT_CONNECT_DELAYED:
-    cb_(SocketMonitorMessage::CONNECT_DELAYED, url);
-    break;
-  case ZMQ_EVENT_CONNECT_RETRIED:
-    cb_(SocketMonitorMessage::CONNECT_RETRIED, url);
-    break;
-  case ZMQ_EVENT_LISTENING:
-    cb_(SocketMonitorMessage::LISTENING, url);
-    break;
-  case ZMQ_EVENT_BIND_FAILED:
-    cb_(SocketMonitorMessage::BIND_FAILED, url);
-    break;
-  case ZMQ_EVENT_ACCEPTED:
-    cb_(SocketMonitorMessage::ACCEPTED, url);
-    break;
-  case ZMQ_EVENT_ACCEPT_FAILED:
-    cb_(SocketMonitorMessage::ACCEPT_FAILED, url);
+void
+SocketMonitor::handleEvent(uint16_t event, folly::StringPiece address) {
+  const auto msg = toMonitorMessage(event);
+  if (not msg) {
+    LOG(ERROR) << "Unknown event: " << event;
+    return;
+  }
+
+  ++stats_.numEvents;
+  auto it = stats_.endpoints.find(address);
+  if (it == stats_.endpoints.end()) {
+    it = stats_.endpoints.emplace(address.str(), SocketEndpointStats()).first;
+  }
+  auto& stats = it->second;
+
+  // Connect is complete once handshake succeeded, or with older ZMQ once
+  // connection is established
+  auto completeConnect = [&]() {
+    auto startIt = connectStartTimes_.find(address);
+    if (startIt != connectStartTimes_.end()) {
+      stats.connectLatency.addValue(
+          std::chrono::steady_clock::now() - startIt->second);
+      connectStartTimes_.erase(startIt);
+    }
+  };
+
+  switch (*msg) {
+  case SocketMonitorMessage::CONNECTED:
+    ++stats.numConnected;
+    ++stats.numActivePeers;
+#if ZMQ_VERSION < ZMQ_MAKE_VERSION(4, 3, 0)
+    completeConnect();
+#endif
     break;
-  case ZMQ_EVENT_CLOSED:
-    cb_(SocketMonitorMessage::CLOSED, url);
+  case SocketMonitorMessage::CONNECT_DELAYED:
+    // Retries keep the start of the first attempt
+    ++stats.numConnectDelayed;
+    if (connectStartTimes_.find(address) == connectStartTimes_.end()) {
+      connectStartTimes_.emplace(
+          address.str(), std::chrono::steady_clock::now());
+    }
     break;
-  case ZMQ_EVENT_CLOSE_FAILED:
-    cb_(SocketMonitorMessage::CLOSE_FAILED, url);
+  case SocketMonitorMessage::CONNECT_RETRIED:
+    ++stats.numConnectRetried;
     break;
-  case ZMQ_EVENT_DISCONNECTED:
-    cb_(SocketMonitorMessage::DISCONNECTED, url);
+  case SocketMonitorMessage::ACCEPTED:
+    ++stats.numAccepted;
+    ++stats.numActivePeers;
     break;
-#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(4, 3, 0)
-  case ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL:
-    cb_(SocketMonitorMessage::HANDSHAKE_FAILED_NO_DETAIL, url);
+  case SocketMonitorMessage::DISCONNECTED:
+    ++stats.numDisconnected;
+    if (stats.numActivePeers > 0) {
+      --stats.numActivePeers;
+    }
     break;
-  case ZMQ_EVENT_HANDSHAKE_SUCCEEDED:
-    cb_(SocketMonitorMessage::HANDSHAKE_SUCCEEDED, url);
+  case SocketMonitorMessage::HANDSHAKE_SUCCEEDED:
+    ++stats.numHandshakeSucceeded;
+    completeConnect();
     break;
-  case ZMQ_EVENT_HANDSHAKE_FAILED_PROTOCOL:
-    cb_(SocketMonitorMessage::HANDSHAKE_FAILED_PROTOCOL, url);
+  case SocketMonitorMessage::HANDSHAKE_FAILED_NO_DETAIL:
+  case SocketMonitorMessage::HANDSHAKE_FAILED_PROTOCOL:
+  case SocketMonitorMessage::HANDSHAKE_FAILED_AUTH:
+    ++stats.numHandshakeFailed;
     break;
-  case ZMQ_EVENT_HANDSHAKE_FAILED_AUTH:
-    cb_(SocketMonitorMessage::HANDSHAKE_FAILED_AUTH, url);
+  case SocketMonitorMessage::BIND_FAILED:
+  case SocketMonitorMessage::ACCEPT_FAILED:
+  case SocketMonitorMessage::CLOSE_FAILED:
+    ++stats.numErrors;
     break;
-#endif
   default:
-    LOG(ERROR) << "Unknown event: " << event.event;
     break;
   } // switch
 
-  return true;
+  if (cb_) {
+    cb_(*msg, SocketUrl{address.str()});
+  }
 }
 
 } // namespace fbzmq
@@ -7,7 +7,13 @@
 
 #pragma once
 
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
 #include <folly/Function.h>
+#include <folly/Range.h>
+#include <folly/container/F14Map.h>
 
 #include <fbzmq/zmq/Socket.h>
 
@@ -31,10 +37,61 @@ enum class SocketMonitorMessage {
   HANDSHAKE_FAILED_AUTH,
 };
 
+/**
+ * Connection churn of an endpoint of a monitored socket, i.e. of an address
+ * it connects or binds to
+ */
+struct SocketEndpointStats {
+  // Connections established to (connect) or accepted on (bind) endpoint
+  uint64_t numConnected{0};
+  uint64_t numAccepted{0};
+  uint64_t numDisconnected{0};
+
+  // Asynchronous connects started, and connects retried after a failure
+  uint64_t numConnectDelayed{0};
+  uint64_t numConnectRetried{0};
+
+  // ZMTP handshakes of connections (ZMQ 4.3 and later)
+  uint64_t numHandshakeSucceeded{0};
+  uint64_t numHandshakeFailed{0};
+
+  // Failed binds, accepts and closes
+  uint64_t numErrors{0};
+
+  // Connections currently up, i.e. connected or accepted and not
+  // disconnected since
+  int64_t numActivePeers{0};
+
+  // Time from start of connecting (CONNECT_DELAYED) to completed handshake,
+  // or to connection with ZMQ before 4.3. Includes any retries in between.
+  LatencyHistogram connectLatency;
+};
+
+struct SocketMonitorStats {
+  // Stats of every endpoint seen in events
+  folly::F14FastMap<std::string, SocketEndpointStats> endpoints;
+
+  uint64_t numEvents{0};
+
+  /**
+   * Flat counters of stats with given key prefix, e.g.
+   * `<prefix>.<endpoint>.active_peers`. Can be published via
+   * `ThreadData::setCounters`.
+   */
+  std::unordered_map<std::string, int64_t> getCounters(
+      std::string const& prefix) const;
+};
+
 /**
  * Socket monitor creates new PAIR socket that observes even on monitored
  * socket and reports it down. It runs synchronous loop and invokes the
  * callback
+ *
+ * Monitor keeps per endpoint stats of events (refer to `getStats`), hence it
+ * can do without callback. Events are decoded in place, and apart from the
+ * first event of an endpoint, stats are updated without allocating. To run
+ * monitor on a ZmqEventLoop instead of a thread of its own, use
+ * ZmqSocketMonitor.
  */
 class SocketMonitor {
  public:
@@ -50,12 +107,12 @@ class SocketMonitor {
    * @param monitoUrl The URL to use for transient PAIR socket. This has to be
    *    inproc:// only
    * @param cb The callback to invoke on every event. Will be invoked in
-   *    the monitoring thread
+   *    the monitoring thread. Optional, stats are kept regardless.
    */
   SocketMonitor(
       detail::SocketImpl const& sock,
       SocketUrl monitorUrl,
-      CallbackT cb) noexcept;
+      CallbackT cb = nullptr) noexcept;
 
   /**
    * non-copyable
@@ -76,6 +133,18 @@ class SocketMonitor {
    */
   folly::Expected<bool, Error> runOnce() noexcept;
 
+  /**
+   * Consume all pending events without blocking, e.g. whenever PAIR socket
+   * becomes readable on an event loop. Return true if socket is still being
+   * monitored, false if monitoring has finished.
+   */
+  folly::Expected<bool, Error> processEvents() noexcept;
+
+  SocketMonitorStats const&
+  getStats() const {
+    return stats_;
+  }
+
   /**
    * return raw pointer to the pair socket so it could be added to event loops
    */
@@ -86,18 +155,27 @@ class SocketMonitor {
 
  private:
   /**
-   * event object passed down the PAIR socket to monitor class
+   * Receive an event, with `flags` of receive. Returns false if monitoring
+   * has finished.
+   */
+  folly::Expected<bool, Error> recvEvent(int flags) noexcept;
+
+  /**
+   * Account event in stats of endpoint and invoke callback
    */
-  using EventT = struct {
-    uint16_t event;
-    int32_t data;
-  };
+  void handleEvent(uint16_t event, folly::StringPiece address);
 
   // this socket will be used to report monitored socket events
   Socket<ZMQ_PAIR, ZMQ_CLIENT> pairSock_;
 
   // we'll call this method on any event
   CallbackT cb_;
+
+  SocketMonitorStats stats_;
+
+  // Start of connects in progress, by endpoint
+  folly::F14FastMap<std::string, std::chrono::steady_clock::time_point>
+      connectStartTimes_;
 };
 
 } // namespace fbzmq
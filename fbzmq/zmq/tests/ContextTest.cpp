@@ -21,6 +21,20 @@ TEST(Context, Move) {
   ctx3 = std::move(ctx2);
 }
 
+TEST(Context, Options) {
+  // IO threads are bounded by CPUs at hand
+  EXPECT_LE(1, Context::getAutoNumIoThreads());
+  EXPECT_EQ(1, Context::getAutoNumIoThreads({0}));
+
+  fbzmq::ContextOptions options;
+  options.numIoThreads = Context::getAutoNumIoThreads({0});
+  options.numMaxSockets = 32;
+  options.ioThreadCpus = {0};
+  options.ioThreadNamePrefix = 7;
+  fbzmq::Context ctx(options);
+  EXPECT_EQ(sizeof(zmq_msg_t), ctx.getMsgTSize());
+}
+
 } // namespace fbzmq
 
 int
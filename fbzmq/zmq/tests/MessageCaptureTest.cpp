@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <unistd.h>
+
+#include <cstdio>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/zmq/MessageCapture.h>
+
+namespace fbzmq {
+
+namespace {
+
+std::string
+getCapturePath(std::string const& name) {
+  return "/tmp/fbzmq_capture_" + name + "_" + std::to_string(::getpid());
+}
+
+std::vector<Message>
+makeFrames(std::vector<std::string> const& strs) {
+  std::vector<Message> frames;
+  for (auto const& str : strs) {
+    frames.emplace_back(Message::from(str).value());
+  }
+  return frames;
+}
+
+std::vector<std::string>
+readFrames(CapturedMessage const& msg) {
+  std::vector<std::string> strs;
+  for (auto const& frame : msg.frames) {
+    strs.emplace_back(frame.read<std::string>().value());
+  }
+  return strs;
+}
+
+} // namespace
+
+TEST(MessageCaptureTest, WriteAndRead) {
+  const auto path = getCapturePath("write_read");
+  ::unlink(path.c_str());
+
+  const auto start = std::chrono::system_clock::now();
+  const std::string large(100000, 'x');
+  {
+    auto writer = MessageCaptureWriter::open(path).value();
+    writer->write(makeFrames({"id", "", "hello"}), start).value();
+    writer->write(makeFrames({large}), start + std::chrono::milliseconds(5))
+        .value();
+    // Clock stepping back is clamped
+    writer->write(makeFrames({}), start + std::chrono::milliseconds(2))
+        .value();
+    EXPECT_EQ(3, writer->getNumMessages());
+    EXPECT_EQ(7 + large.size(), writer->getNumBytes());
+  }
+
+  auto reader = MessageCaptureReader::open(path).value();
+  auto msg = reader->next().value();
+  ASSERT_TRUE(msg.hasValue());
+  EXPECT_EQ(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          start.time_since_epoch()),
+      msg->timestamp.time_since_epoch());
+  EXPECT_EQ(
+      (std::vector<std::string>{"id", "", "hello"}), readFrames(msg.value()));
+
+  msg = reader->next().value();
+  ASSERT_TRUE(msg.hasValue());
+  const auto secondTimestamp = msg->timestamp;
+  EXPECT_EQ(std::vector<std::string>{large}, readFrames(msg.value()));
+
+  msg = reader->next().value();
+  ASSERT_TRUE(msg.hasValue());
+  EXPECT_EQ(secondTimestamp, msg->timestamp);
+  EXPECT_TRUE(msg->frames.empty());
+
+  EXPECT_FALSE(reader->next().value().hasValue());
+  ::unlink(path.c_str());
+}
+
+TEST(MessageCaptureTest, AppendSessions) {
+  const auto path = getCapturePath("append");
+  ::unlink(path.c_str());
+
+  const auto start = std::chrono::system_clock::now();
+  MessageCaptureWriter::open(path)
+      .value()
+      ->write(makeFrames({"a"}), start)
+      .value();
+  // Second session starts earlier, its timestamps are kept as they are
+  MessageCaptureWriter::open(path)
+      .value()
+      ->write(makeFrames({"b"}), start - std::chrono::seconds(1))
+      .value();
+
+  auto reader = MessageCaptureReader::open(path).value();
+  auto first = reader->next().value();
+  auto second = reader->next().value();
+  ASSERT_TRUE(first.hasValue());
+  ASSERT_TRUE(second.hasValue());
+  EXPECT_EQ(std::vector<std::string>{"a"}, readFrames(first.value()));
+  EXPECT_EQ(std::vector<std::string>{"b"}, readFrames(second.value()));
+  EXPECT_LT(second->timestamp, first->timestamp);
+  EXPECT_FALSE(reader->next().value().hasValue());
+  ::unlink(path.c_str());
+}
+
+TEST(MessageCaptureTest, InvalidFiles) {
+  const auto path = getCapturePath("invalid");
+  ::unlink(path.c_str());
+  EXPECT_FALSE(MessageCaptureReader::open(path).hasValue());
+
+  // Not a capture file
+  FILE* file = ::fopen(path.c_str(), "w");
+  ::fputs("garbage", file);
+  ::fclose(file);
+  EXPECT_EQ(EPROTO, MessageCaptureReader::open(path).error().errNum);
+  EXPECT_EQ(EPROTO, MessageCaptureWriter::open(path).error().errNum);
+  ::unlink(path.c_str());
+
+  // Truncated record
+  MessageCaptureWriter::open(path)
+      .value()
+      ->write(makeFrames({"hello"}))
+      .value();
+  ASSERT_EQ(0, ::truncate(path.c_str(), 12));
+  auto reader = MessageCaptureReader::open(path).value();
+  EXPECT_EQ(EPROTO, reader->next().error().errNum);
+  ::unlink(path.c_str());
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
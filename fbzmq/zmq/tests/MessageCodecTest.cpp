@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstring>
+#include <random>
+
+#include <folly/Conv.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/zmq/MessageCodec.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Compressible payload of given size
+std::string
+genPayload(size_t size) {
+  std::string s;
+  s.reserve(size);
+  for (size_t i = 0; s.size() < size; ++i) {
+    s += folly::to<std::string>("key-", i % 100, ":value;");
+  }
+  s.resize(size);
+  return s;
+}
+
+} // namespace
+
+TEST(MessageCodecTest, RoundTrip) {
+  for (auto type : {CompressionType::ZSTD, CompressionType::LZ4}) {
+    MessageCodec codec(CompressionOptions{type});
+    const auto payload = genPayload(64 * 1024);
+
+    auto compressed = codec.compress(Message::from(payload).value()).value();
+    EXPECT_TRUE(MessageCodec::isEncoded(compressed));
+    EXPECT_GT(payload.size() / 4, compressed.size());
+
+    auto decompressed = codec.decompress(std::move(compressed)).value();
+    EXPECT_FALSE(MessageCodec::isEncoded(decompressed));
+    EXPECT_EQ(payload, decompressed.read<std::string>().value());
+
+    auto const& stats = codec.getStats();
+    EXPECT_EQ(1, stats.numCompressed);
+    EXPECT_EQ(0, stats.numUncompressed);
+    EXPECT_EQ(1, stats.numDecompressed);
+    EXPECT_EQ(payload.size(), stats.numBytesIn);
+    EXPECT_LT(4, stats.getCompressionRatio());
+
+    auto counters = stats.getCounters("codec");
+    EXPECT_EQ(1, counters.at("codec.compressed"));
+    EXPECT_EQ(payload.size(), counters.at("codec.bytes_in"));
+    EXPECT_LT(400, counters.at("codec.ratio_pct"));
+    EXPECT_EQ(1, counters.count("codec.compress_us"));
+  }
+}
+
+TEST(MessageCodecTest, PassThrough) {
+  CompressionOptions options;
+  options.minSize = 100;
+  MessageCodec codec(options);
+
+  // Small frame is sent as is, without copying
+  const std::string small(64, 'x');
+  auto msg = Message::from(small).value();
+  const auto data = msg.data().data();
+  auto compressed = codec.compress(std::move(msg)).value();
+  EXPECT_EQ(data, compressed.data().data());
+
+  // Uncompressed frame is received as is
+  auto decompressed = codec.decompress(std::move(compressed)).value();
+  EXPECT_EQ(data, decompressed.data().data());
+  EXPECT_EQ(small, decompressed.read<std::string>().value());
+
+  // Incompressible frame
+  std::mt19937 rng(1);
+  std::string random(1000, 0);
+  for (auto& c : random) {
+    c = static_cast<char>(rng());
+  }
+  compressed = codec.compress(Message::from(random).value()).value();
+  EXPECT_FALSE(MessageCodec::isEncoded(compressed));
+  EXPECT_EQ(2, codec.getStats().numUncompressed);
+  EXPECT_EQ(1, codec.getStats().getCompressionRatio());
+}
+
+TEST(MessageCodecTest, Escape) {
+  MessageCodec codec(CompressionOptions{});
+
+  // Uncompressed payload which looks like an encoded frame
+  const std::string payload("\xFB\x5A\x43\x01garbage");
+  auto compressed = codec.compress(Message::from(payload).value()).value();
+  EXPECT_TRUE(MessageCodec::isEncoded(compressed));
+  EXPECT_EQ(payload.size() + 8, compressed.size());
+  auto decompressed = codec.decompress(std::move(compressed)).value();
+  EXPECT_EQ(payload, decompressed.read<std::string>().value());
+}
+
+TEST(MessageCodecTest, Dictionary) {
+  CompressionOptions options;
+  options.minSize = 0;
+  options.dictionary = genPayload(4096);
+  MessageCodec sender(options);
+  MessageCodec receiver(options);
+  options.dictionary.clear();
+  MessageCodec plain(options);
+
+  // Small frame sharing content with dictionary compresses better
+  const auto payload = genPayload(256);
+  auto withDict = sender.compress(Message::from(payload).value()).value();
+  auto withoutDict = plain.compress(Message::from(payload).value()).value();
+  EXPECT_TRUE(MessageCodec::isEncoded(withDict));
+  EXPECT_GT(withoutDict.size(), withDict.size());
+
+  auto decompressed = receiver.decompress(std::move(withDict)).value();
+  EXPECT_EQ(payload, decompressed.read<std::string>().value());
+}
+
+TEST(MessageCodecTest, Errors) {
+  MessageCodec codec(CompressionOptions{});
+
+  // Corrupt payload
+  auto compressed =
+      codec.compress(Message::from(genPayload(4096)).value()).value();
+  auto corrupt = Message::allocate(compressed.size()).value();
+  std::memcpy(corrupt.writeableData().data(), compressed.data().data(), 8);
+  std::memset(corrupt.writeableData().data() + 8, 0xAA, compressed.size() - 8);
+  auto ret = codec.decompress(std::move(corrupt));
+  ASSERT_TRUE(ret.hasError());
+  EXPECT_EQ(EPROTO, ret.error().errNum);
+
+  // Frame claiming a size above limit
+  CompressionOptions options;
+  options.maxFrameSize = 1024;
+  MessageCodec limited(options);
+  ret = limited.decompress(std::move(compressed));
+  ASSERT_TRUE(ret.hasError());
+  EXPECT_EQ(EMSGSIZE, ret.error().errNum);
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
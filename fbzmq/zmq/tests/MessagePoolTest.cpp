@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/zmq/MessagePool.h>
+#include <fbzmq/zmq/Socket.h>
+#include <fbzmq/zmq/tests/gen-cpp2/Test_types.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+namespace fbzmq {
+
+TEST(MessagePool, Allocate) {
+  MessagePool pool;
+
+  // Not pooled
+  {
+    auto msg = Message::allocate(16, pool).value();
+    EXPECT_EQ(16, msg.size());
+    auto msg2 = Message::allocate(1024 * 1024, pool).value();
+    EXPECT_EQ(1024 * 1024, msg2.size());
+  }
+  EXPECT_EQ(2, pool.getStats().numAllocations);
+  EXPECT_EQ(2, pool.getStats().numUnpooled);
+
+  // Fresh buffers and then recycled buffers
+  const uint8_t* data{nullptr};
+  {
+    auto msg = Message::allocate(1000, pool).value();
+    EXPECT_EQ(1000, msg.size());
+    data = msg.data().data();
+    // Buffer is writeable all the way
+    ::memset(msg.writeableData().data(), 'a', msg.size());
+  }
+  EXPECT_EQ(1, pool.getStats().numMisses);
+  {
+    auto msg = Message::allocate(1024, pool).value();
+    EXPECT_EQ(data, msg.data().data());
+  }
+  EXPECT_EQ(1, pool.getStats().numHits);
+  EXPECT_EQ(4, pool.getStats().numAllocations);
+
+  // Copy shares buffer, which is recycled only after all copies are gone
+  {
+    auto msg = Message::from(std::string(512, 'b'), pool).value();
+    auto msgCopy = msg;
+    EXPECT_EQ(std::string(512, 'b'), msgCopy.read<std::string>().value());
+  }
+  {
+    auto msg = Message::allocate(512, pool).value();
+    auto msg2 = Message::allocate(512, pool).value();
+    EXPECT_NE(msg.data().data(), msg2.data().data());
+  }
+  EXPECT_EQ(3, pool.getStats().numHits);
+  EXPECT_EQ(2, pool.getStats().numMisses);
+  EXPECT_EQ(7, pool.getStats().numAllocations);
+}
+
+TEST(MessagePool, ReturnFromOtherThread) {
+  MessagePool pool;
+  std::vector<Message> msgs;
+  for (int i = 0; i < 100; ++i) {
+    msgs.emplace_back(Message::allocate(4096, pool).value());
+  }
+  EXPECT_EQ(100, pool.getStats().numMisses);
+
+  // Release buffers from another thread
+  std::thread thread([msgs = std::move(msgs)]() mutable { msgs.clear(); });
+  thread.join();
+
+  for (int i = 0; i < 100; ++i) {
+    msgs.emplace_back(Message::allocate(4096, pool).value());
+  }
+  EXPECT_EQ(100, pool.getStats().numHits);
+  EXPECT_EQ(100, pool.getStats().numMisses);
+}
+
+TEST(MessagePool, MessageOutlivesPool) {
+  std::vector<Message> msgs;
+  {
+    MessagePool pool(1 /* maxCachedBuffers */);
+    msgs.emplace_back(Message::allocate(256, pool).value());
+    msgs.emplace_back(Message::allocate(256, pool).value());
+    {
+      auto msg = Message::allocate(256, pool).value();
+      auto msg2 = Message::allocate(256, pool).value();
+    }
+  }
+  // Pool is gone, buffers are still good
+  for (auto& msg : msgs) {
+    ::memset(msg.writeableData().data(), 'c', msg.size());
+  }
+  msgs.clear();
+}
+
+TEST(MessagePool, SendRecv) {
+  Context ctx;
+  Socket<ZMQ_PAIR, ZMQ_SERVER> server(ctx);
+  Socket<ZMQ_PAIR, ZMQ_CLIENT> client(ctx);
+  server.bind(SocketUrl{"inproc://message_pool"}).value();
+  client.connect(SocketUrl{"inproc://message_pool"}).value();
+
+  auto& pool = MessagePool::getThreadLocal();
+  const auto stats = pool.getStats();
+  for (int i = 0; i < 1000; ++i) {
+    const std::string str(100 + i, 'd');
+    client.sendOne(Message::from(str, pool).value()).value();
+    EXPECT_EQ(str, server.recvOne().value().read<std::string>().value());
+  }
+
+  // Buffers are recycled after the first few
+  EXPECT_EQ(1000, pool.getStats().numAllocations - stats.numAllocations);
+  EXPECT_LT(900, pool.getStats().numHits - stats.numHits);
+}
+
+TEST(MessagePool, FromThriftObj) {
+  MessagePool pool;
+  apache::thrift::CompactSerializer serializer;
+
+  // Output buffer grows to fit bigger objects once, and is reused after
+  for (auto size : {16, 200, 5000, 5000, 200, 5000}) {
+    test::TestValue obj;
+    *obj.value_ref() = std::string(size, 'e');
+    auto msg = Message::fromThriftObj(obj, serializer, pool).value();
+    EXPECT_EQ(
+        util::writeThriftObjStr(obj, serializer),
+        msg.read<std::string>().value());
+    EXPECT_EQ(obj, msg.readThriftObj<test::TestValue>(serializer).value());
+  }
+  EXPECT_EQ(1, pool.getStats().numOutputGrowths);
+  EXPECT_EQ(6, pool.getStats().numAllocations);
+
+  // Pooled messages are recycled
+  EXPECT_EQ(2, pool.getStats().numMisses);
+  EXPECT_EQ(3, pool.getStats().numHits);
+
+  // Default goes through the pool of current thread
+  auto& threadPool = MessagePool::getThreadLocal();
+  const auto stats = threadPool.getStats();
+  test::TestValue obj;
+  *obj.value_ref() = std::string(500, 'f');
+  auto msg = Message::fromThriftObj(obj, serializer).value();
+  EXPECT_EQ(obj, msg.readThriftObj<test::TestValue>(serializer).value());
+  EXPECT_EQ(1, threadPool.getStats().numAllocations - stats.numAllocations);
+}
+
+TEST(MessagePool, FromThriftObjBeyondSizeClasses) {
+  MessagePool pool;
+  apache::thrift::CompactSerializer serializer;
+
+  // Objects bigger than largest size class are not pooled, output buffer is
+  // still reused for smaller ones
+  const auto largest = MessagePool::kSizeClasses.back();
+  for (auto size : {largest * 3, size_t(200), largest + 1, size_t(200)}) {
+    test::TestValue obj;
+    *obj.value_ref() = std::string(size, 'b');
+    auto msg = Message::fromThriftObj(obj, serializer, pool).value();
+    EXPECT_LT(size, msg.size());
+    EXPECT_EQ(obj, msg.readThriftObj<test::TestValue>(serializer).value());
+  }
+  const auto stats = pool.getStats();
+  EXPECT_EQ(4, stats.numAllocations);
+  EXPECT_EQ(2, stats.numUnpooled);
+  EXPECT_EQ(1, stats.numMisses);
+  EXPECT_EQ(1, stats.numHits);
+  EXPECT_EQ(0, stats.numOutputGrowths);
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
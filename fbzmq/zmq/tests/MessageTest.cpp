@@ -90,6 +90,139 @@ TEST(Message, WrapBuffer) {
   EXPECT_FALSE(buf->isShared());
 }
 
+TEST(Message, WrapBufferChain) {
+  auto buf = folly::IOBuf::copyBuffer(genRandomStr(128));
+  buf->prependChain(folly::IOBuf::create(0)); // empty buffer
+  buf->prependChain(folly::IOBuf::copyBuffer(genRandomStr(256)));
+  const auto firstData = buf->data();
+  const auto lastData = buf->prev()->data();
+
+  auto msgs = fbzmq::Message::wrapBufferChain(std::move(buf));
+  ASSERT_TRUE(msgs.hasValue());
+  ASSERT_EQ(2, msgs->size());
+  EXPECT_EQ(128, msgs->at(0).size());
+  EXPECT_EQ(256, msgs->at(1).size());
+
+  // no copy
+  EXPECT_EQ(firstData, msgs->at(0).data().data());
+  EXPECT_EQ(lastData, msgs->at(1).data().data());
+
+  // empty chain results in single empty message
+  auto emptyMsgs = fbzmq::Message::wrapBufferChain(folly::IOBuf::create(0));
+  ASSERT_TRUE(emptyMsgs.hasValue());
+  ASSERT_EQ(1, emptyMsgs->size());
+  EXPECT_TRUE(emptyMsgs->at(0).empty());
+}
+
+TEST(Message, Object) {
+  // Tracks destruction of object
+  struct Tracked {
+    explicit Tracked(int& numDestroyed) : numDestroyed(numDestroyed) {}
+    ~Tracked() {
+      ++numDestroyed;
+    }
+    int& numDestroyed;
+  };
+  int numDestroyed{0};
+
+  // Ownership is transferred as is, no copy
+  auto obj = std::make_unique<Tracked>(numDestroyed);
+  auto const ptr = obj.get();
+  auto msg = fbzmq::Message::fromObject(std::move(obj)).value();
+  EXPECT_TRUE(msg.isObject());
+  auto copy = msg;
+  EXPECT_TRUE(copy.isObject());
+
+  // Type mismatch
+  auto wrongType = msg.releaseObject<std::string>();
+  ASSERT_TRUE(wrongType.hasError());
+  EXPECT_EQ(EINVAL, wrongType.error().errNum);
+
+  // Released once, copies share the object
+  auto released = msg.releaseObject<Tracked>().value();
+  EXPECT_EQ(ptr, released.get());
+  auto again = copy.releaseObject<Tracked>();
+  ASSERT_TRUE(again.hasError());
+  EXPECT_EQ(ENOENT, again.error().errNum);
+
+  // Released object outlives message
+  msg = fbzmq::Message();
+  copy = fbzmq::Message();
+  EXPECT_EQ(0, numDestroyed);
+  released.reset();
+  EXPECT_EQ(1, numDestroyed);
+
+  // Object not released is destroyed along with message
+  fbzmq::Message::fromObject(std::make_unique<Tracked>(numDestroyed)).value();
+  EXPECT_EQ(2, numDestroyed);
+
+  // Lookalike payload (e.g. copied or from wire) is not an object
+  auto strMsg =
+      fbzmq::Message::fromObject(std::make_unique<std::string>("a")).value();
+  auto buf = folly::IOBuf::copyBuffer(strMsg.data().data(), strMsg.size());
+  auto lookalike = fbzmq::Message::wrapBuffer(std::move(buf)).value();
+  EXPECT_FALSE(lookalike.isObject());
+  auto notObject = lookalike.releaseObject<std::string>();
+  ASSERT_TRUE(notObject.hasError());
+  EXPECT_EQ(EPROTO, notObject.error().errNum);
+  EXPECT_FALSE(fbzmq::Message::from(std::string("abc")).value().isObject());
+  EXPECT_EQ("a", *strMsg.releaseObject<std::string>().value());
+}
+
+TEST(Message, FromStringPiece) {
+  // Small (stored inline) and large strings alike
+  for (const int len : {0, 8, 30, 4096}) {
+    const auto str = genRandomStr(len);
+    auto msg = fbzmq::Message::from(folly::StringPiece(str)).value();
+    EXPECT_EQ(str, msg.read<std::string>().value());
+    EXPECT_EQ(
+        str, fbzmq::Message::from(str).value().read<std::string>().value());
+  }
+  auto literal = fbzmq::Message::from("literal").value();
+  EXPECT_EQ("literal", literal.read<std::string>().value());
+}
+
+TEST(Message, View) {
+  const auto str = genRandomStr(256);
+  auto msg = fbzmq::Message::from(str).value();
+
+  // Views reference message data
+  auto sp = msg.view<folly::StringPiece>().value();
+  EXPECT_EQ(str, sp);
+  EXPECT_EQ(reinterpret_cast<const char*>(msg.data().data()), sp.data());
+  auto bytes = msg.view<folly::ByteRange>().value();
+  EXPECT_EQ(msg.data().data(), bytes.data());
+  EXPECT_EQ(256, bytes.size());
+
+  // Trivially copyable structs, in place
+  struct Header {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t seqNum;
+  };
+  auto headerMsg = fbzmq::Message::allocate(sizeof(Header)).value();
+  Header header{1, 2, 3};
+  ::memcpy(headerMsg.writeableData().data(), &header, sizeof(header));
+  auto view = headerMsg.view<Header>();
+  if (view.hasValue()) {
+    EXPECT_EQ(
+        headerMsg.data().data(), reinterpret_cast<const uint8_t*>(*view));
+    EXPECT_EQ(1, (*view)->type);
+    EXPECT_EQ(2, (*view)->flags);
+    EXPECT_EQ(3, (*view)->seqNum);
+  } else {
+    // Inline storage of small messages may not be aligned
+    EXPECT_EQ(EINVAL, view.error().errNum);
+  }
+  auto charMsg = fbzmq::Message::from('a').value();
+  EXPECT_EQ('a', *charMsg.view<char>().value());
+
+  // Size must match
+  auto wrongSize = msg.view<Header>();
+  ASSERT_TRUE(wrongSize.hasError());
+  EXPECT_EQ(EPROTO, wrongSize.error().errNum);
+}
+
 } // namespace fbzmq
 
 int
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <thread>
+
+#include <folly/Function.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <fbzmq/zmq/Publisher.h>
+
+namespace fbzmq {
+
+namespace {
+
+// Subscriptions propagate asynchronously, wait for publisher to catch up
+bool
+waitFor(folly::Function<bool()> predicate) {
+  for (int i = 0; i < 100; ++i) {
+    if (predicate()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+} // namespace
+
+TEST(PublisherTest, TopicSubscriptions) {
+  Context context;
+  Publisher publisher(context);
+  publisher.bind(SocketUrl{"inproc://publisher_topics"}).value();
+
+  // Nobody subscribed, nothing is built
+  int numBuilt{0};
+  auto build = [&numBuilt]() {
+    ++numBuilt;
+    return Message::from(std::string("body"));
+  };
+  EXPECT_FALSE(publisher.publish("foo.bar", build).value());
+  EXPECT_FALSE(publisher.publish(build).value());
+  EXPECT_EQ(0, numBuilt);
+  EXPECT_EQ(2, publisher.getStats().numSkipped);
+
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+  sub.connect(SocketUrl{"inproc://publisher_topics"}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "foo", 3).value();
+  ASSERT_TRUE(waitFor([&]() { return publisher.hasSubscribers("foo"); }));
+
+  // Topics are matched by prefix
+  EXPECT_TRUE(publisher.hasSubscribers("foo.bar"));
+  EXPECT_FALSE(publisher.hasSubscribers("fo"));
+  EXPECT_FALSE(publisher.hasSubscribers("bar"));
+  EXPECT_TRUE(publisher.hasSubscribers());
+
+  EXPECT_FALSE(publisher.publish("bar", build).value());
+  EXPECT_TRUE(publisher.publish("foo.bar", build).value());
+  EXPECT_EQ(1, numBuilt);
+  EXPECT_EQ(1, publisher.getStats().numPublished);
+  Message topicMsg, bodyMsg;
+  sub.recvMultiple(topicMsg, bodyMsg).value();
+  EXPECT_EQ("foo.bar", topicMsg.read<std::string>().value());
+  EXPECT_EQ("body", bodyMsg.read<std::string>().value());
+
+  // Second subscriber of the same topic and another topic
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub2(context);
+  sub2.connect(SocketUrl{"inproc://publisher_topics"}).value();
+  sub2.setSockOpt(ZMQ_SUBSCRIBE, "foo", 3).value();
+  sub2.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+  ASSERT_TRUE(waitFor([&]() { return publisher.hasSubscribers("bar"); }));
+  EXPECT_EQ(2, publisher.getTopics().size());
+
+  // Topic stays subscribed until its last subscriber leaves
+  sub2.close();
+  ASSERT_TRUE(waitFor([&]() { return not publisher.hasSubscribers("bar"); }));
+  EXPECT_TRUE(publisher.hasSubscribers("foo"));
+
+  sub.setSockOpt(ZMQ_UNSUBSCRIBE, "foo", 3).value();
+  ASSERT_TRUE(waitFor([&]() { return not publisher.hasSubscribers(); }));
+  EXPECT_TRUE(publisher.getTopics().empty());
+}
+
+TEST(PublisherTest, SubscriberGoesAway) {
+  Context context;
+  Publisher publisher(context);
+  publisher.bind(SocketUrl{"inproc://publisher_disconnect"}).value();
+
+  {
+    Socket<ZMQ_SUB, ZMQ_CLIENT> sub(context);
+    sub.connect(SocketUrl{"inproc://publisher_disconnect"}).value();
+    sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+    ASSERT_TRUE(waitFor([&]() { return publisher.hasSubscribers(); }));
+    EXPECT_TRUE(publisher
+                    .publish([]() { return Message::from(std::string("x")); })
+                    .value());
+    EXPECT_EQ("x", sub.recvOne().value().read<std::string>().value());
+  }
+
+  // Subscriptions of closed subscriber are dropped
+  ASSERT_TRUE(waitFor([&]() { return not publisher.hasSubscribers(); }));
+}
+
+} // namespace fbzmq
+
+int
+main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  google::InstallFailureSignalHandler();
+
+  return RUN_ALL_TESTS();
+}
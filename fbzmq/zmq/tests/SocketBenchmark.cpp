@@ -0,0 +1,434 @@
+/**
+ * Copyright (c) 2014-present, Facebook, Inc.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * Throughput and latency of fbzmq sockets across transports, frame sizes and
+ * socket patterns. Every benchmark reports `msgs_per_sec` and `MB_per_sec`,
+ * round-trip benchmarks additionally report `p50_ns` and `p99_ns` of round
+ * trip latency.
+ *
+ *  fbzmq_socket_bench --bm_regex='tcp.*65536'
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+#include <folly/fibers/EventBaseLoopController.h>
+#include <folly/fibers/FiberManager.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/EventBase.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fbzmq/service/if/gen-cpp2/Monitor_types.h>
+#include <fbzmq/zmq/Zmq.h>
+
+#if FOLLY_HAS_COROUTINES
+#include <folly/experimental/coro/Task.h>
+#endif
+
+namespace fbzmq {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::vector<std::string> kTransports = {"inproc", "ipc", "tcp"};
+const std::vector<size_t> kFrameSizes = {
+    8, 512, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+
+Context&
+getContext() {
+  static Context context;
+  return context;
+}
+
+/**
+ * Unique url to bind on for the transport. Port of tcp is picked by the
+ * system, refer to `getBoundUrl`.
+ */
+std::string
+getBindUrl(std::string const& transport) {
+  static std::atomic<int> nextId{0};
+  const auto id = nextId++;
+  if (transport == "inproc") {
+    return folly::sformat("inproc://socket_bench_{}", id);
+  }
+  if (transport == "ipc") {
+    return folly::sformat("ipc:///tmp/fbzmq_socket_bench_{}_{}", getpid(), id);
+  }
+  return "tcp://127.0.0.1:*";
+}
+
+/**
+ * Actual url of bound socket, to connect to
+ */
+std::string
+getBoundUrl(SocketImpl& sock) {
+  char endpoint[256];
+  size_t len = sizeof(endpoint);
+  sock.getSockOpt(ZMQ_LAST_ENDPOINT, endpoint, &len).value();
+  return std::string(endpoint);
+}
+
+/**
+ * No message is ever dropped or blocked on a high water mark, benchmarks
+ * measure sockets and not queueing policies.
+ */
+void
+disableHwm(SocketImpl& sock) {
+  const int hwm = 0;
+  sock.setSockOpt(ZMQ_SNDHWM, &hwm, sizeof(hwm)).value();
+  sock.setSockOpt(ZMQ_RCVHWM, &hwm, sizeof(hwm)).value();
+}
+
+void
+reportThroughput(
+    folly::UserCounters& counters,
+    size_t numMsgs,
+    size_t frameSize,
+    Clock::duration elapsed) {
+  const double secs = std::chrono::duration<double>(elapsed).count();
+  if (secs <= 0) {
+    return;
+  }
+  counters["msgs_per_sec"] = static_cast<int64_t>(numMsgs / secs);
+  counters["MB_per_sec"] =
+      static_cast<int64_t>(numMsgs * frameSize / secs / (1024 * 1024));
+}
+
+void
+reportLatency(
+    folly::UserCounters& counters, std::vector<Clock::duration>& latencies) {
+  if (latencies.empty()) {
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    const auto index = std::min(
+        latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               latencies[index])
+        .count();
+  };
+  counters["p50_ns"] = percentile(0.5);
+  counters["p99_ns"] = percentile(0.99);
+}
+
+/**
+ * PUB/SUB one-way throughput with sendOne/recvOne, subscriber receives in its
+ * own thread
+ */
+void
+benchPubSub(
+    folly::UserCounters& counters,
+    unsigned n,
+    std::string const& transport,
+    size_t frameSize) {
+  folly::BenchmarkSuspender braces;
+  Socket<ZMQ_PUB, ZMQ_SERVER> pub(getContext());
+  Socket<ZMQ_SUB, ZMQ_CLIENT> sub(getContext());
+  disableHwm(pub);
+  disableHwm(sub);
+  pub.bind(SocketUrl{getBindUrl(transport)}).value();
+  sub.connect(SocketUrl{getBoundUrl(pub)}).value();
+  sub.setSockOpt(ZMQ_SUBSCRIBE, "", 0).value();
+
+  // Wait for subscription to reach publisher
+  const auto probe = Message::from(std::string("probe")).value();
+  while (true) {
+    pub.sendOne(probe).value();
+    if (sub.recvOne(std::chrono::milliseconds(10)).hasValue()) {
+      break;
+    }
+  }
+  while (sub.recvOne(std::chrono::milliseconds(10)).hasValue()) {
+  }
+
+  const auto msg = Message::allocate(frameSize).value();
+  std::thread receiver([&sub, n]() {
+    for (unsigned i = 0; i < n; ++i) {
+      sub.recvOne().value();
+    }
+  });
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  for (unsigned i = 0; i < n; ++i) {
+    pub.sendOne(msg).value();
+  }
+  receiver.join();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  reportThroughput(counters, n, frameSize, elapsed);
+}
+
+/**
+ * DEALER to ROUTER one-way throughput of two frame messages (header and
+ * payload) with sendMultiple/recvMultiple, router receives in its own thread
+ */
+void
+benchDealerRouter(
+    folly::UserCounters& counters,
+    unsigned n,
+    std::string const& transport,
+    size_t frameSize) {
+  folly::BenchmarkSuspender braces;
+  Socket<ZMQ_ROUTER, ZMQ_SERVER> router(getContext());
+  Socket<ZMQ_DEALER, ZMQ_CLIENT> dealer(getContext());
+  disableHwm(router);
+  disableHwm(dealer);
+  router.bind(SocketUrl{getBindUrl(transport)}).value();
+  dealer.connect(SocketUrl{getBoundUrl(router)}).value();
+
+  const auto header = Message::from(static_cast<uint64_t>(1)).value();
+  const auto payload = Message::allocate(frameSize).value();
+  std::thread receiver([&router, n]() {
+    Message identity, rcvdHeader, rcvdPayload;
+    for (unsigned i = 0; i < n; ++i) {
+      router.recvMultiple(identity, rcvdHeader, rcvdPayload).value();
+    }
+  });
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  for (unsigned i = 0; i < n; ++i) {
+    dealer.sendMultiple(header, payload).value();
+  }
+  receiver.join();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  reportThroughput(counters, n, frameSize, elapsed);
+}
+
+/**
+ * REQ/REP round trips, replier runs in its own thread. `isThrift` sends the
+ * payload as a thrift object with sendThriftObj/recvThriftObj instead of a
+ * raw frame.
+ */
+void
+benchReqRep(
+    folly::UserCounters& counters,
+    unsigned n,
+    std::string const& transport,
+    size_t frameSize,
+    bool isThrift) {
+  folly::BenchmarkSuspender braces;
+  Socket<ZMQ_REP, ZMQ_SERVER> rep(getContext());
+  Socket<ZMQ_REQ, ZMQ_CLIENT> req(getContext());
+  rep.bind(SocketUrl{getBindUrl(transport)}).value();
+  req.connect(SocketUrl{getBoundUrl(rep)}).value();
+
+  apache::thrift::CompactSerializer serializer;
+  thrift::EventLog eventLog;
+  eventLog.samples_ref()->emplace_back(std::string(frameSize, 'x'));
+  const auto msg = Message::allocate(frameSize).value();
+
+  std::thread replier([&rep, &serializer, n, isThrift]() {
+    for (unsigned i = 0; i < n; ++i) {
+      if (isThrift) {
+        auto obj = rep.recvThriftObj<thrift::EventLog>(serializer).value();
+        rep.sendThriftObj(obj, serializer).value();
+      } else {
+        rep.sendOne(rep.recvOne().value()).value();
+      }
+    }
+  });
+
+  std::vector<Clock::duration> latencies;
+  latencies.reserve(n);
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  for (unsigned i = 0; i < n; ++i) {
+    const auto sendTime = Clock::now();
+    if (isThrift) {
+      req.sendThriftObj(eventLog, serializer).value();
+      req.recvThriftObj<thrift::EventLog>(serializer).value();
+    } else {
+      req.sendOne(msg).value();
+      req.recvOne().value();
+    }
+    latencies.emplace_back(Clock::now() - sendTime);
+  }
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+  replier.join();
+
+  reportThroughput(counters, n, frameSize, elapsed);
+  reportLatency(counters, latencies);
+}
+
+/**
+ * REQ/REP round trips between two fibers on an EventBase, which exercises
+ * the evb-backed asynchronous wait (recvAsync) of sockets
+ */
+void
+benchFiberReqRep(
+    folly::UserCounters& counters,
+    unsigned n,
+    std::string const& transport,
+    size_t frameSize) {
+  folly::BenchmarkSuspender braces;
+  folly::EventBase evb;
+  Socket<ZMQ_REP, ZMQ_SERVER> rep(
+      getContext(), folly::none, folly::none, NonblockingFlag{true}, &evb);
+  Socket<ZMQ_REQ, ZMQ_CLIENT> req(
+      getContext(), folly::none, folly::none, NonblockingFlag{true}, &evb);
+  rep.bind(SocketUrl{getBindUrl(transport)}).value();
+  req.connect(SocketUrl{getBoundUrl(rep)}).value();
+
+  folly::fibers::FiberManager fm(
+      std::make_unique<folly::fibers::EventBaseLoopController>());
+  static_cast<folly::fibers::EventBaseLoopController&>(fm.loopController())
+      .attachEventBase(evb);
+
+  const auto msg = Message::allocate(frameSize).value();
+  std::vector<Clock::duration> latencies;
+  latencies.reserve(n);
+
+  fm.addTask([&rep, n]() {
+    for (unsigned i = 0; i < n; ++i) {
+      rep.sendOne(rep.recvOne().value()).value();
+    }
+  });
+  fm.addTask([&req, &msg, &latencies, n]() {
+    for (unsigned i = 0; i < n; ++i) {
+      const auto sendTime = Clock::now();
+      req.sendOne(msg).value();
+      req.recvOne().value();
+      latencies.emplace_back(Clock::now() - sendTime);
+    }
+  });
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  evb.loop();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+
+  reportThroughput(counters, n, frameSize, elapsed);
+  reportLatency(counters, latencies);
+}
+
+#if FOLLY_HAS_COROUTINES
+/**
+ * REQ/REP round trips between two coroutines on an EventBase with
+ * sendOneCoro/recvOneCoro
+ */
+void
+benchCoroReqRep(
+    folly::UserCounters& counters,
+    unsigned n,
+    std::string const& transport,
+    size_t frameSize) {
+  folly::BenchmarkSuspender braces;
+  folly::EventBase evb;
+  Socket<ZMQ_REP, ZMQ_SERVER> rep(
+      getContext(), folly::none, folly::none, NonblockingFlag{true}, &evb);
+  Socket<ZMQ_REQ, ZMQ_CLIENT> req(
+      getContext(), folly::none, folly::none, NonblockingFlag{true}, &evb);
+  rep.bind(SocketUrl{getBindUrl(transport)}).value();
+  req.connect(SocketUrl{getBoundUrl(rep)}).value();
+
+  const auto msg = Message::allocate(frameSize).value();
+  std::vector<Clock::duration> latencies;
+  latencies.reserve(n);
+
+  auto replier = [&rep, n]() -> folly::coro::Task<void> {
+    for (unsigned i = 0; i < n; ++i) {
+      auto rcvd = co_await rep.recvOneCoro();
+      (co_await rep.sendOneCoro(std::move(rcvd.value()))).value();
+    }
+  };
+  auto requester = [&req, &msg, &latencies, n]() -> folly::coro::Task<void> {
+    for (unsigned i = 0; i < n; ++i) {
+      const auto sendTime = Clock::now();
+      (co_await req.sendOneCoro(msg)).value();
+      (co_await req.recvOneCoro()).value();
+      latencies.emplace_back(Clock::now() - sendTime);
+    }
+  };
+
+  braces.dismiss();
+  const auto start = Clock::now();
+  auto replierFuture = replier().scheduleOn(&evb).start();
+  auto requesterFuture = requester().scheduleOn(&evb).start();
+  evb.loop();
+  const auto elapsed = Clock::now() - start;
+  braces.rehire();
+  std::move(replierFuture).get();
+  std::move(requesterFuture).get();
+
+  reportThroughput(counters, n, frameSize, elapsed);
+  reportLatency(counters, latencies);
+}
+#endif
+
+/**
+ * Register benchmark of every transport and frame size
+ */
+template <typename Fn>
+void
+addBenchmarks(std::string const& name, Fn fn) {
+  for (auto const& transport : kTransports) {
+    for (auto frameSize : kFrameSizes) {
+      folly::addBenchmark(
+          __FILE__,
+          folly::sformat("{}_{}_{}", name, transport, frameSize),
+          [fn, transport, frameSize](
+              folly::UserCounters& counters, unsigned n) {
+            fn(counters, n, transport, frameSize);
+            return n;
+          });
+    }
+  }
+}
+
+} // namespace
+
+} // namespace fbzmq
+
+int
+main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+
+  using namespace fbzmq;
+  addBenchmarks("pubsub_sendOne", benchPubSub);
+  addBenchmarks("dealer_router_sendMultiple", benchDealerRouter);
+  addBenchmarks(
+      "reqrep_sendOne",
+      [](folly::UserCounters& counters,
+         unsigned n,
+         std::string const& transport,
+         size_t frameSize) {
+        benchReqRep(counters, n, transport, frameSize, false /* isThrift */);
+      });
+  addBenchmarks(
+      "reqrep_sendThriftObj",
+      [](folly::UserCounters& counters,
+         unsigned n,
+         std::string const& transport,
+         size_t frameSize) {
+        benchReqRep(counters, n, transport, frameSize, true /* isThrift */);
+      });
+  addBenchmarks("reqrep_fiber_recvAsync", benchFiberReqRep);
+#if FOLLY_HAS_COROUTINES
+  addBenchmarks("reqrep_recvOneCoro", benchCoroReqRep);
+#endif
+
+  folly::runBenchmarks();
+  return 0;
+}
@@ -204,6 +204,60 @@ TEST(SocketMonitor, ConnectAsync) {
   EXPECT_FALSE(ret);
 }
 
+//
+// Per endpoint stats, events consumed without blocking and without callback
+//
+TEST(SocketMonitor, EndpointStats) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server(ctx);
+  const std::string kServerUrl{getSocketUrl("test_endpoint_stats")};
+
+  fbzmq::SocketMonitor monitor(server, fbzmq::SocketUrl{"inproc://monitor"});
+  std::vector<fbzmq::PollItem> pollItems = {
+      {reinterpret_cast<void*>(*monitor), 0, ZMQ_POLLIN, 0}};
+
+  // Nothing pending
+  EXPECT_TRUE(monitor.processEvents().value());
+  EXPECT_EQ(0, monitor.getStats().numEvents);
+
+  server.bind(fbzmq::SocketUrl{kServerUrl}).value();
+  client.connect(fbzmq::SocketUrl{kServerUrl}).value();
+
+  auto getStats = [&]() {
+    auto const& endpoints = monitor.getStats().endpoints;
+    auto it = endpoints.find(kServerUrl);
+    return it == endpoints.end() ? fbzmq::SocketEndpointStats() : it->second;
+  };
+  while (getStats().numAccepted == 0) {
+    fbzmq::poll(pollItems);
+    EXPECT_TRUE(monitor.processEvents().value());
+  }
+  EXPECT_EQ(1, getStats().numActivePeers);
+
+  client.close();
+  while (getStats().numDisconnected == 0) {
+    fbzmq::poll(pollItems);
+    EXPECT_TRUE(monitor.processEvents().value());
+  }
+  EXPECT_EQ(0, getStats().numActivePeers);
+  EXPECT_EQ(1, getStats().numAccepted);
+  EXPECT_EQ(0, getStats().numConnected);
+
+  const auto counters = monitor.getStats().getCounters("server");
+  EXPECT_EQ(1, counters.at("server." + kServerUrl + ".accepted"));
+  EXPECT_EQ(0, counters.at("server." + kServerUrl + ".active_peers"));
+
+  // Monitoring ends with server
+  server.close();
+  while (true) {
+    fbzmq::poll(pollItems);
+    if (not monitor.processEvents().value()) {
+      break;
+    }
+  }
+}
+
 } // namespace fbzmq
 
 int
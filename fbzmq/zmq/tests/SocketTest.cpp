@@ -5,8 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <set>
 #include <thread>
 
+#include <folly/Format.h>
 #include <folly/Random.h>
 #include <glog/logging.h>
 #include <gtest/gtest.h>
@@ -19,6 +21,7 @@
 #include <folly/fibers/FiberManager.h>
 #include <folly/init/Init.h>
 #include <folly/io/async/AsyncTimeout.h>
+#include <folly/small_vector.h>
 
 #if FOLLY_HAS_COROUTINES
 #include <folly/experimental/coro/Sleep.h>
@@ -274,6 +277,99 @@ TEST(Socket, CoroPubSub) {
   EXPECT_EQ(128, futReader.value());
   EXPECT_TRUE(futWriter.isReady());
 }
+
+TEST(Socket, CoroRecvStream) {
+  folly::EventBase evb;
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(
+      ctx, folly::none, folly::none, NonblockingFlag{true}, &evb);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+  server.setStatsEnabled(true);
+
+  const auto str = genRandomStr(64);
+  auto sendBurst = [&client, &str](bool isLast) {
+    for (int i = 0; i < 50; ++i) {
+      client.sendOne(fbzmq::Message::from(str).value()).value();
+    }
+    if (isLast) {
+      client.sendOne(fbzmq::Message::from(std::string("")).value()).value();
+    }
+  };
+
+  // First burst is readily available, second one arrives later
+  sendBurst(false);
+  evb.runAfterDelay([&sendBurst]() { sendBurst(true); }, 20);
+
+  auto reader = [&server, &str]() -> folly::coro::Task<size_t> {
+    size_t count{0};
+    auto stream = server.recvStream();
+    while (auto item = co_await stream.next()) {
+      auto data = item->value().read<std::string>().value();
+      if (data.empty()) {
+        break;
+      }
+      EXPECT_EQ(str, data);
+      ++count;
+    }
+    co_return count;
+  };
+
+  auto futReader = reader().scheduleOn(&evb).start();
+  evb.loop();
+
+  EXPECT_TRUE(futReader.isReady());
+  EXPECT_EQ(100, futReader.value());
+
+  // Reader got suspended only once, in between the bursts
+  auto stats = server.getStats().value();
+  EXPECT_EQ(101, stats.numMsgsRecvd);
+  EXPECT_EQ(1, stats.readWait.count);
+}
+
+TEST(Socket, CoroRecvMultipleStream) {
+  folly::EventBase evb;
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(
+      ctx, folly::none, folly::none, NonblockingFlag{true}, &evb);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  for (int i = 0; i < 5; ++i) {
+    client
+        .sendMultiple(
+            fbzmq::Message::from(i).value(),
+            fbzmq::Message::from(std::string("hello")).value(),
+            fbzmq::Message::from(std::string("world")).value())
+        .value();
+  }
+  client.sendOne(fbzmq::Message::from(std::string("")).value()).value();
+
+  auto reader = [&server]() -> folly::coro::Task<int> {
+    int count{0};
+    auto stream = server.recvMultipleStream();
+    while (auto item = co_await stream.next()) {
+      auto& msgs = item->value();
+      if (msgs.size() == 1) {
+        EXPECT_TRUE(msgs[0].empty());
+        break;
+      }
+      EXPECT_EQ(3, msgs.size());
+      EXPECT_EQ(count, msgs[0].read<int>().value());
+      EXPECT_EQ("world", msgs[2].read<std::string>().value());
+      ++count;
+    }
+    co_return count;
+  };
+
+  auto futReader = reader().scheduleOn(&evb).start();
+  evb.loop();
+
+  EXPECT_TRUE(futReader.isReady());
+  EXPECT_EQ(5, futReader.value());
+}
 #endif
 
 TEST(Socket, FiberSingleMessage) {
@@ -552,6 +648,85 @@ TEST(Socket, MessageRecvTimeout) {
   }
 }
 
+//
+// I/O modes fixed at compile time
+//
+TEST(Socket, IoModes) {
+  using namespace folly::fibers;
+
+  fbzmq::Context ctx;
+  // NonblockingFlag is overridden by mode
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER, fbzmq::BlockingIo> server(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{true});
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT, fbzmq::NonBlockingIo> client(
+      ctx);
+  EXPECT_FALSE(server.isNonBlocking());
+  EXPECT_TRUE(client.isNonBlocking());
+
+  server.bind(fbzmq::SocketUrl{"inproc://io_modes"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://io_modes"}).value();
+
+  {
+    // nothing to receive, doesn't wait
+    auto rcvd = client.recvOne(1000ms);
+    ASSERT_TRUE(rcvd.hasError());
+    EXPECT_EQ(EAGAIN, rcvd.error().errNum);
+  }
+  {
+    // waits for timeout
+    const auto start = std::chrono::steady_clock::now();
+    auto rcvd = server.recvOne(100ms);
+    ASSERT_TRUE(rcvd.hasError());
+    EXPECT_EQ(EAGAIN, rcvd.error().errNum);
+    EXPECT_LE(100ms, std::chrono::steady_clock::now() - start);
+  }
+
+  client.sendMore(fbzmq::Message::from(std::string("hello")).value()).value();
+  client.sendOne(fbzmq::Message::from(std::string("world")).value()).value();
+  EXPECT_EQ("hello", server.recvOne().value().read<std::string>().value());
+  EXPECT_TRUE(server.hasMore());
+  EXPECT_EQ(
+      "world", server.recvOne(100ms).value().read<std::string>().value());
+
+  server.sendOne(fbzmq::Message::from(std::string("reply")).value()).value();
+  // multipart helpers remain available
+  std::vector<fbzmq::Message> msgs;
+  while (client.recvMultipleInto(msgs).hasError()) {
+    std::this_thread::yield();
+  }
+  ASSERT_EQ(1, msgs.size());
+  EXPECT_EQ("reply", msgs[0].read<std::string>().value());
+
+  // Fibers wait on EventBase
+  folly::EventBase evb;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT, fbzmq::FiberIo> fiberClient(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{false}, &evb);
+  EXPECT_TRUE(fiberClient.isNonBlocking());
+  fiberClient.connect(fbzmq::SocketUrl{"inproc://io_modes_fiber"}).value();
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER, fbzmq::FiberIo> fiberServer(
+      ctx, folly::none, folly::none, fbzmq::NonblockingFlag{false}, &evb);
+  fiberServer.bind(fbzmq::SocketUrl{"inproc://io_modes_fiber"}).value();
+
+  auto fm = std::make_unique<FiberManager>(
+      std::make_unique<EventBaseLoopController>());
+  static_cast<EventBaseLoopController&>(fm->loopController())
+      .attachEventBase(evb);
+  auto receiver = fm->addTaskFuture([&fiberServer]() {
+    auto rcvd = fiberServer.recvOne();
+    EXPECT_EQ("fiber", rcvd.value().read<std::string>().value());
+    auto timedOut = fiberServer.recvOne(100ms);
+    ASSERT_TRUE(timedOut.hasError());
+    EXPECT_EQ(EAGAIN, timedOut.error().errNum);
+  });
+  auto sender = fm->addTaskFuture([&fiberClient]() {
+    fiberClient.sendOne(fbzmq::Message::from(std::string("fiber")).value())
+        .value();
+  });
+  evb.loop();
+  std::move(sender).get();
+  std::move(receiver).get();
+}
+
 //
 // Bounce random messages b/w req/rep sockets
 //
@@ -762,6 +937,129 @@ TEST(Socket, SendRecvThriftObj) {
 //
 // Send lotsa objects back and forth b/w sockets
 //
+TEST(Socket, SendRecvThriftObjShared) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+  CompactSerializer serializer;
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  const auto str = genRandomStr(32768);
+  fbzmq::test::WrapperValue wrapperValue;
+  *wrapperValue.version_ref() = 1;
+  *wrapperValue.value_ref() = *folly::IOBuf::copyBuffer(str);
+  client.sendThriftObj(wrapperValue, serializer).value();
+
+  fbzmq::test::WrapperValue rcvdValue;
+  folly::ByteRange msgData;
+  {
+    auto msg = server.recvOne().value();
+    msgData = msg.data();
+    rcvdValue =
+        msg.readThriftObjShared<fbzmq::test::WrapperValue>(serializer).value();
+  }
+
+  // IOBuf field references message data and outlives the Message
+  auto& value = *rcvdValue.value_ref();
+  EXPECT_EQ(1, *rcvdValue.version_ref());
+  EXPECT_EQ(str, value.cloneAsValue().moveToFbString().toStdString());
+  EXPECT_LE(msgData.begin(), value.data());
+  EXPECT_GE(msgData.end(), value.data() + value.length());
+}
+
+TEST(Socket, SendRecvObject) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> consumer(ctx);
+  consumer.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  // Objects move from producer thread to consumer without serialization
+  const int kNumObjects = 16;
+  std::vector<const fbzmq::test::TestValue*> sentPtrs;
+  std::thread producerThread([&]() {
+    fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> producer(ctx);
+    producer.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+    for (int i = 0; i < kNumObjects; ++i) {
+      auto value = std::make_unique<fbzmq::test::TestValue>();
+      *value->value_ref() = std::to_string(i);
+      sentPtrs.push_back(value.get());
+      producer.sendObject(std::move(value)).value();
+    }
+    producer.sendObject(std::make_unique<std::string>("wrong type")).value();
+  });
+
+  std::vector<std::unique_ptr<fbzmq::test::TestValue>> rcvd;
+  for (int i = 0; i < kNumObjects; ++i) {
+    auto value = consumer.recvObject<fbzmq::test::TestValue>().value();
+    EXPECT_EQ(std::to_string(i), *value->value_ref());
+    rcvd.emplace_back(std::move(value));
+  }
+  auto wrongType = consumer.recvObject<fbzmq::test::TestValue>();
+  ASSERT_TRUE(wrongType.hasError());
+  EXPECT_EQ(EINVAL, wrongType.error().errNum);
+  producerThread.join();
+
+  for (int i = 0; i < kNumObjects; ++i) {
+    EXPECT_EQ(sentPtrs[i], rcvd[i].get());
+  }
+}
+
+TEST(Socket, SendRecvThriftObjCodec) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(ctx);
+  CompactSerializer serializer;
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  // Only sender has codec to begin with
+  auto clientCodec = std::make_shared<fbzmq::MessageCodec>(
+      fbzmq::CompressionOptions{fbzmq::CompressionType::LZ4});
+  client.setCodec(clientCodec);
+  EXPECT_EQ(clientCodec, client.getCodec());
+
+  fbzmq::test::TestValue value;
+  *value.value_ref() = std::string(16384, 'a');
+  client.sendThriftObj(value, serializer).value();
+  auto rcvd = server.recvOne().value();
+  EXPECT_TRUE(fbzmq::MessageCodec::isEncoded(rcvd));
+  EXPECT_GT(1024, rcvd.size());
+  EXPECT_EQ(1, clientCodec->getStats().numCompressed);
+
+  // Receiver detects compressed as well as uncompressed objects
+  server.setCodec(std::make_shared<fbzmq::MessageCodec>(
+      fbzmq::CompressionOptions{fbzmq::CompressionType::ZSTD}));
+  client.sendThriftObj(value, serializer).value();
+  client.setCodec(nullptr);
+  client.sendThriftObj(value, serializer).value();
+  for (int i = 0; i < 2; ++i) {
+    auto rcvdValue =
+        server.recvThriftObj<fbzmq::test::TestValue>(serializer).value();
+    EXPECT_EQ(*value.value_ref(), *rcvdValue.value_ref());
+  }
+  EXPECT_EQ(1, server.getCodec()->getStats().numDecompressed);
+}
+
+TEST(Socket, MessageToIOBuf) {
+  const auto str = genRandomStr(1024);
+  auto msg = fbzmq::Message::from(str).value();
+
+  // Shares data with message
+  auto buf = msg.toIOBuf();
+  EXPECT_EQ(msg.data().data(), buf->data());
+  EXPECT_EQ(str.size(), buf->length());
+
+  // Adopts message
+  auto buf2 = std::move(msg).toIOBuf();
+  EXPECT_EQ(buf->data(), buf2->data());
+  EXPECT_TRUE(msg.empty());
+
+  buf2.reset();
+  EXPECT_EQ(str, buf->moveToFbString().toStdString());
+}
+
 TEST(Socket, ThriftObjPingPong) {
   fbzmq::Context ctx;
   fbzmq::Socket<ZMQ_REQ, fbzmq::ZMQ_CLIENT> req(ctx);
@@ -970,6 +1268,126 @@ TEST(Socket, RecvMultipleDynamic) {
   EXPECT_EQ("test1", msgs.back().read<std::string>().value());
 }
 
+//
+// Receive multiple message in a row, into re-usable container
+//
+TEST(Socket, RecvMultipleInto) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  folly::small_vector<fbzmq::Message, 4> msgs;
+  for (int i = 0; i < 3; ++i) {
+    client.sendMore(fbzmq::Message::from(std::string("test1")).value());
+    client.sendMore(fbzmq::Message::from(std::string("test2")).value());
+    client.sendOne(fbzmq::Message::from(std::string("test3")).value());
+
+    EXPECT_EQ(3, server.recvMultipleInto(msgs).value());
+    ASSERT_EQ(3, msgs.size());
+    EXPECT_EQ("test1", msgs[0].read<std::string>().value());
+    EXPECT_EQ("test2", msgs[1].read<std::string>().value());
+    EXPECT_EQ("test3", msgs[2].read<std::string>().value());
+
+    // No heap allocation for container
+    EXPECT_FALSE(msgs.isExtern());
+  }
+
+  // Timeout
+  EXPECT_TRUE(
+      server.recvMultipleInto(msgs, std::chrono::milliseconds(10)).hasError());
+  EXPECT_TRUE(msgs.empty());
+}
+
+TEST(Socket, SendRecvIOBufChain) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  const auto str1 = genRandomStr(1024);
+  const auto str2 = genRandomStr(4096);
+  auto buf = folly::IOBuf::copyBuffer(str1);
+  buf->prependChain(folly::IOBuf::copyBuffer(str2));
+
+  // Chain is sent as two frames
+  EXPECT_EQ(
+      str1.size() + str2.size(),
+      client.sendIOBufChain(std::move(buf)).value());
+  auto result = server.recvIOBufChain().value();
+  EXPECT_EQ(2, result->countChainElements());
+  EXPECT_EQ(str1 + str2, result->moveToFbString().toStdString());
+
+  // Multipart message received as chain
+  client.sendMultiple(
+      fbzmq::Message::from(str1).value(), fbzmq::Message::from(str2).value());
+  auto result2 = server.recvIOBufChain().value();
+  EXPECT_EQ(2, result2->countChainElements());
+  EXPECT_EQ(str1.size() + str2.size(), result2->computeChainDataLength());
+
+  // No copy along the way for inproc transport
+  buf = folly::IOBuf::copyBuffer(str1);
+  const auto bufData2 = buf->data();
+  client.sendIOBufChain(std::move(buf)).value();
+  auto result3 = server.recvIOBufChain().value();
+  EXPECT_EQ(bufData2, result3->data());
+}
+
+TEST(Socket, SendRecvBatch) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client(ctx);
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER> server(ctx);
+
+  server.bind(fbzmq::SocketUrl{"inproc://test"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://test"}).value();
+
+  // Send 10 messages of 2 frames each
+  std::vector<fbzmq::Message> msgs;
+  for (int i = 0; i < 10; ++i) {
+    const auto suffix = std::to_string(i);
+    msgs.emplace_back(fbzmq::Message::from("a" + suffix).value());
+    msgs.emplace_back(fbzmq::Message::from("b" + suffix).value());
+    EXPECT_EQ(4, client.sendBatch(std::move(msgs)).value());
+    EXPECT_TRUE(msgs.empty());
+  }
+
+  // Empty batch is a no-op
+  EXPECT_EQ(0, client.sendBatch({}).value());
+
+  // Limited by number of messages
+  std::vector<fbzmq::Message> frames;
+  EXPECT_EQ(3, server.recvBatch(frames, 3).value());
+  ASSERT_EQ(6, frames.size());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FALSE(frames[2 * i].isLast());
+    EXPECT_TRUE(frames[2 * i + 1].isLast());
+    const auto suffix = std::to_string(i);
+    EXPECT_EQ("a" + suffix, frames[2 * i].read<std::string>().value());
+    EXPECT_EQ("b" + suffix, frames[2 * i + 1].read<std::string>().value());
+  }
+
+  // Limited by number of bytes, message crossing the limit is included
+  EXPECT_EQ(2, server.recvBatch(frames, 100, 5).value());
+  ASSERT_EQ(4, frames.size());
+  EXPECT_EQ("a3", frames.front().read<std::string>().value());
+  EXPECT_EQ("b4", frames.back().read<std::string>().value());
+
+  // Rest of the messages
+  EXPECT_EQ(5, server.recvBatch(frames, 100).value());
+  ASSERT_EQ(10, frames.size());
+  EXPECT_EQ("b9", frames.back().read<std::string>().value());
+
+  // Nothing left
+  EXPECT_TRUE(
+      server.recvBatch(frames, 100, 100, std::chrono::milliseconds(10))
+          .hasError());
+  EXPECT_TRUE(frames.empty());
+}
+
 //
 // Send multiple messages in a row
 //
@@ -1206,9 +1624,202 @@ TEST(Socket, RouterFailure) {
   EXPECT_TRUE(ret.hasError());
 }
 
+TEST(Socket, Stats) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> dealer(
+      ctx, folly::none, folly::none, NonblockingFlag{true});
+  fbzmq::Socket<ZMQ_ROUTER, fbzmq::ZMQ_SERVER> router(
+      ctx, IdentityString{"router"}, folly::none, NonblockingFlag{true});
+
+  // Disabled by default
+  EXPECT_FALSE(dealer.getStats().hasValue());
+  dealer.setStatsEnabled(true);
+  router.setStatsEnabled(true);
+
+  // No peer yet
+  EXPECT_TRUE(dealer.sendOne(Message::from(std::string("x")).value())
+                  .hasError());
+  EXPECT_TRUE(router.recvOne().hasError());
+
+  router.bind(SocketUrl{"inproc://stats"}).value();
+  dealer.connect(SocketUrl{"inproc://stats"}).value();
+  dealer
+      .sendMultiple(
+          Message::from(std::string("hello")).value(),
+          Message::from(std::string("world")).value())
+      .value();
+  std::vector<Message> msgs;
+  while (msgs.empty()) {
+    auto ret = router.recvMultiple(std::chrono::milliseconds(100));
+    if (ret.hasValue()) {
+      msgs = std::move(ret.value());
+    }
+  }
+  ASSERT_EQ(3, msgs.size()); // identity + 2 frames
+
+  auto dealerStats = dealer.getStats().value();
+  EXPECT_EQ(2, dealerStats.numMsgsSent);
+  EXPECT_EQ(10, dealerStats.numBytesSent);
+  EXPECT_EQ(1, dealerStats.numMoreMsgsSent);
+  EXPECT_EQ(1, dealerStats.numSendEagain);
+  EXPECT_EQ(0, dealerStats.numSendErrors);
+
+  auto routerStats = router.getStats().value();
+  EXPECT_EQ(3, routerStats.numMsgsRecvd);
+  EXPECT_EQ(2, routerStats.numMoreMsgsRecvd);
+  EXPECT_LE(1, routerStats.numRecvEagain);
+
+  // Unknown identity on ROUTER_MANDATORY socket is an error
+  EXPECT_TRUE(router
+                  .sendMultiple(
+                      Message::from(std::string("unknown")).value(),
+                      Message::from(std::string("x")).value())
+                  .hasError());
+  EXPECT_EQ(1, router.getStats()->numSendErrors);
+
+  // Counters
+  auto counters = dealerStats.getCounters("sock");
+  EXPECT_EQ(2, counters.at("sock.msgs_sent"));
+  EXPECT_EQ(10, counters.at("sock.bytes_sent"));
+  EXPECT_EQ(1, counters.at("sock.send_eagain"));
+  EXPECT_EQ(0, counters.at("sock.write_wait_us.count"));
+
+  // Reset and disable
+  dealer.resetStats();
+  EXPECT_EQ(0, dealer.getStats()->numMsgsSent);
+  dealer.setStatsEnabled(false);
+  EXPECT_FALSE(dealer.getStats().hasValue());
+}
+
+TEST(Socket, FiberWaitStats) {
+  using namespace folly::fibers;
+
+  folly::EventBase evb;
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_CLIENT> client(
+      ctx, folly::none, folly::none, NonblockingFlag{true}, &evb);
+  fbzmq::Socket<ZMQ_PAIR, fbzmq::ZMQ_SERVER> server(
+      ctx, folly::none, folly::none, NonblockingFlag{true}, &evb);
+  server.bind(fbzmq::SocketUrl{"inproc://wait_stats"}).value();
+  client.connect(fbzmq::SocketUrl{"inproc://wait_stats"}).value();
+  server.setStatsEnabled(true);
+
+  auto fm = std::make_unique<FiberManager>(
+      std::make_unique<EventBaseLoopController>());
+  static_cast<EventBaseLoopController&>(fm->loopController())
+      .attachEventBase(evb);
+
+  // Receiver waits until sender sends after a delay
+  auto receiver = fm->addTaskFuture(
+      [&server]() { EXPECT_TRUE(server.recvOne().hasValue()); });
+  auto sender = fm->addTaskFuture([&client]() {
+    folly::fibers::Baton baton;
+    baton.try_wait_for(std::chrono::milliseconds(20));
+    client.sendOne(Message::from(std::string("x")).value());
+  });
+
+  evb.loop();
+  std::move(sender).get();
+  std::move(receiver).get();
+
+  auto stats = server.getStats().value();
+  EXPECT_EQ(1, stats.readWait.count);
+  EXPECT_LE(std::chrono::milliseconds(20), stats.readWait.max);
+  EXPECT_EQ(1, stats.numMsgsRecvd);
+  EXPECT_EQ(1, stats.numRecvEagain);
+}
+
 //
 // Crypto testing
 //
+TEST(Socket, Tracing) {
+  fbzmq::Context ctx;
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> dealer(ctx);
+  fbzmq::Socket<ZMQ_ROUTER, fbzmq::ZMQ_SERVER> router(ctx);
+  fbzmq::Socket<ZMQ_PUSH, fbzmq::ZMQ_CLIENT> push(ctx);
+  fbzmq::Socket<ZMQ_PULL, fbzmq::ZMQ_SERVER> pull(ctx);
+  router.bind(SocketUrl{"inproc://trace_router"}).value();
+  dealer.connect(SocketUrl{"inproc://trace_router"}).value();
+  pull.bind(SocketUrl{"inproc://trace_pull"}).value();
+  push.connect(SocketUrl{"inproc://trace_pull"}).value();
+
+  // All traces sampled, traces received on router are recorded
+  std::vector<TraceContext> traces;
+  SocketTraceOptions dealerOptions;
+  dealerOptions.sampleRate = 1.0;
+  dealer.setTraceOptions(std::move(dealerOptions));
+  SocketTraceOptions routerOptions;
+  routerOptions.onTrace = [&traces](
+                              TraceContext const& context,
+                              std::chrono::system_clock::time_point) {
+    traces.emplace_back(context);
+  };
+  EXPECT_FALSE(router.isTracingEnabled());
+  router.setTraceOptions(std::move(routerOptions));
+  router.setStatsEnabled(true);
+  EXPECT_TRUE(router.isTracingEnabled());
+  push.setTraceOptions(SocketTraceOptions());
+
+  // Trace frame is stripped, REQ style envelope remains in place
+  dealer
+      .sendMultiple(
+          Message(), Message::from(std::string("hello")).value())
+      .value();
+  auto msgs = router.recvMultiple().value();
+  ASSERT_EQ(3, msgs.size());
+  EXPECT_TRUE(msgs[1].empty());
+  EXPECT_EQ("hello", msgs[2].read<std::string>().value());
+  ASSERT_EQ(1, traces.size());
+  EXPECT_EQ(0, traces[0].hop);
+  EXPECT_TRUE(traces[0].isSampled);
+  EXPECT_EQ(traces[0].originTime, traces[0].sendTime);
+  ASSERT_TRUE(router.getLastTrace().hasValue());
+  EXPECT_EQ(traces[0].traceId, router.getLastTrace()->traceId);
+  auto stats = router.getStats().value();
+  EXPECT_EQ(4, stats.numMsgsRecvd); // including trace frame
+  EXPECT_EQ(1, stats.hopLatency.count);
+
+  // Forwarded as the next hop. Untraced peer receives trace frame as is.
+  push.continueTrace(router.getLastTrace().value());
+  push.sendOne(std::move(msgs[2])).value();
+  auto forwarded = pull.recvMultiple().value();
+  ASSERT_EQ(2, forwarded.size());
+  pull.setTraceOptions(SocketTraceOptions());
+  push.sendOne(Message::from(std::string("world")).value()).value();
+  EXPECT_EQ("world", pull.recvOne().value().read<std::string>().value());
+  EXPECT_FALSE(pull.hasMore());
+  auto const& next = pull.getLastTrace();
+  ASSERT_TRUE(next.hasValue());
+  EXPECT_NE(traces[0].traceId, next->traceId);
+  EXPECT_EQ(0, next->hop);
+  pull.setTraceOptions(folly::none);
+  push.continueTrace(traces[0]);
+  push.sendOne(Message::from(std::string("again")).value()).value();
+  forwarded = pull.recvMultiple().value();
+  ASSERT_EQ(2, forwarded.size());
+  EXPECT_EQ("again", forwarded[1].read<std::string>().value());
+
+  // Replies go after identity on router, untraced messages pass through
+  router
+      .sendMultiple(
+          std::move(msgs[0]),
+          Message(),
+          Message::from(std::string("world")).value())
+      .value();
+  auto reply = dealer.recvMultiple().value();
+  ASSERT_EQ(2, reply.size());
+  EXPECT_TRUE(reply[0].empty());
+  EXPECT_EQ("world", reply[1].read<std::string>().value());
+  EXPECT_TRUE(dealer.getLastTrace().hasValue());
+  dealer.setTraceOptions(folly::none);
+  dealer.sendOne(Message::from(std::string("plain")).value()).value();
+  msgs = router.recvMultiple().value();
+  ASSERT_EQ(2, msgs.size());
+  EXPECT_EQ("plain", msgs[1].read<std::string>().value());
+  EXPECT_FALSE(router.getLastTrace().hasValue());
+  EXPECT_EQ(1, traces.size());
+}
+
 TEST(CryptoSocket, NoCryptoKey) {
   fbzmq::Context ctx;
 
@@ -1288,6 +1899,88 @@ TEST(CryptoSocket, Dealer2Dealer) {
   client.delServerKey(fbzmq::SocketUrl{"inproc://server"});
 }
 
+//
+// Prepared key pair is shared by sockets instead of being converted per socket
+//
+TEST(CryptoSocket, PrepareKeyPair) {
+  fbzmq::Context ctx;
+
+  auto keyPair = fbzmq::util::genKeyPair();
+  EXPECT_EQ(nullptr, keyPair.curveKeys);
+  fbzmq::util::prepareKeyPair(keyPair).value();
+  ASSERT_NE(nullptr, keyPair.curveKeys);
+  auto const curveKeys = keyPair.curveKeys;
+
+  // No-op on prepared key pair
+  fbzmq::util::prepareKeyPair(keyPair).value();
+  EXPECT_EQ(curveKeys, keyPair.curveKeys);
+  EXPECT_EQ(
+      fbzmq::util::toCurvePublicKey(keyPair.publicKey).value(),
+      curveKeys->publicKey);
+
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client1{
+      ctx, fbzmq::IdentityString{"client1"}, keyPair};
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client2{
+      ctx, fbzmq::IdentityString{"client2"}, keyPair};
+  EXPECT_EQ(curveKeys, client1.getKeyPair()->curveKeys);
+  EXPECT_EQ(curveKeys, client2.getKeyPair()->curveKeys);
+
+  // Invalid keys are rejected
+  fbzmq::KeyPair badKeyPair{"private", "public"};
+  EXPECT_TRUE(fbzmq::util::prepareKeyPair(badKeyPair).hasError());
+  EXPECT_TRUE(fbzmq::util::toCurvePublicKey("public").hasError());
+  EXPECT_TRUE(client1
+                  .addServerKey(
+                      fbzmq::SocketUrl{"inproc://server"},
+                      fbzmq::PublicKey{std::string("public")})
+                  .hasError());
+}
+
+//
+// Connect to many encrypted servers at once
+//
+TEST(CryptoSocket, ConnectMany) {
+  fbzmq::Context ctx;
+
+  auto kpClient = fbzmq::util::genKeyPair();
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> client{
+      ctx, fbzmq::IdentityString{"client"}, kpClient};
+
+  const int kNumServers = 3;
+  std::vector<fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_SERVER>> servers;
+  std::vector<fbzmq::SocketUrl> urls;
+  for (int i = 0; i < kNumServers; ++i) {
+    auto kpServer = fbzmq::util::genKeyPair();
+    servers.emplace_back(
+        ctx, fbzmq::IdentityString{folly::sformat("server{}", i)}, kpServer);
+    urls.emplace_back(folly::sformat("inproc://server{}", i));
+    servers.back().bind(urls.back()).value();
+    client.addServerKey(urls.back(), fbzmq::PublicKey{kpServer.publicKey})
+        .value();
+  }
+
+  // Url without key fails, rest get connected
+  urls.emplace_back("inproc://unknown");
+  EXPECT_TRUE(client.connectMany(urls).hasError());
+
+  // Dealer round robins messages across all connected servers
+  for (int i = 0; i < kNumServers; ++i) {
+    client.sendOne(fbzmq::Message::from(i).value()).value();
+  }
+  std::set<int> rcvd;
+  for (auto& server : servers) {
+    auto msg = server.recvOne(3000ms).value();
+    rcvd.insert(msg.read<int>().value());
+  }
+  EXPECT_EQ(kNumServers, rcvd.size());
+
+  // Without crypto
+  fbzmq::Socket<ZMQ_DEALER, fbzmq::ZMQ_CLIENT> plainClient{ctx};
+  urls.pop_back();
+  EXPECT_TRUE(plainClient.connectMany(urls).hasValue());
+  EXPECT_TRUE(plainClient.connectMany({}).hasValue());
+}
+
 //
 // Publisher sends encrypted messages
 //
@@ -5,6 +5,12 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
 #include <fbzmq/service/monitor/SystemMetrics.h>
 #include <fbzmq/zmq/Zmq.h>
 #include <gflags/gflags.h>
@@ -32,6 +38,66 @@ TEST(SystemMetricsTest, MemoryStats) {
   EXPECT_GT(rssMem2.value(), rssMem1.value() + 100);
 }
 
+TEST(SystemMetricsTest, EventRates) {
+  SystemMetrics systemMetrics_{};
+
+  // first query only caches the counts
+  EXPECT_FALSE(systemMetrics_.getEventRates().hasValue());
+
+  // sleeping thread context switches voluntarily
+  for (int i = 0; i < 10; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  auto rates = systemMetrics_.getEventRates();
+  ASSERT_TRUE(rates.hasValue());
+  EXPECT_LT(0, rates->voluntaryCtxSwitches);
+  EXPECT_LE(0, rates->minorFaults);
+  EXPECT_LE(0, rates->majorFaults);
+  EXPECT_LE(0, rates->involuntaryCtxSwitches);
+}
+
+TEST(SystemMetricsTest, OpenFds) {
+  SystemMetrics systemMetrics_{};
+
+  auto numFds1 = systemMetrics_.getNumOpenFds();
+  ASSERT_TRUE(numFds1.hasValue());
+  EXPECT_LE(3, numFds1.value()); // stdin, stdout and stderr
+
+  const int fd = ::open("/dev/null", O_RDONLY);
+  ASSERT_LE(0, fd);
+  EXPECT_EQ(numFds1.value() + 1, systemMetrics_.getNumOpenFds().value());
+  ::close(fd);
+  EXPECT_EQ(numFds1.value(), systemMetrics_.getNumOpenFds().value());
+}
+
+TEST(SystemMetricsTest, ThreadCpuStats) {
+  SystemMetrics systemMetrics_{};
+
+  std::atomic<bool> isDone{false};
+  auto busyThread = std::make_unique<std::thread>([&isDone]() {
+    // name with spaces and parentheses
+    pthread_setname_np(pthread_self(), "busy (thread)");
+    while (not isDone.load()) {
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // first query only caches the CPU time
+  EXPECT_TRUE(systemMetrics_.getThreadCPUpercentage().empty());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  auto cpuPcts = systemMetrics_.getThreadCPUpercentage();
+  ASSERT_EQ(1, cpuPcts.count("busy (thread)"));
+  EXPECT_LT(50, cpuPcts.at("busy (thread)"));
+  EXPECT_GT(110, cpuPcts.at("busy (thread)"));
+
+  // exited thread is no longer reported
+  isDone = true;
+  busyThread->join();
+  cpuPcts = systemMetrics_.getThreadCPUpercentage();
+  EXPECT_EQ(0, cpuPcts.count("busy (thread)"));
+}
+
 } // namespace fbzmq
 
 int